@@ -0,0 +1,531 @@
+//--------------------------------------------------------------------------------------
+// File: bakefont.cpp
+//
+// Simple command-line tool for baking bitmap fonts to the .spritefont format read by
+// SpriteFont. It takes the same bitmap fonts and options as MakeSpriteFont and gives
+// the same glyph metrics, but needs no .NET and packs large character sets in a
+// fraction of the time. TrueType fonts still go through MakeSpriteFont.
+//
+// The command-line handling comes from xwbtool.cpp, Copyright (c) Microsoft
+// Corporation, under the MIT License in LICENSE. The rest is part of SnowScene's
+// additions to DirectXTK.
+//--------------------------------------------------------------------------------------
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NODRAWTEXT
+#define NOGDI
+#define NOBITMAP
+#define NOMCX
+#define NOSERVICE
+#define NOHELP
+#pragma warning(pop)
+
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include "MappedFile.h"
+#include "SpriteFontData.h"
+
+using namespace DirectX;
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+enum OPTIONS
+{
+    OPT_CHARACTERREGION = 1,
+    OPT_DEFAULTCHARACTER,
+    OPT_LINESPACING,
+    OPT_CHARACTERSPACING,
+    OPT_TEXTUREFORMAT,
+    OPT_NOPREMULTIPLY,
+    OPT_DEBUGSPRITESHEET,
+    OPT_FEATURELEVEL,
+    OPT_FASTPACK,
+    OPT_THREADS,
+    OPT_NOLOGO,
+    OPT_MAX
+};
+
+static_assert(OPT_MAX <= 32, "dwOptions is a DWORD bitfield");
+
+struct SValue
+{
+    LPCWSTR pName;
+    DWORD dwValue;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+// Same names as the MakeSpriteFont options
+const SValue g_pOptions [] =
+{
+    { L"CharacterRegion",           OPT_CHARACTERREGION },
+    { L"DefaultCharacter",          OPT_DEFAULTCHARACTER },
+    { L"LineSpacing",               OPT_LINESPACING },
+    { L"CharacterSpacing",          OPT_CHARACTERSPACING },
+    { L"TextureFormat",             OPT_TEXTUREFORMAT },
+    { L"NoPremultiply",             OPT_NOPREMULTIPLY },
+    { L"DebugOutputSpriteSheet",    OPT_DEBUGSPRITESHEET },
+    { L"FeatureLevel",              OPT_FEATURELEVEL },
+    { L"FastPack",                  OPT_FASTPACK },
+    { L"Threads",                   OPT_THREADS },
+    { L"nologo",                    OPT_NOLOGO },
+    { nullptr,                      0 }
+};
+
+const SValue g_pTextureFormats [] =
+{
+    { L"Auto",              SpriteFontData::TextureFormat_Auto },
+    { L"Rgba32",            SpriteFontData::TextureFormat_Rgba32 },
+    { L"Bgra4444",          SpriteFontData::TextureFormat_Bgra4444 },
+    { L"CompressedMono",    SpriteFontData::TextureFormat_CompressedMono },
+    { nullptr,              0 }
+};
+
+// Values are D3D_FEATURE_LEVEL
+const SValue g_pFeatureLevels [] =
+{
+    { L"FL9_1",     0x9100 },
+    { L"FL9_2",     0x9200 },
+    { L"FL9_3",     0x9300 },
+    { L"FL10_0",    0xa000 },
+    { L"FL10_1",    0xa100 },
+    { L"FL11_0",    0xb000 },
+    { L"FL11_1",    0xb100 },
+    { L"FL12_0",    0xc000 },
+    { L"FL12_1",    0xc100 },
+    { nullptr,      0 }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+#pragma prefast(disable : 26018, "Only used with static internal arrays")
+
+    // Returns false rather than 0 when not found, since TextureFormat_Auto is 0.
+    bool LookupByName(const wchar_t *pName, const SValue *pArray, DWORD& value)
+    {
+        while (pArray->pName)
+        {
+            if (!_wcsicmp(pName, pArray->pName))
+            {
+                value = pArray->dwValue;
+                return true;
+            }
+
+            pArray++;
+        }
+
+        return false;
+    }
+
+    void PrintList(const SValue *pValue)
+    {
+        for (; pValue->pName; ++pValue)
+            wprintf(L"%ls ", pValue->pName);
+
+        wprintf(L"\n");
+    }
+
+    void PrintLogo()
+    {
+        wprintf(L"SnowScene Sprite Font Baker\n");
+#ifdef _DEBUG
+        wprintf(L"*** Debug build ***\n");
+#endif
+        wprintf(L"\n");
+    }
+
+    void PrintUsage()
+    {
+        PrintLogo();
+
+        wprintf(L"Usage: bakefont <source.bmp> <output.spritefont> <options>\n");
+        wprintf(L"\n");
+        wprintf(L"   /CharacterRegion:<region>      characters of the glyphs, in order; may be given more\n");
+        wprintf(L"                                  than once (defaults to 0x20-0x7e)\n");
+        wprintf(L"   /DefaultCharacter:<char>       drawn for characters missing from the font\n");
+        wprintf(L"   /LineSpacing:<pixels>          added to the line spacing\n");
+        wprintf(L"   /CharacterSpacing:<pixels>     added to the advance of every glyph\n");
+        wprintf(L"   /TextureFormat:<format>        sprite sheet format (defaults to Auto)\n");
+        wprintf(L"   /NoPremultiply                 keep straight alpha\n");
+        wprintf(L"   /DebugOutputSpriteSheet:<bmp>  also save the sprite sheet as a .bmp file\n");
+        wprintf(L"   /FeatureLevel:<level>          warn if the sheet is too large for this level\n");
+        wprintf(L"                                  (defaults to FL9_1)\n");
+        wprintf(L"   /FastPack                      pack in a single pass\n");
+        wprintf(L"   /Threads:<count>               worker threads (defaults to one per CPU)\n");
+        wprintf(L"   /nologo                        suppress the banner\n");
+
+        wprintf(L"\n   <region>: A, A-Z, 32-126 or 0x20-0x7e");
+        wprintf(L"\n   <char>: A, 63 or 0x3f");
+        wprintf(L"\n   <format>: ");
+        PrintList(g_pTextureFormats);
+        wprintf(L"   <level>: ");
+        PrintList(g_pFeatureLevels);
+        wprintf(L"\n   The source must be a .bmp bitmap font. Convert .png and .gif fonts to .bmp\n");
+        wprintf(L"   first, and use MakeSpriteFont for TrueType fonts.\n");
+    }
+
+    // A single character stands for itself, anything else is a decimal or 0x hex
+    // code point, as MakeSpriteFont reads them.
+    bool ParseCharacter(const wchar_t* pValue, size_t length, uint32_t& character)
+    {
+        if (length == 1)
+        {
+            character = pValue[0];
+            return true;
+        }
+
+        wchar_t buffer[16] = {};
+        if (!length || length >= _countof(buffer))
+            return false;
+
+        wcsncpy_s(buffer, pValue, length);
+
+        int base = 10;
+        const wchar_t* digits = buffer;
+        if (buffer[0] == L'0' && (buffer[1] == L'x' || buffer[1] == L'X'))
+        {
+            base = 16;
+            digits += 2;
+        }
+
+        if (!*digits || *digits == L'-' || *digits == L'+')
+            return false;
+
+        wchar_t* end = nullptr;
+        unsigned long value = wcstoul(digits, &end, base);
+        if (*end || value > 0x10ffff)
+            return false;
+
+        character = uint32_t(value);
+        return true;
+    }
+
+    bool ParseCharacterRegion(const wchar_t* pValue, SpriteFontData::CharacterRegion& region)
+    {
+        size_t length = wcslen(pValue);
+
+        const wchar_t* dash = (length > 1) ? wcschr(pValue + 1, L'-') : nullptr;
+        if (!dash)
+        {
+            if (!ParseCharacter(pValue, length, region.first))
+                return false;
+
+            region.last = region.first;
+            return true;
+        }
+
+        return ParseCharacter(pValue, size_t(dash - pValue), region.first)
+            && ParseCharacter(dash + 1, wcslen(dash + 1), region.last)
+            && region.first <= region.last;
+    }
+
+    bool ParseFloat(const wchar_t* pValue, float& value)
+    {
+        wchar_t* end = nullptr;
+        value = float(wcstod(pValue, &end));
+        return *pValue && !*end;
+    }
+
+    bool WriteFile(const wchar_t* pszFilename, const std::vector<uint8_t>& fileData)
+    {
+        FILE* file = nullptr;
+        if (_wfopen_s(&file, pszFilename, L"wb") || !file)
+        {
+            wprintf(L"ERROR: Failed opening output file %ls\n", pszFilename);
+            return false;
+        }
+
+        size_t written = fwrite(fileData.data(), 1, fileData.size(), file);
+        if (fclose(file) || written != fileData.size())
+        {
+            wprintf(L"ERROR: Failed writing output file %ls\n", pszFilename);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Same limits as MakeSpriteFont warns about.
+    void PrintSizeWarning(uint32_t width, uint32_t height, DWORD featureLevel)
+    {
+        uint32_t size = std::max(width, height);
+
+        if (size > 16384)
+        {
+            wprintf(L"WARNING: Resulting texture is too large for all known Feature Levels (9.1 - 12.1)\n");
+        }
+        else if (size > 8192)
+        {
+            if (featureLevel < 0xb000)
+                wprintf(L"WARNING: Resulting texture requires a Feature Level 11.0 or later device.\n");
+        }
+        else if (size > 4096)
+        {
+            if (featureLevel < 0xa000)
+                wprintf(L"WARNING: Resulting texture requires a Feature Level 10.0 or later device.\n");
+        }
+        else if (size > 2048)
+        {
+            if (featureLevel < 0x9300)
+                wprintf(L"WARNING: Resulting texture requires a Feature Level 9.3 or later device.\n");
+        }
+    }
+
+    const wchar_t* GetFormatName(SpriteFontData::TextureFormat format)
+    {
+        for (const SValue* pValue = g_pTextureFormats; pValue->pName; ++pValue)
+        {
+            if (pValue->dwValue == DWORD(format))
+                return pValue->pName;
+        }
+
+        return L"?";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------
+// Entry-point
+//--------------------------------------------------------------------------------------
+#pragma prefast(disable : 28198, "Command-line tool, frees all memory on exit")
+
+int __cdecl wmain(_In_ int argc, _In_z_count_(argc) wchar_t* argv[])
+{
+    // Parameters and defaults
+    const wchar_t* szSource = nullptr;
+    const wchar_t* szOutput = nullptr;
+    const wchar_t* szSpriteSheet = nullptr;
+    DWORD dwFeatureLevel = 0x9100;
+    SpriteFontData::BakeOptions bakeOptions;
+
+    // Process command line
+    DWORD dwOptions = 0;
+
+    for (int iArg = 1; iArg < argc; iArg++)
+    {
+        PWSTR pArg = argv[iArg];
+
+        if (('-' == pArg[0]) || ('/' == pArg[0]))
+        {
+            pArg++;
+            PWSTR pValue;
+
+            for (pValue = pArg; *pValue && (':' != *pValue); pValue++);
+
+            if (*pValue)
+                *pValue++ = 0;
+
+            DWORD dwOption = 0;
+            LookupByName(pArg, g_pOptions, dwOption);
+
+            // Character regions add up, as they do in MakeSpriteFont
+            if (!dwOption || ((dwOptions & (1 << dwOption)) && dwOption != OPT_CHARACTERREGION))
+            {
+                PrintUsage();
+                return 1;
+            }
+
+            dwOptions |= 1 << dwOption;
+
+            // Handle options with additional value parameter
+            switch (dwOption)
+            {
+            case OPT_CHARACTERREGION:
+            case OPT_DEFAULTCHARACTER:
+            case OPT_LINESPACING:
+            case OPT_CHARACTERSPACING:
+            case OPT_TEXTUREFORMAT:
+            case OPT_DEBUGSPRITESHEET:
+            case OPT_FEATURELEVEL:
+            case OPT_THREADS:
+                if (!*pValue)
+                {
+                    if ((iArg + 1 >= argc))
+                    {
+                        PrintUsage();
+                        return 1;
+                    }
+
+                    iArg++;
+                    pValue = argv[iArg];
+                }
+                break;
+            }
+
+            bool valid = true;
+
+            switch (dwOption)
+            {
+            case OPT_CHARACTERREGION:
+                {
+                    SpriteFontData::CharacterRegion region;
+                    valid = ParseCharacterRegion(pValue, region);
+                    if (valid)
+                        bakeOptions.characterRegions.push_back(region);
+                }
+                break;
+
+            case OPT_DEFAULTCHARACTER:
+                valid = ParseCharacter(pValue, wcslen(pValue), bakeOptions.defaultCharacter);
+                break;
+
+            case OPT_LINESPACING:
+                valid = ParseFloat(pValue, bakeOptions.lineSpacing);
+                break;
+
+            case OPT_CHARACTERSPACING:
+                valid = ParseFloat(pValue, bakeOptions.characterSpacing);
+                break;
+
+            case OPT_TEXTUREFORMAT:
+                {
+                    DWORD dwFormat = 0;
+                    valid = LookupByName(pValue, g_pTextureFormats, dwFormat);
+                    bakeOptions.textureFormat = SpriteFontData::TextureFormat(dwFormat);
+                }
+                break;
+
+            case OPT_NOPREMULTIPLY:
+                bakeOptions.noPremultiply = true;
+                break;
+
+            case OPT_DEBUGSPRITESHEET:
+                szSpriteSheet = pValue;
+                break;
+
+            case OPT_FEATURELEVEL:
+                valid = LookupByName(pValue, g_pFeatureLevels, dwFeatureLevel);
+                break;
+
+            case OPT_FASTPACK:
+                bakeOptions.fastPack = true;
+                break;
+
+            case OPT_THREADS:
+                valid = swscanf_s(pValue, L"%Iu", &bakeOptions.threadCount) == 1 && bakeOptions.threadCount > 0;
+                break;
+            }
+
+            if (!valid)
+            {
+                wprintf(L"Invalid value specified with /%ls (%ls)\n", pArg, pValue);
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (!szSource)
+        {
+            szSource = pArg;
+        }
+        else if (!szOutput)
+        {
+            szOutput = pArg;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!szOutput)
+    {
+        wprintf(L"ERROR: Need a source font and an output file\n\n");
+        PrintUsage();
+        return 0;
+    }
+
+    if (~dwOptions & (1 << OPT_NOLOGO))
+        PrintLogo();
+
+    wchar_t ext[_MAX_EXT];
+    _wsplitpath_s(szSource, nullptr, 0, nullptr, 0, nullptr, 0, ext, _MAX_EXT);
+
+    if (_wcsicmp(ext, L".bmp") != 0)
+    {
+        wprintf(L"ERROR: Only .bmp bitmap fonts are supported; use MakeSpriteFont for %ls files\n", ext);
+        return 1;
+    }
+
+    wprintf(L"reading %ls\n", szSource);
+    fflush(stdout);
+
+    std::unique_ptr<SpriteFontData> font;
+    std::vector<uint8_t> fileData;
+    std::vector<uint8_t> sheetData;
+
+    try
+    {
+        uint32_t width, height;
+        std::vector<uint32_t> pixels;
+        {
+            MappedFile src;
+            src.Open(szSource);
+            SpriteFontData::ReadBMP(src.GetData(), src.GetSize(), width, height, pixels);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        font = SpriteFontData::BakeBitmap(pixels.data(), width, height, bakeOptions);
+
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        uint64_t sheetPixels = uint64_t(font->width) * font->height;
+
+        wprintf(L"baked %Iu glyphs in %.3f s\n", font->glyphs.size(), seconds);
+        wprintf(L"sprite sheet %ux%u (%hs), %.1f%% used\n", font->width, font->height, font->packer,
+                (sheetPixels > 0) ? 100.0 * double(font->usedPixels) / double(sheetPixels) : 0.0);
+
+        PrintSizeWarning(font->width, font->height, dwFeatureLevel);
+
+        font->Write(fileData);
+
+        if (szSpriteSheet)
+            font->WriteSheetBMP(sheetData);
+    }
+    catch (const std::exception& e)
+    {
+        wprintf(L"ERROR: Failed to bake font (%hs)\n", e.what());
+        return 1;
+    }
+
+    if (szSpriteSheet)
+    {
+        wprintf(L"writing %ls\n", szSpriteSheet);
+
+        if (!WriteFile(szSpriteSheet, sheetData))
+            return 1;
+    }
+
+    wprintf(L"writing %ls (%ls format, %Iu bytes)\n", szOutput, GetFormatName(font->textureFormat), fileData.size());
+    fflush(stdout);
+
+    if (!WriteFile(szOutput, fileData))
+        return 1;
+
+    return 0;
+}
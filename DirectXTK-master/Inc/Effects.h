@@ -746,6 +746,10 @@ namespace DirectX
         // Settings.
         void __cdecl ReleaseCache();
 
+        // Textures no longer used by any effect, including the cached ones, are released
+        // once they take more memory than this. Unlimited by default.
+        void __cdecl SetTextureCacheBudget( size_t bytes );
+
         void __cdecl SetSharing( bool enabled );
 
         void __cdecl EnableNormalMapEffect( bool enabled );
@@ -796,6 +800,10 @@ namespace DirectX
         // Settings.
         void __cdecl ReleaseCache();
 
+        // Textures no longer used by any effect, including the cached ones, are released
+        // once they take more memory than this. Unlimited by default.
+        void __cdecl SetTextureCacheBudget( size_t bytes );
+
         void __cdecl SetSharing( bool enabled );
 
         void __cdecl EnableForceSRGB( bool forceSRGB );
@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.h
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    // Read-only view of a whole file (a file mapping on Windows, mmap elsewhere). Pages
+    // are loaded on first touch and shared with the file cache, so nothing is copied
+    // and nothing is read that the caller does not look at.
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        MappedFile(MappedFile&& moveFrom);
+        MappedFile& operator= (MappedFile&& moveFrom);
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator= (MappedFile const&) = delete;
+
+        ~MappedFile();
+
+        // Throws std::system_error if the file cannot be opened or mapped, and
+        // std::length_error if it does not fit in the address space.
+        void Open(wchar_t const* fileName);
+        void Close();
+
+        // Null for an empty file.
+        uint8_t const* GetData() const { return mData; }
+        size_t GetSize() const { return mSize; }
+
+    private:
+        uint8_t const*  mData;
+        size_t          mSize;
+    };
+
+
+    // Sequential reads from a file of any size.
+    class FileStream
+    {
+    public:
+        FileStream();
+        FileStream(FileStream&& moveFrom);
+        FileStream& operator= (FileStream&& moveFrom);
+
+        FileStream(FileStream const&) = delete;
+        FileStream& operator= (FileStream const&) = delete;
+
+        ~FileStream();
+
+        // Throws std::system_error if the file cannot be opened.
+        void Open(wchar_t const* fileName);
+        void Close();
+
+        bool IsOpen() const { return mHandle != -1; }
+
+        uint64_t GetSize() const { return mSize; }
+
+        // Reads up to byteCount bytes and returns how many were read, which is only
+        // zero at the end of the file. Throws std::system_error on a read error.
+        size_t Read(void* buffer, size_t byteCount);
+
+    private:
+        intptr_t        mHandle;    // HANDLE on Windows, a file descriptor elsewhere
+        uint64_t        mSize;
+    };
+}
@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// File: MeshOptimizer.h
+//
+// Reorders indexed triangle lists for the post-transform vertex cache, overdraw and
+// vertex fetch, and welds duplicate vertices
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    // Vertex cache size the face ordering targets. The cache is modelled as a FIFO,
+    // which matches most hardware closely enough; 16 entries is a conservative size
+    // that orderings for larger caches do not lose much on.
+    const size_t OPTIMIZE_DEFAULT_CACHE_SIZE = 16;
+
+    // The overdraw ordering may raise the average cache miss ratio by this factor.
+    const float OPTIMIZE_DEFAULT_OVERDRAW_THRESHOLD = 1.05f;
+
+    // All functions take triangle lists and throw std::out_of_range for an index that
+    // is not below nVerts. Vertices are opaque blocks of vertexStride bytes, except that
+    // OptimizeOverdraw reads an XMFLOAT3 position from the start of each vertex.
+
+    // Simulates a FIFO vertex cache of cacheSize entries. ACMR is the average number of
+    // cache misses per triangle (0.5 is ideal for a large regular mesh, 3 the worst);
+    // ATVR is the number of misses per referenced vertex (1 is ideal).
+    void ComputeVertexCacheMissRate(const uint16_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize, float& acmr, float& atvr);
+    void ComputeVertexCacheMissRate(const uint32_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize, float& acmr, float& atvr);
+
+    // Reorders the triangles for vertex cache reuse (Tipsify, Sander et al. 2007). The
+    // triangles and their winding are unchanged, and so is the order if it already
+    // misses no more often than the new one would.
+    void OptimizeFaces(uint16_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize = OPTIMIZE_DEFAULT_CACHE_SIZE);
+    void OptimizeFaces(uint32_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize = OPTIMIZE_DEFAULT_CACHE_SIZE);
+
+    // Run after OptimizeFaces: splits the triangles into clusters, mostly where the
+    // cache restarts anyway, and draws the clusters that face away from the mesh center
+    // first so they tend to occlude the rest. The new order is only kept if the miss
+    // ratio stays within threshold times the original.
+    void OptimizeOverdraw(uint16_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                          size_t cacheSize = OPTIMIZE_DEFAULT_CACHE_SIZE, float threshold = OPTIMIZE_DEFAULT_OVERDRAW_THRESHOLD);
+    void OptimizeOverdraw(uint32_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                          size_t cacheSize = OPTIMIZE_DEFAULT_CACHE_SIZE, float threshold = OPTIMIZE_DEFAULT_OVERDRAW_THRESHOLD);
+
+    // Renumbers the vertices in the order the indices first use them and moves them to
+    // match, so vertex fetch walks memory forwards. Unreferenced vertices are dropped;
+    // returns how many vertices remain at the front of the buffer.
+    size_t OptimizeVertices(uint16_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts);
+    size_t OptimizeVertices(uint32_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts);
+
+    // Merges vertices that are identical byte for byte, keeping the first of each set.
+    // Returns how many vertices remain at the front of the buffer.
+    size_t WeldVertices(uint16_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts);
+    size_t WeldVertices(uint32_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts);
+
+    // All of the above in order, for a vertex type that starts with its position and
+    // uint16_t or uint32_t indices.
+    template<typename TVertex, typename TIndex>
+    void OptimizeMesh(std::vector<TVertex>& vertices, std::vector<TIndex>& indices, size_t cacheSize = OPTIMIZE_DEFAULT_CACHE_SIZE)
+    {
+        size_t nVerts = WeldVertices(indices.data(), indices.size(), vertices.data(), sizeof(TVertex), vertices.size());
+
+        size_t nFaces = indices.size() / 3;
+        OptimizeFaces(indices.data(), nFaces, nVerts, cacheSize);
+        OptimizeOverdraw(indices.data(), nFaces, vertices.data(), sizeof(TVertex), nVerts, cacheSize);
+
+        nVerts = OptimizeVertices(indices.data(), indices.size(), vertices.data(), sizeof(TVertex), nVerts);
+        vertices.erase(vertices.begin() + nVerts, vertices.end());
+    }
+}
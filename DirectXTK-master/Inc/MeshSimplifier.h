@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// File: MeshSimplifier.h
+//
+// Reduces the triangle count of indexed triangle lists by quadric-error edge collapse,
+// for building level of detail chains
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    // Collapses edges, cheapest first by quadric error (Garland & Heckbert 1997), until
+    // at most targetFaces triangles remain or the next collapse would move the surface
+    // further than maxError, in position units. Vertices are never moved or added: each
+    // collapse merges a vertex into a neighbour, so the result still indexes the
+    // original vertex buffer and can share it with the full-detail mesh.
+    //
+    // Vertices are opaque blocks of vertexStride bytes starting with an XMFLOAT3
+    // position. Vertices at the same position are treated as one point of the surface,
+    // so open borders only collapse along themselves and attribute seams (texture
+    // seams, hard edges) only along the seam, and neither opens gaps.
+    //
+    // Writes the remaining triangles to destIndices, which has room for nFaces
+    // triangles and may be the same array as indices, and returns how many remain.
+    // resultError receives the estimated distance of the farthest collapse made.
+    // Throws std::out_of_range for an index that is not below nVerts.
+    size_t SimplifyMesh(const uint16_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                        size_t targetFaces, float maxError, uint16_t* destIndices, float* resultError = nullptr);
+    size_t SimplifyMesh(const uint32_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                        size_t targetFaces, float maxError, uint32_t* destIndices, float* resultError = nullptr);
+}
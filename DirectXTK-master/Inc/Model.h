@@ -38,6 +38,9 @@ namespace DirectX
     class IEffect;
     class IEffectFactory;
     class CommonStates;
+    class ModelAnimation;
+    class ModelData;
+    class ModelHierarchy;
     class ModelMesh;
 
     //----------------------------------------------------------------------------------
@@ -89,15 +92,27 @@ namespace DirectX
         std::wstring                name;
         bool                        ccw;
         bool                        pmalpha;
+        std::shared_ptr<ModelAnimation> animation;  // skeleton and clips, if the mesh has bones
+
+        // Coarser levels of detail (see ModelData::GenerateLODs), each with a part for every
+        // one of meshParts sharing its buffers and effect, and how far each strays from the
+        // full mesh in model units. Replacing an effect in meshParts does not change these.
+        std::vector<ModelMeshPart::Collection> lodParts;
+        std::vector<float>          lodErrors;
 
         typedef std::vector<std::shared_ptr<ModelMesh>> Collection;
 
         // Setup states for drawing mesh
         void __cdecl PrepareForRendering( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states, bool alpha = false, bool wireframe = false ) const;
 
-        // Draw the mesh
+        // Coarsest level of detail whose error covers at most screenError of the viewport
+        // height when drawn with these matrices; 0 (meshParts) if there are no levels or
+        // the camera is inside the bounding sphere.
+        size_t XM_CALLCONV SelectLOD( FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection, float screenError ) const;
+
+        // Draw the mesh, at a level of detail from SelectLOD
         void XM_CALLCONV Draw( _In_ ID3D11DeviceContext* deviceContext, FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection,
-                               bool alpha = false, _In_opt_ std::function<void __cdecl()> setCustomState = nullptr ) const;
+                               bool alpha = false, _In_opt_ std::function<void __cdecl()> setCustomState = nullptr, size_t lod = 0 ) const;
     };
 
 
@@ -106,12 +121,20 @@ namespace DirectX
     class Model
     {
     public:
+        Model();
         virtual ~Model();
 
         ModelMesh::Collection   meshes;
         std::wstring            name;
 
-        // Draw all the meshes in the model
+        // Screen error Draw picks each mesh's level of detail by (see ModelMesh::SelectLOD),
+        // as a fraction of the viewport height: about a pixel at 1080 lines by default, 0
+        // always draws full detail.
+        float                   lodScreenError;
+
+        std::shared_ptr<ModelHierarchy> hierarchy;  // frame tree and animation of a .SDKMESH model
+
+        // Draw all the meshes in the model, each at the level of detail lodScreenError selects
         void XM_CALLCONV Draw( _In_ ID3D11DeviceContext* deviceContext, const CommonStates& states, FXMMATRIX world, CXMMATRIX view, CXMMATRIX projection,
                                bool wireframe = false, _In_opt_ std::function<void __cdecl()> setCustomState = nullptr ) const;
 
@@ -127,6 +150,16 @@ namespace DirectX
         static std::unique_ptr<Model> __cdecl CreateFromCMO( _In_ ID3D11Device* d3dDevice, _In_z_ const wchar_t* szFileName,
                                                              _In_ IEffectFactory& fxFactory, bool ccw = true, bool pmalpha = false );
 
+        // Loads a model from a .PMDL file written by PackModel
+        static std::unique_ptr<Model> __cdecl CreateFromPacked( _In_ ID3D11Device* d3dDevice, _In_reads_bytes_(dataSize) const uint8_t* meshData, size_t dataSize,
+                                                                _In_ IEffectFactory& fxFactory, bool ccw = true, bool pmalpha = false );
+        static std::unique_ptr<Model> __cdecl CreateFromPacked( _In_ ID3D11Device* d3dDevice, _In_z_ const wchar_t* szFileName,
+                                                                _In_ IEffectFactory& fxFactory, bool ccw = true, bool pmalpha = false );
+
+        // Creates the device resources for a model parsed by ModelData (e.g. ModelData::ParseCMO)
+        static std::unique_ptr<Model> __cdecl CreateFromModelData( _In_ ID3D11Device* d3dDevice, const ModelData& modelData,
+                                                                   _In_ IEffectFactory& fxFactory, bool ccw = true, bool pmalpha = false );
+
         // Loads a model from a DirectX SDK .SDKMESH file
         static std::unique_ptr<Model> __cdecl CreateFromSDKMESH( _In_ ID3D11Device* d3dDevice, _In_reads_bytes_(dataSize) const uint8_t* meshData, _In_ size_t dataSize,
                                                                  _In_ IEffectFactory& fxFactory, bool ccw = false, bool pmalpha = false );
@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------------------
+// File: ModelAnimation.h
+//
+// Skeleton and keyframe animation clips of a skinned mesh, with a CPU evaluator that
+// produces bone palettes for IEffectSkinning::SetBoneTransforms
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    class ModelData;
+
+    //----------------------------------------------------------------------------------
+    // Keys are split per bone into tracks sorted by time, and each key is stored
+    // decomposed (scale, rotation quaternion, translation) in separate arrays, so
+    // sampling a bone binary searches a short run of floats and touches only the two
+    // keys it blends. The object is immutable once built, so any number of threads can
+    // evaluate it at once.
+    class ModelAnimation
+    {
+    public:
+        ModelAnimation(ModelAnimation const&) = delete;
+        ModelAnimation& operator= (ModelAnimation const&) = delete;
+
+        virtual ~ModelAnimation();
+
+        // Builds the skeleton and clips of one mesh of a parsed model; returns null if
+        // the mesh has no bones. Throws std::runtime_error for malformed keys.
+        static std::unique_ptr<ModelAnimation> CreateFromModelData(const ModelData& modelData, size_t meshIndex);
+
+        size_t GetBoneCount() const { return mParents.size(); }
+        const std::wstring& GetBoneName(size_t bone) const { return mBoneNames[bone]; }
+        int32_t GetBoneParent(size_t bone) const { return mParents[bone]; }
+
+        // Returns -1 if there is no bone or clip with that name.
+        int32_t FindBone(const wchar_t* name) const;
+        int32_t FindClip(const wchar_t* name) const;
+
+        size_t GetClipCount() const { return mClips.size(); }
+        const std::wstring& GetClipName(size_t clip) const { return mClips[clip].name; }
+        float GetClipStartTime(size_t clip) const { return mClips[clip].startTime; }
+        float GetClipEndTime(size_t clip) const { return mClips[clip].endTime; }
+
+        // Samples a clip and writes GetBoneCount() skinning matrices (inverse bind pose
+        // times animated world transform) to boneTransforms. With loop set, times
+        // outside the clip wrap around; otherwise they are clamped to it. Bones without
+        // keys in the clip keep their bind pose local transform.
+        void Evaluate(size_t clip, float time, bool loop, XMMATRIX* boneTransforms) const;
+
+        // Same, but writes the animated world transform of each bone (for attachments).
+        void EvaluateWorld(size_t clip, float time, bool loop, XMMATRIX* boneWorld) const;
+
+    private:
+        ModelAnimation();
+
+        struct ClipInfo
+        {
+            std::wstring    name;
+            float           startTime;
+            float           endTime;
+            size_t          firstTrack;     // one track per bone
+        };
+
+        struct Track
+        {
+            uint32_t        firstKey;
+            uint32_t        keyCount;
+        };
+
+        float ClipTime(const ClipInfo& clip, float time, bool loop) const;
+        XMMATRIX SampleTrack(const Track& track, size_t bone, float time) const;
+
+        // Skeleton; mOrder lists the bones with every parent before its children.
+        std::vector<std::wstring>   mBoneNames;
+        std::vector<int32_t>        mParents;
+        std::vector<uint32_t>       mOrder;
+        std::vector<XMFLOAT4X4>     mInvBindPose;
+        std::vector<XMFLOAT4X4>     mBindLocal;
+
+        // Clips and their keys, track by track.
+        std::vector<ClipInfo>       mClips;
+        std::vector<Track>          mTracks;
+        std::vector<float>          mKeyTimes;
+        std::vector<XMFLOAT3>       mKeyScales;
+        std::vector<XMFLOAT4>       mKeyRotations;
+        std::vector<XMFLOAT3>       mKeyTranslations;
+    };
+}
@@ -0,0 +1,278 @@
+//--------------------------------------------------------------------------------------
+// File: ModelData.h
+//
+// Device-independent model description produced by the CPU stage of the model loaders
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    //----------------------------------------------------------------------------------
+    // Flat description of a model: vertex and index blobs, submeshes, materials, bones,
+    // animation clips and extents. Nothing here needs a Direct3D device, so a model can
+    // be parsed on any thread (or platform) and handed to Model::CreateFromModelData.
+    //
+    // A blob is a byte range either in the source data it was parsed from, when the data
+    // can be used as is, or in storage owned by the ModelData, when the parser had to
+    // rewrite it. Blobs are stored as offsets, so if the source data is moved only
+    // SetSource needs to be called again. Data referenced in place is not necessarily
+    // aligned; owned blobs start on 16-byte boundaries of the owned storage.
+    class ModelData
+    {
+    public:
+        enum BlobLocation : uint32_t
+        {
+            BlobLocation_Source = 0,
+            BlobLocation_Owned,
+        };
+
+        struct Blob
+        {
+            BlobLocation    location;
+            size_t          offset;
+            size_t          size;
+        };
+
+        enum VertexFormat : uint32_t
+        {
+            // VertexPositionNormalTangentColorTexture (52 bytes)
+            VertexFormat_PositionNormalTangentColorTexture = 0,
+
+            // VertexPositionNormalTangentColorTextureSkinning (60 bytes)
+            VertexFormat_PositionNormalTangentColorTextureSkinning,
+        };
+
+        struct VertexBuffer
+        {
+            Blob            data;
+            VertexFormat    format;
+            uint32_t        stride;
+            uint32_t        vertexCount;
+        };
+
+        struct IndexBuffer
+        {
+            Blob            data;
+            uint32_t        indexSize;      // 2 or 4 bytes
+            uint32_t        indexCount;
+        };
+
+        static const uint32_t MaxTextures = 8;
+
+        struct Material
+        {
+            std::wstring    name;
+            std::wstring    pixelShader;
+            std::wstring    texture[MaxTextures];
+            XMFLOAT4        ambient;
+            XMFLOAT4        diffuse;
+            XMFLOAT4        specular;
+            XMFLOAT4        emissive;
+            float           specularPower;
+            XMFLOAT4X4      uvTransform;
+        };
+
+        // Material and buffer indices are relative to the owning mesh.
+        struct SubMesh
+        {
+            uint32_t        materialIndex;
+            uint32_t        indexBufferIndex;
+            uint32_t        vertexBufferIndex;
+            uint32_t        startIndex;
+            uint32_t        indexCount;
+        };
+
+        struct Bone
+        {
+            std::wstring    name;
+            int32_t         parentIndex;    // relative to the owning mesh, -1 for a root
+            XMFLOAT4X4      invBindPos;
+            XMFLOAT4X4      bindPos;
+            XMFLOAT4X4      localTransform;
+        };
+
+        // Layout of the keyframes a clip's keys blob points at.
+        struct Keyframe
+        {
+            uint32_t        boneIndex;
+            float           time;
+            XMFLOAT4X4      transform;
+        };
+
+        struct Clip
+        {
+            std::wstring    name;
+            float           startTime;
+            float           endTime;
+            Blob            keys;
+            uint32_t        keyCount;
+        };
+
+        // A coarser version of a mesh (see GenerateLODs): lodSubMeshes from firstSubMesh
+        // on hold one submesh for each of the mesh's submeshes, in the same order, drawing
+        // fewer triangles from the same vertex buffers.
+        struct LevelOfDetail
+        {
+            uint32_t        firstSubMesh;
+            float           error;          // farthest the surface moved, in mesh units
+        };
+
+        // Each mesh owns a contiguous range of every array below.
+        struct Mesh
+        {
+            std::wstring    name;
+            uint32_t        firstMaterial;
+            uint32_t        materialCount;
+            uint32_t        firstSubMesh;
+            uint32_t        subMeshCount;
+            uint32_t        firstVertexBuffer;
+            uint32_t        vertexBufferCount;
+            uint32_t        firstIndexBuffer;
+            uint32_t        indexBufferCount;
+            uint32_t        firstBone;
+            uint32_t        boneCount;
+            uint32_t        firstClip;
+            uint32_t        clipCount;
+            uint32_t        firstLOD;
+            uint32_t        lodCount;       // coarser levels, not counting the mesh itself
+            bool            skinning;
+            XMFLOAT3        center;
+            float           radius;
+            XMFLOAT3        boxMin;
+            XMFLOAT3        boxMax;
+        };
+
+        enum ParseFlags : uint32_t
+        {
+            ParseFlags_None = 0x0,
+
+            // Apply each material's UV transform to the texture coordinates of the
+            // vertices it is used with, for effects that cannot apply it themselves.
+            ParseFlags_BakeUVTransform = 0x1,
+
+            // Reorder triangles and vertices for the vertex cache and vertex fetch, as
+            // Optimize does.
+            ParseFlags_OptimizeMeshes = 0x2,
+
+            // Build a chain of coarser levels of detail with the defaults of GenerateLODs.
+            ParseFlags_GenerateLODs = 0x4,
+        };
+
+        ModelData();
+        ModelData(ModelData&& moveFrom);
+        ModelData& operator= (ModelData&& moveFrom);
+
+        ModelData(ModelData const&) = delete;
+        ModelData& operator= (ModelData const&) = delete;
+
+        virtual ~ModelData();
+
+        std::vector<Mesh>           meshes;
+        std::vector<Material>       materials;
+        std::vector<SubMesh>        subMeshes;
+        std::vector<VertexBuffer>   vertexBuffers;
+        std::vector<IndexBuffer>    indexBuffers;
+        std::vector<Bone>           bones;
+        std::vector<Clip>           clips;
+        std::vector<LevelOfDetail>  lods;
+        std::vector<SubMesh>        lodSubMeshes;
+        bool                        uvTransformBaked;
+
+        // Points blobs in BlobLocation_Source at a new copy of the source data.
+        void SetSource(const uint8_t* sourceData, size_t sourceSize);
+
+        const uint8_t* GetSource() const { return mSource; }
+        size_t GetSourceSize() const { return mSourceSize; }
+
+        // Start of a blob's bytes.
+        const uint8_t* GetData(const Blob& blob) const;
+
+        // Bytes held by the ModelData itself rather than referenced in place.
+        size_t GetOwnedSize() const { return mOwned.size(); }
+
+        // Copies data into owned storage, or reserves zeroed space for it if data is null.
+        Blob AddOwned(const void* data, size_t size);
+        uint8_t* GetOwnedData(const Blob& blob);
+
+        // Applies each material's UV transform to the texture coordinates of the vertices
+        // it is used with, as ParseFlags_BakeUVTransform does. Vertex buffers that need it
+        // are copied to owned storage first.
+        void BakeUVTransforms();
+
+        // Reorders the triangles of each submesh for the post-transform vertex cache and
+        // overdraw, then the vertices of each vertex buffer into the order they are first
+        // used (see MeshOptimizer.h). Submeshes stay in place and keep their index ranges.
+        // Vertex buffers shared by index buffers that are also drawn with another vertex
+        // buffer keep their order, as do submeshes overlapping others in an index buffer.
+        // Buffers that change are copied to owned storage first.
+        void Optimize();
+
+        // Builds up to maxLevels coarser levels of detail for each mesh by edge collapse
+        // (see MeshSimplifier.h), each level keeping about reduction of the triangles of
+        // the one before and simplified from it, so the chain is consistent. maxError
+        // bounds how far a level may stray from the full mesh, relative to the mesh
+        // radius. The chain ends early when a level no longer gets meaningfully smaller.
+        // Level indices are appended to the index buffers, which are copied to owned
+        // storage first; the file writers keep them but cannot describe the levels, so
+        // generate them after writing.
+        void GenerateLODs(size_t maxLevels = 4, float reduction = 0.5f, float maxError = 0.05f);
+
+        // CPU stage of Model::CreateFromCMO; throws std::runtime_error for malformed data.
+        // Vertex and index data is referenced in place unless skinning streams have to
+        // be merged, UV transforms baked or meshes optimized.
+        static std::unique_ptr<ModelData> ParseCMO(const uint8_t* meshData, size_t dataSize, uint32_t flags = ParseFlags_None);
+
+        // CPU stage of Model::CreateFromPacked; throws std::runtime_error for malformed
+        // data. Vertices are expanded to the VertexFormat they were packed from in owned
+        // storage; index and keyframe data is referenced in place.
+        static std::unique_ptr<ModelData> ParsePacked(const uint8_t* meshData, size_t dataSize, uint32_t flags = ParseFlags_None);
+
+        // Imports a Wavefront .OBJ file and, optionally, the .MTL library it names; throws
+        // std::runtime_error for malformed data. Large files are parsed on several threads.
+        // The result matches what the Visual Studio content pipeline makes of the same
+        // file as a .cmo: one mesh, with each distinct position/texcoord/normal combination
+        // a vertex in the order first used, polygons fanned into counter-clockwise
+        // triangles, a submesh per usemtl run and a "default" material first. Missing
+        // normals are smoothed and tangents computed. All data is owned.
+        static std::unique_ptr<ModelData> ParseOBJ(const uint8_t* objData, size_t objSize,
+                                                   const uint8_t* mtlData = nullptr, size_t mtlSize = 0,
+                                                   uint32_t flags = ParseFlags_None);
+
+        // File name given by the first mtllib statement of an .OBJ file, or empty.
+        static std::wstring GetOBJMaterialLibrary(const uint8_t* objData, size_t objSize);
+
+        // Writes the model as a .PMDL file (see PackedModel.h), quantizing the vertices
+        // and narrowing index buffers to 16 bits where they fit. Triangles are expected
+        // to be counter-clockwise, as ParseCMO returns them.
+        void WritePacked(std::vector<uint8_t>& fileData) const;
+
+        // Writes the model as a .CMO file, the inverse of ParseCMO: skinned vertices are
+        // split back into a skinning stream, and UV transforms that were baked are written
+        // as identity. Throws std::runtime_error if an index buffer does not fit in 16 bits.
+        void WriteCMO(std::vector<uint8_t>& fileData) const;
+
+        // Writes the model as a .VBO file (see Model::CreateFromVBO), which only holds
+        // position, normal and texture coordinate for a single 16-bit indexed buffer.
+        // Triangles are flipped to the clockwise winding CreateFromVBO defaults to.
+        // Throws std::runtime_error for models with more than one mesh, vertex buffer or
+        // index buffer, or more than 65536 vertices.
+        void WriteVBO(std::vector<uint8_t>& fileData) const;
+
+    private:
+        const uint8_t*          mSource;
+        size_t                  mSourceSize;
+        std::vector<uint8_t>    mOwned;
+    };
+}
@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------------------
+// File: ModelHierarchy.h
+//
+// Frame hierarchy and keyframe animation of a DirectX SDK .SDKMESH model, with a CPU
+// evaluator that produces frame world matrices and per-mesh bone palettes
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    //----------------------------------------------------------------------------------
+    // .SDKMESH_ANIM files store one key per frame per tick at a fixed rate, so keys are
+    // kept in tick-major rows with the animated frames packed four to a group, one
+    // component per vector (x0 x1 x2 x3, y0 y1 y2 y3, ...). Sampling a tick blends two
+    // rows and builds four local matrices per group with vector math, then a single
+    // pass over frames sorted parents first composes the hierarchy. The object is
+    // immutable once built, so any number of threads can evaluate it at once.
+    class ModelHierarchy
+    {
+    public:
+        ModelHierarchy(ModelHierarchy const&) = delete;
+        ModelHierarchy& operator= (ModelHierarchy const&) = delete;
+
+        virtual ~ModelHierarchy();
+
+        // Reads the frames and mesh frame influences of a .SDKMESH file. Throws
+        // std::runtime_error for malformed data.
+        static std::unique_ptr<ModelHierarchy> CreateFromSDKMESH(const uint8_t* meshData, size_t dataSize);
+
+        // Attaches the keys of a .SDKMESH_ANIM file, replacing any loaded before. Keys
+        // are matched to frames by name; frames without keys keep their bind pose.
+        // Throws std::runtime_error for malformed data.
+        void LoadAnimation(const uint8_t* animData, size_t dataSize);
+
+        size_t GetFrameCount() const { return mParents.size(); }
+        const std::wstring& GetFrameName(size_t frame) const { return mFrameNames[frame]; }
+        int32_t GetFrameParent(size_t frame) const { return mParents[frame]; }
+        int32_t GetFrameMesh(size_t frame) const { return mFrameMeshes[frame]; }
+
+        // Returns -1 if there is no frame with that name.
+        int32_t FindFrame(const wchar_t* name) const;
+
+        // Bones of a mesh are the frames it lists as influences, in palette order.
+        size_t GetMeshCount() const { return mMeshInfluences.size(); }
+        size_t GetInfluenceCount(size_t mesh) const { return mMeshInfluences[mesh].count; }
+        uint32_t GetInfluenceFrame(size_t mesh, size_t influence) const { return mInfluences[mMeshInfluences[mesh].first + influence]; }
+
+        bool HasAnimation() const { return mKeyCount > 0; }
+        size_t GetAnimatedFrameCount() const { return mAnimatedFrames.size(); }
+
+        // Playback length in seconds. Like DXUT, tick 0 holds the reference pose and is
+        // skipped, so playback runs from tick 1 to the last tick.
+        float GetAnimationDuration() const;
+
+        // Writes GetFrameCount() world matrices (relative to the model) for the
+        // animation at time. With loop set, times past the end wrap around; otherwise
+        // they are clamped. Without animation this is the bind pose.
+        void EvaluateWorld(float time, bool loop, XMMATRIX* frameWorld) const;
+
+        // Writes GetInfluenceCount(mesh) skinning matrices (inverse bind pose world
+        // times animated world) for IEffectSkinning::SetBoneTransforms, from the
+        // output of EvaluateWorld.
+        void GetBonePalette(size_t mesh, const XMMATRIX* frameWorld, XMMATRIX* boneTransforms) const;
+
+    private:
+        ModelHierarchy();
+
+        struct Range
+        {
+            uint32_t        first;
+            uint32_t        count;
+        };
+
+        // Frames; mOrder lists them with every parent before its children.
+        std::vector<std::wstring>   mFrameNames;
+        std::vector<int32_t>        mParents;
+        std::vector<int32_t>        mFrameMeshes;
+        std::vector<uint32_t>       mOrder;
+        std::vector<XMFLOAT4X4>     mBindLocal;
+        std::vector<XMFLOAT4X4>     mInvBindWorld;
+
+        // Frame influences of each mesh.
+        std::vector<Range>          mMeshInfluences;
+        std::vector<uint32_t>       mInfluences;
+
+        // Animation. Each tick row holds one KeyGroup per four animated frames, and
+        // mAnimatedFrames maps group lanes back to frames. Scaling keys are ignored, as
+        // they are by DXUT.
+        struct KeyGroup
+        {
+            XMFLOAT4        rotation[4];    // x, y, z and w of four quaternions
+            XMFLOAT4        translation[3]; // x, y and z of four translations
+        };
+
+        uint32_t                    mKeyCount;
+        float                       mKeysPerSecond;
+        std::vector<uint32_t>       mAnimatedFrames;
+        std::vector<uint32_t>       mStaticFrames;
+        std::vector<KeyGroup>       mKeys;
+    };
+}
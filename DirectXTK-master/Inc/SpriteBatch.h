@@ -24,6 +24,8 @@
 #include <functional>
 #include <memory>
 
+#include <stdint.h>
+
 
 namespace DirectX
 {
@@ -45,6 +47,9 @@ namespace DirectX
         SpriteEffects_FlipBoth = SpriteEffects_FlipHorizontally | SpriteEffects_FlipVertically,
     };
 
+
+    class SpriteLayer;
+
     
     class SpriteBatch
     {
@@ -77,6 +82,9 @@ namespace DirectX
         void XM_CALLCONV Draw(_In_ ID3D11ShaderResourceView* texture, RECT const& destinationRectangle, FXMVECTOR color = Colors::White);
         void XM_CALLCONV Draw(_In_ ID3D11ShaderResourceView* texture, RECT const& destinationRectangle, _In_opt_ RECT const* sourceRectangle, FXMVECTOR color = Colors::White, float rotation = 0, XMFLOAT2 const& origin = Float2Zero, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
 
+        // Draw a retained layer with the state from Begin. Sprites queued before it are drawn first.
+        void __cdecl Draw(SpriteLayer& layer);
+
         // Rotation mode to be applied to the sprite transformation
         void __cdecl SetRotation( DXGI_MODE_ROTATION mode );
         DXGI_MODE_ROTATION __cdecl GetRotation() const;
@@ -92,5 +100,60 @@ namespace DirectX
 
         static const XMMATRIX MatrixIdentity;
         static const XMFLOAT2 Float2Zero;
+
+        friend class SpriteLayer;
+    };
+
+
+    // Sprites kept from frame to frame, with their vertices held on the GPU. Only the sprites
+    // changed since the last draw are turned into vertices again, and only the changed parts of
+    // the buffers are uploaded, so a layer that did not change costs a few draw calls.
+    class SpriteLayer
+    {
+    public:
+        // Identifies a sprite in the layer until it is removed. Zero is never a valid handle.
+        typedef uint64_t Handle;
+
+        // Texture, BackToFront and FrontToBack keep that order as sprites change, drawing sprites
+        // that tie in the order they were added. Deferred draws in the order they were added.
+        explicit SpriteLayer(SpriteSortMode sortMode = SpriteSortMode_Deferred);
+        SpriteLayer(SpriteLayer&& moveFrom);
+        SpriteLayer& operator= (SpriteLayer&& moveFrom);
+
+        SpriteLayer(SpriteLayer const&) = delete;
+        SpriteLayer& operator= (SpriteLayer const&) = delete;
+
+        virtual ~SpriteLayer();
+
+        // Add overloads take the same settings as the SpriteBatch Draw overloads.
+        Handle XM_CALLCONV Add(_In_ ID3D11ShaderResourceView* texture, XMFLOAT2 const& position, _In_opt_ RECT const* sourceRectangle = nullptr, FXMVECTOR color = Colors::White, float rotation = 0, XMFLOAT2 const& origin = Float2Zero, float scale = 1, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
+        Handle XM_CALLCONV Add(_In_ ID3D11ShaderResourceView* texture, XMFLOAT2 const& position, _In_opt_ RECT const* sourceRectangle, FXMVECTOR color, float rotation, XMFLOAT2 const& origin, XMFLOAT2 const& scale, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
+        Handle XM_CALLCONV Add(_In_ ID3D11ShaderResourceView* texture, RECT const& destinationRectangle, _In_opt_ RECT const* sourceRectangle = nullptr, FXMVECTOR color = Colors::White, float rotation = 0, XMFLOAT2 const& origin = Float2Zero, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
+
+        // Update overloads replace every setting of a sprite.
+        void XM_CALLCONV Update(Handle handle, _In_ ID3D11ShaderResourceView* texture, XMFLOAT2 const& position, _In_opt_ RECT const* sourceRectangle = nullptr, FXMVECTOR color = Colors::White, float rotation = 0, XMFLOAT2 const& origin = Float2Zero, float scale = 1, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
+        void XM_CALLCONV Update(Handle handle, _In_ ID3D11ShaderResourceView* texture, XMFLOAT2 const& position, _In_opt_ RECT const* sourceRectangle, FXMVECTOR color, float rotation, XMFLOAT2 const& origin, XMFLOAT2 const& scale, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
+        void XM_CALLCONV Update(Handle handle, _In_ ID3D11ShaderResourceView* texture, RECT const& destinationRectangle, _In_opt_ RECT const* sourceRectangle = nullptr, FXMVECTOR color = Colors::White, float rotation = 0, XMFLOAT2 const& origin = Float2Zero, SpriteEffects effects = SpriteEffects_None, float layerDepth = 0);
+
+        // Change a single setting of a sprite.
+        void __cdecl SetPosition(Handle handle, XMFLOAT2 const& position);
+        void XM_CALLCONV SetColor(Handle handle, FXMVECTOR color);
+        void __cdecl SetLayerDepth(Handle handle, float layerDepth);
+
+        void __cdecl Remove(Handle handle);
+        void __cdecl Clear();
+
+        bool __cdecl IsValid(Handle handle) const;
+        size_t __cdecl GetCount() const;
+
+    private:
+        // Private implementation.
+        class Impl;
+
+        std::unique_ptr<Impl> pImpl;
+
+        static const XMFLOAT2 Float2Zero;
+
+        friend class SpriteBatch;
     };
 }
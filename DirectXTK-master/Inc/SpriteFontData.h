@@ -0,0 +1,151 @@
+//--------------------------------------------------------------------------------------
+// File: SpriteFontData.h
+//
+// Device-independent sprite font description, and the baker that builds one from a
+// bitmap font
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    //----------------------------------------------------------------------------------
+    // The glyphs and sprite sheet of a .spritefont file, as SpriteFont reads it. Nothing
+    // here needs Direct3D, .NET or Windows, so fonts can be baked on any build machine.
+    //
+    // BakeBitmap does what the MakeSpriteFont tool does with a bitmap font, and gives
+    // the same glyph metrics: the same glyphs are found, cropped and spaced the same
+    // way, and the sheet is written in the same pixel formats. Only the packing
+    // differs. Glyphs are placed by MaxRects and skyline packers instead of a brute
+    // force search, which is much faster on large character sets and packs at least
+    // as tightly. The output depends only on the input, not on the thread count.
+    class SpriteFontData
+    {
+    public:
+        struct Rect
+        {
+            int32_t         left;
+            int32_t         top;
+            int32_t         right;
+            int32_t         bottom;
+        };
+
+        // Same layout as SpriteFont::Glyph.
+        struct Glyph
+        {
+            uint32_t        character;
+            Rect            subrect;
+            float           xOffset;
+            float           yOffset;
+            float           xAdvance;
+        };
+
+        // Values are the DXGI_FORMAT of the texture SpriteFont creates.
+        enum TextureFormat : uint32_t
+        {
+            // CompressedMono if every visible pixel of the sheet is white, else Rgba32.
+            TextureFormat_Auto = 0,
+
+            // DXGI_FORMAT_R8G8B8A8_UNORM
+            TextureFormat_Rgba32 = 28,
+
+            // DXGI_FORMAT_B4G4R4A4_UNORM
+            TextureFormat_Bgra4444 = 115,
+
+            // DXGI_FORMAT_BC2_UNORM, with black and white encoded exactly for
+            // monochrome fonts.
+            TextureFormat_CompressedMono = 74,
+        };
+
+        // Inclusive range of characters.
+        struct CharacterRegion
+        {
+            uint32_t        first;
+            uint32_t        last;
+        };
+
+        struct BakeOptions
+        {
+            BakeOptions();
+
+            // Characters of the glyphs in the bitmap, in order; ' ' to '~' if empty.
+            // Glyphs past the end of the list take the characters that follow the last.
+            std::vector<CharacterRegion> characterRegions;
+
+            // Drawn for characters not in the font; 0 for none.
+            uint32_t        defaultCharacter;
+
+            // Added to the height of the tallest glyph and to every glyph's advance.
+            float           lineSpacing;
+            float           characterSpacing;
+
+            TextureFormat   textureFormat;
+
+            // Keeps straight alpha instead of premultiplying the sheet.
+            bool            noPremultiply;
+
+            // Uses a single skyline pass instead of trying every packer and keeping the
+            // best sheet.
+            bool            fastPack;
+
+            // 0 for one per hardware thread.
+            size_t          threadCount;
+        };
+
+        SpriteFontData();
+        SpriteFontData(SpriteFontData&& moveFrom);
+        SpriteFontData& operator= (SpriteFontData&& moveFrom);
+
+        SpriteFontData(SpriteFontData const&) = delete;
+        SpriteFontData& operator= (SpriteFontData const&) = delete;
+
+        virtual ~SpriteFontData();
+
+        std::vector<Glyph>      glyphs;             // ascending character order
+        float                   lineSpacing;
+        uint32_t                defaultCharacter;
+
+        // The sprite sheet, as 8-bit RGBA with red in the low byte of each pixel.
+        // Never TextureFormat_Auto once baked.
+        TextureFormat           textureFormat;
+        bool                    premultiplied;
+        uint32_t                width;
+        uint32_t                height;
+        std::vector<uint32_t>   pixels;
+
+        // Pixels of the sheet taken by glyphs, counting the one pixel border each glyph
+        // is packed with, and the packer that placed them.
+        uint64_t                usedPixels;
+        const char*             packer;
+
+        // Splits a bitmap font into glyphs, crops them and packs them into a new sheet;
+        // throws std::runtime_error if there are no glyphs, or the default character is
+        // not one of them. Pixels are 8-bit RGBA with red in the low byte. Glyphs are
+        // arranged in a grid, top left to bottom right, with magenta (255, 0, 255) around
+        // them. If no pixel has any transparency, the brightness of each pixel is taken as
+        // its alpha, and its color as white.
+        static std::unique_ptr<SpriteFontData> BakeBitmap(const uint32_t* pixels, uint32_t width, uint32_t height,
+                                                          const BakeOptions& options);
+
+        // Reads an uncompressed 8, 24 or 32 bpp .BMP file as 8-bit RGBA; throws
+        // std::runtime_error for anything else. Alpha is only read from 32 bpp files with
+        // an alpha mask, as GDI+ does.
+        static void ReadBMP(const uint8_t* bmpData, size_t bmpSize,
+                            uint32_t& width, uint32_t& height, std::vector<uint32_t>& pixels);
+
+        // Writes the font as a .spritefont file for SpriteFont to load.
+        void Write(std::vector<uint8_t>& fileData) const;
+
+        // Writes the sprite sheet as a 32 bpp .BMP file, for looking at.
+        void WriteSheetBMP(std::vector<uint8_t>& fileData) const;
+    };
+}
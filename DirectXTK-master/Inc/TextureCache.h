@@ -0,0 +1,92 @@
+//--------------------------------------------------------------------------------------
+// File: TextureCache.h
+//
+// Thread-safe cache of texture views by file name, with eviction of unused textures
+// under a memory budget
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#if defined(_XBOX_ONE) && defined(_TITLE)
+#include <d3d11_x.h>
+#else
+#include <d3d11_1.h>
+#endif
+
+#include <functional>
+#include <memory>
+
+#include <stdint.h>
+
+
+namespace DirectX
+{
+    //----------------------------------------------------------------------------------
+    // Names are compared case-insensitively with '/' and '\' equivalent, and are spread
+    // over independently locked shards by a hash of that normalized form, so threads
+    // asking for different textures rarely wait on each other. A texture is loaded once
+    // however many threads ask for it at the same time: the first runs the loader with
+    // no lock held and the others wait for its result.
+    //
+    // The cache holds one reference to each view and counts the bytes of the resource
+    // behind it. When the total goes over the budget, textures that nothing else
+    // references any more are released, least recently requested first. Textures still
+    // referenced are never evicted, so the total can stay over the budget.
+    class TextureCache
+    {
+    public:
+        struct Stats
+        {
+            size_t      textures;
+            size_t      bytes;
+            uint64_t    hits;
+            uint64_t    misses;
+            uint64_t    waits;      // Requests that waited for another thread's load.
+            uint64_t    evictions;
+        };
+
+        // Creates the view for a name that is not cached, or throws.
+        typedef std::function<void(_In_z_ const wchar_t* name, _Outptr_ ID3D11ShaderResourceView** textureView)> Loader;
+
+        // The default budget never evicts.
+        explicit TextureCache(size_t budgetBytes = SIZE_MAX);
+        TextureCache(TextureCache&& moveFrom);
+        TextureCache& operator= (TextureCache&& moveFrom);
+
+        TextureCache(TextureCache const&) = delete;
+        TextureCache& operator= (TextureCache const&) = delete;
+
+        virtual ~TextureCache();
+
+        // Returns a new reference to the cached view, loading it first if need be. If the
+        // loader throws, nothing is cached and every request waiting on it rethrows.
+        void __cdecl GetOrLoad(_In_z_ const wchar_t* name, const Loader& loader, _Outptr_ ID3D11ShaderResourceView** textureView);
+
+        // Returns false, without waiting, if the texture is not cached or still loading.
+        bool __cdecl Find(_In_z_ const wchar_t* name, _Outptr_result_maybenull_ ID3D11ShaderResourceView** textureView);
+
+        // Evicts down to the new budget.
+        void __cdecl SetBudget(size_t bytes);
+        size_t __cdecl GetBudget() const;
+
+        // Evicts unused textures, oldest first, until at most the given bytes are cached.
+        // Returns the bytes still cached.
+        size_t __cdecl Trim(size_t bytes);
+
+        // Drops every loaded texture whether used or not. Loads in progress still complete.
+        void __cdecl Clear();
+
+        Stats __cdecl GetStats() const;
+
+        // Memory taken by the resource a view refers to, counting every mip and slice.
+        static size_t __cdecl GetTextureBytes(_In_ ID3D11ShaderResourceView* textureView);
+
+    private:
+        // Private implementation.
+        class Impl;
+
+        std::unique_ptr<Impl> pImpl;
+    };
+}
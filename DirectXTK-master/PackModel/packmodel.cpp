@@ -0,0 +1,638 @@
+//--------------------------------------------------------------------------------------
+// File: packmodel.cpp
+//
+// Simple command-line tool for converting Visual Studio Starter Kit .CMO models and
+// Wavefront .OBJ models to the packed model (.PMDL) format read by
+// Model::CreateFromPacked. Positions are quantized to 16 bits across each vertex
+// buffer's bounding box, normals and tangents are octahedral encoded, texture
+// coordinates are stored as halves where they fit, and index buffers keep 16-bit
+// indices. The content is otherwise unchanged.
+//
+// .OBJ models (with the .MTL library they name) can also be written as .CMO or .VBO
+// files, so they load through the existing loaders.
+//
+// The command-line handling comes from xwbtool.cpp, Copyright (c) Microsoft
+// Corporation, under the MIT License in LICENSE. The rest is part of SnowScene's
+// additions to DirectXTK.
+//--------------------------------------------------------------------------------------
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NODRAWTEXT
+#define NOGDI
+#define NOBITMAP
+#define NOMCX
+#define NOSERVICE
+#define NOHELP
+#pragma warning(pop)
+
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "ModelData.h"
+
+using namespace DirectX;
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+enum OPTIONS
+{
+    OPT_OUTPUTFILE = 1,
+    OPT_NOOVERWRITE,
+    OPT_NOLOGO,
+    OPT_NOOPTIMIZE,
+    OPT_FILETYPE,
+    OPT_LOD,
+    OPT_MAX
+};
+
+static_assert(OPT_MAX <= 32, "dwOptions is a DWORD bitfield");
+
+struct SConversion
+{
+    wchar_t szSrc[MAX_PATH];
+};
+
+struct SValue
+{
+    LPCWSTR pName;
+    DWORD dwValue;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+const SValue g_pOptions [] =
+{
+    { L"o",         OPT_OUTPUTFILE },
+    { L"n",         OPT_NOOVERWRITE },
+    { L"nologo",    OPT_NOLOGO },
+    { L"nooptimize", OPT_NOOPTIMIZE },
+    { L"ft",        OPT_FILETYPE },
+    { L"lod",       OPT_LOD },
+    { nullptr,      0 }
+};
+
+enum FILETYPES
+{
+    FT_PMDL = 1,
+    FT_CMO,
+    FT_VBO,
+};
+
+const SValue g_pFileTypes [] =
+{
+    { L"pmdl",      FT_PMDL },
+    { L"cmo",       FT_CMO },
+    { L"vbo",       FT_VBO },
+    { nullptr,      0 }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+#pragma prefast(disable : 26018, "Only used with static internal arrays")
+
+    DWORD LookupByName(const wchar_t *pName, const SValue *pArray)
+    {
+        while (pArray->pName)
+        {
+            if (!_wcsicmp(pName, pArray->pName))
+                return pArray->dwValue;
+
+            pArray++;
+        }
+
+        return 0;
+    }
+
+    void PrintList(const SValue *pValue)
+    {
+        for (; pValue->pName; ++pValue)
+            wprintf(L"%ls ", pValue->pName);
+
+        wprintf(L"\n");
+    }
+
+    void PrintLogo()
+    {
+        wprintf(L"SnowScene Packed Model Tool\n");
+#ifdef _DEBUG
+        wprintf(L"*** Debug build ***\n");
+#endif
+        wprintf(L"\n");
+    }
+
+    void PrintUsage()
+    {
+        PrintLogo();
+
+        wprintf(L"Usage: packmodel <options> <cmo-or-obj-files>\n");
+        wprintf(L"\n");
+        wprintf(L"   -o <filename>       output filename (one input file only),\n");
+        wprintf(L"                       otherwise the input name with the output file type\n");
+        wprintf(L"   -ft <filetype>      output file type (defaults to pmdl)\n");
+        wprintf(L"   -n                  do not overwrite output\n");
+        wprintf(L"   -nologo             suppress the banner\n");
+        wprintf(L"   -nooptimize         keep the triangle and vertex order of the input\n");
+        wprintf(L"   -lod <levels>       report the triangles of up to <levels> levels of detail\n");
+        wprintf(L"                       (the output cannot store them; loaders build them)\n");
+
+        wprintf(L"\n   <filetype>: ");
+        PrintList(g_pFileTypes);
+    }
+
+    bool FileExists(const wchar_t* pszFilename)
+    {
+        FILE *f = nullptr;
+        if (!_wfopen_s(&f, pszFilename, L"rb"))
+        {
+            if (f)
+                fclose(f);
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // Same layout as VertexPositionNormalTangentColorTexture
+    struct Vertex
+    {
+        XMFLOAT3    position;
+        XMFLOAT3    normal;
+        XMFLOAT4    tangent;
+        uint32_t    color;
+        XMFLOAT2    textureCoordinate;
+    };
+
+    float AngleInDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        double la = sqrt(double(a.x) * a.x + double(a.y) * a.y + double(a.z) * a.z);
+        double lb = sqrt(double(b.x) * b.x + double(b.y) * b.y + double(b.z) * b.z);
+        if (la <= 0.0 || lb <= 0.0)
+            return 0.f;
+
+        double c = (double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z) / (la * lb);
+        return float(acos(std::min(std::max(c, -1.0), 1.0)) * 57.29577951308232);
+    }
+
+    // Vertex cache statistics over every submesh, weighted by triangle count.
+    void ComputeCacheStats(const ModelData& model, float& acmr, float& atvr)
+    {
+        double faces = 0.0;
+        double misses = 0.0;
+        double verts = 0.0;
+
+        std::vector<uint32_t> indices;
+        for (auto& mesh : model.meshes)
+        {
+            for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+            {
+                auto& sm = model.subMeshes[mesh.firstSubMesh + k];
+                auto& ib = model.indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex];
+                auto& vb = model.vertexBuffers[mesh.firstVertexBuffer + sm.vertexBufferIndex];
+
+                const uint8_t* data = model.GetData(ib.data) + size_t(sm.startIndex) * ib.indexSize;
+
+                indices.resize(sm.indexCount);
+                for (uint32_t q = 0; q < sm.indexCount; ++q)
+                {
+                    if (ib.indexSize == sizeof(uint16_t))
+                    {
+                        uint16_t v;
+                        memcpy(&v, data + q * sizeof(uint16_t), sizeof(v));
+                        indices[q] = v;
+                    }
+                    else
+                    {
+                        memcpy(&indices[q], data + q * sizeof(uint32_t), sizeof(uint32_t));
+                    }
+                }
+
+                size_t nFaces = sm.indexCount / 3;
+                float a, t;
+                ComputeVertexCacheMissRate(indices.data(), nFaces, vb.vertexCount, OPTIMIZE_DEFAULT_CACHE_SIZE, a, t);
+
+                faces += double(nFaces);
+                misses += double(a) * double(nFaces);
+                if (t > 0.f)
+                    verts += double(a) * double(nFaces) / double(t);
+            }
+        }
+
+        acmr = (faces > 0.0) ? float(misses / faces) : 0.f;
+        atvr = (verts > 0.0) ? float(misses / verts) : 0.f;
+    }
+
+    // Largest differences between the vertices read back from the packed file and the
+    // originals. The position error is relative to the size of the vertex buffer's box.
+    void PrintErrors(const ModelData& original, const ModelData& packed)
+    {
+        float positionError = 0.f;
+        float normalError = 0.f;
+        float tangentError = 0.f;
+        float uvError = 0.f;
+
+        for (size_t i = 0; i < original.vertexBuffers.size(); ++i)
+        {
+            auto& vbA = original.vertexBuffers[i];
+            auto& vbB = packed.vertexBuffers[i];
+            const uint8_t* vertsA = original.GetData(vbA.data);
+            const uint8_t* vertsB = packed.GetData(vbB.data);
+
+            XMFLOAT3 pmin(FLT_MAX, FLT_MAX, FLT_MAX);
+            XMFLOAT3 pmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            float error = 0.f;
+            for (uint32_t v = 0; v < vbA.vertexCount; ++v)
+            {
+                Vertex a, b;
+                memcpy(&a, vertsA + size_t(v) * vbA.stride, sizeof(a));
+                memcpy(&b, vertsB + size_t(v) * vbB.stride, sizeof(b));
+
+                pmin = XMFLOAT3(std::min(pmin.x, a.position.x), std::min(pmin.y, a.position.y), std::min(pmin.z, a.position.z));
+                pmax = XMFLOAT3(std::max(pmax.x, a.position.x), std::max(pmax.y, a.position.y), std::max(pmax.z, a.position.z));
+
+                error = std::max(error, fabsf(a.position.x - b.position.x));
+                error = std::max(error, fabsf(a.position.y - b.position.y));
+                error = std::max(error, fabsf(a.position.z - b.position.z));
+
+                normalError = std::max(normalError, AngleInDegrees(a.normal, b.normal));
+                tangentError = std::max(tangentError, AngleInDegrees(XMFLOAT3(a.tangent.x, a.tangent.y, a.tangent.z),
+                                                                     XMFLOAT3(b.tangent.x, b.tangent.y, b.tangent.z)));
+
+                uvError = std::max(uvError, fabsf(a.textureCoordinate.x - b.textureCoordinate.x));
+                uvError = std::max(uvError, fabsf(a.textureCoordinate.y - b.textureCoordinate.y));
+            }
+
+            float extent = std::max(std::max(pmax.x - pmin.x, pmax.y - pmin.y), pmax.z - pmin.z);
+            if (extent > 0.f)
+                positionError = std::max(positionError, error / extent);
+        }
+
+        wprintf(L"max error: position %.2g of extent, normal %.3f deg, tangent %.3f deg, uv %.2g\n",
+                positionError, normalError, tangentError, uvError);
+    }
+
+    // Builds the levels of detail the loaders would and prints their triangle counts and
+    // errors (relative to the mesh radius), and how fast they were simplified.
+    void PrintLODs(ModelData& model, size_t maxLevels)
+    {
+        size_t faces = 0;
+        for (auto& sm : model.subMeshes)
+            faces += sm.indexCount / 3;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        model.GenerateLODs(maxLevels);
+
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        for (auto& mesh : model.meshes)
+        {
+            size_t meshFaces = 0;
+            for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+                meshFaces += model.subMeshes[mesh.firstSubMesh + k].indexCount / 3;
+
+            wprintf(L"lod %ls: %Iu", mesh.name.c_str(), meshFaces);
+
+            for (uint32_t j = 0; j < mesh.lodCount; ++j)
+            {
+                auto& lod = model.lods[mesh.firstLOD + j];
+
+                size_t lodFaces = 0;
+                for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+                    lodFaces += model.lodSubMeshes[lod.firstSubMesh + k].indexCount / 3;
+
+                wprintf(L" -> %Iu (%.3f)", lodFaces, (mesh.radius > 0.f) ? lod.error / mesh.radius : 0.f);
+            }
+
+            wprintf(L" triangles\n");
+        }
+
+        wprintf(L"simplified %Iu triangles in %.3f s (%.0f triangles/s)\n",
+                faces, seconds, (seconds > 0.0) ? double(faces) / seconds : 0.0);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//--------------------------------------------------------------------------------------
+// Entry-point
+//--------------------------------------------------------------------------------------
+#pragma prefast(disable : 28198, "Command-line tool, frees all memory on exit")
+
+int __cdecl wmain(_In_ int argc, _In_z_count_(argc) wchar_t* argv[])
+{
+    // Parameters and defaults
+    wchar_t szOutputFile[MAX_PATH] = {};
+    DWORD dwFileType = FT_PMDL;
+    size_t lodLevels = 0;
+
+    // Process command line
+    DWORD dwOptions = 0;
+    std::list<SConversion> conversion;
+
+    for (int iArg = 1; iArg < argc; iArg++)
+    {
+        PWSTR pArg = argv[iArg];
+
+        if (('-' == pArg[0]) || ('/' == pArg[0]))
+        {
+            pArg++;
+            PWSTR pValue;
+
+            for (pValue = pArg; *pValue && (':' != *pValue); pValue++);
+
+            if (*pValue)
+                *pValue++ = 0;
+
+            DWORD dwOption = LookupByName(pArg, g_pOptions);
+
+            if (!dwOption || (dwOptions & (1 << dwOption)))
+            {
+                PrintUsage();
+                return 1;
+            }
+
+            dwOptions |= 1 << dwOption;
+
+            // Handle options with additional value parameter
+            switch (dwOption)
+            {
+            case OPT_OUTPUTFILE:
+                if (!*pValue)
+                {
+                    if ((iArg + 1 >= argc))
+                    {
+                        PrintUsage();
+                        return 1;
+                    }
+
+                    iArg++;
+                    pValue = argv[iArg];
+                }
+
+                wcscpy_s(szOutputFile, MAX_PATH, pValue);
+                break;
+
+            case OPT_FILETYPE:
+                if (!*pValue)
+                {
+                    if ((iArg + 1 >= argc))
+                    {
+                        PrintUsage();
+                        return 1;
+                    }
+
+                    iArg++;
+                    pValue = argv[iArg];
+                }
+
+                dwFileType = LookupByName(pValue, g_pFileTypes);
+                if (!dwFileType)
+                {
+                    wprintf(L"Invalid value specified with -ft (%ls)\n", pValue);
+                    PrintUsage();
+                    return 1;
+                }
+                break;
+
+            case OPT_LOD:
+                if (!*pValue)
+                {
+                    if ((iArg + 1 >= argc))
+                    {
+                        PrintUsage();
+                        return 1;
+                    }
+
+                    iArg++;
+                    pValue = argv[iArg];
+                }
+
+                if (swscanf_s(pValue, L"%Iu", &lodLevels) != 1 || !lodLevels)
+                {
+                    wprintf(L"Invalid value specified with -lod (%ls)\n", pValue);
+                    PrintUsage();
+                    return 1;
+                }
+                break;
+            }
+        }
+        else
+        {
+            SConversion conv;
+            wcscpy_s(conv.szSrc, MAX_PATH, pArg);
+
+            conversion.push_back(conv);
+        }
+    }
+
+    if (conversion.empty())
+    {
+        wprintf(L"ERROR: Need at least 1 model file to convert\n\n");
+        PrintUsage();
+        return 0;
+    }
+
+    if (*szOutputFile && conversion.size() > 1)
+    {
+        wprintf(L"ERROR: -o can only be used with a single input file\n");
+        return 1;
+    }
+
+    if (~dwOptions & (1 << OPT_NOLOGO))
+        PrintLogo();
+
+    const wchar_t* szOutputExt = (dwFileType == FT_CMO) ? L".cmo" : (dwFileType == FT_VBO) ? L".vbo" : L".pmdl";
+
+    for (auto pConv = conversion.begin(); pConv != conversion.end(); ++pConv)
+    {
+        wchar_t drive[_MAX_DRIVE];
+        wchar_t dir[_MAX_DIR];
+        wchar_t fname[_MAX_FNAME];
+        wchar_t ext[_MAX_EXT];
+        _wsplitpath_s(pConv->szSrc, drive, _MAX_DRIVE, dir, _MAX_DIR, fname, _MAX_FNAME, ext, _MAX_EXT);
+
+        wchar_t szDest[MAX_PATH] = {};
+        if (*szOutputFile)
+        {
+            wcscpy_s(szDest, MAX_PATH, szOutputFile);
+        }
+        else
+        {
+            if (_wcsicmp(ext, szOutputExt) == 0)
+            {
+                wprintf(L"ERROR: Need to specify output file via -o\n");
+                return 1;
+            }
+
+            _wmakepath_s(szDest, drive, dir, fname, szOutputExt);
+        }
+
+        if (pConv != conversion.begin())
+            wprintf(L"\n");
+
+        wprintf(L"reading %ls", pConv->szSrc);
+        fflush(stdout);
+
+        std::unique_ptr<ModelData> original;
+        std::unique_ptr<ModelData> packed;
+        std::vector<uint8_t> fileData;
+        size_t srcSize = 0;
+
+        try
+        {
+            MappedFile src;
+            src.Open(pConv->szSrc);
+            srcSize = src.GetSize();
+
+            if (_wcsicmp(ext, L".obj") == 0)
+            {
+                // The material library is looked for next to the .obj file
+                MappedFile mtl;
+                std::wstring mtlName = ModelData::GetOBJMaterialLibrary(src.GetData(), src.GetSize());
+                if (!mtlName.empty())
+                {
+                    wchar_t szMtl[MAX_PATH] = {};
+                    _wmakepath_s(szMtl, drive, dir, mtlName.c_str(), nullptr);
+
+                    try
+                    {
+                        mtl.Open(szMtl);
+                    }
+                    catch (const std::exception&)
+                    {
+                        wprintf(L"\nWARNING: Cannot read material library %ls, using default materials", szMtl);
+                    }
+                }
+
+                auto start = std::chrono::high_resolution_clock::now();
+
+                original = ModelData::ParseOBJ(src.GetData(), src.GetSize(), mtl.GetData(), mtl.GetSize(), ModelData::ParseFlags_None);
+
+                double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+                wprintf(L"\nparsed in %.3f s (%.1f MB/s)", seconds, double(srcSize) / (seconds * 1000000.0));
+            }
+            else
+            {
+                // UV transforms stay in the materials, so the file suits either effect factory
+                original = ModelData::ParseCMO(src.GetData(), src.GetSize(), ModelData::ParseFlags_None);
+            }
+
+            size_t vertexCount = 0;
+            for (auto& vb : original->vertexBuffers)
+                vertexCount += vb.vertexCount;
+
+            wprintf(L" (%Iu meshes, %Iu vertex buffers, %Iu vertices)\n", original->meshes.size(), original->vertexBuffers.size(), vertexCount);
+
+            if (~dwOptions & (1 << OPT_NOOPTIMIZE))
+            {
+                float acmr, atvr;
+                ComputeCacheStats(*original, acmr, atvr);
+
+                original->Optimize();
+
+                float newAcmr, newAtvr;
+                ComputeCacheStats(*original, newAcmr, newAtvr);
+
+                wprintf(L"vertex cache (FIFO %Iu): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                        OPTIMIZE_DEFAULT_CACHE_SIZE, acmr, newAcmr, atvr, newAtvr);
+            }
+
+            switch (dwFileType)
+            {
+            case FT_CMO:
+                original->WriteCMO(fileData);
+                break;
+
+            case FT_VBO:
+                original->WriteVBO(fileData);
+                break;
+
+            default:
+                original->WritePacked(fileData);
+
+                // Read it back as the loader will, to check it and measure the quantization
+                packed = ModelData::ParsePacked(fileData.data(), fileData.size(), ModelData::ParseFlags_None);
+                break;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            wprintf(L"\nERROR: Failed to convert file (%hs)\n", e.what());
+            return 1;
+        }
+
+        if (dwOptions & (1 << OPT_NOOVERWRITE))
+        {
+            if (FileExists(szDest))
+            {
+                wprintf(L"ERROR: Output file %ls already exists!\n", szDest);
+                return 1;
+            }
+        }
+
+        wprintf(L"writing %ls\n", szDest);
+        fflush(stdout);
+
+        FILE* file = nullptr;
+        if (_wfopen_s(&file, szDest, L"wb") || !file)
+        {
+            wprintf(L"ERROR: Failed opening output file %ls\n", szDest);
+            return 1;
+        }
+
+        size_t written = fwrite(fileData.data(), 1, fileData.size(), file);
+        if (fclose(file) || written != fileData.size())
+        {
+            wprintf(L"ERROR: Failed writing output file %ls\n", szDest);
+            return 1;
+        }
+
+        wprintf(L"%Iu bytes -> %Iu bytes (%.2fx)\n", srcSize, fileData.size(), double(srcSize) / double(fileData.size()));
+
+        if (packed)
+            PrintErrors(*original, *packed);
+
+        if (dwOptions & (1 << OPT_LOD))
+        {
+            try
+            {
+                PrintLODs(*original, lodLevels);
+            }
+            catch (const std::exception& e)
+            {
+                wprintf(L"ERROR: Failed to build levels of detail (%hs)\n", e.what());
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -382,7 +382,8 @@ const int EffectBase<BasicEffectTraits>::PixelShaderIndices[] =
 
 
 // Global pool of per-device BasicEffect resources.
-SharedResourcePool<ID3D11Device*, EffectBase<BasicEffectTraits>::DeviceResources> EffectBase<BasicEffectTraits>::deviceResourcesPool;
+template<>
+SharedResourcePool<ID3D11Device*, EffectBase<BasicEffectTraits>::DeviceResources> EffectBase<BasicEffectTraits>::deviceResourcesPool = {};
 
 
 // Constructor.
@@ -15,36 +15,126 @@
 
 #include "BinaryReader.h"
 
+#include <system_error>
+
 using namespace DirectX;
 
+namespace
+{
+    // Alignment the stream buffer keeps for each byte's offset in the file, enough for
+    // any value BinaryReader is asked for.
+    const size_t StreamAlignment = 8;
+}
+
 
-// Constructor reads from the filesystem.
+// Constructor maps the file, or streams it if it is too large to map.
 BinaryReader::BinaryReader(_In_z_ wchar_t const* fileName) :
     mPos(nullptr),
-    mEnd(nullptr)
+    mEnd(nullptr),
+    mOwnedSize(0)
 {
-    size_t dataSize;
-
-    HRESULT hr = ReadEntireFile(fileName, mOwnedData, &dataSize);
-    if ( FAILED(hr) )
+    try
+    {
+        mMapping.Open(fileName);
+    }
+    catch (const std::length_error&)
     {
-        DebugTrace( "BinaryReader failed (%08X) to load '%ls'\n", hr, fileName );
+        OpenStream(fileName, DefaultStreamBufferSize);
+        return;
+    }
+    catch (const std::system_error& e)
+    {
+        DebugTrace( "BinaryReader failed (%08X) to load '%ls'\n", HRESULT_FROM_WIN32(e.code().value()), fileName );
         throw std::exception( "BinaryReader" );
     }
 
-    mPos = mOwnedData.get();
-    mEnd = mOwnedData.get() + dataSize;
+    mPos = mMapping.GetData();
+    mEnd = mMapping.GetData() + mMapping.GetSize();
+}
+
+
+// Constructor streams the file through a buffer.
+BinaryReader::BinaryReader(_In_z_ wchar_t const* fileName, size_t streamBufferSize) :
+    mPos(nullptr),
+    mEnd(nullptr),
+    mOwnedSize(0)
+{
+    OpenStream(fileName, streamBufferSize);
 }
 
 
 // Constructor reads from an existing memory buffer.
 BinaryReader::BinaryReader(_In_reads_bytes_(dataSize) uint8_t const* dataBlob, size_t dataSize) :
     mPos(dataBlob),
-    mEnd(dataBlob + dataSize)
+    mEnd(dataBlob + dataSize),
+    mOwnedSize(0)
 {
 }
 
 
+void BinaryReader::OpenStream(_In_z_ wchar_t const* fileName, size_t streamBufferSize)
+{
+    try
+    {
+        mStream.Open(fileName);
+    }
+    catch (const std::system_error& e)
+    {
+        DebugTrace( "BinaryReader failed (%08X) to load '%ls'\n", HRESULT_FROM_WIN32(e.code().value()), fileName );
+        throw std::exception( "BinaryReader" );
+    }
+
+    mOwnedSize = std::max<size_t>(streamBufferSize, 1);
+    mOwnedData.reset(new uint8_t[mOwnedSize]);
+
+    mPos = mOwnedData.get();
+    mEnd = mOwnedData.get();
+}
+
+
+// Moves the unread bytes to the front of the stream buffer and tops it up. They keep
+// their offset modulo StreamAlignment, so a value aligned in the file is aligned in
+// the buffer too.
+void BinaryReader::Refill(size_t byteCount)
+{
+    if (!mStream.IsOpen())
+        throw std::exception("End of file");
+
+    size_t remaining = static_cast<size_t>(mEnd - mPos);
+    size_t shift = static_cast<size_t>(mPos - mOwnedData.get()) % StreamAlignment;
+
+    if (shift + byteCount > mOwnedSize)
+    {
+        // A single read larger than the buffer needs all of it in memory at once.
+        std::unique_ptr<uint8_t[]> data(new uint8_t[shift + byteCount]);
+        memcpy(data.get() + shift, mPos, remaining);
+        mOwnedData = std::move(data);
+        mOwnedSize = shift + byteCount;
+    }
+    else if (remaining)
+    {
+        memmove(mOwnedData.get() + shift, mPos, remaining);
+    }
+
+    size_t filled = shift + remaining;
+    try
+    {
+        filled += mStream.Read(mOwnedData.get() + filled, mOwnedSize - filled);
+    }
+    catch (const std::system_error& e)
+    {
+        DebugTrace( "BinaryReader failed (%08X) to read\n", HRESULT_FROM_WIN32(e.code().value()) );
+        throw std::exception( "BinaryReader" );
+    }
+
+    mPos = mOwnedData.get() + shift;
+    mEnd = mOwnedData.get() + filled;
+
+    if (filled - shift < byteCount)
+        throw std::exception("End of file");
+}
+
+
 // Reads from the filesystem into memory.
 HRESULT BinaryReader::ReadEntireFile(_In_z_ wchar_t const* fileName, _Inout_ std::unique_ptr<uint8_t[]>& data, _Out_ size_t* dataSize)
 {
@@ -90,3 +180,23 @@ HRESULT BinaryReader::ReadEntireFile(_In_z_ wchar_t const* fileName, _Inout_ std
     
     return S_OK;
 }
+
+
+// Maps a file read-only.
+HRESULT BinaryReader::MapEntireFile(_In_z_ wchar_t const* fileName, _Inout_ MappedFile& mapping)
+{
+    try
+    {
+        mapping.Open(fileName);
+    }
+    catch (const std::length_error&)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY);
+    }
+    catch (const std::system_error& e)
+    {
+        return HRESULT_FROM_WIN32(e.code().value());
+    }
+
+    return S_OK;
+}
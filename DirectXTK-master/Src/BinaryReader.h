@@ -18,16 +18,25 @@
 #include <stdexcept>
 #include <type_traits>
 
+#include <stdint.h>
+
+#include "MappedFile.h"
 #include "PlatformHelpers.h"
 
 
 namespace DirectX
 {
     // Helper for reading binary data, either from the filesystem a memory buffer.
+    //
+    // Files are memory mapped, so only the pages actually read are loaded. A file too
+    // large for the address space (or any file, if a stream buffer size is given) is
+    // streamed through a buffer instead; the pointers ReadArray returns are then only
+    // valid until the next read.
     class BinaryReader
     {
     public:
         explicit BinaryReader(_In_z_ wchar_t const* fileName);
+        BinaryReader(_In_z_ wchar_t const* fileName, size_t streamBufferSize);
         BinaryReader(_In_reads_bytes_(dataSize) uint8_t const* dataBlob, size_t dataSize);
 
         BinaryReader(BinaryReader const&) = delete;
@@ -45,31 +54,45 @@ namespace DirectX
         {
             static_assert(std::is_pod<T>::value, "Can only read plain-old-data types");
 
-            uint8_t const* newPos = mPos + sizeof(T) * elementCount;
-
-            if (newPos < mPos)
+            if (elementCount > SIZE_MAX / sizeof(T))
                 throw std::overflow_error("ReadArray");
 
-            if (newPos > mEnd)
-                throw std::exception("End of file");
+            size_t byteCount = sizeof(T) * elementCount;
+
+            if (byteCount > static_cast<size_t>(mEnd - mPos))
+                Refill(byteCount);
 
             auto result = reinterpret_cast<T const*>(mPos);
 
-            mPos = newPos;
+            mPos += byteCount;
 
             return result;
         }
 
 
-        // Lower level helper reads directly from the filesystem into memory.
+        // Lower level helpers read directly from the filesystem into memory, or map a
+        // file read-only without copying it.
         static HRESULT ReadEntireFile(_In_z_ wchar_t const* fileName, _Inout_ std::unique_ptr<uint8_t[]>& data, _Out_ size_t* dataSize);
+        static HRESULT MapEntireFile(_In_z_ wchar_t const* fileName, _Inout_ MappedFile& mapping);
+
+        static const size_t DefaultStreamBufferSize = 64 * 1024;
 
 
     private:
+        // Makes byteCount bytes available at mPos when streaming; throws at the end of
+        // the data.
+        void Refill(size_t byteCount);
+
+        void OpenStream(_In_z_ wchar_t const* fileName, size_t streamBufferSize);
+
         // The data currently being read.
         uint8_t const* mPos;
         uint8_t const* mEnd;
 
+        // Backing store: a mapped file, or a stream and its buffer.
+        MappedFile mMapping;
+        FileStream mStream;
         std::unique_ptr<uint8_t[]> mOwnedData;
+        size_t mOwnedSize;
     };
 }
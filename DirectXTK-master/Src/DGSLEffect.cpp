@@ -105,7 +105,7 @@ static_assert( ( sizeof(ObjectConstants) % 16 ) == 0, "CB size not padded correc
 static_assert( ( sizeof(MiscConstants) % 16 ) == 0, "CB size not padded correctly" );
 static_assert( ( sizeof(BoneConstants) % 16 ) == 0, "CB size not padded correctly" );
 
-__declspec(align(16)) struct DGSLEffectConstants
+struct __declspec(align(16)) DGSLEffectConstants
 {
     MaterialConstants   material;
     LightConstants      light;
@@ -15,6 +15,7 @@
 #include "Effects.h"
 #include "DemandCreate.h"
 #include "SharedResourcePool.h"
+#include "TextureCache.h"
 
 #include "DDSTextureLoader.h"
 #include "WICTextureLoader.h"
@@ -48,6 +49,7 @@ public:
     void CreatePixelShader( _In_z_ const wchar_t* shader, _Outptr_ ID3D11PixelShader** pixelShader );
 
     void ReleaseCache();
+    void SetTextureCacheBudget( size_t bytes ) { mTextureCache.SetBudget( bytes ); }
     void SetSharing( bool enabled ) { mSharing = enabled; }
     void EnableForceSRGB(bool forceSRGB) { mForceSRGB = forceSRGB; }
 
@@ -56,10 +58,11 @@ public:
     wchar_t mPath[MAX_PATH];
 
 private:
+    void LoadTexture( _In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView );
+
     ComPtr<ID3D11Device> device;
 
     typedef std::map< std::wstring, std::shared_ptr<IEffect> > EffectCache;
-    typedef std::map< std::wstring, ComPtr<ID3D11ShaderResourceView> > TextureCache;
     typedef std::map< std::wstring, ComPtr<ID3D11PixelShader> > ShaderCache;
 
     EffectCache  mEffectCache;
@@ -351,83 +354,83 @@ void DGSLEffectFactory::Impl::CreateTexture( const wchar_t* name, ID3D11DeviceCo
     if ( !name || !textureView )
         throw std::exception("invalid arguments");
 
+    if ( mSharing && *name )
+    {
+        mTextureCache.GetOrLoad( name, [&]( const wchar_t* texture, ID3D11ShaderResourceView** srv )
+        {
+            LoadTexture( texture, deviceContext, srv );
+        }, textureView );
+    }
+    else
+    {
+        LoadTexture( name, deviceContext, textureView );
+    }
+}
+
+
+_Use_decl_annotations_
+void DGSLEffectFactory::Impl::LoadTexture( const wchar_t* name, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView** textureView )
+{
 #if defined(_XBOX_ONE) && defined(_TITLE)
     UNREFERENCED_PARAMETER(deviceContext);
 #endif
 
-    auto it = mTextureCache.find( name );
+    wchar_t fullName[MAX_PATH] = {};
+    wcscpy_s( fullName, mPath );
+    wcscat_s( fullName, name );
 
-    if ( mSharing && it != mTextureCache.end() )
-    {
-        ID3D11ShaderResourceView* srv = it->second.Get();
-        srv->AddRef();
-        *textureView = srv;
-    }
-    else
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr = {};
+    if ( !GetFileAttributesExW(fullName, GetFileExInfoStandard, &fileAttr) )
     {
-        wchar_t fullName[MAX_PATH] = {};
-        wcscpy_s( fullName, mPath );
-        wcscat_s( fullName, name );
-
-        WIN32_FILE_ATTRIBUTE_DATA fileAttr = {};
+        // Try Current Working Directory (CWD)
+        wcscpy_s( fullName, name );
         if ( !GetFileAttributesExW(fullName, GetFileExInfoStandard, &fileAttr) )
         {
-            // Try Current Working Directory (CWD)
-            wcscpy_s( fullName, name );
-            if ( !GetFileAttributesExW(fullName, GetFileExInfoStandard, &fileAttr) )
-            {
-                DebugTrace( "DGSLEffectFactory could not find texture file '%ls'\n", name );
-                throw std::exception( "CreateTexture" );
-            }
+            DebugTrace( "DGSLEffectFactory could not find texture file '%ls'\n", name );
+            throw std::exception( "CreateTexture" );
         }
+    }
 
-        wchar_t ext[_MAX_EXT];
-        _wsplitpath_s( name, nullptr, 0, nullptr, 0, nullptr, 0, ext, _MAX_EXT );
+    wchar_t ext[_MAX_EXT];
+    _wsplitpath_s( name, nullptr, 0, nullptr, 0, nullptr, 0, ext, _MAX_EXT );
 
-        if ( _wcsicmp( ext, L".dds" ) == 0 )
+    if ( _wcsicmp( ext, L".dds" ) == 0 )
+    {
+        HRESULT hr = CreateDDSTextureFromFileEx(
+            device.Get(), fullName, 0,
+            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+            mForceSRGB, nullptr, textureView);
+        if ( FAILED(hr) )
         {
-            HRESULT hr = CreateDDSTextureFromFileEx(
-                device.Get(), fullName, 0,
-                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
-                mForceSRGB, nullptr, textureView);
-            if ( FAILED(hr) )
-            {
-                DebugTrace( "CreateDDSTextureFromFile failed (%08X) for '%ls'\n", hr, fullName );
-                throw std::exception( "CreateDDSTextureFromFile" );
-            }
+            DebugTrace( "CreateDDSTextureFromFile failed (%08X) for '%ls'\n", hr, fullName );
+            throw std::exception( "CreateDDSTextureFromFile" );
         }
+    }
 #if !defined(_XBOX_ONE) || !defined(_TITLE)
-        else if ( deviceContext )
+    else if ( deviceContext )
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        HRESULT hr = CreateWICTextureFromFileEx(
+            device.Get(), deviceContext, fullName, 0,
+            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+            mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView );
+        if ( FAILED(hr) )
         {
-            std::lock_guard<std::mutex> lock(mutex);
-            HRESULT hr = CreateWICTextureFromFileEx(
-                device.Get(), deviceContext, fullName, 0,
-                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
-                mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView );
-            if ( FAILED(hr) )
-            {
-                DebugTrace( "CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName );
-                throw std::exception( "CreateWICTextureFromFile" );
-            }
+            DebugTrace( "CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName );
+            throw std::exception( "CreateWICTextureFromFile" );
         }
+    }
 #endif
-        else
+    else
+    {
+        HRESULT hr = CreateWICTextureFromFileEx(
+            device.Get(), fullName, 0,
+            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+            mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView );
+        if ( FAILED(hr) )
         {
-            HRESULT hr = CreateWICTextureFromFileEx(
-                device.Get(), fullName, 0,
-                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
-                mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView );
-            if ( FAILED(hr) )
-            {
-                DebugTrace( "CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName );
-                throw std::exception( "CreateWICTextureFromFile" );
-            }
-        }
-
-        if ( mSharing && *name && it == mTextureCache.end() )
-        {   
-            std::lock_guard<std::mutex> lock(mutex);
-            mTextureCache.insert( TextureCache::value_type( name, *textureView ) );
+            DebugTrace( "CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName );
+            throw std::exception( "CreateWICTextureFromFile" );
         }
     }
 }
@@ -465,9 +468,8 @@ void DGSLEffectFactory::Impl::CreatePixelShader( const wchar_t* name, ID3D11Pixe
             }
         }
 
-        size_t dataSize = 0;
-        std::unique_ptr<uint8_t[]> data;
-        HRESULT hr = BinaryReader::ReadEntireFile( fullName, data, &dataSize );
+        MappedFile data;
+        HRESULT hr = BinaryReader::MapEntireFile( fullName, data );
         if ( FAILED(hr) )
         {
             DebugTrace( "CreatePixelShader failed (%08X) to load shader file '%ls'\n", hr, fullName );
@@ -475,7 +477,7 @@ void DGSLEffectFactory::Impl::CreatePixelShader( const wchar_t* name, ID3D11Pixe
         }
        
         ThrowIfFailed(
-            device->CreatePixelShader( data.get(), dataSize, nullptr, pixelShader ) );
+            device->CreatePixelShader( data.GetData(), data.GetSize(), nullptr, pixelShader ) );
 
         _Analysis_assume_(*pixelShader != 0);
 
@@ -493,7 +495,7 @@ void DGSLEffectFactory::Impl::ReleaseCache()
     std::lock_guard<std::mutex> lock(mutex);
     mEffectCache.clear();
     mEffectCacheSkinning.clear();
-    mTextureCache.clear();
+    mTextureCache.Clear();
     mShaderCache.clear();
 }
 
@@ -560,6 +562,11 @@ void DGSLEffectFactory::ReleaseCache()
     pImpl->ReleaseCache();
 }
 
+void DGSLEffectFactory::SetTextureCacheBudget( size_t bytes )
+{
+    pImpl->SetTextureCacheBudget( bytes );
+}
+
 void DGSLEffectFactory::SetSharing( bool enabled )
 {
     pImpl->SetSharing( enabled );
@@ -15,6 +15,7 @@
 #include "Effects.h"
 #include "DemandCreate.h"
 #include "SharedResourcePool.h"
+#include "TextureCache.h"
 
 #include "DDSTextureLoader.h"
 #include "WICTextureLoader.h"
@@ -39,6 +40,7 @@ public:
     void CreateTexture( _In_z_ const wchar_t* texture, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView );
 
     void ReleaseCache();
+    void SetTextureCacheBudget( size_t bytes ) { mTextureCache.SetBudget(bytes); }
     void SetSharing( bool enabled ) { mSharing = enabled; }
     void EnableNormalMapEffect( bool enabled ) { mUseNormalMapEffect = enabled; }
     void EnableForceSRGB(bool forceSRGB) { mForceSRGB = forceSRGB; }
@@ -48,10 +50,11 @@ public:
     wchar_t mPath[MAX_PATH];
 
 private:
+    void LoadTexture(_In_z_ const wchar_t* name, _In_opt_ ID3D11DeviceContext* deviceContext, _Outptr_ ID3D11ShaderResourceView** textureView);
+
     ComPtr<ID3D11Device> device;
 
     typedef std::map< std::wstring, std::shared_ptr<IEffect> > EffectCache;
-    typedef std::map< std::wstring, ComPtr<ID3D11ShaderResourceView> > TextureCache;
 
     EffectCache  mEffectCache;
     EffectCache  mEffectCacheSkinning;
@@ -350,83 +353,82 @@ void EffectFactory::Impl::CreateTexture(const wchar_t* name, ID3D11DeviceContext
     if (!name || !textureView)
         throw std::exception("invalid arguments");
 
+    if (mSharing && *name)
+    {
+        mTextureCache.GetOrLoad(name, [&](const wchar_t* texture, ID3D11ShaderResourceView** srv)
+        {
+            LoadTexture(texture, deviceContext, srv);
+        }, textureView);
+    }
+    else
+    {
+        LoadTexture(name, deviceContext, textureView);
+    }
+}
+
+_Use_decl_annotations_
+void EffectFactory::Impl::LoadTexture(const wchar_t* name, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView** textureView)
+{
 #if defined(_XBOX_ONE) && defined(_TITLE)
     UNREFERENCED_PARAMETER(deviceContext);
 #endif
 
-    auto it = mTextureCache.find(name);
+    wchar_t fullName[MAX_PATH] = {};
+    wcscpy_s(fullName, mPath);
+    wcscat_s(fullName, name);
 
-    if (mSharing && it != mTextureCache.end())
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr = {};
+    if (!GetFileAttributesExW(fullName, GetFileExInfoStandard, &fileAttr))
     {
-        ID3D11ShaderResourceView* srv = it->second.Get();
-        srv->AddRef();
-        *textureView = srv;
-    }
-    else
-    {
-        wchar_t fullName[MAX_PATH] = {};
-        wcscpy_s(fullName, mPath);
-        wcscat_s(fullName, name);
-
-        WIN32_FILE_ATTRIBUTE_DATA fileAttr = {};
+        // Try Current Working Directory (CWD)
+        wcscpy_s(fullName, name);
         if (!GetFileAttributesExW(fullName, GetFileExInfoStandard, &fileAttr))
         {
-            // Try Current Working Directory (CWD)
-            wcscpy_s(fullName, name);
-            if (!GetFileAttributesExW(fullName, GetFileExInfoStandard, &fileAttr))
-            {
-                DebugTrace("EffectFactory could not find texture file '%ls'\n", name);
-                throw std::exception("CreateTexture");
-            }
+            DebugTrace("EffectFactory could not find texture file '%ls'\n", name);
+            throw std::exception("CreateTexture");
         }
+    }
 
-        wchar_t ext[_MAX_EXT];
-        _wsplitpath_s(name, nullptr, 0, nullptr, 0, nullptr, 0, ext, _MAX_EXT);
+    wchar_t ext[_MAX_EXT];
+    _wsplitpath_s(name, nullptr, 0, nullptr, 0, nullptr, 0, ext, _MAX_EXT);
 
-        if (_wcsicmp(ext, L".dds") == 0)
+    if (_wcsicmp(ext, L".dds") == 0)
+    {
+        HRESULT hr = CreateDDSTextureFromFileEx(
+            device.Get(), fullName, 0,
+            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+            mForceSRGB, nullptr, textureView);
+        if (FAILED(hr))
         {
-            HRESULT hr = CreateDDSTextureFromFileEx(
-                device.Get(), fullName, 0,
-                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
-                mForceSRGB, nullptr, textureView);
-            if (FAILED(hr))
-            {
-                DebugTrace("CreateDDSTextureFromFile failed (%08X) for '%ls'\n", hr, fullName);
-                throw std::exception("CreateDDSTextureFromFile");
-            }
+            DebugTrace("CreateDDSTextureFromFile failed (%08X) for '%ls'\n", hr, fullName);
+            throw std::exception("CreateDDSTextureFromFile");
         }
+    }
 #if !defined(_XBOX_ONE) || !defined(_TITLE)
-        else if (deviceContext)
+    else if (deviceContext)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        HRESULT hr = CreateWICTextureFromFileEx(
+            device.Get(), deviceContext, fullName, 0,
+            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+            mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView);
+        if (FAILED(hr))
         {
-            std::lock_guard<std::mutex> lock(mutex);
-            HRESULT hr = CreateWICTextureFromFileEx(
-                device.Get(), deviceContext, fullName, 0,
-                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
-                mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView);
-            if (FAILED(hr))
-            {
-                DebugTrace("CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName);
-                throw std::exception("CreateWICTextureFromFile");
-            }
+            DebugTrace("CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName);
+            throw std::exception("CreateWICTextureFromFile");
         }
+    }
 #endif
-        else
-        {
-            HRESULT hr = CreateWICTextureFromFileEx(
-                device.Get(), fullName, 0,
-                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
-                mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView);
-            if (FAILED(hr))
-            {
-                DebugTrace("CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName);
-                throw std::exception("CreateWICTextureFromFile");
-            }
-        }
-
-        if (mSharing && *name && it == mTextureCache.end())
+    else
+    {
+        HRESULT hr = CreateWICTextureFromFileEx(
+            device.Get(), fullName, 0,
+            D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+            mForceSRGB ? WIC_LOADER_FORCE_SRGB : WIC_LOADER_DEFAULT, nullptr, textureView);
+        if (FAILED(hr))
         {
-            std::lock_guard<std::mutex> lock(mutex);
-            mTextureCache.insert(TextureCache::value_type(name, *textureView));
+            DebugTrace("CreateWICTextureFromFile failed (%08X) for '%ls'\n", hr, fullName);
+            throw std::exception("CreateWICTextureFromFile");
         }
     }
 }
@@ -438,7 +440,7 @@ void EffectFactory::Impl::ReleaseCache()
     mEffectCacheSkinning.clear();
     mEffectCacheDualTexture.clear();
     mEffectNormalMap.clear();
-    mTextureCache.clear();
+    mTextureCache.Clear();
 }
 
 
@@ -485,6 +487,11 @@ void EffectFactory::ReleaseCache()
     pImpl->ReleaseCache();
 }
 
+void EffectFactory::SetTextureCacheBudget(size_t bytes)
+{
+    pImpl->SetTextureCacheBudget(bytes);
+}
+
 void EffectFactory::SetSharing(bool enabled)
 {
     pImpl->SetSharing(enabled);
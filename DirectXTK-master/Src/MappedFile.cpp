@@ -0,0 +1,331 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.cpp
+//
+// Built without the precompiled header so it does not depend on Direct3D.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <codecvt>
+#include <locale>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DirectX;
+
+
+namespace
+{
+#ifdef _WIN32
+    [[noreturn]] void ThrowLastError(const char* what)
+    {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+    }
+
+    struct handle_closer { void operator()(HANDLE h) { if (h) CloseHandle(h); } };
+
+    typedef std::unique_ptr<void, handle_closer> ScopedHandle;
+
+    HANDLE OpenForReading(wchar_t const* fileName, uint64_t* fileSize)
+    {
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+        HANDLE hFile = CreateFile2(fileName, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+#else
+        HANDLE hFile = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#endif
+        if (hFile == INVALID_HANDLE_VALUE)
+            ThrowLastError("Open");
+
+        FILE_STANDARD_INFO fileInfo;
+        if (!GetFileInformationByHandleEx(hFile, FileStandardInfo, &fileInfo, sizeof(fileInfo)))
+        {
+            DWORD error = GetLastError();
+            CloseHandle(hFile);
+            throw std::system_error(static_cast<int>(error), std::system_category(), "Open");
+        }
+
+        *fileSize = static_cast<uint64_t>(fileInfo.EndOfFile.QuadPart);
+        return hFile;
+    }
+#else
+    [[noreturn]] void ThrowErrno(const char* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    int OpenForReading(wchar_t const* fileName, uint64_t* fileSize)
+    {
+        std::string path = std::wstring_convert<std::codecvt_utf8<wchar_t>>().to_bytes(fileName);
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            ThrowErrno("Open");
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "Open");
+        }
+
+        *fileSize = static_cast<uint64_t>(st.st_size);
+        return fd;
+    }
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// MappedFile
+//--------------------------------------------------------------------------------------
+
+MappedFile::MappedFile() :
+    mData(nullptr),
+    mSize(0)
+{
+}
+
+
+MappedFile::MappedFile(MappedFile&& moveFrom) :
+    mData(moveFrom.mData),
+    mSize(moveFrom.mSize)
+{
+    moveFrom.mData = nullptr;
+    moveFrom.mSize = 0;
+}
+
+
+MappedFile& MappedFile::operator= (MappedFile&& moveFrom)
+{
+    if (this != &moveFrom)
+    {
+        Close();
+        mData = moveFrom.mData;
+        mSize = moveFrom.mSize;
+        moveFrom.mData = nullptr;
+        moveFrom.mSize = 0;
+    }
+    return *this;
+}
+
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+
+void MappedFile::Open(wchar_t const* fileName)
+{
+    Close();
+
+    uint64_t fileSize;
+
+#ifdef _WIN32
+    ScopedHandle hFile(OpenForReading(fileName, &fileSize));
+
+    if (fileSize > SIZE_MAX)
+        throw std::length_error("File is too large to map");
+
+    // Mapping an empty file fails, and there is nothing to map anyway.
+    if (!fileSize)
+        return;
+
+    // The view keeps the mapping alive, so neither handle is needed afterwards.
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    ScopedHandle hMapping(CreateFileMappingFromApp(hFile.get(), nullptr, PAGE_READONLY, 0, nullptr));
+#else
+    ScopedHandle hMapping(CreateFileMappingW(hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+#endif
+    if (!hMapping)
+        ThrowLastError("CreateFileMapping");
+
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    void* view = MapViewOfFileFromApp(hMapping.get(), FILE_MAP_READ, 0, 0);
+#else
+    void* view = MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0);
+#endif
+    if (!view)
+    {
+        if (GetLastError() == ERROR_NOT_ENOUGH_MEMORY)
+            throw std::length_error("File is too large to map");
+
+        ThrowLastError("MapViewOfFile");
+    }
+#else
+    int fd = OpenForReading(fileName, &fileSize);
+
+    if (fileSize > SIZE_MAX || !fileSize)
+    {
+        close(fd);
+
+        if (fileSize)
+            throw std::length_error("File is too large to map");
+
+        // Mapping an empty file fails, and there is nothing to map anyway.
+        return;
+    }
+
+    // The mapping outlives the descriptor.
+    void* view = mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+
+    if (view == MAP_FAILED)
+    {
+        if (error == ENOMEM)
+            throw std::length_error("File is too large to map");
+
+        throw std::system_error(error, std::generic_category(), "mmap");
+    }
+#endif
+
+    mData = static_cast<uint8_t const*>(view);
+    mSize = static_cast<size_t>(fileSize);
+}
+
+
+void MappedFile::Close()
+{
+    if (mData)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(mData);
+#else
+        munmap(const_cast<uint8_t*>(mData), mSize);
+#endif
+    }
+
+    mData = nullptr;
+    mSize = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// FileStream
+//--------------------------------------------------------------------------------------
+
+FileStream::FileStream() :
+    mHandle(-1),
+    mSize(0)
+{
+}
+
+
+FileStream::FileStream(FileStream&& moveFrom) :
+    mHandle(moveFrom.mHandle),
+    mSize(moveFrom.mSize)
+{
+    moveFrom.mHandle = -1;
+    moveFrom.mSize = 0;
+}
+
+
+FileStream& FileStream::operator= (FileStream&& moveFrom)
+{
+    if (this != &moveFrom)
+    {
+        Close();
+        mHandle = moveFrom.mHandle;
+        mSize = moveFrom.mSize;
+        moveFrom.mHandle = -1;
+        moveFrom.mSize = 0;
+    }
+    return *this;
+}
+
+
+FileStream::~FileStream()
+{
+    Close();
+}
+
+
+void FileStream::Open(wchar_t const* fileName)
+{
+    Close();
+
+#ifdef _WIN32
+    mHandle = reinterpret_cast<intptr_t>(OpenForReading(fileName, &mSize));
+#else
+    mHandle = OpenForReading(fileName, &mSize);
+#endif
+}
+
+
+void FileStream::Close()
+{
+    if (mHandle != -1)
+    {
+#ifdef _WIN32
+        CloseHandle(reinterpret_cast<HANDLE>(mHandle));
+#else
+        close(static_cast<int>(mHandle));
+#endif
+    }
+
+    mHandle = -1;
+    mSize = 0;
+}
+
+
+size_t FileStream::Read(void* buffer, size_t byteCount)
+{
+    if (mHandle == -1)
+        throw std::logic_error("FileStream is not open");
+
+    // Both APIs cap the size of a single read, so large requests are split.
+    const size_t maxRead = 0x40000000;
+
+    auto dest = static_cast<uint8_t*>(buffer);
+    size_t total = 0;
+    while (total < byteCount)
+    {
+        size_t request = std::min(byteCount - total, maxRead);
+
+#ifdef _WIN32
+        DWORD bytesRead = 0;
+        if (!ReadFile(reinterpret_cast<HANDLE>(mHandle), dest + total, static_cast<DWORD>(request), &bytesRead, nullptr))
+            ThrowLastError("ReadFile");
+#else
+        ssize_t bytesRead = read(static_cast<int>(mHandle), dest + total, request);
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            ThrowErrno("read");
+        }
+#endif
+
+        if (!bytesRead)
+            break;
+
+        total += static_cast<size_t>(bytesRead);
+    }
+
+    return total;
+}
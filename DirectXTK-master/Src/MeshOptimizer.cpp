@@ -0,0 +1,620 @@
+//--------------------------------------------------------------------------------------
+// File: MeshOptimizer.cpp
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+// Built without the precompiled header so it does not depend on Direct3D.
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+
+namespace
+{
+    template<typename TIndex>
+    void CheckIndices(const TIndex* indices, size_t nIndices, size_t nVerts)
+    {
+        if (nVerts >= UINT32_MAX)
+            throw std::invalid_argument("Too many vertices");
+
+        for (size_t j = 0; j < nIndices; ++j)
+        {
+            if (indices[j] >= nVerts)
+                throw std::out_of_range("Invalid index found");
+        }
+    }
+
+
+    // FIFO cache modelled with insertion timestamps: a vertex is cached if fewer than
+    // cacheSize vertices were inserted after it, and not before the last Flush.
+    // Timestamps start at cacheSize + 1 so that a zeroed stamp reads as not cached.
+    class VertexCache
+    {
+    public:
+        VertexCache(size_t nVerts, size_t cacheSize) :
+            mStamps(nVerts, 0),
+            mTime(cacheSize + 1),
+            mFlushed(0),
+            mCacheSize(cacheSize)
+        {
+        }
+
+        // Returns true on a miss, which loads the vertex.
+        bool Access(uint32_t v)
+        {
+            if (mStamps[v] >= mFlushed && mTime - mStamps[v] <= mCacheSize)
+                return false;
+
+            mStamps[v] = mTime++;
+            return true;
+        }
+
+        void Flush() { mFlushed = mTime; }
+
+        size_t Age(uint32_t v) const { return mTime - mStamps[v]; }
+
+    private:
+        std::vector<size_t> mStamps;
+        size_t              mTime;
+        size_t              mFlushed;
+        size_t              mCacheSize;
+    };
+
+
+    template<typename TIndex>
+    size_t CountCacheMisses(const TIndex* indices, size_t nIndices, size_t nVerts, size_t cacheSize)
+    {
+        VertexCache cache(nVerts, cacheSize);
+
+        size_t misses = 0;
+        for (size_t j = 0; j < nIndices; ++j)
+        {
+            if (cache.Access(indices[j]))
+                ++misses;
+        }
+        return misses;
+    }
+
+
+    template<typename TIndex>
+    void ComputeVertexCacheMissRateT(const TIndex* indices, size_t nFaces, size_t nVerts, size_t cacheSize, float& acmr, float& atvr)
+    {
+        acmr = atvr = 0.f;
+
+        CheckIndices(indices, nFaces * 3, nVerts);
+
+        if (!nFaces || !cacheSize)
+            return;
+
+        std::vector<bool> used(nVerts, false);
+        size_t nUsed = 0;
+        for (size_t j = 0; j < nFaces * 3; ++j)
+        {
+            if (!used[indices[j]])
+            {
+                used[indices[j]] = true;
+                ++nUsed;
+            }
+        }
+
+        size_t misses = CountCacheMisses(indices, nFaces * 3, nVerts, cacheSize);
+
+        acmr = float(misses) / float(nFaces);
+        atvr = float(misses) / float(nUsed);
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Tipsify: fan around a vertex, emitting all of its remaining triangles, then move
+    // to the vertex just emitted that will stay in the cache longest while its remaining
+    // triangles are drawn. When none qualifies, back up through recently emitted vertices
+    // and finally scan for any vertex with triangles left.
+    template<typename TIndex>
+    void OptimizeFacesT(TIndex* indices, size_t nFaces, size_t nVerts, size_t cacheSize)
+    {
+        CheckIndices(indices, nFaces * 3, nVerts);
+
+        if (nFaces < 2 || !cacheSize)
+            return;
+
+        // Triangles around each vertex.
+        std::vector<uint32_t> live(nVerts, 0);
+        for (size_t j = 0; j < nFaces * 3; ++j)
+            ++live[indices[j]];
+
+        std::vector<uint32_t> offsets(nVerts + 1, 0);
+        for (size_t v = 0; v < nVerts; ++v)
+            offsets[v + 1] = offsets[v] + live[v];
+
+        std::vector<uint32_t> adjacency(nFaces * 3);
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t j = 0; j < nFaces * 3; ++j)
+                adjacency[fill[indices[j]]++] = static_cast<uint32_t>(j / 3);
+        }
+
+        VertexCache cache(nVerts, cacheSize);
+        std::vector<bool> emitted(nFaces, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<TIndex> result;
+        result.reserve(nFaces * 3);
+        deadEnd.reserve(nFaces * 3);
+
+        size_t cursor = 0;
+        auto skipDeadEnd = [&]() -> size_t
+        {
+            while (!deadEnd.empty())
+            {
+                uint32_t d = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[d] > 0)
+                    return d;
+            }
+
+            for (; cursor < nVerts; ++cursor)
+            {
+                if (live[cursor] > 0)
+                    return cursor;
+            }
+
+            return SIZE_MAX;
+        };
+
+        size_t fan = skipDeadEnd();
+        while (fan != SIZE_MAX)
+        {
+            candidates.clear();
+
+            for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a)
+            {
+                uint32_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    TIndex v = indices[t * 3 + k];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    cache.Access(v);
+                }
+
+                emitted[t] = true;
+            }
+
+            // Prefer the candidate that entered the cache earliest but will still be
+            // in it after its remaining triangles (two new vertices each at most).
+            size_t next = SIZE_MAX;
+            size_t best = 0;
+            for (auto v : candidates)
+            {
+                if (!live[v])
+                    continue;
+
+                size_t priority = 0;
+                if (cache.Age(v) + 2 * live[v] <= cacheSize)
+                    priority = cache.Age(v);
+
+                if (next == SIZE_MAX || priority > best)
+                {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            fan = (next != SIZE_MAX) ? next : skipDeadEnd();
+        }
+
+        // Small fans and caps can come out slightly worse than they went in.
+        if (CountCacheMisses(result.data(), nFaces * 3, nVerts, cacheSize) <= CountCacheMisses(indices, nFaces * 3, nVerts, cacheSize))
+            memcpy(indices, result.data(), nFaces * 3 * sizeof(TIndex));
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Overdraw ordering (after Sander et al.): the face order is cut into clusters and
+    // the clusters are sorted by how far they face away from the mesh centroid. Outward
+    // facing clusters are the likely occluders of a convex-ish mesh, so they go first.
+    //
+    // Clusters end at hard boundaries, triangles that miss the cache on all three
+    // vertices so the cache restarts there anyway, and at soft boundaries, once a
+    // cluster's own miss ratio from a cold cache has come down to the mesh's. Soft
+    // boundaries give smaller clusters at some cost in cache misses; if that cost is
+    // over the threshold only hard boundaries are used.
+    struct Cluster
+    {
+        size_t  start;
+        double  key;
+    };
+
+    template<typename TIndex>
+    void FindClusters(const TIndex* indices, size_t nFaces, size_t nVerts, size_t cacheSize,
+                      const std::vector<bool>& boundary, double softTarget, std::vector<Cluster>& clusters)
+    {
+        clusters.clear();
+
+        VertexCache cache(nVerts, cacheSize);
+        size_t clusterMisses = 0;
+        for (size_t t = 0; t < nFaces; ++t)
+        {
+            if (!t || boundary[t]
+                || (t > clusters.back().start && double(clusterMisses) <= softTarget * double(t - clusters.back().start)))
+            {
+                clusters.push_back({ t, 0.0 });
+                cache.Flush();
+                clusterMisses = 0;
+            }
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                if (cache.Access(indices[t * 3 + k]))
+                    ++clusterMisses;
+            }
+        }
+    }
+
+    // Sort key of each cluster: the distance its area-weighted centroid lies in front of
+    // the mesh centroid along its average normal.
+    template<typename TIndex>
+    void ComputeClusterKeys(const TIndex* indices, size_t nFaces, const uint8_t* vertices, size_t vertexStride,
+                            std::vector<Cluster>& clusters)
+    {
+        auto position = [&](TIndex v, double* p)
+        {
+            float f[3];
+            memcpy(f, vertices + size_t(v) * vertexStride, sizeof(f));
+            p[0] = f[0];
+            p[1] = f[1];
+            p[2] = f[2];
+        };
+
+        size_t nClusters = clusters.size();
+        std::vector<double> centroids(nClusters * 3, 0.0);
+        std::vector<double> normals(nClusters * 3, 0.0);
+
+        double meshCentroid[3] = {};
+        double meshArea = 0.0;
+
+        for (size_t c = 0; c < nClusters; ++c)
+        {
+            double* centroid = &centroids[c * 3];
+            double* normal = &normals[c * 3];
+
+            size_t end = (c + 1 < nClusters) ? clusters[c + 1].start : nFaces;
+
+            double area = 0.0;
+            for (size_t t = clusters[c].start; t < end; ++t)
+            {
+                double p0[3], p1[3], p2[3];
+                position(indices[t * 3], p0);
+                position(indices[t * 3 + 1], p1);
+                position(indices[t * 3 + 2], p2);
+
+                double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                double n[3] =
+                {
+                    e1[1] * e2[2] - e1[2] * e2[1],
+                    e1[2] * e2[0] - e1[0] * e2[2],
+                    e1[0] * e2[1] - e1[1] * e2[0]
+                };
+
+                double a = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    centroid[k] += a * (p0[k] + p1[k] + p2[k]) / 3.0;
+                    normal[k] += n[k];
+                }
+                area += a;
+            }
+
+            for (size_t k = 0; k < 3; ++k)
+                meshCentroid[k] += centroid[k];
+            meshArea += area;
+
+            if (area > 0.0)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                    centroid[k] /= area;
+            }
+        }
+
+        if (meshArea > 0.0)
+        {
+            for (size_t k = 0; k < 3; ++k)
+                meshCentroid[k] /= meshArea;
+        }
+
+        // The sum over the clusters is positive for outward facing triangles, whatever
+        // the winding convention of the mesh, so its sign picks the direction.
+        double total = 0.0;
+        for (size_t c = 0; c < nClusters; ++c)
+        {
+            const double* centroid = &centroids[c * 3];
+            const double* normal = &normals[c * 3];
+
+            double dot = (centroid[0] - meshCentroid[0]) * normal[0]
+                       + (centroid[1] - meshCentroid[1]) * normal[1]
+                       + (centroid[2] - meshCentroid[2]) * normal[2];
+            total += dot;
+
+            double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            clusters[c].key = (length > 0.0) ? dot / length : 0.0;
+        }
+
+        if (total < 0.0)
+        {
+            for (auto& cluster : clusters)
+                cluster.key = -cluster.key;
+        }
+    }
+
+    template<typename TIndex>
+    void OptimizeOverdrawT(TIndex* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                           size_t cacheSize, float threshold)
+    {
+        CheckIndices(indices, nFaces * 3, nVerts);
+
+        if (nFaces < 2 || !cacheSize)
+            return;
+
+        if (!vertices || vertexStride < 3 * sizeof(float))
+            throw std::invalid_argument("Vertices must start with a position");
+
+        std::vector<bool> boundary(nFaces, false);
+        size_t misses = 0;
+        {
+            VertexCache cache(nVerts, cacheSize);
+            for (size_t t = 0; t < nFaces; ++t)
+            {
+                size_t m = 0;
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    if (cache.Access(indices[t * 3 + k]))
+                        ++m;
+                }
+
+                boundary[t] = (m == 3);
+                misses += m;
+            }
+        }
+
+        std::vector<Cluster> clusters;
+        std::vector<size_t> order;
+        std::vector<TIndex> result(nFaces * 3);
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            double softTarget = (pass == 0) ? double(misses) / double(nFaces) : 0.0;
+            FindClusters(indices, nFaces, nVerts, cacheSize, boundary, softTarget, clusters);
+
+            if (clusters.size() < 2)
+                continue;
+
+            ComputeClusterKeys(indices, nFaces, static_cast<const uint8_t*>(vertices), vertexStride, clusters);
+
+            order.resize(clusters.size());
+            for (size_t c = 0; c < clusters.size(); ++c)
+                order[c] = c;
+
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return clusters[a].key > clusters[b].key; });
+
+            TIndex* out = result.data();
+            for (auto c : order)
+            {
+                size_t end = (c + 1 < clusters.size()) ? clusters[c + 1].start : nFaces;
+                size_t count = (end - clusters[c].start) * 3;
+                memcpy(out, indices + clusters[c].start * 3, count * sizeof(TIndex));
+                out += count;
+            }
+
+            size_t newMisses = CountCacheMisses(result.data(), result.size(), nVerts, cacheSize);
+            if (double(newMisses) <= double(misses) * double(threshold))
+            {
+                memcpy(indices, result.data(), nFaces * 3 * sizeof(TIndex));
+                return;
+            }
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Moves each vertex v with remap[v] != UINT32_MAX to slot remap[v] and rewrites the
+    // indices to match; count is the number of vertices kept.
+    template<typename TIndex>
+    void ApplyRemap(TIndex* indices, size_t nIndices, uint8_t* vertices, size_t vertexStride, const std::vector<uint32_t>& remap, size_t count)
+    {
+        std::vector<uint8_t> temp(count * vertexStride);
+        for (size_t v = 0; v < remap.size(); ++v)
+        {
+            if (remap[v] != UINT32_MAX)
+                memcpy(temp.data() + size_t(remap[v]) * vertexStride, vertices + v * vertexStride, vertexStride);
+        }
+
+        if (!temp.empty())
+            memcpy(vertices, temp.data(), temp.size());
+
+        for (size_t j = 0; j < nIndices; ++j)
+            indices[j] = static_cast<TIndex>(remap[indices[j]]);
+    }
+
+
+    template<typename TIndex>
+    size_t OptimizeVerticesT(TIndex* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts)
+    {
+        CheckIndices(indices, nIndices, nVerts);
+
+        std::vector<uint32_t> remap(nVerts, UINT32_MAX);
+
+        uint32_t count = 0;
+        for (size_t j = 0; j < nIndices; ++j)
+        {
+            if (remap[indices[j]] == UINT32_MAX)
+                remap[indices[j]] = count++;
+        }
+
+        ApplyRemap(indices, nIndices, static_cast<uint8_t*>(vertices), vertexStride, remap, count);
+        return count;
+    }
+
+
+    template<typename TIndex>
+    size_t WeldVerticesT(TIndex* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts)
+    {
+        CheckIndices(indices, nIndices, nVerts);
+
+        if (!nVerts)
+            return 0;
+
+        auto verts = static_cast<uint8_t*>(vertices);
+
+        // Open addressing table of the first vertex seen with each content, keyed by
+        // an FNV-1a hash of its bytes.
+        size_t tableSize = 1;
+        while (tableSize < nVerts * 2)
+            tableSize <<= 1;
+
+        std::vector<uint32_t> table(tableSize, UINT32_MAX);
+        std::vector<uint64_t> hashes(nVerts);
+        std::vector<uint32_t> remap(nVerts);
+
+        uint32_t count = 0;
+        for (size_t v = 0; v < nVerts; ++v)
+        {
+            const uint8_t* bytes = verts + v * vertexStride;
+
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t b = 0; b < vertexStride; ++b)
+            {
+                hash ^= bytes[b];
+                hash *= 1099511628211ull;
+            }
+            hashes[v] = hash;
+
+            size_t slot = size_t(hash) & (tableSize - 1);
+            for (;;)
+            {
+                uint32_t other = table[slot];
+                if (other == UINT32_MAX)
+                {
+                    table[slot] = static_cast<uint32_t>(v);
+                    remap[v] = count++;
+                    break;
+                }
+
+                if (hashes[other] == hash && !memcmp(verts + size_t(other) * vertexStride, bytes, vertexStride))
+                {
+                    remap[v] = remap[other];
+                    break;
+                }
+
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+
+        if (count == nVerts)
+            return nVerts;
+
+        // Kept vertices only move down, in order, so they can be compacted in place.
+        uint32_t next = 0;
+        for (size_t v = 0; v < nVerts; ++v)
+        {
+            if (remap[v] == next)
+            {
+                if (next != v)
+                    memcpy(verts + size_t(next) * vertexStride, verts + v * vertexStride, vertexStride);
+                ++next;
+            }
+        }
+
+        for (size_t j = 0; j < nIndices; ++j)
+            indices[j] = static_cast<TIndex>(remap[indices[j]]);
+
+        return count;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vertex cache statistics
+//--------------------------------------------------------------------------------------
+
+void DirectX::ComputeVertexCacheMissRate(const uint16_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize, float& acmr, float& atvr)
+{
+    ComputeVertexCacheMissRateT(indices, nFaces, nVerts, cacheSize, acmr, atvr);
+}
+
+
+void DirectX::ComputeVertexCacheMissRate(const uint32_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize, float& acmr, float& atvr)
+{
+    ComputeVertexCacheMissRateT(indices, nFaces, nVerts, cacheSize, acmr, atvr);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Face ordering
+//--------------------------------------------------------------------------------------
+
+void DirectX::OptimizeFaces(uint16_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize)
+{
+    OptimizeFacesT(indices, nFaces, nVerts, cacheSize);
+}
+
+
+void DirectX::OptimizeFaces(uint32_t* indices, size_t nFaces, size_t nVerts, size_t cacheSize)
+{
+    OptimizeFacesT(indices, nFaces, nVerts, cacheSize);
+}
+
+
+void DirectX::OptimizeOverdraw(uint16_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                               size_t cacheSize, float threshold)
+{
+    OptimizeOverdrawT(indices, nFaces, vertices, vertexStride, nVerts, cacheSize, threshold);
+}
+
+
+void DirectX::OptimizeOverdraw(uint32_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                               size_t cacheSize, float threshold)
+{
+    OptimizeOverdrawT(indices, nFaces, vertices, vertexStride, nVerts, cacheSize, threshold);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vertex ordering
+//--------------------------------------------------------------------------------------
+
+size_t DirectX::OptimizeVertices(uint16_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts)
+{
+    return OptimizeVerticesT(indices, nIndices, vertices, vertexStride, nVerts);
+}
+
+
+size_t DirectX::OptimizeVertices(uint32_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts)
+{
+    return OptimizeVerticesT(indices, nIndices, vertices, vertexStride, nVerts);
+}
+
+
+size_t DirectX::WeldVertices(uint16_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts)
+{
+    return WeldVerticesT(indices, nIndices, vertices, vertexStride, nVerts);
+}
+
+
+size_t DirectX::WeldVertices(uint32_t* indices, size_t nIndices, void* vertices, size_t vertexStride, size_t nVerts)
+{
+    return WeldVerticesT(indices, nIndices, vertices, vertexStride, nVerts);
+}
@@ -0,0 +1,707 @@
+//--------------------------------------------------------------------------------------
+// File: MeshSimplifier.cpp
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+// Built without the precompiled header so it does not depend on Direct3D.
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+
+namespace
+{
+    // Open border edges are held in place by a plane through the edge, perpendicular
+    // to its triangle, this many times heavier than the triangle's own plane.
+    const double c_BorderWeight = 10.0;
+
+    // A vertex split into more attribute sets than this is not collapsed.
+    const size_t c_MaxWedges = 8;
+
+    // Nor is a vertex with more distinct neighbours than this.
+    const size_t c_MaxRing = 32;
+
+    enum VertexKind : uint8_t
+    {
+        Kind_Interior,
+        Kind_Border,        // on one open border
+        Kind_Locked,        // where borders meet, or on a non-manifold edge
+    };
+
+    struct Position
+    {
+        double x, y, z;
+    };
+
+    inline Position Sub(const Position& a, const Position& b)
+    {
+        Position r = { a.x - b.x, a.y - b.y, a.z - b.z };
+        return r;
+    }
+
+    inline Position Cross(const Position& a, const Position& b)
+    {
+        Position r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        return r;
+    }
+
+    inline double Dot(const Position& a, const Position& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+
+    // Sum of weighted squared distances to a set of planes; divided by the total
+    // weight it is a mean squared distance, so errors are in position units.
+    struct Quadric
+    {
+        double a2, b2, c2, d2;
+        double ab, ac, ad;
+        double bc, bd;
+        double cd;
+        double w;
+
+        void AddPlane(const Position& n, double d, double weight)
+        {
+            a2 += weight * n.x * n.x;
+            b2 += weight * n.y * n.y;
+            c2 += weight * n.z * n.z;
+            d2 += weight * d * d;
+            ab += weight * n.x * n.y;
+            ac += weight * n.x * n.z;
+            ad += weight * n.x * d;
+            bc += weight * n.y * n.z;
+            bd += weight * n.y * d;
+            cd += weight * n.z * d;
+            w += weight;
+        }
+
+        void Add(const Quadric& q)
+        {
+            a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+            ab += q.ab; ac += q.ac; ad += q.ad;
+            bc += q.bc; bd += q.bd;
+            cd += q.cd;
+            w += q.w;
+        }
+
+        double Error(const Position& p) const
+        {
+            double e = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z + d2
+                     + 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+                     + 2.0 * (ad * p.x + bd * p.y + cd * p.z);
+            return (w > 0.0) ? fabs(e) / w : 0.0;
+        }
+    };
+
+    inline double Sum(const Quadric& a, const Quadric& b, const Position& p)
+    {
+        Quadric q = a;
+        q.Add(b);
+        return q.Error(p);
+    }
+
+
+    struct Collapse
+    {
+        double      cost;
+        uint32_t    from;
+        uint32_t    to;
+    };
+
+
+    // Orders collapses cheapest first. Only roughly matters, so they are counting
+    // sorted by the exponent and top mantissa bits of their cost as a float, which
+    // keeps the candidates of a bucket in the order they were found.
+    void SortByCost(const std::vector<Collapse>& candidates, std::vector<Collapse>& sorted)
+    {
+        const uint32_t c_SortBits = 11;
+
+        auto key = [](double cost) -> uint32_t
+        {
+            auto f = static_cast<float>(cost);
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            return bits >> (32 - c_SortBits);
+        };
+
+        std::vector<uint32_t> offsets((1u << c_SortBits) + 1, 0);
+        for (auto& c : candidates)
+            ++offsets[key(c.cost) + 1];
+
+        for (size_t j = 1; j < offsets.size(); ++j)
+            offsets[j] += offsets[j - 1];
+
+        sorted.resize(candidates.size());
+        for (auto& c : candidates)
+            sorted[offsets[key(c.cost)]++] = c;
+    }
+
+
+    class Simplifier
+    {
+    public:
+        // Works on the vertices in used only, numbered by their place in it.
+        Simplifier(const uint8_t* vertices, size_t stride, const std::vector<uint32_t>& used);
+
+        size_t Run(std::vector<uint32_t>& tris, size_t targetFaces, float maxError, float* resultError);
+
+    private:
+        uint32_t Corner(size_t tri, size_t k) const { return mRemap[(*mTris)[tri * 3 + k]]; }
+        uint32_t PositionOf(uint32_t v) const { return mPositionOf[v]; }
+
+        // Whether a triangle had the directed edge a -> b at the start of the pass.
+        bool HasEdge(uint32_t a, uint32_t b) const
+        {
+            for (uint32_t j = mAdjOffsets[a]; j < mAdjOffsets[a + 1]; ++j)
+            {
+                if (mAdjNext[j] == b)
+                    return true;
+            }
+            return false;
+        }
+
+        size_t RemoveDegenerate();
+        void BuildAdjacency();
+        void Classify(bool addBorderPlanes);
+        bool CanMove(uint32_t from, uint32_t to) const;
+        bool CanCollapse(uint32_t from, uint32_t to, uint32_t* wedges, uint32_t* partners, size_t& nWedges, size_t& removed) const;
+
+        std::vector<Position>   mPositions;
+        std::vector<uint32_t>   mPositionOf;    // first vertex with the same position
+        std::vector<Quadric>    mQuadrics;      // by position
+        std::vector<uint8_t>    mKinds;         // by position
+        std::vector<uint32_t>   mRemap;         // collapses made in the current pass
+        std::vector<uint32_t>   mAdjOffsets;    // triangles around each position
+        std::vector<uint32_t>   mAdjTris;
+        std::vector<uint32_t>   mAdjNext;       // positions following and preceding
+        std::vector<uint32_t>   mAdjPrev;       // it in each of those triangles
+        std::vector<uint32_t>*  mTris;
+    };
+
+
+    Simplifier::Simplifier(const uint8_t* vertices, size_t stride, const std::vector<uint32_t>& used) :
+        mPositions(used.size()),
+        mPositionOf(used.size()),
+        mQuadrics(used.size()),
+        mKinds(used.size()),
+        mRemap(used.size()),
+        mTris(nullptr)
+    {
+        // Weld by exact position with an open-addressing table.
+        size_t tableSize = 1;
+        while (tableSize < used.size() * 2)
+            tableSize <<= 1;
+
+        std::vector<uint32_t> table(tableSize, UINT32_MAX);
+        for (size_t v = 0; v < used.size(); ++v)
+        {
+            const uint8_t* position = vertices + used[v] * stride;
+
+            float p[3];
+            memcpy(p, position, sizeof(p));
+            mPositions[v].x = p[0];
+            mPositions[v].y = p[1];
+            mPositions[v].z = p[2];
+
+            uint32_t bits[3];
+            memcpy(bits, p, sizeof(bits));
+            uint32_t h = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+
+            size_t slot = h & (tableSize - 1);
+            for (;;)
+            {
+                uint32_t other = table[slot];
+                if (other == UINT32_MAX)
+                {
+                    table[slot] = static_cast<uint32_t>(v);
+                    mPositionOf[v] = static_cast<uint32_t>(v);
+                    break;
+                }
+
+                if (!memcmp(vertices + used[other] * stride, position, sizeof(p)))
+                {
+                    mPositionOf[v] = other;
+                    break;
+                }
+
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+
+        memset(mQuadrics.data(), 0, mQuadrics.size() * sizeof(Quadric));
+    }
+
+
+    // Applies the collapses of the pass and drops the triangles they degenerated.
+    size_t Simplifier::RemoveDegenerate()
+    {
+        auto& tris = *mTris;
+        size_t nFaces = tris.size() / 3;
+
+        size_t write = 0;
+        for (size_t t = 0; t < nFaces; ++t)
+        {
+            uint32_t c[3] = { Corner(t, 0), Corner(t, 1), Corner(t, 2) };
+            uint32_t p[3] = { PositionOf(c[0]), PositionOf(c[1]), PositionOf(c[2]) };
+            if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+                continue;
+
+            tris[write++] = c[0];
+            tris[write++] = c[1];
+            tris[write++] = c[2];
+        }
+
+        for (size_t v = 0; v < mRemap.size(); ++v)
+            mRemap[v] = static_cast<uint32_t>(v);
+
+        tris.resize(write);
+        return write / 3;
+    }
+
+
+    void Simplifier::BuildAdjacency()
+    {
+        auto& tris = *mTris;
+        size_t nFaces = tris.size() / 3;
+
+        mAdjOffsets.assign(mPositions.size() + 1, 0);
+        for (size_t t = 0; t < nFaces; ++t)
+        {
+            for (size_t k = 0; k < 3; ++k)
+                ++mAdjOffsets[PositionOf(Corner(t, k)) + 1];
+        }
+
+        for (size_t v = 0; v < mPositions.size(); ++v)
+            mAdjOffsets[v + 1] += mAdjOffsets[v];
+
+        mAdjTris.resize(nFaces * 3);
+        mAdjNext.resize(nFaces * 3);
+        mAdjPrev.resize(nFaces * 3);
+        std::vector<uint32_t> fill(mAdjOffsets.begin(), mAdjOffsets.end() - 1);
+        for (size_t t = 0; t < nFaces; ++t)
+        {
+            uint32_t p[3] = { PositionOf(Corner(t, 0)), PositionOf(Corner(t, 1)), PositionOf(Corner(t, 2)) };
+            for (size_t k = 0; k < 3; ++k)
+            {
+                uint32_t j = fill[p[k]]++;
+                mAdjTris[j] = static_cast<uint32_t>(t);
+                mAdjNext[j] = p[(k + 1) % 3];
+                mAdjPrev[j] = p[(k + 2) % 3];
+            }
+        }
+    }
+
+
+    // Finds the open and non-manifold edges and classifies the positions by them. The
+    // first time round, planes holding the open borders are added to the quadrics.
+    // Every edge of a position is on a triangle around it, so this only looks there.
+    void Simplifier::Classify(bool addBorderPlanes)
+    {
+        for (uint32_t v = 0; v < mPositions.size(); ++v)
+        {
+            uint32_t begin = mAdjOffsets[v];
+            uint32_t end = mAdjOffsets[v + 1];
+
+            size_t openEdges = 0;
+            bool manifold = true;
+
+            for (uint32_t j = begin; j < end && manifold; ++j)
+            {
+                uint32_t next = mAdjNext[j];
+                uint32_t prev = mAdjPrev[j];
+
+                size_t outgoing = 0;
+                size_t incoming = 0;
+                bool nextReturns = false;
+                bool prevLeaves = false;
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    uint32_t otherNext = mAdjNext[i];
+                    uint32_t otherPrev = mAdjPrev[i];
+                    outgoing += (otherNext == next);
+                    incoming += (otherPrev == prev);
+                    nextReturns |= (otherPrev == next);
+                    prevLeaves |= (otherNext == prev);
+                }
+
+                // An edge used twice in the same direction
+                if (outgoing > 1 || incoming > 1)
+                {
+                    manifold = false;
+                    break;
+                }
+
+                if (!prevLeaves)
+                    ++openEdges;
+
+                if (nextReturns)
+                    continue;
+
+                ++openEdges;
+
+                if (!addBorderPlanes)
+                    continue;
+
+                Position normal = Cross(Sub(mPositions[next], mPositions[v]), Sub(mPositions[prev], mPositions[v]));
+                Position edge = Sub(mPositions[next], mPositions[v]);
+
+                Position n = Cross(edge, normal);
+                double length = sqrt(Dot(n, n));
+                if (length <= 0.0)
+                    continue;
+
+                n.x /= length; n.y /= length; n.z /= length;
+                double d = -Dot(n, mPositions[v]);
+                double weight = Dot(edge, edge) * c_BorderWeight;
+
+                mQuadrics[v].AddPlane(n, d, weight);
+                mQuadrics[next].AddPlane(n, d, weight);
+            }
+
+            if (!manifold)
+                mKinds[v] = Kind_Locked;
+            else if (!openEdges)
+                mKinds[v] = Kind_Interior;
+            else
+                mKinds[v] = (openEdges == 2) ? Kind_Border : Kind_Locked;
+        }
+    }
+
+
+    // Whether the kinds of the positions allow from to merge into to.
+    bool Simplifier::CanMove(uint32_t from, uint32_t to) const
+    {
+        if (mKinds[from] == Kind_Locked)
+            return false;
+
+        // Border vertices only slide along their border
+        if (mKinds[from] == Kind_Border && HasEdge(from, to) && HasEdge(to, from))
+            return false;
+
+        return true;
+    }
+
+
+    // Whether the position from can merge into the position to. On success, each
+    // vertex at from (wedges) is paired with the vertex at to it merges into, found
+    // from a triangle using both, and removed counts the triangles that degenerate.
+    bool Simplifier::CanCollapse(uint32_t from, uint32_t to, uint32_t* wedges, uint32_t* partners, size_t& nWedges, size_t& removed) const
+    {
+        if (!CanMove(from, to))
+            return false;
+
+        nWedges = 0;
+        removed = 0;
+
+        uint32_t ringFrom[c_MaxRing];
+        size_t nRingFrom = 0;
+
+        for (uint32_t j = mAdjOffsets[from]; j < mAdjOffsets[from + 1]; ++j)
+        {
+            uint32_t t = mAdjTris[j];
+            uint32_t c[3] = { Corner(t, 0), Corner(t, 1), Corner(t, 2) };
+            uint32_t p[3] = { PositionOf(c[0]), PositionOf(c[1]), PositionOf(c[2]) };
+
+            // Skip triangles already degenerate from other collapses this pass
+            if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+                continue;
+
+            size_t kFrom = (p[0] == from) ? 0 : (p[1] == from) ? 1 : 2;
+            size_t kTo = (p[0] == to) ? 0 : (p[1] == to) ? 1 : (p[2] == to) ? 2 : 3;
+
+            size_t w = 0;
+            while (w < nWedges && wedges[w] != c[kFrom])
+                ++w;
+
+            if (w == nWedges)
+            {
+                if (nWedges == c_MaxWedges)
+                    return false;
+
+                wedges[nWedges] = c[kFrom];
+                partners[nWedges] = UINT32_MAX;
+                ++nWedges;
+            }
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                if (k == kFrom || std::find(ringFrom, ringFrom + nRingFrom, p[k]) != ringFrom + nRingFrom)
+                    continue;
+
+                if (nRingFrom == c_MaxRing)
+                    return false;
+
+                ringFrom[nRingFrom++] = p[k];
+            }
+
+            if (kTo < 3)
+            {
+                // Degenerates; pairs the wedges
+                if (partners[w] == UINT32_MAX)
+                    partners[w] = c[kTo];
+                else if (partners[w] != c[kTo])
+                    return false;
+
+                ++removed;
+                continue;
+            }
+
+            // Must not flip over
+            Position a = mPositions[p[0]];
+            Position b = mPositions[p[1]];
+            Position cc = mPositions[p[2]];
+            Position before = Cross(Sub(b, a), Sub(cc, a));
+
+            Position* moved = (kFrom == 0) ? &a : (kFrom == 1) ? &b : &cc;
+            *moved = mPositions[to];
+            Position after = Cross(Sub(b, a), Sub(cc, a));
+
+            if (Dot(before, after) <= 0.0)
+                return false;
+        }
+
+        if (!removed)
+            return false;
+
+        for (size_t w = 0; w < nWedges; ++w)
+        {
+            if (partners[w] == UINT32_MAX)
+                return false;
+        }
+
+        // Link condition: the neighbours the two have in common must be exactly the
+        // ones opposite the edge, or the collapse would pinch the surface.
+        size_t common = 0;
+        for (uint32_t j = mAdjOffsets[to]; j < mAdjOffsets[to + 1]; ++j)
+        {
+            uint32_t t = mAdjTris[j];
+            for (size_t k = 0; k < 3; ++k)
+            {
+                uint32_t p = PositionOf(Corner(t, k));
+                if (p == to || p == from)
+                    continue;
+
+                for (size_t r = 0; r < nRingFrom; ++r)
+                {
+                    if (ringFrom[r] == p)
+                    {
+                        // Count each shared neighbour once
+                        ringFrom[r] = UINT32_MAX;
+                        ++common;
+                        break;
+                    }
+                }
+            }
+        }
+
+        return common <= removed;
+    }
+
+
+    size_t Simplifier::Run(std::vector<uint32_t>& tris, size_t targetFaces, float maxError, float* resultError)
+    {
+        mTris = &tris;
+        for (size_t v = 0; v < mRemap.size(); ++v)
+            mRemap[v] = static_cast<uint32_t>(v);
+
+        // Triangles with two corners at one position have no surface to keep
+        size_t nFaces = RemoveDegenerate();
+
+        // Plane of each triangle, weighted by area, on each of its corners
+        for (size_t t = 0; t < nFaces; ++t)
+        {
+            uint32_t p[3] = { PositionOf(tris[t * 3]), PositionOf(tris[t * 3 + 1]), PositionOf(tris[t * 3 + 2]) };
+
+            Position normal = Cross(Sub(mPositions[p[1]], mPositions[p[0]]), Sub(mPositions[p[2]], mPositions[p[0]]));
+            double length = sqrt(Dot(normal, normal));
+            if (length <= 0.0)
+                continue;
+
+            normal.x /= length; normal.y /= length; normal.z /= length;
+            double d = -Dot(normal, mPositions[p[0]]);
+
+            for (size_t k = 0; k < 3; ++k)
+                mQuadrics[p[k]].AddPlane(normal, d, length * 0.5);
+        }
+
+        const double maxCost = double(maxError) * double(maxError);
+        double worst = 0.0;
+
+        std::vector<Collapse> candidates;
+        std::vector<Collapse> sorted;
+        std::vector<uint8_t> touched(mPositions.size());
+
+        uint32_t wedges[c_MaxWedges];
+        uint32_t partners[c_MaxWedges];
+        size_t nWedges;
+        size_t removed;
+
+        // Each pass collapses the cheapest edges that do not share a vertex, so costs
+        // and adjacency only need rebuilding between passes.
+        for (bool first = true; nFaces > targetFaces; first = false)
+        {
+            BuildAdjacency();
+            Classify(first);
+
+            // Each edge once: from its lower position, or from the only triangle with it
+            candidates.clear();
+            for (uint32_t a = 0; a < mPositions.size(); ++a)
+            {
+                for (uint32_t j = mAdjOffsets[a]; j < mAdjOffsets[a + 1]; ++j)
+                {
+                    uint32_t b = mAdjNext[j];
+                    if (b < a && HasEdge(b, a))
+                        continue;
+
+                    Collapse best = { maxCost, 0, 0 };
+                    bool found = false;
+
+                    // The full check waits until the collapse is about to be made; most
+                    // edges are never reached in a pass.
+                    if (CanMove(a, b))
+                    {
+                        double cost = Sum(mQuadrics[a], mQuadrics[b], mPositions[b]);
+                        if (cost <= best.cost)
+                        {
+                            best = { cost, a, b };
+                            found = true;
+                        }
+                    }
+
+                    if (CanMove(b, a))
+                    {
+                        double cost = Sum(mQuadrics[a], mQuadrics[b], mPositions[a]);
+                        if (cost <= best.cost)
+                        {
+                            best = { cost, b, a };
+                            found = true;
+                        }
+                    }
+
+                    if (found)
+                        candidates.push_back(best);
+                }
+            }
+
+            if (candidates.empty())
+                break;
+
+            SortByCost(candidates, sorted);
+
+            std::fill(touched.begin(), touched.end(), uint8_t(0));
+
+            size_t toRemove = nFaces - targetFaces;
+            size_t removedTotal = 0;
+            for (auto& c : sorted)
+            {
+                if (removedTotal >= toRemove)
+                    break;
+
+                if (touched[c.from] || touched[c.to])
+                    continue;
+
+                // Neighbours may have moved since the candidates were costed
+                if (!CanCollapse(c.from, c.to, wedges, partners, nWedges, removed))
+                    continue;
+
+                for (size_t w = 0; w < nWedges; ++w)
+                    mRemap[wedges[w]] = partners[w];
+
+                mQuadrics[c.to].Add(mQuadrics[c.from]);
+                touched[c.from] = touched[c.to] = 1;
+
+                removedTotal += removed;
+                worst = std::max(worst, c.cost);
+            }
+
+            if (!removedTotal)
+                break;
+
+            nFaces = RemoveDegenerate();
+        }
+
+        if (resultError)
+            *resultError = float(sqrt(worst));
+
+        mTris = nullptr;
+        return nFaces;
+    }
+
+
+    template<typename TIndex>
+    size_t SimplifyMeshT(const TIndex* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                         size_t targetFaces, float maxError, TIndex* destIndices, float* resultError)
+    {
+        if (nVerts >= UINT32_MAX)
+            throw std::invalid_argument("Too many vertices");
+
+        for (size_t j = 0; j < nFaces * 3; ++j)
+        {
+            if (indices[j] >= nVerts)
+                throw std::out_of_range("Invalid index found");
+        }
+
+        if (resultError)
+            *resultError = 0.f;
+
+        if (nFaces <= targetFaces)
+        {
+            if (destIndices != indices)
+                memmove(destIndices, indices, nFaces * 3 * sizeof(TIndex));
+            return nFaces;
+        }
+
+        if (!vertices || vertexStride < 3 * sizeof(float))
+            throw std::invalid_argument("Vertices must start with a position");
+
+        // Renumber the vertices used, so the cost of a pass does not depend on the
+        // size of a vertex buffer shared with other submeshes.
+        std::vector<uint32_t> tris(nFaces * 3);
+        std::vector<uint32_t> used;
+        {
+            std::vector<uint32_t> local(nVerts, UINT32_MAX);
+            for (size_t j = 0; j < nFaces * 3; ++j)
+            {
+                uint32_t& v = local[indices[j]];
+                if (v == UINT32_MAX)
+                {
+                    v = static_cast<uint32_t>(used.size());
+                    used.push_back(indices[j]);
+                }
+                tris[j] = v;
+            }
+        }
+
+        Simplifier simplifier(static_cast<const uint8_t*>(vertices), vertexStride, used);
+        nFaces = simplifier.Run(tris, targetFaces, maxError, resultError);
+
+        for (size_t j = 0; j < nFaces * 3; ++j)
+            destIndices[j] = static_cast<TIndex>(used[tris[j]]);
+
+        return nFaces;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+size_t DirectX::SimplifyMesh(const uint16_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                             size_t targetFaces, float maxError, uint16_t* destIndices, float* resultError)
+{
+    return SimplifyMeshT(indices, nFaces, vertices, vertexStride, nVerts, targetFaces, maxError, destIndices, resultError);
+}
+
+
+size_t DirectX::SimplifyMesh(const uint32_t* indices, size_t nFaces, const void* vertices, size_t vertexStride, size_t nVerts,
+                             size_t targetFaces, float maxError, uint32_t* destIndices, float* resultError)
+{
+    return SimplifyMeshT(indices, nFaces, vertices, vertexStride, nVerts, targetFaces, maxError, destIndices, resultError);
+}
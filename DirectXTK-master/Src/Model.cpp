@@ -198,6 +198,50 @@ void ModelMesh::PrepareForRendering(
 }
 
 
+_Use_decl_annotations_
+size_t XM_CALLCONV ModelMesh::SelectLOD(
+    FXMMATRIX world,
+    CXMMATRIX view,
+    CXMMATRIX projection,
+    float screenError) const
+{
+    assert(lodParts.size() == lodErrors.size());
+
+    if (lodErrors.empty() || screenError <= 0.f)
+        return 0;
+
+    // Errors and the bounds scale with the largest axis of the world matrix
+    float scale = std::max(std::max(XMVectorGetX(XMVector3LengthSq(world.r[0])),
+                                    XMVectorGetX(XMVector3LengthSq(world.r[1]))),
+                           XMVectorGetX(XMVector3LengthSq(world.r[2])));
+    scale = sqrtf(scale);
+
+    XMVECTOR center = XMVector3Transform(XMLoadFloat3(&boundingSphere.Center), XMMatrixMultiply(world, view));
+    float distance = XMVectorGetX(XMVector3Length(center)) - boundingSphere.Radius * scale;
+
+    // Viewport heights covered by a unit of error at the nearest point of the bounds;
+    // projection._22 maps view space to the [-1, 1] range of the height, divided by
+    // depth unless the projection is orthographic (_34 is 0).
+    XMFLOAT4X4 proj;
+    XMStoreFloat4x4(&proj, projection);
+
+    float heights = fabsf(proj._22) * 0.5f;
+    if (proj._34 != 0.f)
+    {
+        if (distance <= 0.f)
+            return 0;
+
+        heights /= distance;
+    }
+
+    size_t lod = 0;
+    while (lod < lodErrors.size() && lodErrors[lod] * scale * heights <= screenError)
+        ++lod;
+
+    return lod;
+}
+
+
 _Use_decl_annotations_
 void XM_CALLCONV ModelMesh::Draw(
     ID3D11DeviceContext* deviceContext,
@@ -205,11 +249,14 @@ void XM_CALLCONV ModelMesh::Draw(
     CXMMATRIX view,
     CXMMATRIX projection,
     bool alpha,
-    std::function<void()> setCustomState) const
+    std::function<void()> setCustomState,
+    size_t lod) const
 {
     assert(deviceContext != 0);
 
-    for (auto it = meshParts.cbegin(); it != meshParts.cend(); ++it)
+    auto& parts = (lod > 0 && lod <= lodParts.size()) ? lodParts[lod - 1] : meshParts;
+
+    for (auto it = parts.cbegin(); it != parts.cend(); ++it)
     {
         auto part = (*it).get();
         assert(part != 0);
@@ -235,6 +282,12 @@ void XM_CALLCONV ModelMesh::Draw(
 // Model
 //--------------------------------------------------------------------------------------
 
+Model::Model() :
+    lodScreenError(1.f / 1080.f)
+{
+}
+
+
 Model::~Model()
 {
 }
@@ -259,7 +312,8 @@ void XM_CALLCONV Model::Draw(
 
         mesh->PrepareForRendering(deviceContext, states, false, wireframe);
 
-        mesh->Draw(deviceContext, world, view, projection, false, setCustomState);
+        size_t lod = mesh->SelectLOD(world, view, projection, lodScreenError);
+        mesh->Draw(deviceContext, world, view, projection, false, setCustomState, lod);
     }
 
     // Draw alpha parts
@@ -270,7 +324,8 @@ void XM_CALLCONV Model::Draw(
 
         mesh->PrepareForRendering(deviceContext, states, true, wireframe);
 
-        mesh->Draw(deviceContext, world, view, projection, true, setCustomState);
+        size_t lod = mesh->SelectLOD(world, view, projection, lodScreenError);
+        mesh->Draw(deviceContext, world, view, projection, true, setCustomState, lod);
     }
 }
 
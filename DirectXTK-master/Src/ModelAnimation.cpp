@@ -0,0 +1,286 @@
+//--------------------------------------------------------------------------------------
+// File: ModelAnimation.cpp
+//
+// Built without the precompiled header so it does not depend on Direct3D.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "ModelAnimation.h"
+#include "ModelData.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+
+//--------------------------------------------------------------------------------------
+// ModelAnimation
+//--------------------------------------------------------------------------------------
+
+ModelAnimation::ModelAnimation()
+{
+}
+
+
+ModelAnimation::~ModelAnimation()
+{
+}
+
+
+std::unique_ptr<ModelAnimation> ModelAnimation::CreateFromModelData(const ModelData& modelData, size_t meshIndex)
+{
+    if (meshIndex >= modelData.meshes.size())
+        throw std::out_of_range("meshIndex");
+
+    auto& mesh = modelData.meshes[meshIndex];
+    if (!mesh.boneCount)
+        return nullptr;
+
+    std::unique_ptr<ModelAnimation> anim(new ModelAnimation());
+
+    // Skeleton
+    const size_t nBones = mesh.boneCount;
+    anim->mBoneNames.reserve(nBones);
+    anim->mParents.reserve(nBones);
+    anim->mInvBindPose.reserve(nBones);
+    anim->mBindLocal.reserve(nBones);
+
+    std::vector<std::vector<uint32_t>> children(nBones);
+    std::vector<uint32_t> roots;
+    for (size_t j = 0; j < nBones; ++j)
+    {
+        auto& bone = modelData.bones[mesh.firstBone + j];
+
+        anim->mBoneNames.push_back(bone.name);
+        anim->mParents.push_back(bone.parentIndex);
+        anim->mInvBindPose.push_back(bone.invBindPos);
+        anim->mBindLocal.push_back(bone.localTransform);
+
+        if (bone.parentIndex >= static_cast<int32_t>(nBones))
+            throw std::runtime_error("Invalid bone parent");
+
+        if (bone.parentIndex < 0)
+            roots.push_back(static_cast<uint32_t>(j));
+        else
+            children[bone.parentIndex].push_back(static_cast<uint32_t>(j));
+    }
+
+    // Parents before children, so a single pass can compose the hierarchy. Bones that
+    // are never reached are part of a cycle.
+    anim->mOrder.reserve(nBones);
+    std::vector<uint32_t> stack(roots.rbegin(), roots.rend());
+    while (!stack.empty())
+    {
+        uint32_t bone = stack.back();
+        stack.pop_back();
+
+        anim->mOrder.push_back(bone);
+        stack.insert(stack.end(), children[bone].rbegin(), children[bone].rend());
+    }
+
+    if (anim->mOrder.size() != nBones)
+        throw std::runtime_error("Invalid bone hierarchy");
+
+    // Clips
+    std::vector<ModelData::Keyframe> keys;
+    std::vector<uint32_t> keyOrder;
+    std::vector<uint32_t> bucket;
+
+    anim->mClips.reserve(mesh.clipCount);
+    for (size_t c = 0; c < mesh.clipCount; ++c)
+    {
+        auto& clip = modelData.clips[mesh.firstClip + c];
+
+        ClipInfo info;
+        info.name = clip.name;
+        info.startTime = clip.startTime;
+        info.endTime = clip.endTime;
+        info.firstTrack = anim->mTracks.size();
+        anim->mClips.emplace_back(std::move(info));
+
+        // Keys may not be aligned in the source, so copy them out first.
+        keys.resize(clip.keyCount);
+        if (clip.keyCount)
+            memcpy(keys.data(), modelData.GetData(clip.keys), sizeof(ModelData::Keyframe) * clip.keyCount);
+
+        // Counting sort by bone, then stable sort each track by time.
+        bucket.assign(nBones + 1, 0);
+        for (auto& key : keys)
+        {
+            if (key.boneIndex >= nBones)
+                throw std::runtime_error("Invalid keyframe bone index");
+
+            ++bucket[key.boneIndex + 1];
+        }
+
+        for (size_t j = 0; j < nBones; ++j)
+        {
+            bucket[j + 1] += bucket[j];
+        }
+
+        keyOrder.resize(keys.size());
+        {
+            std::vector<uint32_t> next(bucket.begin(), bucket.end() - 1);
+            for (uint32_t k = 0; k < keys.size(); ++k)
+            {
+                keyOrder[next[keys[k].boneIndex]++] = k;
+            }
+        }
+
+        for (size_t j = 0; j < nBones; ++j)
+        {
+            auto first = keyOrder.begin() + bucket[j];
+            auto last = keyOrder.begin() + bucket[j + 1];
+            std::stable_sort(first, last, [&keys](uint32_t a, uint32_t b)
+            {
+                return keys[a].time < keys[b].time;
+            });
+
+            Track track;
+            track.firstKey = static_cast<uint32_t>(anim->mKeyTimes.size());
+            track.keyCount = bucket[j + 1] - bucket[j];
+            anim->mTracks.push_back(track);
+
+            for (auto it = first; it != last; ++it)
+            {
+                auto& key = keys[*it];
+
+                XMVECTOR s, q, t;
+                if (!XMMatrixDecompose(&s, &q, &t, XMLoadFloat4x4(&key.transform)))
+                {
+                    // Degenerate scale; keep the translation and collapse the rest.
+                    s = XMVectorZero();
+                    q = XMQuaternionIdentity();
+                    t = XMLoadFloat4x4(&key.transform).r[3];
+                }
+
+                XMFLOAT3 scale, translation;
+                XMFLOAT4 rotation;
+                XMStoreFloat3(&scale, s);
+                XMStoreFloat4(&rotation, q);
+                XMStoreFloat3(&translation, t);
+
+                anim->mKeyTimes.push_back(key.time);
+                anim->mKeyScales.push_back(scale);
+                anim->mKeyRotations.push_back(rotation);
+                anim->mKeyTranslations.push_back(translation);
+            }
+        }
+    }
+
+    return anim;
+}
+
+
+int32_t ModelAnimation::FindBone(const wchar_t* name) const
+{
+    for (size_t j = 0; j < mBoneNames.size(); ++j)
+    {
+        if (mBoneNames[j] == name)
+            return static_cast<int32_t>(j);
+    }
+    return -1;
+}
+
+
+int32_t ModelAnimation::FindClip(const wchar_t* name) const
+{
+    for (size_t j = 0; j < mClips.size(); ++j)
+    {
+        if (mClips[j].name == name)
+            return static_cast<int32_t>(j);
+    }
+    return -1;
+}
+
+
+void ModelAnimation::Evaluate(size_t clip, float time, bool loop, XMMATRIX* boneTransforms) const
+{
+    EvaluateWorld(clip, time, loop, boneTransforms);
+
+    for (size_t j = 0; j < mParents.size(); ++j)
+    {
+        boneTransforms[j] = XMMatrixMultiply(XMLoadFloat4x4(&mInvBindPose[j]), boneTransforms[j]);
+    }
+}
+
+
+void ModelAnimation::EvaluateWorld(size_t clip, float time, bool loop, XMMATRIX* boneWorld) const
+{
+    if (clip >= mClips.size())
+        throw std::out_of_range("clip");
+
+    assert(boneWorld != nullptr);
+
+    auto& info = mClips[clip];
+    float t = ClipTime(info, time, loop);
+
+    const Track* tracks = mTracks.data() + info.firstTrack;
+    for (auto bone : mOrder)
+    {
+        XMMATRIX local = SampleTrack(tracks[bone], bone, t);
+
+        int32_t parent = mParents[bone];
+        boneWorld[bone] = (parent < 0) ? local : XMMatrixMultiply(local, boneWorld[parent]);
+    }
+}
+
+
+float ModelAnimation::ClipTime(const ClipInfo& clip, float time, bool loop) const
+{
+    float duration = clip.endTime - clip.startTime;
+    if (!(duration > 0.f))
+        return clip.startTime;
+
+    if (loop)
+    {
+        float t = fmodf(time - clip.startTime, duration);
+        if (t < 0.f)
+            t += duration;
+        return clip.startTime + t;
+    }
+
+    return std::min(std::max(time, clip.startTime), clip.endTime);
+}
+
+
+XMMATRIX ModelAnimation::SampleTrack(const Track& track, size_t bone, float time) const
+{
+    if (!track.keyCount)
+        return XMLoadFloat4x4(&mBindLocal[bone]);
+
+    // First key after time; the pose blends the key before it with it.
+    const float* times = mKeyTimes.data() + track.firstKey;
+    size_t next = std::upper_bound(times, times + track.keyCount, time) - times;
+
+    size_t k0 = track.firstKey + ((next > 0) ? next - 1 : 0);
+    size_t k1 = track.firstKey + std::min<size_t>(next, track.keyCount - 1);
+
+    XMVECTOR s = XMLoadFloat3(&mKeyScales[k0]);
+    XMVECTOR q = XMLoadFloat4(&mKeyRotations[k0]);
+    XMVECTOR t = XMLoadFloat3(&mKeyTranslations[k0]);
+
+    if (k1 != k0)
+    {
+        float span = mKeyTimes[k1] - mKeyTimes[k0];
+        float w = (span > 0.f) ? (time - mKeyTimes[k0]) / span : 0.f;
+
+        s = XMVectorLerp(s, XMLoadFloat3(&mKeyScales[k1]), w);
+        q = XMQuaternionSlerp(q, XMLoadFloat4(&mKeyRotations[k1]), w);
+        t = XMVectorLerp(t, XMLoadFloat3(&mKeyTranslations[k1]), w);
+    }
+
+    // Scale * rotation * translation, built directly rather than by matrix products.
+    XMMATRIX m = XMMatrixRotationQuaternion(q);
+    m.r[0] = XMVectorMultiply(m.r[0], XMVectorSplatX(s));
+    m.r[1] = XMVectorMultiply(m.r[1], XMVectorSplatY(s));
+    m.r[2] = XMVectorMultiply(m.r[2], XMVectorSplatZ(s));
+    m.r[3] = XMVectorSelect(g_XMIdentityR3, t, g_XMSelect1110);
+    return m;
+}
@@ -0,0 +1,644 @@
+//--------------------------------------------------------------------------------------
+// File: ModelData.cpp
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+// Built without the precompiled header so it does not depend on Direct3D.
+#include "ModelData.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "vbo.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <assert.h>
+#include <string.h>
+
+using namespace DirectX;
+
+
+namespace
+{
+    // offsetof(VertexPositionNormalTangentColorTexture[Skinning], textureCoordinate)
+    const size_t c_TextureCoordinateOffset = 44;
+
+    // offsetof(VertexPositionNormalTangentColorTexture[Skinning], normal)
+    const size_t c_NormalOffset = 12;
+
+    // VertexPositionNormalTexture, the only vertex type of a .VBO file
+    struct VBOVertex
+    {
+        XMFLOAT3    position;
+        XMFLOAT3    normal;
+        XMFLOAT2    textureCoordinate;
+    };
+
+    static_assert(sizeof(VBOVertex) == 32, "VBO vertex size mismatch");
+
+    bool IsIdentity(const XMFLOAT4X4& m)
+    {
+        for (size_t r = 0; r < 4; ++r)
+        {
+            for (size_t c = 0; c < 4; ++c)
+            {
+                if (m.m[r][c] != ((r == c) ? 1.f : 0.f))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    inline uint32_t GetIndex(const uint8_t* indices, uint32_t indexSize, size_t j)
+    {
+        if (indexSize == sizeof(uint16_t))
+        {
+            uint16_t v16;
+            memcpy(&v16, indices + j * sizeof(uint16_t), sizeof(uint16_t));
+            return v16;
+        }
+
+        uint32_t v;
+        memcpy(&v, indices + j * sizeof(uint32_t), sizeof(uint32_t));
+        return v;
+    }
+
+    inline void SetIndex(uint8_t* indices, uint32_t indexSize, size_t j, uint32_t v)
+    {
+        if (indexSize == sizeof(uint16_t))
+        {
+            uint16_t v16 = static_cast<uint16_t>(v);
+            memcpy(indices + j * sizeof(uint16_t), &v16, sizeof(uint16_t));
+        }
+        else
+        {
+            memcpy(indices + j * sizeof(uint32_t), &v, sizeof(uint32_t));
+        }
+    }
+
+    // Marks for index buffers not yet seen, or drawn with more than one vertex buffer.
+    const uint32_t c_Unused = UINT32_MAX;
+    const uint32_t c_Mixed = UINT32_MAX - 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// ModelData
+//--------------------------------------------------------------------------------------
+
+ModelData::ModelData() :
+    uvTransformBaked(false),
+    mSource(nullptr),
+    mSourceSize(0)
+{
+}
+
+
+ModelData::ModelData(ModelData&& moveFrom) :
+    meshes(std::move(moveFrom.meshes)),
+    materials(std::move(moveFrom.materials)),
+    subMeshes(std::move(moveFrom.subMeshes)),
+    vertexBuffers(std::move(moveFrom.vertexBuffers)),
+    indexBuffers(std::move(moveFrom.indexBuffers)),
+    bones(std::move(moveFrom.bones)),
+    clips(std::move(moveFrom.clips)),
+    lods(std::move(moveFrom.lods)),
+    lodSubMeshes(std::move(moveFrom.lodSubMeshes)),
+    uvTransformBaked(moveFrom.uvTransformBaked),
+    mSource(moveFrom.mSource),
+    mSourceSize(moveFrom.mSourceSize),
+    mOwned(std::move(moveFrom.mOwned))
+{
+}
+
+
+ModelData& ModelData::operator= (ModelData&& moveFrom)
+{
+    meshes = std::move(moveFrom.meshes);
+    materials = std::move(moveFrom.materials);
+    subMeshes = std::move(moveFrom.subMeshes);
+    vertexBuffers = std::move(moveFrom.vertexBuffers);
+    indexBuffers = std::move(moveFrom.indexBuffers);
+    bones = std::move(moveFrom.bones);
+    clips = std::move(moveFrom.clips);
+    lods = std::move(moveFrom.lods);
+    lodSubMeshes = std::move(moveFrom.lodSubMeshes);
+    uvTransformBaked = moveFrom.uvTransformBaked;
+    mSource = moveFrom.mSource;
+    mSourceSize = moveFrom.mSourceSize;
+    mOwned = std::move(moveFrom.mOwned);
+    return *this;
+}
+
+
+ModelData::~ModelData()
+{
+}
+
+
+void ModelData::SetSource(const uint8_t* sourceData, size_t sourceSize)
+{
+    mSource = sourceData;
+    mSourceSize = sourceSize;
+}
+
+
+const uint8_t* ModelData::GetData(const Blob& blob) const
+{
+    if (blob.location == BlobLocation_Owned)
+    {
+        assert(blob.offset + blob.size <= mOwned.size());
+        return mOwned.data() + blob.offset;
+    }
+
+    if (!mSource || blob.offset + blob.size > mSourceSize)
+        throw std::out_of_range("ModelData blob is outside the source data");
+
+    return mSource + blob.offset;
+}
+
+
+ModelData::Blob ModelData::AddOwned(const void* data, size_t size)
+{
+    // Keep every blob on a 16-byte boundary so it can be read as its element type.
+    size_t offset = (mOwned.size() + 15) & ~size_t(15);
+
+    Blob blob;
+    blob.location = BlobLocation_Owned;
+    blob.offset = offset;
+    blob.size = size;
+
+    mOwned.resize(offset + size);
+    if (data && size)
+        memcpy(mOwned.data() + offset, data, size);
+
+    return blob;
+}
+
+
+uint8_t* ModelData::GetOwnedData(const Blob& blob)
+{
+    assert(blob.location == BlobLocation_Owned);
+    assert(blob.offset + blob.size <= mOwned.size());
+    return mOwned.data() + blob.offset;
+}
+
+
+void ModelData::BakeUVTransforms()
+{
+    std::vector<uint32_t> visited;
+
+    for (auto& mesh : meshes)
+    {
+        // Vertex buffers only drawn with identity transforms keep referencing the source.
+        for (uint32_t j = 0; j < mesh.vertexBufferCount; ++j)
+        {
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + j];
+
+            bool needed = false;
+            for (uint32_t k = 0; k < mesh.subMeshCount && !needed; ++k)
+            {
+                auto& sm = subMeshes[mesh.firstSubMesh + k];
+                if (sm.vertexBufferIndex == j)
+                    needed = !IsIdentity(materials[mesh.firstMaterial + sm.materialIndex].uvTransform);
+            }
+
+            if (!needed)
+                continue;
+
+            if (vb.data.location == BlobLocation_Source)
+                vb.data = AddOwned(GetData(vb.data), vb.data.size);
+
+            uint8_t* verts = GetOwnedData(vb.data);
+
+            visited.assign(vb.vertexCount, UINT32_MAX);
+
+            for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+            {
+                auto& sm = subMeshes[mesh.firstSubMesh + k];
+                if (sm.vertexBufferIndex != j)
+                    continue;
+
+                XMMATRIX uvTransform = XMLoadFloat4x4(&materials[mesh.firstMaterial + sm.materialIndex].uvTransform);
+
+                auto& ib = indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex];
+                const uint8_t* indices = GetData(ib.data);
+
+                // The first material to reach a vertex wins; a vertex shared by
+                // materials with different UV transforms cannot be correct for both.
+                for (uint32_t q = sm.startIndex; q < sm.startIndex + sm.indexCount; ++q)
+                {
+                    uint32_t v;
+                    if (ib.indexSize == sizeof(uint16_t))
+                    {
+                        uint16_t v16;
+                        memcpy(&v16, indices + q * sizeof(uint16_t), sizeof(uint16_t));
+                        v = v16;
+                    }
+                    else
+                    {
+                        memcpy(&v, indices + q * sizeof(uint32_t), sizeof(uint32_t));
+                    }
+
+                    if (v >= vb.vertexCount)
+                        throw std::runtime_error("Invalid index found\n");
+
+                    if (visited[v] != UINT32_MAX)
+                        continue;
+
+                    visited[v] = sm.materialIndex;
+
+                    uint8_t* tc = verts + size_t(v) * vb.stride + c_TextureCoordinateOffset;
+
+                    XMFLOAT2 uv;
+                    memcpy(&uv, tc, sizeof(uv));
+
+                    XMVECTOR t = XMLoadFloat2(&uv);
+
+                    t = XMVectorSelect(g_XMIdentityR3, t, g_XMSelect1110);
+
+                    t = XMVector4Transform(t, uvTransform);
+
+                    XMStoreFloat2(&uv, t);
+                    memcpy(tc, &uv, sizeof(uv));
+                }
+            }
+        }
+    }
+
+    uvTransformBaked = true;
+}
+
+
+void ModelData::Optimize()
+{
+    struct Range
+    {
+        uint32_t start;
+        uint32_t count;
+    };
+
+    std::vector<uint32_t> ibVertexBuffer;
+    std::vector<bool> vbReorder;
+    std::vector<Range> ranges;
+    std::vector<uint32_t> remap;
+    std::vector<uint8_t> temp;
+
+    for (auto& mesh : meshes)
+    {
+        // Reordering vertices means rewriting every index buffer that uses them, so it
+        // is only done when each index buffer is drawn with a single vertex buffer.
+        ibVertexBuffer.assign(mesh.indexBufferCount, c_Unused);
+
+        for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+        {
+            auto& sm = subMeshes[mesh.firstSubMesh + k];
+            uint32_t& vb = ibVertexBuffer[sm.indexBufferIndex];
+            if (vb == c_Unused)
+                vb = sm.vertexBufferIndex;
+            else if (vb != sm.vertexBufferIndex)
+                vb = c_Mixed;
+        }
+
+        for (uint32_t j = 0; j < mesh.indexBufferCount; ++j)
+        {
+            if (ibVertexBuffer[j] == c_Unused || ibVertexBuffer[j] == c_Mixed)
+                continue;
+
+            auto& ib = indexBuffers[mesh.firstIndexBuffer + j];
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + ibVertexBuffer[j]];
+
+            const uint8_t* indices = GetData(ib.data);
+            for (size_t q = 0; q < ib.indexCount; ++q)
+            {
+                if (GetIndex(indices, ib.indexSize, q) >= vb.vertexCount)
+                    throw std::runtime_error("Invalid index found\n");
+            }
+
+            if (ib.data.location == BlobLocation_Source)
+                ib.data = AddOwned(indices, ib.data.size);
+        }
+
+        vbReorder.assign(mesh.vertexBufferCount, false);
+        for (uint32_t j = 0; j < mesh.indexBufferCount; ++j)
+        {
+            if (ibVertexBuffer[j] != c_Unused && ibVertexBuffer[j] != c_Mixed)
+                vbReorder[ibVertexBuffer[j]] = true;
+        }
+
+        for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+        {
+            auto& sm = subMeshes[mesh.firstSubMesh + k];
+            if (ibVertexBuffer[sm.indexBufferIndex] == c_Mixed)
+                vbReorder[sm.vertexBufferIndex] = false;
+        }
+
+        for (uint32_t j = 0; j < mesh.vertexBufferCount; ++j)
+        {
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + j];
+            if (vbReorder[j] && vb.data.location == BlobLocation_Source)
+                vb.data = AddOwned(GetData(vb.data), vb.data.size);
+        }
+
+        // Triangle order, within each submesh so the draw calls are unchanged. Submeshes
+        // that partially overlap in their index buffer are left alone.
+        for (uint32_t j = 0; j < mesh.indexBufferCount; ++j)
+        {
+            if (ibVertexBuffer[j] == c_Unused || ibVertexBuffer[j] == c_Mixed)
+                continue;
+
+            ranges.clear();
+            for (uint32_t k = 0; k < mesh.subMeshCount; ++k)
+            {
+                auto& sm = subMeshes[mesh.firstSubMesh + k];
+                if (sm.indexBufferIndex == j)
+                    ranges.push_back({ sm.startIndex, sm.indexCount });
+            }
+
+            std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b)
+            {
+                return (a.start != b.start) ? (a.start < b.start) : (a.count < b.count);
+            });
+            ranges.erase(std::unique(ranges.begin(), ranges.end(), [](const Range& a, const Range& b)
+            {
+                return a.start == b.start && a.count == b.count;
+            }), ranges.end());
+
+            bool overlaps = false;
+            for (size_t r = 1; r < ranges.size(); ++r)
+            {
+                if (ranges[r].start < ranges[r - 1].start + ranges[r - 1].count)
+                    overlaps = true;
+            }
+
+            if (overlaps)
+                continue;
+
+            auto& ib = indexBuffers[mesh.firstIndexBuffer + j];
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + ibVertexBuffer[j]];
+
+            uint8_t* indices = GetOwnedData(ib.data);
+            const uint8_t* verts = GetData(vb.data);
+
+            for (auto& range : ranges)
+            {
+                size_t nFaces = range.count / 3;
+                if (ib.indexSize == sizeof(uint16_t))
+                {
+                    auto faces = reinterpret_cast<uint16_t*>(indices) + range.start;
+                    OptimizeFaces(faces, nFaces, vb.vertexCount);
+                    OptimizeOverdraw(faces, nFaces, verts, vb.stride, vb.vertexCount);
+                }
+                else
+                {
+                    auto faces = reinterpret_cast<uint32_t*>(indices) + range.start;
+                    OptimizeFaces(faces, nFaces, vb.vertexCount);
+                    OptimizeOverdraw(faces, nFaces, verts, vb.stride, vb.vertexCount);
+                }
+            }
+        }
+
+        // Vertex order: first use across the index buffers drawn with each vertex buffer.
+        // Unreferenced vertices are kept, after the rest, so the counts stay the same.
+        for (uint32_t j = 0; j < mesh.vertexBufferCount; ++j)
+        {
+            if (!vbReorder[j])
+                continue;
+
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + j];
+
+            remap.assign(vb.vertexCount, UINT32_MAX);
+            uint32_t count = 0;
+
+            for (uint32_t i = 0; i < mesh.indexBufferCount; ++i)
+            {
+                if (ibVertexBuffer[i] != j)
+                    continue;
+
+                auto& ib = indexBuffers[mesh.firstIndexBuffer + i];
+                const uint8_t* indices = GetOwnedData(ib.data);
+                for (size_t q = 0; q < ib.indexCount; ++q)
+                {
+                    uint32_t v = GetIndex(indices, ib.indexSize, q);
+                    if (remap[v] == UINT32_MAX)
+                        remap[v] = count++;
+                }
+            }
+
+            for (auto& v : remap)
+            {
+                if (v == UINT32_MAX)
+                    v = count++;
+            }
+
+            uint8_t* verts = GetOwnedData(vb.data);
+            temp.resize(size_t(vb.vertexCount) * vb.stride);
+            for (size_t v = 0; v < vb.vertexCount; ++v)
+                memcpy(temp.data() + size_t(remap[v]) * vb.stride, verts + v * vb.stride, vb.stride);
+            memcpy(verts, temp.data(), temp.size());
+
+            for (uint32_t i = 0; i < mesh.indexBufferCount; ++i)
+            {
+                if (ibVertexBuffer[i] != j)
+                    continue;
+
+                auto& ib = indexBuffers[mesh.firstIndexBuffer + i];
+                uint8_t* indices = GetOwnedData(ib.data);
+                for (size_t q = 0; q < ib.indexCount; ++q)
+                    SetIndex(indices, ib.indexSize, q, remap[GetIndex(indices, ib.indexSize, q)]);
+            }
+        }
+    }
+}
+
+
+void ModelData::GenerateLODs(size_t maxLevels, float reduction, float maxError)
+{
+    if (reduction <= 0.f || reduction >= 1.f)
+        throw std::invalid_argument("LOD reduction must be between 0 and 1");
+
+    // A level that keeps more than this of the one before is not worth a draw call.
+    const float c_MinimumSaving = 0.9f;
+
+    std::vector<std::vector<uint8_t>> ibData;
+    std::vector<size_t> ibSizes;
+    std::vector<SubMesh> previous;
+    std::vector<SubMesh> next;
+
+    for (auto& mesh : meshes)
+    {
+        mesh.firstLOD = static_cast<uint32_t>(lods.size());
+        mesh.lodCount = 0;
+
+        // Working copies of the index buffers, which the levels are appended to
+        ibData.resize(mesh.indexBufferCount);
+        for (uint32_t j = 0; j < mesh.indexBufferCount; ++j)
+        {
+            auto& ib = indexBuffers[mesh.firstIndexBuffer + j];
+            const uint8_t* indices = GetData(ib.data);
+            ibData[j].assign(indices, indices + size_t(ib.indexCount) * ib.indexSize);
+        }
+
+        previous.assign(subMeshes.begin() + mesh.firstSubMesh, subMeshes.begin() + mesh.firstSubMesh + mesh.subMeshCount);
+
+        size_t previousFaces = 0;
+        for (auto& sm : previous)
+        {
+            auto& ib = indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex];
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + sm.vertexBufferIndex];
+
+            const uint8_t* indices = ibData[sm.indexBufferIndex].data();
+            for (size_t q = sm.startIndex; q < size_t(sm.startIndex) + sm.indexCount; ++q)
+            {
+                if (GetIndex(indices, ib.indexSize, q) >= vb.vertexCount)
+                    throw std::runtime_error("Invalid index found\n");
+            }
+
+            previousFaces += sm.indexCount / 3;
+        }
+
+        const float budget = maxError * mesh.radius;
+        float error = 0.f;
+
+        for (size_t level = 0; level < maxLevels && error < budget; ++level)
+        {
+            ibSizes.resize(ibData.size());
+            for (size_t j = 0; j < ibData.size(); ++j)
+                ibSizes[j] = ibData[j].size();
+
+            next = previous;
+
+            size_t faces = 0;
+            float levelError = 0.f;
+            for (auto& sm : next)
+            {
+                auto& ib = indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex];
+                auto& vb = vertexBuffers[mesh.firstVertexBuffer + sm.vertexBufferIndex];
+                auto& dest = ibData[sm.indexBufferIndex];
+
+                const uint8_t* verts = GetData(vb.data);
+
+                size_t nFaces = sm.indexCount / 3;
+                auto target = static_cast<size_t>(float(nFaces) * reduction);
+
+                size_t start = dest.size() / ib.indexSize;
+                dest.resize(dest.size() + nFaces * 3 * ib.indexSize);
+
+                size_t kept;
+                float result = 0.f;
+                if (ib.indexSize == sizeof(uint16_t))
+                {
+                    auto faces16 = reinterpret_cast<uint16_t*>(dest.data());
+                    kept = SimplifyMesh(faces16 + sm.startIndex, nFaces, verts, vb.stride, vb.vertexCount,
+                                        target, budget - error, faces16 + start, &result);
+                    OptimizeFaces(faces16 + start, kept, vb.vertexCount);
+                }
+                else
+                {
+                    auto faces32 = reinterpret_cast<uint32_t*>(dest.data());
+                    kept = SimplifyMesh(faces32 + sm.startIndex, nFaces, verts, vb.stride, vb.vertexCount,
+                                        target, budget - error, faces32 + start, &result);
+                    OptimizeFaces(faces32 + start, kept, vb.vertexCount);
+                }
+
+                if (kept == nFaces)
+                {
+                    // Nothing to gain; the level draws the same range as the one before
+                    dest.resize(start * ib.indexSize);
+                }
+                else
+                {
+                    dest.resize((start + kept * 3) * ib.indexSize);
+                    sm.startIndex = static_cast<uint32_t>(start);
+                    sm.indexCount = static_cast<uint32_t>(kept * 3);
+                }
+
+                faces += kept;
+                levelError = std::max(levelError, result);
+            }
+
+            if (float(faces) > float(previousFaces) * c_MinimumSaving)
+            {
+                for (size_t j = 0; j < ibData.size(); ++j)
+                    ibData[j].resize(ibSizes[j]);
+                break;
+            }
+
+            // Each level is simplified from the one before, so the errors add up
+            error += levelError;
+
+            LevelOfDetail lod;
+            lod.firstSubMesh = static_cast<uint32_t>(lodSubMeshes.size());
+            lod.error = error;
+            lods.push_back(lod);
+            lodSubMeshes.insert(lodSubMeshes.end(), next.begin(), next.end());
+            ++mesh.lodCount;
+
+            previous.swap(next);
+            previousFaces = faces;
+        }
+
+        for (uint32_t j = 0; j < mesh.indexBufferCount; ++j)
+        {
+            auto& ib = indexBuffers[mesh.firstIndexBuffer + j];
+            if (ibData[j].size() == size_t(ib.indexCount) * ib.indexSize)
+                continue;
+
+            ib.data = AddOwned(ibData[j].data(), ibData[j].size());
+            ib.indexCount = static_cast<uint32_t>(ibData[j].size() / ib.indexSize);
+        }
+    }
+}
+
+
+void ModelData::WriteVBO(std::vector<uint8_t>& fileData) const
+{
+    if (meshes.size() != 1 || vertexBuffers.size() != 1 || indexBuffers.size() != 1)
+        throw std::runtime_error("VBO files hold a single vertex and index buffer");
+
+    auto& vb = vertexBuffers[0];
+    auto& ib = indexBuffers[0];
+    if (vb.vertexCount > 0x10000)
+        throw std::runtime_error("Too many vertices for a VBO file");
+
+    if (ib.indexCount % 3)
+        throw std::runtime_error("VBO files hold triangle lists");
+
+    VBO::header_t header;
+    header.numVertices = vb.vertexCount;
+    header.numIndices = ib.indexCount;
+
+    fileData.resize(sizeof(header) + sizeof(VBOVertex) * header.numVertices + sizeof(uint16_t) * header.numIndices);
+    memcpy(fileData.data(), &header, sizeof(header));
+
+    const uint8_t* src = GetData(vb.data);
+    uint8_t* dest = fileData.data() + sizeof(header);
+    for (size_t v = 0; v < vb.vertexCount; ++v, dest += sizeof(VBOVertex))
+    {
+        const uint8_t* vertex = src + v * vb.stride;
+
+        VBOVertex out;
+        memcpy(&out.position, vertex, sizeof(XMFLOAT3));
+        memcpy(&out.normal, vertex + c_NormalOffset, sizeof(XMFLOAT3));
+        memcpy(&out.textureCoordinate, vertex + c_TextureCoordinateOffset, sizeof(XMFLOAT2));
+        memcpy(dest, &out, sizeof(out));
+    }
+
+    // Model::CreateFromVBO defaults to clockwise front faces, so the winding is flipped.
+    const uint8_t* indices = GetData(ib.data);
+    for (size_t t = 0; t < ib.indexCount; t += 3)
+    {
+        uint16_t tri[3];
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t index = GetIndex(indices, ib.indexSize, t + (3 - k) % 3);
+            if (index >= vb.vertexCount)
+                throw std::runtime_error("Invalid index buffer");
+
+            tri[k] = static_cast<uint16_t>(index);
+        }
+        memcpy(dest, tri, sizeof(tri));
+        dest += sizeof(tri);
+    }
+}
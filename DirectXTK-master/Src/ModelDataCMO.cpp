@@ -0,0 +1,780 @@
+//--------------------------------------------------------------------------------------
+// File: ModelDataCMO.cpp
+//
+// CPU stage of the .CMO loader. Built without the precompiled header: it only needs
+// DirectXMath and the standard library, so it runs without a Direct3D device.
+//
+// The parsing code comes from ModelLoadCMO.cpp, Copyright (c) Microsoft Corporation,
+// under the MIT License in LICENSE. The rest is part of SnowScene's additions to
+// DirectXTK.
+//--------------------------------------------------------------------------------------
+
+#include "ModelData.h"
+
+#include <DirectXPackedVector.h>
+
+#include <stdexcept>
+
+#include <string.h>
+
+using namespace DirectX;
+
+
+//--------------------------------------------------------------------------------------
+// .CMO files are built by Visual Studio 2012 and an example renderer is provided
+// in the VS Direct3D Starter Kit
+// http://code.msdn.microsoft.com/Visual-Studio-3D-Starter-455a15f1
+//--------------------------------------------------------------------------------------
+
+namespace VSD3DStarter
+{
+    // .CMO files
+
+    // UINT - Mesh count
+    // { [Mesh count]
+    //      UINT - Length of name
+    //      wchar_t[] - Name of mesh (if length > 0)
+    //      UINT - Material count
+    //      { [Material count]
+    //          UINT - Length of material name
+    //          wchar_t[] - Name of material (if length > 0)
+    //          Material structure
+    //          UINT - Length of pixel shader name
+    //          wchar_t[] - Name of pixel shader (if length > 0)
+    //          { [8]
+    //              UINT - Length of texture name
+    //              wchar_t[] - Name of texture (if length > 0)
+    //          }
+    //      }
+    //      BYTE - 1 if there is skeletal animation data present
+    //      UINT - SubMesh count
+    //      { [SubMesh count]
+    //          SubMesh structure
+    //      }
+    //      UINT - IB Count
+    //      { [IB Count]
+    //          UINT - Number of USHORTs in IB
+    //          USHORT[] - Array of indices
+    //      }
+    //      UINT - VB Count
+    //      { [VB Count]
+    //          UINT - Number of verts in VB
+    //          Vertex[] - Array of vertices
+    //      }
+    //      UINT - Skinning VB Count
+    //      { [Skinning VB Count]
+    //          UINT - Number of verts in Skinning VB
+    //          SkinningVertex[] - Array of skinning verts
+    //      }
+    //      MeshExtents structure
+    //      [If skeleton animation data is not present, file ends here]
+    //      UINT - Bone count
+    //      { [Bone count]
+    //          UINT - Length of bone name
+    //          wchar_t[] - Bone name (if length > 0)
+    //          Bone structure
+    //      }
+    //      UINT - Animation clip count
+    //      { [Animation clip count]
+    //          UINT - Length of clip name
+    //          wchar_t[] - Clip name (if length > 0)
+    //          float - Start time
+    //          float - End time
+    //          UINT - Keyframe count
+    //          { [Keyframe count]
+    //              Keyframe structure
+    //          }
+    //      }
+    // }
+
+    #pragma pack(push,1)
+
+    struct Material
+    {
+        DirectX::XMFLOAT4   Ambient;
+        DirectX::XMFLOAT4   Diffuse;
+        DirectX::XMFLOAT4   Specular;
+        float               SpecularPower;
+        DirectX::XMFLOAT4   Emissive;
+        DirectX::XMFLOAT4X4 UVTransform;
+    };
+
+    const uint32_t MAX_TEXTURE = 8;
+
+    struct SubMesh
+    {
+        uint32_t MaterialIndex;
+        uint32_t IndexBufferIndex;
+        uint32_t VertexBufferIndex;
+        uint32_t StartIndex;
+        uint32_t PrimCount;
+    };
+
+    const uint32_t NUM_BONE_INFLUENCES = 4;
+
+    // Same layout as VertexPositionNormalTangentColorTexture
+    struct Vertex
+    {
+        DirectX::XMFLOAT3   Position;
+        DirectX::XMFLOAT3   Normal;
+        DirectX::XMFLOAT4   Tangent;
+        uint32_t            Color;
+        DirectX::XMFLOAT2   TextureCoordinate;
+    };
+
+    // Same layout as VertexPositionNormalTangentColorTextureSkinning
+    struct SkinnedVertex
+    {
+        Vertex              Base;
+        uint32_t            Indices;
+        uint32_t            Weights;
+    };
+
+    struct SkinningVertex
+    {
+        uint32_t boneIndex[NUM_BONE_INFLUENCES];
+        float boneWeight[NUM_BONE_INFLUENCES];
+    };
+
+    struct MeshExtents
+    {
+        float CenterX, CenterY, CenterZ;
+        float Radius;
+
+        float MinX, MinY, MinZ;
+        float MaxX, MaxY, MaxZ;
+    };
+
+    struct Bone
+    {
+        int32_t ParentIndex;
+        DirectX::XMFLOAT4X4 InvBindPos;
+        DirectX::XMFLOAT4X4 BindPos;
+        DirectX::XMFLOAT4X4 LocalTransform;
+    };
+
+    struct Clip
+    {
+        float StartTime;
+        float EndTime;
+        uint32_t keys;
+    };
+
+    struct Keyframe
+    {
+        uint32_t BoneIndex;
+        float Time;
+        DirectX::XMFLOAT4X4 Transform;
+    };
+
+    #pragma pack(pop)
+
+    const Material s_defMaterial =
+    {
+        { 0.2f, 0.2f, 0.2f, 1.f },
+        { 0.8f, 0.8f, 0.8f, 1.f },
+        { 0.0f, 0.0f, 0.0f, 1.f },
+        1.f,
+        { 0.0f, 0.0f, 0.0f, 1.0f },
+        { 1.f, 0.f, 0.f, 0.f,
+          0.f, 1.f, 0.f, 0.f,
+          0.f, 0.f, 1.f, 0.f,
+          0.f, 0.f, 0.f, 1.f },
+    };
+}; // namespace
+
+static_assert( sizeof(VSD3DStarter::Material) == 132, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::SubMesh) == 20, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::Vertex) == 52, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::SkinnedVertex) == 60, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::SkinningVertex)== 32, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::MeshExtents)== 40, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::Bone) == 196, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::Clip) == 12, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VSD3DStarter::Keyframe)== 72, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(ModelData::Keyframe) == sizeof(VSD3DStarter::Keyframe), "ModelData keyframe must match the CMO layout" );
+
+namespace
+{
+    //----------------------------------------------------------------------------------
+    // Bounds-checked cursor over the file. Everything after the skeleton flag byte is
+    // misaligned, so values are copied out rather than dereferenced in place.
+    class CMOReader
+    {
+    public:
+        CMOReader(const uint8_t* data, size_t size) :
+            mData(data),
+            mSize(size),
+            mPos(0)
+        {
+        }
+
+        // Skips over count elements of elementSize bytes and returns where they start.
+        size_t Skip(size_t elementSize, size_t count)
+        {
+            if (count > (mSize - mPos) / elementSize)
+                throw std::runtime_error("End of file");
+
+            size_t start = mPos;
+            mPos += elementSize * count;
+            return start;
+        }
+
+        template<typename T> T Read()
+        {
+            T value;
+            memcpy(&value, mData + Skip(sizeof(T), 1), sizeof(T));
+            return value;
+        }
+
+        // Names are stored as a UINT length followed by that many UTF-16 code units.
+        std::wstring ReadName()
+        {
+            uint32_t length = Read<uint32_t>();
+            const uint8_t* units = mData + Skip(sizeof(uint16_t), length);
+
+            std::wstring name;
+            name.resize(length);
+            for (uint32_t i = 0; i < length; ++i)
+            {
+                uint16_t c;
+                memcpy(&c, units + i * sizeof(uint16_t), sizeof(uint16_t));
+                name[i] = static_cast<wchar_t>(c);
+            }
+            return name;
+        }
+
+    private:
+        const uint8_t*  mData;
+        size_t          mSize;
+        size_t          mPos;
+    };
+
+
+    ModelData::Blob SourceBlob(size_t offset, size_t size)
+    {
+        ModelData::Blob blob;
+        blob.location = ModelData::BlobLocation_Source;
+        blob.offset = offset;
+        blob.size = size;
+        return blob;
+    }
+
+
+    void CopyMaterial(ModelData::Material& m, const VSD3DStarter::Material& src)
+    {
+        m.ambient = src.Ambient;
+        m.diffuse = src.Diffuse;
+        m.specular = src.Specular;
+        m.emissive = src.Emissive;
+        m.specularPower = src.SpecularPower;
+        m.uvTransform = src.UVTransform;
+    }
+
+
+    // Combines the CMO vertex and skinning streams into one stream.
+    void MergeSkinning(uint8_t* dest, const uint8_t* verts, const uint8_t* skin, size_t nVerts)
+    {
+        for (size_t v = 0; v < nVerts; ++v)
+        {
+            VSD3DStarter::SkinnedVertex out;
+            memcpy(&out.Base, verts + v * sizeof(VSD3DStarter::Vertex), sizeof(VSD3DStarter::Vertex));
+
+            VSD3DStarter::SkinningVertex sv;
+            memcpy(&sv, skin + v * sizeof(VSD3DStarter::SkinningVertex), sizeof(sv));
+
+            // Packed as in VertexPositionNormalTangentColorTextureSkinning::SetBlendIndices
+            // and SetBlendWeights.
+            out.Indices = ((sv.boneIndex[3] & 0xff) << 24) | ((sv.boneIndex[2] & 0xff) << 16)
+                        | ((sv.boneIndex[1] & 0xff) << 8) | (sv.boneIndex[0] & 0xff);
+
+            PackedVector::XMUBYTEN4 packed;
+            PackedVector::XMStoreUByteN4(&packed, XMVectorSet(sv.boneWeight[0], sv.boneWeight[1], sv.boneWeight[2], sv.boneWeight[3]));
+            out.Weights = packed.v;
+
+            memcpy(dest + v * sizeof(VSD3DStarter::SkinnedVertex), &out, sizeof(out));
+        }
+    }
+}
+
+
+//======================================================================================
+// CMO parser
+//======================================================================================
+
+std::unique_ptr<ModelData> ModelData::ParseCMO(const uint8_t* meshData, size_t dataSize, uint32_t flags)
+{
+    if (!meshData)
+        throw std::invalid_argument("meshData cannot be null");
+
+    CMOReader reader(meshData, dataSize);
+
+    // Meshes
+    uint32_t nMesh = reader.Read<uint32_t>();
+    if (!nMesh)
+        throw std::runtime_error("No meshes found");
+
+    std::unique_ptr<ModelData> data(new ModelData());
+    data->SetSource(meshData, dataSize);
+    data->uvTransformBaked = (flags & ParseFlags_BakeUVTransform) != 0;
+    data->meshes.reserve(nMesh);
+
+    // Where each mesh's skinning streams start, until they are merged.
+    std::vector<size_t> skinOffsets;
+
+    for (uint32_t meshIndex = 0; meshIndex < nMesh; ++meshIndex)
+    {
+        Mesh mesh = {};
+        mesh.name = reader.ReadName();
+
+        // Materials
+        uint32_t nMats = reader.Read<uint32_t>();
+
+        mesh.firstMaterial = static_cast<uint32_t>(data->materials.size());
+        for (uint32_t j = 0; j < nMats; ++j)
+        {
+            Material m;
+            m.name = reader.ReadName();
+            CopyMaterial(m, reader.Read<VSD3DStarter::Material>());
+            m.pixelShader = reader.ReadName();
+
+            for (uint32_t t = 0; t < VSD3DStarter::MAX_TEXTURE; ++t)
+            {
+                m.texture[t] = reader.ReadName();
+            }
+
+            data->materials.emplace_back(std::move(m));
+        }
+
+        if (!nMats)
+        {
+            // Add default material if none defined
+            Material m;
+            m.name = L"Default";
+            CopyMaterial(m, VSD3DStarter::s_defMaterial);
+            data->materials.emplace_back(std::move(m));
+        }
+
+        mesh.materialCount = static_cast<uint32_t>(data->materials.size()) - mesh.firstMaterial;
+
+        // Skeletal data?
+        bool bSkeleton = reader.Read<uint8_t>() != 0;
+
+        // Submeshes
+        uint32_t nSubmesh = reader.Read<uint32_t>();
+        if (!nSubmesh)
+            throw std::runtime_error("No submeshes found\n");
+
+        mesh.firstSubMesh = static_cast<uint32_t>(data->subMeshes.size());
+        mesh.subMeshCount = nSubmesh;
+        for (uint32_t j = 0; j < nSubmesh; ++j)
+        {
+            auto sm = reader.Read<VSD3DStarter::SubMesh>();
+
+            SubMesh subMesh;
+            subMesh.materialIndex = sm.MaterialIndex;
+            subMesh.indexBufferIndex = sm.IndexBufferIndex;
+            subMesh.vertexBufferIndex = sm.VertexBufferIndex;
+            subMesh.startIndex = sm.StartIndex;
+            subMesh.indexCount = sm.PrimCount * 3;
+            data->subMeshes.emplace_back(subMesh);
+
+            if (uint64_t(sm.PrimCount) * 3 > UINT32_MAX)
+                throw std::runtime_error("Invalid submesh found\n");
+        }
+
+        // Index buffers
+        uint32_t nIBs = reader.Read<uint32_t>();
+        if (!nIBs)
+            throw std::runtime_error("No index buffers found\n");
+
+        mesh.firstIndexBuffer = static_cast<uint32_t>(data->indexBuffers.size());
+        mesh.indexBufferCount = nIBs;
+        for (uint32_t j = 0; j < nIBs; ++j)
+        {
+            uint32_t nIndexes = reader.Read<uint32_t>();
+            if (!nIndexes)
+                throw std::runtime_error("Empty index buffer found\n");
+
+            IndexBuffer ib;
+            ib.data = SourceBlob(reader.Skip(sizeof(uint16_t), nIndexes), sizeof(uint16_t) * nIndexes);
+            ib.indexSize = sizeof(uint16_t);
+            ib.indexCount = nIndexes;
+            data->indexBuffers.emplace_back(ib);
+        }
+
+        // Vertex buffers
+        uint32_t nVBs = reader.Read<uint32_t>();
+        if (!nVBs)
+            throw std::runtime_error("No vertex buffers found\n");
+
+        mesh.firstVertexBuffer = static_cast<uint32_t>(data->vertexBuffers.size());
+        mesh.vertexBufferCount = nVBs;
+        for (uint32_t j = 0; j < nVBs; ++j)
+        {
+            uint32_t nVerts = reader.Read<uint32_t>();
+            if (!nVerts)
+                throw std::runtime_error("Empty vertex buffer found\n");
+
+            VertexBuffer vb;
+            vb.data = SourceBlob(reader.Skip(sizeof(VSD3DStarter::Vertex), nVerts), sizeof(VSD3DStarter::Vertex) * nVerts);
+            vb.format = VertexFormat_PositionNormalTangentColorTexture;
+            vb.stride = sizeof(VSD3DStarter::Vertex);
+            vb.vertexCount = nVerts;
+            data->vertexBuffers.emplace_back(vb);
+        }
+
+        // Skinning vertex buffers
+        uint32_t nSkinVBs = reader.Read<uint32_t>();
+
+        skinOffsets.clear();
+        if (nSkinVBs)
+        {
+            if (nSkinVBs != nVBs)
+                throw std::runtime_error("Number of VBs not equal to number of skin VBs");
+
+            for (uint32_t j = 0; j < nSkinVBs; ++j)
+            {
+                uint32_t nVerts = reader.Read<uint32_t>();
+                if (!nVerts)
+                    throw std::runtime_error("Empty skinning vertex buffer found\n");
+
+                if (data->vertexBuffers[mesh.firstVertexBuffer + j].vertexCount != nVerts)
+                    throw std::runtime_error("Mismatched number of verts for skin VBs");
+
+                skinOffsets.push_back(reader.Skip(sizeof(VSD3DStarter::SkinningVertex), nVerts));
+            }
+        }
+
+        mesh.skinning = nSkinVBs != 0;
+
+        // Extents
+        auto extents = reader.Read<VSD3DStarter::MeshExtents>();
+
+        mesh.center = XMFLOAT3(extents.CenterX, extents.CenterY, extents.CenterZ);
+        mesh.radius = extents.Radius;
+        mesh.boxMin = XMFLOAT3(extents.MinX, extents.MinY, extents.MinZ);
+        mesh.boxMax = XMFLOAT3(extents.MaxX, extents.MaxY, extents.MaxZ);
+
+        // Animation data
+        mesh.firstBone = static_cast<uint32_t>(data->bones.size());
+        mesh.firstClip = static_cast<uint32_t>(data->clips.size());
+        if (bSkeleton)
+        {
+            // Bones
+            uint32_t nBones = reader.Read<uint32_t>();
+            if (!nBones)
+                throw std::runtime_error("Animation bone data is missing\n");
+
+            mesh.boneCount = nBones;
+            for (uint32_t j = 0; j < nBones; ++j)
+            {
+                Bone bone;
+                bone.name = reader.ReadName();
+
+                auto b = reader.Read<VSD3DStarter::Bone>();
+                if (b.ParentIndex < -1 || b.ParentIndex >= static_cast<int32_t>(nBones))
+                    throw std::runtime_error("Invalid bone parent found\n");
+
+                bone.parentIndex = b.ParentIndex;
+                bone.invBindPos = b.InvBindPos;
+                bone.bindPos = b.BindPos;
+                bone.localTransform = b.LocalTransform;
+                data->bones.emplace_back(std::move(bone));
+            }
+
+            // Animation Clips
+            uint32_t nClips = reader.Read<uint32_t>();
+
+            mesh.clipCount = nClips;
+            for (uint32_t j = 0; j < nClips; ++j)
+            {
+                Clip clip;
+                clip.name = reader.ReadName();
+
+                auto c = reader.Read<VSD3DStarter::Clip>();
+                if (!c.keys)
+                    throw std::runtime_error("Keyframes missing in clip");
+
+                clip.startTime = c.StartTime;
+                clip.endTime = c.EndTime;
+                clip.keys = SourceBlob(reader.Skip(sizeof(VSD3DStarter::Keyframe), c.keys), sizeof(VSD3DStarter::Keyframe) * c.keys);
+                clip.keyCount = c.keys;
+                data->clips.emplace_back(std::move(clip));
+            }
+        }
+
+        // Validate submeshes against the buffers they use
+        for (uint32_t j = 0; j < nSubmesh; ++j)
+        {
+            auto& sm = data->subMeshes[mesh.firstSubMesh + j];
+
+            if ((sm.indexBufferIndex >= nIBs)
+                || (sm.vertexBufferIndex >= nVBs)
+                || (sm.materialIndex >= mesh.materialCount))
+                throw std::runtime_error("Invalid submesh found\n");
+
+            if (uint64_t(sm.startIndex) + sm.indexCount > data->indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex].indexCount)
+                throw std::runtime_error("Invalid submesh found\n");
+        }
+
+        // Combine CMO multi-stream data into a single stream
+        if (mesh.skinning)
+        {
+            for (uint32_t j = 0; j < nVBs; ++j)
+            {
+                auto& vb = data->vertexBuffers[mesh.firstVertexBuffer + j];
+
+                Blob merged = data->AddOwned(nullptr, sizeof(VSD3DStarter::SkinnedVertex) * vb.vertexCount);
+                MergeSkinning(data->GetOwnedData(merged), meshData + vb.data.offset, meshData + skinOffsets[j], vb.vertexCount);
+
+                vb.data = merged;
+                vb.format = VertexFormat_PositionNormalTangentColorTextureSkinning;
+                vb.stride = sizeof(VSD3DStarter::SkinnedVertex);
+            }
+        }
+
+        data->meshes.emplace_back(std::move(mesh));
+    }
+
+    // Fix up VB tex coords for UV transforms, for effects that do not support them
+    if (flags & ParseFlags_BakeUVTransform)
+        data->BakeUVTransforms();
+
+    if (flags & ParseFlags_OptimizeMeshes)
+        data->Optimize();
+
+    if (flags & ParseFlags_GenerateLODs)
+        data->GenerateLODs();
+
+    return data;
+}
+
+
+//======================================================================================
+// CMO writer
+//======================================================================================
+
+namespace
+{
+    class CMOWriter
+    {
+    public:
+        explicit CMOWriter(std::vector<uint8_t>& fileData) :
+            mData(fileData)
+        {
+        }
+
+        void WriteBytes(const void* data, size_t size)
+        {
+            auto bytes = static_cast<const uint8_t*>(data);
+            mData.insert(mData.end(), bytes, bytes + size);
+        }
+
+        template<typename T> void Write(const T& value)
+        {
+            WriteBytes(&value, sizeof(T));
+        }
+
+        void WriteName(const std::wstring& name)
+        {
+            Write(static_cast<uint32_t>(name.size()));
+            for (wchar_t c : name)
+                Write(static_cast<uint16_t>(c));
+        }
+
+    private:
+        std::vector<uint8_t>& mData;
+    };
+
+
+    // Inverse of MergeSkinning: the vertices without their skinning, and the skinning
+    // stream.
+    void SplitSkinning(const uint8_t* src, size_t nVerts, CMOWriter* verts, std::vector<VSD3DStarter::SkinningVertex>* skin)
+    {
+        if (skin)
+            skin->resize(nVerts);
+
+        for (size_t v = 0; v < nVerts; ++v)
+        {
+            VSD3DStarter::SkinnedVertex in;
+            memcpy(&in, src + v * sizeof(in), sizeof(in));
+
+            if (verts)
+                verts->Write(in.Base);
+
+            if (!skin)
+                continue;
+
+            PackedVector::XMUBYTEN4 packed;
+            packed.v = in.Weights;
+
+            XMFLOAT4 weights;
+            XMStoreFloat4(&weights, PackedVector::XMLoadUByteN4(&packed));
+
+            auto& sv = (*skin)[v];
+            for (uint32_t k = 0; k < VSD3DStarter::NUM_BONE_INFLUENCES; ++k)
+                sv.boneIndex[k] = (in.Indices >> (k * 8)) & 0xff;
+
+            sv.boneWeight[0] = weights.x;
+            sv.boneWeight[1] = weights.y;
+            sv.boneWeight[2] = weights.z;
+            sv.boneWeight[3] = weights.w;
+        }
+    }
+}
+
+
+void ModelData::WriteCMO(std::vector<uint8_t>& fileData) const
+{
+    fileData.clear();
+    CMOWriter writer(fileData);
+
+    writer.Write(static_cast<uint32_t>(meshes.size()));
+
+    std::vector<VSD3DStarter::SkinningVertex> skin;
+
+    for (auto& mesh : meshes)
+    {
+        writer.WriteName(mesh.name);
+
+        // Materials
+        writer.Write(mesh.materialCount);
+        for (uint32_t j = 0; j < mesh.materialCount; ++j)
+        {
+            auto& m = materials[mesh.firstMaterial + j];
+
+            VSD3DStarter::Material mat;
+            mat.Ambient = m.ambient;
+            mat.Diffuse = m.diffuse;
+            mat.Specular = m.specular;
+            mat.SpecularPower = m.specularPower;
+            mat.Emissive = m.emissive;
+            mat.UVTransform = uvTransformBaked ? VSD3DStarter::s_defMaterial.UVTransform : m.uvTransform;
+
+            writer.WriteName(m.name);
+            writer.Write(mat);
+            writer.WriteName(m.pixelShader);
+
+            for (uint32_t t = 0; t < VSD3DStarter::MAX_TEXTURE; ++t)
+                writer.WriteName(m.texture[t]);
+        }
+
+        writer.Write(static_cast<uint8_t>(mesh.boneCount != 0));
+
+        // Submeshes
+        writer.Write(mesh.subMeshCount);
+        for (uint32_t j = 0; j < mesh.subMeshCount; ++j)
+        {
+            auto& sm = subMeshes[mesh.firstSubMesh + j];
+
+            VSD3DStarter::SubMesh out;
+            out.MaterialIndex = sm.materialIndex;
+            out.IndexBufferIndex = sm.indexBufferIndex;
+            out.VertexBufferIndex = sm.vertexBufferIndex;
+            out.StartIndex = sm.startIndex;
+            out.PrimCount = sm.indexCount / 3;
+            writer.Write(out);
+        }
+
+        // Index buffers, which are always 16-bit in a CMO
+        writer.Write(mesh.indexBufferCount);
+        for (uint32_t j = 0; j < mesh.indexBufferCount; ++j)
+        {
+            auto& ib = indexBuffers[mesh.firstIndexBuffer + j];
+            const uint8_t* src = GetData(ib.data);
+
+            writer.Write(ib.indexCount);
+            if (ib.indexSize == sizeof(uint16_t))
+            {
+                writer.WriteBytes(src, ib.indexCount * sizeof(uint16_t));
+                continue;
+            }
+
+            for (uint32_t k = 0; k < ib.indexCount; ++k)
+            {
+                uint32_t index;
+                memcpy(&index, src + k * sizeof(uint32_t), sizeof(uint32_t));
+                if (index > UINT16_MAX)
+                    throw std::runtime_error("Index buffer does not fit in 16 bits");
+
+                writer.Write(static_cast<uint16_t>(index));
+            }
+        }
+
+        // Vertex buffers, with skinning split back into its own streams
+        writer.Write(mesh.vertexBufferCount);
+        for (uint32_t j = 0; j < mesh.vertexBufferCount; ++j)
+        {
+            auto& vb = vertexBuffers[mesh.firstVertexBuffer + j];
+
+            writer.Write(vb.vertexCount);
+            if (vb.format == VertexFormat_PositionNormalTangentColorTexture)
+                writer.WriteBytes(GetData(vb.data), vb.vertexCount * sizeof(VSD3DStarter::Vertex));
+            else
+                SplitSkinning(GetData(vb.data), vb.vertexCount, &writer, nullptr);
+        }
+
+        writer.Write(mesh.skinning ? mesh.vertexBufferCount : 0u);
+        if (mesh.skinning)
+        {
+            for (uint32_t j = 0; j < mesh.vertexBufferCount; ++j)
+            {
+                auto& vb = vertexBuffers[mesh.firstVertexBuffer + j];
+
+                SplitSkinning(GetData(vb.data), vb.vertexCount, nullptr, &skin);
+                writer.Write(vb.vertexCount);
+                writer.WriteBytes(skin.data(), skin.size() * sizeof(VSD3DStarter::SkinningVertex));
+            }
+        }
+
+        // Extents
+        VSD3DStarter::MeshExtents extents;
+        extents.CenterX = mesh.center.x;
+        extents.CenterY = mesh.center.y;
+        extents.CenterZ = mesh.center.z;
+        extents.Radius = mesh.radius;
+        extents.MinX = mesh.boxMin.x;
+        extents.MinY = mesh.boxMin.y;
+        extents.MinZ = mesh.boxMin.z;
+        extents.MaxX = mesh.boxMax.x;
+        extents.MaxY = mesh.boxMax.y;
+        extents.MaxZ = mesh.boxMax.z;
+        writer.Write(extents);
+
+        if (!mesh.boneCount)
+            continue;
+
+        // Bones
+        writer.Write(mesh.boneCount);
+        for (uint32_t j = 0; j < mesh.boneCount; ++j)
+        {
+            auto& bone = bones[mesh.firstBone + j];
+
+            VSD3DStarter::Bone b;
+            b.ParentIndex = bone.parentIndex;
+            b.InvBindPos = bone.invBindPos;
+            b.BindPos = bone.bindPos;
+            b.LocalTransform = bone.localTransform;
+
+            writer.WriteName(bone.name);
+            writer.Write(b);
+        }
+
+        // Animation clips
+        writer.Write(mesh.clipCount);
+        for (uint32_t j = 0; j < mesh.clipCount; ++j)
+        {
+            auto& clip = clips[mesh.firstClip + j];
+
+            VSD3DStarter::Clip c;
+            c.StartTime = clip.startTime;
+            c.EndTime = clip.endTime;
+            c.keys = clip.keyCount;
+
+            writer.WriteName(clip.name);
+            writer.Write(c);
+            writer.WriteBytes(GetData(clip.keys), clip.keyCount * sizeof(VSD3DStarter::Keyframe));
+        }
+    }
+}
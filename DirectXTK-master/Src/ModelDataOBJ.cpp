@@ -0,0 +1,1087 @@
+//--------------------------------------------------------------------------------------
+// File: ModelDataOBJ.cpp
+//
+// CPU stage of the Wavefront .OBJ/.MTL importer. Built without the precompiled header
+// so it does not depend on Direct3D, which also lets PackModel use it.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "ModelData.h"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+
+namespace
+{
+    // Same layout as VertexPositionNormalTangentColorTexture
+    struct Vertex
+    {
+        XMFLOAT3    position;
+        XMFLOAT3    normal;
+        XMFLOAT4    tangent;
+        uint32_t    color;
+        XMFLOAT2    textureCoordinate;
+    };
+
+    static_assert(sizeof(Vertex) == 52, "Vertex layout mismatch");
+
+    // Files smaller than this per thread are not worth splitting further.
+    const size_t c_MinChunkSize = 1 << 20;
+
+    const uint32_t c_None = UINT32_MAX;
+
+
+    //----------------------------------------------------------------------------------
+    // Lexing. Statements are one per line; tokens are pointer ranges into the file, so
+    // nothing is allocated per token.
+
+    struct Token
+    {
+        const char* ptr;
+        size_t      length;
+
+        bool operator== (const char* s) const
+        {
+            return strlen(s) == length && !memcmp(ptr, s, length);
+        }
+
+        bool operator== (const Token& t) const
+        {
+            return t.length == length && !memcmp(ptr, t.ptr, length);
+        }
+    };
+
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline const char* SkipBlanks(const char* p, const char* end)
+    {
+        while (p < end && IsBlank(*p))
+            ++p;
+        return p;
+    }
+
+    // Start of the next line.
+    inline const char* NextLine(const char* p, const char* end)
+    {
+        auto eol = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+        return eol ? eol + 1 : end;
+    }
+
+    inline Token ReadToken(const char*& p, const char* end)
+    {
+        p = SkipBlanks(p, end);
+        Token t = { p, 0 };
+        while (p < end && *p != '\n' && !IsBlank(*p))
+            ++p;
+        t.length = size_t(p - t.ptr);
+        return t;
+    }
+
+    // The rest of the line without surrounding blanks, for names that may hold spaces.
+    inline Token ReadRest(const char*& p, const char* end)
+    {
+        p = SkipBlanks(p, end);
+        Token t = { p, 0 };
+        while (p < end && *p != '\n' && *p != '#')
+            ++p;
+
+        const char* last = p;
+        while (last > t.ptr && IsBlank(last[-1]))
+            --last;
+        t.length = size_t(last - t.ptr);
+        return t;
+    }
+
+    // Decimal floats as written by exporters: sign, digits, fraction and exponent. The
+    // first 19 significant digits are kept and scaled by an exact power of ten, which
+    // rounds to the same float as strtof for all but pathological inputs.
+    const double c_PowersOf10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool ReadFloat(const char*& p, const char* end, float& value)
+    {
+        p = SkipBlanks(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                if (mantissa)
+                    ++digits;
+            }
+            else
+            {
+                ++exponent;
+            }
+        }
+
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && IsDigit(*p); ++p)
+            {
+                any = true;
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + uint64_t(*p - '0');
+                    if (mantissa)
+                        ++digits;
+                    --exponent;
+                }
+            }
+        }
+
+        if (!any)
+            return false;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* q = p + 1;
+            bool negativeExp = false;
+            if (q < end && (*q == '-' || *q == '+'))
+                negativeExp = (*q++ == '-');
+
+            if (q < end && IsDigit(*q))
+            {
+                int e = 0;
+                for (; q < end && IsDigit(*q); ++q)
+                {
+                    if (e < 10000)
+                        e = e * 10 + (*q - '0');
+                }
+                exponent += negativeExp ? -e : e;
+                p = q;
+            }
+        }
+
+        double v = double(mantissa);
+        if (exponent < 0)
+            v = (exponent >= -22) ? v / c_PowersOf10[-exponent] : v * pow(10.0, exponent);
+        else if (exponent > 0)
+            v = (exponent <= 22) ? v * c_PowersOf10[exponent] : v * pow(10.0, exponent);
+
+        value = float(negative ? -v : v);
+        return true;
+    }
+
+    bool ReadInt(const char*& p, const char* end, int64_t& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        if (p >= end || !IsDigit(*p))
+            return false;
+
+        int64_t v = 0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            if (v < INT32_MAX)
+                v = v * 10 + (*p - '0');
+        }
+
+        value = negative ? -v : v;
+        return true;
+    }
+
+    // .OBJ and .MTL text is taken to be UTF-8.
+    std::wstring ToWide(const Token& t)
+    {
+        std::wstring str;
+        str.reserve(t.length);
+
+        auto s = reinterpret_cast<const uint8_t*>(t.ptr);
+        for (size_t i = 0; i < t.length; )
+        {
+            uint32_t c = s[i];
+            size_t extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : 0;
+            if (extra)
+            {
+                c &= 0x3F >> extra;
+                for (size_t k = 1; k <= extra && i + k < t.length; ++k)
+                    c = (c << 6) | (s[i + k] & 0x3F);
+            }
+            i += extra + 1;
+
+            if (c >= 0x10000 && sizeof(wchar_t) == 2)
+            {
+                c -= 0x10000;
+                str.push_back(static_cast<wchar_t>(0xD800 + (c >> 10)));
+                str.push_back(static_cast<wchar_t>(0xDC00 + (c & 0x3FF)));
+            }
+            else
+            {
+                str.push_back(static_cast<wchar_t>(c));
+            }
+        }
+        return str;
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // .MTL material libraries
+
+    struct MtlMaterial
+    {
+        Token       name;
+        XMFLOAT3    ambient;
+        XMFLOAT3    diffuse;
+        XMFLOAT3    specular;
+        XMFLOAT3    emissive;
+        float       specularPower;
+        float       alpha;
+        int64_t     illum;
+        Token       diffuseMap;
+    };
+
+    // Defaults of the Visual Studio content pipeline, which uses the same for faces
+    // without a material.
+    const XMFLOAT4 c_DefaultAmbient(0.2f, 0.2f, 0.2f, 1.f);
+    const XMFLOAT4 c_DefaultDiffuse(0.8f, 0.8f, 0.8f, 1.f);
+    const XMFLOAT4 c_DefaultSpecular(0.f, 0.f, 0.f, 1.f);
+    const XMFLOAT4 c_DefaultEmissive(0.f, 0.f, 0.f, 1.f);
+
+    bool ReadColor(const char*& p, const char* end, XMFLOAT3& color)
+    {
+        if (!ReadFloat(p, end, color.x))
+            return false;
+
+        // A single value is a gray level.
+        color.y = color.z = color.x;
+        if (ReadFloat(p, end, color.y))
+            ReadFloat(p, end, color.z);
+        return true;
+    }
+
+    void ParseMTL(const char* p, const char* end, std::vector<MtlMaterial>& materials)
+    {
+        MtlMaterial* m = nullptr;
+
+        for (; p < end; p = NextLine(p, end))
+        {
+            Token keyword = ReadToken(p, end);
+            if (!keyword.length || keyword.ptr[0] == '#')
+                continue;
+
+            if (keyword == "newmtl")
+            {
+                MtlMaterial mat = {};
+                mat.name = ReadRest(p, end);
+                mat.ambient = XMFLOAT3(c_DefaultAmbient.x, c_DefaultAmbient.y, c_DefaultAmbient.z);
+                mat.diffuse = XMFLOAT3(c_DefaultDiffuse.x, c_DefaultDiffuse.y, c_DefaultDiffuse.z);
+                mat.specular = XMFLOAT3(0.f, 0.f, 0.f);
+                mat.emissive = XMFLOAT3(0.f, 0.f, 0.f);
+                mat.specularPower = 1.f;
+                mat.alpha = 1.f;
+                mat.illum = 1;
+                materials.push_back(mat);
+                m = &materials.back();
+                continue;
+            }
+
+            if (!m)
+                continue;
+
+            bool ok = true;
+            if (keyword == "Ka")
+                ok = ReadColor(p, end, m->ambient);
+            else if (keyword == "Kd")
+                ok = ReadColor(p, end, m->diffuse);
+            else if (keyword == "Ks")
+                ok = ReadColor(p, end, m->specular);
+            else if (keyword == "Ke")
+                ok = ReadColor(p, end, m->emissive);
+            else if (keyword == "Ns")
+                ok = ReadFloat(p, end, m->specularPower);
+            else if (keyword == "d")
+                ok = ReadFloat(p, end, m->alpha);
+            else if (keyword == "Tr")
+            {
+                float tr;
+                ok = ReadFloat(p, end, tr);
+                m->alpha = 1.f - tr;
+            }
+            else if (keyword == "illum")
+            {
+                p = SkipBlanks(p, end);
+                ok = ReadInt(p, end, m->illum);
+            }
+            else if (keyword == "map_Kd")
+            {
+                // Options come before the file name, so the name is the last token.
+                for (Token t = ReadToken(p, end); t.length; t = ReadToken(p, end))
+                    m->diffuseMap = t;
+            }
+
+            if (!ok)
+                throw std::runtime_error("Invalid statement in .MTL file");
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // .OBJ geometry. The file is split at line boundaries into one chunk per thread.
+    // Each chunk parses its own attributes and triangles; indices that count back from
+    // the current attribute (negative ones) need the number of attributes in the chunks
+    // before, so they are fixed up once every chunk is done.
+
+    struct Corner
+    {
+        uint32_t    position;
+        uint32_t    texcoord;
+        uint32_t    normal;
+    };
+
+    // corners[slot] component += base of that attribute, where value is chunk-relative.
+    struct Fixup
+    {
+        size_t      slot;
+        uint32_t    component;
+        int64_t     value;
+    };
+
+    // Faces from firstTriangle on use the named material.
+    struct MaterialRun
+    {
+        size_t      firstTriangle;
+        Token       name;
+    };
+
+    struct Chunk
+    {
+        const char*                 begin;
+        const char*                 end;
+        std::vector<XMFLOAT3>       positions;
+        std::vector<XMFLOAT2>       texcoords;
+        std::vector<XMFLOAT3>       normals;
+        std::vector<Corner>         corners;        // three per triangle
+        std::vector<Fixup>          fixups;
+        std::vector<MaterialRun>    runs;
+        Token                       objectName;
+        std::exception_ptr          error;
+
+        // Bases of this chunk's attributes and triangles in the whole file.
+        size_t                      positionBase;
+        size_t                      texcoordBase;
+        size_t                      normalBase;
+        size_t                      cornerBase;
+    };
+
+    // Reads one v, v/vt, v//vn or v/vt/vn corner.
+    bool ReadCorner(const char*& p, const char* end, Chunk& chunk, Corner& c, std::vector<Fixup>& fixups)
+    {
+        size_t counts[3] = { chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size() };
+        uint32_t* values[3] = { &c.position, &c.texcoord, &c.normal };
+
+        c.position = c.texcoord = c.normal = c_None;
+
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            if (k > 0)
+            {
+                if (p >= end || *p != '/')
+                    break;
+                ++p;
+
+                // v//vn
+                if (k == 1 && p < end && *p == '/')
+                    continue;
+            }
+
+            int64_t index;
+            if (!ReadInt(p, end, index) || !index)
+                return false;
+
+            if (index > 0)
+            {
+                if (index > int64_t(UINT32_MAX - 1))
+                    return false;
+
+                *values[k] = static_cast<uint32_t>(index - 1);
+            }
+            else
+            {
+                // Slot is filled in by the caller once the corner is stored.
+                *values[k] = 0;
+                fixups.push_back({ 0, k, int64_t(counts[k]) + index });
+            }
+        }
+
+        return p >= end || *p == '\n' || IsBlank(*p);
+    }
+
+    void ParseChunk(Chunk& chunk)
+    {
+        const char* end = chunk.end;
+
+        std::vector<Corner> polygon;
+        std::vector<Fixup> polygonFixups;
+
+        for (const char* p = chunk.begin; p < end; p = NextLine(p, end))
+        {
+            p = SkipBlanks(p, end);
+            if (p >= end || *p == '\n' || *p == '#')
+                continue;
+
+            if (p[0] == 'v' && p + 1 < end)
+            {
+                bool ok = true;
+                if (IsBlank(p[1]))
+                {
+                    p += 2;
+                    XMFLOAT3 v;
+                    ok = ReadFloat(p, end, v.x) && ReadFloat(p, end, v.y) && ReadFloat(p, end, v.z);
+                    chunk.positions.push_back(v);
+                }
+                else if (p[1] == 't' && p + 2 < end && IsBlank(p[2]))
+                {
+                    p += 3;
+                    XMFLOAT2 t;
+                    ok = ReadFloat(p, end, t.x);
+                    if (!ReadFloat(p, end, t.y))
+                        t.y = 0.f;
+                    chunk.texcoords.push_back(t);
+                }
+                else if (p[1] == 'n' && p + 2 < end && IsBlank(p[2]))
+                {
+                    p += 3;
+                    XMFLOAT3 n;
+                    ok = ReadFloat(p, end, n.x) && ReadFloat(p, end, n.y) && ReadFloat(p, end, n.z);
+                    chunk.normals.push_back(n);
+                }
+
+                if (!ok)
+                    throw std::runtime_error("Invalid vertex in .OBJ file");
+            }
+            else if (p[0] == 'f' && p + 1 < end && IsBlank(p[1]))
+            {
+                p += 2;
+                polygon.clear();
+                polygonFixups.clear();
+
+                for (;;)
+                {
+                    p = SkipBlanks(p, end);
+                    if (p >= end || *p == '\n' || *p == '#')
+                        break;
+
+                    size_t firstFixup = polygonFixups.size();
+
+                    Corner c;
+                    if (!ReadCorner(p, end, chunk, c, polygonFixups))
+                        throw std::runtime_error("Invalid face in .OBJ file");
+
+                    for (size_t f = firstFixup; f < polygonFixups.size(); ++f)
+                        polygonFixups[f].slot = polygon.size();
+
+                    polygon.push_back(c);
+                }
+
+                if (polygon.size() < 3)
+                    throw std::runtime_error("Invalid face in .OBJ file");
+
+                // Fan triangulation, keeping the winding. Fixups follow the corners
+                // that are emitted more than once.
+                for (size_t k = 1; k + 1 < polygon.size(); ++k)
+                {
+                    size_t corners[3] = { 0, k, k + 1 };
+                    for (size_t j = 0; j < 3; ++j)
+                    {
+                        for (auto& f : polygonFixups)
+                        {
+                            if (f.slot == corners[j])
+                                chunk.fixups.push_back({ chunk.corners.size(), f.component, f.value });
+                        }
+                        chunk.corners.push_back(polygon[corners[j]]);
+                    }
+                }
+            }
+            else
+            {
+                Token keyword = ReadToken(p, end);
+                if (keyword == "usemtl")
+                {
+                    chunk.runs.push_back({ chunk.corners.size() / 3, ReadRest(p, end) });
+                }
+                else if ((keyword == "o" || keyword == "g") && !chunk.objectName.length)
+                {
+                    chunk.objectName = ReadRest(p, end);
+                }
+            }
+        }
+    }
+
+    void ParseChunks(std::vector<Chunk>& chunks)
+    {
+        auto run = [](Chunk& chunk)
+        {
+            try
+            {
+                ParseChunk(chunk);
+            }
+            catch (...)
+            {
+                chunk.error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t j = 1; j < chunks.size(); ++j)
+            threads.emplace_back(run, std::ref(chunks[j]));
+
+        run(chunks[0]);
+
+        for (auto& t : threads)
+            t.join();
+
+        for (auto& chunk : chunks)
+        {
+            if (chunk.error)
+                std::rethrow_exception(chunk.error);
+        }
+    }
+
+    // Runs fn(begin, end) over [0, count) on up to threadCount threads.
+    template<typename TFn>
+    void ParallelFor(size_t count, size_t threadCount, TFn fn)
+    {
+        threadCount = std::max<size_t>(1, std::min(threadCount, count));
+        size_t step = (count + threadCount - 1) / std::max<size_t>(1, threadCount);
+
+        std::vector<std::thread> threads;
+        for (size_t j = 1; j < threadCount; ++j)
+        {
+            size_t begin = j * step;
+            size_t end = std::min(count, begin + step);
+            if (begin < end)
+                threads.emplace_back(fn, begin, end);
+        }
+
+        fn(size_t(0), std::min(count, step));
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Welding: every distinct position/texcoord/normal triple becomes one vertex, in the
+    // order the triples are first used.
+
+    inline uint64_t HashCorner(const Corner& c)
+    {
+        uint64_t h = (uint64_t(c.position) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(c.texcoord) * 0xC2B2AE3D27D4EB4Full)
+                   ^ (uint64_t(c.normal) * 0x165667B19E3779F9ull);
+        return h ^ (h >> 29);
+    }
+
+    inline bool operator== (const Corner& a, const Corner& b)
+    {
+        return a.position == b.position && a.texcoord == b.texcoord && a.normal == b.normal;
+    }
+
+    void WeldCorners(const std::vector<Corner>& corners, std::vector<uint32_t>& indices, std::vector<Corner>& unique)
+    {
+        size_t tableSize = 1;
+        while (tableSize < corners.size() * 2)
+            tableSize <<= 1;
+
+        std::vector<uint32_t> table(tableSize, c_None);
+
+        indices.resize(corners.size());
+        unique.clear();
+
+        for (size_t j = 0; j < corners.size(); ++j)
+        {
+            const Corner& c = corners[j];
+
+            size_t slot = size_t(HashCorner(c)) & (tableSize - 1);
+            for (;;)
+            {
+                uint32_t v = table[slot];
+                if (v == c_None)
+                {
+                    if (unique.size() >= c_None)
+                        throw std::runtime_error("Too many vertices in .OBJ file");
+
+                    v = static_cast<uint32_t>(unique.size());
+                    table[slot] = v;
+                    unique.push_back(c);
+                    indices[j] = v;
+                    break;
+                }
+
+                if (unique[v] == c)
+                {
+                    indices[j] = v;
+                    break;
+                }
+
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Normals for corners without one, averaged over the faces sharing the position and
+    // weighted by area; then a tangent frame from the texture coordinates.
+
+    void ComputeMissingNormals(const std::vector<uint32_t>& indices, const std::vector<Corner>& unique,
+                               const std::vector<XMFLOAT3>& positions, std::vector<Vertex>& vertices)
+    {
+        std::vector<XMFLOAT3> sums(positions.size(), XMFLOAT3(0.f, 0.f, 0.f));
+
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            uint32_t p0 = unique[indices[t]].position;
+            uint32_t p1 = unique[indices[t + 1]].position;
+            uint32_t p2 = unique[indices[t + 2]].position;
+
+            XMVECTOR v0 = XMLoadFloat3(&positions[p0]);
+            XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&positions[p1]), v0);
+            XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&positions[p2]), v0);
+            XMVECTOR n = XMVector3Cross(e1, e2);
+
+            for (uint32_t p : { p0, p1, p2 })
+                XMStoreFloat3(&sums[p], XMVectorAdd(XMLoadFloat3(&sums[p]), n));
+        }
+
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            if (unique[v].normal == c_None)
+                XMStoreFloat3(&vertices[v].normal, XMVector3Normalize(XMLoadFloat3(&sums[unique[v].position])));
+        }
+    }
+
+    void ComputeTangents(const std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+    {
+        std::vector<XMFLOAT3> tangents(vertices.size(), XMFLOAT3(0.f, 0.f, 0.f));
+        std::vector<XMFLOAT3> bitangents(vertices.size(), XMFLOAT3(0.f, 0.f, 0.f));
+
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            const Vertex& a = vertices[indices[t]];
+            const Vertex& b = vertices[indices[t + 1]];
+            const Vertex& c = vertices[indices[t + 2]];
+
+            XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&b.position), XMLoadFloat3(&a.position));
+            XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&c.position), XMLoadFloat3(&a.position));
+
+            float du1 = b.textureCoordinate.x - a.textureCoordinate.x;
+            float dv1 = b.textureCoordinate.y - a.textureCoordinate.y;
+            float du2 = c.textureCoordinate.x - a.textureCoordinate.x;
+            float dv2 = c.textureCoordinate.y - a.textureCoordinate.y;
+
+            float det = du1 * dv2 - du2 * dv1;
+            if (fabsf(det) < FLT_EPSILON * FLT_EPSILON)
+                continue;
+
+            float r = 1.f / det;
+            XMVECTOR tangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, dv2), XMVectorScale(e2, dv1)), r);
+            XMVECTOR bitangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e2, du1), XMVectorScale(e1, du2)), r);
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[t + k];
+                XMStoreFloat3(&tangents[v], XMVectorAdd(XMLoadFloat3(&tangents[v]), tangent));
+                XMStoreFloat3(&bitangents[v], XMVectorAdd(XMLoadFloat3(&bitangents[v]), bitangent));
+            }
+        }
+
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            XMVECTOR n = XMLoadFloat3(&vertices[v].normal);
+            XMVECTOR t = XMLoadFloat3(&tangents[v]);
+
+            // Gram-Schmidt against the normal, falling back to any perpendicular axis
+            // where the texture coordinates are degenerate.
+            t = XMVectorSubtract(t, XMVectorScale(n, XMVectorGetX(XMVector3Dot(n, t))));
+            if (XMVectorGetX(XMVector3LengthSq(t)) < FLT_EPSILON)
+            {
+                XMVECTOR axis = (fabsf(vertices[v].normal.x) < 0.9f) ? g_XMIdentityR0 : g_XMIdentityR1;
+                t = XMVector3Cross(n, axis);
+            }
+            t = XMVector3Normalize(t);
+
+            float w = (XMVectorGetX(XMVector3Dot(XMVector3Cross(n, t), XMLoadFloat3(&bitangents[v]))) < 0.f) ? -1.f : 1.f;
+
+            XMStoreFloat4(&vertices[v].tangent, XMVectorSetW(t, w));
+        }
+    }
+}
+
+
+//======================================================================================
+// OBJ parser
+//======================================================================================
+
+std::wstring ModelData::GetOBJMaterialLibrary(const uint8_t* objData, size_t objSize)
+{
+    if (!objData)
+        throw std::invalid_argument("objData cannot be null");
+
+    auto end = reinterpret_cast<const char*>(objData) + objSize;
+    for (auto p = reinterpret_cast<const char*>(objData); p < end; p = NextLine(p, end))
+    {
+        p = SkipBlanks(p, end);
+        if (p < end && *p == 'm')
+        {
+            Token keyword = ReadToken(p, end);
+            if (keyword == "mtllib")
+                return ToWide(ReadRest(p, end));
+        }
+    }
+
+    return std::wstring();
+}
+
+
+std::unique_ptr<ModelData> ModelData::ParseOBJ(const uint8_t* objData, size_t objSize, const uint8_t* mtlData, size_t mtlSize, uint32_t flags)
+{
+    if (!objData)
+        throw std::invalid_argument("objData cannot be null");
+
+    auto text = reinterpret_cast<const char*>(objData);
+
+    size_t threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    threadCount = std::max<size_t>(1, std::min(threadCount, objSize / c_MinChunkSize));
+
+    // Chunks, split after a newline
+    std::vector<Chunk> chunks(threadCount);
+    {
+        const char* begin = text;
+        for (size_t j = 0; j < threadCount; ++j)
+        {
+            const char* end = text + objSize;
+            if (j + 1 < threadCount)
+            {
+                end = std::max(begin, text + objSize * (j + 1) / threadCount);
+                end = NextLine(end > text ? end - 1 : end, text + objSize);
+            }
+
+            chunks[j].begin = begin;
+            chunks[j].end = end;
+            begin = end;
+        }
+    }
+
+    ParseChunks(chunks);
+
+    // Where each chunk's attributes and triangles go in the whole file
+    size_t nPositions = 0;
+    size_t nTexcoords = 0;
+    size_t nNormals = 0;
+    size_t nCorners = 0;
+    for (auto& chunk : chunks)
+    {
+        chunk.positionBase = nPositions;
+        chunk.texcoordBase = nTexcoords;
+        chunk.normalBase = nNormals;
+        chunk.cornerBase = nCorners;
+        nPositions += chunk.positions.size();
+        nTexcoords += chunk.texcoords.size();
+        nNormals += chunk.normals.size();
+        nCorners += chunk.corners.size();
+    }
+
+    if (!nCorners)
+        throw std::runtime_error("No faces found");
+
+    if (nPositions >= c_None || nTexcoords >= c_None || nNormals >= c_None)
+        throw std::runtime_error("Too many vertices in .OBJ file");
+
+    std::vector<XMFLOAT3> positions(nPositions);
+    std::vector<XMFLOAT2> texcoords(nTexcoords);
+    std::vector<XMFLOAT3> normals(nNormals);
+    std::vector<Corner> corners(nCorners);
+
+    // Gather the chunks, resolving relative indices and checking the rest
+    ParallelFor(chunks.size(), chunks.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t j = begin; j < end; ++j)
+        {
+            auto& chunk = chunks[j];
+
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + ptrdiff_t(chunk.positionBase));
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + ptrdiff_t(chunk.texcoordBase));
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + ptrdiff_t(chunk.normalBase));
+
+            const size_t bases[3] = { chunk.positionBase, chunk.texcoordBase, chunk.normalBase };
+            for (auto& f : chunk.fixups)
+            {
+                int64_t value = int64_t(bases[f.component]) + f.value;
+                uint32_t* c = &chunk.corners[f.slot].position + f.component;
+                *c = (value >= 0 && value < int64_t(c_None)) ? static_cast<uint32_t>(value) : c_None - 1;
+            }
+
+            for (auto& c : chunk.corners)
+            {
+                if (c.position >= nPositions
+                    || (c.texcoord != c_None && c.texcoord >= nTexcoords)
+                    || (c.normal != c_None && c.normal >= nNormals))
+                {
+                    chunk.error = std::make_exception_ptr(std::runtime_error("Invalid index in .OBJ file"));
+                    break;
+                }
+            }
+
+            std::copy(chunk.corners.begin(), chunk.corners.end(), corners.begin() + ptrdiff_t(chunk.cornerBase));
+        }
+    });
+
+    for (auto& chunk : chunks)
+    {
+        if (chunk.error)
+            std::rethrow_exception(chunk.error);
+    }
+
+    // Material runs over the whole file; a chunk continues the material of the one
+    // before it until its first usemtl.
+    std::vector<MaterialRun> runs;
+    for (auto& chunk : chunks)
+    {
+        for (auto& r : chunk.runs)
+        {
+            size_t first = chunk.cornerBase / 3 + r.firstTriangle;
+            if (!runs.empty() && runs.back().firstTriangle == first)
+                runs.back().name = r.name;
+            else if (runs.empty() || !(runs.back().name == r.name))
+                runs.push_back({ first, r.name });
+        }
+    }
+
+    std::vector<MtlMaterial> library;
+    if (mtlData)
+    {
+        auto mtlText = reinterpret_cast<const char*>(mtlData);
+        ParseMTL(mtlText, mtlText + mtlSize, library);
+    }
+
+    std::vector<uint32_t> indices;
+    std::vector<Corner> unique;
+    WeldCorners(corners, indices, unique);
+
+    // Vertices
+    std::vector<Vertex> vertices(unique.size());
+    bool missingNormals = false;
+    for (auto& c : unique)
+    {
+        if (c.normal == c_None)
+            missingNormals = true;
+    }
+
+    ParallelFor(vertices.size(), threadCount, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            const Corner& c = unique[v];
+            Vertex& out = vertices[v];
+            out.position = positions[c.position];
+            out.normal = (c.normal != c_None) ? normals[c.normal] : XMFLOAT3(0.f, 0.f, 0.f);
+            out.tangent = XMFLOAT4(0.f, 0.f, 0.f, 1.f);
+            out.color = 0xFFFFFFFF;
+            out.textureCoordinate = (c.texcoord != c_None) ? texcoords[c.texcoord] : XMFLOAT2(0.f, 0.f);
+        }
+    });
+
+    if (missingNormals)
+        ComputeMissingNormals(indices, unique, positions, vertices);
+
+    ComputeTangents(indices, vertices);
+
+    // Materials: the default first, for faces before any usemtl, then the ones used in
+    // library order, then used names the library does not have, with default values.
+    std::unique_ptr<ModelData> data(new ModelData());
+    data->uvTransformBaked = (flags & ParseFlags_BakeUVTransform) != 0;
+
+    auto addMaterial = [&](const std::wstring& name, const MtlMaterial* src)
+    {
+        Material m;
+        m.name = name;
+        m.ambient = c_DefaultAmbient;
+        m.diffuse = c_DefaultDiffuse;
+        m.specular = c_DefaultSpecular;
+        m.emissive = c_DefaultEmissive;
+        m.specularPower = 1.f;
+        m.pixelShader = L"lambert.dgsl";
+        XMStoreFloat4x4(&m.uvTransform, XMMatrixIdentity());
+
+        if (src)
+        {
+            m.ambient = XMFLOAT4(src->ambient.x, src->ambient.y, src->ambient.z, 1.f);
+            m.diffuse = XMFLOAT4(src->diffuse.x, src->diffuse.y, src->diffuse.z, src->alpha);
+            m.specular = XMFLOAT4(src->specular.x, src->specular.y, src->specular.z, 1.f);
+            m.emissive = XMFLOAT4(src->emissive.x, src->emissive.y, src->emissive.z, 1.f);
+            m.specularPower = std::max(src->specularPower, 1.f);
+            m.texture[0] = ToWide(src->diffuseMap);
+
+            // illum 2 and up is highlight on
+            bool specular = src->specular.x > 0.f || src->specular.y > 0.f || src->specular.z > 0.f;
+            if (src->illum >= 2 && specular)
+                m.pixelShader = L"phong.dgsl";
+        }
+
+        data->materials.emplace_back(std::move(m));
+    };
+
+    addMaterial(L"default", nullptr);
+
+    std::vector<uint32_t> runMaterials(runs.size(), c_None);
+    for (size_t l = 0; l < library.size(); ++l)
+    {
+        bool used = false;
+        for (size_t r = 0; r < runs.size(); ++r)
+        {
+            if (runMaterials[r] == c_None && runs[r].name == library[l].name)
+            {
+                if (!used)
+                    addMaterial(ToWide(library[l].name), &library[l]);
+                used = true;
+                runMaterials[r] = static_cast<uint32_t>(data->materials.size() - 1);
+            }
+        }
+    }
+
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        if (runMaterials[r] != c_None)
+            continue;
+
+        addMaterial(ToWide(runs[r].name), nullptr);
+        for (size_t q = r; q < runs.size(); ++q)
+        {
+            if (runMaterials[q] == c_None && runs[q].name == runs[r].name)
+                runMaterials[q] = static_cast<uint32_t>(data->materials.size() - 1);
+        }
+    }
+
+    // One mesh, one vertex and index buffer, and a submesh per material run
+    Mesh mesh = {};
+    for (auto& chunk : chunks)
+    {
+        if (chunk.objectName.length)
+        {
+            mesh.name = ToWide(chunk.objectName);
+            break;
+        }
+    }
+
+    mesh.materialCount = static_cast<uint32_t>(data->materials.size());
+    mesh.vertexBufferCount = 1;
+    mesh.indexBufferCount = 1;
+
+    size_t nFaces = indices.size() / 3;
+    size_t first = 0;
+    uint32_t material = 0;
+    for (size_t r = 0; r <= runs.size(); ++r)
+    {
+        size_t next = (r < runs.size()) ? runs[r].firstTriangle : nFaces;
+        if (next > first)
+        {
+            SubMesh sm = {};
+            sm.materialIndex = material;
+            sm.startIndex = static_cast<uint32_t>(first * 3);
+            sm.indexCount = static_cast<uint32_t>((next - first) * 3);
+            data->subMeshes.push_back(sm);
+            first = next;
+        }
+
+        if (r < runs.size())
+            material = runMaterials[r];
+    }
+    mesh.subMeshCount = static_cast<uint32_t>(data->subMeshes.size());
+
+    if (indices.size() > UINT32_MAX)
+        throw std::runtime_error("Too many faces in .OBJ file");
+
+    VertexBuffer vb;
+    vb.data = data->AddOwned(vertices.data(), vertices.size() * sizeof(Vertex));
+    vb.format = VertexFormat_PositionNormalTangentColorTexture;
+    vb.stride = sizeof(Vertex);
+    vb.vertexCount = static_cast<uint32_t>(vertices.size());
+    data->vertexBuffers.push_back(vb);
+
+    IndexBuffer ib;
+    ib.indexCount = static_cast<uint32_t>(indices.size());
+    if (vertices.size() <= 0x10000)
+    {
+        ib.indexSize = sizeof(uint16_t);
+        ib.data = data->AddOwned(nullptr, indices.size() * sizeof(uint16_t));
+
+        auto dest = reinterpret_cast<uint16_t*>(data->GetOwnedData(ib.data));
+        for (size_t j = 0; j < indices.size(); ++j)
+            dest[j] = static_cast<uint16_t>(indices[j]);
+    }
+    else
+    {
+        ib.indexSize = sizeof(uint32_t);
+        ib.data = data->AddOwned(indices.data(), indices.size() * sizeof(uint32_t));
+    }
+    data->indexBuffers.push_back(ib);
+
+    // Extents: the box, and a sphere around its center
+    XMVECTOR vmin = g_XMFltMax;
+    XMVECTOR vmax = XMVectorNegate(g_XMFltMax);
+    for (auto& v : vertices)
+    {
+        XMVECTOR p = XMLoadFloat3(&v.position);
+        vmin = XMVectorMin(vmin, p);
+        vmax = XMVectorMax(vmax, p);
+    }
+
+    XMVECTOR center = XMVectorScale(XMVectorAdd(vmin, vmax), 0.5f);
+    float radius = 0.f;
+    for (auto& v : vertices)
+        radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&v.position), center))));
+
+    XMStoreFloat3(&mesh.center, center);
+    XMStoreFloat3(&mesh.boxMin, vmin);
+    XMStoreFloat3(&mesh.boxMax, vmax);
+    mesh.radius = radius;
+
+    data->meshes.emplace_back(std::move(mesh));
+
+    if (flags & ParseFlags_BakeUVTransform)
+        data->BakeUVTransforms();
+
+    if (flags & ParseFlags_OptimizeMeshes)
+        data->Optimize();
+
+    if (flags & ParseFlags_GenerateLODs)
+        data->GenerateLODs();
+
+    return data;
+}
@@ -0,0 +1,863 @@
+//--------------------------------------------------------------------------------------
+// File: ModelDataPacked.cpp
+//
+// Reads and writes the packed model (.PMDL) format. Built without the precompiled
+// header so it does not depend on Direct3D, which also lets PackModel use it.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "ModelData.h"
+#include "PackedModel.h"
+
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+using namespace PackedModel;
+
+
+namespace
+{
+    // Same layout as VertexPositionNormalTangentColorTexture
+    struct Vertex
+    {
+        XMFLOAT3    position;
+        XMFLOAT3    normal;
+        XMFLOAT4    tangent;
+        uint32_t    color;
+        XMFLOAT2    textureCoordinate;
+    };
+
+    // Blend indices and weights that follow Vertex in
+    // VertexPositionNormalTangentColorTextureSkinning
+    struct Skinning
+    {
+        uint32_t    indices;
+        uint32_t    weights;
+    };
+
+    static_assert(sizeof(Vertex) == 52, "Vertex layout mismatch");
+    static_assert(sizeof(Skinning) == 8, "Skinning layout mismatch");
+
+    // Texture coordinates in (-2, 2) stay within 1/2048 of their value as halves.
+    const float c_MaxHalfTexCoord = 2.f;
+
+    size_t UnpackedStride(uint32_t format)
+    {
+        return (format == ModelData::VertexFormat_PositionNormalTangentColorTextureSkinning)
+            ? sizeof(Vertex) + sizeof(Skinning) : sizeof(Vertex);
+    }
+
+    size_t PackedStride(uint32_t format, uint32_t flags)
+    {
+        size_t stride = sizeof(vertex_t);
+        stride += (flags & VERTEX_FLAGS_FLOAT_TEXCOORD) ? sizeof(XMFLOAT2) : sizeof(PackedVector::XMHALF2);
+        if (format == ModelData::VertexFormat_PositionNormalTangentColorTextureSkinning)
+            stride += sizeof(Skinning);
+        return stride;
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Octahedral unit vectors: the vector is projected onto the octahedron |x|+|y|+|z| = 1
+    // and the lower half folded over the upper, so two SNORM16s cover the sphere with a
+    // worst case error of about 0.005 degrees.
+
+    inline float SignNotZero(float v)
+    {
+        return (v >= 0.f) ? 1.f : -1.f;
+    }
+
+    XMFLOAT3 OctDecode(int16_t qx, int16_t qy)
+    {
+        float x = std::max(float(qx) / 32767.f, -1.f);
+        float y = std::max(float(qy) / 32767.f, -1.f);
+        float z = 1.f - fabsf(x) - fabsf(y);
+        if (z < 0.f)
+        {
+            float fx = (1.f - fabsf(y)) * SignNotZero(x);
+            float fy = (1.f - fabsf(x)) * SignNotZero(y);
+            x = fx;
+            y = fy;
+        }
+
+        float invLength = 1.f / sqrtf(x * x + y * y + z * z);
+        return XMFLOAT3(x * invLength, y * invLength, z * invLength);
+    }
+
+    // Tries the four roundings of the projected point and keeps the one that decodes
+    // closest to v. A zero vector encodes as +Z.
+    void OctEncode(const XMFLOAT3& v, int16_t q[2])
+    {
+        float sum = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+        if (!(sum > 0.f))
+        {
+            q[0] = q[1] = 0;
+            return;
+        }
+
+        float x = v.x / sum;
+        float y = v.y / sum;
+        if (v.z < 0.f)
+        {
+            float fx = (1.f - fabsf(y)) * SignNotZero(x);
+            float fy = (1.f - fabsf(x)) * SignNotZero(y);
+            x = fx;
+            y = fy;
+        }
+
+        float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+
+        float best = -2.f;
+        for (int i = 0; i < 4; ++i)
+        {
+            float cx = (i & 1) ? ceilf(x * 32767.f) : floorf(x * 32767.f);
+            float cy = (i & 2) ? ceilf(y * 32767.f) : floorf(y * 32767.f);
+            int16_t tx = static_cast<int16_t>(std::min(std::max(cx, -32767.f), 32767.f));
+            int16_t ty = static_cast<int16_t>(std::min(std::max(cy, -32767.f), 32767.f));
+
+            XMFLOAT3 d = OctDecode(tx, ty);
+            float cosine = (d.x * v.x + d.y * v.y + d.z * v.z) / length;
+            if (cosine > best)
+            {
+                best = cosine;
+                q[0] = tx;
+                q[1] = ty;
+            }
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Bounds-checked access to the file. Nothing in it is guaranteed to be aligned in
+    // memory, so tables and values are copied out.
+    class PackedReader
+    {
+    public:
+        PackedReader(const uint8_t* data, size_t size) :
+            mData(data),
+            mSize(size),
+            mPos(0)
+        {
+        }
+
+        // Start of count elements of elementSize bytes at offset.
+        const uint8_t* At(uint64_t offset, size_t elementSize, uint64_t count) const
+        {
+            if (offset > mSize || count > (mSize - offset) / elementSize)
+                throw std::runtime_error("End of file");
+
+            return mData + offset;
+        }
+
+        template<typename T> T Read()
+        {
+            T value;
+            memcpy(&value, At(mPos, sizeof(T), 1), sizeof(T));
+            mPos += sizeof(T);
+            return value;
+        }
+
+        template<typename T> std::vector<T> ReadTable(uint32_t count)
+        {
+            const uint8_t* src = At(mPos, sizeof(T), count);
+
+            std::vector<T> table(count);
+            if (count)
+                memcpy(table.data(), src, sizeof(T) * count);
+            mPos += sizeof(T) * count;
+            return table;
+        }
+
+        size_t GetPosition() const { return mPos; }
+
+    private:
+        const uint8_t*  mData;
+        size_t          mSize;
+        size_t          mPos;
+    };
+
+
+    class StringTable
+    {
+    public:
+        explicit StringTable(std::vector<uint16_t> units) :
+            mUnits(std::move(units))
+        {
+        }
+
+        std::wstring Get(const string_t& s) const
+        {
+            if (s.offset > mUnits.size() || s.length > mUnits.size() - s.offset)
+                throw std::runtime_error("Invalid string found");
+
+            std::wstring str;
+            str.resize(s.length);
+            for (uint32_t i = 0; i < s.length; ++i)
+                str[i] = static_cast<wchar_t>(mUnits[s.offset + i]);
+            return str;
+        }
+
+    private:
+        std::vector<uint16_t> mUnits;
+    };
+
+
+    void CheckRange(uint32_t first, uint32_t count, size_t tableSize)
+    {
+        if (uint64_t(first) + count > tableSize)
+            throw std::runtime_error("Invalid mesh found");
+    }
+
+
+    void UnpackVertices(uint8_t* dest, const uint8_t* src, const vertexBuffer_t& vb)
+    {
+        const bool floatTexCoord = (vb.flags & VERTEX_FLAGS_FLOAT_TEXCOORD) != 0;
+        const bool skinning = (vb.format == ModelData::VertexFormat_PositionNormalTangentColorTextureSkinning);
+        const size_t destStride = UnpackedStride(vb.format);
+
+        for (uint32_t i = 0; i < vb.vertexCount; ++i, src += vb.stride, dest += destStride)
+        {
+            vertex_t in;
+            memcpy(&in, src, sizeof(in));
+
+            Vertex out;
+            out.position.x = vb.positionMin[0] + float(in.position[0]) * vb.positionScale[0];
+            out.position.y = vb.positionMin[1] + float(in.position[1]) * vb.positionScale[1];
+            out.position.z = vb.positionMin[2] + float(in.position[2]) * vb.positionScale[2];
+
+            out.normal = OctDecode(in.normal[0], in.normal[1]);
+
+            XMFLOAT3 t = OctDecode(in.tangent[0], in.tangent[1]);
+            float w = 0.f;
+            switch (in.tangentW & 3)
+            {
+            case TANGENT_W_POSITIVE: w = 1.f; break;
+            case TANGENT_W_NEGATIVE: w = -1.f; break;
+            }
+            out.tangent = XMFLOAT4(t.x, t.y, t.z, w);
+
+            out.color = in.color;
+
+            const uint8_t* tc = src + sizeof(vertex_t);
+            if (floatTexCoord)
+            {
+                memcpy(&out.textureCoordinate, tc, sizeof(XMFLOAT2));
+                tc += sizeof(XMFLOAT2);
+            }
+            else
+            {
+                PackedVector::HALF uv[2];
+                memcpy(uv, tc, sizeof(uv));
+                out.textureCoordinate.x = PackedVector::XMConvertHalfToFloat(uv[0]);
+                out.textureCoordinate.y = PackedVector::XMConvertHalfToFloat(uv[1]);
+                tc += sizeof(uv);
+            }
+
+            memcpy(dest, &out, sizeof(out));
+
+            if (skinning)
+                memcpy(dest + sizeof(Vertex), tc, sizeof(Skinning));
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Output file under construction.
+    class PackedWriter
+    {
+    public:
+        explicit PackedWriter(std::vector<uint8_t>& fileData) :
+            mFile(fileData)
+        {
+            mFile.clear();
+        }
+
+        string_t AddString(const std::wstring& str)
+        {
+            auto it = mStringIndex.find(str);
+            if (it != mStringIndex.end())
+                return it->second;
+
+            if (str.size() > UINT32_MAX - mStrings.size())
+                throw std::length_error("String table too large");
+
+            string_t s;
+            s.offset = static_cast<uint32_t>(mStrings.size());
+            s.length = static_cast<uint32_t>(str.size());
+            for (wchar_t c : str)
+            {
+                if (uint32_t(c) > 0xffff)
+                    throw std::runtime_error("Names must be UTF-16");
+
+                mStrings.push_back(static_cast<uint16_t>(c));
+            }
+
+            mStringIndex[str] = s;
+            return s;
+        }
+
+        // Appends a table or a data block on a 4-byte boundary and returns its offset.
+        uint64_t Append(const void* data, size_t size)
+        {
+            size_t offset = (mFile.size() + 3) & ~size_t(3);
+            mFile.resize(offset + size);
+            if (data && size)
+                memcpy(mFile.data() + offset, data, size);
+            return offset;
+        }
+
+        uint8_t* Reserve(size_t size, uint64_t* offset)
+        {
+            *offset = Append(nullptr, size);
+            return mFile.data() + *offset;
+        }
+
+        const std::vector<uint16_t>& GetStrings() const { return mStrings; }
+
+        // Overwrites bytes already appended.
+        void Patch(uint64_t offset, const void* data, size_t size)
+        {
+            if (size)
+                memcpy(mFile.data() + offset, data, size);
+        }
+
+    private:
+        std::vector<uint8_t>&               mFile;
+        std::vector<uint16_t>               mStrings;
+        std::map<std::wstring, string_t>    mStringIndex;
+    };
+
+
+    void PackVertices(uint8_t* dest, const uint8_t* src, size_t srcStride, const vertexBuffer_t& vb)
+    {
+        const bool floatTexCoord = (vb.flags & VERTEX_FLAGS_FLOAT_TEXCOORD) != 0;
+        const bool skinning = (vb.format == ModelData::VertexFormat_PositionNormalTangentColorTextureSkinning);
+
+        const float* pmin = vb.positionMin;
+        const float* pscale = vb.positionScale;
+
+        for (uint32_t i = 0; i < vb.vertexCount; ++i, src += srcStride, dest += vb.stride)
+        {
+            Vertex in;
+            memcpy(&in, src, sizeof(in));
+
+            vertex_t out;
+
+            const float p[3] = { in.position.x, in.position.y, in.position.z };
+            for (size_t c = 0; c < 3; ++c)
+            {
+                float q = (pscale[c] > 0.f) ? floorf((p[c] - pmin[c]) / pscale[c] + 0.5f) : 0.f;
+                out.position[c] = static_cast<uint16_t>(std::min(std::max(q, 0.f), 65535.f));
+            }
+
+            OctEncode(in.normal, out.normal);
+            OctEncode(XMFLOAT3(in.tangent.x, in.tangent.y, in.tangent.z), out.tangent);
+
+            out.tangentW = static_cast<uint16_t>((in.tangent.w > 0.f) ? TANGENT_W_POSITIVE
+                                               : (in.tangent.w < 0.f) ? TANGENT_W_NEGATIVE : TANGENT_W_ZERO);
+            out.color = in.color;
+
+            memcpy(dest, &out, sizeof(out));
+
+            uint8_t* tc = dest + sizeof(vertex_t);
+            if (floatTexCoord)
+            {
+                memcpy(tc, &in.textureCoordinate, sizeof(XMFLOAT2));
+                tc += sizeof(XMFLOAT2);
+            }
+            else
+            {
+                PackedVector::HALF uv[2] =
+                {
+                    PackedVector::XMConvertFloatToHalf(in.textureCoordinate.x),
+                    PackedVector::XMConvertFloatToHalf(in.textureCoordinate.y)
+                };
+                memcpy(tc, uv, sizeof(uv));
+                tc += sizeof(uv);
+            }
+
+            if (skinning)
+                memcpy(tc, src + sizeof(Vertex), sizeof(Skinning));
+        }
+    }
+}
+
+
+//======================================================================================
+// Packed model parser
+//======================================================================================
+
+std::unique_ptr<ModelData> ModelData::ParsePacked(const uint8_t* meshData, size_t dataSize, uint32_t flags)
+{
+    if (!meshData)
+        throw std::invalid_argument("meshData cannot be null");
+
+    PackedReader reader(meshData, dataSize);
+
+    auto header = reader.Read<header_t>();
+    if (header.magic != MAGIC)
+        throw std::runtime_error("Not a packed model file");
+
+    if (header.version != VERSION)
+        throw std::runtime_error("Unsupported packed model version");
+
+    if (!header.numMeshes)
+        throw std::runtime_error("No meshes found");
+
+    auto meshTable = reader.ReadTable<mesh_t>(header.numMeshes);
+    auto materialTable = reader.ReadTable<material_t>(header.numMaterials);
+    auto subMeshTable = reader.ReadTable<subMesh_t>(header.numSubMeshes);
+    auto vbTable = reader.ReadTable<vertexBuffer_t>(header.numVertexBuffers);
+    auto ibTable = reader.ReadTable<indexBuffer_t>(header.numIndexBuffers);
+    auto boneTable = reader.ReadTable<bone_t>(header.numBones);
+    auto clipTable = reader.ReadTable<clip_t>(header.numClips);
+    StringTable strings(reader.ReadTable<uint16_t>(header.stringTableLength));
+
+    std::unique_ptr<ModelData> data(new ModelData());
+    data->SetSource(meshData, dataSize);
+    data->uvTransformBaked = (header.flags & HEADER_FLAGS_UV_TRANSFORM_BAKED) != 0;
+
+    // Materials
+    data->materials.reserve(header.numMaterials);
+    for (auto& m : materialTable)
+    {
+        Material mat;
+        mat.name = strings.Get(m.name);
+        mat.pixelShader = strings.Get(m.pixelShader);
+        for (uint32_t t = 0; t < MAX_TEXTURE; ++t)
+            mat.texture[t] = strings.Get(m.texture[t]);
+        memcpy(&mat.ambient, m.ambient, sizeof(mat.ambient));
+        memcpy(&mat.diffuse, m.diffuse, sizeof(mat.diffuse));
+        memcpy(&mat.specular, m.specular, sizeof(mat.specular));
+        memcpy(&mat.emissive, m.emissive, sizeof(mat.emissive));
+        mat.specularPower = m.specularPower;
+        memcpy(&mat.uvTransform, m.uvTransform, sizeof(mat.uvTransform));
+        data->materials.emplace_back(std::move(mat));
+    }
+
+    // Submeshes
+    data->subMeshes.reserve(header.numSubMeshes);
+    for (auto& sm : subMeshTable)
+    {
+        SubMesh subMesh;
+        subMesh.materialIndex = sm.materialIndex;
+        subMesh.indexBufferIndex = sm.indexBufferIndex;
+        subMesh.vertexBufferIndex = sm.vertexBufferIndex;
+        subMesh.startIndex = sm.startIndex;
+        subMesh.indexCount = sm.indexCount;
+        data->subMeshes.emplace_back(subMesh);
+    }
+
+    // Index buffers are used as stored
+    data->indexBuffers.reserve(header.numIndexBuffers);
+    for (auto& ib : ibTable)
+    {
+        if ((ib.indexSize != sizeof(uint16_t) && ib.indexSize != sizeof(uint32_t)) || !ib.indexCount)
+            throw std::runtime_error("Invalid index buffer found");
+
+        reader.At(ib.dataOffset, ib.indexSize, ib.indexCount);
+
+        IndexBuffer indexBuffer;
+        indexBuffer.data.location = BlobLocation_Source;
+        indexBuffer.data.offset = static_cast<size_t>(ib.dataOffset);
+        indexBuffer.data.size = size_t(ib.indexSize) * ib.indexCount;
+        indexBuffer.indexSize = ib.indexSize;
+        indexBuffer.indexCount = ib.indexCount;
+        data->indexBuffers.emplace_back(indexBuffer);
+    }
+
+    // Vertex buffers are expanded, all into one allocation
+    size_t unpackedSize = 0;
+    for (auto& vb : vbTable)
+    {
+        if (vb.format != VertexFormat_PositionNormalTangentColorTexture
+            && vb.format != VertexFormat_PositionNormalTangentColorTextureSkinning)
+            throw std::runtime_error("Invalid vertex buffer found");
+
+        if (!vb.vertexCount || vb.stride != PackedStride(vb.format, vb.flags))
+            throw std::runtime_error("Invalid vertex buffer found");
+
+        reader.At(vb.dataOffset, vb.stride, vb.vertexCount);
+
+        unpackedSize += (UnpackedStride(vb.format) * vb.vertexCount + 15) & ~size_t(15);
+    }
+
+    data->mOwned.reserve(unpackedSize);
+    data->vertexBuffers.reserve(header.numVertexBuffers);
+    for (auto& vb : vbTable)
+    {
+        VertexBuffer vertexBuffer;
+        vertexBuffer.format = static_cast<VertexFormat>(vb.format);
+        vertexBuffer.stride = static_cast<uint32_t>(UnpackedStride(vb.format));
+        vertexBuffer.vertexCount = vb.vertexCount;
+        vertexBuffer.data = data->AddOwned(nullptr, size_t(vertexBuffer.stride) * vb.vertexCount);
+
+        UnpackVertices(data->GetOwnedData(vertexBuffer.data), meshData + vb.dataOffset, vb);
+
+        data->vertexBuffers.emplace_back(vertexBuffer);
+    }
+
+    // Bones
+    data->bones.reserve(header.numBones);
+    for (auto& b : boneTable)
+    {
+        Bone bone;
+        bone.name = strings.Get(b.name);
+        bone.parentIndex = b.parentIndex;
+        memcpy(&bone.invBindPos, b.invBindPos, sizeof(bone.invBindPos));
+        memcpy(&bone.bindPos, b.bindPos, sizeof(bone.bindPos));
+        memcpy(&bone.localTransform, b.localTransform, sizeof(bone.localTransform));
+        data->bones.emplace_back(std::move(bone));
+    }
+
+    // Animation clips
+    data->clips.reserve(header.numClips);
+    for (auto& c : clipTable)
+    {
+        if (!c.keyCount)
+            throw std::runtime_error("Keyframes missing in clip");
+
+        reader.At(c.keysOffset, sizeof(Keyframe), c.keyCount);
+
+        Clip clip;
+        clip.name = strings.Get(c.name);
+        clip.startTime = c.startTime;
+        clip.endTime = c.endTime;
+        clip.keys.location = BlobLocation_Source;
+        clip.keys.offset = static_cast<size_t>(c.keysOffset);
+        clip.keys.size = sizeof(Keyframe) * c.keyCount;
+        clip.keyCount = c.keyCount;
+        data->clips.emplace_back(std::move(clip));
+    }
+
+    // Meshes, checked against the tables as ParseCMO checks them against the file
+    data->meshes.reserve(header.numMeshes);
+    for (auto& m : meshTable)
+    {
+        Mesh mesh;
+        mesh.name = strings.Get(m.name);
+        mesh.firstMaterial = m.firstMaterial;
+        mesh.materialCount = m.materialCount;
+        mesh.firstSubMesh = m.firstSubMesh;
+        mesh.subMeshCount = m.subMeshCount;
+        mesh.firstVertexBuffer = m.firstVertexBuffer;
+        mesh.vertexBufferCount = m.vertexBufferCount;
+        mesh.firstIndexBuffer = m.firstIndexBuffer;
+        mesh.indexBufferCount = m.indexBufferCount;
+        mesh.firstBone = m.firstBone;
+        mesh.boneCount = m.boneCount;
+        mesh.firstClip = m.firstClip;
+        mesh.clipCount = m.clipCount;
+        mesh.firstLOD = 0;
+        mesh.lodCount = 0;
+        mesh.skinning = (m.flags & MESH_FLAGS_SKINNING) != 0;
+        mesh.center = XMFLOAT3(m.center);
+        mesh.radius = m.radius;
+        mesh.boxMin = XMFLOAT3(m.boxMin);
+        mesh.boxMax = XMFLOAT3(m.boxMax);
+
+        CheckRange(mesh.firstMaterial, mesh.materialCount, data->materials.size());
+        CheckRange(mesh.firstSubMesh, mesh.subMeshCount, data->subMeshes.size());
+        CheckRange(mesh.firstVertexBuffer, mesh.vertexBufferCount, data->vertexBuffers.size());
+        CheckRange(mesh.firstIndexBuffer, mesh.indexBufferCount, data->indexBuffers.size());
+        CheckRange(mesh.firstBone, mesh.boneCount, data->bones.size());
+        CheckRange(mesh.firstClip, mesh.clipCount, data->clips.size());
+
+        if (!mesh.materialCount || !mesh.subMeshCount || !mesh.vertexBufferCount || !mesh.indexBufferCount)
+            throw std::runtime_error("Invalid mesh found");
+
+        for (uint32_t j = 0; j < mesh.subMeshCount; ++j)
+        {
+            auto& sm = data->subMeshes[mesh.firstSubMesh + j];
+
+            if ((sm.indexBufferIndex >= mesh.indexBufferCount)
+                || (sm.vertexBufferIndex >= mesh.vertexBufferCount)
+                || (sm.materialIndex >= mesh.materialCount))
+                throw std::runtime_error("Invalid submesh found");
+
+            if (uint64_t(sm.startIndex) + sm.indexCount > data->indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex].indexCount)
+                throw std::runtime_error("Invalid submesh found");
+        }
+
+        for (uint32_t j = 0; j < mesh.vertexBufferCount; ++j)
+        {
+            bool skinned = data->vertexBuffers[mesh.firstVertexBuffer + j].format == VertexFormat_PositionNormalTangentColorTextureSkinning;
+            if (skinned != mesh.skinning)
+                throw std::runtime_error("Invalid vertex buffer found");
+        }
+
+        for (uint32_t j = 0; j < mesh.boneCount; ++j)
+        {
+            int32_t parent = data->bones[mesh.firstBone + j].parentIndex;
+            if (parent < -1 || parent >= static_cast<int32_t>(mesh.boneCount))
+                throw std::runtime_error("Invalid bone parent found");
+        }
+
+        data->meshes.emplace_back(std::move(mesh));
+    }
+
+    if ((flags & ParseFlags_BakeUVTransform) && !data->uvTransformBaked)
+        data->BakeUVTransforms();
+
+    if (flags & ParseFlags_OptimizeMeshes)
+        data->Optimize();
+
+    if (flags & ParseFlags_GenerateLODs)
+        data->GenerateLODs();
+
+    return data;
+}
+
+
+//======================================================================================
+// Packed model writer
+//======================================================================================
+
+void ModelData::WritePacked(std::vector<uint8_t>& fileData) const
+{
+    if (meshes.empty())
+        throw std::runtime_error("No meshes found");
+
+    if (meshes.size() > UINT32_MAX || materials.size() > UINT32_MAX || subMeshes.size() > UINT32_MAX
+        || vertexBuffers.size() > UINT32_MAX || indexBuffers.size() > UINT32_MAX
+        || bones.size() > UINT32_MAX || clips.size() > UINT32_MAX)
+        throw std::length_error("Too many model elements");
+
+    PackedWriter writer(fileData);
+
+    header_t header = {};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.flags = uvTransformBaked ? HEADER_FLAGS_UV_TRANSFORM_BAKED : 0;
+    header.numMeshes = static_cast<uint32_t>(meshes.size());
+    header.numMaterials = static_cast<uint32_t>(materials.size());
+    header.numSubMeshes = static_cast<uint32_t>(subMeshes.size());
+    header.numVertexBuffers = static_cast<uint32_t>(vertexBuffers.size());
+    header.numIndexBuffers = static_cast<uint32_t>(indexBuffers.size());
+    header.numBones = static_cast<uint32_t>(bones.size());
+    header.numClips = static_cast<uint32_t>(clips.size());
+
+    // Tables, with their data offsets and the string table filled in below
+    std::vector<mesh_t> meshTable(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        auto& src = meshes[i];
+        auto& m = meshTable[i];
+        m.name = writer.AddString(src.name);
+        m.flags = src.skinning ? MESH_FLAGS_SKINNING : 0;
+        m.firstMaterial = src.firstMaterial;
+        m.materialCount = src.materialCount;
+        m.firstSubMesh = src.firstSubMesh;
+        m.subMeshCount = src.subMeshCount;
+        m.firstVertexBuffer = src.firstVertexBuffer;
+        m.vertexBufferCount = src.vertexBufferCount;
+        m.firstIndexBuffer = src.firstIndexBuffer;
+        m.indexBufferCount = src.indexBufferCount;
+        m.firstBone = src.firstBone;
+        m.boneCount = src.boneCount;
+        m.firstClip = src.firstClip;
+        m.clipCount = src.clipCount;
+        memcpy(m.center, &src.center, sizeof(m.center));
+        m.radius = src.radius;
+        memcpy(m.boxMin, &src.boxMin, sizeof(m.boxMin));
+        memcpy(m.boxMax, &src.boxMax, sizeof(m.boxMax));
+    }
+
+    std::vector<material_t> materialTable(materials.size());
+    for (size_t i = 0; i < materials.size(); ++i)
+    {
+        auto& src = materials[i];
+        auto& m = materialTable[i];
+        m.name = writer.AddString(src.name);
+        m.pixelShader = writer.AddString(src.pixelShader);
+        for (uint32_t t = 0; t < MAX_TEXTURE; ++t)
+            m.texture[t] = writer.AddString(src.texture[t]);
+        memcpy(m.ambient, &src.ambient, sizeof(m.ambient));
+        memcpy(m.diffuse, &src.diffuse, sizeof(m.diffuse));
+        memcpy(m.specular, &src.specular, sizeof(m.specular));
+        memcpy(m.emissive, &src.emissive, sizeof(m.emissive));
+        m.specularPower = src.specularPower;
+        memcpy(m.uvTransform, &src.uvTransform, sizeof(m.uvTransform));
+    }
+
+    std::vector<subMesh_t> subMeshTable(subMeshes.size());
+    for (size_t i = 0; i < subMeshes.size(); ++i)
+    {
+        auto& src = subMeshes[i];
+        auto& sm = subMeshTable[i];
+        sm.materialIndex = src.materialIndex;
+        sm.indexBufferIndex = src.indexBufferIndex;
+        sm.vertexBufferIndex = src.vertexBufferIndex;
+        sm.startIndex = src.startIndex;
+        sm.indexCount = src.indexCount;
+    }
+
+    std::vector<vertexBuffer_t> vbTable(vertexBuffers.size());
+    for (size_t i = 0; i < vertexBuffers.size(); ++i)
+    {
+        auto& src = vertexBuffers[i];
+        auto& vb = vbTable[i];
+
+        if (src.stride != UnpackedStride(src.format) || !src.vertexCount
+            || src.data.size < size_t(src.stride) * src.vertexCount)
+            throw std::runtime_error("Invalid vertex buffer found");
+
+        const uint8_t* verts = GetData(src.data);
+
+        // Quantization box and texture coordinate range
+        XMFLOAT3 pmin, pmax;
+        memcpy(&pmin, verts, sizeof(pmin));
+        pmax = pmin;
+
+        float maxTexCoord = 0.f;
+        for (uint32_t v = 0; v < src.vertexCount; ++v)
+        {
+            Vertex in;
+            memcpy(&in, verts + size_t(v) * src.stride, sizeof(in));
+
+            pmin.x = std::min(pmin.x, in.position.x);
+            pmin.y = std::min(pmin.y, in.position.y);
+            pmin.z = std::min(pmin.z, in.position.z);
+            pmax.x = std::max(pmax.x, in.position.x);
+            pmax.y = std::max(pmax.y, in.position.y);
+            pmax.z = std::max(pmax.z, in.position.z);
+
+            maxTexCoord = std::max(maxTexCoord, std::max(fabsf(in.textureCoordinate.x), fabsf(in.textureCoordinate.y)));
+        }
+
+        vb.format = src.format;
+        vb.flags = (maxTexCoord < c_MaxHalfTexCoord) ? 0 : VERTEX_FLAGS_FLOAT_TEXCOORD;
+        vb.vertexCount = src.vertexCount;
+        vb.stride = static_cast<uint32_t>(PackedStride(src.format, vb.flags));
+        vb.dataOffset = 0;
+        vb.positionMin[0] = pmin.x;
+        vb.positionMin[1] = pmin.y;
+        vb.positionMin[2] = pmin.z;
+        vb.positionScale[0] = (pmax.x - pmin.x) / 65535.f;
+        vb.positionScale[1] = (pmax.y - pmin.y) / 65535.f;
+        vb.positionScale[2] = (pmax.z - pmin.z) / 65535.f;
+    }
+
+    // Index buffers are narrowed to 16 bits when every index fits
+    std::vector<indexBuffer_t> ibTable(indexBuffers.size());
+    for (size_t i = 0; i < indexBuffers.size(); ++i)
+    {
+        auto& src = indexBuffers[i];
+        auto& ib = ibTable[i];
+
+        if ((src.indexSize != sizeof(uint16_t) && src.indexSize != sizeof(uint32_t))
+            || src.data.size < size_t(src.indexSize) * src.indexCount)
+            throw std::runtime_error("Invalid index buffer found");
+
+        ib.indexSize = src.indexSize;
+        ib.indexCount = src.indexCount;
+        ib.dataOffset = 0;
+
+        if (src.indexSize == sizeof(uint32_t))
+        {
+            const uint8_t* indices = GetData(src.data);
+
+            uint32_t maxIndex = 0;
+            for (uint32_t j = 0; j < src.indexCount; ++j)
+            {
+                uint32_t index;
+                memcpy(&index, indices + j * sizeof(uint32_t), sizeof(uint32_t));
+                maxIndex = std::max(maxIndex, index);
+            }
+
+            if (maxIndex <= UINT16_MAX)
+                ib.indexSize = sizeof(uint16_t);
+        }
+    }
+
+    std::vector<bone_t> boneTable(bones.size());
+    for (size_t i = 0; i < bones.size(); ++i)
+    {
+        auto& src = bones[i];
+        auto& b = boneTable[i];
+        b.name = writer.AddString(src.name);
+        b.parentIndex = src.parentIndex;
+        memcpy(b.invBindPos, &src.invBindPos, sizeof(b.invBindPos));
+        memcpy(b.bindPos, &src.bindPos, sizeof(b.bindPos));
+        memcpy(b.localTransform, &src.localTransform, sizeof(b.localTransform));
+    }
+
+    std::vector<clip_t> clipTable(clips.size());
+    for (size_t i = 0; i < clips.size(); ++i)
+    {
+        auto& src = clips[i];
+        auto& c = clipTable[i];
+
+        if (src.keys.size < sizeof(Keyframe) * size_t(src.keyCount))
+            throw std::runtime_error("Invalid clip found");
+
+        c.name = writer.AddString(src.name);
+        c.startTime = src.startTime;
+        c.endTime = src.endTime;
+        c.keyCount = src.keyCount;
+        c.keysOffset = 0;
+    }
+
+    header.stringTableLength = static_cast<uint32_t>(writer.GetStrings().size());
+
+    // Lay out the header and tables; their offsets are fixed from here on
+    writer.Append(&header, sizeof(header));
+    writer.Append(meshTable.data(), sizeof(mesh_t) * meshTable.size());
+    writer.Append(materialTable.data(), sizeof(material_t) * materialTable.size());
+    writer.Append(subMeshTable.data(), sizeof(subMesh_t) * subMeshTable.size());
+    uint64_t vbOffset = writer.Append(vbTable.data(), sizeof(vertexBuffer_t) * vbTable.size());
+    uint64_t ibOffset = writer.Append(ibTable.data(), sizeof(indexBuffer_t) * ibTable.size());
+    writer.Append(boneTable.data(), sizeof(bone_t) * boneTable.size());
+    uint64_t clipOffset = writer.Append(clipTable.data(), sizeof(clip_t) * clipTable.size());
+    writer.Append(writer.GetStrings().data(), sizeof(uint16_t) * writer.GetStrings().size());
+
+    // Data blocks
+    for (size_t i = 0; i < vertexBuffers.size(); ++i)
+    {
+        auto& vb = vbTable[i];
+        uint8_t* dest = writer.Reserve(size_t(vb.stride) * vb.vertexCount, &vb.dataOffset);
+        PackVertices(dest, GetData(vertexBuffers[i].data), vertexBuffers[i].stride, vb);
+    }
+
+    for (size_t i = 0; i < indexBuffers.size(); ++i)
+    {
+        auto& src = indexBuffers[i];
+        auto& ib = ibTable[i];
+
+        const uint8_t* indices = GetData(src.data);
+        uint8_t* dest = writer.Reserve(size_t(ib.indexSize) * ib.indexCount, &ib.dataOffset);
+
+        if (ib.indexSize == src.indexSize)
+        {
+            memcpy(dest, indices, size_t(ib.indexSize) * ib.indexCount);
+        }
+        else
+        {
+            for (uint32_t j = 0; j < ib.indexCount; ++j)
+            {
+                uint32_t index;
+                memcpy(&index, indices + j * sizeof(uint32_t), sizeof(uint32_t));
+                uint16_t index16 = static_cast<uint16_t>(index);
+                memcpy(dest + j * sizeof(uint16_t), &index16, sizeof(uint16_t));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < clips.size(); ++i)
+    {
+        clipTable[i].keysOffset = writer.Append(GetData(clips[i].keys), sizeof(Keyframe) * clips[i].keyCount);
+    }
+
+    // Patch the data offsets into the tables
+    writer.Patch(vbOffset, vbTable.data(), sizeof(vertexBuffer_t) * vbTable.size());
+    writer.Patch(ibOffset, ibTable.data(), sizeof(indexBuffer_t) * ibTable.size());
+    writer.Patch(clipOffset, clipTable.data(), sizeof(clip_t) * clipTable.size());
+}
@@ -0,0 +1,463 @@
+//--------------------------------------------------------------------------------------
+// File: ModelHierarchy.cpp
+//
+// Built without the precompiled header so it does not depend on Direct3D.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "ModelHierarchy.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+// SDKMesh.h uses a few Windows and DXGI definitions; nothing here needs a device.
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <dxgiformat.h>
+
+#include "SDKMesh.h"
+
+using namespace DirectX;
+
+
+namespace
+{
+    // Throws unless count elements of elementSize bytes at offset lie within the data.
+    void CheckRange(uint64_t offset, uint64_t count, size_t elementSize, size_t dataSize)
+    {
+        if (offset > dataSize || count > (dataSize - offset) / elementSize)
+            throw std::runtime_error("End of file");
+    }
+
+    // SDKMESH names are fixed-size ANSI fields that may not be terminated.
+    template<size_t N>
+    std::wstring FrameName(const char (&name)[N])
+    {
+        std::wstring result;
+        for (size_t j = 0; j < N && name[j]; ++j)
+        {
+            result += static_cast<wchar_t>(static_cast<unsigned char>(name[j]));
+        }
+        return result;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// ModelHierarchy
+//--------------------------------------------------------------------------------------
+
+ModelHierarchy::ModelHierarchy() :
+    mKeyCount(0),
+    mKeysPerSecond(0.f)
+{
+}
+
+
+ModelHierarchy::~ModelHierarchy()
+{
+}
+
+
+std::unique_ptr<ModelHierarchy> ModelHierarchy::CreateFromSDKMESH(const uint8_t* meshData, size_t dataSize)
+{
+    if (!meshData)
+        throw std::invalid_argument("meshData cannot be null");
+
+    // File Headers
+    if (dataSize < sizeof(DXUT::SDKMESH_HEADER))
+        throw std::runtime_error("End of file");
+
+    DXUT::SDKMESH_HEADER header;
+    memcpy(&header, meshData, sizeof(header));
+
+    if (header.HeaderSize != sizeof(DXUT::SDKMESH_HEADER))
+        throw std::runtime_error("Not a valid SDKMESH file");
+
+    if (header.Version != DXUT::SDKMESH_FILE_VERSION)
+        throw std::runtime_error("Not a supported SDKMESH version");
+
+    if (header.IsBigEndian)
+        throw std::runtime_error("Loading BigEndian SDKMESH files not supported");
+
+    CheckRange(header.FrameDataOffset, header.NumFrames, sizeof(DXUT::SDKMESH_FRAME), dataSize);
+    CheckRange(header.MeshDataOffset, header.NumMeshes, sizeof(DXUT::SDKMESH_MESH), dataSize);
+
+    std::unique_ptr<ModelHierarchy> hierarchy(new ModelHierarchy());
+
+    // Frames
+    const size_t nFrames = header.NumFrames;
+    hierarchy->mFrameNames.reserve(nFrames);
+    hierarchy->mParents.reserve(nFrames);
+    hierarchy->mFrameMeshes.reserve(nFrames);
+    hierarchy->mBindLocal.reserve(nFrames);
+
+    std::vector<std::vector<uint32_t>> children(nFrames);
+    std::vector<uint32_t> roots;
+    for (size_t j = 0; j < nFrames; ++j)
+    {
+        DXUT::SDKMESH_FRAME frame;
+        memcpy(&frame, meshData + header.FrameDataOffset + j * sizeof(frame), sizeof(frame));
+
+        if (frame.ParentFrame != DXUT::INVALID_FRAME && frame.ParentFrame >= nFrames)
+            throw std::runtime_error("Invalid frame parent");
+
+        if (frame.Mesh != DXUT::INVALID_MESH && frame.Mesh >= header.NumMeshes)
+            throw std::runtime_error("Invalid frame mesh");
+
+        hierarchy->mFrameNames.emplace_back(FrameName(frame.Name));
+        hierarchy->mParents.push_back((frame.ParentFrame == DXUT::INVALID_FRAME) ? -1 : static_cast<int32_t>(frame.ParentFrame));
+        hierarchy->mFrameMeshes.push_back((frame.Mesh == DXUT::INVALID_MESH) ? -1 : static_cast<int32_t>(frame.Mesh));
+        hierarchy->mBindLocal.push_back(frame.Matrix);
+
+        if (frame.ParentFrame == DXUT::INVALID_FRAME)
+            roots.push_back(static_cast<uint32_t>(j));
+        else
+            children[frame.ParentFrame].push_back(static_cast<uint32_t>(j));
+    }
+
+    // Parents before children, so a single pass can compose the hierarchy. Frames that
+    // are never reached are part of a cycle.
+    hierarchy->mOrder.reserve(nFrames);
+    hierarchy->mOrder.insert(hierarchy->mOrder.end(), roots.begin(), roots.end());
+    for (size_t j = 0; j < hierarchy->mOrder.size(); ++j)
+    {
+        auto& next = children[hierarchy->mOrder[j]];
+        hierarchy->mOrder.insert(hierarchy->mOrder.end(), next.begin(), next.end());
+    }
+
+    if (hierarchy->mOrder.size() != nFrames)
+        throw std::runtime_error("Invalid frame hierarchy");
+
+    // Bind pose, which the palettes are relative to.
+    std::vector<XMMATRIX> bindWorld(nFrames);
+    for (auto frame : hierarchy->mOrder)
+    {
+        XMMATRIX local = XMLoadFloat4x4(&hierarchy->mBindLocal[frame]);
+
+        int32_t parent = hierarchy->mParents[frame];
+        bindWorld[frame] = (parent < 0) ? local : XMMatrixMultiply(local, bindWorld[parent]);
+    }
+
+    hierarchy->mInvBindWorld.resize(nFrames);
+    for (size_t j = 0; j < nFrames; ++j)
+    {
+        XMVECTOR det;
+        XMMATRIX inv = XMMatrixInverse(&det, bindWorld[j]);
+        if (XMVectorGetX(det) == 0.f)
+            inv = XMMatrixIdentity();
+
+        XMStoreFloat4x4(&hierarchy->mInvBindWorld[j], inv);
+    }
+
+    // Mesh frame influences
+    hierarchy->mMeshInfluences.reserve(header.NumMeshes);
+    for (size_t j = 0; j < header.NumMeshes; ++j)
+    {
+        DXUT::SDKMESH_MESH mesh;
+        memcpy(&mesh, meshData + header.MeshDataOffset + j * sizeof(mesh), sizeof(mesh));
+
+        Range range;
+        range.first = static_cast<uint32_t>(hierarchy->mInfluences.size());
+        range.count = mesh.NumFrameInfluences;
+        hierarchy->mMeshInfluences.push_back(range);
+
+        if (!mesh.NumFrameInfluences)
+            continue;
+
+        CheckRange(mesh.FrameInfluenceOffset, mesh.NumFrameInfluences, sizeof(uint32_t), dataSize);
+
+        size_t first = hierarchy->mInfluences.size();
+        hierarchy->mInfluences.resize(first + mesh.NumFrameInfluences);
+        memcpy(&hierarchy->mInfluences[first], meshData + mesh.FrameInfluenceOffset, sizeof(uint32_t) * mesh.NumFrameInfluences);
+
+        for (size_t k = first; k < hierarchy->mInfluences.size(); ++k)
+        {
+            if (hierarchy->mInfluences[k] >= nFrames)
+                throw std::runtime_error("Invalid mesh frame influence");
+        }
+    }
+
+    hierarchy->mStaticFrames.resize(nFrames);
+    for (size_t j = 0; j < nFrames; ++j)
+    {
+        hierarchy->mStaticFrames[j] = static_cast<uint32_t>(j);
+    }
+
+    return hierarchy;
+}
+
+
+void ModelHierarchy::LoadAnimation(const uint8_t* animData, size_t dataSize)
+{
+    if (!animData)
+        throw std::invalid_argument("animData cannot be null");
+
+    if (dataSize < sizeof(DXUT::SDKANIMATION_FILE_HEADER))
+        throw std::runtime_error("End of file");
+
+    DXUT::SDKANIMATION_FILE_HEADER header;
+    memcpy(&header, animData, sizeof(header));
+
+    if (header.IsBigEndian)
+        throw std::runtime_error("Loading BigEndian SDKMESH_ANIM files not supported");
+
+    if (header.FrameTransformType != DXUT::FTT_RELATIVE)
+        throw std::runtime_error("Only relative SDKMESH_ANIM frame transforms are supported");
+
+    CheckRange(header.AnimationDataOffset, header.NumFrames, sizeof(DXUT::SDKANIMATION_FRAME_DATA), dataSize);
+
+    // Match animation frames to frames by name; the first frame with a name wins, and
+    // the last keys given for it.
+    std::unordered_map<std::wstring, uint32_t> frameByName;
+    frameByName.reserve(mFrameNames.size());
+    for (size_t j = 0; j < mFrameNames.size(); ++j)
+    {
+        frameByName.emplace(mFrameNames[j], static_cast<uint32_t>(j));
+    }
+
+    std::vector<int32_t> source(mFrameNames.size(), -1);
+    std::vector<uint64_t> keyOffsets(header.NumFrames);
+    for (size_t j = 0; j < header.NumFrames; ++j)
+    {
+        DXUT::SDKANIMATION_FRAME_DATA frameData;
+        memcpy(&frameData, animData + header.AnimationDataOffset + j * sizeof(frameData), sizeof(frameData));
+
+        // Key offsets are relative to the end of the file header.
+        if (frameData.DataOffset > dataSize - sizeof(header))
+            throw std::runtime_error("End of file");
+
+        keyOffsets[j] = frameData.DataOffset + sizeof(header);
+        CheckRange(keyOffsets[j], header.NumAnimationKeys, sizeof(DXUT::SDKANIMATION_DATA), dataSize);
+
+        auto it = frameByName.find(FrameName(frameData.FrameName));
+        if (it != frameByName.end())
+            source[it->second] = static_cast<int32_t>(j);
+    }
+
+    mAnimatedFrames.clear();
+    mStaticFrames.clear();
+    for (size_t j = 0; j < source.size(); ++j)
+    {
+        if (source[j] >= 0 && header.NumAnimationKeys > 0)
+            mAnimatedFrames.push_back(static_cast<uint32_t>(j));
+        else
+            mStaticFrames.push_back(static_cast<uint32_t>(j));
+    }
+
+    mKeyCount = mAnimatedFrames.empty() ? 0 : header.NumAnimationKeys;
+    mKeysPerSecond = static_cast<float>(header.AnimationFPS);
+
+    // Transpose the keys into tick rows of four-frame groups. Lanes past the last
+    // animated frame hold identity rotations so every lane normalizes cleanly.
+    const size_t nGroups = (mAnimatedFrames.size() + 3) / 4;
+    mKeys.assign(mKeyCount * nGroups, KeyGroup());
+    for (auto& group : mKeys)
+    {
+        memset(&group, 0, sizeof(group));
+        group.rotation[3] = XMFLOAT4(1.f, 1.f, 1.f, 1.f);
+    }
+
+    for (size_t slot = 0; slot < mAnimatedFrames.size(); ++slot)
+    {
+        const uint8_t* keys = animData + keyOffsets[source[mAnimatedFrames[slot]]];
+        const size_t lane = slot & 3;
+
+        XMVECTOR prev = XMQuaternionIdentity();
+        for (size_t k = 0; k < mKeyCount; ++k)
+        {
+            DXUT::SDKANIMATION_DATA key;
+            memcpy(&key, keys + k * sizeof(key), sizeof(key));
+
+            XMVECTOR q = XMLoadFloat4(&key.Orientation);
+            if (XMVector4Equal(q, XMVectorZero()))
+                q = XMQuaternionIdentity();
+            q = XMQuaternionNormalize(q);
+
+            // Keep consecutive keys on the same hemisphere, so blending two of them
+            // never needs a sign test.
+            if (k > 0 && XMVectorGetX(XMVector4Dot(q, prev)) < 0.f)
+                q = XMVectorNegate(q);
+            prev = q;
+
+            XMFLOAT4 rotation;
+            XMStoreFloat4(&rotation, q);
+
+            auto& group = mKeys[k * nGroups + (slot >> 2)];
+            reinterpret_cast<float*>(&group.rotation[0])[lane] = rotation.x;
+            reinterpret_cast<float*>(&group.rotation[1])[lane] = rotation.y;
+            reinterpret_cast<float*>(&group.rotation[2])[lane] = rotation.z;
+            reinterpret_cast<float*>(&group.rotation[3])[lane] = rotation.w;
+            reinterpret_cast<float*>(&group.translation[0])[lane] = key.Translation.x;
+            reinterpret_cast<float*>(&group.translation[1])[lane] = key.Translation.y;
+            reinterpret_cast<float*>(&group.translation[2])[lane] = key.Translation.z;
+        }
+    }
+}
+
+
+int32_t ModelHierarchy::FindFrame(const wchar_t* name) const
+{
+    for (size_t j = 0; j < mFrameNames.size(); ++j)
+    {
+        if (mFrameNames[j] == name)
+            return static_cast<int32_t>(j);
+    }
+    return -1;
+}
+
+
+float ModelHierarchy::GetAnimationDuration() const
+{
+    if (mKeyCount < 3 || !(mKeysPerSecond > 0.f))
+        return 0.f;
+
+    return static_cast<float>(mKeyCount - 2) / mKeysPerSecond;
+}
+
+
+void ModelHierarchy::EvaluateWorld(float time, bool loop, XMMATRIX* frameWorld) const
+{
+    assert(frameWorld != nullptr);
+
+    for (auto frame : mStaticFrames)
+    {
+        frameWorld[frame] = XMLoadFloat4x4(&mBindLocal[frame]);
+    }
+
+    if (mKeyCount > 0)
+    {
+        // Ticks 1 to mKeyCount - 1 are played; see GetAnimationDuration.
+        size_t k0 = std::min<size_t>(1, mKeyCount - 1);
+        float w = 0.f;
+
+        if (mKeyCount > 2 && mKeysPerSecond > 0.f)
+        {
+            float span = static_cast<float>(mKeyCount - 2);
+            float pos = time * mKeysPerSecond;
+            if (loop)
+            {
+                pos = fmodf(pos, span);
+                if (pos < 0.f)
+                    pos += span;
+            }
+            else
+            {
+                pos = std::min(std::max(pos, 0.f), span);
+            }
+
+            float tick = floorf(pos);
+            k0 = 1 + static_cast<size_t>(tick);
+            w = pos - tick;
+            if (k0 >= mKeyCount - 1)
+            {
+                k0 = mKeyCount - 1;
+                w = 0.f;
+            }
+        }
+
+        size_t k1 = std::min<size_t>(k0 + 1, mKeyCount - 1);
+
+        const size_t nGroups = (mAnimatedFrames.size() + 3) / 4;
+        const KeyGroup* row0 = mKeys.data() + k0 * nGroups;
+        const KeyGroup* row1 = mKeys.data() + k1 * nGroups;
+
+        const XMVECTOR one = XMVectorSplatOne();
+        const XMVECTOR zero = XMVectorZero();
+
+        for (size_t g = 0; g < nGroups; ++g)
+        {
+            auto& a = row0[g];
+            auto& b = row1[g];
+
+            // Normalized lerp; at tick spacing it is indistinguishable from slerp.
+            XMVECTOR qx = XMVectorLerp(XMLoadFloat4(&a.rotation[0]), XMLoadFloat4(&b.rotation[0]), w);
+            XMVECTOR qy = XMVectorLerp(XMLoadFloat4(&a.rotation[1]), XMLoadFloat4(&b.rotation[1]), w);
+            XMVECTOR qz = XMVectorLerp(XMLoadFloat4(&a.rotation[2]), XMLoadFloat4(&b.rotation[2]), w);
+            XMVECTOR qw = XMVectorLerp(XMLoadFloat4(&a.rotation[3]), XMLoadFloat4(&b.rotation[3]), w);
+
+            XMVECTOR lengthSq = XMVectorMultiply(qx, qx);
+            lengthSq = XMVectorMultiplyAdd(qy, qy, lengthSq);
+            lengthSq = XMVectorMultiplyAdd(qz, qz, lengthSq);
+            lengthSq = XMVectorMultiplyAdd(qw, qw, lengthSq);
+
+            XMVECTOR scale = XMVectorReciprocalSqrt(lengthSq);
+            qx = XMVectorMultiply(qx, scale);
+            qy = XMVectorMultiply(qy, scale);
+            qz = XMVectorMultiply(qz, scale);
+            qw = XMVectorMultiply(qw, scale);
+
+            // Rotation matrix terms of four quaternions at once.
+            XMVECTOR x2 = XMVectorAdd(qx, qx);
+            XMVECTOR y2 = XMVectorAdd(qy, qy);
+            XMVECTOR z2 = XMVectorAdd(qz, qz);
+
+            XMVECTOR xx = XMVectorMultiply(qx, x2);
+            XMVECTOR yy = XMVectorMultiply(qy, y2);
+            XMVECTOR zz = XMVectorMultiply(qz, z2);
+            XMVECTOR xy = XMVectorMultiply(qx, y2);
+            XMVECTOR xz = XMVectorMultiply(qx, z2);
+            XMVECTOR yz = XMVectorMultiply(qy, z2);
+            XMVECTOR wx = XMVectorMultiply(qw, x2);
+            XMVECTOR wy = XMVectorMultiply(qw, y2);
+            XMVECTOR wz = XMVectorMultiply(qw, z2);
+
+            XMMATRIX r0(XMVectorSubtract(one, XMVectorAdd(yy, zz)), XMVectorAdd(xy, wz), XMVectorSubtract(xz, wy), zero);
+            XMMATRIX r1(XMVectorSubtract(xy, wz), XMVectorSubtract(one, XMVectorAdd(xx, zz)), XMVectorAdd(yz, wx), zero);
+            XMMATRIX r2(XMVectorAdd(xz, wy), XMVectorSubtract(yz, wx), XMVectorSubtract(one, XMVectorAdd(xx, yy)), zero);
+
+            XMMATRIX r3(XMVectorLerp(XMLoadFloat4(&a.translation[0]), XMLoadFloat4(&b.translation[0]), w),
+                        XMVectorLerp(XMLoadFloat4(&a.translation[1]), XMLoadFloat4(&b.translation[1]), w),
+                        XMVectorLerp(XMLoadFloat4(&a.translation[2]), XMLoadFloat4(&b.translation[2]), w),
+                        one);
+
+            // Back to one matrix per lane.
+            r0 = XMMatrixTranspose(r0);
+            r1 = XMMatrixTranspose(r1);
+            r2 = XMMatrixTranspose(r2);
+            r3 = XMMatrixTranspose(r3);
+
+            const size_t lanes = std::min<size_t>(4, mAnimatedFrames.size() - g * 4);
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                frameWorld[mAnimatedFrames[g * 4 + lane]] = XMMATRIX(r0.r[lane], r1.r[lane], r2.r[lane], r3.r[lane]);
+            }
+        }
+    }
+
+    // Locals to world, in place.
+    for (auto frame : mOrder)
+    {
+        int32_t parent = mParents[frame];
+        if (parent >= 0)
+            frameWorld[frame] = XMMatrixMultiply(frameWorld[frame], frameWorld[parent]);
+    }
+}
+
+
+void ModelHierarchy::GetBonePalette(size_t mesh, const XMMATRIX* frameWorld, XMMATRIX* boneTransforms) const
+{
+    if (mesh >= mMeshInfluences.size())
+        throw std::out_of_range("mesh");
+
+    assert(frameWorld != nullptr && boneTransforms != nullptr);
+
+    auto& range = mMeshInfluences[mesh];
+    const uint32_t* influences = mInfluences.data() + range.first;
+    for (size_t j = 0; j < range.count; ++j)
+    {
+        uint32_t frame = influences[j];
+        boneTransforms[j] = XMMatrixMultiply(XMLoadFloat4x4(&mInvBindWorld[frame]), frameWorld[frame]);
+    }
+}
@@ -13,6 +13,8 @@
 
 #include "pch.h"
 #include "Model.h"
+#include "ModelAnimation.h"
+#include "ModelData.h"
 
 #include "DDSTextureLoader.h"
 #include "Effects.h"
@@ -26,170 +28,18 @@ using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
 
-//--------------------------------------------------------------------------------------
-// .CMO files are built by Visual Studio 2012 and an example renderer is provided
-// in the VS Direct3D Starter Kit
-// http://code.msdn.microsoft.com/Visual-Studio-3D-Starter-455a15f1
-//--------------------------------------------------------------------------------------
-
-namespace VSD3DStarter
-{
-    // .CMO files
-
-    // UINT - Mesh count
-    // { [Mesh count]
-    //      UINT - Length of name
-    //      wchar_t[] - Name of mesh (if length > 0)
-    //      UINT - Material count
-    //      { [Material count]
-    //          UINT - Length of material name
-    //          wchar_t[] - Name of material (if length > 0)
-    //          Material structure
-    //          UINT - Length of pixel shader name
-    //          wchar_t[] - Name of pixel shader (if length > 0)
-    //          { [8]
-    //              UINT - Length of texture name
-    //              wchar_t[] - Name of texture (if length > 0)
-    //          }
-    //      }
-    //      BYTE - 1 if there is skeletal animation data present
-    //      UINT - SubMesh count
-    //      { [SubMesh count]
-    //          SubMesh structure
-    //      }
-    //      UINT - IB Count
-    //      { [IB Count]
-    //          UINT - Number of USHORTs in IB
-    //          USHORT[] - Array of indices
-    //      }
-    //      UINT - VB Count
-    //      { [VB Count]
-    //          UINT - Number of verts in VB
-    //          Vertex[] - Array of vertices
-    //      }
-    //      UINT - Skinning VB Count
-    //      { [Skinning VB Count]
-    //          UINT - Number of verts in Skinning VB
-    //          SkinningVertex[] - Array of skinning verts
-    //      }
-    //      MeshExtents structure
-    //      [If skeleton animation data is not present, file ends here]
-    //      UINT - Bone count
-    //      { [Bone count]
-    //          UINT - Length of bone name
-    //          wchar_t[] - Bone name (if length > 0)
-    //          Bone structure
-    //      }
-    //      UINT - Animation clip count
-    //      { [Animation clip count]
-    //          UINT - Length of clip name
-    //          wchar_t[] - Clip name (if length > 0)
-    //          float - Start time
-    //          float - End time
-    //          UINT - Keyframe count
-    //          { [Keyframe count]
-    //              Keyframe structure
-    //          }
-    //      }
-    // }
-
-    #pragma pack(push,1)
-
-    struct Material
-    {
-        DirectX::XMFLOAT4   Ambient;
-        DirectX::XMFLOAT4   Diffuse;
-        DirectX::XMFLOAT4   Specular;
-        float               SpecularPower;
-        DirectX::XMFLOAT4   Emissive;
-        DirectX::XMFLOAT4X4 UVTransform;
-    };
-
-    const uint32_t MAX_TEXTURE = 8;
-
-    struct SubMesh
-    {
-        UINT MaterialIndex;
-        UINT IndexBufferIndex;
-        UINT VertexBufferIndex;
-        UINT StartIndex;
-        UINT PrimCount;
-    };
-
-    const uint32_t NUM_BONE_INFLUENCES = 4;
-
-    static_assert( sizeof(VertexPositionNormalTangentColorTexture) == 52, "mismatch with CMO vertex type" );
-
-    struct SkinningVertex
-    {
-        UINT boneIndex[NUM_BONE_INFLUENCES];
-        float boneWeight[NUM_BONE_INFLUENCES];
-    };
-
-    struct MeshExtents
-    {
-        float CenterX, CenterY, CenterZ;
-        float Radius;
-
-        float MinX, MinY, MinZ;
-        float MaxX, MaxY, MaxZ;
-    };
-
-    struct Bone
-    {
-        INT ParentIndex;
-        DirectX::XMFLOAT4X4 InvBindPos;
-        DirectX::XMFLOAT4X4 BindPos;
-        DirectX::XMFLOAT4X4 LocalTransform;
-    };
-    
-    struct Clip
-    {
-        float StartTime;
-        float EndTime;
-        UINT  keys;
-    };
+// The file format is parsed by ModelData::ParseCMO (ModelDataCMO.cpp); this file
+// creates the device resources for the result.
 
-    struct Keyframe
-    {
-        UINT BoneIndex;
-        float Time;
-        DirectX::XMFLOAT4X4 Transform;
-    };
-
-    #pragma pack(pop)
-
-    const Material s_defMaterial =
-    {
-        { 0.2f, 0.2f, 0.2f, 1.f },
-        { 0.8f, 0.8f, 0.8f, 1.f },
-        { 0.0f, 0.0f, 0.0f, 1.f },
-        1.f,
-        { 0.0f, 0.0f, 0.0f, 1.0f },
-        { 1.f, 0.f, 0.f, 0.f,
-          0.f, 1.f, 0.f, 0.f,
-          0.f, 0.f, 1.f, 0.f,
-          0.f, 0.f, 0.f, 1.f },
-    };
-}; // namespace
-
-static_assert( sizeof(VSD3DStarter::Material) == 132, "CMO Mesh structure size incorrect" );
-static_assert( sizeof(VSD3DStarter::SubMesh) == 20, "CMO Mesh structure size incorrect" );
-static_assert( sizeof(VSD3DStarter::SkinningVertex)== 32, "CMO Mesh structure size incorrect" );
-static_assert( sizeof(VSD3DStarter::MeshExtents)== 40, "CMO Mesh structure size incorrect" );
-static_assert( sizeof(VSD3DStarter::Bone) == 196, "CMO Mesh structure size incorrect" );
-static_assert( sizeof(VSD3DStarter::Clip) == 12, "CMO Mesh structure size incorrect" );
-static_assert( sizeof(VSD3DStarter::Keyframe)== 72, "CMO Mesh structure size incorrect" );
+static_assert( sizeof(VertexPositionNormalTangentColorTexture) == 52, "mismatch with CMO vertex type" );
+static_assert( sizeof(VertexPositionNormalTangentColorTextureSkinning) == 60, "mismatch with CMO skinned vertex type" );
 
 namespace
 {
     //----------------------------------------------------------------------------------
     struct MaterialRecordCMO
     {
-        const VSD3DStarter::Material*   pMaterial;
-        std::wstring                    name;
-        std::wstring                    pixelShader;
-        std::wstring                    texture[VSD3DStarter::MAX_TEXTURE];
+        const ModelData::Material*      pMaterial;
         std::shared_ptr<IEffect>        effect;
         ComPtr<ID3D11InputLayout>       il;
     };
@@ -252,601 +102,204 @@ namespace
 //======================================================================================
 
 _Use_decl_annotations_
-std::unique_ptr<Model> DirectX::Model::CreateFromCMO( ID3D11Device* d3dDevice, const uint8_t* meshData, size_t dataSize, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
+std::unique_ptr<Model> DirectX::Model::CreateFromModelData( ID3D11Device* d3dDevice, const ModelData& modelData, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
 {
     if ( !InitOnceExecuteOnce( &g_InitOnce, InitializeDecl, nullptr, nullptr ) )
         throw std::exception("One-time initialization failed");
-    
-    if ( !d3dDevice || !meshData )
-        throw std::exception("Device and meshData cannot be null");
-
-    auto fxFactoryDGSL = dynamic_cast<DGSLEffectFactory*>( &fxFactory );
 
-    // Meshes
-    auto nMesh = reinterpret_cast<const UINT*>( meshData );
-    size_t usedSize = sizeof(UINT);
-    if ( dataSize < usedSize )
-        throw std::exception("End of file");
+    if ( !d3dDevice )
+        throw std::exception("Device cannot be null");
 
-    if ( !*nMesh )
+    if ( modelData.meshes.empty() )
         throw std::exception("No meshes found");
 
+    auto fxFactoryDGSL = dynamic_cast<DGSLEffectFactory*>( &fxFactory );
+
     std::unique_ptr<Model> model(new Model());
 
-    for( UINT meshIndex = 0; meshIndex < *nMesh; ++meshIndex )
+    for( size_t meshIndex = 0; meshIndex < modelData.meshes.size(); ++meshIndex )
     {
-        // Mesh name
-        auto nName = reinterpret_cast<const UINT*>( meshData + usedSize );
-        usedSize += sizeof(UINT);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        auto meshName = reinterpret_cast<const wchar_t*>( meshData + usedSize );
-
-        usedSize += sizeof(wchar_t)*(*nName);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
+        auto& md = modelData.meshes[ meshIndex ];
 
         auto mesh = std::make_shared<ModelMesh>();
-        mesh->name.assign( meshName, *nName );
+        mesh->name = md.name;
         mesh->ccw = ccw;
         mesh->pmalpha = pmalpha;
+        mesh->animation = ModelAnimation::CreateFromModelData( modelData, meshIndex );
 
-        // Materials
-        auto nMats = reinterpret_cast<const UINT*>( meshData + usedSize );
-        usedSize += sizeof(UINT);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        std::vector<MaterialRecordCMO> materials;
-        materials.reserve( *nMats );
-        for( UINT j = 0; j < *nMats; ++j )
-        {
-            MaterialRecordCMO m;
-
-            // Material name
-            nName = reinterpret_cast<const UINT*>( meshData + usedSize );
-            usedSize += sizeof(UINT);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            auto matName = reinterpret_cast<const wchar_t*>( meshData + usedSize );
-
-            usedSize += sizeof(wchar_t)*(*nName);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            m.name.assign( matName, *nName );
-
-            // Material settings
-            auto matSetting = reinterpret_cast<const VSD3DStarter::Material*>( meshData + usedSize );
-            usedSize += sizeof(VSD3DStarter::Material);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
+        mesh->boundingSphere.Center = md.center;
+        mesh->boundingSphere.Radius = md.radius;
 
-            m.pMaterial = matSetting;
-
-            // Pixel shader name
-            nName = reinterpret_cast<const UINT*>( meshData + usedSize );
-            usedSize += sizeof(UINT);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            auto psName = reinterpret_cast<const wchar_t*>( meshData + usedSize );
-
-            usedSize += sizeof(wchar_t)*(*nName);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            m.pixelShader.assign( psName, *nName );
-
-            for( UINT t = 0; t < VSD3DStarter::MAX_TEXTURE; ++t )
-            {
-                nName = reinterpret_cast<const UINT*>( meshData + usedSize );
-                usedSize += sizeof(UINT);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                auto txtName = reinterpret_cast<const wchar_t*>( meshData + usedSize );
-
-                usedSize += sizeof(wchar_t)*(*nName);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                m.texture[t].assign( txtName, *nName );
-            }
-
-            materials.emplace_back( m );
-        }
-
-        assert( materials.size() == *nMats );
-
-        if (materials.empty())
-        {
-            // Add default material if none defined
-            MaterialRecordCMO m;
-            m.pMaterial = &VSD3DStarter::s_defMaterial;
-            m.name = L"Default";
-            materials.emplace_back(m);
-        }
-
-        // Skeletal data?
-        auto bSkeleton = reinterpret_cast<const BYTE*>( meshData + usedSize );
-        usedSize += sizeof(BYTE);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        // Submeshes
-        auto nSubmesh = reinterpret_cast<const UINT*>( meshData + usedSize );
-        usedSize += sizeof(UINT);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        if ( !*nSubmesh )
-            throw std::exception("No submeshes found\n");
-
-        auto subMesh = reinterpret_cast<const VSD3DStarter::SubMesh*>( meshData + usedSize );
-        usedSize += sizeof(VSD3DStarter::SubMesh) * (*nSubmesh);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
+        XMVECTOR min = XMLoadFloat3( &md.boxMin );
+        XMVECTOR max = XMLoadFloat3( &md.boxMax );
+        BoundingBox::CreateFromPoints( mesh->boundingBox, min, max );
 
         // Index buffers
-        auto nIBs = reinterpret_cast<const UINT*>( meshData + usedSize );
-        usedSize += sizeof(UINT);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        if ( !*nIBs )
-            throw std::exception("No index buffers found\n");
-
-        struct IBData
-        {
-            size_t          nIndices;
-            const USHORT*   ptr;
-        };
-
-        std::vector<IBData> ibData;
-        ibData.reserve( *nIBs );
-
         std::vector<ComPtr<ID3D11Buffer>> ibs;
-        ibs.resize( *nIBs );
+        ibs.resize( md.indexBufferCount );
 
-        for( UINT j = 0; j < *nIBs; ++j )
+        for( UINT j = 0; j < md.indexBufferCount; ++j )
         {
-            auto nIndexes = reinterpret_cast<const UINT*>( meshData + usedSize );
-            usedSize += sizeof(UINT);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            if ( !*nIndexes )
-                throw std::exception("Empty index buffer found\n");
-
-            size_t ibBytes = sizeof(USHORT) * (*(nIndexes));
-
-            auto indexes = reinterpret_cast<const USHORT*>( meshData + usedSize );
-            usedSize += ibBytes;
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            IBData ib;
-            ib.nIndices = *nIndexes;
-            ib.ptr = indexes;
-            ibData.emplace_back( ib );
+            auto& ib = modelData.indexBuffers[ md.firstIndexBuffer + j ];
 
             D3D11_BUFFER_DESC desc = {};
             desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.ByteWidth = static_cast<UINT>( ibBytes );
+            desc.ByteWidth = static_cast<UINT>( ib.data.size );
             desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 
             D3D11_SUBRESOURCE_DATA initData = {};
-            initData.pSysMem = indexes;
+            initData.pSysMem = modelData.GetData( ib.data );
 
             ThrowIfFailed(
                 d3dDevice->CreateBuffer( &desc, &initData, &ibs[j] )
                 );
 
-            SetDebugObjectName( ibs[j].Get(), "ModelCMO" ); 
+            SetDebugObjectName( ibs[j].Get(), "ModelCMO" );
         }
 
-        assert( ibData.size() == *nIBs );
-        assert( ibs.size() == *nIBs );
-
         // Vertex buffers
-        auto nVBs = reinterpret_cast<const UINT*>( meshData + usedSize );
-        usedSize += sizeof(UINT);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        if ( !*nVBs )
-            throw std::exception("No vertex buffers found\n");
-
-        struct VBData
-        {
-            size_t                                          nVerts;
-            const VertexPositionNormalTangentColorTexture*  ptr;
-            const VSD3DStarter::SkinningVertex*             skinPtr;
-        };
-
-        std::vector<VBData> vbData;
-        vbData.reserve( *nVBs );
-        for( UINT j = 0; j < *nVBs; ++j )
-        {
-            auto nVerts = reinterpret_cast<const UINT*>( meshData + usedSize );
-            usedSize += sizeof(UINT);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            if ( !*nVerts )
-                throw std::exception("Empty vertex buffer found\n");
-
-            size_t vbBytes = sizeof(VertexPositionNormalTangentColorTexture) * (*(nVerts));
-
-            auto verts = reinterpret_cast<const VertexPositionNormalTangentColorTexture*>( meshData + usedSize );
-            usedSize += vbBytes;
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            VBData vb;
-            vb.nVerts = *nVerts;
-            vb.ptr = verts;
-            vb.skinPtr = nullptr;
-            vbData.emplace_back( vb );
-        }
-
-        assert( vbData.size() == *nVBs );
-
-        // Skinning vertex buffers
-        auto nSkinVBs = reinterpret_cast<const UINT*>( meshData + usedSize );
-        usedSize += sizeof(UINT);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        if ( *nSkinVBs )
-        {
-            if ( *nSkinVBs != *nVBs )
-                throw std::exception("Number of VBs not equal to number of skin VBs");
-
-            for( UINT j = 0; j < *nSkinVBs; ++j )
-            {
-                auto nVerts = reinterpret_cast<const UINT*>( meshData + usedSize );
-                usedSize += sizeof(UINT);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                if ( !*nVerts )
-                    throw std::exception("Empty skinning vertex buffer found\n");
-
-                if ( vbData[ j ].nVerts != *nVerts )
-                    throw std::exception("Mismatched number of verts for skin VBs");
-    
-                size_t vbBytes = sizeof(VSD3DStarter::SkinningVertex) * (*(nVerts));
-
-                auto verts = reinterpret_cast<const VSD3DStarter::SkinningVertex*>( meshData + usedSize );
-                usedSize += vbBytes;
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                vbData[j].skinPtr = verts;
-            }
-        }
-
-        // Extents
-        auto extents = reinterpret_cast<const VSD3DStarter::MeshExtents*>( meshData + usedSize );
-        usedSize += sizeof(VSD3DStarter::MeshExtents);
-        if ( dataSize < usedSize )
-            throw std::exception("End of file");
-
-        mesh->boundingSphere.Center.x = extents->CenterX;
-        mesh->boundingSphere.Center.y = extents->CenterY;
-        mesh->boundingSphere.Center.z = extents->CenterZ;
-        mesh->boundingSphere.Radius = extents->Radius;
-
-        XMVECTOR min = XMVectorSet( extents->MinX, extents->MinY, extents->MinZ, 0.f );
-        XMVECTOR max = XMVectorSet( extents->MaxX, extents->MaxY, extents->MaxZ, 0.f );
-        BoundingBox::CreateFromPoints( mesh->boundingBox, min, max );
-
-#if 0
-        // Animation data
-        if ( *bSkeleton )
-        {
-            // Bones
-            auto nBones = reinterpret_cast<const UINT*>( meshData + usedSize );
-            usedSize += sizeof(UINT);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            if ( !*nBones )
-                throw std::exception("Animation bone data is missing\n");
-
-            for( UINT j = 0; j < *nBones; ++j )
-            {
-                // Bone name
-                nName = reinterpret_cast<const UINT*>( meshData + usedSize );
-                usedSize += sizeof(UINT);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                auto boneName = reinterpret_cast<const wchar_t*>( meshData + usedSize );
-
-                usedSize += sizeof(wchar_t)*(*nName);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-                
-                // TODO - What to do with bone name?
-                boneName;
-
-                // Bone settings
-                auto bones = reinterpret_cast<const VSD3DStarter::Bone*>( meshData + usedSize );
-                usedSize += sizeof(VSD3DStarter::Bone);
-                if ( dataSize < usedSize )  
-                    throw std::exception("End of file");
-
-                // TODO - What to do with bone data?
-                bones;
-            }
-
-            // Animation Clips
-            auto nClips = reinterpret_cast<const UINT*>( meshData + usedSize );
-            usedSize += sizeof(UINT);
-            if ( dataSize < usedSize )
-                throw std::exception("End of file");
-
-            for( UINT j = 0; j < *nClips; ++j )
-            {
-                // Clip name
-                nName = reinterpret_cast<const UINT*>( meshData + usedSize );
-                usedSize += sizeof(UINT);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                auto clipName = reinterpret_cast<const wchar_t*>( meshData + usedSize );
-
-                usedSize += sizeof(wchar_t)*(*nName);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-                
-                // TODO - What to do with clip name?
-                clipName;
-
-                auto clip = reinterpret_cast<const VSD3DStarter::Clip*>( meshData + usedSize );
-                usedSize += sizeof(VSD3DStarter::Clip);
-                if ( dataSize < usedSize )
-                    throw std::exception("End of file");
-
-                if ( !clip->keys )
-                    throw std::exception("Keyframes missing in clip");
-
-                auto keys = reinterpret_cast<const VSD3DStarter::Keyframe*>( meshData + usedSize );
-                usedSize += sizeof(VSD3DStarter::Keyframe) * clip->keys;
-                if ( dataSize < usedSize )  
-                    throw std::exception("End of file");
-
-                // TODO - What to do with keys and clip->StartTime, clip->EndTime?
-                keys;
-            }
-        }
-#else
-        UNREFERENCED_PARAMETER(bSkeleton);
-#endif
-
-        bool enableSkinning = ( *nSkinVBs ) != 0;
-
-        // Build vertex buffers
         std::vector<ComPtr<ID3D11Buffer>> vbs;
-        vbs.resize( *nVBs );
+        vbs.resize( md.vertexBufferCount );
 
-        const size_t stride = enableSkinning ? sizeof(VertexPositionNormalTangentColorTextureSkinning)
-                                             : sizeof(VertexPositionNormalTangentColorTexture);
-
-        for( UINT j = 0; j < *nVBs; ++j )
+        for( UINT j = 0; j < md.vertexBufferCount; ++j )
         {
-            size_t nVerts = vbData[ j ].nVerts;
-
-            size_t bytes = stride * nVerts;
+            auto& vb = modelData.vertexBuffers[ md.firstVertexBuffer + j ];
 
             D3D11_BUFFER_DESC desc = {};
             desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.ByteWidth = static_cast<UINT>( bytes );
+            desc.ByteWidth = static_cast<UINT>( vb.data.size );
             desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-            
-            if ( fxFactoryDGSL && !enableSkinning )
-            {
-                // Can use CMO vertex data directly
-                D3D11_SUBRESOURCE_DATA initData = {};
-                initData.pSysMem = vbData[j].ptr;
-
-                ThrowIfFailed(
-                    d3dDevice->CreateBuffer( &desc, &initData, &vbs[j] )
-                    );
-            }
-            else
-            {
-                std::unique_ptr<uint8_t[]> temp( new uint8_t[ bytes + ( sizeof(UINT) * nVerts ) ] );
-
-                auto visited = reinterpret_cast<UINT*>( temp.get() + bytes );
-                memset( visited, 0xff, sizeof(UINT) * nVerts );
-
-                assert( vbData[j].ptr != 0 );
-
-                if ( enableSkinning )
-                {
-                    // Combine CMO multi-stream data into a single stream
-                    auto skinptr = vbData[j].skinPtr;
-                    assert( skinptr != 0 );
-
-                    uint8_t* ptr = temp.get();
-
-                    auto sptr = vbData[j].ptr;
-
-                    for( size_t v = 0; v < nVerts; ++v )
-                    {
-                        *reinterpret_cast<VertexPositionNormalTangentColorTexture*>( ptr ) = *sptr;
-                        ++sptr;
-
-                        auto skinv = reinterpret_cast<VertexPositionNormalTangentColorTextureSkinning*>( ptr );
-                        skinv->SetBlendIndices( *reinterpret_cast<const XMUINT4*>( skinptr->boneIndex ) );
-                        skinv->SetBlendWeights( *reinterpret_cast<const XMFLOAT4*>( skinptr->boneWeight ) );
-
-                        ptr += stride;
-                    }
-                }
-                else
-                {
-                    memcpy( temp.get(), vbData[j].ptr, bytes );
-                }
-
-                if ( !fxFactoryDGSL )
-                {
-                    // Need to fix up VB tex coords for UV transform which is not supported by basic effects
-                    for( UINT k = 0; k < *nSubmesh; ++k )
-                    {
-                        auto& sm = subMesh[ k ];
-
-                        if ( sm.VertexBufferIndex != j )
-                            continue;
-
-                        if ( (sm.IndexBufferIndex >= *nIBs)
-                             || (sm.MaterialIndex >= materials.size()) )
-                             throw std::exception("Invalid submesh found\n");
-
-                        XMMATRIX uvTransform = XMLoadFloat4x4( &materials[ sm.MaterialIndex ].pMaterial->UVTransform );
-
-                        auto ib = ibData[ sm.IndexBufferIndex ].ptr;
-
-                        size_t count = ibData[ sm.IndexBufferIndex ].nIndices;
-
-                        for( size_t q = 0; q < count; ++q )
-                        {
-                            size_t v = ib[ q ];
 
-                            if ( v >= nVerts )
-                                throw std::exception("Invalid index found\n");
-
-                            auto verts = reinterpret_cast<VertexPositionNormalTangentColorTexture*>( temp.get() + ( v * stride ) );
-                            if ( visited[v] == UINT(-1) )
-                            {
-                                visited[v] = sm.MaterialIndex;
-
-                                XMVECTOR t = XMLoadFloat2( &verts->textureCoordinate );
-
-                                t = XMVectorSelect( g_XMIdentityR3, t, g_XMSelect1110 );
-
-                                t = XMVector4Transform( t, uvTransform );
-
-                                XMStoreFloat2( &verts->textureCoordinate, t );
-                            }
-                            else if ( visited[v] != sm.MaterialIndex )
-                            {
-#ifdef _DEBUG
-                                XMMATRIX uv2 = XMLoadFloat4x4( &materials[ visited[v] ].pMaterial->UVTransform );
-
-                                if ( XMVector4NotEqual( uvTransform.r[0], uv2.r[0] )
-                                     || XMVector4NotEqual( uvTransform.r[1], uv2.r[1] )
-                                     || XMVector4NotEqual( uvTransform.r[2], uv2.r[2] )
-                                     || XMVector4NotEqual( uvTransform.r[3], uv2.r[3] ) )
-                                {
-                                    DebugTrace( "WARNING: %ls - mismatched UV transforms for the same vertex; texture coordinates may not be correct\n", mesh->name.c_str() );
-                                }
-#endif
-                            }
-                        }
-                    }
-                }
-
-                // Create vertex buffer from temporary buffer
-                D3D11_SUBRESOURCE_DATA initData = {};
-                initData.pSysMem = temp.get();
+            D3D11_SUBRESOURCE_DATA initData = {};
+            initData.pSysMem = modelData.GetData( vb.data );
 
-                ThrowIfFailed(
-                    d3dDevice->CreateBuffer( &desc, &initData, &vbs[j] )
-                    );
-            }
+            ThrowIfFailed(
+                d3dDevice->CreateBuffer( &desc, &initData, &vbs[j] )
+                );
 
-            SetDebugObjectName( vbs[j].Get(), "ModelCMO" ); 
+            SetDebugObjectName( vbs[j].Get(), "ModelCMO" );
         }
 
-        assert( vbs.size() == *nVBs );
-        
         // Create Effects
+        std::vector<MaterialRecordCMO> materials;
+        materials.resize( md.materialCount );
+
         for( size_t j = 0; j < materials.size(); ++j )
         {
             auto& m = materials[ j ];
+            m.pMaterial = &modelData.materials[ md.firstMaterial + j ];
+
+            auto& mat = *m.pMaterial;
 
             if ( fxFactoryDGSL )
             {
                 DGSLEffectFactory::DGSLEffectInfo info;
-                info.name = m.name.c_str();
-                info.specularPower = m.pMaterial->SpecularPower;
+                info.name = mat.name.c_str();
+                info.specularPower = mat.specularPower;
                 info.perVertexColor = true;
-                info.enableSkinning = enableSkinning;
-                info.alpha = m.pMaterial->Diffuse.w;
-                info.ambientColor = XMFLOAT3( m.pMaterial->Ambient.x, m.pMaterial->Ambient.y, m.pMaterial->Ambient.z );
-                info.diffuseColor = XMFLOAT3( m.pMaterial->Diffuse.x, m.pMaterial->Diffuse.y, m.pMaterial->Diffuse.z );
-                info.specularColor = XMFLOAT3( m.pMaterial->Specular.x, m.pMaterial->Specular.y, m.pMaterial->Specular.z );
-                info.emissiveColor = XMFLOAT3( m.pMaterial->Emissive.x, m.pMaterial->Emissive.y, m.pMaterial->Emissive.z );
-                info.diffuseTexture = m.texture[0].empty() ? nullptr : m.texture[0].c_str();
-                info.specularTexture = m.texture[1].empty() ? nullptr : m.texture[1].c_str();
-                info.normalTexture = m.texture[2].empty() ? nullptr : m.texture[2].c_str();
-                info.pixelShader = m.pixelShader.c_str();
-                
+                info.enableSkinning = md.skinning;
+                info.alpha = mat.diffuse.w;
+                info.ambientColor = XMFLOAT3( mat.ambient.x, mat.ambient.y, mat.ambient.z );
+                info.diffuseColor = XMFLOAT3( mat.diffuse.x, mat.diffuse.y, mat.diffuse.z );
+                info.specularColor = XMFLOAT3( mat.specular.x, mat.specular.y, mat.specular.z );
+                info.emissiveColor = XMFLOAT3( mat.emissive.x, mat.emissive.y, mat.emissive.z );
+                info.diffuseTexture = mat.texture[0].empty() ? nullptr : mat.texture[0].c_str();
+                info.specularTexture = mat.texture[1].empty() ? nullptr : mat.texture[1].c_str();
+                info.normalTexture = mat.texture[2].empty() ? nullptr : mat.texture[2].c_str();
+                info.pixelShader = mat.pixelShader.c_str();
+
                 const int offset = DGSLEffectFactory::DGSLEffectInfo::BaseTextureOffset;
                 for( int i = 0; i < (DGSLEffect::MaxTextures - offset); ++i )
                 {
-                    info.textures[i] = m.texture[ i + offset ].empty() ? nullptr : m.texture[ i + offset ].c_str();
+                    info.textures[i] = mat.texture[ i + offset ].empty() ? nullptr : mat.texture[ i + offset ].c_str();
                 }
 
                 m.effect = fxFactoryDGSL->CreateDGSLEffect( info, nullptr );
 
+                // Texture coordinates that already have the transform applied must not get it twice
                 auto dgslEffect = static_cast<DGSLEffect*>( m.effect.get() );
-                dgslEffect->SetUVTransform( XMLoadFloat4x4( &m.pMaterial->UVTransform ) );
+                dgslEffect->SetUVTransform( modelData.uvTransformBaked ? XMMatrixIdentity() : XMLoadFloat4x4( &mat.uvTransform ) );
             }
             else
             {
+#ifdef _DEBUG
+                XMMATRIX uvTransform = XMLoadFloat4x4( &mat.uvTransform );
+                if ( !modelData.uvTransformBaked
+                     && ( XMVector4NotEqual( uvTransform.r[0], g_XMIdentityR0 )
+                          || XMVector4NotEqual( uvTransform.r[1], g_XMIdentityR1 )
+                          || XMVector4NotEqual( uvTransform.r[2], g_XMIdentityR2 )
+                          || XMVector4NotEqual( uvTransform.r[3], g_XMIdentityR3 ) ) )
+                {
+                    DebugTrace( "WARNING: %ls - UV transform not baked into the vertices; texture coordinates may not be correct\n", mesh->name.c_str() );
+                }
+#endif
+
                 EffectFactory::EffectInfo info;
-                info.name = m.name.c_str();
-                info.specularPower = m.pMaterial->SpecularPower;
+                info.name = mat.name.c_str();
+                info.specularPower = mat.specularPower;
                 info.perVertexColor = true;
-                info.enableSkinning = enableSkinning;
-                info.alpha = m.pMaterial->Diffuse.w;
-                info.ambientColor = XMFLOAT3( m.pMaterial->Ambient.x, m.pMaterial->Ambient.y, m.pMaterial->Ambient.z );
-                info.diffuseColor = XMFLOAT3( m.pMaterial->Diffuse.x, m.pMaterial->Diffuse.y, m.pMaterial->Diffuse.z );
-                info.specularColor = XMFLOAT3( m.pMaterial->Specular.x, m.pMaterial->Specular.y, m.pMaterial->Specular.z );
-                info.emissiveColor = XMFLOAT3( m.pMaterial->Emissive.x, m.pMaterial->Emissive.y, m.pMaterial->Emissive.z );
-                info.diffuseTexture = m.texture[0].c_str();
+                info.enableSkinning = md.skinning;
+                info.alpha = mat.diffuse.w;
+                info.ambientColor = XMFLOAT3( mat.ambient.x, mat.ambient.y, mat.ambient.z );
+                info.diffuseColor = XMFLOAT3( mat.diffuse.x, mat.diffuse.y, mat.diffuse.z );
+                info.specularColor = XMFLOAT3( mat.specular.x, mat.specular.y, mat.specular.z );
+                info.emissiveColor = XMFLOAT3( mat.emissive.x, mat.emissive.y, mat.emissive.z );
+                info.diffuseTexture = mat.texture[0].c_str();
 
                 m.effect = fxFactory.CreateEffect( info, nullptr );
             }
 
-            CreateInputLayout( d3dDevice, m.effect.get(), &m.il, enableSkinning );
+            CreateInputLayout( d3dDevice, m.effect.get(), &m.il, md.skinning );
         }
 
-        // Build mesh parts
-        for( UINT j = 0; j < *nSubmesh; ++j )
+        // Build mesh parts, and the same parts drawing each coarser level of detail
+        auto createPart = [&]( const ModelData::SubMesh& sm ) -> ModelMeshPart*
         {
-            auto& sm = subMesh[j];
-
-            if ( (sm.IndexBufferIndex >= *nIBs)
-                 || (sm.VertexBufferIndex >= *nVBs)
-                 || (sm.MaterialIndex >= materials.size()) )
+            if ( (sm.indexBufferIndex >= md.indexBufferCount)
+                 || (sm.vertexBufferIndex >= md.vertexBufferCount)
+                 || (sm.materialIndex >= materials.size()) )
                  throw std::exception("Invalid submesh found\n");
 
-            auto& mat = materials[ sm.MaterialIndex ];
+            auto& mat = materials[ sm.materialIndex ];
+            auto& ib = modelData.indexBuffers[ md.firstIndexBuffer + sm.indexBufferIndex ];
+            auto& vb = modelData.vertexBuffers[ md.firstVertexBuffer + sm.vertexBufferIndex ];
 
             auto part = new ModelMeshPart();
 
-            if ( mat.pMaterial->Diffuse.w < 1 )
+            if ( mat.pMaterial->diffuse.w < 1 )
                 part->isAlpha = true;
 
-            part->indexCount = sm.PrimCount * 3;
-            part->startIndex = sm.StartIndex;
-            part->vertexStride = static_cast<UINT>( stride );
+            part->indexCount = sm.indexCount;
+            part->startIndex = sm.startIndex;
+            part->vertexStride = vb.stride;
+            part->indexFormat = ( ib.indexSize == sizeof(uint32_t) ) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
             part->inputLayout = mat.il;
-            part->indexBuffer = ibs[ sm.IndexBufferIndex ];
-            part->vertexBuffer = vbs[ sm.VertexBufferIndex ];
+            part->indexBuffer = ibs[ sm.indexBufferIndex ];
+            part->vertexBuffer = vbs[ sm.vertexBufferIndex ];
             part->effect = mat.effect;
-            part->vbDecl = enableSkinning ? g_vbdeclSkinning : g_vbdecl;
+            part->vbDecl = md.skinning ? g_vbdeclSkinning : g_vbdecl;
 
-            mesh->meshParts.emplace_back( part );
+            return part;
+        };
+
+        for( UINT j = 0; j < md.subMeshCount; ++j )
+        {
+            mesh->meshParts.emplace_back( createPart( modelData.subMeshes[ md.firstSubMesh + j ] ) );
+        }
+
+        mesh->lodParts.resize( md.lodCount );
+        mesh->lodErrors.resize( md.lodCount );
+
+        for( UINT level = 0; level < md.lodCount; ++level )
+        {
+            auto& lod = modelData.lods[ md.firstLOD + level ];
+
+            for( UINT j = 0; j < md.subMeshCount; ++j )
+            {
+                mesh->lodParts[ level ].emplace_back( createPart( modelData.lodSubMeshes[ lod.firstSubMesh + j ] ) );
+            }
+
+            mesh->lodErrors[ level ] = lod.error;
         }
 
         model->meshes.emplace_back( mesh );
@@ -856,20 +309,36 @@ std::unique_ptr<Model> DirectX::Model::CreateFromCMO( ID3D11Device* d3dDevice, c
 }
 
 
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromCMO( ID3D11Device* d3dDevice, const uint8_t* meshData, size_t dataSize, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
+{
+    if ( !d3dDevice || !meshData )
+        throw std::exception("Device and meshData cannot be null");
+
+    // Basic effects have no UV transform, so it has to be applied to the vertices
+    auto fxFactoryDGSL = dynamic_cast<DGSLEffectFactory*>( &fxFactory );
+
+    auto modelData = ModelData::ParseCMO( meshData, dataSize,
+                                          fxFactoryDGSL ? ModelData::ParseFlags_None : ModelData::ParseFlags_BakeUVTransform );
+
+    return CreateFromModelData( d3dDevice, *modelData, fxFactory, ccw, pmalpha );
+}
+
+
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 std::unique_ptr<Model> DirectX::Model::CreateFromCMO( ID3D11Device* d3dDevice, const wchar_t* szFileName, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
 {
-    size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile( szFileName, data, &dataSize );
+    MappedFile data;
+    HRESULT hr = BinaryReader::MapEntireFile( szFileName, data );
     if ( FAILED(hr) )
     {
         DebugTrace( "CreateFromCMO failed (%08X) loading '%ls'\n", hr, szFileName );
         throw std::exception( "CreateFromCMO" );
     }
 
-    auto model = CreateFromCMO( d3dDevice, data.get(), dataSize, fxFactory, ccw, pmalpha );
+    auto model = CreateFromCMO( d3dDevice, data.GetData(), data.GetSize(), fxFactory, ccw, pmalpha );
 
     model->name = szFileName;
 
@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// File: ModelLoadPacked.cpp
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "Model.h"
+#include "ModelData.h"
+
+#include "Effects.h"
+#include "PlatformHelpers.h"
+#include "BinaryReader.h"
+
+using namespace DirectX;
+
+// The file format is parsed by ModelData::ParsePacked (ModelDataPacked.cpp), which
+// expands the vertices to the CMO vertex types; CreateFromModelData does the rest.
+
+
+//======================================================================================
+// Model Loader
+//======================================================================================
+
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromPacked( ID3D11Device* d3dDevice, const uint8_t* meshData, size_t dataSize, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
+{
+    if ( !d3dDevice || !meshData )
+        throw std::exception("Device and meshData cannot be null");
+
+    // Basic effects have no UV transform, so it has to be applied to the vertices
+    auto fxFactoryDGSL = dynamic_cast<DGSLEffectFactory*>( &fxFactory );
+
+    auto modelData = ModelData::ParsePacked( meshData, dataSize,
+                                             fxFactoryDGSL ? ModelData::ParseFlags_None : ModelData::ParseFlags_BakeUVTransform );
+
+    return CreateFromModelData( d3dDevice, *modelData, fxFactory, ccw, pmalpha );
+}
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+std::unique_ptr<Model> DirectX::Model::CreateFromPacked( ID3D11Device* d3dDevice, const wchar_t* szFileName, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
+{
+    MappedFile data;
+    HRESULT hr = BinaryReader::MapEntireFile( szFileName, data );
+    if ( FAILED(hr) )
+    {
+        DebugTrace( "CreateFromPacked failed (%08X) loading '%ls'\n", hr, szFileName );
+        throw std::exception( "CreateFromPacked" );
+    }
+
+    auto model = CreateFromPacked( d3dDevice, data.GetData(), data.GetSize(), fxFactory, ccw, pmalpha );
+
+    model->name = szFileName;
+
+    return model;
+}
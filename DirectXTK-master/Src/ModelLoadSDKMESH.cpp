@@ -13,6 +13,7 @@
 
 #include "pch.h"
 #include "Model.h"
+#include "ModelHierarchy.h"
 
 #include "Effects.h"
 #include "VertexTypes.h"
@@ -396,7 +397,6 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH( ID3D11Device* d3dDevic
     if ( dataSize < header->FrameDataOffset
          || (dataSize < (header->FrameDataOffset + header->NumFrames * sizeof(DXUT::SDKMESH_FRAME) ) ) )
         throw std::exception("End of file");
-    // TODO - auto frameArray = reinterpret_cast<const DXUT::SDKMESH_FRAME*>( meshData + header->FrameDataOffset );
 
     if ( dataSize < header->MaterialDataOffset
          || (dataSize < (header->MaterialDataOffset + header->NumMaterials * sizeof(DXUT::SDKMESH_MATERIAL) ) ) )
@@ -521,8 +521,6 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH( ID3D11Device* d3dDevic
             if ( dataSize < mh.FrameInfluenceOffset
                  || (dataSize < mh.FrameInfluenceOffset + mh.NumFrameInfluences*sizeof(UINT) ) )
                 throw std::exception("End of file");
-
-            // TODO - auto influences = reinterpret_cast<const UINT*>( meshData + mh.FrameInfluenceOffset );
         }
 
         auto mesh = std::make_shared<ModelMesh>();
@@ -607,6 +605,10 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH( ID3D11Device* d3dDevic
         model->meshes.emplace_back( mesh );
     }
 
+    // Frames and influences; animation is loaded separately with ModelHierarchy::LoadAnimation
+    if ( header->NumFrames > 0 )
+        model->hierarchy = ModelHierarchy::CreateFromSDKMESH( meshData, dataSize );
+
     return model;
 }
 
@@ -615,16 +617,15 @@ std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH( ID3D11Device* d3dDevic
 _Use_decl_annotations_
 std::unique_ptr<Model> DirectX::Model::CreateFromSDKMESH( ID3D11Device* d3dDevice, const wchar_t* szFileName, IEffectFactory& fxFactory, bool ccw, bool pmalpha )
 {
-    size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile( szFileName, data, &dataSize );
+    MappedFile data;
+    HRESULT hr = BinaryReader::MapEntireFile( szFileName, data );
     if ( FAILED(hr) )
     {
         DebugTrace( "CreateFromSDKMESH failed (%08X) loading '%ls'\n", hr, szFileName );
         throw std::exception( "CreateFromSDKMESH" );
     }
 
-    auto model = CreateFromSDKMESH( d3dDevice, data.get(), dataSize, fxFactory, ccw, pmalpha );
+    auto model = CreateFromSDKMESH( d3dDevice, data.GetData(), data.GetSize(), fxFactory, ccw, pmalpha );
 
     model->name = szFileName;
 
@@ -0,0 +1,196 @@
+//--------------------------------------------------------------------------------------
+// File: PackedModel.h
+//
+// The packed model (.PMDL) format holds the same content as a .CMO (meshes, materials,
+// submeshes, bones and animation clips) with quantized vertices. It is written by the
+// PackModel tool and read by Model::CreateFromPacked, which expands the vertices back
+// to VertexPositionNormalTangentColorTexture[Skinning] for the standard effects.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+
+
+namespace PackedModel
+{
+    // Little-endian throughout. The file starts with header_t, followed by the tables
+    // below in this order, each starting on a 4-byte boundary:
+    //
+    //  mesh_t[numMeshes]
+    //  material_t[numMaterials]
+    //  subMesh_t[numSubMeshes]
+    //  vertexBuffer_t[numVertexBuffers]
+    //  indexBuffer_t[numIndexBuffers]
+    //  bone_t[numBones]
+    //  clip_t[numClips]
+    //  uint16_t[stringTableLength]         UTF-16 names, referenced by string_t
+    //
+    // Vertex, index and keyframe data follows, each block 4-byte aligned and located
+    // by its byte offset from the start of the file. Triangles are counter-clockwise.
+
+    const uint32_t MAGIC = 0x4c444d50; // "PMDL"
+    const uint32_t VERSION = 1;
+
+    enum HEADER_FLAGS
+    {
+        // Texture coordinates already have the material UV transforms applied.
+        HEADER_FLAGS_UV_TRANSFORM_BAKED = 0x1,
+    };
+
+    enum MESH_FLAGS
+    {
+        MESH_FLAGS_SKINNING = 0x1,
+    };
+
+    enum VERTEX_FLAGS
+    {
+        // Texture coordinates are stored as two floats rather than two halves, for
+        // meshes with coordinates too far from [0,1] for half precision.
+        VERTEX_FLAGS_FLOAT_TEXCOORD = 0x1,
+    };
+
+    enum TANGENT_W
+    {
+        // Low two bits of vertex_t::tangentW.
+        TANGENT_W_ZERO = 0,
+        TANGENT_W_POSITIVE = 1,
+        TANGENT_W_NEGATIVE = 2,
+    };
+
+    const uint32_t MAX_TEXTURE = 8;
+
+#pragma pack(push,1)
+
+    struct string_t
+    {
+        uint32_t offset;            // in UTF-16 code units from the start of the string table
+        uint32_t length;
+    };
+
+    struct header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t flags;             // HEADER_FLAGS
+        uint32_t numMeshes;
+        uint32_t numMaterials;
+        uint32_t numSubMeshes;
+        uint32_t numVertexBuffers;
+        uint32_t numIndexBuffers;
+        uint32_t numBones;
+        uint32_t numClips;
+        uint32_t stringTableLength;
+    };
+
+    // Index ranges are into the file-wide tables; indices inside a submesh, bone or
+    // keyframe are relative to the owning mesh, as in ModelData.
+    struct mesh_t
+    {
+        string_t name;
+        uint32_t flags;             // MESH_FLAGS
+        uint32_t firstMaterial;
+        uint32_t materialCount;
+        uint32_t firstSubMesh;
+        uint32_t subMeshCount;
+        uint32_t firstVertexBuffer;
+        uint32_t vertexBufferCount;
+        uint32_t firstIndexBuffer;
+        uint32_t indexBufferCount;
+        uint32_t firstBone;
+        uint32_t boneCount;
+        uint32_t firstClip;
+        uint32_t clipCount;
+        float center[3];
+        float radius;
+        float boxMin[3];
+        float boxMax[3];
+    };
+
+    struct material_t
+    {
+        string_t name;
+        string_t pixelShader;
+        string_t texture[MAX_TEXTURE];
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float emissive[4];
+        float specularPower;
+        float uvTransform[16];
+    };
+
+    struct subMesh_t
+    {
+        uint32_t materialIndex;
+        uint32_t indexBufferIndex;
+        uint32_t vertexBufferIndex;
+        uint32_t startIndex;
+        uint32_t indexCount;
+    };
+
+    // Positions decode as positionMin + q * positionScale per component.
+    struct vertexBuffer_t
+    {
+        uint32_t format;            // ModelData::VertexFormat it expands to
+        uint32_t flags;             // VERTEX_FLAGS
+        uint32_t vertexCount;
+        uint32_t stride;            // of the packed vertices
+        uint64_t dataOffset;
+        float positionMin[3];
+        float positionScale[3];
+    };
+
+    struct indexBuffer_t
+    {
+        uint32_t indexSize;         // 2 or 4
+        uint32_t indexCount;
+        uint64_t dataOffset;
+    };
+
+    struct bone_t
+    {
+        string_t name;
+        int32_t parentIndex;
+        float invBindPos[16];
+        float bindPos[16];
+        float localTransform[16];
+    };
+
+    // Keys are ModelData::Keyframe.
+    struct clip_t
+    {
+        string_t name;
+        float startTime;
+        float endTime;
+        uint32_t keyCount;
+        uint64_t keysOffset;
+    };
+
+    // Packed vertex. Normals and tangents are octahedral encoded in [-1,1] as SNORM16.
+    // Texture coordinates are two halves (or two floats with VERTEX_FLAGS_FLOAT_TEXCOORD),
+    // and skinned vertices add the blend indices and weights unchanged.
+    struct vertex_t
+    {
+        uint16_t position[3];       // UNORM16 across the vertex buffer's bounding box
+        uint16_t tangentW;          // TANGENT_W
+        int16_t normal[2];
+        int16_t tangent[2];
+        uint32_t color;             // R8G8B8A8_UNORM
+    };
+
+#pragma pack(pop)
+
+}; // namespace
+
+static_assert(sizeof(PackedModel::header_t) == 44, "PMDL header size mismatch");
+static_assert(sizeof(PackedModel::mesh_t) == 100, "PMDL mesh size mismatch");
+static_assert(sizeof(PackedModel::material_t) == 212, "PMDL material size mismatch");
+static_assert(sizeof(PackedModel::subMesh_t) == 20, "PMDL submesh size mismatch");
+static_assert(sizeof(PackedModel::vertexBuffer_t) == 48, "PMDL vertex buffer size mismatch");
+static_assert(sizeof(PackedModel::indexBuffer_t) == 16, "PMDL index buffer size mismatch");
+static_assert(sizeof(PackedModel::bone_t) == 204, "PMDL bone size mismatch");
+static_assert(sizeof(PackedModel::clip_t) == 28, "PMDL clip size mismatch");
+static_assert(sizeof(PackedModel::vertex_t) == 20, "PMDL vertex size mismatch");
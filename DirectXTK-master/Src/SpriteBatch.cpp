@@ -19,6 +19,12 @@
 #include "VertexTypes.h"
 #include "SharedResourcePool.h"
 #include "AlignedNew.h"
+#include "SpriteBatchVertices.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -58,11 +64,233 @@ namespace
 
         return v;
     }
+
+
+    // Maps a depth to an unsigned integer that orders the same way, flipping every bit of
+    // negative values and just the sign bit of positive ones. Adding zero turns -0 into +0.
+    inline uint32_t SortableDepth(float depth)
+    {
+        depth += 0.0f;
+
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+
+        return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+    }
+
+
+    // Spreads pointer values over a power of two sized hash table.
+    inline size_t HashPointer(_In_ void const* p, size_t mask)
+    {
+        return static_cast<size_t>((static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+
+
+    // Stable LSD radix sort on the upper 32 bits of the keys, one byte per pass. Passes over
+    // a byte that is the same in every key are skipped, so with up to 256 textures the sort
+    // takes a single pass. Returns whichever of the two buffers holds the sorted keys.
+    uint64_t* RadixSortKeys(_Inout_updates_(count) uint64_t* keys, _Out_writes_(count) uint64_t* scratch, size_t count)
+    {
+        uint32_t histograms[4][256] = {};
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t key = keys[i];
+
+            histograms[0][(key >> 32) & 0xFF]++;
+            histograms[1][(key >> 40) & 0xFF]++;
+            histograms[2][(key >> 48) & 0xFF]++;
+            histograms[3][(key >> 56) & 0xFF]++;
+        }
+
+        for (unsigned pass = 0; pass < 4; pass++)
+        {
+            unsigned shift = 32 + pass * 8;
+            uint32_t* histogram = histograms[pass];
+
+            if (histogram[(keys[0] >> shift) & 0xFF] == count)
+                continue;
+
+            // Turn the counts into the first output position of each digit.
+            uint32_t offset = 0;
+
+            for (size_t digit = 0; digit < 256; digit++)
+            {
+                uint32_t digitCount = histogram[digit];
+                histogram[digit] = offset;
+                offset += digitCount;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t key = keys[i];
+                scratch[histogram[(key >> shift) & 0xFF]++] = key;
+            }
+
+            std::swap(keys, scratch);
+        }
+
+        return keys;
+    }
+
+
+    // Threads that help the calling thread generate vertices for large batches. Run hands
+    // out fixed size chunks of work from a shared counter, with the caller taking chunks
+    // too, and only returns once every worker has checked in for that job, so a worker
+    // that wakes up late can never pick up chunks of the next one.
+    class WorkerThreads
+    {
+    public:
+        explicit WorkerThreads(size_t threadCount)
+          : mGeneration(0),
+            mPending(0),
+            mStop(false),
+            mJob(nullptr),
+            mContext(nullptr),
+            mCount(0),
+            mChunkSize(1),
+            mNext(0)
+        {
+            try
+            {
+                mThreads.reserve(threadCount);
+
+                for (size_t i = 0; i < threadCount; i++)
+                {
+                    mThreads.emplace_back(&WorkerThreads::WorkerMain, this);
+                }
+            }
+            catch (...)
+            {
+                Stop();
+                throw;
+            }
+        }
+
+        WorkerThreads(WorkerThreads const&) = delete;
+        WorkerThreads& operator= (WorkerThreads const&) = delete;
+
+        ~WorkerThreads()
+        {
+            Stop();
+        }
+
+        // Calls fn(begin, end) over [0, count) in chunks of chunkSize. fn must not throw.
+        template<typename TFn>
+        void Run(size_t count, size_t chunkSize, TFn& fn)
+        {
+            Job job = [](void* context, size_t begin, size_t end)
+            {
+                (*static_cast<TFn*>(context))(begin, end);
+            };
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+
+                mJob = job;
+                mContext = &fn;
+                mCount = count;
+                mChunkSize = chunkSize;
+                mNext = 0;
+                mPending = mThreads.size();
+                mGeneration++;
+            }
+
+            mWake.notify_all();
+
+            DoChunks(job, &fn, count, chunkSize);
+
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            mDone.wait(lock, [this] { return mPending == 0; });
+        }
+
+    private:
+        typedef void (*Job)(void* context, size_t begin, size_t end);
+
+        void DoChunks(Job job, void* context, size_t count, size_t chunkSize)
+        {
+            for (;;)
+            {
+                size_t begin = mNext.fetch_add(chunkSize);
+
+                if (begin >= count)
+                    break;
+
+                job(context, begin, std::min(count, begin + chunkSize));
+            }
+        }
+
+        void WorkerMain()
+        {
+            uint64_t seen = 0;
+
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            for (;;)
+            {
+                mWake.wait(lock, [&] { return mStop || mGeneration != seen; });
+
+                if (mStop)
+                    return;
+
+                seen = mGeneration;
+
+                Job job = mJob;
+                void* context = mContext;
+                size_t count = mCount;
+                size_t chunkSize = mChunkSize;
+
+                lock.unlock();
+
+                DoChunks(job, context, count, chunkSize);
+
+                lock.lock();
+
+                if (--mPending == 0)
+                {
+                    mDone.notify_one();
+                }
+            }
+        }
+
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStop = true;
+            }
+
+            mWake.notify_all();
+
+            for (auto& thread : mThreads)
+            {
+                if (thread.joinable())
+                    thread.join();
+            }
+        }
+
+        std::mutex mMutex;
+        std::condition_variable mWake;
+        std::condition_variable mDone;
+        std::vector<std::thread> mThreads;
+
+        // Guarded by mMutex.
+        uint64_t mGeneration;
+        size_t mPending;
+        bool mStop;
+        Job mJob;
+        void* mContext;
+        size_t mCount;
+        size_t mChunkSize;
+
+        std::atomic<size_t> mNext;
+    };
 }
 
 
 // Internal SpriteBatch implementation class.
-__declspec(align(16)) class SpriteBatch::Impl : public AlignedNew<SpriteBatch::Impl>
+class __declspec(align(16)) SpriteBatch::Impl : public AlignedNew<SpriteBatch::Impl>
 {
 public:
     Impl(_In_ ID3D11DeviceContext* deviceContext);
@@ -83,30 +311,36 @@ public:
         FXMVECTOR originRotationDepth,
         int flags);
 
-
-    // Info about a single sprite that is waiting to be drawn.
-    __declspec(align(16)) struct SpriteInfo : public AlignedNew<SpriteInfo>
-    {
-        XMFLOAT4A source;
-        XMFLOAT4A destination;
-        XMFLOAT4A color;
-        XMFLOAT4A originRotationDepth;
-        ID3D11ShaderResourceView* texture;
-        int flags;
+    void Draw(SpriteLayer::Impl& layer);
 
 
-        // Combine values from the public SpriteEffects enum with these internal-only flags.
-        static const int SourceInTexels = 4;
-        static const int DestSizeInPixels = 8;
+    // Info about a single sprite that is waiting to be drawn (see SpriteBatchVertices.h).
+    typedef Internal::SpriteInfo SpriteInfo;
 
-        static_assert((SpriteEffects_FlipBoth & (SourceInTexels | DestSizeInPixels)) == 0, "Flag bits must not overlap");
-    };
+    static_assert(SpriteInfo::FlipHorizontally == SpriteEffects_FlipHorizontally &&
+                  SpriteInfo::FlipVertically == SpriteEffects_FlipVertically, "Mirroring flags must match SpriteEffects");
+    static_assert((SpriteEffects_FlipBoth & (SpriteInfo::SourceInTexels | SpriteInfo::DestSizeInPixels)) == 0, "Flag bits must not overlap");
 
     DXGI_MODE_ROTATION mRotation;
 
     bool mSetViewport;
     D3D11_VIEWPORT mViewPort;
 
+
+    // Helpers shared with SpriteLayer.
+    static void XM_CALLCONV StoreSprite(_Out_ SpriteInfo* sprite,
+        _In_ ID3D11ShaderResourceView* texture,
+        FXMVECTOR destination,
+        _In_opt_ RECT const* sourceRectangle,
+        FXMVECTOR color,
+        FXMVECTOR originRotationDepth,
+        int flags);
+
+    static XMVECTOR GetTextureSize(_In_ ID3D11ShaderResourceView* texture);
+
+    static const size_t VerticesPerSprite = Internal::VerticesPerSprite;
+    static const size_t IndicesPerSprite = 6;
+
 private:
     // Implementation helper methods.
     void GrowSpriteQueue();
@@ -114,15 +348,11 @@ private:
     void FlushBatch();
     void SortSprites();
     void GrowSortedSprites();
+    void CreateTextureSortKeys();
+    void CreateDepthSortKeys(bool backToFront);
 
     void RenderBatch(_In_ ID3D11ShaderResourceView* texture, _In_reads_(count) SpriteInfo const* const* sprites, size_t count);
 
-    static void XM_CALLCONV RenderSprite(_In_ SpriteInfo const* sprite,
-        _Out_writes_(VerticesPerSprite) VertexPositionColorTexture* vertices,
-        FXMVECTOR textureSize,
-        FXMVECTOR inverseTextureSize);
-
-    static XMVECTOR GetTextureSize(_In_ ID3D11ShaderResourceView* texture);
     XMMATRIX GetViewportTransform(_In_ ID3D11DeviceContext* deviceContext, DXGI_MODE_ROTATION rotation );
 
 
@@ -130,8 +360,7 @@ private:
     static const size_t MaxBatchSize = 2048;
     static const size_t MinBatchSize = 128;
     static const size_t InitialQueueSize = 64;
-    static const size_t VerticesPerSprite = 4;
-    static const size_t IndicesPerSprite = 6;
+    static const size_t ParallelChunkSize = 256;
 
 
     // Queue of sprites waiting to be drawn.
@@ -148,6 +377,15 @@ private:
     std::vector<SpriteInfo const*> mSortedSprites;
 
 
+    // Sorting works on 64-bit keys that hold the sort value in their upper half and the queue
+    // index in their lower half, so the keys order the sprites by value and sprites with equal
+    // values stay in the order they were drawn. Textures are numbered in order of first use,
+    // through a small open addressed table from texture pointer to number.
+    std::vector<uint64_t> mSortKeys;
+    std::vector<uint64_t> mSortScratch;
+    std::vector<std::pair<ID3D11ShaderResourceView const*, uint32_t>> mTextureIds;
+
+
     // If each SpriteInfo instance held a refcount on its texture, could end up with
     // many redundant AddRef/Release calls on the same object, so instead we use
     // this separate list to hold just a single refcount each time we change texture.
@@ -205,8 +443,14 @@ private:
 
         bool inImmediateMode;
 
+        // Returns null if there are no spare hardware threads to share vertex generation with.
+        WorkerThreads* GetWorkerThreads();
+
     private:
         void CreateVertexBuffer();
+
+        size_t workerThreadCount;
+        std::unique_ptr<WorkerThreads> workerThreads;
     };
 
 
@@ -319,8 +563,18 @@ std::vector<short> SpriteBatch::Impl::DeviceResources::CreateIndexValues()
 SpriteBatch::Impl::ContextResources::ContextResources(_In_ ID3D11DeviceContext* context)
   :constantBuffer(GetDevice(context).Get()),
     vertexBufferPosition(0),
-    inImmediateMode(false)
+    inImmediateMode(false),
+    workerThreadCount(0)
 {
+    // A mapped batch never holds more than MaxBatchSize / ParallelChunkSize chunks, so more
+    // threads than that would have nothing to do.
+    size_t hardwareThreads = std::thread::hardware_concurrency();
+
+    if (hardwareThreads > 1)
+    {
+        workerThreadCount = std::min(hardwareThreads, MaxBatchSize / ParallelChunkSize) - 1;
+    }
+
 #if defined(_XBOX_ONE) && defined(_TITLE)
     ThrowIfFailed(context->QueryInterface(IID_GRAPHICS_PPV_ARGS(deviceContext.GetAddressOf())));
 #else
@@ -369,6 +623,18 @@ void SpriteBatch::Impl::ContextResources::CreateVertexBuffer()
 }
 
 
+// The worker threads are only started the first time a batch is big enough to share.
+WorkerThreads* SpriteBatch::Impl::ContextResources::GetWorkerThreads()
+{
+    if (!workerThreads && workerThreadCount > 0)
+    {
+        workerThreads.reset(new WorkerThreads(workerThreadCount));
+    }
+
+    return workerThreads.get();
+}
+
+
 // Per-SpriteBatch constructor.
 SpriteBatch::Impl::Impl(_In_ ID3D11DeviceContext* deviceContext)
   : mRotation( DXGI_MODE_ROTATION_IDENTITY ),
@@ -473,6 +739,40 @@ void XM_CALLCONV SpriteBatch::Impl::Draw(ID3D11ShaderResourceView* texture,
 
     SpriteInfo* sprite = &mSpriteQueue[mSpriteQueueCount];
 
+    StoreSprite(sprite, texture, destination, sourceRectangle, color, originRotationDepth, flags);
+
+    if (mSortMode == SpriteSortMode_Immediate)
+    {
+        // If we are in immediate mode, draw this sprite straight away.
+        RenderBatch(texture, &sprite, 1);
+    }
+    else
+    {
+        // Queue this sprite for later sorting and batched rendering.
+        mSpriteQueueCount++;
+
+        // Make sure we hold a refcount on this texture until the sprite has been drawn. Only checking the
+        // back of the vector means we will add duplicate references if the caller switches back and forth
+        // between multiple repeated textures, but calling AddRef more times than strictly necessary hurts
+        // nothing, and is faster than scanning the whole list or using a map to detect all duplicates.
+        if (mSpriteTextureReferences.empty() || texture != mSpriteTextureReferences.back().Get())
+        {
+            mSpriteTextureReferences.emplace_back(texture);
+        }
+    }
+}
+
+
+// Fills in the queued form of a sprite.
+_Use_decl_annotations_
+void XM_CALLCONV SpriteBatch::Impl::StoreSprite(SpriteInfo* sprite,
+    ID3D11ShaderResourceView* texture,
+    FXMVECTOR destination,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    FXMVECTOR originRotationDepth,
+    int flags)
+{
     XMVECTOR dest = destination;
 
     if (sourceRectangle)
@@ -505,26 +805,6 @@ void XM_CALLCONV SpriteBatch::Impl::Draw(ID3D11ShaderResourceView* texture,
 
     sprite->texture = texture;
     sprite->flags = flags;
-
-    if (mSortMode == SpriteSortMode_Immediate)
-    {
-        // If we are in immediate mode, draw this sprite straight away.
-        RenderBatch(texture, &sprite, 1);
-    }
-    else
-    {
-        // Queue this sprite for later sorting and batched rendering.
-        mSpriteQueueCount++;
-
-        // Make sure we hold a refcount on this texture until the sprite has been drawn. Only checking the
-        // back of the vector means we will add duplicate references if the caller switches back and forth
-        // between multiple repeated textures, but calling AddRef more times than strictly necessary hurts
-        // nothing, and is faster than scanning the whole list or using a map to detect all duplicates.
-        if (mSpriteTextureReferences.empty() || texture != mSpriteTextureReferences.back().Get())
-        {
-            mSpriteTextureReferences.emplace_back(texture);
-        }
-    }
 }
 
 
@@ -532,7 +812,7 @@ void XM_CALLCONV SpriteBatch::Impl::Draw(ID3D11ShaderResourceView* texture,
 void SpriteBatch::Impl::GrowSpriteQueue()
 {
     // Grow by a factor of 2.
-    size_t newSize = std::max(InitialQueueSize, mSpriteQueueArraySize * 2);
+    size_t newSize = std::max(size_t(InitialQueueSize), mSpriteQueueArraySize * 2);
 
     // Allocate the new array.
     std::unique_ptr<SpriteInfo[]> newArray(new SpriteInfo[newSize]);
@@ -668,40 +948,106 @@ void SpriteBatch::Impl::FlushBatch()
 // Sorts the array of queued sprites.
 void SpriteBatch::Impl::SortSprites()
 {
-    // Fill the mSortedSprites vector.
-    if (mSortedSprites.size() < mSpriteQueueCount)
-    {
-        GrowSortedSprites();
-    }
-
     switch (mSortMode)
     {
         case SpriteSortMode_Texture:
-            // Sort by texture.
-            std::sort(mSortedSprites.begin(), mSortedSprites.begin() + mSpriteQueueCount, [](SpriteInfo const* x, SpriteInfo const* y) -> bool
-            {
-                return x->texture < y->texture;
-            });
+            CreateTextureSortKeys();
             break;
 
         case SpriteSortMode_BackToFront:
-            // Sort back to front.
-            std::sort(mSortedSprites.begin(), mSortedSprites.begin() + mSpriteQueueCount, [](SpriteInfo const* x, SpriteInfo const* y) -> bool
-            {
-                return x->originRotationDepth.w > y->originRotationDepth.w;
-            });
+            CreateDepthSortKeys(true);
             break;
 
         case SpriteSortMode_FrontToBack:
-            // Sort front to back.
-            std::sort(mSortedSprites.begin(), mSortedSprites.begin() + mSpriteQueueCount, [](SpriteInfo const* x, SpriteInfo const* y) -> bool
-            {
-                return x->originRotationDepth.w < y->originRotationDepth.w;
-            });
+            CreateDepthSortKeys(false);
             break;
 
         default:
-            break;
+            // Fill the mSortedSprites vector.
+            if (mSortedSprites.size() < mSpriteQueueCount)
+            {
+                GrowSortedSprites();
+            }
+            return;
+    }
+
+    mSortScratch.resize(mSpriteQueueCount);
+
+    uint64_t const* sortedKeys = RadixSortKeys(mSortKeys.data(), mSortScratch.data(), mSpriteQueueCount);
+
+    mSortedSprites.resize(mSpriteQueueCount);
+
+    for (size_t i = 0; i < mSpriteQueueCount; i++)
+    {
+        mSortedSprites[i] = &mSpriteQueue[static_cast<uint32_t>(sortedKeys[i])];
+    }
+}
+
+
+// Builds sort keys that group the queued sprites by texture, in order of first use.
+void SpriteBatch::Impl::CreateTextureSortKeys()
+{
+    assert(mSpriteQueueCount <= UINT32_MAX);
+
+    // mSpriteTextureReferences gains an entry each time the texture changes, so it has at
+    // least one per distinct texture and a table twice its size never fills up.
+    size_t tableSize = 16;
+
+    while (tableSize < mSpriteTextureReferences.size() * 2)
+    {
+        tableSize *= 2;
+    }
+
+    size_t mask = tableSize - 1;
+
+    mTextureIds.assign(tableSize, std::make_pair(nullptr, 0u));
+    mSortKeys.resize(mSpriteQueueCount);
+
+    ID3D11ShaderResourceView const* lastTexture = nullptr;
+    uint64_t lastId = 0;
+    uint32_t textureCount = 0;
+
+    for (size_t i = 0; i < mSpriteQueueCount; i++)
+    {
+        ID3D11ShaderResourceView const* texture = mSpriteQueue[i].texture;
+
+        if (texture != lastTexture)
+        {
+            size_t slot = HashPointer(texture, mask);
+
+            while (mTextureIds[slot].first && mTextureIds[slot].first != texture)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            if (!mTextureIds[slot].first)
+            {
+                mTextureIds[slot] = std::make_pair(texture, textureCount++);
+            }
+
+            lastTexture = texture;
+            lastId = mTextureIds[slot].second;
+        }
+
+        mSortKeys[i] = (lastId << 32) | i;
+    }
+}
+
+
+// Builds sort keys that order the queued sprites by layer depth.
+void SpriteBatch::Impl::CreateDepthSortKeys(bool backToFront)
+{
+    assert(mSpriteQueueCount <= UINT32_MAX);
+
+    uint32_t flip = backToFront ? 0xFFFFFFFFu : 0;
+
+    mSortKeys.resize(mSpriteQueueCount);
+
+    for (size_t i = 0; i < mSpriteQueueCount; i++)
+    {
+        uint64_t depth = SortableDepth(mSpriteQueue[i].originRotationDepth.w) ^ flip;
+
+        mSortKeys[i] = (depth << 32) | i;
     }
 }
 
@@ -747,7 +1093,7 @@ void SpriteBatch::Impl::RenderBatch(ID3D11ShaderResourceView* texture, SpriteInf
                 // If we are out of room, or about to submit an excessively small batch, wrap back to the start of the vertex buffer.
                 mContextResources->vertexBufferPosition = 0;
 
-                batchSize = std::min(count, MaxBatchSize);
+                batchSize = std::min(count, size_t(MaxBatchSize));
             }
             else
             {
@@ -773,14 +1119,23 @@ void SpriteBatch::Impl::RenderBatch(ID3D11ShaderResourceView* texture, SpriteInf
         auto vertices = static_cast<VertexPositionColorTexture*>(mappedBuffer.pData) + mContextResources->vertexBufferPosition * VerticesPerSprite;
 #endif
 
-        // Generate sprite vertex data.
-        for (size_t i = 0; i < batchSize; i++)
+        // Generate sprite vertex data. Large batches are split into chunks that spare threads
+        // write in parallel, each into its own range of the vertex buffer.
+        auto renderSprites = [&](size_t begin, size_t end)
         {
-            assert(i < count);
-            _Analysis_assume_(i < count);
-            RenderSprite(sprites[i], vertices, textureSize, inverseTextureSize);
+            assert(end <= count);
+            Internal::RenderSprites(sprites + begin, end - begin, vertices + begin * VerticesPerSprite, textureSize, inverseTextureSize);
+        };
+
+        WorkerThreads* workerThreads = (batchSize >= ParallelChunkSize * 2) ? mContextResources->GetWorkerThreads() : nullptr;
 
-            vertices += VerticesPerSprite;
+        if (workerThreads)
+        {
+            workerThreads->Run(batchSize, ParallelChunkSize, renderSprites);
+        }
+        else
+        {
+            renderSprites(0, batchSize);
         }
 
 #if defined(_XBOX_ONE) && defined(_TITLE)
@@ -806,206 +1161,882 @@ void SpriteBatch::Impl::RenderBatch(ID3D11ShaderResourceView* texture, SpriteInf
 }
 
 
-// Generates vertex data for drawing a single sprite.
-_Use_decl_annotations_
-void XM_CALLCONV SpriteBatch::Impl::RenderSprite(SpriteInfo const* sprite,
-    VertexPositionColorTexture* vertices,
-    FXMVECTOR textureSize,
-    FXMVECTOR inverseTextureSize)
+
+// Helper looks up the size of the specified texture.
+XMVECTOR SpriteBatch::Impl::GetTextureSize(_In_ ID3D11ShaderResourceView* texture)
 {
-    // Load sprite parameters into SIMD registers.
-    XMVECTOR source = XMLoadFloat4A(&sprite->source);
-    XMVECTOR destination = XMLoadFloat4A(&sprite->destination);
-    XMVECTOR color = XMLoadFloat4A(&sprite->color);
-    XMVECTOR originRotationDepth = XMLoadFloat4A(&sprite->originRotationDepth);
+    // Convert resource view to underlying resource.
+    ComPtr<ID3D11Resource> resource;
 
-    float rotation = sprite->originRotationDepth.z;
-    int flags = sprite->flags;
+    texture->GetResource(&resource);
+    
+    // Cast to texture.
+    ComPtr<ID3D11Texture2D> texture2D;
+    
+    if (FAILED(resource.As(&texture2D)))
+    {
+        throw std::exception("SpriteBatch can only draw Texture2D resources");
+    }
 
-    // Extract the source and destination sizes into separate vectors.
-    XMVECTOR sourceSize = XMVectorSwizzle<2, 3, 2, 3>(source);
-    XMVECTOR destinationSize = XMVectorSwizzle<2, 3, 2, 3>(destination);
+    // Query the texture size.
+    D3D11_TEXTURE2D_DESC desc;
 
-    // Scale the origin offset by source size, taking care to avoid overflow if the source region is zero.
-    XMVECTOR isZeroMask = XMVectorEqual(sourceSize, XMVectorZero());
-    XMVECTOR nonZeroSourceSize = XMVectorSelect(sourceSize, g_XMEpsilon, isZeroMask);
+    texture2D->GetDesc(&desc);
 
-    XMVECTOR origin = XMVectorDivide(originRotationDepth, nonZeroSourceSize);
+    // Convert to vector format.
+    XMVECTOR size = XMVectorMergeXY(XMLoadInt(&desc.Width),
+                                    XMLoadInt(&desc.Height));
 
-    // Convert the source region from texels to mod-1 texture coordinate format.
-    if (flags & SpriteInfo::SourceInTexels)
-    {
-        source *= inverseTextureSize;
-        sourceSize *= inverseTextureSize;
+    return XMConvertVectorUIntToFloat(size, 0);
+}
+
+
+// Generates a viewport transform matrix for rendering sprites using x-right y-down screen pixel coordinates.
+XMMATRIX SpriteBatch::Impl::GetViewportTransform(_In_ ID3D11DeviceContext* deviceContext, DXGI_MODE_ROTATION rotation )
+{
+    // Look up the current viewport.
+    if ( !mSetViewport )
+    {
+        UINT viewportCount = 1;
+
+        deviceContext->RSGetViewports(&viewportCount, &mViewPort);
+
+        if (viewportCount != 1)
+            throw std::exception("No viewport is set");
     }
-    else
+    
+    // Compute the matrix.
+    float xScale = (mViewPort.Width  > 0) ? 2.0f / mViewPort.Width  : 0.0f;
+    float yScale = (mViewPort.Height > 0) ? 2.0f / mViewPort.Height : 0.0f;
+
+    switch( rotation )
     {
-        origin *= inverseTextureSize;
+    case DXGI_MODE_ROTATION_ROTATE90:
+        return XMMATRIX
+        (
+             0,       -yScale,  0,  0,
+             -xScale, 0,        0,  0,
+             0,       0,        1,  0,
+             1,       1,        0,  1
+        );
+
+    case DXGI_MODE_ROTATION_ROTATE270:
+        return XMMATRIX
+        (
+             0,       yScale,   0,  0,
+             xScale,  0,        0,  0,
+             0,       0,        1,  0,
+            -1,      -1,        0,  1
+        );
+
+    case DXGI_MODE_ROTATION_ROTATE180:
+        return XMMATRIX
+        (
+            -xScale,  0,       0,  0,
+             0,       yScale,  0,  0,
+             0,       0,       1,  0,
+             1,      -1,       0,  1
+        );
+
+    default:
+        return XMMATRIX
+        (
+             xScale,  0,       0,  0,
+             0,      -yScale,  0,  0,
+             0,       0,       1,  0,
+            -1,       1,       0,  1
+        );
     }
+}
+
+
+//--------------------------------------------------------------------------------------
+// SpriteLayer
+//--------------------------------------------------------------------------------------
+
+// Internal SpriteLayer implementation class.
+//
+// Sprites live in slots that keep their place for as long as the sprite exists, and each
+// slot owns the same four vertices in the vertex buffer, so a changed sprite is rebuilt
+// and uploaded on its own. Draw order is kept in a sorted list of slots that turns into a
+// 32-bit index buffer. Changes that affect the order are collected and merged into the
+// list once per draw, and only the indices from the first changed position are uploaded.
+class SpriteLayer::Impl
+{
+public:
+    typedef SpriteBatch::Impl::SpriteInfo SpriteInfo;
+
+    explicit Impl(SpriteSortMode sortMode);
+
+    Handle XM_CALLCONV Add(_In_ ID3D11ShaderResourceView* texture,
+        FXMVECTOR destination,
+        _In_opt_ RECT const* sourceRectangle,
+        FXMVECTOR color,
+        FXMVECTOR originRotationDepth,
+        int flags);
+
+    void XM_CALLCONV Update(Handle handle,
+        _In_ ID3D11ShaderResourceView* texture,
+        FXMVECTOR destination,
+        _In_opt_ RECT const* sourceRectangle,
+        FXMVECTOR color,
+        FXMVECTOR originRotationDepth,
+        int flags);
+
+    void SetPosition(Handle handle, XMFLOAT2 const& position);
+    void XM_CALLCONV SetColor(Handle handle, FXMVECTOR color);
+    void SetLayerDepth(Handle handle, float layerDepth);
+
+    void Remove(Handle handle);
+    void Clear();
+
+    bool IsValid(Handle handle) const;
+    size_t GetCount() const { return mCount; }
 
-    // If the destination size is relative to the source region, convert it to pixels.
-    if (!(flags & SpriteInfo::DestSizeInPixels))
+    // Brings the GPU copy up to date and draws it. The caller has set up all other state.
+    void Render(_In_ ID3D11DeviceContext* deviceContext);
+
+private:
+    // Bookkeeping for one slot of mSprites.
+    struct Slot
+    {
+        ComPtr<ID3D11ShaderResourceView> texture;
+        XMFLOAT2 textureSize;
+        uint64_t serial;        // Add order, which breaks ties in the sort.
+        uint32_t sortValue;
+        uint32_t generation;    // Changes when the sprite is removed, so old handles stop matching.
+        bool live;
+        bool dirty;             // Listed in mDirtySlots.
+        bool moved;             // Listed in mMovedSlots.
+    };
+
+    // One entry of the draw order.
+    struct OrderEntry
     {
-        destinationSize *= textureSize;
+        uint32_t sortValue;
+        uint32_t slot;
+        uint64_t serial;
+
+        bool operator< (OrderEntry const& other) const
+        {
+            return (sortValue != other.sortValue) ? (sortValue < other.sortValue) : (serial < other.serial);
+        }
+    };
+
+    // Consecutive entries of the draw order that share a texture.
+    struct TextureRun
+    {
+        ID3D11ShaderResourceView* texture;
+        size_t start;
+        size_t count;
+    };
+
+    size_t FindSlot(Handle handle) const;
+    size_t AllocateSlot();
+    void GrowSlots();
+    void XM_CALLCONV SetSprite(size_t slot,
+        _In_ ID3D11ShaderResourceView* texture,
+        FXMVECTOR textureSize,
+        FXMVECTOR destination,
+        _In_opt_ RECT const* sourceRectangle,
+        FXMVECTOR color,
+        FXMVECTOR originRotationDepth,
+        int flags);
+    uint32_t GetSortValue(_In_ SpriteInfo const& sprite);
+    void MarkDirty(size_t slot);
+    void MarkMoved(size_t slot);
+    size_t UpdateOrder();
+    void UpdateTextureRuns();
+    void CreateBuffers(_In_ ID3D11Device* device);
+
+    static const size_t InitialCapacity = 64;
+    static const size_t VerticesPerSprite = SpriteBatch::Impl::VerticesPerSprite;
+    static const size_t IndicesPerSprite = SpriteBatch::Impl::IndicesPerSprite;
+
+    SpriteSortMode mSortMode;
+
+    std::unique_ptr<SpriteInfo[]> mSprites;
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    size_t mCapacity;
+    size_t mCount;
+    uint64_t mNextSerial;
+
+    // Textures are numbered in order of first use for SpriteSortMode_Texture.
+    std::map<ID3D11ShaderResourceView*, uint32_t> mTextureIds;
+
+    // Draw order, and the changes to fold into it at the next draw.
+    std::vector<OrderEntry> mOrder;
+    std::vector<OrderEntry> mOrderScratch;
+    std::vector<uint32_t> mMovedSlots;
+    bool mOrderStale;
+    bool mRunsStale;
+
+    std::vector<TextureRun> mTextureRuns;
+
+    // Slots whose vertices must be rebuilt.
+    std::vector<uint32_t> mDirtySlots;
+
+    // CPU copies of the buffers: vertices by slot and indices in draw order.
+    std::vector<VertexPositionColorTexture> mVertices;
+    std::vector<uint32_t> mIndices;
+
+    ComPtr<ID3D11Device> mDevice;
+    ComPtr<ID3D11Buffer> mVertexBuffer;
+    ComPtr<ID3D11Buffer> mIndexBuffer;
+    size_t mBufferCapacity;
+    bool mUploadAll;
+};
+
+
+SpriteLayer::Impl::Impl(SpriteSortMode sortMode)
+  : mSortMode(sortMode),
+    mCapacity(0),
+    mCount(0),
+    mNextSerial(0),
+    mOrderStale(false),
+    mRunsStale(false),
+    mBufferCapacity(0),
+    mUploadAll(false)
+{
+    if (sortMode == SpriteSortMode_Immediate)
+        throw std::exception("SpriteLayer cannot use SpriteSortMode_Immediate");
+}
+
+
+// Adds a sprite to the layer.
+_Use_decl_annotations_
+SpriteLayer::Handle XM_CALLCONV SpriteLayer::Impl::Add(ID3D11ShaderResourceView* texture,
+    FXMVECTOR destination,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    FXMVECTOR originRotationDepth,
+    int flags)
+{
+    if (!texture)
+        throw std::exception("Texture cannot be null");
+
+    if (mCount >= UINT32_MAX)
+        throw std::exception("Too many sprites in SpriteLayer");
+
+    // Look up the size before taking a slot, as this throws for unsupported resources.
+    XMVECTOR textureSize = SpriteBatch::Impl::GetTextureSize(texture);
+
+    size_t slot = AllocateSlot();
+
+    mSlots[slot].serial = mNextSerial++;
+
+    SetSprite(slot, texture, textureSize, destination, sourceRectangle, color, originRotationDepth, flags);
+
+    MarkMoved(slot);
+
+    return (static_cast<uint64_t>(mSlots[slot].generation) << 32) | slot;
+}
+
+
+// Replaces all the settings of a sprite.
+_Use_decl_annotations_
+void XM_CALLCONV SpriteLayer::Impl::Update(Handle handle,
+    ID3D11ShaderResourceView* texture,
+    FXMVECTOR destination,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    FXMVECTOR originRotationDepth,
+    int flags)
+{
+    if (!texture)
+        throw std::exception("Texture cannot be null");
+
+    size_t slot = FindSlot(handle);
+
+    XMVECTOR textureSize = (texture == mSlots[slot].texture.Get())
+                           ? XMLoadFloat2(&mSlots[slot].textureSize)
+                           : SpriteBatch::Impl::GetTextureSize(texture);
+
+    uint32_t sortValue = mSlots[slot].sortValue;
+
+    SetSprite(slot, texture, textureSize, destination, sourceRectangle, color, originRotationDepth, flags);
+
+    if (mSlots[slot].sortValue != sortValue)
+    {
+        MarkMoved(slot);
+    }
+}
+
+
+// Moves a sprite without touching its other settings.
+void SpriteLayer::Impl::SetPosition(Handle handle, XMFLOAT2 const& position)
+{
+    size_t slot = FindSlot(handle);
+
+    mSprites[slot].destination.x = position.x;
+    mSprites[slot].destination.y = position.y;
+
+    MarkDirty(slot);
+}
+
+
+// Changes the color of a sprite.
+void XM_CALLCONV SpriteLayer::Impl::SetColor(Handle handle, FXMVECTOR color)
+{
+    size_t slot = FindSlot(handle);
+
+    XMStoreFloat4A(&mSprites[slot].color, color);
+
+    MarkDirty(slot);
+}
+
+
+// Changes the depth of a sprite, which moves it in the depth sorted modes.
+void SpriteLayer::Impl::SetLayerDepth(Handle handle, float layerDepth)
+{
+    size_t slot = FindSlot(handle);
+
+    mSprites[slot].originRotationDepth.w = layerDepth;
+
+    MarkDirty(slot);
+
+    uint32_t sortValue = GetSortValue(mSprites[slot]);
+
+    if (mSlots[slot].sortValue != sortValue)
+    {
+        mSlots[slot].sortValue = sortValue;
+
+        MarkMoved(slot);
+    }
+}
+
+
+// Removes a sprite. Its handle is no longer valid.
+void SpriteLayer::Impl::Remove(Handle handle)
+{
+    size_t slot = FindSlot(handle);
+
+    Slot& info = mSlots[slot];
+
+    info.texture.Reset();
+    info.live = false;
+
+    if (++info.generation == 0)
+    {
+        info.generation = 1;
     }
 
-    // Compute a 2x2 rotation matrix.
-    XMVECTOR rotationMatrix1;
-    XMVECTOR rotationMatrix2;
+    mFreeSlots.push_back(static_cast<uint32_t>(slot));
+    mCount--;
+
+    // Its entry is dropped from the draw order at the next draw.
+    mOrderStale = true;
+}
 
-    if (rotation != 0)
+
+// Removes every sprite, keeping the buffers for reuse.
+void SpriteLayer::Impl::Clear()
+{
+    mFreeSlots.clear();
+
+    for (size_t slot = mSlots.size(); slot-- > 0; )
     {
-        float sin, cos;
+        Slot& info = mSlots[slot];
 
-        XMScalarSinCos(&sin, &cos, rotation);
+        if (info.live)
+        {
+            info.texture.Reset();
+            info.live = false;
 
-        XMVECTOR sinV = XMLoadFloat(&sin);
-        XMVECTOR cosV = XMLoadFloat(&cos);
+            if (++info.generation == 0)
+            {
+                info.generation = 1;
+            }
+        }
+
+        info.dirty = false;
+        info.moved = false;
 
-        rotationMatrix1 = XMVectorMergeXY(cosV, sinV);
-        rotationMatrix2 = XMVectorMergeXY(-sinV, cosV);
+        mFreeSlots.push_back(static_cast<uint32_t>(slot));
+    }
+
+    mCount = 0;
+    mTextureIds.clear();
+    mOrder.clear();
+    mMovedSlots.clear();
+    mDirtySlots.clear();
+    mTextureRuns.clear();
+    mOrderStale = false;
+    mRunsStale = false;
+}
+
+
+bool SpriteLayer::Impl::IsValid(Handle handle) const
+{
+    size_t slot = static_cast<uint32_t>(handle);
+
+    return slot < mSlots.size()
+        && mSlots[slot].live
+        && mSlots[slot].generation == static_cast<uint32_t>(handle >> 32);
+}
+
+
+// Brings the buffers up to date and draws the sprites in order.
+_Use_decl_annotations_
+void SpriteLayer::Impl::Render(ID3D11DeviceContext* deviceContext)
+{
+    if (!mCount)
+        return;
+
+    // (Re)create the buffers if the layer outgrew them or moved to another device.
+    auto device = GetDevice(deviceContext);
+
+    if (device.Get() != mDevice.Get() || mBufferCapacity < mSlots.size())
+    {
+        CreateBuffers(device.Get());
+    }
+
+    size_t firstChanged = UpdateOrder();
+
+    if (mRunsStale)
+    {
+        UpdateTextureRuns();
+    }
+
+    // Rebuild the vertices of changed sprites.
+    for (auto slot : mDirtySlots)
+    {
+        Slot& info = mSlots[slot];
+
+        info.dirty = false;
+
+        if (info.live)
+        {
+            XMVECTOR textureSize = XMLoadFloat2(&info.textureSize);
+            XMVECTOR inverseTextureSize = XMVectorReciprocal(textureSize);
+
+            Internal::RenderSprite(&mSprites[slot], &mVertices[slot * VerticesPerSprite], textureSize, inverseTextureSize);
+        }
+    }
+
+    // Upload the changes.
+    size_t vertexSize = sizeof(VertexPositionColorTexture) * VerticesPerSprite;
+    size_t indexSize = sizeof(uint32_t) * IndicesPerSprite;
+
+    if (mUploadAll)
+    {
+        D3D11_BOX box = { 0, 0, 0, static_cast<UINT>(mSlots.size() * vertexSize), 1, 1 };
+
+        deviceContext->UpdateSubresource(mVertexBuffer.Get(), 0, &box, mVertices.data(), 0, 0);
+
+        firstChanged = 0;
+        mUploadAll = false;
+    }
+    else if (!mDirtySlots.empty())
+    {
+        // Upload runs of changed slots, joining runs separated by small gaps into one copy.
+        static const size_t MaxGap = 32;
+
+        std::sort(mDirtySlots.begin(), mDirtySlots.end());
+
+        size_t begin = mDirtySlots[0];
+        size_t end = begin + 1;
+
+        for (size_t i = 1; i <= mDirtySlots.size(); i++)
+        {
+            if (i < mDirtySlots.size() && mDirtySlots[i] <= end + MaxGap)
+            {
+                end = mDirtySlots[i] + 1;
+                continue;
+            }
+
+            D3D11_BOX box = { static_cast<UINT>(begin * vertexSize), 0, 0, static_cast<UINT>(end * vertexSize), 1, 1 };
+
+            deviceContext->UpdateSubresource(mVertexBuffer.Get(), 0, &box, &mVertices[begin * VerticesPerSprite], 0, 0);
+
+            if (i < mDirtySlots.size())
+            {
+                begin = mDirtySlots[i];
+                end = begin + 1;
+            }
+        }
+    }
+
+    mDirtySlots.clear();
+
+    if (firstChanged < mOrder.size())
+    {
+        D3D11_BOX box = { static_cast<UINT>(firstChanged * indexSize), 0, 0, static_cast<UINT>(mOrder.size() * indexSize), 1, 1 };
+
+        deviceContext->UpdateSubresource(mIndexBuffer.Get(), 0, &box, &mIndices[firstChanged * IndicesPerSprite], 0, 0);
+    }
+
+    // Draw each run of sprites that share a texture.
+    auto vertexBuffer = mVertexBuffer.Get();
+    UINT vertexStride = sizeof(VertexPositionColorTexture);
+    UINT vertexOffset = 0;
+
+    deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &vertexStride, &vertexOffset);
+    deviceContext->IASetIndexBuffer(mIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+
+    for (auto& run : mTextureRuns)
+    {
+        deviceContext->PSSetShaderResources(0, 1, &run.texture);
+
+        deviceContext->DrawIndexed(static_cast<UINT>(run.count * IndicesPerSprite), static_cast<UINT>(run.start * IndicesPerSprite), 0);
+    }
+}
+
+
+// Looks up the slot of a handle, which must be valid.
+size_t SpriteLayer::Impl::FindSlot(Handle handle) const
+{
+    if (!IsValid(handle))
+        throw std::exception("Invalid SpriteLayer handle");
+
+    return static_cast<uint32_t>(handle);
+}
+
+
+// Takes a free slot, growing the arrays when there is none.
+size_t SpriteLayer::Impl::AllocateSlot()
+{
+    size_t slot;
+
+    if (!mFreeSlots.empty())
+    {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
     }
     else
     {
-        rotationMatrix1 = g_XMIdentityR0;
-        rotationMatrix2 = g_XMIdentityR1;
+        slot = mSlots.size();
+
+        if (slot >= mCapacity)
+        {
+            GrowSlots();
+        }
+
+        Slot info = {};
+        info.generation = 1;
+
+        mSlots.push_back(info);
     }
-    
-    // The four corner vertices are computed by transforming these unit-square positions.
-    static XMVECTORF32 cornerOffsets[VerticesPerSprite] =
+
+    mSlots[slot].live = true;
+    mCount++;
+
+    return slot;
+}
+
+
+// Dynamically expands the slot arrays, by a factor of 2 like the SpriteBatch queue.
+void SpriteLayer::Impl::GrowSlots()
+{
+    size_t newCapacity = std::max(size_t(InitialCapacity), mCapacity * 2);
+
+    std::unique_ptr<SpriteInfo[]> newArray(new SpriteInfo[newCapacity]);
+
+    for (size_t i = 0; i < mSlots.size(); i++)
     {
-        { { { 0, 0, 0, 0 } } },
-        { { { 1, 0, 0, 0 } } },
-        { { { 0, 1, 0, 0 } } },
-        { { { 1, 1, 0, 0 } } },
-    };
+        newArray[i] = mSprites[i];
+    }
 
-    // Tricksy alert! Texture coordinates are computed from the same cornerOffsets
-    // table as vertex positions, but if the sprite is mirrored, this table
-    // must be indexed in a different order. This is done as follows:
-    //
-    //    position = cornerOffsets[i]
-    //    texcoord = cornerOffsets[i ^ SpriteEffects]
+    mVertices.resize(newCapacity * VerticesPerSprite);
+    mIndices.resize(newCapacity * IndicesPerSprite);
+    mSlots.reserve(newCapacity);
 
-    static_assert(SpriteEffects_FlipHorizontally == 1 &&
-                  SpriteEffects_FlipVertically == 2, "If you change these enum values, the mirroring implementation must be updated to match");
+    mSprites = std::move(newArray);
+    mCapacity = newCapacity;
+}
 
-    int mirrorBits = flags & 3;
 
-    // Generate the four output vertices.
-    for (int i = 0; i < VerticesPerSprite; i++)
+// Stores a sprite's settings in its slot.
+_Use_decl_annotations_
+void XM_CALLCONV SpriteLayer::Impl::SetSprite(size_t slot,
+    ID3D11ShaderResourceView* texture,
+    FXMVECTOR textureSize,
+    FXMVECTOR destination,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    FXMVECTOR originRotationDepth,
+    int flags)
+{
+    Slot& info = mSlots[slot];
+
+    if (info.texture.Get() != texture)
     {
-        // Calculate position.
-        XMVECTOR cornerOffset = (cornerOffsets[i] - origin) * destinationSize;
-        
-        // Apply 2x2 rotation matrix.
-        XMVECTOR position1 = XMVectorMultiplyAdd(XMVectorSplatX(cornerOffset), rotationMatrix1, destination);
-        XMVECTOR position2 = XMVectorMultiplyAdd(XMVectorSplatY(cornerOffset), rotationMatrix2, position1);
+        info.texture = texture;
+        XMStoreFloat2(&info.textureSize, textureSize);
+
+        mRunsStale = true;
+    }
+
+    SpriteBatch::Impl::StoreSprite(&mSprites[slot], texture, destination, sourceRectangle, color, originRotationDepth, flags);
+
+    info.sortValue = GetSortValue(mSprites[slot]);
+
+    MarkDirty(slot);
+}
+
+
+// Computes the value the draw order is sorted by.
+_Use_decl_annotations_
+uint32_t SpriteLayer::Impl::GetSortValue(SpriteInfo const& sprite)
+{
+    switch (mSortMode)
+    {
+        case SpriteSortMode_Texture:
+        {
+            auto it = mTextureIds.find(sprite.texture);
+
+            if (it == mTextureIds.end())
+            {
+                it = mTextureIds.insert(std::make_pair(sprite.texture, static_cast<uint32_t>(mTextureIds.size()))).first;
+            }
+
+            return it->second;
+        }
+
+        case SpriteSortMode_BackToFront:
+            return ~SortableDepth(sprite.originRotationDepth.w);
+
+        case SpriteSortMode_FrontToBack:
+            return SortableDepth(sprite.originRotationDepth.w);
+
+        default:
+            return 0;
+    }
+}
+
+
+void SpriteLayer::Impl::MarkDirty(size_t slot)
+{
+    if (!mSlots[slot].dirty)
+    {
+        mSlots[slot].dirty = true;
+        mDirtySlots.push_back(static_cast<uint32_t>(slot));
+    }
+}
+
+
+// Queues a sprite to be (re)inserted into the draw order at the next draw.
+void SpriteLayer::Impl::MarkMoved(size_t slot)
+{
+    if (!mSlots[slot].moved)
+    {
+        mSlots[slot].moved = true;
+        mMovedSlots.push_back(static_cast<uint32_t>(slot));
+    }
+
+    // A sprite that was already in the order has an entry to drop.
+    mOrderStale = true;
+}
+
+
+// Folds the changes since the last draw into the draw order, refreshing the CPU copy of the
+// indices. Returns the first position whose indices changed.
+size_t SpriteLayer::Impl::UpdateOrder()
+{
+    size_t firstChanged = SIZE_MAX;
+
+    if (!mOrderStale)
+        return firstChanged;
+
+    // Drop the entries of removed and moved sprites.
+    size_t kept = 0;
+
+    for (size_t i = 0; i < mOrder.size(); i++)
+    {
+        Slot const& info = mSlots[mOrder[i].slot];
+
+        if (info.live && !info.moved)
+        {
+            mOrder[kept++] = mOrder[i];
+        }
+        else if (firstChanged == SIZE_MAX)
+        {
+            firstChanged = i;
+        }
+    }
+
+    mOrder.resize(kept);
+
+    // Sort the moved sprites and merge them in.
+    mOrderScratch.clear();
+
+    for (auto slot : mMovedSlots)
+    {
+        Slot& info = mSlots[slot];
+
+        if (info.live)
+        {
+            OrderEntry entry = { info.sortValue, slot, info.serial };
 
-        // Set z = depth.
-        XMVECTOR position = XMVectorPermute<0, 1, 7, 6>(position2, originRotationDepth);
+            mOrderScratch.push_back(entry);
+        }
+
+        info.moved = false;
+    }
+
+    mMovedSlots.clear();
+
+    if (!mOrderScratch.empty())
+    {
+        std::sort(mOrderScratch.begin(), mOrderScratch.end());
+
+        size_t firstInsert = std::upper_bound(mOrder.begin(), mOrder.end(), mOrderScratch.front()) - mOrder.begin();
+
+        firstChanged = std::min(firstChanged, firstInsert);
+
+        size_t merged = mOrder.size() + mOrderScratch.size();
+
+        mOrder.resize(merged);
+
+        // Merge from the back so the existing entries can stay where they are.
+        size_t a = kept;
+        size_t b = mOrderScratch.size();
+
+        for (size_t out = merged; b > 0; )
+        {
+            if (a > firstInsert && mOrderScratch[b - 1] < mOrder[a - 1])
+            {
+                mOrder[--out] = mOrder[--a];
+            }
+            else
+            {
+                mOrder[--out] = mOrderScratch[--b];
+            }
+        }
+    }
+
+    // Rewrite the indices from the first change on.
+    for (size_t i = firstChanged; i < mOrder.size(); i++)
+    {
+        uint32_t base = mOrder[i].slot * static_cast<uint32_t>(VerticesPerSprite);
+        uint32_t* indices = &mIndices[i * IndicesPerSprite];
+
+        indices[0] = base;
+        indices[1] = base + 1;
+        indices[2] = base + 2;
+
+        indices[3] = base + 1;
+        indices[4] = base + 3;
+        indices[5] = base + 2;
+    }
+
+    mOrderStale = false;
+    mRunsStale = true;
+
+    return firstChanged;
+}
+
+
+// Splits the draw order into runs of sprites that share a texture.
+void SpriteLayer::Impl::UpdateTextureRuns()
+{
+    mTextureRuns.clear();
+
+    for (size_t i = 0; i < mOrder.size(); i++)
+    {
+        ID3D11ShaderResourceView* texture = mSlots[mOrder[i].slot].texture.Get();
+
+        if (mTextureRuns.empty() || mTextureRuns.back().texture != texture)
+        {
+            TextureRun run = { texture, i, 0 };
+
+            mTextureRuns.push_back(run);
+        }
+
+        mTextureRuns.back().count++;
+    }
+
+    mRunsStale = false;
+}
+
+
+// Creates buffers big enough for every slot, and marks everything for upload. The CPU copy
+// of the indices is always current, so it only needs uploading.
+void SpriteLayer::Impl::CreateBuffers(_In_ ID3D11Device* device)
+{
+    size_t capacity = mCapacity;
+
+    if (capacity > UINT32_MAX / (sizeof(VertexPositionColorTexture) * VerticesPerSprite))
+        throw std::exception("SpriteLayer is too large for a vertex buffer");
+
+    D3D11_BUFFER_DESC vertexBufferDesc = {};
+
+    vertexBufferDesc.ByteWidth = static_cast<UINT>(sizeof(VertexPositionColorTexture) * VerticesPerSprite * capacity);
+    vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
 
-        // Write position as a Float4, even though VertexPositionColor::position is an XMFLOAT3.
-        // This is faster, and harmless as we are just clobbering the first element of the
-        // following color field, which will immediately be overwritten with its correct value.
-        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&vertices[i].position), position);
+    ComPtr<ID3D11Buffer> vertexBuffer;
 
-        // Write the color.
-        XMStoreFloat4(&vertices[i].color, color);
+    ThrowIfFailed(
+        device->CreateBuffer(&vertexBufferDesc, nullptr, &vertexBuffer)
+    );
 
-        // Compute and write the texture coordinate.
-        XMVECTOR textureCoordinate = XMVectorMultiplyAdd(cornerOffsets[i ^ mirrorBits], sourceSize, source);
+    SetDebugObjectName(vertexBuffer.Get(), "DirectXTK:SpriteLayer");
 
-        XMStoreFloat2(&vertices[i].textureCoordinate, textureCoordinate);
-    }
-}
+    // 32-bit indices need feature level 9_2 or better.
+    D3D11_BUFFER_DESC indexBufferDesc = {};
 
+    indexBufferDesc.ByteWidth = static_cast<UINT>(sizeof(uint32_t) * IndicesPerSprite * capacity);
+    indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
 
-// Helper looks up the size of the specified texture.
-XMVECTOR SpriteBatch::Impl::GetTextureSize(_In_ ID3D11ShaderResourceView* texture)
-{
-    // Convert resource view to underlying resource.
-    ComPtr<ID3D11Resource> resource;
+    ComPtr<ID3D11Buffer> indexBuffer;
 
-    texture->GetResource(&resource);
-    
-    // Cast to texture.
-    ComPtr<ID3D11Texture2D> texture2D;
-    
-    if (FAILED(resource.As(&texture2D)))
-    {
-        throw std::exception("SpriteBatch can only draw Texture2D resources");
-    }
+    ThrowIfFailed(
+        device->CreateBuffer(&indexBufferDesc, nullptr, &indexBuffer)
+    );
 
-    // Query the texture size.
-    D3D11_TEXTURE2D_DESC desc;
+    SetDebugObjectName(indexBuffer.Get(), "DirectXTK:SpriteLayer");
 
-    texture2D->GetDesc(&desc);
+    mDevice = device;
+    mVertexBuffer = vertexBuffer;
+    mIndexBuffer = indexBuffer;
+    mBufferCapacity = capacity;
 
-    // Convert to vector format.
-    XMVECTOR size = XMVectorMergeXY(XMLoadInt(&desc.Width),
-                                    XMLoadInt(&desc.Height));
+    // Rebuild every live sprite, and every index.
+    for (size_t slot = 0; slot < mSlots.size(); slot++)
+    {
+        if (mSlots[slot].live)
+        {
+            MarkDirty(slot);
+        }
+    }
 
-    return XMConvertVectorUIntToFloat(size, 0);
+    mUploadAll = true;
 }
 
 
-// Generates a viewport transform matrix for rendering sprites using x-right y-down screen pixel coordinates.
-XMMATRIX SpriteBatch::Impl::GetViewportTransform(_In_ ID3D11DeviceContext* deviceContext, DXGI_MODE_ROTATION rotation )
+// Draws a retained layer between the sprites queued before and after it.
+void SpriteBatch::Impl::Draw(SpriteLayer::Impl& layer)
 {
-    // Look up the current viewport.
-    if ( !mSetViewport )
-    {
-        UINT viewportCount = 1;
+    if (!mInBeginEndPair)
+        throw std::exception("Begin must be called before Draw");
 
-        deviceContext->RSGetViewports(&viewportCount, &mViewPort);
+    if (mSortMode != SpriteSortMode_Immediate)
+    {
+        if (mContextResources->inImmediateMode)
+            throw std::exception("Cannot draw a layer while another SpriteBatch is using SpriteSortMode_Immediate");
 
-        if (viewportCount != 1)
-            throw std::exception("No viewport is set");
+        // Sprites queued so far go underneath the layer.
+        PrepareForRendering();
+        FlushBatch();
     }
-    
-    // Compute the matrix.
-    float xScale = (mViewPort.Width  > 0) ? 2.0f / mViewPort.Width  : 0.0f;
-    float yScale = (mViewPort.Height > 0) ? 2.0f / mViewPort.Height : 0.0f;
 
-    switch( rotation )
-    {
-    case DXGI_MODE_ROTATION_ROTATE90:
-        return XMMATRIX
-        (
-             0,       -yScale,  0,  0,
-             -xScale, 0,        0,  0,
-             0,       0,        1,  0,
-             1,       1,        0,  1
-        );
+    auto deviceContext = mContextResources->deviceContext.Get();
 
-    case DXGI_MODE_ROTATION_ROTATE270:
-        return XMMATRIX
-        (
-             0,       yScale,   0,  0,
-             xScale,  0,        0,  0,
-             0,       0,        1,  0,
-            -1,      -1,        0,  1
-        );
+    layer.Render(deviceContext);
 
-    case DXGI_MODE_ROTATION_ROTATE180:
-        return XMMATRIX
-        (
-            -xScale,  0,       0,  0,
-             0,       yScale,  0,  0,
-             0,       0,       1,  0,
-             1,      -1,       0,  1
-        );
+    // Put back the buffers the rest of the batch draws from.
+    deviceContext->IASetIndexBuffer(mDeviceResources->indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
 
-    default:
-        return XMMATRIX
-        (
-             xScale,  0,       0,  0,
-             0,      -yScale,  0,  0,
-             0,       0,       1,  0,
-            -1,       1,       0,  1
-        );
-    }
+#if !defined(_XBOX_ONE) || !defined(_TITLE)
+    auto vertexBuffer = mContextResources->vertexBuffer.Get();
+    UINT vertexStride = sizeof(VertexPositionColorTexture);
+    UINT vertexOffset = 0;
+
+    deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &vertexStride, &vertexOffset);
+#endif
 }
 
 
@@ -1181,6 +2212,12 @@ void XM_CALLCONV SpriteBatch::Draw(ID3D11ShaderResourceView* texture,
 }
 
 
+void SpriteBatch::Draw(SpriteLayer& layer)
+{
+    pImpl->Draw(*layer.pImpl);
+}
+
+
 void SpriteBatch::SetRotation( DXGI_MODE_ROTATION mode )
 {
     pImpl->mRotation = mode;
@@ -1198,3 +2235,194 @@ void SpriteBatch::SetViewport( const D3D11_VIEWPORT& viewPort )
     pImpl->mSetViewport = true;
     pImpl->mViewPort = viewPort;
 }
+
+
+//--------------------------------------------------------------------------------------
+// SpriteLayer public methods.
+//--------------------------------------------------------------------------------------
+
+const XMFLOAT2 SpriteLayer::Float2Zero(0, 0);
+
+// Public constructor.
+SpriteLayer::SpriteLayer(SpriteSortMode sortMode)
+  : pImpl(new Impl(sortMode))
+{
+}
+
+
+// Move constructor.
+SpriteLayer::SpriteLayer(SpriteLayer&& moveFrom)
+  : pImpl(std::move(moveFrom.pImpl))
+{
+}
+
+
+// Move assignment.
+SpriteLayer& SpriteLayer::operator= (SpriteLayer&& moveFrom)
+{
+    pImpl = std::move(moveFrom.pImpl);
+    return *this;
+}
+
+
+// Public destructor.
+SpriteLayer::~SpriteLayer()
+{
+}
+
+
+_Use_decl_annotations_
+SpriteLayer::Handle XM_CALLCONV SpriteLayer::Add(ID3D11ShaderResourceView* texture,
+    XMFLOAT2 const& position,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    float rotation,
+    XMFLOAT2 const& origin,
+    float scale,
+    SpriteEffects effects,
+    float layerDepth)
+{
+    XMVECTOR destination = XMVectorPermute<0, 1, 4, 4>(XMLoadFloat2(&position), XMLoadFloat(&scale)); // x, y, scale, scale
+
+    XMVECTOR originRotationDepth = XMVectorSet(origin.x, origin.y, rotation, layerDepth);
+
+    return pImpl->Add(texture, destination, sourceRectangle, color, originRotationDepth, effects);
+}
+
+
+_Use_decl_annotations_
+SpriteLayer::Handle XM_CALLCONV SpriteLayer::Add(ID3D11ShaderResourceView* texture,
+    XMFLOAT2 const& position,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    float rotation,
+    XMFLOAT2 const& origin,
+    XMFLOAT2 const& scale,
+    SpriteEffects effects,
+    float layerDepth)
+{
+    XMVECTOR destination = XMVectorPermute<0, 1, 4, 5>(XMLoadFloat2(&position), XMLoadFloat2(&scale)); // x, y, scale.x, scale.y
+
+    XMVECTOR originRotationDepth = XMVectorSet(origin.x, origin.y, rotation, layerDepth);
+
+    return pImpl->Add(texture, destination, sourceRectangle, color, originRotationDepth, effects);
+}
+
+
+_Use_decl_annotations_
+SpriteLayer::Handle XM_CALLCONV SpriteLayer::Add(ID3D11ShaderResourceView* texture,
+    RECT const& destinationRectangle,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    float rotation,
+    XMFLOAT2 const& origin,
+    SpriteEffects effects,
+    float layerDepth)
+{
+    XMVECTOR destination = LoadRect(&destinationRectangle); // x, y, w, h
+
+    XMVECTOR originRotationDepth = XMVectorSet(origin.x, origin.y, rotation, layerDepth);
+
+    return pImpl->Add(texture, destination, sourceRectangle, color, originRotationDepth, effects | SpriteBatch::Impl::SpriteInfo::DestSizeInPixels);
+}
+
+
+_Use_decl_annotations_
+void XM_CALLCONV SpriteLayer::Update(Handle handle,
+    ID3D11ShaderResourceView* texture,
+    XMFLOAT2 const& position,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    float rotation,
+    XMFLOAT2 const& origin,
+    float scale,
+    SpriteEffects effects,
+    float layerDepth)
+{
+    XMVECTOR destination = XMVectorPermute<0, 1, 4, 4>(XMLoadFloat2(&position), XMLoadFloat(&scale)); // x, y, scale, scale
+
+    XMVECTOR originRotationDepth = XMVectorSet(origin.x, origin.y, rotation, layerDepth);
+
+    pImpl->Update(handle, texture, destination, sourceRectangle, color, originRotationDepth, effects);
+}
+
+
+_Use_decl_annotations_
+void XM_CALLCONV SpriteLayer::Update(Handle handle,
+    ID3D11ShaderResourceView* texture,
+    XMFLOAT2 const& position,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    float rotation,
+    XMFLOAT2 const& origin,
+    XMFLOAT2 const& scale,
+    SpriteEffects effects,
+    float layerDepth)
+{
+    XMVECTOR destination = XMVectorPermute<0, 1, 4, 5>(XMLoadFloat2(&position), XMLoadFloat2(&scale)); // x, y, scale.x, scale.y
+
+    XMVECTOR originRotationDepth = XMVectorSet(origin.x, origin.y, rotation, layerDepth);
+
+    pImpl->Update(handle, texture, destination, sourceRectangle, color, originRotationDepth, effects);
+}
+
+
+_Use_decl_annotations_
+void XM_CALLCONV SpriteLayer::Update(Handle handle,
+    ID3D11ShaderResourceView* texture,
+    RECT const& destinationRectangle,
+    RECT const* sourceRectangle,
+    FXMVECTOR color,
+    float rotation,
+    XMFLOAT2 const& origin,
+    SpriteEffects effects,
+    float layerDepth)
+{
+    XMVECTOR destination = LoadRect(&destinationRectangle); // x, y, w, h
+
+    XMVECTOR originRotationDepth = XMVectorSet(origin.x, origin.y, rotation, layerDepth);
+
+    pImpl->Update(handle, texture, destination, sourceRectangle, color, originRotationDepth, effects | SpriteBatch::Impl::SpriteInfo::DestSizeInPixels);
+}
+
+
+void SpriteLayer::SetPosition(Handle handle, XMFLOAT2 const& position)
+{
+    pImpl->SetPosition(handle, position);
+}
+
+
+void XM_CALLCONV SpriteLayer::SetColor(Handle handle, FXMVECTOR color)
+{
+    pImpl->SetColor(handle, color);
+}
+
+
+void SpriteLayer::SetLayerDepth(Handle handle, float layerDepth)
+{
+    pImpl->SetLayerDepth(handle, layerDepth);
+}
+
+
+void SpriteLayer::Remove(Handle handle)
+{
+    pImpl->Remove(handle);
+}
+
+
+void SpriteLayer::Clear()
+{
+    pImpl->Clear();
+}
+
+
+bool SpriteLayer::IsValid(Handle handle) const
+{
+    return pImpl->IsValid(handle);
+}
+
+
+size_t SpriteLayer::GetCount() const
+{
+    return pImpl->GetCount();
+}
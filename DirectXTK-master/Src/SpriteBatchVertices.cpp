@@ -0,0 +1,362 @@
+//--------------------------------------------------------------------------------------
+// File: SpriteBatchVertices.cpp
+//
+// Built without the precompiled header; Direct3D is only needed for the vertex type.
+//
+// RenderSprite comes from SpriteBatch.cpp, Copyright (c) Microsoft Corporation, under
+// the MIT License in LICENSE. The rest is part of SnowScene's additions to DirectXTK.
+//--------------------------------------------------------------------------------------
+
+#include "SpriteBatchVertices.h"
+#include "VertexTypes.h"
+
+#ifdef SPRITEBATCH_AVX
+#include <intrin.h>
+#endif
+
+using namespace DirectX;
+using namespace DirectX::Internal;
+
+
+namespace
+{
+    // Sine and cosine of four angles, computed the same way XMScalarSinCos does one, so that
+    // sprites expanded four at a time come out the same as sprites expanded one at a time.
+    inline void XM_CALLCONV SpriteSinCos(FXMVECTOR angle, _Out_ XMVECTOR* sin, _Out_ XMVECTOR* cos)
+    {
+        // Map the angle to y in [-pi,pi], with angle = 2*pi*quotient + y.
+        XMVECTOR rounding = XMVectorSelect(XMVectorNegate(g_XMOneHalf), g_XMOneHalf, XMVectorGreaterOrEqual(angle, XMVectorZero()));
+        XMVECTOR quotient = XMVectorTruncate(XMVectorMultiplyAdd(g_XMReciprocalTwoPi, angle, rounding));
+        XMVECTOR y = XMVectorNegativeMultiplySubtract(g_XMTwoPi, quotient, angle);
+
+        // Map y to [-pi/2,pi/2] with sin(y) = sin(angle).
+        XMVECTOR above = XMVectorGreater(y, g_XMHalfPi);
+        XMVECTOR below = XMVectorLess(y, XMVectorNegate(g_XMHalfPi));
+
+        y = XMVectorSelect(XMVectorSelect(y, XMVectorSubtract(g_XMPi, y), above), XMVectorSubtract(XMVectorNegate(g_XMPi), y), below);
+
+        XMVECTOR sign = XMVectorSelect(g_XMOne, g_XMNegativeOne, XMVectorOrInt(above, below));
+        XMVECTOR y2 = y * y;
+
+        // 11-degree minimax approximation.
+        XMVECTOR s = XMVectorMultiplyAdd(XMVectorReplicate(-2.3889859e-08f), y2, XMVectorReplicate(2.7525562e-06f));
+        s = XMVectorMultiplyAdd(s, y2, XMVectorReplicate(-0.00019840874f));
+        s = XMVectorMultiplyAdd(s, y2, XMVectorReplicate(0.0083333310f));
+        s = XMVectorMultiplyAdd(s, y2, XMVectorReplicate(-0.16666667f));
+        *sin = XMVectorMultiplyAdd(s, y2, g_XMOne) * y;
+
+        // 10-degree minimax approximation.
+        XMVECTOR c = XMVectorMultiplyAdd(XMVectorReplicate(-2.6051615e-07f), y2, XMVectorReplicate(2.4760495e-05f));
+        c = XMVectorMultiplyAdd(c, y2, XMVectorReplicate(-0.0013888378f));
+        c = XMVectorMultiplyAdd(c, y2, XMVectorReplicate(0.041666638f));
+        c = XMVectorMultiplyAdd(c, y2, XMVectorReplicate(-0.5f));
+        *cos = sign * XMVectorMultiplyAdd(c, y2, g_XMOne);
+    }
+
+
+#ifdef SPRITEBATCH_AVX
+    // AVX needs both the instructions and an OS that saves the upper halves of the YMM
+    // registers. Only AVX1 is used, so this is true of every x64 Xbox and most PCs.
+    bool DetectAVX()
+    {
+        int info[4];
+
+        __cpuid(info, 1);
+
+        const int osxsave = 1 << 27;
+        const int avx = 1 << 28;
+
+        if ((info[2] & (osxsave | avx)) != (osxsave | avx))
+            return false;
+
+        return (_xgetbv(0) & 6) == 6;
+    }
+
+    const bool g_HasAVX = DetectAVX();
+#endif
+}
+
+
+// Generates vertex data for drawing a single sprite.
+_Use_decl_annotations_
+void XM_CALLCONV Internal::RenderSprite(SpriteInfo const* sprite,
+    VertexPositionColorTexture* vertices,
+    FXMVECTOR textureSize,
+    FXMVECTOR inverseTextureSize)
+{
+    // Load sprite parameters into SIMD registers.
+    XMVECTOR source = XMLoadFloat4A(&sprite->source);
+    XMVECTOR destination = XMLoadFloat4A(&sprite->destination);
+    XMVECTOR color = XMLoadFloat4A(&sprite->color);
+    XMVECTOR originRotationDepth = XMLoadFloat4A(&sprite->originRotationDepth);
+
+    float rotation = sprite->originRotationDepth.z;
+    int flags = sprite->flags;
+
+    // Extract the source and destination sizes into separate vectors.
+    XMVECTOR sourceSize = XMVectorSwizzle<2, 3, 2, 3>(source);
+    XMVECTOR destinationSize = XMVectorSwizzle<2, 3, 2, 3>(destination);
+
+    // Scale the origin offset by source size, taking care to avoid overflow if the source region is zero.
+    XMVECTOR isZeroMask = XMVectorEqual(sourceSize, XMVectorZero());
+    XMVECTOR nonZeroSourceSize = XMVectorSelect(sourceSize, g_XMEpsilon, isZeroMask);
+
+    XMVECTOR origin = XMVectorDivide(originRotationDepth, nonZeroSourceSize);
+
+    // Convert the source region from texels to mod-1 texture coordinate format.
+    if (flags & SpriteInfo::SourceInTexels)
+    {
+        source *= inverseTextureSize;
+        sourceSize *= inverseTextureSize;
+    }
+    else
+    {
+        origin *= inverseTextureSize;
+    }
+
+    // If the destination size is relative to the source region, convert it to pixels.
+    if (!(flags & SpriteInfo::DestSizeInPixels))
+    {
+        destinationSize *= textureSize;
+    }
+
+    // Compute a 2x2 rotation matrix.
+    XMVECTOR rotationMatrix1;
+    XMVECTOR rotationMatrix2;
+
+    if (rotation != 0)
+    {
+        float sin, cos;
+
+        XMScalarSinCos(&sin, &cos, rotation);
+
+        XMVECTOR sinV = XMLoadFloat(&sin);
+        XMVECTOR cosV = XMLoadFloat(&cos);
+
+        rotationMatrix1 = XMVectorMergeXY(cosV, sinV);
+        rotationMatrix2 = XMVectorMergeXY(XMVectorNegate(sinV), cosV);
+    }
+    else
+    {
+        rotationMatrix1 = g_XMIdentityR0;
+        rotationMatrix2 = g_XMIdentityR1;
+    }
+    
+    // The four corner vertices are computed by transforming these unit-square positions.
+    static XMVECTORF32 cornerOffsets[VerticesPerSprite] =
+    {
+        { { { 0, 0, 0, 0 } } },
+        { { { 1, 0, 0, 0 } } },
+        { { { 0, 1, 0, 0 } } },
+        { { { 1, 1, 0, 0 } } },
+    };
+
+    // Tricksy alert! Texture coordinates are computed from the same cornerOffsets
+    // table as vertex positions, but if the sprite is mirrored, this table
+    // must be indexed in a different order. This is done as follows:
+    //
+    //    position = cornerOffsets[i]
+    //    texcoord = cornerOffsets[i ^ SpriteEffects]
+
+    static_assert(SpriteInfo::FlipHorizontally == 1 &&
+                  SpriteInfo::FlipVertically == 2, "If you change these enum values, the mirroring implementation must be updated to match");
+
+    int mirrorBits = flags & 3;
+
+    // Generate the four output vertices.
+    for (size_t i = 0; i < VerticesPerSprite; i++)
+    {
+        // Calculate position.
+        XMVECTOR cornerOffset = XMVectorSubtract(cornerOffsets[i], origin) * destinationSize;
+        
+        // Apply 2x2 rotation matrix.
+        XMVECTOR position1 = XMVectorMultiplyAdd(XMVectorSplatX(cornerOffset), rotationMatrix1, destination);
+        XMVECTOR position2 = XMVectorMultiplyAdd(XMVectorSplatY(cornerOffset), rotationMatrix2, position1);
+
+        // Set z = depth.
+        XMVECTOR position = XMVectorPermute<0, 1, 7, 6>(position2, originRotationDepth);
+
+        // Write position as a Float4, even though VertexPositionColor::position is an XMFLOAT3.
+        // This is faster, and harmless as we are just clobbering the first element of the
+        // following color field, which will immediately be overwritten with its correct value.
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&vertices[i].position), position);
+
+        // Write the color.
+        XMStoreFloat4(&vertices[i].color, color);
+
+        // Compute and write the texture coordinate.
+        XMVECTOR textureCoordinate = XMVectorMultiplyAdd(cornerOffsets[i ^ mirrorBits], sourceSize, source);
+
+        XMStoreFloat2(&vertices[i].textureCoordinate, textureCoordinate);
+    }
+}
+
+
+// Generates vertex data for a run of sprites that share a texture. Most of them are done
+// several at a time by RenderEightSpritesAVX and RenderFourSprites, which give the same
+// results as RenderSprite.
+_Use_decl_annotations_
+void XM_CALLCONV Internal::RenderSprites(SpriteInfo const* const* sprites,
+    size_t count,
+    VertexPositionColorTexture* vertices,
+    FXMVECTOR textureSize,
+    FXMVECTOR inverseTextureSize)
+{
+    size_t i = 0;
+
+#ifdef SPRITEBATCH_AVX
+    if (g_HasAVX)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            RenderEightSpritesAVX(sprites + i, vertices + i * VerticesPerSprite, textureSize, inverseTextureSize);
+        }
+    }
+#endif
+
+    for (; i + 4 <= count; i += 4)
+    {
+        RenderFourSprites(sprites + i, vertices + i * VerticesPerSprite, textureSize, inverseTextureSize);
+    }
+
+    for (; i < count; i++)
+    {
+        RenderSprite(sprites[i], vertices + i * VerticesPerSprite, textureSize, inverseTextureSize);
+    }
+}
+
+
+// Generates vertex data for four sprites at once. The sprites are transposed so that each
+// vector holds one field of all four, then every step of RenderSprite is done for all of them
+// with the same operations in the same order, its per-sprite branches becoming selects. This
+// is SSE on x86 and x64 and NEON on ARM, through DirectXMath.
+_Use_decl_annotations_
+void XM_CALLCONV Internal::RenderFourSprites(SpriteInfo const* const* sprites,
+    VertexPositionColorTexture* vertices,
+    FXMVECTOR textureSize,
+    FXMVECTOR inverseTextureSize)
+{
+    auto loadTransposed = [sprites](XMFLOAT4A const SpriteInfo::* field) -> XMMATRIX
+    {
+        return XMMatrixTranspose(XMMATRIX(XMLoadFloat4A(&(sprites[0]->*field)),
+                                          XMLoadFloat4A(&(sprites[1]->*field)),
+                                          XMLoadFloat4A(&(sprites[2]->*field)),
+                                          XMLoadFloat4A(&(sprites[3]->*field))));
+    };
+
+    XMMATRIX source = loadTransposed(&SpriteInfo::source);
+    XMMATRIX destination = loadTransposed(&SpriteInfo::destination);
+    XMMATRIX color = loadTransposed(&SpriteInfo::color);
+    XMMATRIX originRotationDepth = loadTransposed(&SpriteInfo::originRotationDepth);
+
+    // The flags become masks for the unit conversions, and 0 or 1 for mirroring.
+    XMVECTOR flags = XMVectorSetInt(sprites[0]->flags, sprites[1]->flags, sprites[2]->flags, sprites[3]->flags);
+
+    auto flagMask = [flags](int flag) -> XMVECTOR
+    {
+        XMVECTOR bit = XMVectorReplicateInt(flag);
+
+        return XMVectorEqualInt(XMVectorAndInt(flags, bit), bit);
+    };
+
+    XMVECTOR sourceInTexels = flagMask(SpriteInfo::SourceInTexels);
+    XMVECTOR destSizeInPixels = flagMask(SpriteInfo::DestSizeInPixels);
+    XMVECTOR flipH = XMVectorAndInt(flagMask(SpriteInfo::FlipHorizontally), g_XMOne);
+    XMVECTOR flipV = XMVectorAndInt(flagMask(SpriteInfo::FlipVertically), g_XMOne);
+
+    XMVECTOR textureWidth = XMVectorSplatX(textureSize);
+    XMVECTOR textureHeight = XMVectorSplatY(textureSize);
+    XMVECTOR inverseWidth = XMVectorSplatX(inverseTextureSize);
+    XMVECTOR inverseHeight = XMVectorSplatY(inverseTextureSize);
+
+    // Scale the origin offset by source size, taking care to avoid overflow if the source region is zero.
+    XMVECTOR originX = XMVectorDivide(originRotationDepth.r[0], XMVectorSelect(source.r[2], g_XMEpsilon, XMVectorEqual(source.r[2], XMVectorZero())));
+    XMVECTOR originY = XMVectorDivide(originRotationDepth.r[1], XMVectorSelect(source.r[3], g_XMEpsilon, XMVectorEqual(source.r[3], XMVectorZero())));
+
+    // Convert the source region from texels to mod-1 texture coordinate format.
+    XMVECTOR sourceX = XMVectorSelect(source.r[0], source.r[0] * inverseWidth, sourceInTexels);
+    XMVECTOR sourceY = XMVectorSelect(source.r[1], source.r[1] * inverseHeight, sourceInTexels);
+    XMVECTOR sourceWidth = XMVectorSelect(source.r[2], source.r[2] * inverseWidth, sourceInTexels);
+    XMVECTOR sourceHeight = XMVectorSelect(source.r[3], source.r[3] * inverseHeight, sourceInTexels);
+
+    originX = XMVectorSelect(originX * inverseWidth, originX, sourceInTexels);
+    originY = XMVectorSelect(originY * inverseHeight, originY, sourceInTexels);
+
+    // If the destination size is relative to the source region, convert it to pixels.
+    XMVECTOR destinationWidth = XMVectorSelect(destination.r[2] * textureWidth, destination.r[2], destSizeInPixels);
+    XMVECTOR destinationHeight = XMVectorSelect(destination.r[3] * textureHeight, destination.r[3], destSizeInPixels);
+
+    // Compute the 2x2 rotation matrices, using the identity for sprites that are not rotated.
+    XMVECTOR rotation = originRotationDepth.r[2];
+    XMVECTOR notRotated = XMVectorEqual(rotation, XMVectorZero());
+
+    XMVECTOR sin = XMVectorZero();
+    XMVECTOR cos = g_XMOne;
+    XMVECTOR negativeSin = XMVectorZero();
+
+    // Runs of unrotated sprites, such as text, are common enough to be worth a branch.
+    if (!XMVector4EqualInt(notRotated, XMVectorTrueInt()))
+    {
+        SpriteSinCos(rotation, &sin, &cos);
+
+        negativeSin = XMVectorSelect(XMVectorNegate(sin), XMVectorZero(), notRotated);
+
+        sin = XMVectorSelect(sin, XMVectorZero(), notRotated);
+        cos = XMVectorSelect(cos, g_XMOne, notRotated);
+    }
+
+    // Texture coordinates of the left and right, and top and bottom, edges. Mirroring swaps
+    // them, which is the cornerOffsets[i ^ SpriteEffects] lookup of RenderSprite.
+    XMVECTOR leftU = flipH;
+    XMVECTOR rightU = XMVectorSubtract(g_XMOne, flipH);
+    XMVECTOR topV = flipV;
+    XMVECTOR bottomV = XMVectorSubtract(g_XMOne, flipV);
+
+    // Vertices are computed a corner at a time but written a sprite at a time, because the
+    // vertex buffer is usually write-combined memory, which is best filled in order.
+    XMMATRIX positionRed[VerticesPerSprite];
+    XMMATRIX colorU[VerticesPerSprite];
+    XMVECTORF32 textureV[VerticesPerSprite];
+
+    for (size_t i = 0; i < VerticesPerSprite; i++)
+    {
+        XMVECTOR cornerX = (i & 1) ? g_XMOne : g_XMZero;
+        XMVECTOR cornerY = (i & 2) ? g_XMOne : g_XMZero;
+
+        // Calculate position.
+        XMVECTOR cornerOffsetX = (cornerX - originX) * destinationWidth;
+        XMVECTOR cornerOffsetY = (cornerY - originY) * destinationHeight;
+
+        // Apply 2x2 rotation matrix.
+        XMVECTOR positionX = XMVectorMultiplyAdd(cornerOffsetY, negativeSin, XMVectorMultiplyAdd(cornerOffsetX, cos, destination.r[0]));
+        XMVECTOR positionY = XMVectorMultiplyAdd(cornerOffsetY, cos, XMVectorMultiplyAdd(cornerOffsetX, sin, destination.r[1]));
+
+        // Compute the texture coordinate.
+        XMVECTOR textureU = XMVectorMultiplyAdd((i & 1) ? rightU : leftU, sourceWidth, sourceX);
+
+        textureV[i].v = XMVectorMultiplyAdd((i & 2) ? bottomV : topV, sourceHeight, sourceY);
+
+        // Transpose back to one vertex per vector: position and red, then green, blue, alpha and u.
+        positionRed[i] = XMMatrixTranspose(XMMATRIX(positionX, positionY, originRotationDepth.r[3], color.r[0]));
+        colorU[i] = XMMatrixTranspose(XMMATRIX(color.r[1], color.r[2], color.r[3], textureU));
+    }
+
+    for (size_t j = 0; j < 4; j++)
+    {
+        for (size_t i = 0; i < VerticesPerSprite; i++, vertices++)
+        {
+            XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&vertices->position), positionRed[i].r[j]);
+            XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&vertices->color.y), colorU[i].r[j]);
+
+            vertices->textureCoordinate.y = textureV[i].f[j];
+        }
+    }
+}
+
+
+#ifdef SPRITEBATCH_AVX
+bool Internal::IsAVXSupported()
+{
+    return g_HasAVX;
+}
+#endif
@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// File: SpriteBatchVertices.h
+//
+// Vertex generation shared by SpriteBatch and SpriteLayer. It only needs the queued
+// sprites and the texture size, so it is kept apart from the device code.
+//
+// SpriteInfo comes from SpriteBatch.cpp, Copyright (c) Microsoft Corporation, under
+// the MIT License in LICENSE. The rest is part of SnowScene's additions to DirectXTK.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+
+#include "AlignedNew.h"
+
+#include <stddef.h>
+
+// The eight-wide kernel. Compilers other than MSVC have to build SpriteBatchVerticesAVX.cpp,
+// and only that file, with AVX code generation enabled.
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)) && !defined(_XM_NO_INTRINSICS_)
+#define SPRITEBATCH_AVX
+#endif
+
+struct ID3D11ShaderResourceView;
+
+
+namespace DirectX
+{
+    struct VertexPositionColorTexture;
+
+    namespace Internal
+    {
+        // Info about a single sprite that is waiting to be drawn. The XMFLOAT4A fields make
+        // it 16-byte aligned.
+        struct SpriteInfo : public AlignedNew<SpriteInfo>
+        {
+            XMFLOAT4A source;
+            XMFLOAT4A destination;
+            XMFLOAT4A color;
+            XMFLOAT4A originRotationDepth;
+            ID3D11ShaderResourceView* texture;
+            int flags;
+
+
+            // The mirroring bits are the SpriteEffects values; the internal-only flags
+            // are combined with them.
+            static const int FlipHorizontally = 1;
+            static const int FlipVertically = 2;
+            static const int SourceInTexels = 4;
+            static const int DestSizeInPixels = 8;
+        };
+
+        const size_t VerticesPerSprite = 4;
+
+
+        // Generates vertex data for drawing a single sprite.
+        void XM_CALLCONV RenderSprite(_In_ SpriteInfo const* sprite,
+            _Out_writes_(VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize);
+
+        // Generates vertex data for a run of sprites that share a texture, using the widest
+        // kernel the CPU supports. The results are the same as RenderSprite's.
+        void XM_CALLCONV RenderSprites(_In_reads_(count) SpriteInfo const* const* sprites,
+            size_t count,
+            _Out_writes_(count * VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize);
+
+        // The kernels RenderSprites picks from.
+        void XM_CALLCONV RenderFourSprites(_In_reads_(4) SpriteInfo const* const* sprites,
+            _Out_writes_(4 * VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize);
+
+#ifdef SPRITEBATCH_AVX
+        // RenderEightSpritesAVX may only be called if this returns true.
+        bool IsAVXSupported();
+
+        void XM_CALLCONV RenderEightSpritesAVX(_In_reads_(8) SpriteInfo const* const* sprites,
+            _Out_writes_(8 * VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize);
+#endif
+    }
+}
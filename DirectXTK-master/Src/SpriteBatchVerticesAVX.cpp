@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------
+// File: SpriteBatchVerticesAVX.cpp
+//
+// The eight-wide sprite kernel. It is kept in its own file so that, on compilers that
+// need AVX code generation enabled to use the AVX intrinsics, only this file is built
+// that way and everything else still runs on CPUs without AVX.
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "SpriteBatchVertices.h"
+#include "VertexTypes.h"
+
+#ifdef SPRITEBATCH_AVX
+
+#include <immintrin.h>
+
+using namespace DirectX;
+using namespace DirectX::Internal;
+
+
+namespace
+{
+    // Eight-wide XMVectorSelect.
+    inline __m256 SelectAVX(__m256 const& v1, __m256 const& v2, __m256 const& control)
+    {
+        return _mm256_or_ps(_mm256_andnot_ps(control, v1), _mm256_and_ps(v2, control));
+    }
+
+
+    // Eight-wide version of SpriteSinCos.
+    inline void SpriteSinCosAVX(__m256 const& angle, _Out_ __m256* sin, _Out_ __m256* cos)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 pi = _mm256_set1_ps(XM_PI);
+        const __m256 halfPi = _mm256_set1_ps(XM_PIDIV2);
+
+        __m256 rounding = SelectAVX(_mm256_set1_ps(-0.5f), _mm256_set1_ps(0.5f), _mm256_cmp_ps(angle, zero, _CMP_GE_OQ));
+        __m256 quotient = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(XM_1DIV2PI), angle), rounding);
+        quotient = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(quotient));
+        __m256 y = _mm256_sub_ps(angle, _mm256_mul_ps(_mm256_set1_ps(XM_2PI), quotient));
+
+        __m256 above = _mm256_cmp_ps(y, halfPi, _CMP_GT_OQ);
+        __m256 below = _mm256_cmp_ps(y, _mm256_sub_ps(zero, halfPi), _CMP_LT_OQ);
+
+        y = SelectAVX(SelectAVX(y, _mm256_sub_ps(pi, y), above), _mm256_sub_ps(_mm256_sub_ps(zero, pi), y), below);
+
+        __m256 sign = SelectAVX(one, _mm256_set1_ps(-1.0f), _mm256_or_ps(above, below));
+        __m256 y2 = _mm256_mul_ps(y, y);
+
+        __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-2.3889859e-08f), y2), _mm256_set1_ps(2.7525562e-06f));
+        s = _mm256_add_ps(_mm256_mul_ps(s, y2), _mm256_set1_ps(-0.00019840874f));
+        s = _mm256_add_ps(_mm256_mul_ps(s, y2), _mm256_set1_ps(0.0083333310f));
+        s = _mm256_add_ps(_mm256_mul_ps(s, y2), _mm256_set1_ps(-0.16666667f));
+        *sin = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s, y2), one), y);
+
+        __m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-2.6051615e-07f), y2), _mm256_set1_ps(2.4760495e-05f));
+        c = _mm256_add_ps(_mm256_mul_ps(c, y2), _mm256_set1_ps(-0.0013888378f));
+        c = _mm256_add_ps(_mm256_mul_ps(c, y2), _mm256_set1_ps(0.041666638f));
+        c = _mm256_add_ps(_mm256_mul_ps(c, y2), _mm256_set1_ps(-0.5f));
+        *cos = _mm256_mul_ps(sign, _mm256_add_ps(_mm256_mul_ps(c, y2), one));
+    }
+
+
+    // Transposes an 8x8 matrix held as eight rows.
+    inline void TransposeAVX(_Inout_updates_(8) __m256* rows)
+    {
+        __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+        __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+        __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+        __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+        __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+        __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+        __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+        __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+
+        __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        rows[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+        rows[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+        rows[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+        rows[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+        rows[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+        rows[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+        rows[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+        rows[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+    }
+}
+
+
+// Eight-wide version of RenderFourSprites, for CPUs with AVX.
+_Use_decl_annotations_
+void XM_CALLCONV Internal::RenderEightSpritesAVX(SpriteInfo const* const* sprites,
+    VertexPositionColorTexture* vertices,
+    FXMVECTOR textureSize,
+    FXMVECTOR inverseTextureSize)
+{
+    auto loadTransposed = [sprites](XMFLOAT4A const SpriteInfo::* field, _Out_writes_(4) __m256* rows)
+    {
+        __m128 low[4];
+        __m128 high[4];
+
+        for (size_t j = 0; j < 4; j++)
+        {
+            low[j] = _mm_load_ps(&(sprites[j]->*field).x);
+            high[j] = _mm_load_ps(&(sprites[j + 4]->*field).x);
+        }
+
+        _MM_TRANSPOSE4_PS(low[0], low[1], low[2], low[3]);
+        _MM_TRANSPOSE4_PS(high[0], high[1], high[2], high[3]);
+
+        for (size_t j = 0; j < 4; j++)
+        {
+            rows[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(low[j]), high[j], 1);
+        }
+    };
+
+    __m256 source[4];
+    __m256 destination[4];
+    __m256 color[4];
+    __m256 originRotationDepth[4];
+
+    loadTransposed(&SpriteInfo::source, source);
+    loadTransposed(&SpriteInfo::destination, destination);
+    loadTransposed(&SpriteInfo::color, color);
+    loadTransposed(&SpriteInfo::originRotationDepth, originRotationDepth);
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    // AVX has no 256-bit integer operations, so the flags are tested in two halves.
+    __m128i flagsLow = _mm_setr_epi32(sprites[0]->flags, sprites[1]->flags, sprites[2]->flags, sprites[3]->flags);
+    __m128i flagsHigh = _mm_setr_epi32(sprites[4]->flags, sprites[5]->flags, sprites[6]->flags, sprites[7]->flags);
+
+    auto flagMask = [&flagsLow, &flagsHigh](int flag) -> __m256
+    {
+        __m128i bit = _mm_set1_epi32(flag);
+        __m128i low = _mm_cmpeq_epi32(_mm_and_si128(flagsLow, bit), bit);
+        __m128i high = _mm_cmpeq_epi32(_mm_and_si128(flagsHigh, bit), bit);
+
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_castsi128_ps(low)), _mm_castsi128_ps(high), 1);
+    };
+
+    __m256 texelMask = flagMask(SpriteInfo::SourceInTexels);
+    __m256 pixelMask = flagMask(SpriteInfo::DestSizeInPixels);
+
+    __m256 textureWidth = _mm256_set1_ps(XMVectorGetX(textureSize));
+    __m256 textureHeight = _mm256_set1_ps(XMVectorGetY(textureSize));
+    __m256 inverseWidth = _mm256_set1_ps(XMVectorGetX(inverseTextureSize));
+    __m256 inverseHeight = _mm256_set1_ps(XMVectorGetY(inverseTextureSize));
+    __m256 epsilon = _mm256_set1_ps(g_XMEpsilon.f[0]);
+
+    __m256 originX = _mm256_div_ps(originRotationDepth[0], SelectAVX(source[2], epsilon, _mm256_cmp_ps(source[2], zero, _CMP_EQ_OQ)));
+    __m256 originY = _mm256_div_ps(originRotationDepth[1], SelectAVX(source[3], epsilon, _mm256_cmp_ps(source[3], zero, _CMP_EQ_OQ)));
+
+    __m256 sourceX = SelectAVX(source[0], _mm256_mul_ps(source[0], inverseWidth), texelMask);
+    __m256 sourceY = SelectAVX(source[1], _mm256_mul_ps(source[1], inverseHeight), texelMask);
+    __m256 sourceWidth = SelectAVX(source[2], _mm256_mul_ps(source[2], inverseWidth), texelMask);
+    __m256 sourceHeight = SelectAVX(source[3], _mm256_mul_ps(source[3], inverseHeight), texelMask);
+
+    originX = SelectAVX(_mm256_mul_ps(originX, inverseWidth), originX, texelMask);
+    originY = SelectAVX(_mm256_mul_ps(originY, inverseHeight), originY, texelMask);
+
+    __m256 destinationWidth = SelectAVX(_mm256_mul_ps(destination[2], textureWidth), destination[2], pixelMask);
+    __m256 destinationHeight = SelectAVX(_mm256_mul_ps(destination[3], textureHeight), destination[3], pixelMask);
+
+    __m256 rotation = originRotationDepth[2];
+    __m256 notRotated = _mm256_cmp_ps(rotation, zero, _CMP_EQ_OQ);
+
+    __m256 sin = zero;
+    __m256 cos = one;
+    __m256 negativeSin = zero;
+
+    if (_mm256_movemask_ps(notRotated) != 0xFF)
+    {
+        SpriteSinCosAVX(rotation, &sin, &cos);
+
+        negativeSin = SelectAVX(_mm256_sub_ps(zero, sin), zero, notRotated);
+
+        sin = SelectAVX(sin, zero, notRotated);
+        cos = SelectAVX(cos, one, notRotated);
+    }
+
+    __m256 leftU = _mm256_and_ps(flagMask(SpriteInfo::FlipHorizontally), one);
+    __m256 rightU = _mm256_sub_ps(one, leftU);
+    __m256 topV = _mm256_and_ps(flagMask(SpriteInfo::FlipVertically), one);
+    __m256 bottomV = _mm256_sub_ps(one, topV);
+
+    // Each transposed row is the first eight floats of one vertex: position, color and u.
+    __m256 rows[VerticesPerSprite][8];
+    float textureV[VerticesPerSprite][8];
+
+    for (size_t i = 0; i < VerticesPerSprite; i++)
+    {
+        __m256 cornerX = (i & 1) ? one : zero;
+        __m256 cornerY = (i & 2) ? one : zero;
+
+        __m256 cornerOffsetX = _mm256_mul_ps(_mm256_sub_ps(cornerX, originX), destinationWidth);
+        __m256 cornerOffsetY = _mm256_mul_ps(_mm256_sub_ps(cornerY, originY), destinationHeight);
+
+        __m256 positionX = _mm256_add_ps(_mm256_mul_ps(cornerOffsetX, cos), destination[0]);
+        __m256 positionY = _mm256_add_ps(_mm256_mul_ps(cornerOffsetX, sin), destination[1]);
+
+        rows[i][0] = _mm256_add_ps(_mm256_mul_ps(cornerOffsetY, negativeSin), positionX);
+        rows[i][1] = _mm256_add_ps(_mm256_mul_ps(cornerOffsetY, cos), positionY);
+        rows[i][2] = originRotationDepth[3];
+        rows[i][3] = color[0];
+        rows[i][4] = color[1];
+        rows[i][5] = color[2];
+        rows[i][6] = color[3];
+        rows[i][7] = _mm256_add_ps(_mm256_mul_ps((i & 1) ? rightU : leftU, sourceWidth), sourceX);
+
+        TransposeAVX(rows[i]);
+
+        _mm256_storeu_ps(textureV[i], _mm256_add_ps(_mm256_mul_ps((i & 2) ? bottomV : topV, sourceHeight), sourceY));
+    }
+
+    for (size_t j = 0; j < 8; j++)
+    {
+        for (size_t i = 0; i < VerticesPerSprite; i++, vertices++)
+        {
+            _mm256_storeu_ps(&vertices->position.x, rows[i][j]);
+
+            vertices->textureCoordinate.y = textureV[i][j];
+        }
+    }
+
+    // Avoid the penalty for going from AVX back to SSE code with dirty upper halves.
+    _mm256_zeroupper();
+}
+
+#endif
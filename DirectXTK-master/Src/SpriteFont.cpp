@@ -14,6 +14,8 @@
 #include "pch.h"
 
 #include <algorithm>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include "SpriteFont.h"
@@ -33,18 +35,75 @@ public:
     Impl(_In_ ID3D11ShaderResourceView* texture, _In_reads_(glyphCount) Glyph const* glyphs, _In_ size_t glyphCount, _In_ float lineSpacing);
 
     Glyph const* FindGlyph(wchar_t character) const;
+    Glyph const* LookupGlyph(wchar_t character) const;
 
     void SetDefaultCharacter(wchar_t character);
+    void SetLineSpacing(float spacing);
 
     template<typename TAction>
     void ForEachGlyph(_In_z_ wchar_t const* text, TAction action) const;
 
+    XMVECTOR MeasureString(_In_z_ wchar_t const* text) const;
+
 
     // Fields.
     ComPtr<ID3D11ShaderResourceView> texture;
     std::vector<Glyph> glyphs;
     Glyph const* defaultGlyph;
     float lineSpacing;
+
+private:
+    // Glyphs for characters up to U+FFFF are found through a two level table, one page
+    // per block of 256 characters. Blocks with no glyphs all share the empty page 0.
+    static const size_t GlyphPageSize = 256;
+
+    // Layouts are cached in a small set-associative table keyed by a hash of the text. A
+    // text is only cached when it misses twice in a row within its set, so strings drawn
+    // once don't evict ones drawn every frame. Longer strings are never cached.
+    static const size_t LayoutSetCount = 256;
+    static const size_t LayoutWays = 2;
+    static const size_t MaxLayoutLength = 512;
+
+    struct LayoutGlyph
+    {
+        Glyph const* glyph;
+        float x;
+        float y;
+        float advance;
+    };
+
+    struct Layout
+    {
+        uint64_t hash;
+        std::wstring text;
+        std::vector<LayoutGlyph> glyphs;
+        XMFLOAT2 size;
+    };
+
+    // Most recently used first, plus the hash of the last text that missed.
+    struct LayoutSet
+    {
+        LayoutSet() : candidate(0) { }
+
+        std::shared_ptr<const Layout> layouts[LayoutWays];
+        uint64_t candidate;
+    };
+
+    void CreateGlyphTable();
+
+    template<typename TAction>
+    void LayoutGlyphs(_In_z_ wchar_t const* text, TAction action) const;
+
+    XMVECTOR XM_CALLCONV MeasureGlyph(FXMVECTOR result, Glyph const* glyph, float x, float y) const;
+
+    std::shared_ptr<const Layout> FindLayout(_In_z_ wchar_t const* text) const;
+    void ClearLayouts();
+
+    uint16_t glyphPageMap[0x10000 / GlyphPageSize];
+    std::vector<Glyph const*> glyphPages;
+
+    mutable std::mutex layoutMutex;
+    mutable LayoutSet layoutSets[LayoutSetCount];
 };
 
 
@@ -94,6 +153,8 @@ SpriteFont::Impl::Impl(_In_ ID3D11Device* device, _In_ BinaryReader* reader, boo
 
     glyphs.assign(glyphData, glyphData + glyphCount);
 
+    CreateGlyphTable();
+
     // Read font properties.
     lineSpacing = reader->Read<float>();
 
@@ -143,19 +204,75 @@ SpriteFont::Impl::Impl(ID3D11ShaderResourceView* texture, Glyph const* glyphs, s
     {
         throw std::exception("Glyphs must be in ascending codepoint order");
     }
+
+    CreateGlyphTable();
 }
 
 
-// Looks up the requested glyph, falling back to the default character if it is not in the font.
-SpriteFont::Glyph const* SpriteFont::Impl::FindGlyph(wchar_t character) const
+// Fills in the page table used by LookupGlyph.
+void SpriteFont::Impl::CreateGlyphTable()
+{
+    std::fill(std::begin(glyphPageMap), std::end(glyphPageMap), uint16_t(0));
+
+    glyphPages.assign(GlyphPageSize, nullptr);
+
+    for (auto& glyph : glyphs)
+    {
+        // Characters outside the table are binary searched instead.
+        if (glyph.Character > 0xFFFF)
+            continue;
+
+        auto& page = glyphPageMap[glyph.Character / GlyphPageSize];
+
+        if (!page)
+        {
+            page = static_cast<uint16_t>(glyphPages.size() / GlyphPageSize);
+
+            glyphPages.resize(glyphPages.size() + GlyphPageSize, nullptr);
+        }
+
+        auto& entry = glyphPages[page * GlyphPageSize + glyph.Character % GlyphPageSize];
+
+        // Keep the first of any duplicates, as the binary search would.
+        if (!entry)
+        {
+            entry = &glyph;
+        }
+    }
+}
+
+
+// Looks up the requested glyph, returning null if it is not in the font.
+inline SpriteFont::Glyph const* SpriteFont::Impl::LookupGlyph(wchar_t character) const
 {
+    auto code = static_cast<uint32_t>(character);
+
+    if (code <= 0xFFFF)
+    {
+        return glyphPages[glyphPageMap[code / GlyphPageSize] * GlyphPageSize + code % GlyphPageSize];
+    }
+
     auto glyph = std::lower_bound(glyphs.begin(), glyphs.end(), character);
 
-    if (glyph != glyphs.end() && glyph->Character == character)
+    if (glyph != glyphs.end() && glyph->Character == code)
     {
         return &*glyph;
     }
 
+    return nullptr;
+}
+
+
+// Looks up the requested glyph, falling back to the default character if it is not in the font.
+SpriteFont::Glyph const* SpriteFont::Impl::FindGlyph(wchar_t character) const
+{
+    auto glyph = LookupGlyph(character);
+
+    if (glyph)
+    {
+        return glyph;
+    }
+
     if (defaultGlyph)
     {
         return defaultGlyph;
@@ -175,12 +292,66 @@ void SpriteFont::Impl::SetDefaultCharacter(wchar_t character)
     {
         defaultGlyph = FindGlyph(character);
     }
+
+    ClearLayouts();
+}
+
+
+// Changes the distance between lines.
+void SpriteFont::Impl::SetLineSpacing(float spacing)
+{
+    lineSpacing = spacing;
+
+    ClearLayouts();
 }
 
 
 // The core glyph layout algorithm, shared between DrawString and MeasureString.
 template<typename TAction>
 void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action) const
+{
+    auto layout = FindLayout(text);
+
+    if (layout)
+    {
+        for (auto& it : layout->glyphs)
+        {
+            action(it.glyph, it.x, it.y, it.advance);
+        }
+    }
+    else
+    {
+        LayoutGlyphs(text, action);
+    }
+}
+
+
+// Returns the size of the text, as the maximum extent of every glyph.
+XMVECTOR SpriteFont::Impl::MeasureString(_In_z_ wchar_t const* text) const
+{
+    auto layout = FindLayout(text);
+
+    if (layout)
+    {
+        return XMLoadFloat2(&layout->size);
+    }
+
+    XMVECTOR result = XMVectorZero();
+
+    LayoutGlyphs(text, [&](Glyph const* glyph, float x, float y, float advance)
+    {
+        UNREFERENCED_PARAMETER(advance);
+
+        result = MeasureGlyph(result, glyph, x, y);
+    });
+
+    return result;
+}
+
+
+// Positions each glyph of the text in turn.
+template<typename TAction>
+void SpriteFont::Impl::LayoutGlyphs(_In_z_ wchar_t const* text, TAction action) const
 {
     float x = 0;
     float y = 0;
@@ -226,6 +397,106 @@ void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action)
 }
 
 
+// Extends a MeasureString result to cover one glyph.
+XMVECTOR XM_CALLCONV SpriteFont::Impl::MeasureGlyph(FXMVECTOR result, Glyph const* glyph, float x, float y) const
+{
+    float w = (float)(glyph->Subrect.right - glyph->Subrect.left);
+    float h = (float)(glyph->Subrect.bottom - glyph->Subrect.top) + glyph->YOffset;
+
+    h = std::max(h, lineSpacing);
+
+    return XMVectorMax(result, XMVectorSet(x + w, y + h, 0, 0));
+}
+
+
+// Returns the cached layout of the text, laying it out now if it was also the last text
+// in its set to miss. Returns null if the text should be laid out without caching.
+std::shared_ptr<const SpriteFont::Impl::Layout> SpriteFont::Impl::FindLayout(_In_z_ wchar_t const* text) const
+{
+    // FNV-1a of the text.
+    uint64_t hash = 14695981039346656037ull;
+    size_t length = 0;
+
+    for (; text[length]; length++)
+    {
+        if (length == MaxLayoutLength)
+            return nullptr;
+
+        hash = (hash ^ static_cast<uint64_t>(text[length])) * 1099511628211ull;
+    }
+
+    LayoutSet& set = layoutSets[(hash >> 32) % LayoutSetCount];
+
+    {
+        std::lock_guard<std::mutex> lock(layoutMutex);
+
+        for (size_t i = 0; i < LayoutWays; i++)
+        {
+            auto& layout = set.layouts[i];
+
+            if (layout && layout->hash == hash && layout->text.compare(0, std::wstring::npos, text, length) == 0)
+            {
+                std::rotate(set.layouts, set.layouts + i, set.layouts + i + 1);
+
+                return set.layouts[0];
+            }
+        }
+
+        // Text seen only once costs no more than the hash.
+        if (set.candidate != hash)
+        {
+            set.candidate = hash;
+
+            return nullptr;
+        }
+    }
+
+    auto layout = std::make_shared<Layout>();
+
+    layout->hash = hash;
+    layout->text.assign(text, length);
+
+    XMVECTOR size = XMVectorZero();
+
+    LayoutGlyphs(text, [&](Glyph const* glyph, float x, float y, float advance)
+    {
+        LayoutGlyph layoutGlyph = { glyph, x, y, advance };
+
+        layout->glyphs.push_back(layoutGlyph);
+
+        size = MeasureGlyph(size, glyph, x, y);
+    });
+
+    XMStoreFloat2(&layout->size, size);
+
+    std::lock_guard<std::mutex> lock(layoutMutex);
+
+    std::move_backward(set.layouts, set.layouts + LayoutWays - 1, set.layouts + LayoutWays);
+
+    set.layouts[0] = layout;
+    set.candidate = 0;
+
+    return layout;
+}
+
+
+// Drops every cached layout, after a change that affects them.
+void SpriteFont::Impl::ClearLayouts()
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+
+    for (auto& set : layoutSets)
+    {
+        for (auto& layout : set.layouts)
+        {
+            layout.reset();
+        }
+
+        set.candidate = 0;
+    }
+}
+
+
 // Construct from a binary file created by the MakeSpriteFont utility.
 SpriteFont::SpriteFont(_In_ ID3D11Device* device, _In_z_ wchar_t const* fileName, bool forceSRGB)
 {
@@ -348,21 +619,7 @@ void XM_CALLCONV SpriteFont::DrawString(_In_ SpriteBatch* spriteBatch, _In_z_ wc
 
 XMVECTOR XM_CALLCONV SpriteFont::MeasureString(_In_z_ wchar_t const* text) const
 {
-    XMVECTOR result = XMVectorZero();
-
-    pImpl->ForEachGlyph(text, [&](Glyph const* glyph, float x, float y, float advance)
-    {
-        UNREFERENCED_PARAMETER(advance);
-
-        float w = (float)(glyph->Subrect.right - glyph->Subrect.left);
-        float h = (float)(glyph->Subrect.bottom - glyph->Subrect.top) + glyph->YOffset;
-
-        h = std::max(h, pImpl->lineSpacing);
-
-        result = XMVectorMax(result, XMVectorSet(x + w, y + h, 0, 0));
-    });
-
-    return result;
+    return pImpl->MeasureString(text);
 }
 
 
@@ -422,7 +679,7 @@ float SpriteFont::GetLineSpacing() const
 
 void SpriteFont::SetLineSpacing(float spacing)
 {
-    pImpl->lineSpacing = spacing;
+    pImpl->SetLineSpacing(spacing);
 }
 
 
@@ -441,7 +698,7 @@ void SpriteFont::SetDefaultCharacter(wchar_t character)
 
 bool SpriteFont::ContainsCharacter(wchar_t character) const
 {
-    return std::binary_search(pImpl->glyphs.begin(), pImpl->glyphs.end(), character);
+    return pImpl->LookupGlyph(character) != nullptr;
 }
 
 
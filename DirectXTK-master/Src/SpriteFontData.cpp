@@ -0,0 +1,1362 @@
+//--------------------------------------------------------------------------------------
+// File: SpriteFontData.cpp
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+// Built without the precompiled header so it does not depend on Direct3D.
+#include "SpriteFontData.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+
+namespace
+{
+    const char c_SpriteFontMagic[] = "DXTKfont";
+
+    // RGBA (255, 0, 255, 255), red in the low byte.
+    const uint32_t c_MarkerColor = 0xFFFF00FF;
+
+    const uint32_t c_RgbMask = 0x00FFFFFF;
+
+    // Sheet sizes are kept to multiples of this so the sheet can be block compressed.
+    const int32_t c_BlockSize = 4;
+
+    // Each glyph is packed with a one pixel border, so filtering never reads its
+    // neighbors.
+    const int32_t c_Border = 1;
+
+    inline uint32_t GetAlpha(uint32_t pixel)
+    {
+        return pixel >> 24;
+    }
+
+    // Runs fn(i) for every i in [0, count) on up to threadCount threads, handing out one
+    // index at a time.
+    template<typename TFn>
+    void ParallelFor(size_t count, size_t threadCount, TFn fn)
+    {
+        threadCount = std::max<size_t>(1, std::min(threadCount, count));
+
+        std::atomic<size_t> next(0);
+
+        auto run = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                fn(i);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t j = 1; j < threadCount; ++j)
+            threads.emplace_back(run);
+
+        run();
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Bitmap import and cropping, as MakeSpriteFont's BitmapImporter and GlyphCropper.
+
+    struct Box
+    {
+        int32_t     x;
+        int32_t     y;
+        int32_t     w;
+        int32_t     h;
+    };
+
+    struct BakedGlyph
+    {
+        uint32_t    character;
+        Box         source;
+        float       xOffset;
+        float       yOffset;
+        float       xAdvance;
+    };
+
+    // Source pixels, with the brightness of each taken as its alpha for bitmaps that
+    // have no transparency.
+    class SourceBitmap
+    {
+    public:
+        SourceBitmap(const uint32_t* pixels, uint32_t width, uint32_t height) :
+            mPixels(pixels),
+            mWidth(int32_t(width)),
+            mHeight(int32_t(height)),
+            mGreyToAlpha(false)
+        {
+        }
+
+        int32_t GetWidth() const { return mWidth; }
+        int32_t GetHeight() const { return mHeight; }
+
+        bool IsMarker(int32_t x, int32_t y) const
+        {
+            return mPixels[size_t(y) * mWidth + x] == c_MarkerColor;
+        }
+
+        uint32_t GetPixel(int32_t x, int32_t y) const
+        {
+            uint32_t pixel = mPixels[size_t(y) * mWidth + x];
+
+            if (mGreyToAlpha)
+            {
+                uint32_t alpha = ((pixel & 0xFF) + ((pixel >> 8) & 0xFF) + ((pixel >> 16) & 0xFF)) / 3;
+
+                pixel = (alpha << 24) | c_RgbMask;
+            }
+
+            return pixel;
+        }
+
+        void SetGreyToAlpha(bool value) { mGreyToAlpha = value; }
+
+        bool IsTransparent(const Box& box) const
+        {
+            for (int32_t y = box.y; y < box.y + box.h; ++y)
+            {
+                for (int32_t x = box.x; x < box.x + box.w; ++x)
+                {
+                    if (GetAlpha(GetPixel(x, y)))
+                        return false;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        const uint32_t* mPixels;
+        int32_t         mWidth;
+        int32_t         mHeight;
+        bool            mGreyToAlpha;
+    };
+
+    // Finds the glyphs surrounded by the marker color, top left to bottom right: the top
+    // left corner of each is a pixel that is not the marker, with the marker to its left
+    // and above it.
+    std::vector<Box> FindGlyphs(const SourceBitmap& bitmap, size_t threadCount)
+    {
+        int32_t width = bitmap.GetWidth();
+        int32_t height = bitmap.GetHeight();
+
+        std::vector<std::vector<Box>> rows(height);
+
+        ParallelFor(size_t(std::max(height - 1, 0)), threadCount, [&](size_t i)
+        {
+            int32_t y = int32_t(i) + 1;
+
+            for (int32_t x = 1; x < width; ++x)
+            {
+                if (!bitmap.IsMarker(x, y) && bitmap.IsMarker(x - 1, y) && bitmap.IsMarker(x, y - 1))
+                {
+                    Box box = { x, y, 1, 1 };
+
+                    while ((x + box.w < width) && !bitmap.IsMarker(x + box.w, y))
+                        box.w++;
+
+                    while ((y + box.h < height) && !bitmap.IsMarker(x, y + box.h))
+                        box.h++;
+
+                    rows[y].push_back(box);
+                }
+            }
+        });
+
+        std::vector<Box> boxes;
+        for (auto& row : rows)
+            boxes.insert(boxes.end(), row.begin(), row.end());
+
+        return boxes;
+    }
+
+    // Characters of the glyphs in the order they are found, without repeats.
+    std::vector<uint32_t> FlattenRegions(const std::vector<SpriteFontData::CharacterRegion>& regions)
+    {
+        std::vector<uint32_t> characters;
+
+        if (regions.empty())
+        {
+            for (uint32_t c = ' '; c <= '~'; ++c)
+                characters.push_back(c);
+
+            return characters;
+        }
+
+        std::vector<bool> seen;
+
+        for (auto& region : regions)
+        {
+            if (region.first > region.last || region.last > 0x10FFFF)
+                throw std::invalid_argument("Invalid character region");
+
+            if (seen.size() <= region.last)
+                seen.resize(region.last + 1);
+
+            for (uint32_t c = region.first; c <= region.last; ++c)
+            {
+                if (!seen[c])
+                {
+                    seen[c] = true;
+                    characters.push_back(c);
+                }
+            }
+        }
+
+        return characters;
+    }
+
+    // Trims fully transparent rows and columns from each side of a glyph, keeping at
+    // least one pixel, and adjusts its offsets to leave it drawn in the same place.
+    void CropGlyph(const SourceBitmap& bitmap, BakedGlyph& glyph)
+    {
+        Box& box = glyph.source;
+
+        while (box.h > 1 && bitmap.IsTransparent(Box{ box.x, box.y, box.w, 1 }))
+        {
+            box.y++;
+            box.h--;
+            glyph.yOffset++;
+        }
+
+        while (box.h > 1 && bitmap.IsTransparent(Box{ box.x, box.y + box.h - 1, box.w, 1 }))
+        {
+            box.h--;
+        }
+
+        while (box.w > 1 && bitmap.IsTransparent(Box{ box.x, box.y, 1, box.h }))
+        {
+            box.x++;
+            box.w--;
+            glyph.xOffset++;
+        }
+
+        while (box.w > 1 && bitmap.IsTransparent(Box{ box.x + box.w - 1, box.y, 1, box.h }))
+        {
+            box.w--;
+            glyph.xAdvance++;
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Packing. Glyphs are placed on a strip of fixed width and unbounded height, largest
+    // first; the height used is rounded up to a multiple of the block size afterwards.
+
+    struct Size
+    {
+        int32_t     w;
+        int32_t     h;
+    };
+
+    struct Point
+    {
+        int32_t     x;
+        int32_t     y;
+    };
+
+    inline bool IsContainedIn(const Box& a, const Box& b)
+    {
+        return a.x >= b.x && a.y >= b.y && a.x + a.w <= b.x + b.w && a.y + a.h <= b.y + b.h;
+    }
+
+    // MaxRects (Jylanki 2010): keeps every maximal free rectangle, so later glyphs can
+    // fill holes left anywhere. Each glyph goes where its top edge is lowest, then
+    // leftmost.
+    class MaxRectsPacker
+    {
+    public:
+        MaxRectsPacker(int32_t width, int32_t height) :
+            mNewFreeLastSize(0)
+        {
+            Box all = { 0, 0, width, height };
+            mFree.push_back(all);
+        }
+
+        bool Insert(const Size& size, Point& position)
+        {
+            const Box* best = nullptr;
+            int64_t bestY = INT64_MAX;
+            int32_t bestX = INT32_MAX;
+
+            for (auto& free : mFree)
+            {
+                if (free.w >= size.w && free.h >= size.h)
+                {
+                    int64_t y = int64_t(free.y) + size.h;
+
+                    if (y < bestY || (y == bestY && free.x < bestX))
+                    {
+                        best = &free;
+                        bestY = y;
+                        bestX = free.x;
+                    }
+                }
+            }
+
+            if (!best)
+                return false;
+
+            Box used = { best->x, best->y, size.w, size.h };
+
+            for (size_t i = 0; i < mFree.size();)
+            {
+                if (SplitFreeNode(mFree[i], used))
+                {
+                    mFree[i] = mFree.back();
+                    mFree.pop_back();
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+
+            PruneFreeList();
+
+            position.x = used.x;
+            position.y = used.y;
+            return true;
+        }
+
+    private:
+        // Replaces a free rectangle the glyph overlaps with the parts of it on each side.
+        bool SplitFreeNode(const Box& free, const Box& used)
+        {
+            if (used.x >= free.x + free.w || used.x + used.w <= free.x ||
+                used.y >= free.y + free.h || used.y + used.h <= free.y)
+            {
+                return false;
+            }
+
+            mNewFreeLastSize = mNewFree.size();
+
+            if (used.y > free.y && used.y < free.y + free.h)
+                InsertNewFreeRect(Box{ free.x, free.y, free.w, used.y - free.y });
+
+            if (used.y + used.h < free.y + free.h)
+                InsertNewFreeRect(Box{ free.x, used.y + used.h, free.w, free.y + free.h - (used.y + used.h) });
+
+            if (used.x > free.x && used.x < free.x + free.w)
+                InsertNewFreeRect(Box{ free.x, free.y, used.x - free.x, free.h });
+
+            if (used.x + used.w < free.x + free.w)
+                InsertNewFreeRect(Box{ used.x + used.w, free.y, free.x + free.w - (used.x + used.w), free.h });
+
+            return true;
+        }
+
+        // New rectangles are only checked against the ones split from other free
+        // rectangles; those from the same one cannot contain each other.
+        void InsertNewFreeRect(const Box& box)
+        {
+            for (size_t i = 0; i < mNewFreeLastSize;)
+            {
+                if (IsContainedIn(box, mNewFree[i]))
+                    return;
+
+                if (IsContainedIn(mNewFree[i], box))
+                {
+                    mNewFree[i] = mNewFree[--mNewFreeLastSize];
+                    mNewFree[mNewFreeLastSize] = mNewFree.back();
+                    mNewFree.pop_back();
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+
+            mNewFree.push_back(box);
+        }
+
+        // Free rectangles only shrink, so an old one is never inside a new one.
+        void PruneFreeList()
+        {
+            for (auto& free : mFree)
+            {
+                for (size_t j = 0; j < mNewFree.size();)
+                {
+                    if (IsContainedIn(mNewFree[j], free))
+                    {
+                        mNewFree[j] = mNewFree.back();
+                        mNewFree.pop_back();
+                    }
+                    else
+                    {
+                        ++j;
+                    }
+                }
+            }
+
+            mFree.insert(mFree.end(), mNewFree.begin(), mNewFree.end());
+            mNewFree.clear();
+        }
+
+        std::vector<Box>    mFree;
+        std::vector<Box>    mNewFree;
+        size_t              mNewFreeLastSize;
+    };
+
+    // Skyline: keeps only the top edge of what has been placed, so it is fast but never
+    // fills holes below it. Glyphs go where their top edge is lowest or, with minWaste,
+    // where they leave the least space below them.
+    class SkylinePacker
+    {
+    public:
+        SkylinePacker(int32_t width, bool minWaste) :
+            mWidth(width),
+            mMinWaste(minWaste)
+        {
+            Segment all = { 0, 0, width };
+            mSkyline.push_back(all);
+        }
+
+        bool Insert(const Size& size, Point& position)
+        {
+            size_t bestIndex = SIZE_MAX;
+            int64_t bestScore1 = INT64_MAX;
+            int64_t bestScore2 = INT64_MAX;
+            int32_t bestY = 0;
+
+            for (size_t i = 0; i < mSkyline.size(); ++i)
+            {
+                int32_t y;
+                int64_t waste;
+                if (!Fit(i, size.w, y, waste))
+                    continue;
+
+                int64_t top = int64_t(y) + size.h;
+                int64_t score1 = mMinWaste ? waste : top;
+                int64_t score2 = mMinWaste ? top : mSkyline[i].w;
+
+                if (score1 < bestScore1 || (score1 == bestScore1 && score2 < bestScore2))
+                {
+                    bestIndex = i;
+                    bestScore1 = score1;
+                    bestScore2 = score2;
+                    bestY = y;
+                }
+            }
+
+            if (bestIndex == SIZE_MAX)
+                return false;
+
+            position.x = mSkyline[bestIndex].x;
+            position.y = bestY;
+
+            AddLevel(bestIndex, position.x, bestY + size.h, size.w);
+            return true;
+        }
+
+    private:
+        struct Segment
+        {
+            int32_t     x;
+            int32_t     y;
+            int32_t     w;
+        };
+
+        // Height a glyph of the given width would sit at from the start of segment i,
+        // and the area left empty below it.
+        bool Fit(size_t i, int32_t w, int32_t& y, int64_t& waste) const
+        {
+            int32_t x = mSkyline[i].x;
+            if (x + w > mWidth)
+                return false;
+
+            // The skyline spans the whole width, so it runs at least to x + w.
+            size_t end = i;
+            y = mSkyline[i].y;
+            for (; end < mSkyline.size() && mSkyline[end].x < x + w; ++end)
+                y = std::max(y, mSkyline[end].y);
+
+            waste = 0;
+            for (size_t j = i; j < end; ++j)
+            {
+                int32_t covered = std::min(mSkyline[j].x + mSkyline[j].w, x + w) - mSkyline[j].x;
+                waste += int64_t(y - mSkyline[j].y) * covered;
+            }
+
+            return true;
+        }
+
+        void AddLevel(size_t i, int32_t x, int32_t y, int32_t w)
+        {
+            Segment level = { x, y, w };
+            mSkyline.insert(mSkyline.begin() + ptrdiff_t(i), level);
+
+            // Cut the segments the new one covers.
+            for (size_t j = i + 1; j < mSkyline.size();)
+            {
+                int32_t end = mSkyline[j - 1].x + mSkyline[j - 1].w;
+                if (mSkyline[j].x >= end)
+                    break;
+
+                int32_t shrink = end - mSkyline[j].x;
+                mSkyline[j].x += shrink;
+                mSkyline[j].w -= shrink;
+
+                if (mSkyline[j].w > 0)
+                    break;
+
+                mSkyline.erase(mSkyline.begin() + ptrdiff_t(j));
+            }
+
+            // Merge neighbors at the same height.
+            for (size_t j = 0; j + 1 < mSkyline.size();)
+            {
+                if (mSkyline[j].y == mSkyline[j + 1].y)
+                {
+                    mSkyline[j].w += mSkyline[j + 1].w;
+                    mSkyline.erase(mSkyline.begin() + ptrdiff_t(j + 1));
+                }
+                else
+                {
+                    ++j;
+                }
+            }
+        }
+
+        std::vector<Segment>    mSkyline;
+        int32_t                 mWidth;
+        bool                    mMinWaste;
+    };
+
+    enum PackHeuristic
+    {
+        PackHeuristic_MaxRectsBottomLeft,
+        PackHeuristic_SkylineBottomLeft,
+        PackHeuristic_SkylineMinWaste,
+        PackHeuristic_Count,
+    };
+
+    const char* const c_PackerNames[PackHeuristic_Count] =
+    {
+        "MaxRects bottom-left",
+        "skyline bottom-left",
+        "skyline min-waste",
+    };
+
+    struct PackResult
+    {
+        int32_t             width;
+        int32_t             height;
+        std::vector<Point>  positions;
+        bool                ok;
+    };
+
+    inline int32_t RoundUpToBlock(int64_t value)
+    {
+        return int32_t((value + c_BlockSize - 1) & ~int64_t(c_BlockSize - 1));
+    }
+
+    // Places sizes, in order, on a strip of the given width.
+    PackResult Pack(const std::vector<Size>& sizes, int32_t width, PackHeuristic heuristic)
+    {
+        PackResult result;
+        result.width = width;
+        result.height = 0;
+        result.positions.resize(sizes.size());
+        result.ok = false;
+
+        // Stacking every glyph in one column always fits.
+        int64_t stripHeight = 0;
+        for (auto& size : sizes)
+            stripHeight += size.h;
+
+        if (stripHeight > INT32_MAX / 2)
+            return result;
+
+        MaxRectsPacker maxRects(width, int32_t(stripHeight));
+        SkylinePacker skyline(width, heuristic == PackHeuristic_SkylineMinWaste);
+
+        int64_t height = 0;
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            Point& position = result.positions[i];
+
+            bool placed = (heuristic == PackHeuristic_MaxRectsBottomLeft)
+                ? maxRects.Insert(sizes[i], position)
+                : skyline.Insert(sizes[i], position);
+
+            if (!placed)
+                return result;
+
+            height = std::max(height, int64_t(position.y) + sizes[i].h);
+        }
+
+        if (height > INT32_MAX / 2)
+            return result;
+
+        result.height = RoundUpToBlock(height);
+        result.ok = true;
+        return result;
+    }
+
+    // Orders packed sheets by the power of two that bounds their larger side, then area.
+    std::pair<int64_t, int64_t> SheetRank(const PackResult& result)
+    {
+        int64_t limit = 1;
+        while (limit < std::max(result.width, result.height))
+            limit <<= 1;
+
+        return std::make_pair(limit, int64_t(result.width) * result.height);
+    }
+
+    // Same guess as MakeSpriteFont: a power of two about as wide as the square root of
+    // the glyph area, but always wide enough for the widest glyph and its border.
+    int32_t GuessOutputWidth(const std::vector<BakedGlyph>& glyphs)
+    {
+        int32_t maxWidth = 0;
+        double totalSize = 0;
+
+        for (auto& glyph : glyphs)
+        {
+            maxWidth = std::max(maxWidth, glyph.source.w);
+            totalSize += double(glyph.source.w) * glyph.source.h;
+        }
+
+        int64_t width = std::max(int64_t(sqrt(totalSize)), int64_t(maxWidth) + 2 * c_Border);
+
+        int64_t powerOfTwo = c_BlockSize;
+        while (powerOfTwo < width)
+            powerOfTwo <<= 1;
+
+        if (powerOfTwo > INT32_MAX / 2)
+            throw std::runtime_error("Glyphs are too large to pack");
+
+        return int32_t(powerOfTwo);
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Sprite sheet output, as MakeSpriteFont's GlyphPacker, BitmapUtils and
+    // SpriteFontWriter.
+
+    // Copies a glyph to the sheet and repeats its edge pixels, at zero alpha, into the
+    // border around it, so filtering a font with straight alpha picks up the right color.
+    void CopyGlyph(const SourceBitmap& source, const Box& from, uint32_t* sheet, uint32_t sheetWidth, int32_t x, int32_t y)
+    {
+        auto at = [=](int32_t px, int32_t py) -> uint32_t&
+        {
+            return sheet[size_t(py) * sheetWidth + px];
+        };
+
+        for (int32_t row = 0; row < from.h; ++row)
+        {
+            for (int32_t col = 0; col < from.w; ++col)
+            {
+                at(x + col, y + row) = source.GetPixel(from.x + col, from.y + row);
+            }
+        }
+
+        int32_t right = x + from.w;
+        int32_t bottom = y + from.h;
+
+        for (int32_t px = x; px < right; ++px)
+        {
+            at(px, y - 1) = at(px, y) & c_RgbMask;
+            at(px, bottom) = at(px, bottom - 1) & c_RgbMask;
+        }
+
+        for (int32_t py = y; py < bottom; ++py)
+        {
+            at(x - 1, py) = at(x, py) & c_RgbMask;
+            at(right, py) = at(right - 1, py) & c_RgbMask;
+        }
+
+        at(x - 1, y - 1) = at(x, y) & c_RgbMask;
+        at(right, y - 1) = at(right - 1, y) & c_RgbMask;
+        at(x - 1, bottom) = at(x, bottom - 1) & c_RgbMask;
+        at(right, bottom) = at(right - 1, bottom - 1) & c_RgbMask;
+    }
+
+    inline uint32_t Premultiply(uint32_t pixel)
+    {
+        uint32_t a = GetAlpha(pixel);
+        uint32_t r = (pixel & 0xFF) * a / 255;
+        uint32_t g = ((pixel >> 8) & 0xFF) * a / 255;
+        uint32_t b = ((pixel >> 16) & 0xFF) * a / 255;
+
+        return (a << 24) | (b << 16) | (g << 8) | r;
+    }
+
+    // A 4x4 block of a monochrome font as BC2. The end colors are fixed at white and
+    // black, so solid and empty pixels are exact and the two colors between match alpha
+    // values of the 4-bit alpha exactly; a generic compressor would trade those for a
+    // lower average error and leave the text blotchy.
+    void CompressMonoBlock(const uint32_t* pixels, uint32_t width, uint32_t blockX, uint32_t blockY, bool noPremultiply, uint8_t* block)
+    {
+        uint64_t alphaBits = 0;
+        uint32_t rgbBits = 0;
+
+        for (uint32_t y = 0; y < 4; ++y)
+        {
+            for (uint32_t x = 0; x < 4; ++x)
+            {
+                uint32_t value = GetAlpha(pixels[size_t(blockY + y) * width + blockX + x]);
+                uint32_t pixelIndex = y * 4 + x;
+                uint64_t alpha;
+                uint32_t rgb;
+
+                if (noPremultiply)
+                {
+                    // Straight alpha: the color is always white, with 4-bit alpha.
+                    alpha = value >> 4;
+                    rgb = 0;
+                }
+                else if (value < 256 / 6)
+                {
+                    alpha = 0;
+                    rgb = 1;
+                }
+                else if (value < 256 / 2)
+                {
+                    alpha = 5;
+                    rgb = 3;
+                }
+                else if (value < 256 * 5 / 6)
+                {
+                    alpha = 10;
+                    rgb = 2;
+                }
+                else
+                {
+                    alpha = 15;
+                    rgb = 0;
+                }
+
+                alphaBits |= alpha << (pixelIndex * 4);
+                rgbBits |= rgb << (pixelIndex * 2);
+            }
+        }
+
+        const uint16_t white = 0xFFFF;
+        const uint16_t black = 0;
+
+        memcpy(block, &alphaBits, sizeof(alphaBits));
+        memcpy(block + 8, &white, sizeof(white));
+        memcpy(block + 10, &black, sizeof(black));
+        memcpy(block + 12, &rgbBits, sizeof(rgbBits));
+    }
+
+    template<typename T>
+    void Append(std::vector<uint8_t>& data, const T& value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // .BMP files.
+
+    const uint16_t c_BmpMagic = 0x4D42;     // "BM"
+    const size_t c_BmpFileHeaderSize = 14;
+    const size_t c_BmpInfoHeaderSize = 40;
+    const size_t c_BmpV4HeaderSize = 108;
+
+    const uint32_t c_BiRgb = 0;
+    const uint32_t c_BiBitFields = 3;
+    const uint32_t c_BiAlphaBitFields = 6;
+
+    template<typename T>
+    T ReadAt(const uint8_t* data, size_t offset)
+    {
+        T value;
+        memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+
+    // Scales a channel selected by a bit mask to 8 bits.
+    class ChannelMask
+    {
+    public:
+        explicit ChannelMask(uint32_t mask) :
+            mMask(mask),
+            mShift(0),
+            mMax(0)
+        {
+            if (mask)
+            {
+                while (!(mask & 1))
+                {
+                    mask >>= 1;
+                    mShift++;
+                }
+
+                mMax = mask;
+            }
+        }
+
+        bool IsEmpty() const { return !mMask; }
+
+        uint32_t Read(uint32_t value) const
+        {
+            if (!mMask)
+                return 0;
+
+            return uint32_t(uint64_t((value & mMask) >> mShift) * 255 / mMax);
+        }
+
+    private:
+        uint32_t    mMask;
+        uint32_t    mShift;
+        uint32_t    mMax;
+    };
+}
+
+
+//======================================================================================
+// SpriteFontData
+//======================================================================================
+
+SpriteFontData::BakeOptions::BakeOptions() :
+    defaultCharacter(0),
+    lineSpacing(0),
+    characterSpacing(0),
+    textureFormat(TextureFormat_Auto),
+    noPremultiply(false),
+    fastPack(false),
+    threadCount(0)
+{
+}
+
+
+SpriteFontData::SpriteFontData() :
+    lineSpacing(0),
+    defaultCharacter(0),
+    textureFormat(TextureFormat_Rgba32),
+    premultiplied(true),
+    width(0),
+    height(0),
+    usedPixels(0),
+    packer(nullptr)
+{
+}
+
+
+SpriteFontData::SpriteFontData(SpriteFontData&& moveFrom) :
+    glyphs(std::move(moveFrom.glyphs)),
+    lineSpacing(moveFrom.lineSpacing),
+    defaultCharacter(moveFrom.defaultCharacter),
+    textureFormat(moveFrom.textureFormat),
+    premultiplied(moveFrom.premultiplied),
+    width(moveFrom.width),
+    height(moveFrom.height),
+    pixels(std::move(moveFrom.pixels)),
+    usedPixels(moveFrom.usedPixels),
+    packer(moveFrom.packer)
+{
+}
+
+
+SpriteFontData& SpriteFontData::operator= (SpriteFontData&& moveFrom)
+{
+    glyphs = std::move(moveFrom.glyphs);
+    lineSpacing = moveFrom.lineSpacing;
+    defaultCharacter = moveFrom.defaultCharacter;
+    textureFormat = moveFrom.textureFormat;
+    premultiplied = moveFrom.premultiplied;
+    width = moveFrom.width;
+    height = moveFrom.height;
+    pixels = std::move(moveFrom.pixels);
+    usedPixels = moveFrom.usedPixels;
+    packer = moveFrom.packer;
+    return *this;
+}
+
+
+SpriteFontData::~SpriteFontData()
+{
+}
+
+
+std::unique_ptr<SpriteFontData> SpriteFontData::BakeBitmap(const uint32_t* pixels, uint32_t width, uint32_t height, const BakeOptions& options)
+{
+    if (!pixels || !width || !height)
+        throw std::invalid_argument("Bitmap cannot be empty");
+
+    if (width > INT32_MAX / 2 || height > INT32_MAX / 2)
+        throw std::invalid_argument("Bitmap is too large");
+
+    size_t threadCount = options.threadCount;
+    if (!threadCount)
+        threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    SourceBitmap source(pixels, width, height);
+
+    // Split the bitmap into glyphs, numbered in the order the regions list them.
+    std::vector<Box> boxes = FindGlyphs(source, threadCount);
+    std::vector<uint32_t> characters = FlattenRegions(options.characterRegions);
+
+    std::vector<BakedGlyph> glyphs(boxes.size());
+    float lineSpacing = 0;
+    uint32_t character = 0;
+
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        character = (i < characters.size()) ? characters[i] : character + 1;
+
+        BakedGlyph& glyph = glyphs[i];
+        glyph.character = character;
+        glyph.source = boxes[i];
+        glyph.xOffset = 0;
+        glyph.yOffset = 0;
+        glyph.xAdvance = 0;
+
+        lineSpacing = std::max(lineSpacing, float(boxes[i].h));
+    }
+
+    // Without any transparency, brightness is alpha.
+    std::vector<uint8_t> opaqueRows(height);
+
+    ParallelFor(height, threadCount, [&](size_t y)
+    {
+        const uint32_t* row = pixels + y * width;
+
+        opaqueRows[y] = std::all_of(row, row + width, [](uint32_t pixel) { return GetAlpha(pixel) == 255; });
+    });
+
+    source.SetGreyToAlpha(std::all_of(opaqueRows.begin(), opaqueRows.end(), [](uint8_t opaque) { return opaque != 0; }));
+
+    std::stable_sort(glyphs.begin(), glyphs.end(), [](const BakedGlyph& a, const BakedGlyph& b)
+    {
+        return a.character < b.character;
+    });
+
+    if (glyphs.empty())
+        throw std::runtime_error("Font does not contain any glyphs");
+
+    if (options.defaultCharacter && !std::any_of(glyphs.begin(), glyphs.end(), [&](const BakedGlyph& glyph) { return glyph.character == options.defaultCharacter; }))
+        throw std::runtime_error("The default character is not part of this font");
+
+    ParallelFor(glyphs.size(), threadCount, [&](size_t i)
+    {
+        CropGlyph(source, glyphs[i]);
+    });
+
+    // Largest first: height dominates, then width, then character order.
+    std::vector<size_t> order(glyphs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        const int64_t heightWeight = 1024;
+
+        int64_t aSize = int64_t(glyphs[a].source.h) * heightWeight + glyphs[a].source.w;
+        int64_t bSize = int64_t(glyphs[b].source.h) * heightWeight + glyphs[b].source.w;
+
+        return aSize > bSize;
+    });
+
+    std::vector<Size> sizes(glyphs.size());
+    uint64_t usedPixels = 0;
+    int32_t maxFootprint = 0;
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        auto& box = glyphs[order[i]].source;
+
+        sizes[i].w = box.w + 2 * c_Border;
+        sizes[i].h = box.h + 2 * c_Border;
+
+        usedPixels += uint64_t(sizes[i].w) * uint64_t(sizes[i].h);
+        maxFootprint = std::max(maxFootprint, sizes[i].w);
+    }
+
+    // Try each packer on the guessed width, half of it and twice it. The sheet kept is
+    // the one that needs the lowest texture size limit, which is what decides the
+    // feature levels it loads on, then the smallest. Ties go to the earliest candidate,
+    // whatever finishes first.
+    int32_t guessedWidth = GuessOutputWidth(glyphs);
+
+    struct Candidate
+    {
+        int32_t         width;
+        PackHeuristic   heuristic;
+    };
+
+    std::vector<Candidate> candidates;
+
+    if (options.fastPack)
+    {
+        candidates.push_back(Candidate{ guessedWidth, PackHeuristic_SkylineBottomLeft });
+    }
+    else
+    {
+        const int32_t widths[] = { guessedWidth, guessedWidth / 2, guessedWidth * 2 };
+
+        for (int32_t candidateWidth : widths)
+        {
+            if (candidateWidth < maxFootprint || candidateWidth > INT32_MAX / 4)
+                continue;
+
+            for (int heuristic = 0; heuristic < PackHeuristic_Count; ++heuristic)
+                candidates.push_back(Candidate{ candidateWidth, PackHeuristic(heuristic) });
+        }
+    }
+
+    std::vector<PackResult> results(candidates.size());
+
+    ParallelFor(candidates.size(), threadCount, [&](size_t i)
+    {
+        results[i] = Pack(sizes, candidates[i].width, candidates[i].heuristic);
+    });
+
+    size_t best = SIZE_MAX;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if (!results[i].ok)
+            continue;
+
+        if (best == SIZE_MAX || SheetRank(results[i]) < SheetRank(results[best]))
+            best = i;
+    }
+
+    if (best == SIZE_MAX)
+        throw std::runtime_error("Glyphs are too large to pack");
+
+    const PackResult& packed = results[best];
+
+    auto font = std::make_unique<SpriteFontData>();
+
+    font->width = uint32_t(packed.width);
+    font->height = uint32_t(packed.height);
+    font->usedPixels = usedPixels;
+    font->packer = c_PackerNames[candidates[best].heuristic];
+
+    // Zero is transparent black.
+    font->pixels.resize(size_t(font->width) * font->height);
+
+    font->glyphs.resize(glyphs.size());
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const BakedGlyph& from = glyphs[order[i]];
+        Glyph& glyph = font->glyphs[order[i]];
+
+        int32_t x = packed.positions[i].x + c_Border;
+        int32_t y = packed.positions[i].y + c_Border;
+
+        glyph.character = from.character;
+        glyph.subrect.left = x;
+        glyph.subrect.top = y;
+        glyph.subrect.right = x + from.source.w;
+        glyph.subrect.bottom = y + from.source.h;
+        glyph.xOffset = from.xOffset;
+        glyph.yOffset = from.yOffset;
+        glyph.xAdvance = from.xAdvance + options.characterSpacing;
+    }
+
+    // Glyphs and their borders never overlap, so they can be copied in any order.
+    ParallelFor(glyphs.size(), threadCount, [&](size_t i)
+    {
+        auto& subrect = font->glyphs[i].subrect;
+
+        CopyGlyph(source, glyphs[i].source, font->pixels.data(), font->width, subrect.left, subrect.top);
+    });
+
+    font->lineSpacing = lineSpacing + options.lineSpacing;
+    font->defaultCharacter = options.defaultCharacter;
+    font->textureFormat = options.textureFormat;
+
+    if (font->textureFormat == TextureFormat_Auto)
+    {
+        // Monochrome if every pixel that shows is white.
+        std::vector<uint8_t> whiteRows(font->height);
+
+        ParallelFor(font->height, threadCount, [&](size_t y)
+        {
+            const uint32_t* row = font->pixels.data() + y * font->width;
+
+            whiteRows[y] = std::all_of(row, row + font->width, [](uint32_t pixel)
+            {
+                return !GetAlpha(pixel) || (pixel & c_RgbMask) == c_RgbMask;
+            });
+        });
+
+        bool isMono = std::all_of(whiteRows.begin(), whiteRows.end(), [](uint8_t white) { return white != 0; });
+
+        font->textureFormat = isMono ? TextureFormat_CompressedMono : TextureFormat_Rgba32;
+    }
+
+    if (!options.noPremultiply)
+    {
+        ParallelFor(font->height, threadCount, [&](size_t y)
+        {
+            uint32_t* row = font->pixels.data() + y * font->width;
+
+            for (uint32_t x = 0; x < font->width; ++x)
+                row[x] = Premultiply(row[x]);
+        });
+    }
+
+    font->premultiplied = !options.noPremultiply;
+
+    return font;
+}
+
+
+void SpriteFontData::ReadBMP(const uint8_t* bmpData, size_t bmpSize, uint32_t& width, uint32_t& height, std::vector<uint32_t>& pixels)
+{
+    if (!bmpData)
+        throw std::invalid_argument("bmpData cannot be null");
+
+    if (bmpSize < c_BmpFileHeaderSize + c_BmpInfoHeaderSize || ReadAt<uint16_t>(bmpData, 0) != c_BmpMagic)
+        throw std::runtime_error("Not a .BMP file");
+
+    uint32_t pixelOffset = ReadAt<uint32_t>(bmpData, 10);
+    uint32_t headerSize = ReadAt<uint32_t>(bmpData, c_BmpFileHeaderSize);
+
+    if (headerSize < c_BmpInfoHeaderSize || headerSize > bmpSize - c_BmpFileHeaderSize)
+        throw std::runtime_error("Unsupported .BMP header");
+
+    const uint8_t* header = bmpData + c_BmpFileHeaderSize;
+
+    int32_t bmpWidth = ReadAt<int32_t>(header, 4);
+    int32_t bmpHeight = ReadAt<int32_t>(header, 8);
+    uint16_t bitCount = ReadAt<uint16_t>(header, 14);
+    uint32_t compression = ReadAt<uint32_t>(header, 16);
+    uint32_t paletteSize = ReadAt<uint32_t>(header, 32);
+
+    // Rows are stored bottom up unless the height is negative.
+    bool topDown = bmpHeight < 0;
+    int64_t rows = topDown ? -int64_t(bmpHeight) : int64_t(bmpHeight);
+
+    if (bmpWidth <= 0 || rows <= 0 || bmpWidth > 65536 || rows > 65536)
+        throw std::runtime_error("Invalid .BMP dimensions");
+
+    // Bit masks follow a plain info header, or are part of a larger one.
+    size_t maskOffset = c_BmpFileHeaderSize + ((headerSize == c_BmpInfoHeaderSize) ? c_BmpInfoHeaderSize : 40);
+    size_t maskCount = (headerSize > c_BmpInfoHeaderSize) ? std::min<size_t>(4, (headerSize - 40) / 4)
+                     : (compression == c_BiAlphaBitFields) ? 4
+                     : (compression == c_BiBitFields) ? 3
+                     : 0;
+
+    uint32_t masks[4] = {};
+
+    if (bitCount == 32 && (compression == c_BiBitFields || compression == c_BiAlphaBitFields))
+    {
+        if (maskOffset + maskCount * 4 > bmpSize)
+            throw std::runtime_error("Truncated .BMP file");
+
+        for (size_t i = 0; i < maskCount; ++i)
+            masks[i] = ReadAt<uint32_t>(bmpData, maskOffset + i * 4);
+    }
+    else if (compression != c_BiRgb || (bitCount != 8 && bitCount != 24 && bitCount != 32))
+    {
+        throw std::runtime_error("Only uncompressed 8, 24 and 32 bpp .BMP files are supported");
+    }
+    else if (bitCount == 32)
+    {
+        masks[0] = 0x00FF0000;
+        masks[1] = 0x0000FF00;
+        masks[2] = 0x000000FF;
+    }
+
+    ChannelMask red(masks[0]);
+    ChannelMask green(masks[1]);
+    ChannelMask blue(masks[2]);
+    ChannelMask alpha(masks[3]);
+
+    uint32_t palette[256] = {};
+
+    if (bitCount == 8)
+    {
+        if (!paletteSize || paletteSize > 256)
+            paletteSize = 256;
+
+        size_t paletteOffset = c_BmpFileHeaderSize + headerSize;
+        if (paletteOffset + paletteSize * 4 > bmpSize)
+            throw std::runtime_error("Truncated .BMP file");
+
+        // BGRX entries.
+        for (uint32_t i = 0; i < paletteSize; ++i)
+        {
+            const uint8_t* entry = bmpData + paletteOffset + i * 4;
+            palette[i] = 0xFF000000 | (uint32_t(entry[0]) << 16) | (uint32_t(entry[1]) << 8) | entry[2];
+        }
+    }
+
+    size_t stride = ((size_t(bmpWidth) * bitCount + 31) / 32) * 4;
+
+    if (pixelOffset > bmpSize || stride * size_t(rows) > bmpSize - pixelOffset)
+        throw std::runtime_error("Truncated .BMP file");
+
+    width = uint32_t(bmpWidth);
+    height = uint32_t(rows);
+    pixels.resize(size_t(width) * height);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t* src = bmpData + pixelOffset + stride * (topDown ? y : height - 1 - y);
+        uint32_t* dest = pixels.data() + size_t(y) * width;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            switch (bitCount)
+            {
+            case 8:
+                dest[x] = palette[src[x]];
+                break;
+
+            case 24:
+                dest[x] = 0xFF000000 | (uint32_t(src[x * 3]) << 16) | (uint32_t(src[x * 3 + 1]) << 8) | src[x * 3 + 2];
+                break;
+
+            default:
+                {
+                    uint32_t value = ReadAt<uint32_t>(src, x * 4);
+                    uint32_t a = alpha.IsEmpty() ? 255 : alpha.Read(value);
+
+                    dest[x] = (a << 24) | (blue.Read(value) << 16) | (green.Read(value) << 8) | red.Read(value);
+                }
+                break;
+            }
+        }
+    }
+}
+
+
+void SpriteFontData::Write(std::vector<uint8_t>& fileData) const
+{
+    if (!width || !height || pixels.size() != size_t(width) * height)
+        throw std::runtime_error("Sprite sheet is empty");
+
+    size_t bytesPerRow;
+    uint32_t rowCount;
+
+    switch (textureFormat)
+    {
+    case TextureFormat_Rgba32:
+        bytesPerRow = size_t(width) * sizeof(uint32_t);
+        rowCount = height;
+        break;
+
+    case TextureFormat_Bgra4444:
+        bytesPerRow = size_t(width) * sizeof(uint16_t);
+        rowCount = height;
+        break;
+
+    case TextureFormat_CompressedMono:
+        if ((width & 3) || (height & 3))
+            throw std::runtime_error("Block compression requires texture size to be a multiple of 4");
+
+        // One row of 16-byte blocks for every four rows of pixels.
+        bytesPerRow = size_t(width) * 4;
+        rowCount = height / 4;
+        break;
+
+    default:
+        throw std::runtime_error("Unsupported texture format");
+    }
+
+    fileData.assign(c_SpriteFontMagic, c_SpriteFontMagic + sizeof(c_SpriteFontMagic) - 1);
+
+    Append(fileData, uint32_t(glyphs.size()));
+
+    static_assert(sizeof(Glyph) == 32, "Glyph layout mismatch");
+
+    auto glyphData = reinterpret_cast<const uint8_t*>(glyphs.data());
+    fileData.insert(fileData.end(), glyphData, glyphData + glyphs.size() * sizeof(Glyph));
+
+    Append(fileData, lineSpacing);
+    Append(fileData, defaultCharacter);
+
+    Append(fileData, width);
+    Append(fileData, height);
+    Append(fileData, uint32_t(textureFormat));
+    Append(fileData, uint32_t(bytesPerRow));
+    Append(fileData, rowCount);
+
+    size_t textureOffset = fileData.size();
+    fileData.resize(textureOffset + bytesPerRow * rowCount);
+
+    uint8_t* texture = fileData.data() + textureOffset;
+
+    switch (textureFormat)
+    {
+    case TextureFormat_Rgba32:
+        memcpy(texture, pixels.data(), pixels.size() * sizeof(uint32_t));
+        break;
+
+    case TextureFormat_Bgra4444:
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            uint32_t pixel = pixels[i];
+            uint16_t packed = uint16_t(((pixel >> 20) & 0xF) | ((pixel >> 8) & 0xF0) | ((pixel << 4) & 0xF00) | ((pixel >> 16) & 0xF000));
+
+            memcpy(texture + i * sizeof(uint16_t), &packed, sizeof(packed));
+        }
+        break;
+
+    default:
+        ParallelFor(rowCount, std::thread::hardware_concurrency(), [&](size_t blockRow)
+        {
+            uint8_t* block = texture + blockRow * bytesPerRow;
+
+            for (uint32_t x = 0; x < width; x += 4, block += 16)
+            {
+                CompressMonoBlock(pixels.data(), width, x, uint32_t(blockRow * 4), !premultiplied, block);
+            }
+        });
+        break;
+    }
+}
+
+
+void SpriteFontData::WriteSheetBMP(std::vector<uint8_t>& fileData) const
+{
+    // 32 bpp with an alpha mask in a BITMAPV4HEADER, top down.
+    size_t pixelOffset = c_BmpFileHeaderSize + c_BmpV4HeaderSize;
+    size_t imageSize = pixels.size() * sizeof(uint32_t);
+
+    if (imageSize > UINT32_MAX - pixelOffset)
+        throw std::runtime_error("Sprite sheet is too large for a .BMP file");
+
+    fileData.assign(pixelOffset, 0);
+
+    uint8_t* header = fileData.data();
+
+    auto put16 = [&](size_t offset, uint16_t value) { memcpy(header + offset, &value, sizeof(value)); };
+    auto put32 = [&](size_t offset, uint32_t value) { memcpy(header + offset, &value, sizeof(value)); };
+
+    put16(0, c_BmpMagic);
+    put32(2, uint32_t(pixelOffset + imageSize));
+    put32(10, uint32_t(pixelOffset));
+
+    header += c_BmpFileHeaderSize;
+
+    put32(0, uint32_t(c_BmpV4HeaderSize));
+    put32(4, width);
+    put32(8, uint32_t(-int32_t(height)));
+    put16(12, 1);
+    put16(14, 32);
+    put32(16, c_BiBitFields);
+    put32(20, uint32_t(imageSize));
+    put32(40, 0x000000FF);
+    put32(44, 0x0000FF00);
+    put32(48, 0x00FF0000);
+    put32(52, 0xFF000000);
+    put32(56, 0x73524742);  // LCS_sRGB
+
+    auto data = reinterpret_cast<const uint8_t*>(pixels.data());
+    fileData.insert(fileData.end(), data, data + imageSize);
+}
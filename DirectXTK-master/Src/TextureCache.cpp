@@ -0,0 +1,565 @@
+//--------------------------------------------------------------------------------------
+// File: TextureCache.cpp
+//
+// Part of SnowScene's additions to DirectXTK; not Microsoft code.
+//--------------------------------------------------------------------------------------
+
+#include "pch.h"
+#include "TextureCache.h"
+#include "PlatformHelpers.h"
+#include "LoaderHelpers.h"
+
+#include <atomic>
+#include <cwctype>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+
+namespace
+{
+    // Power of two. Enough that a few dozen loading threads seldom share a lock.
+    const size_t c_ShardCount = 32;
+
+    inline wchar_t Normalize(wchar_t c)
+    {
+        if (c < 0x80)
+            return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c + (L'a' - L'A')) : (c == L'/') ? L'\\' : c;
+
+        return static_cast<wchar_t>(towlower(c));
+    }
+
+    // FNV-1a of the normalized name.
+    uint64_t HashName(_In_z_ const wchar_t* name)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (; *name; ++name)
+            hash = (hash ^ static_cast<uint64_t>(Normalize(*name))) * 1099511628211ull;
+
+        return hash;
+    }
+
+    std::wstring NormalizeName(_In_z_ const wchar_t* name)
+    {
+        std::wstring result(name);
+        for (auto it = result.begin(); it != result.end(); ++it)
+            *it = Normalize(*it);
+
+        return result;
+    }
+
+    // Compares a normalized name with one as requested, without copying the latter.
+    bool SameName(const std::wstring& normalized, _In_z_ const wchar_t* name)
+    {
+        auto it = normalized.begin();
+        for (; *name; ++name, ++it)
+        {
+            if (it == normalized.end() || *it != Normalize(*name))
+                return false;
+        }
+
+        return it == normalized.end();
+    }
+
+    struct IdentityHash
+    {
+        size_t operator()(uint64_t hash) const { return static_cast<size_t>(hash); }
+    };
+
+    // True if the caller's reference is the only one.
+    bool IsUnused(_In_ ID3D11ShaderResourceView* view)
+    {
+        view->AddRef();
+        return view->Release() == 1;
+    }
+
+    size_t MipChainBytes(UINT width, UINT height, UINT depth, UINT mipLevels, DXGI_FORMAT format)
+    {
+        size_t total = 0;
+
+        for (UINT level = 0; level < mipLevels; ++level)
+        {
+            size_t bytes = 0;
+            LoaderHelpers::GetSurfaceInfo(std::max(width >> level, 1u), std::max(height >> level, 1u), format, &bytes, nullptr, nullptr);
+            total += bytes * std::max(depth >> level, 1u);
+        }
+
+        return total;
+    }
+}
+
+
+// Internal TextureCache implementation class.
+class TextureCache::Impl
+{
+public:
+    explicit Impl(size_t budgetBytes)
+      : mBudget(budgetBytes),
+        mBytes(0),
+        mTick(0),
+        mEvictions(0)
+    {}
+
+    void GetOrLoad(_In_z_ const wchar_t* name, const Loader& loader, _Outptr_ ID3D11ShaderResourceView** textureView);
+    bool Find(_In_z_ const wchar_t* name, _Outptr_result_maybenull_ ID3D11ShaderResourceView** textureView);
+    size_t Trim(size_t bytes, bool wait);
+    void Clear();
+    Stats GetStats();
+
+    std::atomic<size_t> mBudget;
+
+private:
+    struct Entry
+    {
+        std::wstring name;
+        ComPtr<ID3D11ShaderResourceView> view;
+
+        // Valid, and view null, while the first request for the texture loads it.
+        std::shared_future<void> loading;
+
+        size_t      bytes;
+        uint64_t    lastUse;
+    };
+
+    // By the hash of the normalized name; names that collide share a key.
+    typedef std::unordered_multimap<uint64_t, Entry, IdentityHash> EntryMap;
+
+    struct Shard
+    {
+        Shard() : hits(0), misses(0), waits(0) {}
+
+        std::mutex mutex;
+        EntryMap entries;
+
+        uint64_t    hits;
+        uint64_t    misses;
+        uint64_t    waits;
+    };
+
+    Shard& GetShard(uint64_t hash)
+    {
+        // The maps bucket by the low bits, so take the shard from the high ones.
+        return mShards[(hash >> 32) & (c_ShardCount - 1)];
+    }
+
+    static EntryMap::iterator FindEntry(Shard& shard, uint64_t hash, _In_z_ const wchar_t* name)
+    {
+        auto range = shard.entries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (SameName(it->second.name, name))
+                return it;
+        }
+
+        return shard.entries.end();
+    }
+
+    void Load(Shard& shard, Entry& entry, _In_z_ const wchar_t* name, const Loader& loader, std::promise<void>& promise, _Outptr_ ID3D11ShaderResourceView** textureView);
+
+    Shard mShards[c_ShardCount];
+
+    std::atomic<size_t> mBytes;
+
+    // Advances once per load rather than per request, so hits only read it. Textures
+    // requested between the same two loads are equally old.
+    std::atomic<uint64_t> mTick;
+
+    std::atomic<uint64_t> mEvictions;
+
+    // Held while evicting, so only one thread scans for victims at a time.
+    std::mutex mTrimMutex;
+};
+
+
+_Use_decl_annotations_
+void TextureCache::Impl::GetOrLoad(const wchar_t* name, const Loader& loader, ID3D11ShaderResourceView** textureView)
+{
+    uint64_t hash = HashName(name);
+    Shard& shard = GetShard(hash);
+
+    bool waited = false;
+    for (;;)
+    {
+        // Only a miss pays for the promise's shared state.
+        std::unique_ptr<std::promise<void>> promise;
+        std::shared_future<void> loading;
+        Entry* loadEntry = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto it = FindEntry(shard, hash, name);
+            if (it == shard.entries.end())
+            {
+                promise.reset(new std::promise<void>);
+
+                Entry entry;
+                entry.name = NormalizeName(name);
+                entry.loading = promise->get_future().share();
+                entry.bytes = 0;
+                entry.lastUse = 0;
+
+                // Nothing else erases an entry that is loading, so this stays valid.
+                loadEntry = &shard.entries.insert(EntryMap::value_type(hash, std::move(entry)))->second;
+                ++shard.misses;
+            }
+            else if (it->second.view)
+            {
+                it->second.lastUse = mTick.load(std::memory_order_relaxed);
+                if (!waited)
+                    ++shard.hits;
+
+                *textureView = it->second.view.Get();
+                (*textureView)->AddRef();
+                return;
+            }
+            else
+            {
+                loading = it->second.loading;
+                ++shard.waits;
+            }
+        }
+
+        if (loadEntry)
+        {
+            Load(shard, *loadEntry, name, loader, *promise, textureView);
+            return;
+        }
+
+        // Rethrows the loader's error. Otherwise look again: the texture is normally
+        // there now, but could have been evicted or cleared meanwhile.
+        loading.get();
+        waited = true;
+    }
+}
+
+_Use_decl_annotations_
+void TextureCache::Impl::Load(Shard& shard, Entry& entry, const wchar_t* name, const Loader& loader, std::promise<void>& promise, ID3D11ShaderResourceView** textureView)
+{
+    ComPtr<ID3D11ShaderResourceView> view;
+    size_t bytes = 0;
+
+    try
+    {
+        loader(name, view.GetAddressOf());
+        if (!view)
+            throw std::exception("TextureCache loader");
+
+        bytes = GetTextureBytes(view.Get());
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            for (auto it = shard.entries.begin(); it != shard.entries.end(); ++it)
+            {
+                if (&it->second == &entry)
+                {
+                    shard.entries.erase(it);
+                    break;
+                }
+            }
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        entry.view = view;
+        entry.loading = std::shared_future<void>();
+        entry.bytes = bytes;
+        entry.lastUse = ++mTick;
+    }
+
+    mBytes += bytes;
+    promise.set_value();
+
+    *textureView = view.Detach();
+
+    // The caller's reference keeps this texture out of the eviction.
+    if (mBytes > mBudget)
+        Trim(mBudget, false);
+}
+
+_Use_decl_annotations_
+bool TextureCache::Impl::Find(const wchar_t* name, ID3D11ShaderResourceView** textureView)
+{
+    *textureView = nullptr;
+
+    uint64_t hash = HashName(name);
+    Shard& shard = GetShard(hash);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = FindEntry(shard, hash, name);
+    if (it == shard.entries.end() || !it->second.view)
+        return false;
+
+    it->second.lastUse = mTick.load(std::memory_order_relaxed);
+    ++shard.hits;
+
+    *textureView = it->second.view.Get();
+    (*textureView)->AddRef();
+    return true;
+}
+
+size_t TextureCache::Impl::Trim(size_t bytes, bool wait)
+{
+    if (mBytes <= bytes)
+        return mBytes;
+
+    // A thread that only went over the budget leaves the eviction to whoever is
+    // already doing it rather than queuing up behind it.
+    std::unique_lock<std::mutex> trimLock(mTrimMutex, std::defer_lock);
+    if (wait)
+        trimLock.lock();
+    else if (!trimLock.try_lock())
+        return mBytes;
+
+    // Entries are identified by address, which is only compared, never followed,
+    // until the entry has been found again under the shard's lock.
+    struct Candidate
+    {
+        uint64_t        lastUse;
+        uint64_t        hash;
+        size_t          shard;
+        const Entry*    entry;
+    };
+
+    std::vector<Candidate> candidates;
+
+    for (size_t j = 0; j < c_ShardCount; ++j)
+    {
+        std::lock_guard<std::mutex> lock(mShards[j].mutex);
+
+        for (auto it = mShards[j].entries.begin(); it != mShards[j].entries.end(); ++it)
+        {
+            if (it->second.view && IsUnused(it->second.view.Get()))
+            {
+                Candidate candidate = { it->second.lastUse, it->first, j, &it->second };
+                candidates.push_back(candidate);
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+    {
+        return a.lastUse < b.lastUse;
+    });
+
+    for (auto it = candidates.begin(); it != candidates.end() && mBytes > bytes; ++it)
+    {
+        // Released after the shard is unlocked.
+        ComPtr<ID3D11ShaderResourceView> evicted;
+        {
+            Shard& shard = mShards[it->shard];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto range = shard.entries.equal_range(it->hash);
+            auto entry = range.first;
+            while (entry != range.second && &entry->second != it->entry)
+                ++entry;
+
+            // Skip it if it was requested since the scan.
+            if (entry == range.second
+                || !entry->second.view
+                || entry->second.lastUse != it->lastUse
+                || !IsUnused(entry->second.view.Get()))
+                continue;
+
+            evicted.Swap(entry->second.view);
+            mBytes -= entry->second.bytes;
+            shard.entries.erase(entry);
+        }
+
+        ++mEvictions;
+    }
+
+    return mBytes;
+}
+
+void TextureCache::Impl::Clear()
+{
+    for (size_t j = 0; j < c_ShardCount; ++j)
+    {
+        std::vector<ComPtr<ID3D11ShaderResourceView>> released;
+        {
+            std::lock_guard<std::mutex> lock(mShards[j].mutex);
+
+            auto& entries = mShards[j].entries;
+            for (auto it = entries.begin(); it != entries.end(); )
+            {
+                if (it->second.view)
+                {
+                    released.push_back(std::move(it->second.view));
+                    mBytes -= it->second.bytes;
+                    it = entries.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+}
+
+TextureCache::Stats TextureCache::Impl::GetStats()
+{
+    Stats stats = {};
+
+    for (size_t j = 0; j < c_ShardCount; ++j)
+    {
+        std::lock_guard<std::mutex> lock(mShards[j].mutex);
+
+        for (auto it = mShards[j].entries.begin(); it != mShards[j].entries.end(); ++it)
+        {
+            if (it->second.view)
+                ++stats.textures;
+        }
+
+        stats.hits += mShards[j].hits;
+        stats.misses += mShards[j].misses;
+        stats.waits += mShards[j].waits;
+    }
+
+    stats.bytes = mBytes;
+    stats.evictions = mEvictions;
+    return stats;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// TextureCache
+//--------------------------------------------------------------------------------------
+
+TextureCache::TextureCache(size_t budgetBytes)
+    : pImpl(new Impl(budgetBytes))
+{
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+
+TextureCache::TextureCache(TextureCache&& moveFrom)
+    : pImpl(std::move(moveFrom.pImpl))
+{
+}
+
+TextureCache& TextureCache::operator= (TextureCache&& moveFrom)
+{
+    pImpl = std::move(moveFrom.pImpl);
+    return *this;
+}
+
+_Use_decl_annotations_
+void TextureCache::GetOrLoad(const wchar_t* name, const Loader& loader, ID3D11ShaderResourceView** textureView)
+{
+    if (!name || !textureView || !loader)
+        throw std::exception("invalid arguments");
+
+    pImpl->GetOrLoad(name, loader, textureView);
+}
+
+_Use_decl_annotations_
+bool TextureCache::Find(const wchar_t* name, ID3D11ShaderResourceView** textureView)
+{
+    if (!name || !textureView)
+        throw std::exception("invalid arguments");
+
+    return pImpl->Find(name, textureView);
+}
+
+void TextureCache::SetBudget(size_t bytes)
+{
+    pImpl->mBudget = bytes;
+    pImpl->Trim(bytes, true);
+}
+
+size_t TextureCache::GetBudget() const
+{
+    return pImpl->mBudget;
+}
+
+size_t TextureCache::Trim(size_t bytes)
+{
+    return pImpl->Trim(bytes, true);
+}
+
+void TextureCache::Clear()
+{
+    pImpl->Clear();
+}
+
+TextureCache::Stats TextureCache::GetStats() const
+{
+    return pImpl->GetStats();
+}
+
+_Use_decl_annotations_
+size_t TextureCache::GetTextureBytes(ID3D11ShaderResourceView* textureView)
+{
+    if (!textureView)
+        throw std::exception("invalid arguments");
+
+    ComPtr<ID3D11Resource> resource;
+    textureView->GetResource(resource.GetAddressOf());
+
+    D3D11_RESOURCE_DIMENSION dimension = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+    resource->GetType(&dimension);
+
+    switch (dimension)
+    {
+        case D3D11_RESOURCE_DIMENSION_BUFFER:
+        {
+            ComPtr<ID3D11Buffer> buffer;
+            ThrowIfFailed(resource.As(&buffer));
+
+            D3D11_BUFFER_DESC desc;
+            buffer->GetDesc(&desc);
+            return desc.ByteWidth;
+        }
+
+        case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+        {
+            ComPtr<ID3D11Texture1D> texture;
+            ThrowIfFailed(resource.As(&texture));
+
+            D3D11_TEXTURE1D_DESC desc;
+            texture->GetDesc(&desc);
+            return MipChainBytes(desc.Width, 1, 1, desc.MipLevels, desc.Format) * desc.ArraySize;
+        }
+
+        case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+        {
+            ComPtr<ID3D11Texture2D> texture;
+            ThrowIfFailed(resource.As(&texture));
+
+            D3D11_TEXTURE2D_DESC desc;
+            texture->GetDesc(&desc);
+            return MipChainBytes(desc.Width, desc.Height, 1, desc.MipLevels, desc.Format) * desc.ArraySize * desc.SampleDesc.Count;
+        }
+
+        case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        {
+            ComPtr<ID3D11Texture3D> texture;
+            ThrowIfFailed(resource.As(&texture));
+
+            D3D11_TEXTURE3D_DESC desc;
+            texture->GetDesc(&desc);
+            return MipChainBytes(desc.Width, desc.Height, desc.Depth, desc.MipLevels, desc.Format);
+        }
+
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,43 @@
+//***************************************************************************************
+// Clock.cpp
+//***************************************************************************************
+
+#include "Clock.h"
+#include <chrono>
+
+const Clock& Clock::Steady()
+{
+	static SteadyClock clock;
+	return clock;
+}
+
+long long SteadyClock::NowNs()const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ManualClock::ManualClock(long long startNs)
+: mNow(startNs)
+{
+}
+
+long long ManualClock::NowNs()const
+{
+	return mNow;
+}
+
+void ManualClock::Set(long long ns)
+{
+	mNow = ns;
+}
+
+void ManualClock::Advance(long long ns)
+{
+	mNow += ns;
+}
+
+void ManualClock::AdvanceSeconds(double seconds)
+{
+	mNow += (long long)(seconds*1.0e9);
+}
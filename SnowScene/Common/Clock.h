@@ -0,0 +1,44 @@
+//***************************************************************************************
+// Clock.h
+//
+// Monotonic time source in nanoseconds.  GameTimer reads time through a Clock so that
+// tests can drive it from a ManualClock instead of the system clock.
+//***************************************************************************************
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+class Clock
+{
+public:
+	virtual ~Clock() {}
+
+	virtual long long NowNs()const = 0;
+
+	// Process wide std::chrono::steady_clock instance.
+	static const Clock& Steady();
+};
+
+class SteadyClock : public Clock
+{
+public:
+	long long NowNs()const;
+};
+
+// Clock that only moves when told to.
+class ManualClock : public Clock
+{
+public:
+	explicit ManualClock(long long startNs = 0);
+
+	long long NowNs()const;
+
+	void Set(long long ns);
+	void Advance(long long ns);
+	void AdvanceSeconds(double seconds);
+
+private:
+	long long mNow;
+};
+
+#endif // CLOCK_H
@@ -0,0 +1,87 @@
+//***************************************************************************************
+// FixedStepScheduler.cpp
+//***************************************************************************************
+
+#include "FixedStepScheduler.h"
+#include <cassert>
+#include <cmath>
+
+FixedStepScheduler::FixedStepScheduler()
+: mStep(1.0/60.0), mMaxStepsPerFrame(5),
+  mAccumulator(0.0), mStepCount(0), mDroppedTime(0.0)
+{
+}
+
+void FixedStepScheduler::Init(float step, unsigned int maxStepsPerFrame)
+{
+	assert(step > 0.0f && maxStepsPerFrame > 0);
+
+	mStep = step;
+	mMaxStepsPerFrame = maxStepsPerFrame;
+	Reset();
+}
+
+void FixedStepScheduler::Reset()
+{
+	mAccumulator = 0.0;
+	mStepCount   = 0;
+	mDroppedTime = 0.0;
+}
+
+unsigned int FixedStepScheduler::Advance(float frameTime, const StepFn& fn)
+{
+	// Force nonnegative, as GameTimer does.
+	if( frameTime > 0.0f )
+		mAccumulator += frameTime;
+
+	unsigned int steps = 0;
+	while( mAccumulator >= mStep && steps < mMaxStepsPerFrame )
+	{
+		fn((float)mStep);
+
+		mAccumulator -= mStep;
+		++mStepCount;
+		++steps;
+	}
+
+	// Out of steps for this frame: drop the whole steps still owed and keep only the
+	// fraction, so the next frame does not start behind.
+	if( mAccumulator >= mStep )
+	{
+		double owed = floor(mAccumulator / mStep)*mStep;
+		mDroppedTime += owed;
+		mAccumulator -= owed;
+	}
+
+	return steps;
+}
+
+float FixedStepScheduler::GetAlpha()const
+{
+	return (float)(mAccumulator / mStep);
+}
+
+float FixedStepScheduler::GetStep()const
+{
+	return (float)mStep;
+}
+
+unsigned int FixedStepScheduler::GetMaxStepsPerFrame()const
+{
+	return mMaxStepsPerFrame;
+}
+
+unsigned long long FixedStepScheduler::GetStepCount()const
+{
+	return mStepCount;
+}
+
+double FixedStepScheduler::GetSimulationTime()const
+{
+	return mStepCount*mStep;
+}
+
+double FixedStepScheduler::GetDroppedTime()const
+{
+	return mDroppedTime;
+}
@@ -0,0 +1,54 @@
+//***************************************************************************************
+// FixedStepScheduler.h
+//
+// Runs a simulation at a fixed time step, independent of the frame rate.  Each frame
+// the elapsed time is added to an accumulator and the simulation is stepped once per
+// whole step in it; the remainder, as a fraction of a step, is the interpolation
+// factor between the last two simulated states.
+//
+// A frame runs at most maxStepsPerFrame steps.  Time beyond that is dropped, so a slow
+// frame slows the simulation down instead of making the next frame slower still.
+//***************************************************************************************
+
+#ifndef FIXEDSTEPSCHEDULER_H
+#define FIXEDSTEPSCHEDULER_H
+
+#include <functional>
+
+class FixedStepScheduler
+{
+public:
+	// Advances the simulation by dt seconds.
+	typedef std::function<void(float dt)> StepFn;
+
+public:
+	FixedStepScheduler();
+
+	void Init(float step, unsigned int maxStepsPerFrame);
+	void Reset();
+
+	// Adds frameTime seconds and runs the steps that are due.  Returns how many ran.
+	unsigned int Advance(float frameTime, const StepFn& fn);
+
+	// Leftover time as a fraction of a step, in [0, 1).  Blend the previous and the
+	// current simulation state with it when rendering.
+	float GetAlpha()const;
+
+	float GetStep()const;
+	unsigned int GetMaxStepsPerFrame()const;
+	unsigned long long GetStepCount()const;
+
+	// Time simulated so far, and time dropped by the catch-up limit.
+	double GetSimulationTime()const;
+	double GetDroppedTime()const;
+
+private:
+	double mStep;
+	unsigned int mMaxStepsPerFrame;
+
+	double mAccumulator;
+	unsigned long long mStepCount;
+	double mDroppedTime;
+};
+
+#endif // FIXEDSTEPSCHEDULER_H
@@ -2,16 +2,13 @@
 // GameTimer.cpp by Frank Luna (C) 2011 All Rights Reserved.
 //***************************************************************************************
 
-#include <windows.h>
 #include "GameTimer.h"
 
-GameTimer::GameTimer()
-: mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
-  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
+GameTimer::GameTimer(const Clock* clock)
+: mClock(clock ? clock : &Clock::Steady()),
+  mSecondsPerCount(1.0e-9), mDeltaTime(-1.0), mBaseTime(0), 
+  mPausedTime(0), mStopTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
 {
-	__int64 countsPerSec;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-	mSecondsPerCount = 1.0 / (double)countsPerSec;
 }
 
 // Returns the total time elapsed since Reset() was called, NOT counting any
@@ -55,8 +52,7 @@ float GameTimer::DeltaTime()const
 
 void GameTimer::Reset()
 {
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	long long currTime = mClock->NowNs();
 
 	mBaseTime = currTime;
 	mPrevTime = currTime;
@@ -66,8 +62,7 @@ void GameTimer::Reset()
 
 void GameTimer::Start()
 {
-	__int64 startTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+	long long startTime = mClock->NowNs();
 
 
 	// Accumulate the time elapsed between stop and start pairs.
@@ -90,8 +85,7 @@ void GameTimer::Stop()
 {
 	if( !mStopped )
 	{
-		__int64 currTime;
-		QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+		long long currTime = mClock->NowNs();
 
 		mStopTime = currTime;
 		mStopped  = true;
@@ -106,8 +100,7 @@ void GameTimer::Tick()
 		return;
 	}
 
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	long long currTime = mClock->NowNs();
 	mCurrTime = currTime;
 
 	// Time difference between this frame and the previous.
@@ -5,10 +5,13 @@
 #ifndef GAMETIMER_H
 #define GAMETIMER_H
 
+#include "Clock.h"
+
 class GameTimer
 {
 public:
-	GameTimer();
+	// Reads time from clock, or from Clock::Steady() if clock is null.
+	explicit GameTimer(const Clock* clock = 0);
 
 	float TotalTime()const;  // in seconds
 	float DeltaTime()const; // in seconds
@@ -19,14 +22,16 @@ public:
 	void Tick();  // Call every frame.
 
 private:
+	const Clock* mClock;
+
 	double mSecondsPerCount;
 	double mDeltaTime;
 
-	__int64 mBaseTime;
-	__int64 mPausedTime;
-	__int64 mStopTime;
-	__int64 mPrevTime;
-	__int64 mCurrTime;
+	long long mBaseTime;
+	long long mPausedTime;
+	long long mStopTime;
+	long long mPrevTime;
+	long long mCurrTime;
 
 	bool mStopped;
 };
@@ -4,6 +4,7 @@
 
 #include "GeometryGenerator.h"
 #include "MathHelper.h"
+#include "MeshOptimizer.h"
 
 using namespace DirectX;
 
@@ -618,3 +619,8 @@ void GeometryGenerator::CreateFullscreenQuad(MeshData& meshData)
 	meshData.Indices[4] = 2;
 	meshData.Indices[5] = 3;
 }
+
+void GeometryGenerator::Optimize(MeshData& meshData)
+{
+	OptimizeMesh(meshData.Vertices, meshData.Indices);
+}
@@ -81,6 +81,13 @@ public:
 	///</summary>
 	void CreateFullscreenQuad(MeshData& meshData);
 
+	///<summary>
+	/// Welds identical vertices and reorders the mesh for the post-transform vertex
+	/// cache, overdraw and vertex fetch.  The triangles stay the same, but the vertex
+	/// and index order do not, so the Create functions leave this to the caller.
+	///</summary>
+	void Optimize(MeshData& meshData);
+
 private:
 	void Subdivide(MeshData& meshData);
 	void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount, MeshData& meshData);
@@ -0,0 +1,362 @@
+//***************************************************************************************
+// ModelLoader.cpp
+//***************************************************************************************
+
+#include "ModelLoader.h"
+#include "Effects.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cwctype>
+#include <stdexcept>
+
+using namespace DirectX;
+
+namespace
+{
+	std::wstring ToLower(std::wstring s)
+	{
+		std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c){ return (wchar_t)std::towlower(c); });
+		return s;
+	}
+
+	// Reads one byte of every page so the file is paged in by the worker rather than
+	// by the owning thread when the buffers are created from it.
+	void TouchPages(const BYTE* data, UINT64 size)
+	{
+		const UINT64 pageSize = 4096;
+
+		BYTE sum = 0;
+		for(UINT64 i = 0; i < size; i += pageSize)
+			sum += data[i];
+
+		volatile BYTE sink = sum;
+		(void)sink;
+	}
+}
+
+ModelLoader::ModelLoader()
+: md3dDevice(0), mFxFactory(0), mParseFlags(0),
+  mParsing(0), mLoadsCompleted(0), mRequestsShared(0), mQuit(false)
+{
+}
+
+ModelLoader::~ModelLoader()
+{
+	Shutdown();
+}
+
+void ModelLoader::Init(ID3D11Device* device, IEffectFactory* fxFactory, UINT numWorkers)
+{
+	// In case Init() called again.
+	Shutdown();
+
+	md3dDevice  = device;
+	mFxFactory  = fxFactory;
+	mOwnerThread = std::this_thread::get_id();
+
+	// Basic effects have no UV transform, so it has to be applied to the vertices.
+	mParseFlags = dynamic_cast<DGSLEffectFactory*>(fxFactory) ? ModelData::ParseFlags_None : ModelData::ParseFlags_BakeUVTransform;
+
+	// Workers spend much of their time waiting on the disk, so use every hardware
+	// thread even though the owning thread keeps running.
+	if( numWorkers == 0 )
+	{
+		UINT hw = std::thread::hardware_concurrency();
+		numWorkers = hw > 0 ? hw : 1;
+	}
+
+	mLoadsCompleted = 0;
+	mRequestsShared = 0;
+
+	mQuit = false;
+	for(UINT i = 0; i < numWorkers; ++i)
+		mWorkers.push_back(std::thread(&ModelLoader::WorkerMain, this));
+}
+
+void ModelLoader::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+
+		// Dropping the last reference to a request breaks its promise.
+		mQueue.clear();
+		mParsed.clear();
+		mPending.clear();
+	}
+	mWorkCV.notify_all();
+	mParsedCV.notify_all();
+
+	for(size_t i = 0; i < mWorkers.size(); ++i)
+		mWorkers[i].join();
+
+	mWorkers.clear();
+}
+
+ModelLoader::ModelFuture ModelLoader::Load(const std::wstring& filename, bool generateLODs)
+{
+	size_t dot = filename.find_last_of(L'.');
+	std::wstring ext = dot != std::wstring::npos ? ToLower(filename.substr(dot)) : std::wstring();
+
+	if( ext == L".sdkmesh" )
+		return Load(filename, Format_SDKMESH, false, false, generateLODs);
+
+	if( ext == L".vbo" )
+		return Load(filename, Format_VBO, false, false, generateLODs);
+
+	if( ext == L".pmdl" )
+		return Load(filename, Format_Packed, true, false, generateLODs);
+
+	if( ext == L".obj" )
+		return Load(filename, Format_OBJ, true, false, generateLODs);
+
+	return Load(filename, Format_CMO, true, false, generateLODs);
+}
+
+ModelLoader::ModelFuture ModelLoader::Load(const std::wstring& filename, Format format, bool ccw, bool pmalpha, bool generateLODs)
+{
+	// The same file loaded with different options is a different model.
+	std::wstring key = ToLower(filename);
+	std::replace(key.begin(), key.end(), L'/', L'\\');
+	key += L'|';
+	key += (wchar_t)(L'0' + format);
+	key += ccw ? L'c' : L'w';
+	key += pmalpha ? L'p' : L's';
+	key += generateLODs ? L'l' : L'f';
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mPending.find(key);
+	if( it != mPending.end() )
+	{
+		++mRequestsShared;
+		return it->second->Future;
+	}
+
+	std::shared_ptr<Request> request = std::make_shared<Request>();
+	request->Key        = key;
+	request->Filename   = filename;
+	request->FileFormat = format;
+	request->Ccw        = ccw;
+	request->PMAlpha    = pmalpha;
+	request->GenerateLODs = generateLODs;
+	request->Future     = request->Promise.get_future().share();
+
+	mPending[key] = request;
+	mQueue.push_back(request);
+	mWorkCV.notify_one();
+
+	return request->Future;
+}
+
+UINT ModelLoader::Update(UINT maxModels)
+{
+	assert(std::this_thread::get_id() == mOwnerThread);
+
+	UINT completed = 0;
+	while( completed < maxModels )
+	{
+		std::shared_ptr<Request> request;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if( mParsed.empty() )
+				break;
+
+			request = mParsed.front();
+			mParsed.pop_front();
+		}
+
+		if( request->Error )
+		{
+			request->Promise.set_exception(request->Error);
+		}
+		else
+		{
+			try
+			{
+				Create(*request);
+			}
+			catch(...)
+			{
+				request->Promise.set_exception(std::current_exception());
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mPending.erase(request->Key);
+			++mLoadsCompleted;
+		}
+
+		++completed;
+	}
+
+	return completed;
+}
+
+std::shared_ptr<Model> ModelLoader::Wait(const ModelFuture& future)
+{
+	assert(std::this_thread::get_id() == mOwnerThread);
+
+	while( future.wait_for(std::chrono::seconds(0)) != std::future_status::ready )
+	{
+		// Nothing left that could complete it.
+		if( !WaitForParsed() )
+			throw std::logic_error("Future was not returned by this ModelLoader");
+
+		Update();
+	}
+
+	return future.get();
+}
+
+void ModelLoader::Flush()
+{
+	assert(std::this_thread::get_id() == mOwnerThread);
+
+	while( WaitForParsed() )
+		Update();
+}
+
+ModelLoader::Stats ModelLoader::GetStats()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	Stats stats;
+	stats.Queued         = (UINT)mQueue.size();
+	stats.Parsing        = mParsing;
+	stats.Parsed         = (UINT)mParsed.size();
+	stats.LoadsCompleted = mLoadsCompleted;
+	stats.RequestsShared = mRequestsShared;
+	return stats;
+}
+
+void ModelLoader::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		mWorkCV.wait(lock, [this]{ return mQuit || !mQueue.empty(); });
+		if( mQuit )
+			break;
+
+		std::shared_ptr<Request> request = mQueue.front();
+		mQueue.pop_front();
+		++mParsing;
+		lock.unlock();
+
+		try
+		{
+			Parse(*request);
+		}
+		catch(...)
+		{
+			request->Error = std::current_exception();
+		}
+
+		lock.lock();
+		--mParsing;
+
+		// Dropped by Shutdown() meanwhile.
+		if( mQuit )
+			break;
+
+		mParsed.push_back(request);
+		mParsedCV.notify_all();
+	}
+}
+
+void ModelLoader::Parse(Request& request)
+{
+	// Throws if the file is missing or does not fit in the address space.
+	request.File.Open(request.Filename.c_str());
+	if( !request.File.GetData() )
+		throw std::runtime_error("ModelLoader: model file is empty");
+
+	const BYTE* data = request.File.GetData();
+	size_t size = request.File.GetSize();
+
+	// Only the .cmo, .pmdl and .obj loaders have a device-independent stage; the others
+	// are just paged in. Exported .cmo and .obj files are not ordered for the vertex
+	// cache, so that is done here too; PackModel has already done it for .pmdl files.
+	// None of the formats store levels of detail, so those are built here when asked for.
+	uint32_t flags = mParseFlags | (request.GenerateLODs ? ModelData::ParseFlags_GenerateLODs : 0);
+
+	if( request.FileFormat == Format_CMO )
+		request.Data = ModelData::ParseCMO(data, size, flags | ModelData::ParseFlags_OptimizeMeshes);
+	else if( request.FileFormat == Format_Packed )
+		request.Data = ModelData::ParsePacked(data, size, flags);
+	else if( request.FileFormat == Format_OBJ )
+		ParseOBJ(request, flags);
+
+	TouchPages(data, size);
+}
+
+void ModelLoader::ParseOBJ(Request& request, uint32_t flags)
+{
+	const BYTE* data = request.File.GetData();
+	size_t size = request.File.GetSize();
+
+	// The material library is looked for next to the .obj file; without it every face
+	// gets the default material. The ModelData owns copies of everything it needs, so
+	// the library is only mapped while parsing.
+	MappedFile mtl;
+	std::wstring mtlName = ModelData::GetOBJMaterialLibrary(data, size);
+	if( !mtlName.empty() )
+	{
+		size_t slash = request.Filename.find_last_of(L"\\/");
+		std::wstring mtlPath = (slash != std::wstring::npos ? request.Filename.substr(0, slash + 1) : std::wstring()) + mtlName;
+
+		try
+		{
+			mtl.Open(mtlPath.c_str());
+		}
+		catch(...)
+		{
+			// Left closed: the faces get the default material.
+		}
+	}
+
+	request.Data = ModelData::ParseOBJ(data, size, mtl.GetData(), mtl.GetSize(),
+		flags | ModelData::ParseFlags_OptimizeMeshes);
+}
+
+void ModelLoader::Create(Request& request)
+{
+	const BYTE* data = request.File.GetData();
+	size_t size = request.File.GetSize();
+
+	std::unique_ptr<Model> model;
+	switch( request.FileFormat )
+	{
+	case Format_CMO:
+	case Format_Packed:
+	case Format_OBJ:
+		model = Model::CreateFromModelData(md3dDevice, *request.Data, *mFxFactory, request.Ccw, request.PMAlpha);
+		break;
+
+	case Format_SDKMESH:
+		model = Model::CreateFromSDKMESH(md3dDevice, data, size, *mFxFactory, request.Ccw, request.PMAlpha);
+		break;
+
+	case Format_VBO:
+		model = Model::CreateFromVBO(md3dDevice, data, size, nullptr, request.Ccw, request.PMAlpha);
+		break;
+	}
+
+	model->name = request.Filename;
+
+	request.Promise.set_value(std::shared_ptr<Model>(std::move(model)));
+
+	// The buffers hold their own copies now.
+	request.Data.reset();
+	request.File.Close();
+}
+
+bool ModelLoader::WaitForParsed()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mParsedCV.wait(lock, [this]{ return !mParsed.empty() || mPending.empty(); });
+	return !mParsed.empty();
+}
@@ -0,0 +1,144 @@
+//***************************************************************************************
+// ModelLoader.h
+//
+// Loads .cmo, .pmdl, .obj, .sdkmesh and .vbo models on background threads.  Workers map
+// the files and run the device-independent part of loading (parsing a .cmo, .pmdl or
+// .obj into ModelData, and building its levels of detail if asked, paging in the others); the
+// buffers and effects are created by Update() on the thread that owns the loader, so the
+// device and effect factory are only used from that thread.
+// Requests for a file that is still loading share the pending load.
+//***************************************************************************************
+
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#include <Windows.h>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Model.h"
+#include "ModelData.h"
+
+class ModelLoader
+{
+public:
+	enum Format
+	{
+		Format_CMO,
+		Format_SDKMESH,
+		Format_VBO,
+		Format_Packed,
+		Format_OBJ
+	};
+
+	// Ready once Update() has created the model on the owning thread; holds the
+	// exception instead if the file could not be loaded.
+	typedef std::shared_future<std::shared_ptr<DirectX::Model>> ModelFuture;
+
+	struct Stats
+	{
+		UINT Queued;
+		UINT Parsing;
+		UINT Parsed;
+		UINT64 LoadsCompleted;
+		UINT64 RequestsShared;
+	};
+
+public:
+	ModelLoader();
+	~ModelLoader();
+
+	// The calling thread becomes the owning thread.  Zero workers picks one per
+	// hardware thread.
+	void Init(ID3D11Device* device, DirectX::IEffectFactory* fxFactory, UINT numWorkers = 0);
+
+	// Waits for the workers to finish the file they are on.  Loads that have not
+	// completed are dropped and their futures report std::future_error.
+	void Shutdown();
+
+	// Format from the file extension, and Model's default winding for that format.
+	// generateLODs builds levels of detail for Model::Draw to pick from by distance
+	// (.cmo, .pmdl and .obj only); it adds to the parse time on the worker.
+	ModelFuture Load(const std::wstring& filename, bool generateLODs = false);
+	ModelFuture Load(const std::wstring& filename, Format format, bool ccw, bool pmalpha = false, bool generateLODs = false);
+
+	// Creates up to maxModels parsed models, oldest first, and makes their futures
+	// ready.  Call once a frame from the owning thread.  Returns how many completed.
+	UINT Update(UINT maxModels = UINT_MAX);
+
+	// Owning thread only: creates models as they are parsed until the given one is
+	// ready, then returns it (or rethrows its error).  Calling get() on a future from
+	// the owning thread without this would wait forever.
+	std::shared_ptr<DirectX::Model> Wait(const ModelFuture& future);
+
+	// Owning thread only: completes every load queued so far.
+	void Flush();
+
+	Stats GetStats()const;
+
+private:
+	struct Request
+	{
+		std::wstring Key;
+		std::wstring Filename;
+		Format FileFormat;
+		bool Ccw;
+		bool PMAlpha;
+		bool GenerateLODs;
+
+		std::promise<std::shared_ptr<DirectX::Model>> Promise;
+		ModelFuture Future;
+
+		// Filled in by a worker.  CMO and packed model data may point into File.
+		DirectX::MappedFile File;
+		std::unique_ptr<DirectX::ModelData> Data;
+		std::exception_ptr Error;
+	};
+
+	void WorkerMain();
+	void Parse(Request& request);
+	void ParseOBJ(Request& request, uint32_t flags);
+	void Create(Request& request);
+	bool WaitForParsed();
+
+	ModelLoader(const ModelLoader& rhs);
+	ModelLoader& operator=(const ModelLoader& rhs);
+
+private:
+	ID3D11Device* md3dDevice;
+	DirectX::IEffectFactory* mFxFactory;
+	std::thread::id mOwnerThread;
+
+	// Parse flags matching what Model::CreateFromCMO picks for mFxFactory.
+	uint32_t mParseFlags;
+
+	// Every load that has been requested and not yet completed, by key.
+	std::map<std::wstring, std::shared_ptr<Request>> mPending;
+
+	// Waiting for a worker, and waiting for the owning thread.
+	std::deque<std::shared_ptr<Request>> mQueue;
+	std::deque<std::shared_ptr<Request>> mParsed;
+
+	UINT mParsing;
+	UINT64 mLoadsCompleted;
+	UINT64 mRequestsShared;
+
+	// Guards everything above except the device, factory and flags.
+	mutable std::mutex mMutex;
+	std::condition_variable mWorkCV;
+	std::condition_variable mParsedCV;
+
+	std::vector<std::thread> mWorkers;
+	bool mQuit;
+};
+
+#endif // MODELLOADER_H
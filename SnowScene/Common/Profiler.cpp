@@ -0,0 +1,610 @@
+//***************************************************************************************
+// Profiler.cpp
+//***************************************************************************************
+
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PROFILER_USE_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#if !defined(_WIN32)
+#include <chrono>
+#endif
+
+namespace
+{
+	std::atomic<UINT64> gNextProfilerId(1);
+
+	// The system clock, which the time stamp counter is calibrated against.
+	INT64 SystemNow()
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	INT64 SystemTicksPerSecond()
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return frequency.QuadPart;
+#else
+		return 1000000000;
+#endif
+	}
+
+#if defined(PROFILER_USE_TSC)
+	// Counts time stamp counter ticks over 10 ms of the system clock.  Any CPU with
+	// an invariant TSC (everything since Nehalem and Bulldozer) ticks at a constant
+	// rate on every core, whatever the power state.
+	INT64 CalibrateTsc()
+	{
+		INT64 systemPerSecond = SystemTicksPerSecond();
+		INT64 system0 = SystemNow();
+		UINT64 tsc0 = __rdtsc();
+
+		INT64 system1;
+		do
+		{
+			system1 = SystemNow();
+		} while( system1 - system0 < systemPerSecond/100 );
+		UINT64 tsc1 = __rdtsc();
+
+		return (INT64)((double)(tsc1 - tsc0) * systemPerSecond / (system1 - system0));
+	}
+#endif
+}
+
+const UINT Profiler::EventsPerThread;
+const UINT Profiler::NodesPerThread;
+const UINT Profiler::HistoryFrames;
+const UINT Profiler::NoScope;
+
+struct Profiler::ThreadBufferOwner
+{
+	struct Entry
+	{
+		UINT64 ProfilerId;
+		std::shared_ptr<ThreadBuffer> Buffer;
+	};
+
+	// One per profiler this thread has recorded into.
+	std::vector<Entry> Entries;
+
+	~ThreadBufferOwner()
+	{
+		// Every scope has closed, so the buffers are consistent for the next owner;
+		// the release store publishes the last events to it.
+		for(size_t i = 0; i < Entries.size(); ++i)
+			Entries[i].Buffer->InUse.store(false, std::memory_order_release);
+	}
+};
+
+Profiler::Profiler()
+: mId(gNextProfilerId++), mEnabled(true), mTicksPerSecond(TicksPerSecond()), mFrameStart(Now()), mFrameScope(NoScope)
+{
+}
+
+Profiler::~Profiler()
+{
+}
+
+Profiler& Profiler::Default()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+	mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::IsEnabled()const
+{
+	return mEnabled.load(std::memory_order_relaxed);
+}
+
+INT64 Profiler::Now()
+{
+#if defined(PROFILER_USE_TSC)
+	// A few ns, against 20-40 ns for QueryPerformanceCounter or steady_clock; a
+	// scope reads the clock twice.
+	return (INT64)__rdtsc();
+#else
+	return SystemNow();
+#endif
+}
+
+INT64 Profiler::TicksPerSecond()
+{
+#if defined(PROFILER_USE_TSC)
+	static const INT64 ticksPerSecond = CalibrateTsc();
+	return ticksPerSecond;
+#else
+	return SystemTicksPerSecond();
+#endif
+}
+
+UINT Profiler::EnterScope(ThreadBuffer* buffer, const char* name)
+{
+	Node* nodes = buffer->Nodes.get();
+	UINT parent = buffer->Current;
+
+	// Names are compared by address; a literal that exists at two addresses gives
+	// two nodes, which EndFrame() maps to the same scope.
+	UINT child = nodes[parent].FirstChild;
+	while( child != 0 && nodes[child].Name != name )
+		child = nodes[child].NextSibling;
+
+	if( child == 0 )
+	{
+		// When the table is full the scope is not recorded, and scopes inside it
+		// are attributed to its parent.
+		UINT count = buffer->NumNodes.load(std::memory_order_relaxed);
+		if( count == NodesPerThread )
+			return 0;
+
+		Node& node = nodes[count];
+		node.Name        = name;
+		node.Parent      = parent;
+		node.Depth       = nodes[parent].Depth + 1;
+		node.FirstChild  = 0;
+		node.NextSibling = nodes[parent].FirstChild;
+		nodes[parent].FirstChild = count;
+		buffer->NumNodes.store(count + 1, std::memory_order_release);
+
+		child = count;
+	}
+
+	buffer->Current = child;
+	return child;
+}
+
+void Profiler::Record(ThreadBuffer* buffer, UINT node, INT64 begin, INT64 end)
+{
+	// Only this thread writes to its buffer.  Claiming the slot before writing it
+	// lets a concurrent reader tell whether its copy of the slot was overwritten;
+	// the release store of Written publishes the event.
+	UINT64 written = buffer->Written.load(std::memory_order_relaxed);
+	buffer->Claimed.store(written + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Event& e = buffer->Events[written & (EventsPerThread-1)];
+	e.Node.store(node, std::memory_order_relaxed);
+	e.Begin.store(begin, std::memory_order_relaxed);
+	e.End.store(end, std::memory_order_relaxed);
+	buffer->Written.store(written + 1, std::memory_order_release);
+}
+
+UINT64 Profiler::CopyEvents(const ThreadBuffer* buffer, UINT64 first, std::vector<EventCopy>& events)
+{
+	events.clear();
+
+	// Events that were overwritten before we got to them are lost.
+	UINT64 written = buffer->Written.load(std::memory_order_acquire);
+	first = std::max<UINT64>(first, written > EventsPerThread ? written - EventsPerThread : 0);
+
+	for(UINT64 k = first; k < written; ++k)
+	{
+		const Event& e = buffer->Events[k & (EventsPerThread-1)];
+
+		EventCopy copy;
+		copy.Node  = e.Node.load(std::memory_order_relaxed);
+		copy.Begin = e.Begin.load(std::memory_order_relaxed);
+		copy.End   = e.End.load(std::memory_order_relaxed);
+		events.push_back(copy);
+	}
+
+	// Slots the owner claimed while we copied may hold parts of newer events, so
+	// drop the copies of those.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	UINT64 claimed = buffer->Claimed.load(std::memory_order_relaxed);
+	UINT64 firstIntact = claimed > EventsPerThread ? claimed - EventsPerThread : 0;
+	if( firstIntact > first )
+		events.erase(events.begin(), events.begin() + (size_t)std::min(firstIntact - first, (UINT64)events.size()));
+
+	return written;
+}
+
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer()
+{
+	// Threads normally record into a single profiler, so the last buffer used is
+	// cached and the thread's list is only searched when that changes.
+	thread_local ThreadBuffer* cached = 0;
+	thread_local UINT64 cachedId = 0;
+	if( cachedId == mId )
+		return cached;
+
+	thread_local ThreadBufferOwner owner;
+	for(size_t i = 0; i < owner.Entries.size(); ++i)
+	{
+		if( owner.Entries[i].ProfilerId == mId )
+		{
+			cached = owner.Entries[i].Buffer.get();
+			cachedId = mId;
+			return cached;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+
+	// Take over the buffer of a thread that has exited.
+	for(size_t i = 0; i < mThreads.size(); ++i)
+	{
+		if( !mThreads[i]->InUse.load(std::memory_order_acquire) )
+		{
+			mThreads[i]->InUse.store(true, std::memory_order_relaxed);
+
+			ThreadBufferOwner::Entry entry = { mId, mThreads[i] };
+			owner.Entries.push_back(entry);
+			cached = mThreads[i].get();
+			cachedId = mId;
+			return cached;
+		}
+	}
+
+	std::shared_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+	buffer->InUse.store(true);
+	buffer->ThreadIndex = (UINT)mThreads.size();
+	buffer->Nodes.reset(new Node[NodesPerThread]);
+	buffer->Nodes[0].Name        = "";
+	buffer->Nodes[0].Parent      = 0;
+	buffer->Nodes[0].Depth       = 0;
+	buffer->Nodes[0].FirstChild  = 0;
+	buffer->Nodes[0].NextSibling = 0;
+	buffer->NumNodes.store(1);
+	buffer->Current = 0;
+	buffer->Events.reset(new Event[EventsPerThread]);
+	buffer->Claimed.store(0);
+	buffer->Written.store(0);
+	buffer->Consumed = 0;
+
+	ThreadBufferOwner::Entry entry = { mId, buffer };
+	owner.Entries.push_back(entry);
+	cached = buffer.get();
+	cachedId = mId;
+	mThreads.push_back(buffer);
+
+	return cached;
+}
+
+UINT Profiler::GetThreadBufferCount()const
+{
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	return (UINT)mThreads.size();
+}
+
+void Profiler::EndFrame()
+{
+	INT64 now = Now();
+	float msPerTick = 1000.0f / mTicksPerSecond;
+
+	std::vector<ThreadBuffer*> threads;
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for(size_t i = 0; i < mThreads.size(); ++i)
+			threads.push_back(mThreads[i].get());
+	}
+
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+
+	// The whole frame, as the root of every thread's scopes.
+	if( mFrameScope == NoScope )
+		mFrameScope = FindScope(NoScope, "Frame", mFrameStart);
+	mScopes[mFrameScope].CurrentMs    = (now - mFrameStart)*msPerTick;
+	mScopes[mFrameScope].CurrentCalls = 1;
+	mFrameStart = now;
+
+	std::vector<EventCopy>& events = mEventScratch;
+	for(size_t t = 0; t < threads.size(); ++t)
+	{
+		ThreadBuffer* buffer = threads[t];
+		buffer->Consumed = CopyEvents(buffer, buffer->Consumed, events);
+
+		// Every node an event refers to was published before the event.
+		size_t numNodes = buffer->NumNodes.load(std::memory_order_acquire);
+		buffer->NodeScopes.resize(numNodes, NoScope);
+		buffer->NodeTicks.resize(numNodes, 0);
+		buffer->NodeCalls.resize(numNodes, 0);
+
+		// Sum per node, then hand the sums to the scopes.
+		for(size_t k = 0; k < events.size(); ++k)
+		{
+			const EventCopy& e = events[k];
+			if( buffer->NodeScopes[e.Node] == NoScope )
+				ScopeForNode(buffer, e.Node, e.Begin);
+
+			buffer->NodeTicks[e.Node] += e.End - e.Begin;
+			++buffer->NodeCalls[e.Node];
+		}
+
+		for(size_t n = 1; n < numNodes; ++n)
+		{
+			if( buffer->NodeCalls[n] == 0 )
+				continue;
+
+			ScopeHistory& scope = mScopes[buffer->NodeScopes[n]];
+			scope.CurrentMs    += buffer->NodeTicks[n]*msPerTick;
+			scope.CurrentCalls += buffer->NodeCalls[n];
+			buffer->NodeTicks[n] = 0;
+			buffer->NodeCalls[n] = 0;
+		}
+	}
+
+	for(size_t i = 0; i < mScopes.size(); ++i)
+	{
+		ScopeHistory& scope = mScopes[i];
+		PushFrame(scope, scope.CurrentMs);
+		scope.LastCalls    = scope.CurrentCalls;
+		scope.CurrentMs    = 0.0f;
+		scope.CurrentCalls = 0;
+	}
+}
+
+void Profiler::GetStats(std::vector<ScopeStats>& stats)const
+{
+	stats.clear();
+
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+
+	// Depth first, siblings in the order they were first seen.
+	std::vector<UINT> bySeen;
+	for(UINT i = 0; i < mScopes.size(); ++i)
+		bySeen.push_back(i);
+
+	std::stable_sort(bySeen.begin(), bySeen.end(), [this](UINT a, UINT b)
+	{
+		return mScopes[a].FirstSeen < mScopes[b].FirstSeen;
+	});
+
+	std::vector<const ScopeHistory*> order;
+	std::vector<UINT> pending;
+	for(size_t i = bySeen.size(); i-- > 0; )
+	{
+		if( mScopes[bySeen[i]].Parent == NoScope )
+			pending.push_back(bySeen[i]);
+	}
+
+	while( !pending.empty() )
+	{
+		UINT index = pending.back();
+		pending.pop_back();
+		order.push_back(&mScopes[index]);
+
+		for(size_t i = bySeen.size(); i-- > 0; )
+		{
+			if( mScopes[bySeen[i]].Parent == index )
+				pending.push_back(bySeen[i]);
+		}
+	}
+
+	std::vector<float> sorted;
+	for(size_t i = 0; i < order.size(); ++i)
+	{
+		const ScopeHistory& scope = *order[i];
+		if( scope.NumFrames == 0 )
+			continue;
+
+		sorted.assign(scope.FrameMs.begin(), scope.FrameMs.begin() + scope.NumFrames);
+		std::sort(sorted.begin(), sorted.end());
+
+		float sum = 0.0f;
+		for(size_t k = 0; k < sorted.size(); ++k)
+			sum += sorted[k];
+
+		// Nearest rank percentiles.
+		UINT n = scope.NumFrames;
+		UINT last = (scope.NextFrame + HistoryFrames - 1) % HistoryFrames;
+
+		ScopeStats s;
+		s.Name   = scope.Name;
+		s.Depth  = scope.Depth;
+		s.Calls  = scope.LastCalls;
+		s.LastMs = scope.FrameMs[last];
+		s.AvgMs  = sum / n;
+		s.P50Ms  = sorted[(n*50 + 99)/100 - 1];
+		s.P95Ms  = sorted[(n*95 + 99)/100 - 1];
+		s.P99Ms  = sorted[(n*99 + 99)/100 - 1];
+		s.MaxMs  = sorted[n-1];
+		stats.push_back(s);
+	}
+}
+
+std::string Profiler::FormatReport()const
+{
+	std::vector<ScopeStats> stats;
+	GetStats(stats);
+
+	std::string report = "scope                                    calls    avg ms    p50 ms    p95 ms    p99 ms    max ms\n";
+	for(size_t i = 0; i < stats.size(); ++i)
+	{
+		const ScopeStats& s = stats[i];
+
+		std::string name(2*s.Depth, ' ');
+		name += s.Name;
+
+		char line[256];
+		snprintf(line, sizeof(line), "%-40s %5u %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+			name.c_str(), s.Calls, s.AvgMs, s.P50Ms, s.P95Ms, s.P99Ms, s.MaxMs);
+		report += line;
+	}
+
+	return report;
+}
+
+bool Profiler::WriteChromeTrace(const std::wstring& filename)const
+{
+	std::ofstream out;
+#if defined(_WIN32)
+	out.open(filename.c_str());
+#else
+	// Paths are passed through as the locale's multibyte encoding.
+	std::vector<char> path(filename.size()*4 + 1);
+	if( wcstombs(&path[0], filename.c_str(), path.size()) == (size_t)-1 )
+		return false;
+	out.open(&path[0]);
+#endif
+	if( !out )
+		return false;
+
+	// Timestamps are in microseconds, relative to the earliest buffered event.
+	std::vector<ThreadBuffer*> threads;
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for(size_t i = 0; i < mThreads.size(); ++i)
+			threads.push_back(mThreads[i].get());
+	}
+
+	std::vector<std::vector<EventCopy> > events(threads.size());
+	INT64 origin = 0;
+	bool haveOrigin = false;
+	for(size_t t = 0; t < threads.size(); ++t)
+	{
+		CopyEvents(threads[t], 0, events[t]);
+		for(size_t k = 0; k < events[t].size(); ++k)
+		{
+			if( !haveOrigin || events[t][k].Begin < origin )
+				origin = events[t][k].Begin;
+			haveOrigin = true;
+		}
+	}
+
+	double usPerTick = 1000000.0 / mTicksPerSecond;
+
+	out << "{\"traceEvents\":[";
+	bool firstEvent = true;
+	for(size_t t = 0; t < threads.size(); ++t)
+	{
+		const ThreadBuffer* buffer = threads[t];
+		for(size_t k = 0; k < events[t].size(); ++k)
+		{
+			const EventCopy& e = events[t][k];
+
+			std::string name;
+			for(const char* c = buffer->Nodes[e.Node].Name; *c; ++c)
+			{
+				if( *c == '"' || *c == '\\' )
+					name += '\\';
+				name += *c;
+			}
+
+			char line[512];
+			snprintf(line, sizeof(line),
+				"%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				firstEvent ? "" : ",", name.c_str(), buffer->ThreadIndex,
+				(e.Begin - origin)*usPerTick, (e.End - e.Begin)*usPerTick);
+			out << line;
+			firstEvent = false;
+		}
+	}
+	out << "\n]}\n";
+
+	return !out.fail();
+}
+
+void Profiler::Reset()
+{
+	std::lock_guard<std::mutex> threadsLock(mThreadsMutex);
+	std::lock_guard<std::mutex> statsLock(mStatsMutex);
+
+	for(size_t i = 0; i < mThreads.size(); ++i)
+	{
+		mThreads[i]->Consumed = mThreads[i]->Written.load(std::memory_order_acquire);
+		mThreads[i]->NodeScopes.clear();
+		mThreads[i]->NodeTicks.clear();
+		mThreads[i]->NodeCalls.clear();
+	}
+
+	mScopes.clear();
+	mFrameScope = NoScope;
+	mFrameStart = Now();
+}
+
+UINT Profiler::ScopeForNode(ThreadBuffer* buffer, UINT node, INT64 begin)
+{
+	if( node == 0 )
+		return mFrameScope;
+
+	if( buffer->NodeScopes[node] == NoScope )
+	{
+		const Node& n = buffer->Nodes[node];
+		UINT parent = ScopeForNode(buffer, n.Parent, begin);
+		buffer->NodeScopes[node] = FindScope(parent, n.Name, begin);
+	}
+
+	return buffer->NodeScopes[node];
+}
+
+UINT Profiler::FindScope(UINT parent, const char* name, INT64 begin)
+{
+	// Only called the first time a thread's node is seen, so a search is fine.  The
+	// same literal may live at different addresses in different modules, so compare
+	// the text.
+	for(UINT i = 0; i < mScopes.size(); ++i)
+	{
+		if( mScopes[i].Parent == parent && (mScopes[i].Name == name || strcmp(mScopes[i].Name, name) == 0) )
+			return i;
+	}
+
+	ScopeHistory scope;
+	scope.Name         = name;
+	scope.Parent       = parent;
+	scope.Depth        = parent == NoScope ? 0 : mScopes[parent].Depth + 1;
+	scope.FirstSeen    = begin;
+	scope.FrameMs.assign(HistoryFrames, 0.0f);
+	scope.NumFrames    = 0;
+	scope.NextFrame    = 0;
+	scope.CurrentMs    = 0.0f;
+	scope.CurrentCalls = 0;
+	scope.LastCalls    = 0;
+	mScopes.push_back(scope);
+
+	return (UINT)mScopes.size() - 1;
+}
+
+void Profiler::PushFrame(ScopeHistory& scope, float ms)
+{
+	scope.FrameMs[scope.NextFrame] = ms;
+	scope.NextFrame = (scope.NextFrame + 1) % HistoryFrames;
+	scope.NumFrames = std::min(scope.NumFrames + 1, HistoryFrames);
+}
+
+ProfileScope::ProfileScope(const char* name)
+: mBuffer(0), mNode(0), mBegin(0)
+{
+	Profiler& profiler = Profiler::Default();
+	if( profiler.IsEnabled() )
+	{
+		mBuffer = profiler.GetThreadBuffer();
+		mNode = Profiler::EnterScope(mBuffer, name);
+		mBegin = Profiler::Now();
+	}
+}
+
+ProfileScope::~ProfileScope()
+{
+	if( mNode != 0 )
+	{
+		INT64 end = Profiler::Now();
+		mBuffer->Current = mBuffer->Nodes[mNode].Parent;
+		Profiler::Record(mBuffer, mNode, mBegin, end);
+	}
+}
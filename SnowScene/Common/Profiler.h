@@ -0,0 +1,229 @@
+//***************************************************************************************
+// Profiler.h
+//
+// Hierarchical CPU frame profiler.  Code marks regions with PROFILE_SCOPE("name"); each
+// scope writes one event into a ring buffer owned by the calling thread, so recording
+// takes no lock and allocates nothing once the thread has seen the scope.
+//
+// Scopes are identified by their parent scope and name, so a name used under two
+// different parents is reported as two entries.  Each thread keeps its own tree of the
+// scopes it has opened; an event refers to a node of that tree.
+//
+// EndFrame(), called once per frame, folds the new events into per-scope frame times
+// from which GetStats() reports the average and p50/p95/p99 over recent frames.
+// WriteChromeTrace() dumps the buffered events for chrome://tracing.  Both may run
+// while other threads record: events a thread overwrites during the read are dropped
+// rather than reported torn.
+//
+// On x86 and x64 the clock is the time stamp counter, calibrated once against the
+// system clock; elsewhere it is QueryPerformanceCounter or steady_clock.
+//
+// A thread's buffer is handed to the next new thread once it exits, so short-lived
+// worker threads do not each leave a buffer behind.
+
+// Scope names must be string literals (or otherwise outlive the profiler).  Define
+// DISABLE_PROFILER to compile the scopes out.
+//***************************************************************************************
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Windows.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Profiler
+{
+public:
+	struct ScopeStats
+	{
+		const char* Name;
+		UINT Depth;          // 0 for "Frame", 1 for top level scopes, ...
+		UINT Calls;          // calls in the last frame
+		float LastMs;        // time in the last frame, summed over calls
+		float AvgMs;
+		float P50Ms;
+		float P95Ms;
+		float P99Ms;
+		float MaxMs;
+	};
+
+	// Events kept per thread, distinct scopes (name and parent) per thread, and frames
+	// of history kept per scope.
+	static const UINT EventsPerThread = 1 << 16;
+	static const UINT NodesPerThread = 4096;
+	static const UINT HistoryFrames = 512;
+
+public:
+	Profiler();
+	~Profiler();
+
+	// Process wide profiler, created on first use.
+	static Profiler& Default();
+
+	void SetEnabled(bool enabled);
+	bool IsEnabled()const;
+
+	// Closes the current frame.  Call from one thread, between frames.
+	void EndFrame();
+
+	// Stats per scope, plus a "Frame" entry for the time between EndFrame() calls.
+	// Ordered depth first, each scope followed by its children in the order they
+	// were first seen.
+	void GetStats(std::vector<ScopeStats>& stats)const;
+
+	// One line per scope, indented by depth.
+	std::string FormatReport()const;
+
+	// Writes the buffered events in the Chrome trace event format.  Each buffer is
+	// one trace thread, so threads that ran one after another may share one.
+	bool WriteChromeTrace(const std::wstring& filename)const;
+
+	// Per-thread buffers allocated so far; at most the number of threads that have
+	// recorded at the same time.
+	UINT GetThreadBufferCount()const;
+
+	// Drops all buffered events and history.
+	void Reset();
+
+	// Raw clock; ticks per second are given by TicksPerSecond().
+	static INT64 Now();
+	static INT64 TicksPerSecond();
+
+private:
+	friend class ProfileScope;
+
+	// A scope as seen by one thread.  Name, Parent and Depth are written before the
+	// node is published through NumNodes and never change; the child links are only
+	// used by the owning thread.
+	struct Node
+	{
+		const char* Name;
+		UINT Parent;
+		UINT Depth;
+		UINT FirstChild;
+		UINT NextSibling;
+	};
+
+	// Ring buffer slot.  The fields are atomics so EndFrame() can copy slots that
+	// the owner may be reusing; torn copies are detected and dropped.
+	struct Event
+	{
+		std::atomic<UINT> Node;
+		std::atomic<INT64> Begin;
+		std::atomic<INT64> End;
+	};
+
+	struct EventCopy
+	{
+		UINT Node;
+		INT64 Begin;
+		INT64 End;
+	};
+
+	struct ThreadBuffer
+	{
+		// Cleared when the thread using the buffer exits; the next thread to record
+		// takes the buffer over, with its nodes and buffered events.
+		std::atomic<bool> InUse;
+		UINT ThreadIndex;
+
+		// Node 0 is the thread's root; Current is the innermost open scope.
+		std::unique_ptr<Node[]> Nodes;
+		std::atomic<UINT> NumNodes;
+		UINT Current;
+
+		// Claimed counts events whose slot the owner has started to write,
+		// Written those that are complete.
+		std::unique_ptr<Event[]> Events;
+		std::atomic<UINT64> Claimed;
+		std::atomic<UINT64> Written;
+
+		// Used by EndFrame() under mStatsMutex.
+		UINT64 Consumed;
+		std::vector<UINT> NodeScopes;
+		std::vector<INT64> NodeTicks;
+		std::vector<UINT> NodeCalls;
+	};
+
+	struct ScopeHistory
+	{
+		const char* Name;
+		UINT Parent;
+		UINT Depth;
+		INT64 FirstSeen;
+		std::vector<float> FrameMs;
+		UINT NumFrames;
+		UINT NextFrame;
+		float CurrentMs;
+		UINT CurrentCalls;
+		UINT LastCalls;
+	};
+
+	// Releases a thread's buffers when it exits (see Profiler.cpp).
+	struct ThreadBufferOwner;
+
+	static const UINT NoScope = ~0u;
+
+	ThreadBuffer* GetThreadBuffer();
+	static UINT EnterScope(ThreadBuffer* buffer, const char* name);
+	static void Record(ThreadBuffer* buffer, UINT node, INT64 begin, INT64 end);
+	static UINT64 CopyEvents(const ThreadBuffer* buffer, UINT64 first, std::vector<EventCopy>& events);
+	UINT ScopeForNode(ThreadBuffer* buffer, UINT node, INT64 begin);
+	UINT FindScope(UINT parent, const char* name, INT64 begin);
+	void PushFrame(ScopeHistory& scope, float ms);
+
+	Profiler(const Profiler& rhs);
+	Profiler& operator=(const Profiler& rhs);
+
+private:
+	// Distinguishes this profiler from any later one at the same address, for the
+	// threads' cached buffers.
+	UINT64 mId;
+
+	std::atomic<bool> mEnabled;
+	INT64 mTicksPerSecond;
+	INT64 mFrameStart;
+
+	// Guards mThreads.  A thread's ThreadBufferOwner shares its buffers, so they stay
+	// valid until the thread exits even if the profiler is destroyed first.
+	mutable std::mutex mThreadsMutex;
+	std::vector<std::shared_ptr<ThreadBuffer> > mThreads;
+
+	// Guards the histories, the buffers' EndFrame() state and the scratch copy of
+	// their events.
+	mutable std::mutex mStatsMutex;
+	std::vector<ScopeHistory> mScopes;
+	UINT mFrameScope;
+	std::vector<EventCopy> mEventScratch;
+};
+
+// Times the enclosing block.
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name);
+	~ProfileScope();
+
+private:
+	ProfileScope(const ProfileScope& rhs);
+	ProfileScope& operator=(const ProfileScope& rhs);
+
+private:
+	Profiler::ThreadBuffer* mBuffer;
+	UINT mNode;
+	INT64 mBegin;
+};
+
+#if defined(DISABLE_PROFILER)
+	#define PROFILE_SCOPE(name)
+#else
+	#define PROFILE_SCOPE_CONCAT2(a, b) a##b
+	#define PROFILE_SCOPE_CONCAT(a, b)  PROFILE_SCOPE_CONCAT2(a, b)
+	#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_CONCAT(profileScope, __LINE__)(name)
+#endif
+
+#endif // PROFILER_H
@@ -6,12 +6,6 @@ TextureMgr::TextureMgr() : md3dDevice(0)
 
 TextureMgr::~TextureMgr()
 {
-	for(auto it = mTextureSRV.begin(); it != mTextureSRV.end(); ++it)
-    {
-		ReleaseCOM(it->second);
-    }
-
-	mTextureSRV.clear();
 }
 
 void TextureMgr::Init(ID3D11Device* device)
@@ -23,24 +17,29 @@ ID3D11ShaderResourceView* TextureMgr::CreateTexture(std::wstring filename)
 {
 	ID3D11ShaderResourceView* srv = 0;
 
-	// Does it already exist?
-	if( mTextureSRV.find(filename) != mTextureSRV.end() )
+	// A missing or invalid file makes the cache throw; report it as a null view, as
+	// a failed CreateDDSTextureFromFile did before.  Failures are not cached, so a
+	// later call tries the file again.
+	try
 	{
-		srv = mTextureSRV[filename];
+		mTextures.GetOrLoad(filename.c_str(), [this](const wchar_t* name, ID3D11ShaderResourceView** textureView)
+		{
+			ID3D11Resource* texResource = nullptr;
+
+			HR(DirectX::CreateDDSTextureFromFile(md3dDevice,
+				name, &texResource, textureView));
+			ReleaseCOM(texResource); // view saves reference
+		}, &srv);
 	}
-	else
+	catch(...)
 	{
-		ID3D11Resource* texResource = nullptr;
-
-		HR(DirectX::CreateDDSTextureFromFile(md3dDevice,
-			filename.c_str(), &texResource, &srv));
-		ReleaseCOM(texResource); // view saves reference
-
-		//HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, filename.c_str(), 0, 0, &srv, 0 ));
-
-		mTextureSRV[filename] = srv;
+		return 0;
 	}
 
+	// The cache keeps its own reference.
+	if( srv )
+		srv->Release();
+
 	return srv;
 }
  
@@ -2,11 +2,13 @@
 #define TEXTUREMGR_H
 
 #include "d3dUtil.h"
-#include <map>
+#include "TextureCache.h"
 
 ///<summary>
 /// Simple texture manager to avoid loading duplicate textures from file.  That can
 /// happen, for example, if multiple meshes reference the same texture filename. 
+/// CreateTexture may be called from several threads at once; a file requested by
+/// more than one of them is still only loaded once.
 ///</summary>
 class TextureMgr
 {
@@ -16,6 +18,8 @@ public:
 
 	void Init(ID3D11Device* device);
 
+	// The view stays valid for as long as the manager, so callers do not release it.
+	// Returns null if the file is missing or is not a valid DDS texture.
 	ID3D11ShaderResourceView* CreateTexture(std::wstring filename);
 
 private:
@@ -24,7 +28,10 @@ private:
 	
 private:
 	ID3D11Device* md3dDevice;
-	std::map<std::wstring, ID3D11ShaderResourceView*> mTextureSRV;
+
+	// Callers hold no references of their own, so the cache keeps the default budget
+	// and never evicts.
+	DirectX::TextureCache mTextures;
 };
 
 #endif // TEXTUREMGR_H
\ No newline at end of file
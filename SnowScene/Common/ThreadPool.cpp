@@ -0,0 +1,198 @@
+//***************************************************************************************
+// ThreadPool.cpp
+//***************************************************************************************
+
+#include "ThreadPool.h"
+
+namespace
+{
+	// Set while a thread runs loop chunks so nested ParallelFor calls run inline
+	// instead of deadlocking on the pool.
+	thread_local bool tInsideLoop = false;
+
+	// Sets tInsideLoop for a scope, and restores it however the scope is left.
+	class InsideLoopScope
+	{
+	public:
+		InsideLoopScope() : mWasInside(tInsideLoop) { tInsideLoop = true; }
+		~InsideLoopScope() { tInsideLoop = mWasInside; }
+
+	private:
+		InsideLoopScope(const InsideLoopScope& rhs);
+		InsideLoopScope& operator=(const InsideLoopScope& rhs);
+
+		bool mWasInside;
+	};
+}
+
+ThreadPool::ThreadPool()
+: mGeneration(0), mActiveWorkers(0), mQuit(false),
+  mJobFn(0), mJobCount(0), mJobGrain(1), mJobChunks(0),
+  mNextChunk(0)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	Shutdown();
+}
+
+void ThreadPool::Init(UINT numWorkers)
+{
+	// In case Init() called again.
+	Shutdown();
+
+	if( numWorkers == 0 )
+	{
+		UINT hw = std::thread::hardware_concurrency();
+		numWorkers = hw > 1 ? hw - 1 : 0;
+	}
+
+	mQuit = false;
+	for(UINT i = 0; i < numWorkers; ++i)
+		mWorkers.push_back(std::thread(&ThreadPool::WorkerMain, this));
+}
+
+void ThreadPool::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWakeCV.notify_all();
+
+	for(size_t i = 0; i < mWorkers.size(); ++i)
+		mWorkers[i].join();
+
+	mWorkers.clear();
+}
+
+UINT ThreadPool::ThreadCount()const
+{
+	return (UINT)mWorkers.size() + 1;
+}
+
+void ThreadPool::ParallelFor(UINT count, UINT grainSize, const RangeFn& fn)
+{
+	if( count == 0 )
+		return;
+
+	if( grainSize == 0 )
+		grainSize = 1;
+
+	UINT numChunks = (count + grainSize - 1) / grainSize;
+
+	// Nothing to share out.
+	if( mWorkers.empty() || numChunks == 1 || tInsideLoop )
+	{
+		fn(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit(mSubmitMutex);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	// A worker that woke up late for the previous loop may still hold its parameters.
+	mDoneCV.wait(lock, [this]() { return mActiveWorkers == 0; });
+
+	mJobFn      = &fn;
+	mJobCount   = count;
+	mJobGrain   = grainSize;
+	mJobChunks  = numChunks;
+	mJobError   = nullptr;
+	mNextChunk  = 0;
+	++mGeneration;
+
+	lock.unlock();
+	mWakeCV.notify_all();
+
+	{
+		InsideLoopScope inside;
+		RunChunks(fn, count, grainSize, numChunks);
+	}
+
+	// Every chunk has been claimed, but workers that picked up this loop must leave
+	// RunChunks before fn goes out of scope.  A worker only claims chunks while it is
+	// counted as active.
+	lock.lock();
+	mDoneCV.wait(lock, [this]() { return mActiveWorkers == 0; });
+	mJobFn = 0;
+
+	std::exception_ptr error = mJobError;
+	mJobError = nullptr;
+	lock.unlock();
+
+	if( error )
+		std::rethrow_exception(error);
+}
+
+ThreadPool& ThreadPool::Default()
+{
+	struct DefaultPool
+	{
+		DefaultPool() { Pool.Init(); }
+		ThreadPool Pool;
+	};
+
+	static DefaultPool pool;
+	return pool.Pool;
+}
+
+void ThreadPool::WorkerMain()
+{
+	tInsideLoop = true;
+
+	UINT64 seen = 0;
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		mWakeCV.wait(lock, [&]() { return mQuit || mGeneration != seen; });
+		if( mQuit )
+			return;
+
+		// Copy the loop parameters while they cannot change.
+		seen = mGeneration;
+		const RangeFn* fn = mJobFn;
+		UINT count  = mJobCount;
+		UINT grain  = mJobGrain;
+		UINT chunks = mJobChunks;
+		++mActiveWorkers;
+		lock.unlock();
+
+		if( fn )
+			RunChunks(*fn, count, grain, chunks);
+
+		lock.lock();
+		--mActiveWorkers;
+		mDoneCV.notify_all();
+	}
+}
+
+void ThreadPool::RunChunks(const RangeFn& fn, UINT count, UINT grainSize, UINT numChunks)
+{
+	for(;;)
+	{
+		UINT chunk = mNextChunk++;
+		if( chunk >= numChunks )
+			return;
+
+		UINT begin = chunk*grainSize;
+		UINT end   = count - begin > grainSize ? begin + grainSize : count;
+
+		try
+		{
+			fn(begin, end);
+		}
+		catch(...)
+		{
+			// Keep the first error and leave the chunks nobody has started.
+			std::lock_guard<std::mutex> lock(mMutex);
+			if( !mJobError )
+				mJobError = std::current_exception();
+
+			mNextChunk = numChunks;
+			return;
+		}
+	}
+}
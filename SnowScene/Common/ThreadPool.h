@@ -0,0 +1,79 @@
+//***************************************************************************************
+// ThreadPool.h
+//
+// Small fixed-size worker pool for the CPU side systems (particles, terrain, waves).
+// Work is submitted as a data parallel loop; the calling thread takes part in the
+// loop and the call returns once every chunk has been processed.
+//***************************************************************************************
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <Windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// Loop body; invoked with a half open range [begin, end).
+	typedef std::function<void(UINT begin, UINT end)> RangeFn;
+
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	// Spawns numWorkers threads.  Zero picks one worker per hardware thread, minus
+	// the calling thread.
+	void Init(UINT numWorkers = 0);
+	void Shutdown();
+
+	// Number of threads that execute loop chunks, including the caller.
+	UINT ThreadCount()const;
+
+	// Splits [0, count) into chunks of grainSize items and runs fn over them on the
+	// workers and the calling thread.  Calls made from inside a loop body run inline.
+	// If fn throws, chunks not yet started are skipped and, once every running chunk has
+	// finished, the first exception is rethrown on the calling thread.
+	void ParallelFor(UINT count, UINT grainSize, const RangeFn& fn);
+
+	// Process wide pool, created on first use.
+	static ThreadPool& Default();
+
+private:
+	void WorkerMain();
+	void RunChunks(const RangeFn& fn, UINT count, UINT grainSize, UINT numChunks);
+
+	ThreadPool(const ThreadPool& rhs);
+	ThreadPool& operator=(const ThreadPool& rhs);
+
+private:
+	std::vector<std::thread> mWorkers;
+
+	// Serializes ParallelFor calls from different threads.
+	std::mutex mSubmitMutex;
+
+	std::mutex mMutex;
+	std::condition_variable mWakeCV;
+	std::condition_variable mDoneCV;
+	UINT64 mGeneration;
+	UINT mActiveWorkers;
+	bool mQuit;
+
+	// Current loop.
+	const RangeFn* mJobFn;
+	UINT mJobCount;
+	UINT mJobGrain;
+	UINT mJobChunks;
+	std::atomic<UINT> mNextChunk;
+
+	// First exception thrown by the current loop's body.
+	std::exception_ptr mJobError;
+};
+
+#endif // THREADPOOL_H
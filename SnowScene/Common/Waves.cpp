@@ -3,6 +3,7 @@
 //***************************************************************************************
 
 #include "Waves.h"
+#include "ThreadPool.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
@@ -10,8 +11,8 @@ using namespace DirectX;
 
 Waves::Waves()
 : mNumRows(0), mNumCols(0), mVertexCount(0), mTriangleCount(0), 
-  mK1(0.0f), mK2(0.0f), mK3(0.0f), mTimeStep(0.0f), mSpatialStep(0.0f),
-  mPrevSolution(0), mCurrSolution(0), mNormals(0), mTangentX(0)
+  mK1(0.0f), mK2(0.0f), mK3(0.0f), mTimeStep(0.0f), mSpatialStep(0.0f), mTime(0.0f),
+  mPool(0), mPrevSolution(0), mCurrSolution(0), mNormals(0), mTangentX(0)
 {
 }
 
@@ -53,7 +54,18 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
+XMFLOAT3 Waves::operator[](int i)const
+{
+	UINT row = i / mNumCols;
+	UINT col = i % mNumCols;
+
+	float halfWidth = (mNumCols-1)*mSpatialStep*0.5f;
+	float halfDepth = (mNumRows-1)*mSpatialStep*0.5f;
+
+	return XMFLOAT3(-halfWidth + col*mSpatialStep, mCurrSolution[i], halfDepth - row*mSpatialStep);
+}
+
+void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping, ThreadPool* pool)
 {
 	mNumRows  = m;
 	mNumCols  = n;
@@ -63,6 +75,8 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 
 	mTimeStep    = dt;
 	mSpatialStep = dx;
+	mTime        = 0.0f;
+	mPool        = pool ? pool : &ThreadPool::Default();
 
 	float d = damping*dt+2.0f;
 	float e = (speed*speed)*(dt*dt)/(dx*dx);
@@ -76,94 +90,177 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 	delete[] mNormals;
 	delete[] mTangentX;
 
-	mPrevSolution = new XMFLOAT3[m*n];
-	mCurrSolution = new XMFLOAT3[m*n];
+	mPrevSolution = new float[m*n];
+	mCurrSolution = new float[m*n];
 	mNormals      = new XMFLOAT3[m*n];
 	mTangentX     = new XMFLOAT3[m*n];
 
-	// Generate grid vertices in system memory.
-
-	float halfWidth = (n-1)*dx*0.5f;
-	float halfDepth = (m-1)*dx*0.5f;
-	for(UINT i = 0; i < m; ++i)
-	{
-		float z = halfDepth - i*dx;
-		for(UINT j = 0; j < n; ++j)
-		{
-			float x = -halfWidth + j*dx;
-
-			mPrevSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mCurrSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mNormals[i*n+j]      = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			mTangentX[i*n+j]     = XMFLOAT3(1.0f, 0.0f, 0.0f);
-		}
-	}
+	// Start from a flat surface.
+	std::fill(mPrevSolution, mPrevSolution + m*n, 0.0f);
+	std::fill(mCurrSolution, mCurrSolution + m*n, 0.0f);
+	std::fill(mNormals, mNormals + m*n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+	std::fill(mTangentX, mTangentX + m*n, XMFLOAT3(1.0f, 0.0f, 0.0f));
 }
 
 void Waves::Update(float dt)
 {
-	static float t = 0;
-
 	// Accumulate time.
-	t += dt;
+	mTime += dt;
 
 	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	if( mTime >= mTimeStep && mNumRows > 2 )
 	{
-		// Only update interior points; we use zero boundary conditions.
-		for(UINT i = 1; i < mNumRows-1; ++i)
+		// Only update interior points; we use zero boundary conditions.  Each task
+		// steps a band of rows and computes the normals of the rows whose neighbors
+		// it also owns; the two edge rows of every band are finished afterwards, once
+		// the bands next to them have been stepped.
+		UINT numInterior = mNumRows-2;
+		UINT numBands = (numInterior + RowsPerTask-1) / RowsPerTask;
+
+		mPool->ParallelFor(numBands, 1, [&](UINT bandBegin, UINT bandEnd)
 		{
-			for(UINT j = 1; j < mNumCols-1; ++j)
+			for(UINT band = bandBegin; band < bandEnd; ++band)
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				UINT begin = 1 + band*RowsPerTask;
+				UINT end   = std::min(begin + RowsPerTask, mNumRows-1);
+				UpdateRows(begin, end);
 			}
-		}
+		});
+
+		mPool->ParallelFor(numBands, 16, [&](UINT bandBegin, UINT bandEnd)
+		{
+			for(UINT band = bandBegin; band < bandEnd; ++band)
+			{
+				UINT begin = 1 + band*RowsPerTask;
+				UINT end   = std::min(begin + RowsPerTask, mNumRows-1);
+				UpdateNormals(begin);
+				if( end-1 > begin )
+					UpdateNormals(end-1);
+			}
+		});
 
 		// We just overwrote the previous buffer with the new data, so
 		// this data needs to become the current solution and the old
 		// current solution becomes the new previous solution.
 		std::swap(mPrevSolution, mCurrSolution);
 
-		t = 0.0f; // reset time
+		mTime = 0.0f; // reset time
+	}
+}
+
+void Waves::UpdateRows(UINT begin, UINT end)
+{
+	XMVECTOR k1 = XMVectorReplicate(mK1);
+	XMVECTOR k2 = XMVectorReplicate(mK2);
+	XMVECTOR k3 = XMVectorReplicate(mK3);
+
+	for(UINT i = begin; i < end; ++i)
+	{
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element) 
+		// because we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to 
+		// keep consistent with our row indices going down.
+		float* prev = &mPrevSolution[i*mNumCols];
+		const float* curr = &mCurrSolution[i*mNumCols];
+		const float* up   = curr - mNumCols;
+		const float* down = curr + mNumCols;
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		for(UINT i = 1; i < mNumRows-1; ++i)
+		// Four columns at a time.  The terms are combined in the same order as the
+		// scalar tail, with separate multiplies and adds, so both give the same bits.
+		UINT j = 1;
+		for(; j + 4 <= mNumCols-1; j += 4)
 		{
-			for(UINT j = 1; j < mNumCols-1; ++j)
-			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
-			}
+			XMVECTOR neighbors = XMVectorAdd(XMVectorAdd(XMVectorAdd(
+				XMLoadFloat4((const XMFLOAT4*)&down[j]),
+				XMLoadFloat4((const XMFLOAT4*)&up[j])),
+				XMLoadFloat4((const XMFLOAT4*)&curr[j+1])),
+				XMLoadFloat4((const XMFLOAT4*)&curr[j-1]));
+
+			XMVECTOR h = XMVectorAdd(XMVectorAdd(
+				XMVectorMultiply(k1, XMLoadFloat4((const XMFLOAT4*)&prev[j])),
+				XMVectorMultiply(k2, XMLoadFloat4((const XMFLOAT4*)&curr[j]))),
+				XMVectorMultiply(k3, neighbors));
+
+			XMStoreFloat4((XMFLOAT4*)&prev[j], h);
+		}
+
+		for(; j < mNumCols-1; ++j)
+		{
+			prev[j] = 
+				mK1*prev[j] +
+				mK2*curr[j] +
+				mK3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
 		}
+
+		// Rows above have all their new neighbors now.
+		if( i >= begin+2 )
+			UpdateNormals(i-1);
+	}
+}
+
+void Waves::UpdateNormals(UINT i)
+{
+	//
+	// Compute normals using finite difference scheme, from the heights just
+	// written to the previous solution buffer.
+	//
+	const float* row  = &mPrevSolution[i*mNumCols];
+	const float* up   = row - mNumCols;
+	const float* down = row + mNumCols;
+
+	XMVECTOR twoDx = XMVectorReplicate(2.0f*mSpatialStep);
+
+	// Four columns at a time, with x, y and z of the vectors in separate registers.
+	UINT j = 1;
+	for(; j + 4 <= mNumCols-1; j += 4)
+	{
+		XMVECTOR l = XMLoadFloat4((const XMFLOAT4*)&row[j-1]);
+		XMVECTOR r = XMLoadFloat4((const XMFLOAT4*)&row[j+1]);
+		XMVECTOR t = XMLoadFloat4((const XMFLOAT4*)&up[j]);
+		XMVECTOR b = XMLoadFloat4((const XMFLOAT4*)&down[j]);
+
+		// n = (l-r, 2dx, b-t) and T = (2dx, r-l, 0), both normalized.
+		XMVECTOR nx = XMVectorSubtract(l, r);
+		XMVECTOR nz = XMVectorSubtract(b, t);
+		XMVECTOR twoDxSq = XMVectorMultiply(twoDx, twoDx);
+		XMVECTOR nLen = XMVectorSqrt(XMVectorAdd(XMVectorAdd(XMVectorMultiply(nx, nx), twoDxSq), XMVectorMultiply(nz, nz)));
+		XMVECTOR tLen = XMVectorSqrt(XMVectorAdd(twoDxSq, XMVectorMultiply(nx, nx)));
+
+		XMFLOAT4 nX, nY, nZ, tX, tY;
+		XMStoreFloat4(&nX, XMVectorDivide(nx, nLen));
+		XMStoreFloat4(&nY, XMVectorDivide(twoDx, nLen));
+		XMStoreFloat4(&nZ, XMVectorDivide(nz, nLen));
+		XMStoreFloat4(&tX, XMVectorDivide(twoDx, tLen));
+		XMStoreFloat4(&tY, XMVectorDivide(XMVectorNegate(nx), tLen));
+
+		XMFLOAT3* normals  = &mNormals[i*mNumCols+j];
+		XMFLOAT3* tangents = &mTangentX[i*mNumCols+j];
+		normals[0]  = XMFLOAT3(nX.x, nY.x, nZ.x);
+		normals[1]  = XMFLOAT3(nX.y, nY.y, nZ.y);
+		normals[2]  = XMFLOAT3(nX.z, nY.z, nZ.z);
+		normals[3]  = XMFLOAT3(nX.w, nY.w, nZ.w);
+		tangents[0] = XMFLOAT3(tX.x, tY.x, 0.0f);
+		tangents[1] = XMFLOAT3(tX.y, tY.y, 0.0f);
+		tangents[2] = XMFLOAT3(tX.z, tY.z, 0.0f);
+		tangents[3] = XMFLOAT3(tX.w, tY.w, 0.0f);
+	}
+
+	for(; j < mNumCols-1; ++j)
+	{
+		float l = row[j-1];
+		float r = row[j+1];
+		float t = up[j];
+		float b = down[j];
+
+		XMVECTOR n = XMVector3Normalize(XMVectorSet(-r+l, 2.0f*mSpatialStep, b-t, 0.0f));
+		XMStoreFloat3(&mNormals[i*mNumCols+j], n);
+
+		XMVECTOR T = XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r-l, 0.0f, 0.0f));
+		XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
 	}
 }
 
@@ -176,10 +273,10 @@ void Waves::Disturb(UINT i, UINT j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrSolution[i*mNumCols+j]     += magnitude;
+	mCurrSolution[i*mNumCols+j+1]   += halfMag;
+	mCurrSolution[i*mNumCols+j-1]   += halfMag;
+	mCurrSolution[(i+1)*mNumCols+j] += halfMag;
+	mCurrSolution[(i-1)*mNumCols+j] += halfMag;
 }
 	
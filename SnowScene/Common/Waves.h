@@ -4,6 +4,10 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// Heights are kept in their own float planes; the x and z of a grid point follow from
+// its row and column.  Each step splits the rows across the thread pool and computes
+// the normals and tangents in the same sweep as the heights.
 //***************************************************************************************
 
 #ifndef WAVES_H
@@ -12,6 +16,8 @@
 #include <Windows.h>
 #include <DirectXMath.h>
 
+class ThreadPool;
+
 class Waves
 {
 public:
@@ -26,7 +32,11 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-	const DirectX::XMFLOAT3& operator[](int i)const { return mCurrSolution[i]; }
+	DirectX::XMFLOAT3 operator[](int i)const;
+
+	// Returns the height at the ith grid point; all heights are contiguous, row by row.
+	float Height(int i)const { return mCurrSolution[i]; }
+	const float* Heights()const { return mCurrSolution; }
 
 	// Returns the solution normal at the ith grid point.
 	const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
@@ -34,10 +44,18 @@ public:
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
 	const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
 
-	void Init(UINT m, UINT n, float dx, float dt, float speed, float damping);
+	// pool may be null, in which case ThreadPool::Default() is used.
+	void Init(UINT m, UINT n, float dx, float dt, float speed, float damping, ThreadPool* pool = 0);
 	void Update(float dt);
 	void Disturb(UINT i, UINT j, float magnitude);
 
+private:
+	void UpdateRows(UINT begin, UINT end);
+	void UpdateNormals(UINT i);
+
+	// Rows handed to each worker per step.
+	static const UINT RowsPerTask = 32;
+
 private:
 	UINT mNumRows;
 	UINT mNumCols;
@@ -53,8 +71,13 @@ private:
 	float mTimeStep;
 	float mSpatialStep;
 
-	DirectX::XMFLOAT3* mPrevSolution;
-	DirectX::XMFLOAT3* mCurrSolution;
+	// Time accumulated since the last step.
+	float mTime;
+
+	ThreadPool* mPool;
+
+	float* mPrevSolution;
+	float* mCurrSolution;
 	DirectX::XMFLOAT3* mNormals;
 	DirectX::XMFLOAT3* mTangentX;
 };
@@ -3,6 +3,7 @@
 //***************************************************************************************
 
 #include "d3dApp.h"
+#include "Profiler.h"
 #include <WindowsX.h>
 #include <sstream>
 
@@ -103,8 +104,10 @@ int D3DApp::Run()
 			if( !mAppPaused )
 			{
 				CalculateFrameStats();
+				mSimulation.Advance(mTimer.DeltaTime(), [this](float dt) { FixedUpdateScene(dt); });
 				UpdateScene(mTimer.DeltaTime());	
 				DrawScene();
+				Profiler::Default().EndFrame();
 			}
 			else
 			{
@@ -13,6 +13,7 @@
 
 #include "d3dUtil.h"
 #include "GameTimer.h"
+#include "FixedStepScheduler.h"
 #include <string>
 
 class D3DApp
@@ -33,6 +34,7 @@ public:
 	virtual bool Init();
 	virtual void OnResize(); 
 	virtual void UpdateScene(float dt)=0;
+	virtual void FixedUpdateScene(float dt){ }
 	virtual void DrawScene()=0; 
 	virtual LRESULT MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
@@ -59,6 +61,11 @@ protected:
 
 	GameTimer mTimer;
 
+	// Calls FixedUpdateScene at a fixed rate before each UpdateScene.  Derived class
+	// can Init() it in its constructor to change the step; the default is 60 Hz with
+	// at most 5 steps per frame.
+	FixedStepScheduler mSimulation;
+
 	ID3D11Device* md3dDevice;
 	ID3D11DeviceContext* md3dImmediateContext;
 	IDXGISwapChain* mSwapChain;
@@ -0,0 +1,181 @@
+//***************************************************************************************
+// HeightmapSource.cpp
+//***************************************************************************************
+
+#include "HeightmapSource.h"
+#include <DirectXMath.h>
+#include <cassert>
+#include <cstring>
+using namespace DirectX;
+
+HeightmapSource::HeightmapSource()
+: mFormat(Format_R8), mWidth(0), mHeight(0), mTexelCount(0)
+{
+}
+
+HeightmapSource::~HeightmapSource()
+{
+}
+
+bool HeightmapSource::Open(const std::wstring& filename, Format format, UINT width, UINT height)
+{
+	Close();
+
+	// DirectXTK's MappedFile throws if the file cannot be mapped and leaves an empty
+	// file unmapped; neither is a heightmap.
+	try
+	{
+		mFile.Open(filename.c_str());
+	}
+	catch(...)
+	{
+		return false;
+	}
+
+	if( !mFile.GetData() )
+		return false;
+
+	// A short file is not an error: keep the texels it has and let ReadTile zero
+	// the rest.
+	UINT64 needed = (UINT64)width*height;
+	UINT64 present = mFile.GetSize() / BytesPerTexel(format);
+
+	mFormat = format;
+	mWidth  = width;
+	mHeight = height;
+	mTexelCount = present < needed ? present : needed;
+	return true;
+}
+
+void HeightmapSource::Close()
+{
+	mFile.Close();
+	mWidth  = 0;
+	mHeight = 0;
+	mTexelCount = 0;
+}
+
+bool HeightmapSource::IsOpen()const
+{
+	return mFile.GetData() != 0;
+}
+
+UINT HeightmapSource::GetWidth()const
+{
+	return mWidth;
+}
+
+UINT HeightmapSource::GetHeight()const
+{
+	return mHeight;
+}
+
+HeightmapSource::Format HeightmapSource::GetFormat()const
+{
+	return mFormat;
+}
+
+UINT64 HeightmapSource::GetTexelCount()const
+{
+	return mTexelCount;
+}
+
+UINT HeightmapSource::BytesPerTexel(Format format)
+{
+	switch( format )
+	{
+	case Format_R16:  return 2;
+	case Format_R32F: return 4;
+	default:          return 1;
+	}
+}
+
+void HeightmapSource::ReadTile(UINT x0, UINT y0, UINT w, UINT h, float heightScale,
+	float* dest, UINT destPitch)const
+{
+	assert(x0 + w <= mWidth && y0 + h <= mHeight);
+
+	UINT texelSize = BytesPerTexel(mFormat);
+	const BYTE* data = mFile.GetData();
+
+	for(UINT y = 0; y < h; ++y)
+	{
+		UINT64 first = (UINT64)(y0 + y)*mWidth + x0;
+		float* row = dest + (size_t)y*destPitch;
+
+		// Only the part of the row that lies inside a truncated file is converted.
+		UINT present = 0;
+		if( first < mTexelCount )
+			present = (UINT)(mTexelCount - first < w ? mTexelCount - first : w);
+
+		if( present > 0 )
+			ConvertTexels(mFormat, data + first*texelSize, present, heightScale, row);
+
+		for(UINT x = present; x < w; ++x)
+			row[x] = 0.0f;
+	}
+}
+
+void HeightmapSource::ConvertTexels(Format format, const BYTE* src, UINT count, float heightScale, float* dest)
+{
+	XMVECTOR scale = XMVectorReplicate(heightScale);
+	UINT i = 0;
+
+	switch( format )
+	{
+	case Format_R8:
+		{
+			// Divide rather than multiply by 1/255 so 8-bit maps load exactly as before.
+			XMVECTOR maxValue = XMVectorReplicate(255.0f);
+			for(; i + 4 <= count; i += 4)
+			{
+				XMVECTOR v = XMVectorSet(src[i], src[i+1], src[i+2], src[i+3]);
+				XMStoreFloat4((XMFLOAT4*)&dest[i], XMVectorMultiply(XMVectorDivide(v, maxValue), scale));
+			}
+
+			for(; i < count; ++i)
+				dest[i] = (src[i] / 255.0f)*heightScale;
+		}
+		break;
+
+	case Format_R16:
+		{
+			XMVECTOR maxValue = XMVectorReplicate(65535.0f);
+			for(; i + 4 <= count; i += 4)
+			{
+				const BYTE* p = src + i*2;
+				XMVECTOR v = XMVectorSet(
+					(float)(p[0] | (p[1] << 8)), (float)(p[2] | (p[3] << 8)),
+					(float)(p[4] | (p[5] << 8)), (float)(p[6] | (p[7] << 8)));
+				XMStoreFloat4((XMFLOAT4*)&dest[i], XMVectorMultiply(XMVectorDivide(v, maxValue), scale));
+			}
+
+			for(; i < count; ++i)
+			{
+				const BYTE* p = src + i*2;
+				dest[i] = ((p[0] | (p[1] << 8)) / 65535.0f)*heightScale;
+			}
+		}
+		break;
+
+	case Format_R32F:
+		{
+			// The mapping has no alignment guarantee past the file start, so copy the
+			// texels out before loading them.
+			for(; i + 4 <= count; i += 4)
+			{
+				XMFLOAT4 v;
+				memcpy(&v, src + i*4, sizeof(v));
+				XMStoreFloat4((XMFLOAT4*)&dest[i], XMVectorMultiply(XMLoadFloat4(&v), scale));
+			}
+
+			for(; i < count; ++i)
+			{
+				float v;
+				memcpy(&v, src + i*4, sizeof(v));
+				dest[i] = v*heightScale;
+			}
+		}
+		break;
+	}
+}
@@ -0,0 +1,73 @@
+//***************************************************************************************
+// HeightmapSource.h
+//
+// Read access to a RAW heightmap file without loading it into a byte buffer first.
+// The file is memory mapped and converted to heights one tile at a time, straight
+// from the mapped pages into the caller's float storage.
+//***************************************************************************************
+
+#ifndef HEIGHTMAP_SOURCE_H
+#define HEIGHTMAP_SOURCE_H
+
+#include <Windows.h>
+#include <string>
+#include "MappedFile.h"
+
+class HeightmapSource
+{
+public:
+	// Texel formats of the RAW file.  Integer formats are normalized to [0, 1]
+	// before scaling; float texels are scaled as stored.
+	enum Format
+	{
+		Format_R8,      // unsigned 8-bit
+		Format_R16,     // unsigned 16-bit, little-endian
+		Format_R32F     // 32-bit IEEE float, little-endian
+	};
+
+public:
+	HeightmapSource();
+	~HeightmapSource();
+
+	// Returns false if the file is missing or empty.  A file holding fewer than
+	// width*height texels is still opened; texels past its end read as zero, the
+	// same as the old stream loader that kept whatever part of the file it got.
+	bool Open(const std::wstring& filename, Format format, UINT width, UINT height);
+	void Close();
+
+	bool IsOpen()const;
+	UINT GetWidth()const;
+	UINT GetHeight()const;
+	Format GetFormat()const;
+
+	// Number of whole texels present in the file; less than width*height for a
+	// truncated file.
+	UINT64 GetTexelCount()const;
+
+	static UINT BytesPerTexel(Format format);
+
+	// Converts count consecutive texels of the given format, read from src, to heights
+	// times heightScale.  Used by ReadTile and by readers that fetch texels themselves.
+	static void ConvertTexels(Format format, const BYTE* src, UINT count, float heightScale, float* dest);
+
+	// Converts the texels in [x0, x0+w) x [y0, y0+h) to heights times heightScale and
+	// writes them to dest, whose rows are destPitch floats apart.  Texels missing from
+	// a truncated file are written as zero.  Safe to call from several threads on
+	// disjoint tiles.
+	void ReadTile(UINT x0, UINT y0, UINT w, UINT h, float heightScale,
+		float* dest, UINT destPitch)const;
+
+private:
+	HeightmapSource(const HeightmapSource& rhs);
+	HeightmapSource& operator=(const HeightmapSource& rhs);
+
+private:
+	DirectX::MappedFile mFile;
+
+	Format mFormat;
+	UINT mWidth;
+	UINT mHeight;
+	UINT64 mTexelCount;
+};
+
+#endif // HEIGHTMAP_SOURCE_H
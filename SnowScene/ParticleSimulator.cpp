@@ -0,0 +1,378 @@
+//***************************************************************************************
+// ParticleSimulator.cpp
+//***************************************************************************************
+
+#include "ParticleSimulator.h"
+#include "MathHelper.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+using namespace DirectX;
+
+namespace
+{
+	// Constants from StreamOutGS and cbFixed in Snow.fx.
+	const float EmitInterval  = 0.002f;
+	const float FlareLifetime = 3.0f;
+	const float SpawnSpread   = 35.0f;
+	const float SpawnHeight   = 20.0f;
+
+	UINT RoundUp4(UINT n)
+	{
+		return (n + 3) & ~3u;
+	}
+
+	XMVECTOR Load4(const float* p)
+	{
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(p));
+	}
+
+	void Store4(float* p, FXMVECTOR v)
+	{
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(p), v);
+	}
+}
+
+void ParticleSimulator::ParticleStore::Resize(UINT n)
+{
+	InitialPosX.assign(n, 0.0f);
+	InitialPosY.assign(n, 0.0f);
+	InitialPosZ.assign(n, 0.0f);
+	InitialVelX.assign(n, 0.0f);
+	InitialVelY.assign(n, 0.0f);
+	InitialVelZ.assign(n, 0.0f);
+	SizeX.assign(n, 0.0f);
+	SizeY.assign(n, 0.0f);
+	Age.assign(n, 0.0f);
+	Type.assign(n, PT_Emitter);
+}
+
+ParticleSimulator::ParticleSimulator()
+: mMaxParticles(0), mNumParticles(0), mOverflow(0), mFirstRun(true),
+  mPool(0), mCurr(&mStores[0]), mNext(&mStores[1])
+{
+	mEmitPosW = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	mAccelW   = XMFLOAT3(-1.0f, -9.8f, 0.0f);
+
+	for(UINT i = 0; i < FlaresPerEmit; ++i)
+		mSpawnPos[i] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+}
+
+ParticleSimulator::~ParticleSimulator()
+{
+}
+
+void ParticleSimulator::Init(UINT maxParticles, ThreadPool* pool)
+{
+	mMaxParticles = maxParticles;
+	mPool = pool ? pool : &ThreadPool::Default();
+
+	// Pad so the four wide loops can run past the last particle.
+	UINT capacity = RoundUp4(maxParticles);
+	mStores[0].Resize(capacity);
+	mStores[1].Resize(capacity);
+	mCurr = &mStores[0];
+	mNext = &mStores[1];
+
+	mPosX.assign(capacity, 0.0f);
+	mPosY.assign(capacity, 0.0f);
+	mPosZ.assign(capacity, 0.0f);
+
+	// Same distribution as d3dHelper::CreateRandomTexture1DSRV.
+	mRandomValues.resize(RandomTexSize);
+	for(UINT i = 0; i < RandomTexSize; ++i)
+	{
+		mRandomValues[i].x = MathHelper::RandF(-1.0f, 1.0f);
+		mRandomValues[i].y = MathHelper::RandF(-1.0f, 1.0f);
+		mRandomValues[i].z = MathHelper::RandF(-1.0f, 1.0f);
+		mRandomValues[i].w = MathHelper::RandF(-1.0f, 1.0f);
+	}
+
+	Reset();
+}
+
+void ParticleSimulator::SetRandomValues(const XMFLOAT4* values, UINT count)
+{
+	assert(count > 0);
+	mRandomValues.assign(values, values + count);
+}
+
+void ParticleSimulator::SetEmitPos(const XMFLOAT3& emitPosW)
+{
+	mEmitPosW = emitPosW;
+}
+
+void ParticleSimulator::SetAcceleration(const XMFLOAT3& accelW)
+{
+	mAccelW = accelW;
+}
+
+void ParticleSimulator::Reset()
+{
+	mFirstRun     = true;
+	mNumParticles = 0;
+	mOverflow     = 0;
+}
+
+void ParticleSimulator::SetParticles(const Particle* particles, UINT count)
+{
+	mFirstRun     = false;
+	mNumParticles = MathHelper::Min(count, mMaxParticles);
+	mOverflow     = count - mNumParticles;
+
+	for(UINT i = 0; i < mNumParticles; ++i)
+	{
+		const Particle& p = particles[i];
+		mCurr->InitialPosX[i] = p.InitialPos.x;
+		mCurr->InitialPosY[i] = p.InitialPos.y;
+		mCurr->InitialPosZ[i] = p.InitialPos.z;
+		mCurr->InitialVelX[i] = p.InitialVel.x;
+		mCurr->InitialVelY[i] = p.InitialVel.y;
+		mCurr->InitialVelZ[i] = p.InitialVel.z;
+		mCurr->SizeX[i] = p.Size.x;
+		mCurr->SizeY[i] = p.Size.y;
+		mCurr->Age[i]   = p.Age;
+		mCurr->Type[i]  = p.Type;
+	}
+}
+
+UINT ParticleSimulator::GetParticleCount()const
+{
+	return mNumParticles;
+}
+
+UINT ParticleSimulator::GetMaxParticles()const
+{
+	return mMaxParticles;
+}
+
+UINT ParticleSimulator::GetOverflowCount()const
+{
+	return mOverflow;
+}
+
+void ParticleSimulator::Update(float dt, float gameTime)
+{
+	if( mMaxParticles == 0 )
+		return;
+
+	// On the first pass the GPU reads the initialization VB: a single emitter with
+	// type 0, age 0 and every other attribute zeroed.
+	if( mFirstRun )
+	{
+		mCurr->InitialPosX[0] = mCurr->InitialPosY[0] = mCurr->InitialPosZ[0] = 0.0f;
+		mCurr->InitialVelX[0] = mCurr->InitialVelY[0] = mCurr->InitialVelZ[0] = 0.0f;
+		mCurr->SizeX[0] = mCurr->SizeY[0] = 0.0f;
+		mCurr->Age[0]  = 0.0f;
+		mCurr->Type[0] = PT_Emitter;
+
+		mNumParticles = 1;
+		mFirstRun = false;
+	}
+
+	// Spread snow out above the emit position.  RandVec3 only depends on the game
+	// time and the flare index, so every emitter spawns at the same offsets.
+	for(UINT i = 0; i < FlaresPerEmit; ++i)
+	{
+		XMVECTOR v = XMVectorScale(RandVec3(gameTime, (float)i/FlaresPerEmit), SpawnSpread);
+		v = XMVectorSetY(v, SpawnHeight);
+		XMStoreFloat3(&mSpawnPos[i], XMVectorAdd(XMLoadFloat3(&mEmitPosW), v));
+	}
+
+	UINT numChunks = (mNumParticles + ChunkSize - 1) / ChunkSize;
+	mChunkOutput.resize(numChunks);
+
+	mPool->ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for(UINT c = begin; c < end; ++c)
+			AgeChunk(c, dt);
+	});
+
+	// Turn the per chunk output counts into offsets into the next store.
+	UINT total = 0;
+	for(UINT c = 0; c < numChunks; ++c)
+	{
+		UINT n = mChunkOutput[c];
+		mChunkOutput[c] = total;
+		total += n;
+	}
+
+	mPool->ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		for(UINT c = begin; c < end; ++c)
+			WriteChunk(c);
+	});
+
+	// Stream-out drops whatever does not fit in the target buffer.
+	mOverflow     = total > mMaxParticles ? total - mMaxParticles : 0;
+	mNumParticles = total - mOverflow;
+
+	std::swap(mCurr, mNext);
+}
+
+void ParticleSimulator::ComputePositions()
+{
+	UINT numChunks = (mNumParticles + ChunkSize - 1) / ChunkSize;
+
+	mPool->ParallelFor(numChunks, 1, [&](UINT begin, UINT end)
+	{
+		XMVECTOR ax = XMVectorReplicate(mAccelW.x);
+		XMVECTOR ay = XMVectorReplicate(mAccelW.y);
+		XMVECTOR az = XMVectorReplicate(mAccelW.z);
+		XMVECTOR half = XMVectorReplicate(0.5f);
+
+		UINT first = begin*ChunkSize;
+		UINT last  = MathHelper::Min(end*ChunkSize, mNumParticles);
+		for(UINT i = first; i < last; i += 4)
+		{
+			// Constant acceleration equation: 0.5*t^2*a + t*v0 + p0.
+			XMVECTOR t  = Load4(&mCurr->Age[i]);
+			XMVECTOR ht = XMVectorMultiply(half, XMVectorMultiply(t, t));
+
+			XMVECTOR x = XMVectorMultiplyAdd(t, Load4(&mCurr->InitialVelX[i]), Load4(&mCurr->InitialPosX[i]));
+			XMVECTOR y = XMVectorMultiplyAdd(t, Load4(&mCurr->InitialVelY[i]), Load4(&mCurr->InitialPosY[i]));
+			XMVECTOR z = XMVectorMultiplyAdd(t, Load4(&mCurr->InitialVelZ[i]), Load4(&mCurr->InitialPosZ[i]));
+
+			Store4(&mPosX[i], XMVectorMultiplyAdd(ht, ax, x));
+			Store4(&mPosY[i], XMVectorMultiplyAdd(ht, ay, y));
+			Store4(&mPosZ[i], XMVectorMultiplyAdd(ht, az, z));
+		}
+	});
+}
+
+void ParticleSimulator::GetParticles(std::vector<Particle>& particles)const
+{
+	particles.resize(mNumParticles);
+
+	for(UINT i = 0; i < mNumParticles; ++i)
+	{
+		Particle& p = particles[i];
+		p.InitialPos = XMFLOAT3(mCurr->InitialPosX[i], mCurr->InitialPosY[i], mCurr->InitialPosZ[i]);
+		p.InitialVel = XMFLOAT3(mCurr->InitialVelX[i], mCurr->InitialVelY[i], mCurr->InitialVelZ[i]);
+		p.Size       = XMFLOAT2(mCurr->SizeX[i], mCurr->SizeY[i]);
+		p.Age        = mCurr->Age[i];
+		p.Type       = mCurr->Type[i];
+	}
+}
+
+UINT ParticleSimulator::MeasurePeakCount(float dt, float duration)
+{
+	Reset();
+
+	UINT peak = 0;
+	UINT steps = (UINT)ceilf(duration / dt);
+	for(UINT i = 1; i <= steps; ++i)
+	{
+		Update(dt, i*dt);
+		peak = MathHelper::Max(peak, mNumParticles);
+	}
+
+	return peak;
+}
+
+XMVECTOR ParticleSimulator::RandVec3(float gameTime, float offset)const
+{
+	// Emulates gRandomTex.SampleLevel(samLinear, u, 0) with MIN_MAG_MIP_LINEAR
+	// filtering and WRAP addressing.
+	int n = (int)mRandomValues.size();
+
+	float u = gameTime + offset;
+	float x = u*n - 0.5f;
+	float fx = floorf(x);
+	float s = x - fx;
+
+	int i0 = (int)fx % n;
+	if( i0 < 0 )
+		i0 += n;
+	int i1 = (i0 + 1) % n;
+
+	XMVECTOR v0 = XMLoadFloat4(&mRandomValues[i0]);
+	XMVECTOR v1 = XMLoadFloat4(&mRandomValues[i1]);
+
+	return XMVectorSetW(XMVectorLerp(v0, v1, s), 0.0f);
+}
+
+void ParticleSimulator::AgeChunk(UINT chunk, float dt)
+{
+	UINT first = chunk*ChunkSize;
+	UINT last  = MathHelper::Min(first + ChunkSize, mNumParticles);
+
+	float* age = &mCurr->Age[0];
+	const UINT* type = &mCurr->Type[0];
+
+	// gin[0].Age += gTimeStep, four particles at a time.  The store is padded to a
+	// multiple of four so the tail may touch unused slots.
+	XMVECTOR step = XMVectorReplicate(dt);
+	for(UINT i = first; i < last; i += 4)
+		Store4(&age[i], XMVectorAdd(Load4(&age[i]), step));
+
+	UINT count = 0;
+	for(UINT i = first; i < last; ++i)
+	{
+		if( type[i] == PT_Emitter )
+			count += age[i] > EmitInterval ? FlaresPerEmit + 1 : 1;
+		else
+			count += age[i] <= FlareLifetime ? 1 : 0;
+	}
+
+	mChunkOutput[chunk] = count;
+}
+
+void ParticleSimulator::WriteChunk(UINT chunk)
+{
+	UINT first = chunk*ChunkSize;
+	UINT last  = MathHelper::Min(first + ChunkSize, mNumParticles);
+
+	const ParticleStore& src = *mCurr;
+	ParticleStore& dst = *mNext;
+
+	UINT out = mChunkOutput[chunk];
+	for(UINT i = first; i < last && out < mMaxParticles; ++i)
+	{
+		float age = src.Age[i];
+
+		if( src.Type[i] == PT_Emitter )
+		{
+			// Time to emit new flares?  They are appended ahead of the emitter.
+			if( age > EmitInterval )
+			{
+				for(UINT k = 0; k < FlaresPerEmit && out < mMaxParticles; ++k, ++out)
+				{
+					dst.InitialPosX[out] = mSpawnPos[k].x;
+					dst.InitialPosY[out] = mSpawnPos[k].y;
+					dst.InitialPosZ[out] = mSpawnPos[k].z;
+					dst.InitialVelX[out] = 0.0f;
+					dst.InitialVelY[out] = 0.0f;
+					dst.InitialVelZ[out] = 0.0f;
+					dst.SizeX[out] = 1.0f;
+					dst.SizeY[out] = 1.0f;
+					dst.Age[out]   = 0.0f;
+					dst.Type[out]  = PT_Flare;
+				}
+
+				// Reset the time to emit.
+				age = 0.0f;
+			}
+		}
+		else if( age > FlareLifetime )
+		{
+			continue;
+		}
+
+		if( out >= mMaxParticles )
+			break;
+
+		dst.InitialPosX[out] = src.InitialPosX[i];
+		dst.InitialPosY[out] = src.InitialPosY[i];
+		dst.InitialPosZ[out] = src.InitialPosZ[i];
+		dst.InitialVelX[out] = src.InitialVelX[i];
+		dst.InitialVelY[out] = src.InitialVelY[i];
+		dst.InitialVelZ[out] = src.InitialVelZ[i];
+		dst.SizeX[out] = src.SizeX[i];
+		dst.SizeY[out] = src.SizeY[i];
+		dst.Age[out]   = age;
+		dst.Type[out]  = src.Type[i];
+		++out;
+	}
+}
@@ -0,0 +1,160 @@
+//***************************************************************************************
+// ParticleSimulator.h
+//
+// CPU reference implementation of the snow particle system in FX/Snow.fx.
+//   -Update() reproduces StreamOutGS: ages every particle, lets emitters spawn flares
+//    and kills expired flares, writing the survivors in the same order the GPU
+//    streams them out, clipped to the buffer capacity.
+//   -ComputePositions() reproduces the constant acceleration equation in DrawVS.
+// Particles are stored as a structure of arrays over the Vertex::Particle attributes
+// so both passes run four lanes at a time and split across a ThreadPool.  No device
+// is needed, which makes the snow workload measurable and testable headless; the app
+// uses it to size the stream-out buffers.
+//***************************************************************************************
+
+#ifndef PARTICLE_SIMULATOR_H
+#define PARTICLE_SIMULATOR_H
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <vector>
+
+class ThreadPool;
+
+class ParticleSimulator
+{
+public:
+	// Matches PT_EMITTER and PT_FLARE in Snow.fx.
+	enum ParticleType
+	{
+		PT_Emitter = 0,
+		PT_Flare   = 1
+	};
+
+	// Number of texels in the random texture made by d3dHelper::CreateRandomTexture1DSRV.
+	static const UINT RandomTexSize = 1024;
+
+	// One particle with the attributes of Vertex::Particle.
+	struct Particle
+	{
+		DirectX::XMFLOAT3 InitialPos;
+		DirectX::XMFLOAT3 InitialVel;
+		DirectX::XMFLOAT2 Size;
+		float Age;
+		UINT Type;
+	};
+
+public:
+	ParticleSimulator();
+	~ParticleSimulator();
+
+	// pool may be null, in which case ThreadPool::Default() is used.
+	void Init(UINT maxParticles, ThreadPool* pool = 0);
+
+	// Replaces the values sampled by RandVec3.  Pass the texels used to create the
+	// random texture to reproduce the GPU output exactly.
+	void SetRandomValues(const DirectX::XMFLOAT4* values, UINT count);
+
+	void SetEmitPos(const DirectX::XMFLOAT3& emitPosW);
+	void SetAcceleration(const DirectX::XMFLOAT3& accelW);
+
+	void Reset();
+
+	// Replaces the particles, as if they had been streamed out by the last pass.
+	// Particles past GetMaxParticles() are dropped.
+	void SetParticles(const Particle* particles, UINT count);
+
+	// Same as one stream-out pass of ParticleSystem::Draw with the given constants.
+	void Update(float dt, float gameTime);
+
+	// Evaluates the world position of every particle at its current age.
+	void ComputePositions();
+
+	UINT GetParticleCount()const;
+	UINT GetMaxParticles()const;
+
+	// Particles dropped by the last Update because the buffer was full.
+	UINT GetOverflowCount()const;
+
+	// Attribute streams; each holds GetParticleCount() valid entries.
+	const float* GetInitialPosX()const { return &mCurr->InitialPosX[0]; }
+	const float* GetInitialPosY()const { return &mCurr->InitialPosY[0]; }
+	const float* GetInitialPosZ()const { return &mCurr->InitialPosZ[0]; }
+	const float* GetAge()const         { return &mCurr->Age[0]; }
+	const UINT*  GetType()const        { return &mCurr->Type[0]; }
+
+	// Outputs of ComputePositions().
+	const float* GetPosX()const { return &mPosX[0]; }
+	const float* GetPosY()const { return &mPosY[0]; }
+	const float* GetPosZ()const { return &mPosZ[0]; }
+
+	// Interleaves the particles back into one structure per particle.
+	void GetParticles(std::vector<Particle>& particles)const;
+
+	// Resets and runs from the initial emitter for the given time at a fixed step,
+	// returning the most particles alive after any pass.  Init with enough room that
+	// nothing overflows, or the result is clipped to GetMaxParticles().
+	UINT MeasurePeakCount(float dt, float duration);
+
+private:
+	struct ParticleStore
+	{
+		std::vector<float> InitialPosX;
+		std::vector<float> InitialPosY;
+		std::vector<float> InitialPosZ;
+		std::vector<float> InitialVelX;
+		std::vector<float> InitialVelY;
+		std::vector<float> InitialVelZ;
+		std::vector<float> SizeX;
+		std::vector<float> SizeY;
+		std::vector<float> Age;
+		std::vector<UINT>  Type;
+
+		void Resize(UINT n);
+	};
+
+	DirectX::XMVECTOR RandVec3(float gameTime, float offset)const;
+
+	void AgeChunk(UINT chunk, float dt);
+	void WriteChunk(UINT chunk);
+
+	ParticleSimulator(const ParticleSimulator& rhs);
+	ParticleSimulator& operator=(const ParticleSimulator& rhs);
+
+private:
+	// Particles handled per task; the spawn/kill pass keeps chunk order, so the
+	// output order does not depend on the number of threads.
+	static const UINT ChunkSize = 4096;
+
+	// Flares spawned each time an emitter fires.
+	static const UINT FlaresPerEmit = 5;
+
+	UINT mMaxParticles;
+	UINT mNumParticles;
+	UINT mOverflow;
+	bool mFirstRun;
+
+	DirectX::XMFLOAT3 mEmitPosW;
+	DirectX::XMFLOAT3 mAccelW;
+
+	ThreadPool* mPool;
+
+	// Ping-pong stores, like mDrawVB and mStreamOutVB.
+	ParticleStore mStores[2];
+	ParticleStore* mCurr;
+	ParticleStore* mNext;
+
+	// Per update spawn positions; every emitter samples the same texels in a frame.
+	DirectX::XMFLOAT3 mSpawnPos[FlaresPerEmit];
+
+	// Number of particles each chunk writes, then its offset in the next store.
+	std::vector<UINT> mChunkOutput;
+
+	std::vector<float> mPosX;
+	std::vector<float> mPosY;
+	std::vector<float> mPosZ;
+
+	std::vector<DirectX::XMFLOAT4> mRandomValues;
+};
+
+#endif // PARTICLE_SIMULATOR_H
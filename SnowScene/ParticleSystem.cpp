@@ -7,6 +7,7 @@
 #include "Vertex.h"
 #include "Effect.h"
 #include "Camera.h"
+#include "Profiler.h"
  
 ParticleSystem::ParticleSystem()
 : mInitVB(0), mDrawVB(0), mStreamOutVB(0), mTexArraySRV(0), mRandomTexSRV(0)
@@ -77,6 +78,8 @@ void ParticleSystem::Update(float dt, float gameTime)
 
 void ParticleSystem::Draw(ID3D11DeviceContext* dc, const Camera& cam)
 {
+	PROFILE_SCOPE("ParticleSystem::Draw");
+
 	XMMATRIX VP = cam.ViewProj();
 
 	//
@@ -23,12 +23,15 @@
 #include "Snowman.h"
 #include "RenderStates.h"
 #include "ParticleSystem.h"
+#include "ParticleSimulator.h"
 #include "Terrain.h"
 #include "SpriteBatch.h"
 #include "Model.h"
+#include "ModelLoader.h"
 #include "Effects.h"
 #include "CommonStates.h"
 #include "DDSTextureLoader.h"
+#include "Profiler.h"
 
 class SnowSceneApp : public D3DApp
 {
@@ -39,6 +42,7 @@ public:
 	bool Init();
 	void OnResize();
 	void UpdateScene(float dt);
+	void FixedUpdateScene(float dt);
 	void DrawScene();
 
 	void OnMouseDown(WPARAM btnState, int x, int y);
@@ -47,6 +51,7 @@ public:
 
 private:
 	void BuildShapeGeometryBuffers();
+	bool PickTerrain(int sx, int sy, XMFLOAT3& pos);
 
 private:
 	// Sky box.
@@ -63,14 +68,20 @@ private:
 	// House and tree model, load from .cmo files.
 	std::unique_ptr<DirectX::CommonStates> mStates;
 	std::unique_ptr<DirectX::EffectFactory> mFxFactory;
-	std::unique_ptr<DirectX::Model> mHouseModel;
-	std::unique_ptr<DirectX::Model> mTreeModel;
+	ModelLoader mModelLoader;
+	std::shared_ptr<DirectX::Model> mHouseModel;
+	std::shared_ptr<DirectX::Model> mTreeModel;
 
 	// Walk mode.
 	bool mWalkCamMode;
 	// Camera in box.
 	bool mCameraInBox;
 
+	// Spin of the box, stepped by FixedUpdateScene.  The angle before the last step
+	// is kept so frames can blend between the two.
+	float mBoxSpin;
+	float mPrevBoxSpin;
+
 	ID3D11Buffer* mShapesVB;
 	ID3D11Buffer* mShapesIB;
 
@@ -99,6 +110,9 @@ private:
 	// Last mouse position.
 	POINT mLastMousePos;
 
+	// Profiler dump key was down last frame.
+	bool mProfileKeyDown;
+
 	// Location information.
 	FLOAT mLeftX;
 	FLOAT mRightX;
@@ -130,9 +144,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 SnowSceneApp::SnowSceneApp(HINSTANCE hInstance)
 	: D3DApp(hInstance), mSky(0),
 	mSnowmanBox(0), mSnowmanFloor(0),
+	mWalkCamMode(true), mCameraInBox(false),
+	mBoxSpin(0.0f), mPrevBoxSpin(0.0f),
 	mShapesVB(0), mShapesIB(0),
-	mBoxTexSRV(0), mRandomTexSRV(0), mSnowTexSRV(0), 
-	mWalkCamMode(true), mCameraInBox(false)
+	mBoxTexSRV(0), mSnowTexSRV(0), mRandomTexSRV(0),
+	mProfileKeyDown(false)
 {
 	mMainWndCaption = L"Snow Scene Demo";
 	mEnable4xMsaa = false;
@@ -217,12 +233,21 @@ bool SnowSceneApp::Init()
 	InputLayouts::InitAll(md3dDevice);
 	RenderStates::InitAll(md3dDevice);
 
+	// Start loading the house and tree models; they are parsed on worker threads while
+	// the rest of the scene is set up.  Only the trees get levels of detail: they are
+	// the dense models and are drawn more than once.
+	mFxFactory.reset(new EffectFactory(md3dDevice));
+	mModelLoader.Init(md3dDevice, mFxFactory.get());
+	ModelLoader::ModelFuture houseFuture = mModelLoader.Load(L"snowhouse2.cmo");
+	ModelLoader::ModelFuture treeFuture = mModelLoader.Load(L"needle01.cmo", true);
+
 	// Initial sky box information.
 	mSky = new Sky(md3dDevice, L"Textures/snowcube1024.dds", 5000.0f);
 
 	// Initial terrain information.
 	Terrain::InitInfo tii;
 	tii.HeightMapFilename = L"Textures/terrain.raw";
+	tii.HeightmapFormat = HeightmapSource::Format_R8;
 	tii.LayerMapFilename = L"Textures/layersnow.dds";
 	tii.BlendMapFilename = L"Textures/blend.dds";
 	tii.HeightScale = 50.0f;
@@ -234,16 +259,22 @@ bool SnowSceneApp::Init()
 	// Setting snow informatoin.
 	mRandomTexSRV = d3dHelper::CreateRandomTexture1DSRV(md3dDevice);
 	DirectX::CreateDDSTextureFromFile(md3dDevice, L"Textures/snow.dds", 0, &mSnowTexSRV);
-	mSnow.Init(md3dDevice, Effects::SnowFX, mSnowTexSRV, mRandomTexSRV, 5000);
+
+	// Size the snow buffers from the CPU simulator.  The frame rate is not capped and the
+	// emitter fires at most once every 2ms, so the most snow is alive when frames take
+	// just over that (ParticleSimulatorTest prints the peak for other frame times).
+	ParticleSimulator snowSim;
+	snowSim.Init(16384);
+	UINT maxSnow = snowSim.MeasurePeakCount(0.00201f, 4.0f);
+	mSnow.Init(md3dDevice, Effects::SnowFX, mSnowTexSRV, mRandomTexSRV, maxSnow);
 
 	// Setting box texture.
 	DirectX::CreateDDSTextureFromFile(md3dDevice, L"Textures/box.dds", 0, &mBoxTexSRV);
 
 	// Setting house and tree information.
-	mFxFactory.reset(new EffectFactory(md3dDevice));
 	mStates.reset(new CommonStates(md3dDevice));
-	mHouseModel = Model::CreateFromCMO(md3dDevice, L"snowhouse2.cmo", *mFxFactory);
-	mTreeModel = Model::CreateFromCMO(md3dDevice, L"needle01.cmo", *mFxFactory);
+	mHouseModel = mModelLoader.Wait(houseFuture);
+	mTreeModel = mModelLoader.Wait(treeFuture);
 
 	// Setting snowman information.
 	mSnowmanBox = new Snowman(md3dDevice, mBoxScale);
@@ -263,9 +294,34 @@ void SnowSceneApp::OnResize()
 	mCam.SetLens(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 3000.0f);
 }
 
+// Step the box spin at the fixed rate, one radian per second.
+void SnowSceneApp::FixedUpdateScene(float dt)
+{
+	mPrevBoxSpin = mBoxSpin;
+	mBoxSpin += dt;
+
+	// Keep the angles small so they do not lose precision over a long run.
+	if (mBoxSpin > 2.0f*MathHelper::Pi)
+	{
+		mBoxSpin -= 2.0f*MathHelper::Pi;
+		mPrevBoxSpin -= 2.0f*MathHelper::Pi;
+	}
+}
+
 // Update scene.
 void SnowSceneApp::UpdateScene(float dt)
 {
+	PROFILE_SCOPE("SnowSceneApp::UpdateScene");
+
+	// Dump the profiler stats to the debugger and write a Chrome trace.
+	bool profileKey = (GetAsyncKeyState('P') & 0x8000) != 0;
+	if (profileKey && !mProfileKeyDown)
+	{
+		OutputDebugStringA(Profiler::Default().FormatReport().c_str());
+		Profiler::Default().WriteChromeTrace(L"SnowSceneTrace.json");
+	}
+	mProfileKeyDown = profileKey;
+
 	// Jump into the box.
 	if (GetAsyncKeyState('F') & 0x8000)
 		mCameraInBox = true;
@@ -313,9 +369,10 @@ void SnowSceneApp::UpdateScene(float dt)
 		mSnow.Reset();
 	}
 
-	// Rotate along the Y axis
-	XMMATRIX localRotate = XMMatrixRotationY(-mTimer.TotalTime());
-	XMMATRIX globalRotate = XMMatrixRotationY(mTimer.TotalTime());
+	// Rotate along the Y axis, between the last two simulated angles.
+	float spin = mPrevBoxSpin + mSimulation.GetAlpha()*(mBoxSpin - mPrevBoxSpin);
+	XMMATRIX localRotate = XMMatrixRotationY(-spin);
+	XMMATRIX globalRotate = XMMatrixRotationY(spin);
 
 	// Animate the box.
 	XMMATRIX boxScale = XMMatrixScaling(mBoxScale, mBoxScale, mBoxScale);
@@ -329,7 +386,7 @@ void SnowSceneApp::UpdateScene(float dt)
 	// Animate camera on the box.
 	if (mCameraInBox)
 	{
-		XMFLOAT3 cameraOffset = XMFLOAT3(mLeftX * cosf(mTimer.TotalTime()), mBoxScale * 3.0f, mZ + sinf(mTimer.TotalTime()));
+		XMFLOAT3 cameraOffset = XMFLOAT3(mLeftX * cosf(spin), mBoxScale * 3.0f, mZ + sinf(spin));
 		mCam.SetPosition(cameraOffset);
 	}
 
@@ -341,6 +398,8 @@ void SnowSceneApp::UpdateScene(float dt)
 // Draw scene.
 void SnowSceneApp::DrawScene()
 {
+	PROFILE_SCOPE("SnowSceneApp::DrawScene");
+
 	// Draw the scene as normal.
 	md3dImmediateContext->ClearRenderTargetView(mRenderTargetView, reinterpret_cast<const float*>(&DirectX::Colors::Silver));
 	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
@@ -400,18 +459,30 @@ void SnowSceneApp::DrawScene()
 	md3dImmediateContext->RSSetState(0);
 
 	// Draw sky box.
-	mSky->Draw(md3dImmediateContext, mCam);
+	{
+		PROFILE_SCOPE("Sky::Draw");
+		mSky->Draw(md3dImmediateContext, mCam);
+	}
 
 	// Draw snowman.
-	mSnowmanFloor->Draw(md3dImmediateContext, mCam);
-	mSnowmanBox->Draw(md3dImmediateContext, mCam);
+	{
+		PROFILE_SCOPE("Snowman::Draw");
+		mSnowmanFloor->Draw(md3dImmediateContext, mCam);
+		mSnowmanBox->Draw(md3dImmediateContext, mCam);
+	}
 
 	// Draw house model
-	mHouseModel->Draw(md3dImmediateContext, *mStates, XMLoadFloat4x4(&mHouseWorld), view, proj);
+	{
+		PROFILE_SCOPE("Model::Draw(House)");
+		mHouseModel->Draw(md3dImmediateContext, *mStates, XMLoadFloat4x4(&mHouseWorld), view, proj);
+	}
 
 	// Draw tree model
-	mTreeModel->Draw(md3dImmediateContext, *mStates, XMLoadFloat4x4(&mTreeLeftWorld), view, proj);
-	mTreeModel->Draw(md3dImmediateContext, *mStates, XMLoadFloat4x4(&mTreeRightWorld), view, proj);
+	{
+		PROFILE_SCOPE("Model::Draw(Trees)");
+		mTreeModel->Draw(md3dImmediateContext, *mStates, XMLoadFloat4x4(&mTreeLeftWorld), view, proj);
+		mTreeModel->Draw(md3dImmediateContext, *mStates, XMLoadFloat4x4(&mTreeRightWorld), view, proj);
+	}
 
 	// Draw particle systems last so it is blended with scene.
 	mSnow.SetEyePos(mCam.GetPosition());
@@ -435,6 +506,11 @@ void SnowSceneApp::OnMouseDown(WPARAM btnState, int x, int y)
 	mLastMousePos.y = y;
 
 	SetCapture(mhMainWnd);
+
+	// Right click stands the floor snowman on the terrain under the cursor.
+	XMFLOAT3 pos;
+	if ((btnState & MK_RBUTTON) != 0 && PickTerrain(x, y, pos))
+		mSnowmanFloor->UpdatePosition(XMMatrixTranslation(pos.x, pos.y, pos.z));
 }
 
 // Mouse up.
@@ -460,6 +536,33 @@ void SnowSceneApp::OnMouseMove(WPARAM btnState, int x, int y)
 	mLastMousePos.y = y;
 }
 
+// Cast a ray through the cursor and return where it meets the terrain.
+bool SnowSceneApp::PickTerrain(int sx, int sy, XMFLOAT3& pos)
+{
+	XMFLOAT4X4 P;
+	XMStoreFloat4x4(&P, mCam.Proj());
+
+	// Compute picking ray in view space.
+	float vx = (+2.0f*sx/mClientWidth  - 1.0f)/P(0,0);
+	float vy = (-2.0f*sy/mClientHeight + 1.0f)/P(1,1);
+
+	// Transform ray to world space.
+	XMMATRIX V = mCam.View();
+	XMVECTOR det = XMMatrixDeterminant(V);
+	XMMATRIX invView = XMMatrixInverse(&det, V);
+
+	XMFLOAT3 rayOrigin, rayDir;
+	XMStoreFloat3(&rayOrigin, XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invView));
+	XMStoreFloat3(&rayDir, XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView)));
+
+	float dist;
+	if (!mTerrain.CastRay(rayOrigin, rayDir, mCam.GetFarZ(), dist))
+		return false;
+
+	XMStoreFloat3(&pos, XMVectorAdd(XMLoadFloat3(&rayOrigin), XMVectorScale(XMLoadFloat3(&rayDir), dist)));
+	return true;
+}
+
 // Build box buffers.
 void SnowSceneApp::BuildShapeGeometryBuffers()
 {
@@ -121,6 +121,12 @@ void Snowman::BuildSnowmanBuffers()
 	geoGen.CreateCylinder(mHandRadius, mHandRadius, mHandHeight, 20, 20, handCylinder);
 	geoGen.CreateBox(mMouthWidth, mMouthHeight, mMouthDepth, mouthBox);
 
+	// The spheres share most of their vertices between triangles, so they gain from
+	// a cache friendly order; the cylinders and the box barely change.
+	geoGen.Optimize(bodySphere);
+	geoGen.Optimize(headSphere);
+	geoGen.Optimize(eyeSphere);
+
 	// Cache the vertex offsets to each object in the concatenated vertex buffer.
 	mBodySphereVertexOffset = 0;
 	mHeadSphereVertexOffset = mBodySphereVertexOffset + bodySphere.Vertices.size();
@@ -7,7 +7,7 @@
 #include "LightHelper.h"
 #include "Effect.h"
 #include "Vertex.h"
-#include <fstream>
+#include "Profiler.h"
 #include <sstream>
 
 Terrain::Terrain() : 
@@ -40,53 +40,37 @@ Terrain::~Terrain()
 
 float Terrain::GetWidth()const
 {
-	// Total terrain width.
-	return (mInfo.HeightmapWidth-1)*mInfo.CellSpacing;
+	return mHeightfield.GetWidth();
 }
 
 float Terrain::GetDepth()const
 {
-	// Total terrain depth.
-	return (mInfo.HeightmapHeight-1)*mInfo.CellSpacing;
+	return mHeightfield.GetDepth();
 }
 
 float Terrain::GetHeight(float x, float z)const
 {
-	// Transform from terrain local space to "cell" space.
-	float c = (x + 0.5f*GetWidth()) /  mInfo.CellSpacing;
-	float d = (z - 0.5f*GetDepth()) / -mInfo.CellSpacing;
-
-	// Get the row and column we are in.
-	int row = (int)floorf(d);
-	int col = (int)floorf(c);
-
-	// Grab the heights of the cell we are in.
-	// A*--*B
-	//  | /|
-	//  |/ |
-	// C*--*D
-	float A = mHeightmap[row*mInfo.HeightmapWidth + col];
-	float B = mHeightmap[row*mInfo.HeightmapWidth + col + 1];
-	float C = mHeightmap[(row+1)*mInfo.HeightmapWidth + col];
-	float D = mHeightmap[(row+1)*mInfo.HeightmapWidth + col + 1];
-
-	// Where we are relative to the cell.
-	float s = c - (float)col;
-	float t = d - (float)row;
-
-	// If upper triangle ABC.
-	if( s + t <= 1.0f)
-	{
-		float uy = B - A;
-		float vy = C - A;
-		return A + s*uy + t*vy;
-	}
-	else // lower triangle DCB.
-	{
-		float uy = C - D;
-		float vy = B - D;
-		return D + (1.0f-s)*uy + (1.0f-t)*vy;
-	}
+	return mHeightfield.GetHeight(x, z);
+}
+
+void Terrain::GetHeights(const XMFLOAT2* points, float* heights, UINT count, ThreadPool* pool)const
+{
+	mHeightfield.GetHeights(points, heights, count, pool);
+}
+
+bool Terrain::CastRay(const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDist, float& hitDist)const
+{
+	return mHeightfield.CastRay(origin, dir, maxDist, hitDist);
+}
+
+bool Terrain::IntersectSegment(const XMFLOAT3& p0, const XMFLOAT3& p1)const
+{
+	return mHeightfield.IntersectSegment(p0, p1);
+}
+
+void Terrain::CastRays(const RayQuery* rays, RayHit* hits, UINT count, ThreadPool* pool)const
+{
+	mHeightfield.CastRays(rays, hits, count, pool);
 }
 
 XMMATRIX Terrain::GetWorld()const
@@ -103,16 +87,24 @@ void Terrain::Init(ID3D11Device* device, ID3D11DeviceContext* dc, const InitInfo
 {
 	mInfo = initInfo;
 
+	// Load the heightmap and compute the patch bounds on the CPU first.
+	TerrainHeightfield::InitInfo hii;
+	hii.HeightMapFilename = mInfo.HeightMapFilename;
+	hii.HeightmapFormat   = mInfo.HeightmapFormat;
+	hii.HeightScale       = mInfo.HeightScale;
+	hii.HeightmapWidth    = mInfo.HeightmapWidth;
+	hii.HeightmapHeight   = mInfo.HeightmapHeight;
+	hii.CellSpacing       = mInfo.CellSpacing;
+	mHeightfield.Init(hii);
+
 	// Divide heightmap into patches such that each patch has CellsPerPatch.
-	mNumPatchVertRows = ((mInfo.HeightmapHeight-1) / CellsPerPatch) + 1;
-	mNumPatchVertCols = ((mInfo.HeightmapWidth-1) / CellsPerPatch) + 1;
+	mNumPatchVertRows = mHeightfield.GetNumPatchRows() + 1;
+	mNumPatchVertCols = mHeightfield.GetNumPatchCols() + 1;
 
 	mNumPatchVertices  = mNumPatchVertRows*mNumPatchVertCols;
 	mNumPatchQuadFaces = (mNumPatchVertRows-1)*(mNumPatchVertCols-1);
 
-	LoadHeightmap();
-	Smooth();
-	CalcAllPatchBoundsY();
+	mQuadtree.Build(&mHeightfield.GetPatchBoundsY()[0], mNumPatchVertRows-1, mNumPatchVertCols-1, GetWidth(), GetDepth());
 
 	BuildQuadPatchVB(device);
 	BuildQuadPatchIB(device);
@@ -127,6 +119,8 @@ void Terrain::Init(ID3D11Device* device, ID3D11DeviceContext* dc, const InitInfo
 
 void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight lights[3])
 {
+	PROFILE_SCOPE("Terrain::Draw");
+
 	dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
 	dc->IASetInputLayout(InputLayouts::Terrain);
 
@@ -143,6 +137,13 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
 	XMFLOAT4 worldPlanes[6];
 	ExtractFrustumPlanes(worldPlanes, viewProj);
 
+	// Cull on the CPU so only visible patches are submitted.  The hull shader still
+	// runs its own test, which now only rejects patches at the frustum edges.
+	{
+		PROFILE_SCOPE("TerrainQuadtree::Cull");
+		mQuadtree.Cull(worldPlanes, mVisibleRanges);
+	}
+
 	// Set per frame constants.
 	Effects::TerrainFX->SetViewProj(viewProj);
 	Effects::TerrainFX->SetEyePosW(cam.GetPosition());
@@ -174,7 +175,13 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
         ID3DX11EffectPass* pass = tech->GetPassByIndex(i);
 		pass->Apply(0, dc);
 
-		dc->DrawIndexed(mNumPatchQuadFaces*4, 0, 0);
+		// The index buffer is in quadtree leaf order, so each run of visible leaves
+		// is one contiguous index range.
+		for(size_t r = 0; r < mVisibleRanges.size(); ++r)
+		{
+			const TerrainQuadtree::LeafRange& range = mVisibleRanges[r];
+			dc->DrawIndexed(range.NumLeaves*4, range.FirstLeaf*4, 0);
+		}
 	}	
 
 	// FX sets tessellation stages, but it does not disable them.  So do that here
@@ -183,131 +190,6 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
 	dc->DSSetShader(0, 0, 0);
 }
 
-void Terrain::LoadHeightmap()
-{
-	// A height for each vertex
-	std::vector<unsigned char> in( mInfo.HeightmapWidth * mInfo.HeightmapHeight );
-
-	// Open the file.
-	std::ifstream inFile;
-	inFile.open(mInfo.HeightMapFilename.c_str(), std::ios_base::binary);
-
-	if(inFile)
-	{
-		// Read the RAW bytes.
-		inFile.read((char*)&in[0], (std::streamsize)in.size());
-
-		// Done with file.
-		inFile.close();
-	}
-
-	// Copy the array data into a float array and scale it.
-	mHeightmap.resize(mInfo.HeightmapHeight * mInfo.HeightmapWidth, 0);
-	for(UINT i = 0; i < mInfo.HeightmapHeight * mInfo.HeightmapWidth; ++i)
-	{
-		mHeightmap[i] = (in[i] / 255.0f)*mInfo.HeightScale;
-	}
-}
-
-void Terrain::Smooth()
-{
-	std::vector<float> dest( mHeightmap.size() );
-
-	for(UINT i = 0; i < mInfo.HeightmapHeight; ++i)
-	{
-		for(UINT j = 0; j < mInfo.HeightmapWidth; ++j)
-		{
-			dest[i*mInfo.HeightmapWidth+j] = Average(i,j);
-		}
-	}
-
-	// Replace the old heightmap with the filtered one.
-	mHeightmap = dest;
-}
-
-bool Terrain::InBounds(int i, int j)
-{
-	// True if ij are valid indices; false otherwise.
-	return 
-		i >= 0 && i < (int)mInfo.HeightmapHeight && 
-		j >= 0 && j < (int)mInfo.HeightmapWidth;
-}
-
-float Terrain::Average(int i, int j)
-{
-	// Function computes the average height of the ij element.
-	// It averages itself with its eight neighbor pixels.  Note
-	// that if a pixel is missing neighbor, we just don't include it
-	// in the average--that is, edge pixels don't have a neighbor pixel.
-	//
-	// ----------
-	// | 1| 2| 3|
-	// ----------
-	// |4 |ij| 6|
-	// ----------
-	// | 7| 8| 9|
-	// ----------
-
-	float avg = 0.0f;
-	float num = 0.0f;
-
-	// Use int to allow negatives.  If we use UINT, @ i=0, m=i-1=UINT_MAX
-	// and no iterations of the outer for loop occur.
-	for(int m = i-1; m <= i+1; ++m)
-	{
-		for(int n = j-1; n <= j+1; ++n)
-		{
-			if( InBounds(m,n) )
-			{
-				avg += mHeightmap[m*mInfo.HeightmapWidth + n];
-				num += 1.0f;
-			}
-		}
-	}
-
-	return avg / num;
-}
-
-void Terrain::CalcAllPatchBoundsY()
-{
-	mPatchBoundsY.resize(mNumPatchQuadFaces);
-
-	// For each patch
-	for(UINT i = 0; i < mNumPatchVertRows-1; ++i)
-	{
-		for(UINT j = 0; j < mNumPatchVertCols-1; ++j)
-		{
-			CalcPatchBoundsY(i, j);
-		}
-	}
-}
-
-void Terrain::CalcPatchBoundsY(UINT i, UINT j)
-{
-	// Scan the heightmap values this patch covers and compute the min/max height.
-
-	UINT x0 = j*CellsPerPatch;
-	UINT x1 = (j+1)*CellsPerPatch;
-
-	UINT y0 = i*CellsPerPatch;
-	UINT y1 = (i+1)*CellsPerPatch;
-
-	float minY = +MathHelper::Infinity;
-	float maxY = -MathHelper::Infinity;
-	for(UINT y = y0; y <= y1; ++y)
-	{
-		for(UINT x = x0; x <= x1; ++x)
-		{
-			UINT k = y*mInfo.HeightmapWidth + x;
-			minY = MathHelper::Min(minY, mHeightmap[k]);
-			maxY = MathHelper::Max(maxY, mHeightmap[k]);
-		}
-	}
-
-	UINT patchID = i*(mNumPatchVertCols-1)+j;
-	mPatchBoundsY[patchID] = XMFLOAT2(minY, maxY);
-}
-
 void Terrain::BuildQuadPatchVB(ID3D11Device* device)
 {
 	std::vector<Vertex::Terrain> patchVertices(mNumPatchVertRows*mNumPatchVertCols);
@@ -336,12 +218,13 @@ void Terrain::BuildQuadPatchVB(ID3D11Device* device)
 	}
 
 	// Store axis-aligned bounding box y-bounds in upper-left patch corner.
+	const std::vector<XMFLOAT2>& patchBoundsY = mHeightfield.GetPatchBoundsY();
 	for(UINT i = 0; i < mNumPatchVertRows-1; ++i)
 	{
 		for(UINT j = 0; j < mNumPatchVertCols-1; ++j)
 		{
 			UINT patchID = i*(mNumPatchVertCols-1)+j;
-			patchVertices[i*mNumPatchVertCols+j].BoundsY = mPatchBoundsY[patchID];
+			patchVertices[i*mNumPatchVertCols+j].BoundsY = patchBoundsY[patchID];
 		}
 	}
 
@@ -362,22 +245,24 @@ void Terrain::BuildQuadPatchIB(ID3D11Device* device)
 {
 	std::vector<USHORT> indices(mNumPatchQuadFaces*4); // 4 indices per quad face
 
-	// Iterate over each quad and compute indices.
+	// Iterate over each quad in quadtree leaf order and compute indices, so that
+	// every quadtree node covers a contiguous range of the buffer.
 	int k = 0;
-	for(UINT i = 0; i < mNumPatchVertRows-1; ++i)
+	for(UINT leaf = 0; leaf < mNumPatchQuadFaces; ++leaf)
 	{
-		for(UINT j = 0; j < mNumPatchVertCols-1; ++j)
-		{
-			// Top row of 2x2 quad patch
-			indices[k]   = i*mNumPatchVertCols+j;
-			indices[k+1] = i*mNumPatchVertCols+j+1;
+		UINT patchID = mQuadtree.GetLeafPatch(leaf);
+		UINT i = patchID / (mNumPatchVertCols-1);
+		UINT j = patchID % (mNumPatchVertCols-1);
 
-			// Bottom row of 2x2 quad patch
-			indices[k+2] = (i+1)*mNumPatchVertCols+j;
-			indices[k+3] = (i+1)*mNumPatchVertCols+j+1;
+		// Top row of 2x2 quad patch
+		indices[k]   = i*mNumPatchVertCols+j;
+		indices[k+1] = i*mNumPatchVertCols+j+1;
 
-			k += 4; // next quad
-		}
+		// Bottom row of 2x2 quad patch
+		indices[k+2] = (i+1)*mNumPatchVertCols+j;
+		indices[k+3] = (i+1)*mNumPatchVertCols+j+1;
+
+		k += 4; // next quad
 	}
 
 	D3D11_BUFFER_DESC ibd;
@@ -409,8 +294,9 @@ void Terrain::BuildHeightmapSRV(ID3D11Device* device)
 	texDesc.MiscFlags = 0;
 
 	// HALF is defined in xnamath.h, for storing 16-bit float.
-	std::vector<DirectX::PackedVector::HALF> hmap(mHeightmap.size());
-	std::transform(mHeightmap.begin(), mHeightmap.end(), hmap.begin(), DirectX::PackedVector::XMConvertFloatToHalf);
+	const std::vector<float>& heightmap = mHeightfield.GetHeightmap();
+	std::vector<DirectX::PackedVector::HALF> hmap(heightmap.size());
+	std::transform(heightmap.begin(), heightmap.end(), hmap.begin(), DirectX::PackedVector::XMConvertFloatToHalf);
 
 	D3D11_SUBRESOURCE_DATA data;
 	data.pSysMem = &hmap[0];
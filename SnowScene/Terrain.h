@@ -8,8 +8,12 @@
 #define TERRAIN_H
 
 #include "d3dUtil.h"
+#include "HeightmapSource.h"
+#include "TerrainHeightfield.h"
+#include "TerrainQuadtree.h"
 
 class Camera;
+class ThreadPool;
 struct DirectionalLight;
 
 class Terrain
@@ -18,6 +22,7 @@ public:
 	struct InitInfo
 	{
 		std::wstring HeightMapFilename;
+		HeightmapSource::Format HeightmapFormat;
 		std::wstring LayerMapFilename;
 		std::wstring BlendMapFilename;
 		float HeightScale;
@@ -26,6 +31,9 @@ public:
 		float CellSpacing;
 	};
 
+	typedef TerrainHeightfield::RayQuery RayQuery;
+	typedef TerrainHeightfield::RayHit RayHit;
+
 public:
 	Terrain();
 	~Terrain();
@@ -34,6 +42,12 @@ public:
 	float GetDepth()const;
 	float GetHeight(float x, float z)const;
 
+	// Height and ray queries; see TerrainHeightfield.
+	void GetHeights(const XMFLOAT2* points, float* heights, UINT count, ThreadPool* pool = 0)const;
+	bool CastRay(const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDist, float& hitDist)const;
+	bool IntersectSegment(const XMFLOAT3& p0, const XMFLOAT3& p1)const;
+	void CastRays(const RayQuery* rays, RayHit* hits, UINT count, ThreadPool* pool = 0)const;
+
 	XMMATRIX GetWorld()const;
 	void SetWorld(CXMMATRIX M);
 
@@ -42,23 +56,11 @@ public:
 	void Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight lights[3]);
 
 private:
-	void LoadHeightmap();
-	void Smooth();
-	bool InBounds(int i, int j);
-	float Average(int i, int j);
-	void CalcAllPatchBoundsY();
-	void CalcPatchBoundsY(UINT i, UINT j);
 	void BuildQuadPatchVB(ID3D11Device* device);
 	void BuildQuadPatchIB(ID3D11Device* device);
 	void BuildHeightmapSRV(ID3D11Device* device);
 
 private:
-
-	// Divide heightmap into patches such that each patch has CellsPerPatch cells
-	// and CellsPerPatch+1 vertices.  Use 64 so that if we tessellate all the way 
-	// to 64, we use all the data from the heightmap.  
-	static const int CellsPerPatch = 64;
-
 	ID3D11Buffer* mQuadPatchVB;
 	ID3D11Buffer* mQuadPatchIB;
 
@@ -78,8 +80,10 @@ private:
 
 	Material mMat;
 
-	std::vector<XMFLOAT2> mPatchBoundsY;
-	std::vector<float> mHeightmap;
+	TerrainHeightfield mHeightfield;
+
+	TerrainQuadtree mQuadtree;
+	std::vector<TerrainQuadtree::LeafRange> mVisibleRanges;
 };
 
 #endif // TERRAIN_H
\ No newline at end of file
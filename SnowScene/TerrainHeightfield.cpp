@@ -0,0 +1,713 @@
+//***************************************************************************************
+// TerrainHeightfield.cpp
+//***************************************************************************************
+
+#include "TerrainHeightfield.h"
+#include "MathHelper.h"
+#include "ThreadPool.h"
+#include <cmath>
+using namespace DirectX;
+
+namespace
+{
+	// 2D DDA: visits, in order, the cells of a square grid that the line o + t*d
+	// crosses for t in [t0, t1].  Works in (column, row) coordinates; cells are
+	// cellSize units wide and indices are kept within [colMin, colMax] x [rowMin, rowMax].
+	class GridWalk
+	{
+	public:
+		GridWalk(float oc, float od, float dc, float dd, float cellSize,
+			int colMin, int colMax, int rowMin, int rowMax, float t0, float t1)
+		: mOc(oc), mOd(od), mDc(dc), mDd(dd), mCellSize(cellSize),
+		  mColMin(colMin), mColMax(colMax), mRowMin(rowMin), mRowMax(rowMax),
+		  mT(t0), mT1(t1), mDone(t0 > t1)
+		{
+			mStepC = dc > 0.0f ? 1 : (dc < 0.0f ? -1 : 0);
+			mStepR = dd > 0.0f ? 1 : (dd < 0.0f ? -1 : 0);
+
+			mCol = MathHelper::Clamp((int)floorf((oc + dc*t0) / cellSize), colMin, colMax);
+			mRow = MathHelper::Clamp((int)floorf((od + dd*t0) / cellSize), rowMin, rowMax);
+		}
+
+		bool Next(int& col, int& row, float& tEnter, float& tExit)
+		{
+			if( mDone )
+				return false;
+
+			// Parameters where the line leaves the current cell through a column or
+			// row boundary.  Recomputed from the cell index, so no error accumulates.
+			float tc = BoundaryT(mCol, mStepC, mOc, mDc);
+			float tr = BoundaryT(mRow, mStepR, mOd, mDd);
+
+			col = mCol;
+			row = mRow;
+			tEnter = mT;
+			tExit  = MathHelper::Max(MathHelper::Min(MathHelper::Min(tc, tr), mT1), mT);
+
+			if( tExit >= mT1 )
+			{
+				mDone = true;
+				return true;
+			}
+
+			if( tc < tr )
+				mCol += mStepC;
+			else
+				mRow += mStepR;
+
+			mT = tExit;
+			mDone = mCol < mColMin || mCol > mColMax || mRow < mRowMin || mRow > mRowMax;
+			return true;
+		}
+
+	private:
+		float BoundaryT(int cell, int step, float o, float d)const
+		{
+			if( step == 0 )
+				return MathHelper::Infinity;
+
+			float edge = (step > 0 ? cell + 1 : cell)*mCellSize;
+			return (edge - o) / d;
+		}
+
+	private:
+		float mOc, mOd, mDc, mDd;
+		float mCellSize;
+		int mColMin, mColMax, mRowMin, mRowMax;
+		int mStepC, mStepR;
+		int mCol, mRow;
+		float mT, mT1;
+		bool mDone;
+	};
+
+	// Narrows [t0, t1] to where o + t*d lies in [lo, hi].
+	void ClipSlab(float o, float d, float lo, float hi, float& t0, float& t1)
+	{
+		if( d == 0.0f )
+		{
+			if( o < lo || o > hi )
+				t0 = MathHelper::Infinity;
+			return;
+		}
+
+		float ta = (lo - o) / d;
+		float tb = (hi - o) / d;
+		t0 = MathHelper::Max(t0, MathHelper::Min(ta, tb));
+		t1 = MathHelper::Min(t1, MathHelper::Max(ta, tb));
+	}
+
+	// Height of the cell surface at cell coordinates (s, t), as in GetHeight.
+	float CellHeight(float A, float B, float C, float D, float s, float t, bool upper)
+	{
+		if( upper )
+			return A + s*(B - A) + t*(C - A);
+		else
+			return D + (1.0f-s)*(C - D) + (1.0f-t)*(B - D);
+	}
+}
+
+TerrainHeightfield::TerrainHeightfield()
+: mNumPatchVertRows(0), mNumPatchVertCols(0), mNumPatchQuadFaces(0),
+  mBoundsY(0.0f, 0.0f)
+{
+}
+
+TerrainHeightfield::~TerrainHeightfield()
+{
+}
+
+void TerrainHeightfield::Init(const InitInfo& initInfo)
+{
+	mInfo = initInfo;
+
+	// Divide heightmap into patches such that each patch has CellsPerPatch.
+	mNumPatchVertRows = ((mInfo.HeightmapHeight-1) / CellsPerPatch) + 1;
+	mNumPatchVertCols = ((mInfo.HeightmapWidth-1) / CellsPerPatch) + 1;
+	mNumPatchQuadFaces = (mNumPatchVertRows-1)*(mNumPatchVertCols-1);
+
+	LoadHeightmap();
+	Smooth();
+	CalcAllPatchBoundsY();
+}
+
+float TerrainHeightfield::GetWidth()const
+{
+	// Total terrain width.
+	return (mInfo.HeightmapWidth-1)*mInfo.CellSpacing;
+}
+
+float TerrainHeightfield::GetDepth()const
+{
+	// Total terrain depth.
+	return (mInfo.HeightmapHeight-1)*mInfo.CellSpacing;
+}
+
+float TerrainHeightfield::GetHeight(float x, float z)const
+{
+	// Transform from terrain local space to "cell" space, clamped to the map.
+	float c = (x + 0.5f*GetWidth()) /  mInfo.CellSpacing;
+	float d = (z - 0.5f*GetDepth()) / -mInfo.CellSpacing;
+	c = MathHelper::Clamp(c, 0.0f, (float)(mInfo.HeightmapWidth-1));
+	d = MathHelper::Clamp(d, 0.0f, (float)(mInfo.HeightmapHeight-1));
+
+	// Get the row and column we are in.  The last row and column of texels belong
+	// to the cells before them.
+	int row = MathHelper::Min((int)floorf(d), (int)mInfo.HeightmapHeight-2);
+	int col = MathHelper::Min((int)floorf(c), (int)mInfo.HeightmapWidth-2);
+
+	// Grab the heights of the cell we are in.
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	float A = mHeightmap[row*mInfo.HeightmapWidth + col];
+	float B = mHeightmap[row*mInfo.HeightmapWidth + col + 1];
+	float C = mHeightmap[(row+1)*mInfo.HeightmapWidth + col];
+	float D = mHeightmap[(row+1)*mInfo.HeightmapWidth + col + 1];
+
+	// Where we are relative to the cell.
+	float s = c - (float)col;
+	float t = d - (float)row;
+
+	// If upper triangle ABC.
+	if( s + t <= 1.0f)
+	{
+		float uy = B - A;
+		float vy = C - A;
+		return A + s*uy + t*vy;
+	}
+	else // lower triangle DCB.
+	{
+		float uy = C - D;
+		float vy = B - D;
+		return D + (1.0f-s)*uy + (1.0f-t)*vy;
+	}
+}
+
+void TerrainHeightfield::GetHeights(const XMFLOAT2* points, float* heights, UINT count, ThreadPool* pool)const
+{
+	if( count == 0 )
+		return;
+
+	if( !pool )
+		pool = &ThreadPool::Default();
+
+	// Small batches: resolve the points in the order given, four per step.
+	if( count < HeightQueryBucketMin )
+	{
+		pool->ParallelFor(count, HeightQueriesPerTask, [&](UINT begin, UINT end)
+		{
+			for(UINT i = begin; i < end; i += 4)
+			{
+				// Pad the last step by repeating the final point.
+				UINT last = end - 1;
+				XMFLOAT4 h;
+				CalcHeights4(&points[i], &points[MathHelper::Min(i+1, last)],
+					&points[MathHelper::Min(i+2, last)], &points[MathHelper::Min(i+3, last)], h);
+
+				heights[i] = h.x;
+				if( i+1 < end ) heights[i+1] = h.y;
+				if( i+2 < end ) heights[i+2] = h.z;
+				if( i+3 < end ) heights[i+3] = h.w;
+			}
+		});
+		return;
+	}
+
+	// Large batches: counting sort the queries by patch so each worker walks the
+	// heightmap one patch (65x65 heights) at a time instead of jumping around.
+	std::vector<UINT> keys(count);
+	pool->ParallelFor(count, HeightQueriesPerTask, [&](UINT begin, UINT end)
+	{
+		for(UINT i = begin; i < end; ++i)
+			keys[i] = GetPatchIndex(points[i].x, points[i].y);
+	});
+
+	std::vector<UINT> offsets(mNumPatchQuadFaces + 1, 0);
+	for(UINT i = 0; i < count; ++i)
+		++offsets[keys[i] + 1];
+	for(UINT k = 0; k < mNumPatchQuadFaces; ++k)
+		offsets[k + 1] += offsets[k];
+
+	std::vector<UINT> order(count);
+	for(UINT i = 0; i < count; ++i)
+		order[offsets[keys[i]]++] = i;
+
+	pool->ParallelFor(count, HeightQueriesPerTask, [&](UINT begin, UINT end)
+	{
+		for(UINT i = begin; i < end; i += 4)
+		{
+			UINT last = end - 1;
+			UINT q0 = order[i];
+			UINT q1 = order[MathHelper::Min(i+1, last)];
+			UINT q2 = order[MathHelper::Min(i+2, last)];
+			UINT q3 = order[MathHelper::Min(i+3, last)];
+
+			XMFLOAT4 h;
+			CalcHeights4(&points[q0], &points[q1], &points[q2], &points[q3], h);
+
+			heights[q0] = h.x;
+			heights[q1] = h.y;
+			heights[q2] = h.z;
+			heights[q3] = h.w;
+		}
+	});
+}
+
+UINT TerrainHeightfield::GetPatchIndex(float x, float z)const
+{
+	float c = (x + 0.5f*GetWidth()) /  mInfo.CellSpacing;
+	float d = (z - 0.5f*GetDepth()) / -mInfo.CellSpacing;
+
+	int patchCols = (int)mNumPatchVertCols - 1;
+	int patchRows = (int)mNumPatchVertRows - 1;
+
+	int j = MathHelper::Clamp((int)floorf(c) / CellsPerPatch, 0, patchCols - 1);
+	int i = MathHelper::Clamp((int)floorf(d) / CellsPerPatch, 0, patchRows - 1);
+
+	return (UINT)(i*patchCols + j);
+}
+
+void TerrainHeightfield::CalcHeights4(const XMFLOAT2* p0, const XMFLOAT2* p1,
+	const XMFLOAT2* p2, const XMFLOAT2* p3, XMFLOAT4& heights)const
+{
+	// Four lane version of GetHeight.  Every lane performs the same operations in
+	// the same order as the scalar code (no fused multiply-add), so the results
+	// match it bit for bit.
+	XMVECTOR x = XMVectorSet(p0->x, p1->x, p2->x, p3->x);
+	XMVECTOR z = XMVectorSet(p0->y, p1->y, p2->y, p3->y);
+
+	// Transform from terrain local space to "cell" space, clamped to the map.
+	XMVECTOR c = XMVectorDivide(XMVectorAdd(x, XMVectorReplicate(0.5f*GetWidth())),
+		XMVectorReplicate(mInfo.CellSpacing));
+	XMVECTOR d = XMVectorDivide(XMVectorSubtract(z, XMVectorReplicate(0.5f*GetDepth())),
+		XMVectorReplicate(-mInfo.CellSpacing));
+	c = XMVectorClamp(c, XMVectorZero(), XMVectorReplicate((float)(mInfo.HeightmapWidth-1)));
+	d = XMVectorClamp(d, XMVectorZero(), XMVectorReplicate((float)(mInfo.HeightmapHeight-1)));
+
+	// Get the row and column we are in.  The last row and column of texels belong
+	// to the cells before them.
+	XMVECTOR colF = XMVectorMin(XMVectorFloor(c), XMVectorReplicate((float)(mInfo.HeightmapWidth-2)));
+	XMVECTOR rowF = XMVectorMin(XMVectorFloor(d), XMVectorReplicate((float)(mInfo.HeightmapHeight-2)));
+
+	XMFLOAT4 cols, rows;
+	XMStoreFloat4(&cols, colF);
+	XMStoreFloat4(&rows, rowF);
+
+	// Grab the heights of the cell each point is in.
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	const float* colArray = &cols.x;
+	const float* rowArray = &rows.x;
+	XMFLOAT4 A, B, C, D;
+	float* a = &A.x;
+	float* b = &B.x;
+	float* cc = &C.x;
+	float* dd = &D.x;
+	for(int k = 0; k < 4; ++k)
+	{
+		const float* h = &mHeightmap[(int)rowArray[k]*mInfo.HeightmapWidth + (int)colArray[k]];
+		a[k]  = h[0];
+		b[k]  = h[1];
+		cc[k] = h[mInfo.HeightmapWidth];
+		dd[k] = h[mInfo.HeightmapWidth + 1];
+	}
+
+	XMVECTOR vA = XMLoadFloat4(&A);
+	XMVECTOR vB = XMLoadFloat4(&B);
+	XMVECTOR vC = XMLoadFloat4(&C);
+	XMVECTOR vD = XMLoadFloat4(&D);
+
+	// Where we are relative to the cell.
+	XMVECTOR s = XMVectorSubtract(c, colF);
+	XMVECTOR t = XMVectorSubtract(d, rowF);
+	XMVECTOR one = XMVectorReplicate(1.0f);
+
+	// Upper triangle ABC.
+	XMVECTOR upper = XMVectorAdd(
+		XMVectorAdd(vA, XMVectorMultiply(s, XMVectorSubtract(vB, vA))),
+		XMVectorMultiply(t, XMVectorSubtract(vC, vA)));
+
+	// Lower triangle DCB.
+	XMVECTOR lower = XMVectorAdd(
+		XMVectorAdd(vD, XMVectorMultiply(XMVectorSubtract(one, s), XMVectorSubtract(vC, vD))),
+		XMVectorMultiply(XMVectorSubtract(one, t), XMVectorSubtract(vB, vD)));
+
+	XMVECTOR inUpper = XMVectorLessOrEqual(XMVectorAdd(s, t), one);
+	XMStoreFloat4(&heights, XMVectorSelect(lower, upper, inUpper));
+}
+
+bool TerrainHeightfield::CastRay(const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDist, float& hitDist)const
+{
+	float length = XMVectorGetX(XMVector3Length(XMLoadFloat3(&dir)));
+	if( length <= 0.0f || mHeightmap.empty() )
+		return false;
+
+	// Work in cell space: x is the heightmap column, z the row, y the height, and t
+	// stays the world distance along the normalized direction.
+	XMFLOAT3 o((origin.x + 0.5f*GetWidth()) / mInfo.CellSpacing, origin.y,
+		(0.5f*GetDepth() - origin.z) / mInfo.CellSpacing);
+	XMFLOAT3 d(dir.x / length / mInfo.CellSpacing, dir.y / length,
+		-dir.z / length / mInfo.CellSpacing);
+
+	// Clip to the terrain's bounding box.
+	float t0 = 0.0f;
+	float t1 = maxDist;
+	ClipSlab(o.x, d.x, 0.0f, (float)(mInfo.HeightmapWidth-1),  t0, t1);
+	ClipSlab(o.z, d.z, 0.0f, (float)(mInfo.HeightmapHeight-1), t0, t1);
+	ClipSlab(o.y, d.y, mBoundsY.x, mBoundsY.y, t0, t1);
+	if( t0 > t1 )
+		return false;
+
+	// Walk the patches first and only step through the cells of patches whose
+	// height range the ray overlaps.
+	int patchCols = (int)mNumPatchVertCols - 1;
+	int patchRows = (int)mNumPatchVertRows - 1;
+	GridWalk patches(o.x, o.z, d.x, d.z, (float)CellsPerPatch, 0, patchCols-1, 0, patchRows-1, t0, t1);
+
+	int i, j;
+	float tEnter, tExit;
+	while( patches.Next(j, i, tEnter, tExit) )
+	{
+		float y0 = o.y + d.y*tEnter;
+		float y1 = o.y + d.y*tExit;
+		const XMFLOAT2& bounds = mPatchBoundsY[i*patchCols + j];
+		if( MathHelper::Max(y0, y1) < bounds.x || MathHelper::Min(y0, y1) > bounds.y )
+			continue;
+
+		if( CastRayPatch(o, d, i, j, tEnter, tExit, hitDist) )
+			return true;
+	}
+
+	return false;
+}
+
+bool TerrainHeightfield::IntersectSegment(const XMFLOAT3& p0, const XMFLOAT3& p1)const
+{
+	XMVECTOR v = XMVectorSubtract(XMLoadFloat3(&p1), XMLoadFloat3(&p0));
+
+	XMFLOAT3 dir;
+	XMStoreFloat3(&dir, v);
+
+	float hitDist;
+	return CastRay(p0, dir, XMVectorGetX(XMVector3Length(v)), hitDist);
+}
+
+void TerrainHeightfield::CastRays(const RayQuery* rays, RayHit* hits, UINT count, ThreadPool* pool)const
+{
+	if( !pool )
+		pool = &ThreadPool::Default();
+
+	pool->ParallelFor(count, RaysPerTask, [&](UINT begin, UINT end)
+	{
+		for(UINT i = begin; i < end; ++i)
+		{
+			const RayQuery& ray = rays[i];
+			RayHit& hit = hits[i];
+
+			hit.Hit  = CastRay(ray.Origin, ray.Dir, ray.MaxDist, hit.Dist);
+			hit.Pos  = ray.Origin;
+			if( !hit.Hit )
+			{
+				hit.Dist = 0.0f;
+				continue;
+			}
+
+			XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&ray.Dir));
+			XMStoreFloat3(&hit.Pos, XMVectorAdd(XMLoadFloat3(&ray.Origin), XMVectorScale(dir, hit.Dist)));
+		}
+	});
+}
+
+bool TerrainHeightfield::CastRayPatch(const XMFLOAT3& o, const XMFLOAT3& d, UINT i, UINT j,
+	float t0, float t1, float& hitT)const
+{
+	int col0 = j*CellsPerPatch;
+	int row0 = i*CellsPerPatch;
+	int col1 = MathHelper::Min(col0 + CellsPerPatch, (int)mInfo.HeightmapWidth-1) - 1;
+	int row1 = MathHelper::Min(row0 + CellsPerPatch, (int)mInfo.HeightmapHeight-1) - 1;
+
+	GridWalk cells(o.x, o.z, d.x, d.z, 1.0f, col0, col1, row0, row1, t0, t1);
+
+	int row, col;
+	float tEnter, tExit;
+	while( cells.Next(col, row, tEnter, tExit) )
+	{
+		if( CastRayCell(o, d, row, col, tEnter, tExit, hitT) )
+			return true;
+	}
+
+	return false;
+}
+
+bool TerrainHeightfield::CastRayCell(const XMFLOAT3& o, const XMFLOAT3& d, int row, int col,
+	float t0, float t1, float& hitT)const
+{
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	float A = mHeightmap[row*mInfo.HeightmapWidth + col];
+	float B = mHeightmap[row*mInfo.HeightmapWidth + col + 1];
+	float C = mHeightmap[(row+1)*mInfo.HeightmapWidth + col];
+	float D = mHeightmap[(row+1)*mInfo.HeightmapWidth + col + 1];
+
+	// Where the ray is relative to the cell at t0.
+	float s0 = o.x + d.x*t0 - (float)col;
+	float u0 = o.z + d.z*t0 - (float)row;
+
+	// The surface is planar on each side of the diagonal s + t = 1, so split the span
+	// where the ray crosses it and solve each piece linearly.
+	float ts[3] = { t0, t1, t1 };
+	UINT numPieces = 1;
+	float diag = d.x + d.z;
+	if( diag != 0.0f )
+	{
+		float tm = t0 + (1.0f - s0 - u0) / diag;
+		if( tm > t0 && tm < t1 )
+		{
+			ts[1] = tm;
+			numPieces = 2;
+		}
+	}
+
+	for(UINT k = 0; k < numPieces; ++k)
+	{
+		float ta = ts[k];
+		float tb = ts[k+1];
+
+		float tm = 0.5f*(ta + tb) - t0;
+		bool upper = (s0 + d.x*tm) + (u0 + d.z*tm) <= 1.0f;
+
+		float fa = o.y + d.y*ta - CellHeight(A, B, C, D, s0 + d.x*(ta-t0), u0 + d.z*(ta-t0), upper);
+		float fb = o.y + d.y*tb - CellHeight(A, B, C, D, s0 + d.x*(tb-t0), u0 + d.z*(tb-t0), upper);
+
+		// Above (or on) the surface at the start of the piece and on or below it at the end.
+		if( fa >= 0.0f && fb <= 0.0f )
+		{
+			hitT = fa == fb ? ta : ta + (tb - ta)*(fa / (fa - fb));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+UINT TerrainHeightfield::GetNumPatchRows()const
+{
+	return mNumPatchVertRows-1;
+}
+
+UINT TerrainHeightfield::GetNumPatchCols()const
+{
+	return mNumPatchVertCols-1;
+}
+
+const std::vector<XMFLOAT2>& TerrainHeightfield::GetPatchBoundsY()const
+{
+	return mPatchBoundsY;
+}
+
+const std::vector<float>& TerrainHeightfield::GetHeightmap()const
+{
+	return mHeightmap;
+}
+
+void TerrainHeightfield::LoadHeightmap()
+{
+	// A height for each vertex; stays flat if the file cannot be read.
+	mHeightmap.assign(mInfo.HeightmapHeight * mInfo.HeightmapWidth, 0.0f);
+
+	// Map the file and convert it in place, one band of rows per task, instead of
+	// reading it into a byte array and copying that into the float array.
+	HeightmapSource source;
+	if( !source.Open(mInfo.HeightMapFilename, mInfo.HeightmapFormat,
+		mInfo.HeightmapWidth, mInfo.HeightmapHeight) )
+	{
+		return;
+	}
+
+	const UINT width = mInfo.HeightmapWidth;
+	ThreadPool::Default().ParallelFor(mInfo.HeightmapHeight, RowsPerTask, [&](UINT rowBegin, UINT rowEnd)
+	{
+		source.ReadTile(0, rowBegin, width, rowEnd - rowBegin, mInfo.HeightScale,
+			&mHeightmap[rowBegin*width], width);
+	});
+}
+
+void TerrainHeightfield::Smooth()
+{
+	std::vector<float> dest( mHeightmap.size() );
+
+	ThreadPool::Default().ParallelFor(mInfo.HeightmapHeight, RowsPerTask, [&](UINT rowBegin, UINT rowEnd)
+	{
+		for(UINT i = rowBegin; i < rowEnd; ++i)
+		{
+			SmoothRow(i, &dest[0]);
+		}
+	});
+
+	// Replace the old heightmap with the filtered one.
+	mHeightmap.swap(dest);
+}
+
+void TerrainHeightfield::SmoothRow(UINT i, float* dest)
+{
+	const UINT w = mInfo.HeightmapWidth;
+
+	// Border rows have missing neighbors; use the bounds checked path.
+	if( i == 0 || i + 1 >= mInfo.HeightmapHeight || w < 3 )
+	{
+		for(UINT j = 0; j < w; ++j)
+			dest[i*w+j] = Average(i,j);
+
+		return;
+	}
+
+	// Interior texels, four columns at a time.  The nine taps are summed in the same
+	// order as Average() and divided by 9, so the result is bit-for-bit identical.
+	// A separable row/column filter would reassociate the additions and shift the
+	// heights by an ulp here and there, which moves terrain collision.
+	const float* r0 = &mHeightmap[(i-1)*w];
+	const float* r1 = &mHeightmap[i*w];
+	const float* r2 = &mHeightmap[(i+1)*w];
+
+	XMVECTOR nine = XMVectorReplicate(9.0f);
+
+	dest[i*w] = Average(i, 0);
+
+	UINT j = 1;
+	for(; j + 4 < w; j += 4)
+	{
+		XMVECTOR avg = XMVectorZero();
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r0[j-1]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r0[j]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r0[j+1]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r1[j-1]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r1[j]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r1[j+1]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r2[j-1]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r2[j]));
+		avg = XMVectorAdd(avg, XMLoadFloat4((const XMFLOAT4*)&r2[j+1]));
+
+		XMStoreFloat4((XMFLOAT4*)&dest[i*w+j], XMVectorDivide(avg, nine));
+	}
+
+	// Remaining interior columns and the right border.
+	for(; j < w; ++j)
+		dest[i*w+j] = Average(i,j);
+}
+
+bool TerrainHeightfield::InBounds(int i, int j)const
+{
+	// True if ij are valid indices; false otherwise.
+	return 
+		i >= 0 && i < (int)mInfo.HeightmapHeight && 
+		j >= 0 && j < (int)mInfo.HeightmapWidth;
+}
+
+float TerrainHeightfield::Average(int i, int j)const
+{
+	// Function computes the average height of the ij element.
+	// It averages itself with its eight neighbor pixels.  Note
+	// that if a pixel is missing neighbor, we just don't include it
+	// in the average--that is, edge pixels don't have a neighbor pixel.
+	//
+	// ----------
+	// | 1| 2| 3|
+	// ----------
+	// |4 |ij| 6|
+	// ----------
+	// | 7| 8| 9|
+	// ----------
+
+	float avg = 0.0f;
+	float num = 0.0f;
+
+	// Use int to allow negatives.  If we use UINT, @ i=0, m=i-1=UINT_MAX
+	// and no iterations of the outer for loop occur.
+	for(int m = i-1; m <= i+1; ++m)
+	{
+		for(int n = j-1; n <= j+1; ++n)
+		{
+			if( InBounds(m,n) )
+			{
+				avg += mHeightmap[m*mInfo.HeightmapWidth + n];
+				num += 1.0f;
+			}
+		}
+	}
+
+	return avg / num;
+}
+
+void TerrainHeightfield::CalcAllPatchBoundsY()
+{
+	mPatchBoundsY.resize(mNumPatchQuadFaces);
+
+	// For each patch, one row of patches per task.
+	ThreadPool::Default().ParallelFor(mNumPatchVertRows-1, 1, [&](UINT rowBegin, UINT rowEnd)
+	{
+		for(UINT i = rowBegin; i < rowEnd; ++i)
+		{
+			for(UINT j = 0; j < mNumPatchVertCols-1; ++j)
+			{
+				CalcPatchBoundsY(i, j);
+			}
+		}
+	});
+
+	// Height range of the whole terrain.
+	mBoundsY = XMFLOAT2(+MathHelper::Infinity, -MathHelper::Infinity);
+	for(size_t k = 0; k < mPatchBoundsY.size(); ++k)
+	{
+		mBoundsY.x = MathHelper::Min(mBoundsY.x, mPatchBoundsY[k].x);
+		mBoundsY.y = MathHelper::Max(mBoundsY.y, mPatchBoundsY[k].y);
+	}
+}
+
+void TerrainHeightfield::CalcPatchBoundsY(UINT i, UINT j)
+{
+	// Scan the heightmap values this patch covers and compute the min/max height.
+
+	UINT x0 = j*CellsPerPatch;
+	UINT x1 = (j+1)*CellsPerPatch;
+
+	UINT y0 = i*CellsPerPatch;
+	UINT y1 = (i+1)*CellsPerPatch;
+
+	// Min/max are exact, so the four lanes can be reduced in any order.
+	XMVECTOR minV = XMVectorReplicate(+MathHelper::Infinity);
+	XMVECTOR maxV = XMVectorReplicate(-MathHelper::Infinity);
+	float minY = +MathHelper::Infinity;
+	float maxY = -MathHelper::Infinity;
+	for(UINT y = y0; y <= y1; ++y)
+	{
+		const float* row = &mHeightmap[y*mInfo.HeightmapWidth];
+
+		UINT x = x0;
+		for(; x + 4 <= x1 + 1; x += 4)
+		{
+			XMVECTOR h = XMLoadFloat4((const XMFLOAT4*)&row[x]);
+			minV = XMVectorMin(minV, h);
+			maxV = XMVectorMax(maxV, h);
+		}
+
+		for(; x <= x1; ++x)
+		{
+			minY = MathHelper::Min(minY, row[x]);
+			maxY = MathHelper::Max(maxY, row[x]);
+		}
+	}
+
+	XMFLOAT4 mins, maxs;
+	XMStoreFloat4(&mins, minV);
+	XMStoreFloat4(&maxs, maxV);
+	minY = MathHelper::Min(minY, MathHelper::Min(MathHelper::Min(mins.x, mins.y), MathHelper::Min(mins.z, mins.w)));
+	maxY = MathHelper::Max(maxY, MathHelper::Max(MathHelper::Max(maxs.x, maxs.y), MathHelper::Max(maxs.z, maxs.w)));
+
+	UINT patchID = i*(mNumPatchVertCols-1)+j;
+	mPatchBoundsY[patchID] = XMFLOAT2(minY, maxY);
+}
@@ -0,0 +1,132 @@
+//***************************************************************************************
+// TerrainHeightfield.h
+//
+// The CPU half of the terrain: the smoothed heightmap, the height range of every patch,
+// and the height and ray queries against them.  Nothing here touches Direct3D, so the
+// queries can be used and tested without a device; Terrain owns one and adds the
+// GPU resources and drawing on top.
+//***************************************************************************************
+
+#ifndef TERRAIN_HEIGHTFIELD_H
+#define TERRAIN_HEIGHTFIELD_H
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "HeightmapSource.h"
+
+class ThreadPool;
+
+class TerrainHeightfield
+{
+public:
+	struct InitInfo
+	{
+		std::wstring HeightMapFilename;
+		HeightmapSource::Format HeightmapFormat;
+		float HeightScale;
+		UINT HeightmapWidth;
+		UINT HeightmapHeight;
+		float CellSpacing;
+	};
+
+	struct RayQuery
+	{
+		DirectX::XMFLOAT3 Origin;
+		DirectX::XMFLOAT3 Dir;
+		float MaxDist;
+	};
+
+	struct RayHit
+	{
+		bool Hit;
+		float Dist;
+		DirectX::XMFLOAT3 Pos;
+	};
+
+	// Divide heightmap into patches such that each patch has CellsPerPatch cells
+	// and CellsPerPatch+1 vertices.  Use 64 so that if we tessellate all the way
+	// to 64, we use all the data from the heightmap.
+	static const int CellsPerPatch = 64;
+
+public:
+	TerrainHeightfield();
+	~TerrainHeightfield();
+
+	// Loads and smooths the heightmap and computes the patch height ranges.
+	void Init(const InitInfo& initInfo);
+
+	float GetWidth()const;
+	float GetDepth()const;
+
+	// Height of the surface at (x, z).  Points off the terrain take the height of
+	// the nearest point on its border.
+	float GetHeight(float x, float z)const;
+
+	// Batched GetHeight for many (x, z) points, given as XMFLOAT2(x, z).  Results are
+	// identical to calling GetHeight per point.  Large batches are bucketed by patch
+	// for locality and split across pool, or ThreadPool::Default() if pool is null.
+	void GetHeights(const DirectX::XMFLOAT2* points, float* heights, UINT count, ThreadPool* pool = 0)const;
+
+	// Casts origin + t*dir, 0 <= t <= maxDist, against the surface GetHeight
+	// interpolates and returns the nearest t where the ray passes from above the
+	// surface to on or below it.  dir need not be normalized; t is measured in world
+	// units along it.
+	bool CastRay(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir, float maxDist, float& hitDist)const;
+
+	// True if the segment from p0 to p1 enters the terrain; for line of sight checks.
+	bool IntersectSegment(const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1)const;
+
+	// CastRay for many rays, split across pool, or ThreadPool::Default() if pool is null.
+	void CastRays(const RayQuery* rays, RayHit* hits, UINT count, ThreadPool* pool = 0)const;
+
+	// Patch grid size, and the min/max height of each patch in row major order.
+	UINT GetNumPatchRows()const;
+	UINT GetNumPatchCols()const;
+	const std::vector<DirectX::XMFLOAT2>& GetPatchBoundsY()const;
+
+	// Heightmap texels, HeightmapWidth per row.
+	const std::vector<float>& GetHeightmap()const;
+
+private:
+	void LoadHeightmap();
+	void Smooth();
+	void SmoothRow(UINT i, float* dest);
+	bool InBounds(int i, int j)const;
+	float Average(int i, int j)const;
+	UINT GetPatchIndex(float x, float z)const;
+	void CalcHeights4(const DirectX::XMFLOAT2* p0, const DirectX::XMFLOAT2* p1,
+		const DirectX::XMFLOAT2* p2, const DirectX::XMFLOAT2* p3, DirectX::XMFLOAT4& heights)const;
+	bool CastRayPatch(const DirectX::XMFLOAT3& o, const DirectX::XMFLOAT3& d, UINT i, UINT j, float t0, float t1, float& hitT)const;
+	bool CastRayCell(const DirectX::XMFLOAT3& o, const DirectX::XMFLOAT3& d, int row, int col, float t0, float t1, float& hitT)const;
+	void CalcAllPatchBoundsY();
+	void CalcPatchBoundsY(UINT i, UINT j);
+
+	TerrainHeightfield(const TerrainHeightfield& rhs);
+	TerrainHeightfield& operator=(const TerrainHeightfield& rhs);
+
+private:
+	// Heightmap rows handed to each worker while preprocessing the heightmap.
+	static const UINT RowsPerTask = 32;
+
+	// Height queries handed to each worker, and the batch size from which queries
+	// are bucketed by patch before they are resolved.
+	static const UINT HeightQueriesPerTask = 1024;
+	static const UINT HeightQueryBucketMin = 4096;
+
+	// Rays handed to each worker by CastRays.
+	static const UINT RaysPerTask = 64;
+
+	InitInfo mInfo;
+
+	UINT mNumPatchVertRows;
+	UINT mNumPatchVertCols;
+	UINT mNumPatchQuadFaces;
+
+	std::vector<DirectX::XMFLOAT2> mPatchBoundsY;
+	DirectX::XMFLOAT2 mBoundsY;
+	std::vector<float> mHeightmap;
+};
+
+#endif // TERRAIN_HEIGHTFIELD_H
@@ -0,0 +1,204 @@
+//***************************************************************************************
+// TerrainQuadtree.cpp
+//***************************************************************************************
+
+#include "TerrainQuadtree.h"
+#include "MathHelper.h"
+#include <chrono>
+using namespace DirectX;
+
+TerrainQuadtree::TerrainQuadtree()
+: mNumPatchRows(0), mNumPatchCols(0),
+  mPatchWidth(0.0f), mPatchDepth(0.0f),
+  mHalfWidth(0.0f), mHalfDepth(0.0f)
+{
+}
+
+TerrainQuadtree::~TerrainQuadtree()
+{
+}
+
+void TerrainQuadtree::Build(const XMFLOAT2* patchBoundsY, UINT numPatchRows, UINT numPatchCols,
+	float width, float depth)
+{
+	mNumPatchRows = numPatchRows;
+	mNumPatchCols = numPatchCols;
+	mPatchWidth = width / numPatchCols;
+	mPatchDepth = depth / numPatchRows;
+	mHalfWidth  = 0.5f*width;
+	mHalfDepth  = 0.5f*depth;
+
+	mNodes.clear();
+	mLeafPatch.clear();
+
+	if( numPatchRows == 0 || numPatchCols == 0 )
+		return;
+
+	// A full quadtree has about a third more nodes than leaves.
+	UINT numPatches = numPatchRows*numPatchCols;
+	mNodes.reserve(numPatches + numPatches/2 + 1);
+	mLeafPatch.reserve(numPatches);
+
+	BuildNode(patchBoundsY, 0, 0, numPatchRows, numPatchCols);
+}
+
+UINT TerrainQuadtree::GetNumPatches()const
+{
+	return (UINT)mLeafPatch.size();
+}
+
+UINT TerrainQuadtree::GetNumNodes()const
+{
+	return (UINT)mNodes.size();
+}
+
+UINT TerrainQuadtree::GetLeafPatch(UINT leaf)const
+{
+	return mLeafPatch[leaf];
+}
+
+void TerrainQuadtree::Cull(const XMFLOAT4 frustumPlanes[6], std::vector<LeafRange>& ranges, CullStats* stats)const
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	// clear() keeps the capacity, so culling every frame does not allocate once the
+	// list has grown to the largest visible set.
+	ranges.clear();
+
+	CullContext ctx;
+	ctx.Planes = frustumPlanes;
+	ctx.Ranges = &ranges;
+	ctx.NumVisible     = 0;
+	ctx.NumNodesTested = 0;
+
+	// Start with all six planes active.
+	if( !mNodes.empty() )
+		CullNode(0, 0x3f, ctx);
+
+	if( stats )
+	{
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+		stats->NumPatches     = GetNumPatches();
+		stats->NumVisible     = ctx.NumVisible;
+		stats->NumNodesTested = ctx.NumNodesTested;
+		stats->NumRanges      = (UINT)ranges.size();
+		stats->CullTimeMs     = elapsed.count();
+	}
+}
+
+UINT TerrainQuadtree::BuildNode(const XMFLOAT2* patchBoundsY, UINT row0, UINT col0, UINT numRows, UINT numCols)
+{
+	// Reserve the slot first so a parent precedes its children.
+	UINT index = (UINT)mNodes.size();
+	mNodes.push_back(Node());
+
+	Node node;
+	node.FirstLeaf   = (UINT)mLeafPatch.size();
+	node.NumChildren = 0;
+
+	if( numRows == 1 && numCols == 1 )
+	{
+		// Same corner expressions as Terrain::BuildQuadPatchVB, so the box matches the
+		// one the hull shader builds from the control points.
+		UINT patchID = row0*mNumPatchCols + col0;
+		node.BoxMin = XMFLOAT3(-mHalfWidth + col0*mPatchWidth, patchBoundsY[patchID].x, mHalfDepth - (row0+1)*mPatchDepth);
+		node.BoxMax = XMFLOAT3(-mHalfWidth + (col0+1)*mPatchWidth, patchBoundsY[patchID].y, mHalfDepth - row0*mPatchDepth);
+
+		mLeafPatch.push_back(patchID);
+	}
+	else
+	{
+		// Split each side in half; a side one patch long is not split, so a node has
+		// two or four children.
+		UINT rowCount[2] = { (numRows+1)/2, numRows/2 };
+		UINT colCount[2] = { (numCols+1)/2, numCols/2 };
+
+		XMVECTOR vMin = XMVectorReplicate(+MathHelper::Infinity);
+		XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+		for(UINT r = 0; r < 2; ++r)
+		{
+			for(UINT c = 0; c < 2; ++c)
+			{
+				if( rowCount[r] == 0 || colCount[c] == 0 )
+					continue;
+
+				UINT child = BuildNode(patchBoundsY, row0 + r*rowCount[0], col0 + c*colCount[0],
+					rowCount[r], colCount[c]);
+				node.Children[node.NumChildren++] = child;
+
+				vMin = XMVectorMin(vMin, XMLoadFloat3(&mNodes[child].BoxMin));
+				vMax = XMVectorMax(vMax, XMLoadFloat3(&mNodes[child].BoxMax));
+			}
+		}
+
+		XMStoreFloat3(&node.BoxMin, vMin);
+		XMStoreFloat3(&node.BoxMax, vMax);
+	}
+
+	node.NumLeaves = (UINT)mLeafPatch.size() - node.FirstLeaf;
+	mNodes[index] = node;
+
+	return index;
+}
+
+void TerrainQuadtree::CullNode(UINT nodeIndex, UINT planeMask, CullContext& ctx)const
+{
+	const Node& node = mNodes[nodeIndex];
+	++ctx.NumNodesTested;
+
+	XMVECTOR vMin = XMLoadFloat3(&node.BoxMin);
+	XMVECTOR vMax = XMLoadFloat3(&node.BoxMax);
+	XMVECTOR center  = 0.5f*(vMin + vMax);
+	XMVECTOR extents = 0.5f*(vMax - vMin);
+
+	for(UINT i = 0; i < 6; ++i)
+	{
+		UINT bit = 1u << i;
+		if( (planeMask & bit) == 0 )
+			continue;
+
+		XMVECTOR plane = XMLoadFloat4(&ctx.Planes[i]);
+
+		// Projected box radius and signed distance of the center, as in the hull shader.
+		float r = XMVectorGetX(XMVector3Dot(extents, XMVectorAbs(plane)));
+		float s = XMVectorGetX(XMPlaneDotCoord(plane, center));
+
+		// Completely behind the plane: nothing below this node is visible.
+		if( s + r < 0.0f )
+			return;
+
+		// Completely in front of the plane: the children need not test it again.
+		if( s - r >= 0.0f )
+			planeMask &= ~bit;
+	}
+
+	// Inside the whole frustum, or a leaf that intersects it.
+	if( planeMask == 0 || node.NumChildren == 0 )
+	{
+		AddLeaves(node.FirstLeaf, node.NumLeaves, ctx);
+		return;
+	}
+
+	for(UINT i = 0; i < node.NumChildren; ++i)
+		CullNode(node.Children[i], planeMask, ctx);
+}
+
+void TerrainQuadtree::AddLeaves(UINT firstLeaf, UINT numLeaves, CullContext& ctx)const
+{
+	ctx.NumVisible += numLeaves;
+
+	// Leaves are visited in order, so a run can only continue the last one.
+	std::vector<LeafRange>& ranges = *ctx.Ranges;
+	if( !ranges.empty() && ranges.back().FirstLeaf + ranges.back().NumLeaves == firstLeaf )
+	{
+		ranges.back().NumLeaves += numLeaves;
+	}
+	else
+	{
+		LeafRange range;
+		range.FirstLeaf = firstLeaf;
+		range.NumLeaves = numLeaves;
+		ranges.push_back(range);
+	}
+}
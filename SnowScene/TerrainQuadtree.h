@@ -0,0 +1,106 @@
+//***************************************************************************************
+// TerrainQuadtree.h
+//
+// Min/max quadtree over the terrain patch grid.  Culls patches against the camera
+// frustum on the CPU, using the same box test as the terrain hull shader.  Nothing
+// here touches Direct3D; the Camera overload of Cull lives in TerrainQuadtreeCamera.cpp
+// so the rest can be built and tested without the app code.
+//
+// Patches are stored in leaf order, so every node covers a contiguous run of leaves.
+// Building the patch index buffer in that order lets the visible set be drawn as a
+// few index ranges instead of the whole grid.
+//***************************************************************************************
+
+#ifndef TERRAIN_QUADTREE_H
+#define TERRAIN_QUADTREE_H
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <vector>
+
+class Camera;
+
+class TerrainQuadtree
+{
+public:
+	// Run of consecutive leaves.
+	struct LeafRange
+	{
+		UINT FirstLeaf;
+		UINT NumLeaves;
+	};
+
+	struct CullStats
+	{
+		UINT NumPatches;
+		UINT NumVisible;
+		UINT NumNodesTested;
+		UINT NumRanges;
+		float CullTimeMs;
+	};
+
+public:
+	TerrainQuadtree();
+	~TerrainQuadtree();
+
+	// patchBoundsY holds numPatchRows*numPatchCols (minY, maxY) pairs in row-major
+	// order.  The grid is centered at the origin and spans width x depth in xz, with
+	// patch row 0 at +z, as in Terrain's patch vertex buffer.
+	void Build(const DirectX::XMFLOAT2* patchBoundsY, UINT numPatchRows, UINT numPatchCols,
+		float width, float depth);
+
+	UINT GetNumPatches()const;
+	UINT GetNumNodes()const;
+
+	// Patch stored in the given leaf slot; its ID is i*numPatchCols + j.
+	UINT GetLeafPatch(UINT leaf)const;
+
+	// ranges receives the leaves whose boxes intersect the frustum, merged into runs in
+	// leaf order.  Plane normals point into the frustum.  The Camera overload takes the
+	// planes from the camera's view-projection matrix, so patches are tested in the
+	// space the camera lives in.
+	void Cull(const Camera& cam, std::vector<LeafRange>& ranges, CullStats* stats = 0)const;
+	void Cull(const DirectX::XMFLOAT4 frustumPlanes[6], std::vector<LeafRange>& ranges,
+		CullStats* stats = 0)const;
+
+private:
+	struct Node
+	{
+		DirectX::XMFLOAT3 BoxMin;
+		DirectX::XMFLOAT3 BoxMax;
+		UINT FirstLeaf;
+		UINT NumLeaves;
+		UINT Children[4];
+		UINT NumChildren;
+	};
+
+	struct CullContext
+	{
+		const DirectX::XMFLOAT4* Planes;
+		std::vector<LeafRange>* Ranges;
+		UINT NumVisible;
+		UINT NumNodesTested;
+	};
+
+	UINT BuildNode(const DirectX::XMFLOAT2* patchBoundsY, UINT row0, UINT col0, UINT numRows, UINT numCols);
+	void CullNode(UINT nodeIndex, UINT planeMask, CullContext& ctx)const;
+	void AddLeaves(UINT firstLeaf, UINT numLeaves, CullContext& ctx)const;
+
+	TerrainQuadtree(const TerrainQuadtree& rhs);
+	TerrainQuadtree& operator=(const TerrainQuadtree& rhs);
+
+private:
+	UINT mNumPatchRows;
+	UINT mNumPatchCols;
+	float mPatchWidth;
+	float mPatchDepth;
+	float mHalfWidth;
+	float mHalfDepth;
+
+	std::vector<Node> mNodes;
+
+	// Patch ID of each leaf, in leaf order.
+	std::vector<UINT> mLeafPatch;
+};
+
+#endif // TERRAIN_QUADTREE_H
@@ -0,0 +1,17 @@
+//***************************************************************************************
+// TerrainQuadtreeCamera.cpp
+//
+// The Camera overload of TerrainQuadtree::Cull.  Kept apart from TerrainQuadtree.cpp
+// because Camera and the plane extraction come with d3dUtil.
+//***************************************************************************************
+
+#include "TerrainQuadtree.h"
+#include "Camera.h"
+
+void TerrainQuadtree::Cull(const Camera& cam, std::vector<LeafRange>& ranges, CullStats* stats)const
+{
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(planes, cam.ViewProj());
+
+	Cull(planes, ranges, stats);
+}
@@ -0,0 +1,537 @@
+//***************************************************************************************
+// TerrainTileStore.cpp
+//***************************************************************************************
+
+#include "TerrainTileStore.h"
+#include "MathHelper.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+using namespace DirectX;
+
+TerrainTileStore::TerrainTileStore()
+: mNumTilesX(0), mNumTilesZ(0), mResidentBytes(0),
+  mLastEyeCell(0.0f, 0.0f), mHasLastEye(false), mUpdateStamp(0), mQuit(false)
+{
+	ZeroMemory(&mInfo, sizeof(mInfo));
+	ZeroMemory(&mStats, sizeof(mStats));
+}
+
+TerrainTileStore::~TerrainTileStore()
+{
+	Shutdown();
+}
+
+bool TerrainTileStore::Init(const InitInfo& info, const TileLoader& loader)
+{
+	// In case Init() called again.
+	Shutdown();
+
+	if( info.HeightmapWidth < 2 || info.HeightmapHeight < 2 ||
+		info.PatchCells == 0 || info.TileCells == 0 || info.TileCells % info.PatchCells != 0 )
+	{
+		return false;
+	}
+
+	mInfo   = info;
+	mLoader = loader;
+
+	mNumTilesX = (mInfo.HeightmapWidth-1  + mInfo.TileCells-1) / mInfo.TileCells;
+	mNumTilesZ = (mInfo.HeightmapHeight-1 + mInfo.TileCells-1) / mInfo.TileCells;
+
+	Tile empty;
+	empty.State     = TileState_Unloaded;
+	empty.Width     = 0;
+	empty.Height    = 0;
+	empty.PatchCols = 0;
+	mTiles.assign(mNumTilesX*mNumTilesZ, empty);
+	mWantedStamp.assign(mTiles.size(), 0);
+
+	mResidentBytes = 0;
+	mUpdateStamp   = 0;
+	mHasLastEye    = false;
+	ZeroMemory(&mStats, sizeof(mStats));
+
+	mQuit = false;
+	mIoThread = std::thread(&TerrainTileStore::IoThreadMain, this);
+
+	return true;
+}
+
+bool TerrainTileStore::InitFromFile(const InitInfo& info, const std::wstring& filename,
+	HeightmapSource::Format format, float heightScale)
+{
+	std::shared_ptr<std::ifstream> file = std::make_shared<std::ifstream>();
+#if defined(_WIN32)
+	file->open(filename.c_str(), std::ios_base::binary);
+#else
+	// Paths are passed through as the locale's multibyte encoding.
+	std::vector<char> path(filename.size()*4 + 1);
+	if( wcstombs(&path[0], filename.c_str(), path.size()) == (size_t)-1 )
+		return false;
+	file->open(&path[0], std::ios_base::binary);
+#endif
+	if( !*file )
+		return false;
+
+	UINT texelSize = HeightmapSource::BytesPerTexel(format);
+	UINT64 needed = (UINT64)info.HeightmapWidth*info.HeightmapHeight*texelSize;
+
+	file->seekg(0, std::ios_base::end);
+	if( !*file || (UINT64)file->tellg() < needed )
+		return false;
+
+	// Read tiles a row at a time with plain file reads rather than mapping the file,
+	// so maps larger than the address space still work in 32-bit builds.
+	UINT width = info.HeightmapWidth;
+	TileLoader loader = [file, format, heightScale, texelSize, width](
+		UINT x0, UINT y0, UINT w, UINT h, float* dest, UINT destPitch)
+	{
+		std::vector<BYTE> row(w*texelSize);
+		for(UINT y = 0; y < h; ++y)
+		{
+			file->clear();
+			file->seekg((std::streamoff)(((UINT64)(y0 + y)*width + x0)*texelSize));
+			if( !file->read((char*)&row[0], row.size()) )
+				return false;
+
+			HeightmapSource::ConvertTexels(format, &row[0], w, heightScale, dest + (size_t)y*destPitch);
+		}
+
+		return true;
+	};
+
+	return Init(info, loader);
+}
+
+void TerrainTileStore::Shutdown()
+{
+	if( mIoThread.joinable() )
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mIoCV.notify_all();
+		mIoThread.join();
+	}
+
+	mTiles.clear();
+	mWantedStamp.clear();
+	mLru.clear();
+	mQueue.clear();
+	mResidentBytes = 0;
+	mNumTilesX = 0;
+	mNumTilesZ = 0;
+	mLoader = TileLoader();
+}
+
+float TerrainTileStore::GetWidth()const
+{
+	// Total terrain width.
+	return (mInfo.HeightmapWidth-1)*mInfo.CellSpacing;
+}
+
+float TerrainTileStore::GetDepth()const
+{
+	// Total terrain depth.
+	return (mInfo.HeightmapHeight-1)*mInfo.CellSpacing;
+}
+
+UINT TerrainTileStore::GetNumPatchRows()const
+{
+	return (mInfo.HeightmapHeight-1 + mInfo.PatchCells-1) / mInfo.PatchCells;
+}
+
+UINT TerrainTileStore::GetNumPatchCols()const
+{
+	return (mInfo.HeightmapWidth-1 + mInfo.PatchCells-1) / mInfo.PatchCells;
+}
+
+void TerrainTileStore::Update(const XMFLOAT3& eyePos)
+{
+	if( mTiles.empty() )
+		return;
+
+	// Eye position in cell space.
+	float c = (eyePos.x + 0.5f*GetWidth()) /  mInfo.CellSpacing;
+	float d = (eyePos.z - 0.5f*GetDepth()) / -mInfo.CellSpacing;
+
+	// Direction of movement since the last call; zero when standing still.
+	XMVECTOR eye = XMVectorSet(c, d, 0.0f, 0.0f);
+	XMVECTOR dir = XMVectorZero();
+	if( mHasLastEye )
+	{
+		XMVECTOR move = XMVectorSubtract(eye, XMLoadFloat2(&mLastEyeCell));
+		if( XMVectorGetX(XMVector2LengthSq(move)) > 0.0f )
+			dir = XMVector2Normalize(move);
+	}
+	XMStoreFloat2(&mLastEyeCell, eye);
+	mHasLastEye = true;
+
+	// Gather the tiles within PrefetchRadius of the camera tile and of each tile step
+	// ahead of it.
+	float tileSize = (float)mInfo.TileCells;
+	int radius = (int)mInfo.PrefetchRadius;
+
+	std::vector<std::pair<float, UINT> > wanted;
+	++mUpdateStamp;
+	for(UINT step = 0; step <= mInfo.PrefetchAhead; ++step)
+	{
+		XMFLOAT2 p;
+		XMStoreFloat2(&p, XMVectorAdd(eye, XMVectorScale(dir, step*tileSize)));
+
+		int tx = (int)floorf(p.x / tileSize);
+		int tz = (int)floorf(p.y / tileSize);
+		for(int z = tz - radius; z <= tz + radius; ++z)
+		{
+			for(int x = tx - radius; x <= tx + radius; ++x)
+			{
+				if( x < 0 || z < 0 || x >= (int)mNumTilesX || z >= (int)mNumTilesZ )
+					continue;
+
+				UINT tileIndex = z*mNumTilesX + x;
+				if( mWantedStamp[tileIndex] == mUpdateStamp )
+					continue;
+				mWantedStamp[tileIndex] = mUpdateStamp;
+
+				// Nearest first, with tiles in front of the camera ahead of those
+				// behind it at the same distance.
+				XMVECTOR center = XMVectorSet((x + 0.5f)*tileSize, (z + 0.5f)*tileSize, 0.0f, 0.0f);
+				XMVECTOR toTile = XMVectorSubtract(center, eye);
+				float dist  = XMVectorGetX(XMVector2Length(toTile));
+				float ahead = XMVectorGetX(XMVector2Dot(toTile, dir));
+				wanted.push_back(std::make_pair(dist - 0.5f*ahead, tileIndex));
+			}
+		}
+	}
+
+	std::sort(wanted.begin(), wanted.end());
+
+	// Never ask for more than the budget holds, or the nearest tiles would be evicted
+	// by farther ones.
+	UINT64 tileBytes = (UINT64)(mInfo.TileCells+1)*(mInfo.TileCells+1)*sizeof(float) +
+		(UINT64)(mInfo.TileCells/mInfo.PatchCells)*(mInfo.TileCells/mInfo.PatchCells)*sizeof(XMFLOAT2);
+	size_t maxTiles = (size_t)MathHelper::Max<UINT64>(mInfo.MemoryBudget / tileBytes, 1);
+	if( wanted.size() > maxTiles )
+		wanted.resize(maxTiles);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// Requests from the previous call that are still waiting are dropped; the ones
+		// still wanted are queued again below in the new order.
+		for(size_t i = 0; i < mQueue.size(); ++i)
+		{
+			if( mTiles[mQueue[i]].State == TileState_Queued )
+				mTiles[mQueue[i]].State = TileState_Unloaded;
+		}
+		mQueue.clear();
+
+		// Walk back to front so the nearest resident tile ends up most recently used.
+		for(size_t i = wanted.size(); i-- > 0; )
+		{
+			UINT tileIndex = wanted[i].second;
+			if( mTiles[tileIndex].State == TileState_Resident )
+				TouchTile(tileIndex);
+		}
+
+		for(size_t i = 0; i < wanted.size(); ++i)
+		{
+			UINT tileIndex = wanted[i].second;
+			if( mTiles[tileIndex].State == TileState_Unloaded )
+			{
+				mTiles[tileIndex].State = TileState_Queued;
+				mQueue.push_back(tileIndex);
+			}
+		}
+	}
+
+	mIoCV.notify_one();
+}
+
+float TerrainTileStore::GetHeight(float x, float z)
+{
+	UINT tileIndex;
+	int row, col;
+	float c, d;
+	if( !CellToTile(x, z, tileIndex, row, col, c, d) )
+		return 0.0f;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	const Tile& tile = AcquireTile(tileIndex, lock);
+
+	return SampleHeight(tile, tileIndex, row, col, c, d);
+}
+
+XMFLOAT2 TerrainTileStore::GetPatchBoundsY(UINT row, UINT col)
+{
+	assert(row < GetNumPatchRows() && col < GetNumPatchCols());
+	UINT tileIndex = PatchToTile(row, col);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	const Tile& tile = AcquireTile(tileIndex, lock);
+
+	return SamplePatchBoundsY(tile, tileIndex, row, col);
+}
+
+bool TerrainTileStore::TryGetHeight(float x, float z, float& height)
+{
+	UINT tileIndex;
+	int row, col;
+	float c, d;
+	if( !CellToTile(x, z, tileIndex, row, col, c, d) )
+		return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if( mTiles[tileIndex].State != TileState_Resident )
+		return false;
+
+	TouchTile(tileIndex);
+	height = SampleHeight(mTiles[tileIndex], tileIndex, row, col, c, d);
+	return true;
+}
+
+bool TerrainTileStore::TryGetPatchBoundsY(UINT row, UINT col, XMFLOAT2& bounds)
+{
+	assert(row < GetNumPatchRows() && col < GetNumPatchCols());
+	UINT tileIndex = PatchToTile(row, col);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if( mTiles[tileIndex].State != TileState_Resident )
+		return false;
+
+	TouchTile(tileIndex);
+	bounds = SamplePatchBoundsY(mTiles[tileIndex], tileIndex, row, col);
+	return true;
+}
+
+TerrainTileStore::Stats TerrainTileStore::GetStats()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	Stats stats = mStats;
+	stats.ResidentTiles = (UINT)mLru.size();
+	stats.QueuedTiles   = (UINT)mQueue.size();
+	stats.ResidentBytes = mResidentBytes;
+	return stats;
+}
+
+void TerrainTileStore::IoThreadMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		mIoCV.wait(lock, [this]{ return mQuit || !mQueue.empty(); });
+		if( mQuit )
+			break;
+
+		UINT tileIndex = mQueue.front();
+		mQueue.pop_front();
+
+		// Skip requests that were dropped or loaded on demand meanwhile.
+		if( mTiles[tileIndex].State != TileState_Queued )
+			continue;
+
+		mTiles[tileIndex].State = TileState_Loading;
+		lock.unlock();
+
+		Tile loaded;
+		LoadTile(tileIndex, loaded);
+
+		lock.lock();
+		InsertTile(tileIndex, loaded);
+		++mStats.TilesPrefetched;
+		mLoadedCV.notify_all();
+	}
+}
+
+bool TerrainTileStore::CellToTile(float x, float z, UINT& tileIndex, int& row, int& col, float& c, float& d)const
+{
+	if( mTiles.empty() )
+		return false;
+
+	// Transform from terrain local space to "cell" space.
+	c = (x + 0.5f*GetWidth()) /  mInfo.CellSpacing;
+	d = (z - 0.5f*GetDepth()) / -mInfo.CellSpacing;
+
+	// Clamp to the map, and get the row and column we are in.  The last row and
+	// column of texels belong to the cells before them.
+	c = MathHelper::Clamp(c, 0.0f, (float)(mInfo.HeightmapWidth-1));
+	d = MathHelper::Clamp(d, 0.0f, (float)(mInfo.HeightmapHeight-1));
+	row = MathHelper::Min((int)floorf(d), (int)mInfo.HeightmapHeight-2);
+	col = MathHelper::Min((int)floorf(c), (int)mInfo.HeightmapWidth-2);
+
+	tileIndex = (row / mInfo.TileCells)*mNumTilesX + col / mInfo.TileCells;
+	return true;
+}
+
+UINT TerrainTileStore::PatchToTile(UINT row, UINT col)const
+{
+	return (row*mInfo.PatchCells / mInfo.TileCells)*mNumTilesX + col*mInfo.PatchCells / mInfo.TileCells;
+}
+
+TerrainTileStore::Tile& TerrainTileStore::AcquireTile(UINT tileIndex, std::unique_lock<std::mutex>& lock)
+{
+	for(;;)
+	{
+		Tile& tile = mTiles[tileIndex];
+		if( tile.State == TileState_Resident )
+		{
+			TouchTile(tileIndex);
+			return tile;
+		}
+
+		if( tile.State == TileState_Loading )
+		{
+			mLoadedCV.wait(lock);
+			continue;
+		}
+
+		// Not resident and not in flight: load it here instead of waiting for the
+		// I/O thread to get to it.  A queued request for it is skipped later.
+		tile.State = TileState_Loading;
+		lock.unlock();
+
+		Tile loaded;
+		LoadTile(tileIndex, loaded);
+
+		lock.lock();
+		InsertTile(tileIndex, loaded);
+		++mStats.TilesLoadedOnDemand;
+		mLoadedCV.notify_all();
+	}
+}
+
+void TerrainTileStore::LoadTile(UINT tileIndex, Tile& tile)
+{
+	UINT tx = tileIndex % mNumTilesX;
+	UINT tz = tileIndex / mNumTilesX;
+
+	// Tiles share their border texels with their neighbors, so every cell can be
+	// sampled from a single tile.
+	UINT x0 = tx*mInfo.TileCells;
+	UINT y0 = tz*mInfo.TileCells;
+	tile.Width  = MathHelper::Min(mInfo.TileCells, mInfo.HeightmapWidth-1  - x0) + 1;
+	tile.Height = MathHelper::Min(mInfo.TileCells, mInfo.HeightmapHeight-1 - y0) + 1;
+	tile.Heights.resize(tile.Width*tile.Height);
+
+	bool loaded;
+	{
+		std::lock_guard<std::mutex> loadLock(mLoadMutex);
+		loaded = mLoader && mLoader(x0, y0, tile.Width, tile.Height, &tile.Heights[0], tile.Width);
+	}
+
+	// A tile that failed to load reads as flat ground rather than garbage.
+	if( !loaded )
+		std::fill(tile.Heights.begin(), tile.Heights.end(), 0.0f);
+
+	// Patch bounds, as in Terrain::CalcPatchBoundsY.
+	UINT patchCells = mInfo.PatchCells;
+	UINT patchRows = (tile.Height-1 + patchCells-1) / patchCells;
+	tile.PatchCols = (tile.Width-1 + patchCells-1) / patchCells;
+	tile.PatchBoundsY.resize(patchRows*tile.PatchCols);
+
+	for(UINT i = 0; i < patchRows; ++i)
+	{
+		for(UINT j = 0; j < tile.PatchCols; ++j)
+		{
+			UINT px1 = MathHelper::Min((j+1)*patchCells, tile.Width-1);
+			UINT py1 = MathHelper::Min((i+1)*patchCells, tile.Height-1);
+
+			float minY = +MathHelper::Infinity;
+			float maxY = -MathHelper::Infinity;
+			for(UINT y = i*patchCells; y <= py1; ++y)
+			{
+				const float* row = &tile.Heights[y*tile.Width];
+				for(UINT x = j*patchCells; x <= px1; ++x)
+				{
+					minY = MathHelper::Min(minY, row[x]);
+					maxY = MathHelper::Max(maxY, row[x]);
+				}
+			}
+
+			tile.PatchBoundsY[i*tile.PatchCols+j] = XMFLOAT2(minY, maxY);
+		}
+	}
+}
+
+void TerrainTileStore::InsertTile(UINT tileIndex, Tile& loaded)
+{
+	Tile& tile = mTiles[tileIndex];
+	tile.Width     = loaded.Width;
+	tile.Height    = loaded.Height;
+	tile.PatchCols = loaded.PatchCols;
+	tile.Heights.swap(loaded.Heights);
+	tile.PatchBoundsY.swap(loaded.PatchBoundsY);
+	tile.State = TileState_Resident;
+
+	mLru.push_front(tileIndex);
+	tile.LruPos = mLru.begin();
+	mResidentBytes += tile.Heights.size()*sizeof(float) + tile.PatchBoundsY.size()*sizeof(XMFLOAT2);
+
+	// Evict least recently used tiles until within budget, but never the tile just
+	// loaded.
+	while( mResidentBytes > mInfo.MemoryBudget && mLru.size() > 1 )
+	{
+		Tile& victim = mTiles[mLru.back()];
+		mLru.pop_back();
+
+		mResidentBytes -= victim.Heights.size()*sizeof(float) + victim.PatchBoundsY.size()*sizeof(XMFLOAT2);
+		std::vector<float>().swap(victim.Heights);
+		std::vector<XMFLOAT2>().swap(victim.PatchBoundsY);
+		victim.State = TileState_Unloaded;
+		++mStats.TilesEvicted;
+	}
+}
+
+void TerrainTileStore::TouchTile(UINT tileIndex)
+{
+	mLru.splice(mLru.begin(), mLru, mTiles[tileIndex].LruPos);
+}
+
+float TerrainTileStore::SampleHeight(const Tile& tile, UINT tileIndex, int row, int col, float c, float d)const
+{
+	// Cell relative to the tile.
+	UINT i = row - (tileIndex / mNumTilesX)*mInfo.TileCells;
+	UINT j = col - (tileIndex % mNumTilesX)*mInfo.TileCells;
+
+	// Grab the heights of the cell we are in.
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	float A = tile.Heights[i*tile.Width + j];
+	float B = tile.Heights[i*tile.Width + j + 1];
+	float C = tile.Heights[(i+1)*tile.Width + j];
+	float D = tile.Heights[(i+1)*tile.Width + j + 1];
+
+	// Where we are relative to the cell.
+	float s = c - (float)col;
+	float t = d - (float)row;
+
+	// If upper triangle ABC.
+	if( s + t <= 1.0f)
+	{
+		float uy = B - A;
+		float vy = C - A;
+		return A + s*uy + t*vy;
+	}
+	else // lower triangle DCB.
+	{
+		float uy = C - D;
+		float vy = B - D;
+		return D + (1.0f-s)*uy + (1.0f-t)*vy;
+	}
+}
+
+XMFLOAT2 TerrainTileStore::SamplePatchBoundsY(const Tile& tile, UINT tileIndex, UINT row, UINT col)const
+{
+	UINT patchesPerTile = mInfo.TileCells / mInfo.PatchCells;
+	UINT i = row - (tileIndex / mNumTilesX)*patchesPerTile;
+	UINT j = col - (tileIndex % mNumTilesX)*patchesPerTile;
+
+	return tile.PatchBoundsY[i*tile.PatchCols + j];
+}
@@ -0,0 +1,171 @@
+//***************************************************************************************
+// TerrainTileStore.h
+//
+// Paged height store for heightmaps too large to keep resident.  The map is split into
+// square tiles of TileCells cells that are loaded on demand and kept in an LRU cache
+// bounded by a memory budget.  Update() queues the tiles around the camera, nearest and
+// in the direction of movement first, for a background I/O thread to load.
+//
+// Height and patch bounds queries use the same cell layout as Terrain: the map is
+// centered at the origin, texel row 0 is at +z, and patch (i, j) covers cells
+// [i*PatchCells, (i+1)*PatchCells] x [j*PatchCells, (j+1)*PatchCells].
+//
+// The store only serves CPU queries.  Terrain still renders from a heightmap texture
+// that holds the whole map, so it keeps TerrainHeightfield resident and does not use
+// this class; streaming the texture as well is a separate piece of work.  Tools and
+// gameplay code that need heights on maps too large to load can use it directly.
+//***************************************************************************************
+
+#ifndef TERRAIN_TILE_STORE_H
+#define TERRAIN_TILE_STORE_H
+
+#include <Windows.h>
+#include <DirectXMath.h>
+#include "HeightmapSource.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TerrainTileStore
+{
+public:
+	// Writes the w x h block of heights whose upper-left texel is (x0, y0) to dest,
+	// whose rows are destPitch floats apart.  Calls are serialized, but may come from
+	// the I/O thread or from a thread that queried a tile that was not resident.
+	typedef std::function<bool(UINT x0, UINT y0, UINT w, UINT h, float* dest, UINT destPitch)> TileLoader;
+
+	struct InitInfo
+	{
+		UINT HeightmapWidth;
+		UINT HeightmapHeight;
+		float CellSpacing;
+
+		// Cells per tile side; must be a multiple of PatchCells.
+		UINT TileCells;
+		UINT PatchCells;
+
+		// Bytes of tile data kept resident.  At least one tile is always kept.
+		UINT64 MemoryBudget;
+
+		// Tiles kept loaded on each side of the camera tile, and how many tile steps
+		// ahead of the camera are prefetched while it moves.
+		UINT PrefetchRadius;
+		UINT PrefetchAhead;
+	};
+
+	struct Stats
+	{
+		UINT ResidentTiles;
+		UINT QueuedTiles;
+		UINT64 ResidentBytes;
+		UINT64 TilesPrefetched;
+		UINT64 TilesLoadedOnDemand;
+		UINT64 TilesEvicted;
+	};
+
+public:
+	TerrainTileStore();
+	~TerrainTileStore();
+
+	bool Init(const InitInfo& info, const TileLoader& loader);
+
+	// Reads tiles from a RAW heightmap file.  Returns false if the file is missing or
+	// smaller than the map.
+	bool InitFromFile(const InitInfo& info, const std::wstring& filename,
+		HeightmapSource::Format format, float heightScale);
+
+	void Shutdown();
+
+	float GetWidth()const;
+	float GetDepth()const;
+	UINT GetNumPatchRows()const;
+	UINT GetNumPatchCols()const;
+
+	// Queues the tiles around eyePos for loading and marks them recently used.  The
+	// movement direction is taken from the eye position of the previous call.
+	void Update(const DirectX::XMFLOAT3& eyePos);
+
+	// Same result as TerrainHeightfield::GetHeight on the unsmoothed map; points off
+	// the map take the height of the nearest border point.  Loads the tile on the
+	// calling thread if it is not resident.
+	float GetHeight(float x, float z);
+
+	// (minY, maxY) of the given patch, loading its tile if needed.
+	DirectX::XMFLOAT2 GetPatchBoundsY(UINT row, UINT col);
+
+	// Non-blocking versions; return false if the tile is not resident.
+	bool TryGetHeight(float x, float z, float& height);
+	bool TryGetPatchBoundsY(UINT row, UINT col, DirectX::XMFLOAT2& bounds);
+
+	Stats GetStats()const;
+
+private:
+	enum TileState
+	{
+		TileState_Unloaded,
+		TileState_Queued,
+		TileState_Loading,
+		TileState_Resident
+	};
+
+	struct Tile
+	{
+		TileState State;
+		UINT Width;
+		UINT Height;
+		UINT PatchCols;
+		std::vector<float> Heights;
+		std::vector<DirectX::XMFLOAT2> PatchBoundsY;
+		std::list<UINT>::iterator LruPos;
+	};
+
+	void IoThreadMain();
+	bool CellToTile(float x, float z, UINT& tileIndex, int& row, int& col, float& c, float& d)const;
+	UINT PatchToTile(UINT row, UINT col)const;
+	Tile& AcquireTile(UINT tileIndex, std::unique_lock<std::mutex>& lock);
+	void LoadTile(UINT tileIndex, Tile& tile);
+	void InsertTile(UINT tileIndex, Tile& loaded);
+	void TouchTile(UINT tileIndex);
+	float SampleHeight(const Tile& tile, UINT tileIndex, int row, int col, float c, float d)const;
+	DirectX::XMFLOAT2 SamplePatchBoundsY(const Tile& tile, UINT tileIndex, UINT row, UINT col)const;
+
+	TerrainTileStore(const TerrainTileStore& rhs);
+	TerrainTileStore& operator=(const TerrainTileStore& rhs);
+
+private:
+	InitInfo mInfo;
+	TileLoader mLoader;
+
+	UINT mNumTilesX;
+	UINT mNumTilesZ;
+	std::vector<Tile> mTiles;
+
+	// Most recently used tile first.
+	std::list<UINT> mLru;
+	std::deque<UINT> mQueue;
+	UINT64 mResidentBytes;
+	Stats mStats;
+
+	DirectX::XMFLOAT2 mLastEyeCell;
+	bool mHasLastEye;
+	std::vector<UINT> mWantedStamp;
+	UINT mUpdateStamp;
+
+	// Guards everything above except mInfo, mLoader and the tile counts.
+	mutable std::mutex mMutex;
+	std::condition_variable mIoCV;
+	std::condition_variable mLoadedCV;
+
+	// Serializes loader calls.
+	std::mutex mLoadMutex;
+
+	std::thread mIoThread;
+	bool mQuit;
+};
+
+#endif // TERRAIN_TILE_STORE_H
@@ -0,0 +1,310 @@
+//***************************************************************************************
+// BinaryReaderTest.cpp
+//
+// BinaryReader must give back the same bytes whether it maps its file, streams it
+// through a buffer of any size, or reads a memory blob: a mix of single values and
+// arrays, some longer than the stream buffer, must match the file at every offset, and
+// values aligned in the file must come back aligned.  Reading exactly to the end must
+// succeed and one byte more must throw, an element count whose byte size overflows
+// must throw std::overflow_error, and empty, missing and non-ASCII file names must
+// behave the same in every mode.  MapEntireFile must map the same bytes.  Also prints
+// MB/s for reading a 64 MB file into the heap, as BinaryReader used to, against
+// mapping it and streaming it.
+//***************************************************************************************
+
+// BinaryReader.h expects what DirectXTK's pch.h includes first.
+#include <windows.h>
+#include <malloc.h>
+#include "BinaryReader.h"
+#include "TestUtil.h"
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	const char* const FileName = "BinaryReaderTest.bin";
+
+	std::wstring WriteFile(const char* name, const std::vector<uint8_t>& data)
+	{
+		FILE* file = fopen(name, "wb");
+		if( file )
+		{
+			if( !data.empty() )
+				fwrite(&data[0], 1, data.size(), file);
+			fclose(file);
+		}
+		return std::wstring(name, name + strlen(name));
+	}
+
+	std::vector<uint8_t> RandomBytes(size_t size, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::vector<uint8_t> data(size);
+		for(size_t i = 0; i < size; ++i)
+			data[i] = (uint8_t)rng();
+		return data;
+	}
+
+	// How a reader is made for one pass over the file.
+	struct ReaderMode
+	{
+		const char* Name;
+		size_t StreamBufferSize;	// 0 to map the file, SIZE_MAX to read the memory blob
+	};
+
+	std::unique_ptr<BinaryReader> MakeReader(const ReaderMode& mode, const std::wstring& fileName,
+		const std::vector<uint8_t>& data)
+	{
+		if( mode.StreamBufferSize == SIZE_MAX )
+			return std::unique_ptr<BinaryReader>(new BinaryReader(data.empty() ? nullptr : &data[0], data.size()));
+		if( mode.StreamBufferSize == 0 )
+			return std::unique_ptr<BinaryReader>(new BinaryReader(fileName.c_str()));
+		return std::unique_ptr<BinaryReader>(new BinaryReader(fileName.c_str(), mode.StreamBufferSize));
+	}
+
+	// True if reading count more bytes throws.
+	bool ReadThrows(BinaryReader& reader, size_t count)
+	{
+		try
+		{
+			reader.ReadArray<uint8_t>(count);
+		}
+		catch( ... )
+		{
+			return true;
+		}
+		return false;
+	}
+
+	// Reads the whole file in a seeded mix of values and arrays, then one byte past the end.
+	void CheckReads(const ReaderMode& mode, const std::wstring& fileName, const std::vector<uint8_t>& data, unsigned seed)
+	{
+		std::unique_ptr<BinaryReader> reader = MakeReader(mode, fileName, data);
+		std::mt19937 rng(seed);
+
+		size_t offset = 0, mismatches = 0, misaligned = 0;
+		while( offset < data.size() )
+		{
+			size_t left = data.size() - offset;
+			switch( rng() % 5 )
+			{
+			case 0:
+				if( reader->Read<uint8_t>() != data[offset] )
+					++mismatches;
+				++offset;
+				break;
+			case 1:
+				if( left >= 4 && offset % 4 == 0 )
+				{
+					uint32_t expected;
+					memcpy(&expected, &data[offset], 4);
+					if( reader->Read<uint32_t>() != expected )
+						++mismatches;
+					offset += 4;
+				}
+				break;
+			case 2:
+				if( left >= 24 && offset % 8 == 0 )
+				{
+					const uint64_t* values = reader->ReadArray<uint64_t>(3);
+					if( (uintptr_t)values % 8 != 0 )
+						++misaligned;
+					if( memcmp(values, &data[offset], 24) != 0 )
+						++mismatches;
+					offset += 24;
+				}
+				break;
+			default:
+			{
+				// Up to 3x the largest stream buffer tried, and zero-length reads.
+				size_t count = std::min<size_t>(left, rng() % 4 == 0 ? rng() % 200000 : rng() % 100);
+				const uint8_t* bytes = reader->ReadArray<uint8_t>(count);
+				if( count && memcmp(bytes, &data[offset], count) != 0 )
+					++mismatches;
+				offset += count;
+				break;
+			}
+			}
+		}
+		if( mismatches )
+			printf("  %s, %zu bytes: %zu reads differ from the file\n", mode.Name, data.size(), mismatches);
+		CHECK(mismatches == 0);
+		if( misaligned )
+			printf("  %s, %zu bytes: %zu aligned reads returned misaligned values\n", mode.Name, data.size(), misaligned);
+		CHECK(misaligned == 0);
+
+		CHECK(!ReadThrows(*reader, 0));
+		CHECK(ReadThrows(*reader, 1));
+	}
+
+	// Reading one more element than the file holds throws, without reading any of it.
+	void CheckEnd(const ReaderMode& mode, const std::wstring& fileName, const std::vector<uint8_t>& data)
+	{
+		std::unique_ptr<BinaryReader> past = MakeReader(mode, fileName, data);
+		CHECK(ReadThrows(*past, data.size() + 1));
+
+		std::unique_ptr<BinaryReader> exact = MakeReader(mode, fileName, data);
+		if( data.empty() )
+			CHECK(!ReadThrows(*exact, 0));
+		else
+			CHECK(memcmp(exact->ReadArray<uint8_t>(data.size()), &data[0], data.size()) == 0);
+		CHECK(ReadThrows(*exact, 1));
+
+		// The byte size of this count does not fit in size_t.
+		std::unique_ptr<BinaryReader> overflow = MakeReader(mode, fileName, data);
+		bool overflowed = false;
+		try
+		{
+			overflow->ReadArray<uint32_t>(SIZE_MAX / 2);
+		}
+		catch( const std::overflow_error& )
+		{
+			overflowed = true;
+		}
+		catch( ... )
+		{
+		}
+		CHECK(overflowed);
+	}
+
+	bool OpenThrows(const ReaderMode& mode, const std::wstring& fileName)
+	{
+		try
+		{
+			std::vector<uint8_t> none;
+			MakeReader(mode, fileName, none);
+		}
+		catch( ... )
+		{
+			return true;
+		}
+		return false;
+	}
+
+	// Sums one byte in every 64 so every page of the data is touched.
+	uint64_t Touch(const uint8_t* bytes, size_t count)
+	{
+		uint64_t sum = 0;
+		for(size_t i = 0; i < count; i += 64)
+			sum += bytes[i];
+		return sum;
+	}
+
+	void Benchmark()
+	{
+		const size_t size = 64 << 20;
+		const size_t record = 4096;
+		const int runs = 5;
+		std::vector<uint8_t> data = RandomBytes(size, 5);
+		std::wstring fileName = WriteFile(FileName, data);
+		uint64_t expected = Touch(&data[0], size);
+		data = std::vector<uint8_t>();
+
+		// The file is read once first, so every run finds it in the file cache.
+		const char* names[] = { "heap copy", "mapped", "streamed 64 KB" };
+		for(int m = -1; m < 3; ++m)
+		{
+			double best = 1e30;
+			bool same = true;
+			for(int r = 0; r < runs; ++r)
+			{
+				double t0 = TestSeconds();
+				uint64_t sum = 0;
+				if( m <= 0 )
+				{
+					// What BinaryReader did before it mapped files: the whole file into a
+					// new heap buffer, then read from there.
+					std::unique_ptr<uint8_t[]> copy(new uint8_t[size]);
+					FILE* file = fopen(FileName, "rb");
+					size_t read = file ? fread(copy.get(), 1, size, file) : 0;
+					if( file )
+						fclose(file);
+					BinaryReader reader(copy.get(), read);
+					for(size_t offset = 0; offset + record <= read; offset += record)
+						sum += Touch(reader.ReadArray<uint8_t>(record), record);
+				}
+				else
+				{
+					ReaderMode mode = { names[m], m == 1 ? 0 : BinaryReader::DefaultStreamBufferSize };
+					std::unique_ptr<BinaryReader> reader = MakeReader(mode, fileName, data);
+					for(size_t offset = 0; offset + record <= size; offset += record)
+						sum += Touch(reader->ReadArray<uint8_t>(record), record);
+				}
+				best = std::min(best, TestSeconds() - t0);
+				same = same && sum == expected;
+			}
+			CHECK(same);
+			if( m >= 0 )
+			{
+				printf("%-15s %zu MB in %zu-byte records: %7.2f ms, %8.1f MB/s\n", names[m], size >> 20, record,
+					best*1000.0, (size >> 20) / best);
+			}
+		}
+		remove(FileName);
+	}
+}
+
+int main()
+{
+	const ReaderMode modes[] =
+	{
+		{ "mapped", 0 },
+		{ "streamed 1", 1 },
+		{ "streamed 7", 7 },
+		{ "streamed 4096", 4096 },
+		{ "streamed 64 KB", BinaryReader::DefaultStreamBufferSize },
+		{ "memory", SIZE_MAX },
+	};
+	const size_t numModes = sizeof(modes)/sizeof(modes[0]);
+
+	// Sizes either side of the buffer sizes, and a file several buffers long.
+	const size_t sizes[] = { 1, 6, 7, 8, 4095, 4096, 4097, 65536, 65537, 300000, 1 << 20 };
+	for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+	{
+		std::vector<uint8_t> data = RandomBytes(sizes[s], (unsigned)s);
+		std::wstring fileName = WriteFile(FileName, data);
+		for(size_t m = 0; m < numModes; ++m)
+		{
+			// Streaming one byte at a time is slow; a smaller file shows the same.
+			if( modes[m].StreamBufferSize == 1 && sizes[s] > 65537 )
+				continue;
+			CheckReads(modes[m], fileName, data, (unsigned)(s*numModes + m));
+			CheckEnd(modes[m], fileName, data);
+		}
+
+		MappedFile mapping;
+		CHECK(SUCCEEDED(BinaryReader::MapEntireFile(fileName.c_str(), mapping)));
+		CHECK(mapping.GetSize() == data.size() && memcmp(mapping.GetData(), &data[0], data.size()) == 0);
+	}
+
+	// An empty file: nothing to read, in any mode.
+	std::vector<uint8_t> empty;
+	std::wstring emptyName = WriteFile(FileName, empty);
+	for(size_t m = 0; m < numModes; ++m)
+		CheckEnd(modes[m], emptyName, empty);
+	remove(FileName);
+
+	// A missing file fails to open, mapped or streamed.
+	for(size_t m = 0; m + 1 < numModes; ++m)
+		CHECK(OpenThrows(modes[m], L"BinaryReaderTest.missing"));
+	MappedFile missing;
+	CHECK(FAILED(BinaryReader::MapEntireFile(L"BinaryReaderTest.missing", missing)));
+
+	// A name outside ASCII reaches the file system as the same file.
+	std::vector<uint8_t> data = RandomBytes(5000, 99);
+	const char* utf8Name = "BinaryReaderTest \xc3\xa9\xe2\x82\xac.bin";
+	WriteFile(utf8Name, data);
+	std::wstring wideName = L"BinaryReaderTest é€.bin";
+	for(size_t m = 0; m + 1 < numModes; ++m)
+		CheckReads(modes[m], wideName, data, (unsigned)m);
+	remove(utf8Name);
+
+	Benchmark();
+
+	return TestResult("BinaryReaderTest");
+}
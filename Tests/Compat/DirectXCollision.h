@@ -0,0 +1,118 @@
+//***************************************************************************************
+// DirectXCollision.h (test compat)
+//
+// The bounding volumes the model loaders fill in, for building the tests where the
+// Windows SDK is not available.  Only what the loaders call is here; the sphere
+// around a point set uses the same method as DirectXCollision (Ritter's: start from
+// the most distant pair of axis extremes, then grow to take in every point), so the
+// result is close to but not always bit-identical with a Windows build.  Never on the
+// include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_DIRECTXCOLLISION_H
+#define TESTS_COMPAT_DIRECTXCOLLISION_H
+
+#include "DirectXMath.h"
+
+namespace DirectX
+{
+    struct BoundingBox
+    {
+        XMFLOAT3 Center;
+        XMFLOAT3 Extents;
+
+        BoundingBox() : Center(0.0f, 0.0f, 0.0f), Extents(1.0f, 1.0f, 1.0f) {}
+
+        static void CreateFromPoints(BoundingBox& out, FXMVECTOR pt1, FXMVECTOR pt2)
+        {
+            XMVECTOR minv = XMVectorMin(pt1, pt2);
+            XMVECTOR maxv = XMVectorMax(pt1, pt2);
+            XMStoreFloat3(&out.Center, XMVectorScale(XMVectorAdd(minv, maxv), 0.5f));
+            XMStoreFloat3(&out.Extents, XMVectorScale(XMVectorSubtract(maxv, minv), 0.5f));
+        }
+
+        static void CreateFromPoints(BoundingBox& out, size_t count, const XMFLOAT3* points, size_t stride)
+        {
+            XMVECTOR minv = XMLoadFloat3(points);
+            XMVECTOR maxv = minv;
+            for(size_t i = 1; i < count; ++i)
+            {
+                XMVECTOR p = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(points) + i*stride));
+                minv = XMVectorMin(minv, p);
+                maxv = XMVectorMax(maxv, p);
+            }
+            CreateFromPoints(out, minv, maxv);
+        }
+    };
+
+    struct BoundingSphere
+    {
+        XMFLOAT3 Center;
+        float Radius;
+
+        BoundingSphere() : Center(0.0f, 0.0f, 0.0f), Radius(1.0f) {}
+
+        static void CreateFromBoundingBox(BoundingSphere& out, const BoundingBox& box)
+        {
+            out.Center = box.Center;
+            out.Radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+        }
+
+        static void CreateFromPoints(BoundingSphere& out, size_t count, const XMFLOAT3* points, size_t stride)
+        {
+            auto point = [&](size_t i)
+            {
+                return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(points) + i*stride));
+            };
+
+            // The lowest and highest point on each axis.
+            XMVECTOR minPt[3], maxPt[3];
+            minPt[0] = minPt[1] = minPt[2] = maxPt[0] = maxPt[1] = maxPt[2] = point(0);
+            for(size_t i = 1; i < count; ++i)
+            {
+                XMVECTOR p = point(i);
+                for(int a = 0; a < 3; ++a)
+                {
+                    float pa = XMVectorGetByIndex(p, a);
+                    if( pa < XMVectorGetByIndex(minPt[a], a) )
+                        minPt[a] = p;
+                    if( pa > XMVectorGetByIndex(maxPt[a], a) )
+                        maxPt[a] = p;
+                }
+            }
+
+            // The pair furthest apart gives the first sphere.
+            int axis = 0;
+            float best = -1.0f;
+            for(int a = 0; a < 3; ++a)
+            {
+                float d = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(maxPt[a], minPt[a])));
+                if( d > best )
+                {
+                    best = d;
+                    axis = a;
+                }
+            }
+            XMVECTOR center = XMVectorScale(XMVectorAdd(maxPt[axis], minPt[axis]), 0.5f);
+            float radius = sqrtf(best) * 0.5f;
+
+            // Grow it to take in each point outside it.
+            for(size_t i = 0; i < count; ++i)
+            {
+                XMVECTOR delta = XMVectorSubtract(point(i), center);
+                float dist = XMVectorGetX(XMVector3Length(delta));
+                if( dist > radius )
+                {
+                    float newRadius = (radius + dist) * 0.5f;
+                    center = XMVectorAdd(center, XMVectorScale(delta, (1.0f - radius / dist) * 0.5f));
+                    radius = newRadius;
+                }
+            }
+
+            XMStoreFloat3(&out.Center, center);
+            out.Radius = radius;
+        }
+    };
+}
+
+#endif // TESTS_COMPAT_DIRECTXCOLLISION_H
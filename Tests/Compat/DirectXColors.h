@@ -0,0 +1,22 @@
+//***************************************************************************************
+// DirectXColors.h (test compat)
+//
+// The colors DirectXTK's headers use as default arguments.  Never on the include path
+// of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_DIRECTXCOLORS_H
+#define TESTS_COMPAT_DIRECTXCOLORS_H
+
+#include "DirectXMath.h"
+
+namespace DirectX
+{
+namespace Colors
+{
+    XMGLOBALCONST XMVECTORF32 White = { { { 1.0f, 1.0f, 1.0f, 1.0f } } };
+    XMGLOBALCONST XMVECTORF32 Black = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+}
+
+#endif // TESTS_COMPAT_DIRECTXCOLORS_H
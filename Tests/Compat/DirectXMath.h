@@ -0,0 +1,859 @@
+//***************************************************************************************
+// DirectXMath.h (test compat)
+//
+// The subset of DirectXMath used by the device independent code under test, for
+// building the headless tests where the Windows SDK is not available.  Vector
+// operations follow the _XM_SSE_INTRINSICS_ implementations (SSE, no fused
+// multiply-add), so results match a Windows x86/x64 build bit for bit.  Never on the
+// include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_DIRECTXMATH_H
+#define TESTS_COMPAT_DIRECTXMATH_H
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <sal.h>
+
+#define _XM_SSE_INTRINSICS_
+#define XM_CALLCONV
+#define XM_ALIGNED_STRUCT(x) struct alignas(x)
+#define XMGLOBALCONST extern const __attribute__((weak))
+
+#ifndef __cdecl
+#define __cdecl
+#endif
+
+namespace DirectX
+{
+    const float XM_PI       = 3.141592654f;
+    const float XM_2PI      = 6.283185307f;
+    const float XM_1DIVPI   = 0.318309886f;
+    const float XM_1DIV2PI  = 0.159154943f;
+    const float XM_PIDIV2   = 1.570796327f;
+    const float XM_PIDIV4   = 0.785398163f;
+
+    const uint32_t XM_SELECT_0 = 0x00000000;
+    const uint32_t XM_SELECT_1 = 0xFFFFFFFF;
+
+    const uint32_t XM_PERMUTE_0X = 0;
+    const uint32_t XM_PERMUTE_0Y = 1;
+    const uint32_t XM_PERMUTE_0Z = 2;
+    const uint32_t XM_PERMUTE_0W = 3;
+    const uint32_t XM_PERMUTE_1X = 4;
+    const uint32_t XM_PERMUTE_1Y = 5;
+    const uint32_t XM_PERMUTE_1Z = 6;
+    const uint32_t XM_PERMUTE_1W = 7;
+
+    const uint32_t XM_SWIZZLE_X = 0;
+    const uint32_t XM_SWIZZLE_Y = 1;
+    const uint32_t XM_SWIZZLE_Z = 2;
+    const uint32_t XM_SWIZZLE_W = 3;
+
+    inline float XMConvertToRadians(float degrees) { return degrees * (XM_PI / 180.0f); }
+    inline float XMConvertToDegrees(float radians) { return radians * (180.0f / XM_PI); }
+
+    //-----------------------------------------------------------------------------------
+    // Types
+    //-----------------------------------------------------------------------------------
+
+    typedef __m128 XMVECTOR;
+    typedef const XMVECTOR FXMVECTOR;
+    typedef const XMVECTOR GXMVECTOR;
+    typedef const XMVECTOR& HXMVECTOR;
+    typedef const XMVECTOR& CXMVECTOR;
+
+    struct alignas(16) XMVECTORF32
+    {
+        union { float f[4]; XMVECTOR v; };
+        operator XMVECTOR() const { return v; }
+        operator const float*() const { return f; }
+    };
+
+    struct alignas(16) XMVECTORI32
+    {
+        union { int32_t i[4]; XMVECTOR v; };
+        operator XMVECTOR() const { return v; }
+    };
+
+    struct alignas(16) XMVECTORU32
+    {
+        union { uint32_t u[4]; XMVECTOR v; };
+        operator XMVECTOR() const { return v; }
+    };
+
+    struct alignas(16) XMVECTORU8
+    {
+        union { uint8_t u[16]; XMVECTOR v; };
+        operator XMVECTOR() const { return v; }
+    };
+
+    struct XMFLOAT2
+    {
+        float x, y;
+        XMFLOAT2() = default;
+        XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+        explicit XMFLOAT2(const float* p) : x(p[0]), y(p[1]) {}
+    };
+
+    struct alignas(16) XMFLOAT2A : public XMFLOAT2
+    {
+        XMFLOAT2A() = default;
+        XMFLOAT2A(float _x, float _y) : XMFLOAT2(_x, _y) {}
+    };
+
+    struct XMFLOAT3
+    {
+        float x, y, z;
+        XMFLOAT3() = default;
+        XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+        explicit XMFLOAT3(const float* p) : x(p[0]), y(p[1]), z(p[2]) {}
+    };
+
+    struct alignas(16) XMFLOAT3A : public XMFLOAT3
+    {
+        XMFLOAT3A() = default;
+        XMFLOAT3A(float _x, float _y, float _z) : XMFLOAT3(_x, _y, _z) {}
+    };
+
+    struct XMFLOAT4
+    {
+        float x, y, z, w;
+        XMFLOAT4() = default;
+        XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+        explicit XMFLOAT4(const float* p) : x(p[0]), y(p[1]), z(p[2]), w(p[3]) {}
+    };
+
+    struct alignas(16) XMFLOAT4A : public XMFLOAT4
+    {
+        XMFLOAT4A() = default;
+        XMFLOAT4A(float _x, float _y, float _z, float _w) : XMFLOAT4(_x, _y, _z, _w) {}
+    };
+
+    struct XMINT2 { int32_t x, y; };
+    struct XMUINT2 { uint32_t x, y; };
+    struct XMINT3 { int32_t x, y, z; };
+    struct XMUINT3 { uint32_t x, y, z; };
+    struct XMINT4 { int32_t x, y, z, w; };
+    struct XMUINT4 { uint32_t x, y, z, w; };
+
+    struct XMFLOAT3X3 { float m[3][3]; };
+    struct XMFLOAT4X3 { float m[4][3]; };
+
+    struct XMFLOAT4X4
+    {
+        union
+        {
+            struct
+            {
+                float _11, _12, _13, _14;
+                float _21, _22, _23, _24;
+                float _31, _32, _33, _34;
+                float _41, _42, _43, _44;
+            };
+            float m[4][4];
+        };
+
+        XMFLOAT4X4() = default;
+        XMFLOAT4X4(float m00, float m01, float m02, float m03,
+                   float m10, float m11, float m12, float m13,
+                   float m20, float m21, float m22, float m23,
+                   float m30, float m31, float m32, float m33)
+            : _11(m00), _12(m01), _13(m02), _14(m03),
+              _21(m10), _22(m11), _23(m12), _24(m13),
+              _31(m20), _32(m21), _33(m22), _34(m23),
+              _41(m30), _42(m31), _43(m32), _44(m33) {}
+    };
+
+    struct alignas(16) XMFLOAT4X4A : public XMFLOAT4X4 {};
+
+    struct alignas(16) XMMATRIX
+    {
+        XMVECTOR r[4];
+
+        XMMATRIX() = default;
+        XMMATRIX(FXMVECTOR r0, FXMVECTOR r1, FXMVECTOR r2, CXMVECTOR r3) { r[0] = r0; r[1] = r1; r[2] = r2; r[3] = r3; }
+        XMMATRIX(float m00, float m01, float m02, float m03,
+                 float m10, float m11, float m12, float m13,
+                 float m20, float m21, float m22, float m23,
+                 float m30, float m31, float m32, float m33)
+        {
+            r[0] = _mm_setr_ps(m00, m01, m02, m03);
+            r[1] = _mm_setr_ps(m10, m11, m12, m13);
+            r[2] = _mm_setr_ps(m20, m21, m22, m23);
+            r[3] = _mm_setr_ps(m30, m31, m32, m33);
+        }
+    };
+
+    typedef const XMMATRIX& FXMMATRIX;
+    typedef const XMMATRIX& CXMMATRIX;
+
+    //-----------------------------------------------------------------------------------
+    // Constants
+    //-----------------------------------------------------------------------------------
+
+    XMGLOBALCONST XMVECTORF32 g_XMZero          = { { { 0.0f, 0.0f, 0.0f, 0.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMOne           = { { { 1.0f, 1.0f, 1.0f, 1.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMNegativeOne   = { { { -1.0f, -1.0f, -1.0f, -1.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMOneHalf       = { { { 0.5f, 0.5f, 0.5f, 0.5f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMNegativeOneHalf = { { { -0.5f, -0.5f, -0.5f, -0.5f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMTwo           = { { { 2.0f, 2.0f, 2.0f, 2.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMNegateX       = { { { -1.0f, 1.0f, 1.0f, 1.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMNegateZ       = { { { 1.0f, 1.0f, -1.0f, 1.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMIdentityR0    = { { { 1.0f, 0.0f, 0.0f, 0.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMIdentityR1    = { { { 0.0f, 1.0f, 0.0f, 0.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMNegIdentityR1 = { { { 0.0f, -1.0f, 0.0f, 0.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMIdentityR2    = { { { 0.0f, 0.0f, 1.0f, 0.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMIdentityR3    = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMEpsilon       = { { { 1.192092896e-7f, 1.192092896e-7f, 1.192092896e-7f, 1.192092896e-7f } } };
+    XMGLOBALCONST XMVECTORF32 g_XMPi            = { { { XM_PI, XM_PI, XM_PI, XM_PI } } };
+    XMGLOBALCONST XMVECTORF32 g_XMTwoPi         = { { { XM_2PI, XM_2PI, XM_2PI, XM_2PI } } };
+    XMGLOBALCONST XMVECTORF32 g_XMHalfPi        = { { { XM_PIDIV2, XM_PIDIV2, XM_PIDIV2, XM_PIDIV2 } } };
+    XMGLOBALCONST XMVECTORF32 g_XMReciprocalTwoPi = { { { XM_1DIV2PI, XM_1DIV2PI, XM_1DIV2PI, XM_1DIV2PI } } };
+    XMGLOBALCONST XMVECTORF32 g_XMFltMax        = { { { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX } } };
+    XMGLOBALCONST XMVECTORU32 g_XMMaskXY        = { { { 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0x00000000 } } };
+    XMGLOBALCONST XMVECTORU32 g_XMMask3         = { { { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000 } } };
+    XMGLOBALCONST XMVECTORU32 g_XMSelect1110    = { { { XM_SELECT_1, XM_SELECT_1, XM_SELECT_1, XM_SELECT_0 } } };
+    XMGLOBALCONST XMVECTORU32 g_XMAbsMask       = { { { 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF } } };
+
+    //-----------------------------------------------------------------------------------
+    // Vector initialization and access
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMVectorZero() { return _mm_setzero_ps(); }
+    inline XMVECTOR XM_CALLCONV XMVectorSet(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    inline XMVECTOR XM_CALLCONV XMVectorSetInt(uint32_t x, uint32_t y, uint32_t z, uint32_t w)
+    {
+        return _mm_castsi128_ps(_mm_setr_epi32((int)x, (int)y, (int)z, (int)w));
+    }
+    inline XMVECTOR XM_CALLCONV XMVectorReplicate(float value) { return _mm_set1_ps(value); }
+    inline XMVECTOR XM_CALLCONV XMVectorReplicatePtr(const float* p) { return _mm_load1_ps(p); }
+    inline XMVECTOR XM_CALLCONV XMVectorReplicateInt(uint32_t value) { return _mm_castsi128_ps(_mm_set1_epi32((int)value)); }
+    inline XMVECTOR XM_CALLCONV XMVectorTrueInt() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    inline XMVECTOR XM_CALLCONV XMVectorFalseInt() { return _mm_setzero_ps(); }
+    inline XMVECTOR XM_CALLCONV XMVectorSplatOne() { return g_XMOne; }
+    inline XMVECTOR XM_CALLCONV XMVectorSplatEpsilon() { return XMVectorReplicateInt(0x34000000); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorSplatX(FXMVECTOR v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)); }
+    inline XMVECTOR XM_CALLCONV XMVectorSplatY(FXMVECTOR v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)); }
+    inline XMVECTOR XM_CALLCONV XMVectorSplatZ(FXMVECTOR v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)); }
+    inline XMVECTOR XM_CALLCONV XMVectorSplatW(FXMVECTOR v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+
+    inline float XM_CALLCONV XMVectorGetX(FXMVECTOR v) { return _mm_cvtss_f32(v); }
+    inline float XM_CALLCONV XMVectorGetY(FXMVECTOR v) { return _mm_cvtss_f32(XMVectorSplatY(v)); }
+    inline float XM_CALLCONV XMVectorGetZ(FXMVECTOR v) { return _mm_cvtss_f32(XMVectorSplatZ(v)); }
+    inline float XM_CALLCONV XMVectorGetW(FXMVECTOR v) { return _mm_cvtss_f32(XMVectorSplatW(v)); }
+    inline float XM_CALLCONV XMVectorGetByIndex(FXMVECTOR v, size_t i) { XMVECTORF32 u; u.v = v; return u.f[i]; }
+
+    inline XMVECTOR XM_CALLCONV XMVectorSetByIndex(FXMVECTOR v, float f, size_t i) { XMVECTORF32 u; u.v = v; u.f[i] = f; return u.v; }
+    inline XMVECTOR XM_CALLCONV XMVectorSetX(FXMVECTOR v, float f) { return XMVectorSetByIndex(v, f, 0); }
+    inline XMVECTOR XM_CALLCONV XMVectorSetY(FXMVECTOR v, float f) { return XMVectorSetByIndex(v, f, 1); }
+    inline XMVECTOR XM_CALLCONV XMVectorSetZ(FXMVECTOR v, float f) { return XMVectorSetByIndex(v, f, 2); }
+    inline XMVECTOR XM_CALLCONV XMVectorSetW(FXMVECTOR v, float f) { return XMVectorSetByIndex(v, f, 3); }
+
+    template<uint32_t X, uint32_t Y, uint32_t Z, uint32_t W>
+    inline XMVECTOR XM_CALLCONV XMVectorSwizzle(FXMVECTOR v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X)); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorSwizzle(FXMVECTOR v, uint32_t x, uint32_t y, uint32_t z, uint32_t w)
+    {
+        XMVECTORF32 a, r; a.v = v;
+        r.f[0] = a.f[x]; r.f[1] = a.f[y]; r.f[2] = a.f[z]; r.f[3] = a.f[w];
+        return r.v;
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVectorPermute(FXMVECTOR v1, FXMVECTOR v2, uint32_t x, uint32_t y, uint32_t z, uint32_t w)
+    {
+        XMVECTORF32 a[2], r; a[0].v = v1; a[1].v = v2;
+        r.f[0] = a[x >> 2].f[x & 3]; r.f[1] = a[y >> 2].f[y & 3];
+        r.f[2] = a[z >> 2].f[z & 3]; r.f[3] = a[w >> 2].f[w & 3];
+        return r.v;
+    }
+
+    template<uint32_t X, uint32_t Y, uint32_t Z, uint32_t W>
+    inline XMVECTOR XM_CALLCONV XMVectorPermute(FXMVECTOR v1, FXMVECTOR v2) { return XMVectorPermute(v1, v2, X, Y, Z, W); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorMergeXY(FXMVECTOR v1, FXMVECTOR v2) { return _mm_unpacklo_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorMergeZW(FXMVECTOR v1, FXMVECTOR v2) { return _mm_unpackhi_ps(v1, v2); }
+
+    //-----------------------------------------------------------------------------------
+    // Comparison and bitwise operations
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMVectorEqual(FXMVECTOR v1, FXMVECTOR v2) { return _mm_cmpeq_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorNotEqual(FXMVECTOR v1, FXMVECTOR v2) { return _mm_cmpneq_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorGreater(FXMVECTOR v1, FXMVECTOR v2) { return _mm_cmpgt_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorGreaterOrEqual(FXMVECTOR v1, FXMVECTOR v2) { return _mm_cmpge_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorLess(FXMVECTOR v1, FXMVECTOR v2) { return _mm_cmplt_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorLessOrEqual(FXMVECTOR v1, FXMVECTOR v2) { return _mm_cmple_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorIsNaN(FXMVECTOR v) { return _mm_cmpneq_ps(v, v); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorEqualInt(FXMVECTOR v1, FXMVECTOR v2)
+    {
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_castps_si128(v1), _mm_castps_si128(v2)));
+    }
+    inline XMVECTOR XM_CALLCONV XMVectorNotEqualInt(FXMVECTOR v1, FXMVECTOR v2)
+    {
+        return _mm_xor_ps(XMVectorEqualInt(v1, v2), XMVectorTrueInt());
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVectorAndInt(FXMVECTOR v1, FXMVECTOR v2) { return _mm_and_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorAndCInt(FXMVECTOR v1, FXMVECTOR v2) { return _mm_andnot_ps(v2, v1); }
+    inline XMVECTOR XM_CALLCONV XMVectorOrInt(FXMVECTOR v1, FXMVECTOR v2) { return _mm_or_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorXorInt(FXMVECTOR v1, FXMVECTOR v2) { return _mm_xor_ps(v1, v2); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorSelect(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR control)
+    {
+        return _mm_or_ps(_mm_andnot_ps(control, v1), _mm_and_ps(v2, control));
+    }
+    inline XMVECTOR XM_CALLCONV XMVectorSelectControl(uint32_t x, uint32_t y, uint32_t z, uint32_t w)
+    {
+        return XMVectorSetInt(x ? 0xFFFFFFFF : 0, y ? 0xFFFFFFFF : 0, z ? 0xFFFFFFFF : 0, w ? 0xFFFFFFFF : 0);
+    }
+
+    //-----------------------------------------------------------------------------------
+    // Arithmetic
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMVectorAdd(FXMVECTOR v1, FXMVECTOR v2) { return _mm_add_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorSubtract(FXMVECTOR v1, FXMVECTOR v2) { return _mm_sub_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorMultiply(FXMVECTOR v1, FXMVECTOR v2) { return _mm_mul_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorDivide(FXMVECTOR v1, FXMVECTOR v2) { return _mm_div_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorMultiplyAdd(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR v3) { return _mm_add_ps(_mm_mul_ps(v1, v2), v3); }
+    inline XMVECTOR XM_CALLCONV XMVectorNegativeMultiplySubtract(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR v3) { return _mm_sub_ps(v3, _mm_mul_ps(v1, v2)); }
+    inline XMVECTOR XM_CALLCONV XMVectorScale(FXMVECTOR v, float s) { return _mm_mul_ps(v, _mm_set_ps1(s)); }
+    inline XMVECTOR XM_CALLCONV XMVectorNegate(FXMVECTOR v) { return _mm_sub_ps(_mm_setzero_ps(), v); }
+    inline XMVECTOR XM_CALLCONV XMVectorAbs(FXMVECTOR v) { return _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), v), v); }
+    inline XMVECTOR XM_CALLCONV XMVectorReciprocal(FXMVECTOR v) { return _mm_div_ps(g_XMOne, v); }
+    inline XMVECTOR XM_CALLCONV XMVectorReciprocalEst(FXMVECTOR v) { return _mm_rcp_ps(v); }
+    inline XMVECTOR XM_CALLCONV XMVectorSqrt(FXMVECTOR v) { return _mm_sqrt_ps(v); }
+    inline XMVECTOR XM_CALLCONV XMVectorReciprocalSqrt(FXMVECTOR v) { return _mm_div_ps(g_XMOne, _mm_sqrt_ps(v)); }
+    inline XMVECTOR XM_CALLCONV XMVectorReciprocalSqrtEst(FXMVECTOR v) { return _mm_rsqrt_ps(v); }
+    inline XMVECTOR XM_CALLCONV XMVectorMin(FXMVECTOR v1, FXMVECTOR v2) { return _mm_min_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorMax(FXMVECTOR v1, FXMVECTOR v2) { return _mm_max_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV XMVectorClamp(FXMVECTOR v, FXMVECTOR lo, FXMVECTOR hi) { return _mm_min_ps(_mm_max_ps(lo, v), hi); }
+    inline XMVECTOR XM_CALLCONV XMVectorSaturate(FXMVECTOR v) { return _mm_min_ps(_mm_max_ps(v, g_XMZero), g_XMOne); }
+    inline XMVECTOR XM_CALLCONV XMVectorFloor(FXMVECTOR v) { return _mm_floor_ps(v); }
+    inline XMVECTOR XM_CALLCONV XMVectorCeiling(FXMVECTOR v) { return _mm_ceil_ps(v); }
+    inline XMVECTOR XM_CALLCONV XMVectorRound(FXMVECTOR v) { return _mm_round_ps(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    inline XMVECTOR XM_CALLCONV XMVectorTruncate(FXMVECTOR v) { return _mm_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorLerp(FXMVECTOR v0, FXMVECTOR v1, float t)
+    {
+        return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v1, v0), _mm_set_ps1(t)), v0);
+    }
+    inline XMVECTOR XM_CALLCONV XMVectorLerpV(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR t)
+    {
+        return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v1, v0), t), v0);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMConvertVectorIntToFloat(FXMVECTOR v, uint32_t divExponent)
+    {
+        XMVECTOR r = _mm_cvtepi32_ps(_mm_castps_si128(v));
+        return _mm_mul_ps(r, _mm_set_ps1(1.0f / (float)(1U << divExponent)));
+    }
+    inline XMVECTOR XM_CALLCONV XMConvertVectorFloatToInt(FXMVECTOR v, uint32_t mulExponent)
+    {
+        XMVECTOR r = _mm_mul_ps(v, _mm_set_ps1((float)(1U << mulExponent)));
+        return _mm_castsi128_ps(_mm_cvttps_epi32(r));
+    }
+    inline XMVECTOR XM_CALLCONV XMConvertVectorUIntToFloat(FXMVECTOR v, uint32_t divExponent)
+    {
+        XMVECTORU32 u; u.v = v;
+        float scale = 1.0f / (float)(1U << divExponent);
+        return XMVectorSet((float)u.u[0] * scale, (float)u.u[1] * scale, (float)u.u[2] * scale, (float)u.u[3] * scale);
+    }
+
+    //-----------------------------------------------------------------------------------
+    // 2D, 3D and 4D vector operations
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMVector2Dot(FXMVECTOR v1, FXMVECTOR v2)
+    {
+        XMVECTOR d = _mm_mul_ps(v1, v2);
+        XMVECTOR t = XMVectorSplatY(d);
+        d = _mm_add_ss(d, t);
+        return XMVectorSplatX(d);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector3Dot(FXMVECTOR v1, FXMVECTOR v2)
+    {
+        XMVECTOR d = _mm_mul_ps(v1, v2);
+        XMVECTOR t = _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 1, 2, 1));
+        d = _mm_add_ss(d, t);
+        t = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1));
+        d = _mm_add_ss(d, t);
+        return XMVectorSplatX(d);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector4Dot(FXMVECTOR v1, FXMVECTOR v2)
+    {
+        XMVECTOR t2 = v2;
+        XMVECTOR t = _mm_mul_ps(v1, t2);
+        t2 = _mm_shuffle_ps(t2, t, _MM_SHUFFLE(1, 0, 0, 0));
+        t2 = _mm_add_ps(t2, t);
+        t = _mm_shuffle_ps(t, t2, _MM_SHUFFLE(0, 3, 0, 0));
+        t = _mm_add_ps(t, t2);
+        return XMVectorSplatZ(t);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector3Cross(FXMVECTOR v1, FXMVECTOR v2)
+    {
+        XMVECTOR t1 = _mm_shuffle_ps(v1, v1, _MM_SHUFFLE(3, 0, 2, 1));
+        XMVECTOR t2 = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 1, 0, 2));
+        XMVECTOR r = _mm_mul_ps(t1, t2);
+        t1 = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(3, 0, 2, 1));
+        t2 = _mm_shuffle_ps(t2, t2, _MM_SHUFFLE(3, 1, 0, 2));
+        t1 = _mm_mul_ps(t1, t2);
+        r = _mm_sub_ps(r, t1);
+        return _mm_and_ps(r, g_XMMask3);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector2LengthSq(FXMVECTOR v) { return XMVector2Dot(v, v); }
+    inline XMVECTOR XM_CALLCONV XMVector3LengthSq(FXMVECTOR v) { return XMVector3Dot(v, v); }
+    inline XMVECTOR XM_CALLCONV XMVector4LengthSq(FXMVECTOR v) { return XMVector4Dot(v, v); }
+    inline XMVECTOR XM_CALLCONV XMVector2Length(FXMVECTOR v) { return _mm_sqrt_ps(XMVector2Dot(v, v)); }
+    inline XMVECTOR XM_CALLCONV XMVector3Length(FXMVECTOR v) { return _mm_sqrt_ps(XMVector3Dot(v, v)); }
+    inline XMVECTOR XM_CALLCONV XMVector4Length(FXMVECTOR v) { return _mm_sqrt_ps(XMVector4Dot(v, v)); }
+
+    inline XMVECTOR XM_CALLCONV XMVectorNormalizeWith(FXMVECTOR v, FXMVECTOR lengthSq)
+    {
+        // Zero length gives zero, infinite length gives NaN, as DirectXMath does.
+        XMVECTOR length = _mm_sqrt_ps(lengthSq);
+        XMVECTOR zeroMask = _mm_cmpneq_ps(_mm_setzero_ps(), length);
+        XMVECTOR infMask = _mm_cmpneq_ps(lengthSq, _mm_set_ps1(INFINITY));
+        XMVECTOR r = _mm_div_ps(v, length);
+        r = _mm_and_ps(r, zeroMask);
+        return _mm_or_ps(_mm_andnot_ps(infMask, _mm_set_ps1(NAN)), _mm_and_ps(r, infMask));
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector2Normalize(FXMVECTOR v) { return XMVectorNormalizeWith(v, XMVector2Dot(v, v)); }
+    inline XMVECTOR XM_CALLCONV XMVector3Normalize(FXMVECTOR v) { return XMVectorNormalizeWith(v, XMVector3Dot(v, v)); }
+    inline XMVECTOR XM_CALLCONV XMVector4Normalize(FXMVECTOR v) { return XMVectorNormalizeWith(v, XMVector4Dot(v, v)); }
+
+    inline bool XM_CALLCONV XMVector2NearEqual(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR epsilon)
+    {
+        XMVECTOR delta = _mm_sub_ps(v1, v2);
+        XMVECTOR t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), delta), delta);
+        return (_mm_movemask_ps(_mm_cmple_ps(t, epsilon)) & 3) == 3;
+    }
+    inline bool XM_CALLCONV XMVector3NearEqual(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR epsilon)
+    {
+        XMVECTOR delta = _mm_sub_ps(v1, v2);
+        XMVECTOR t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), delta), delta);
+        return (_mm_movemask_ps(_mm_cmple_ps(t, epsilon)) & 7) == 7;
+    }
+    inline bool XM_CALLCONV XMVector2Equal(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmpeq_ps(v1, v2)) & 3) == 3; }
+    inline bool XM_CALLCONV XMVector3Equal(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmpeq_ps(v1, v2)) & 7) == 7; }
+    inline bool XM_CALLCONV XMVector4Equal(FXMVECTOR v1, FXMVECTOR v2) { return _mm_movemask_ps(_mm_cmpeq_ps(v1, v2)) == 0xF; }
+    inline bool XM_CALLCONV XMVector3NotEqual(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmpeq_ps(v1, v2)) & 7) != 7; }
+    inline bool XM_CALLCONV XMVector4EqualInt(FXMVECTOR v1, FXMVECTOR v2) { return _mm_movemask_ps(XMVectorEqualInt(v1, v2)) == 0xF; }
+    inline bool XM_CALLCONV XMVector3Greater(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmpgt_ps(v1, v2)) & 7) == 7; }
+    inline bool XM_CALLCONV XMVector3GreaterOrEqual(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmpge_ps(v1, v2)) & 7) == 7; }
+    inline bool XM_CALLCONV XMVector3Less(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmplt_ps(v1, v2)) & 7) == 7; }
+    inline bool XM_CALLCONV XMVector3LessOrEqual(FXMVECTOR v1, FXMVECTOR v2) { return (_mm_movemask_ps(_mm_cmple_ps(v1, v2)) & 7) == 7; }
+    inline bool XM_CALLCONV XMVector4Less(FXMVECTOR v1, FXMVECTOR v2) { return _mm_movemask_ps(_mm_cmplt_ps(v1, v2)) == 0xF; }
+    inline bool XM_CALLCONV XMVector3InBounds(FXMVECTOR v, FXMVECTOR bounds)
+    {
+        XMVECTOR t = _mm_and_ps(_mm_cmple_ps(v, bounds), _mm_cmple_ps(XMVectorNegate(bounds), v));
+        return (_mm_movemask_ps(t) & 7) == 7;
+    }
+
+    //-----------------------------------------------------------------------------------
+    // Planes
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMPlaneDotCoord(FXMVECTOR p, FXMVECTOR v)
+    {
+        return XMVector4Dot(p, XMVectorSelect(g_XMOne, v, g_XMSelect1110));
+    }
+
+    // The XMVECTOR operators need no definitions here: GCC and Clang already provide +, -
+    // and * on __m128, element-wise and with scalars, as addps/subps/mulps.  Only a
+    // constant on one side needs them, since the built-in operators do not convert it.
+    inline XMVECTOR XM_CALLCONV operator+(FXMVECTOR v1, const XMVECTORF32& v2) { return _mm_add_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV operator+(const XMVECTORF32& v1, FXMVECTOR v2) { return _mm_add_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV operator-(FXMVECTOR v1, const XMVECTORF32& v2) { return _mm_sub_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV operator*(FXMVECTOR v1, const XMVECTORF32& v2) { return _mm_mul_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV operator*(const XMVECTORF32& v1, FXMVECTOR v2) { return _mm_mul_ps(v1, v2); }
+    inline XMVECTOR XM_CALLCONV operator*(const XMVECTORF32& v, float s) { return _mm_mul_ps(v, _mm_set_ps1(s)); }
+    inline XMVECTOR& XM_CALLCONV operator*=(XMVECTOR& v1, const XMVECTORF32& v2) { v1 = _mm_mul_ps(v1, v2); return v1; }
+
+    //-----------------------------------------------------------------------------------
+    // Loads and stores
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMLoadFloat(const float* p) { return _mm_load_ss(p); }
+    inline XMVECTOR XM_CALLCONV XMLoadInt(const uint32_t* p) { return _mm_load_ss(reinterpret_cast<const float*>(p)); }
+    inline XMVECTOR XM_CALLCONV XMLoadFloat2(const XMFLOAT2* p) { return _mm_setr_ps(p->x, p->y, 0.0f, 0.0f); }
+    inline XMVECTOR XM_CALLCONV XMLoadFloat2A(const XMFLOAT2A* p) { return _mm_setr_ps(p->x, p->y, 0.0f, 0.0f); }
+    inline XMVECTOR XM_CALLCONV XMLoadFloat3(const XMFLOAT3* p) { return _mm_setr_ps(p->x, p->y, p->z, 0.0f); }
+    inline XMVECTOR XM_CALLCONV XMLoadFloat3A(const XMFLOAT3A* p) { return _mm_and_ps(_mm_load_ps(&p->x), g_XMMask3); }
+    inline XMVECTOR XM_CALLCONV XMLoadFloat4(const XMFLOAT4* p) { return _mm_loadu_ps(&p->x); }
+    inline XMVECTOR XM_CALLCONV XMLoadFloat4A(const XMFLOAT4A* p) { return _mm_load_ps(&p->x); }
+    inline XMVECTOR XM_CALLCONV XMLoadInt2(const uint32_t* p) { return _mm_setr_ps(*reinterpret_cast<const float*>(p), *reinterpret_cast<const float*>(p + 1), 0.0f, 0.0f); }
+    inline XMVECTOR XM_CALLCONV XMLoadInt4(const uint32_t* p) { return _mm_loadu_ps(reinterpret_cast<const float*>(p)); }
+    inline XMVECTOR XM_CALLCONV XMLoadInt4A(const uint32_t* p) { return _mm_load_ps(reinterpret_cast<const float*>(p)); }
+    inline XMVECTOR XM_CALLCONV XMLoadUInt4(const XMUINT4* p) { return XMVectorSet((float)p->x, (float)p->y, (float)p->z, (float)p->w); }
+
+    inline void XM_CALLCONV XMStoreFloat(float* p, FXMVECTOR v) { _mm_store_ss(p, v); }
+    inline void XM_CALLCONV XMStoreInt(uint32_t* p, FXMVECTOR v) { _mm_store_ss(reinterpret_cast<float*>(p), v); }
+    inline void XM_CALLCONV XMStoreFloat2(XMFLOAT2* p, FXMVECTOR v) { _mm_storel_pi(reinterpret_cast<__m64*>(p), v); }
+    inline void XM_CALLCONV XMStoreFloat2A(XMFLOAT2A* p, FXMVECTOR v) { _mm_storel_pi(reinterpret_cast<__m64*>(p), v); }
+    inline void XM_CALLCONV XMStoreFloat3(XMFLOAT3* p, FXMVECTOR v)
+    {
+        XMVECTORF32 u; u.v = v;
+        p->x = u.f[0]; p->y = u.f[1]; p->z = u.f[2];
+    }
+    inline void XM_CALLCONV XMStoreFloat3A(XMFLOAT3A* p, FXMVECTOR v) { XMStoreFloat3(p, v); }
+    inline void XM_CALLCONV XMStoreFloat4(XMFLOAT4* p, FXMVECTOR v) { _mm_storeu_ps(&p->x, v); }
+    inline void XM_CALLCONV XMStoreFloat4A(XMFLOAT4A* p, FXMVECTOR v) { _mm_store_ps(&p->x, v); }
+    inline void XM_CALLCONV XMStoreInt2(uint32_t* p, FXMVECTOR v) { _mm_storel_pi(reinterpret_cast<__m64*>(p), v); }
+    inline void XM_CALLCONV XMStoreInt4(uint32_t* p, FXMVECTOR v) { _mm_storeu_ps(reinterpret_cast<float*>(p), v); }
+    inline void XM_CALLCONV XMStoreInt4A(uint32_t* p, FXMVECTOR v) { _mm_store_ps(reinterpret_cast<float*>(p), v); }
+
+    //-----------------------------------------------------------------------------------
+    // Matrices
+    //-----------------------------------------------------------------------------------
+
+    inline XMMATRIX XM_CALLCONV XMMatrixIdentity()
+    {
+        return XMMATRIX(g_XMIdentityR0, g_XMIdentityR1, g_XMIdentityR2, g_XMIdentityR3);
+    }
+
+    inline XMMATRIX XM_CALLCONV XMMatrixMultiply(FXMMATRIX m1, CXMMATRIX m2)
+    {
+        XMMATRIX r;
+        for (int i = 0; i < 4; ++i)
+        {
+            XMVECTOR v = m1.r[i];
+            XMVECTOR x = _mm_mul_ps(XMVectorSplatX(v), m2.r[0]);
+            XMVECTOR y = _mm_mul_ps(XMVectorSplatY(v), m2.r[1]);
+            XMVECTOR z = _mm_mul_ps(XMVectorSplatZ(v), m2.r[2]);
+            XMVECTOR w = _mm_mul_ps(XMVectorSplatW(v), m2.r[3]);
+            r.r[i] = _mm_add_ps(_mm_add_ps(x, z), _mm_add_ps(y, w));
+        }
+        return r;
+    }
+
+    inline XMMATRIX XM_CALLCONV operator*(FXMMATRIX m1, CXMMATRIX m2) { return XMMatrixMultiply(m1, m2); }
+
+    inline XMMATRIX XM_CALLCONV XMMatrixTranspose(FXMMATRIX m)
+    {
+        XMMATRIX r = m;
+        _MM_TRANSPOSE4_PS(r.r[0], r.r[1], r.r[2], r.r[3]);
+        return r;
+    }
+
+    inline XMMATRIX XM_CALLCONV XMMatrixTranslation(float x, float y, float z)
+    {
+        XMMATRIX m = XMMatrixIdentity();
+        m.r[3] = XMVectorSet(x, y, z, 1.0f);
+        return m;
+    }
+
+    inline XMMATRIX XM_CALLCONV XMMatrixScaling(float x, float y, float z)
+    {
+        return XMMATRIX(x, 0, 0, 0, 0, y, 0, 0, 0, 0, z, 0, 0, 0, 0, 1);
+    }
+
+    inline XMMATRIX XM_CALLCONV XMMatrixRotationY(float angle)
+    {
+        float s = sinf(angle), c = cosf(angle);
+        return XMMATRIX(c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1);
+    }
+
+    inline XMMATRIX XM_CALLCONV XMMatrixRotationZ(float angle)
+    {
+        float s = sinf(angle), c = cosf(angle);
+        return XMMATRIX(c, s, 0, 0, -s, c, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+    }
+
+    // Cofactor inverse; only used off the measured paths.
+    inline XMMATRIX XM_CALLCONV XMMatrixInverse(XMVECTOR* pDeterminant, FXMMATRIX M)
+    {
+        XMFLOAT4X4 a;
+        for (int i = 0; i < 4; ++i)
+            XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(a.m[i]), M.r[i]);
+
+        const float* m = &a.m[0][0];
+        float inv[16];
+        inv[0]  =  m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+        inv[4]  = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+        inv[8]  =  m[4]*m[9]*m[15]  - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+        inv[12] = -m[4]*m[9]*m[14]  + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+        inv[1]  = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+        inv[5]  =  m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+        inv[9]  = -m[0]*m[9]*m[15]  + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+        inv[13] =  m[0]*m[9]*m[14]  - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+        inv[2]  =  m[1]*m[6]*m[15]  - m[1]*m[7]*m[14]  - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7]  - m[13]*m[3]*m[6];
+        inv[6]  = -m[0]*m[6]*m[15]  + m[0]*m[7]*m[14]  + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7]  + m[12]*m[3]*m[6];
+        inv[10] =  m[0]*m[5]*m[15]  - m[0]*m[7]*m[13]  - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7]  - m[12]*m[3]*m[5];
+        inv[14] = -m[0]*m[5]*m[14]  + m[0]*m[6]*m[13]  + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6]  + m[12]*m[2]*m[5];
+        inv[3]  = -m[1]*m[6]*m[11]  + m[1]*m[7]*m[10]  + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7]   + m[9]*m[3]*m[6];
+        inv[7]  =  m[0]*m[6]*m[11]  - m[0]*m[7]*m[10]  - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7]   - m[8]*m[3]*m[6];
+        inv[11] = -m[0]*m[5]*m[11]  + m[0]*m[7]*m[9]   + m[4]*m[1]*m[11] - m[4]*m[3]*m[9]  - m[8]*m[1]*m[7]   + m[8]*m[3]*m[5];
+        inv[15] =  m[0]*m[5]*m[10]  - m[0]*m[6]*m[9]   - m[4]*m[1]*m[10] + m[4]*m[2]*m[9]  + m[8]*m[1]*m[6]   - m[8]*m[2]*m[5];
+
+        float det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+        if (pDeterminant)
+            *pDeterminant = XMVectorReplicate(det);
+
+        float s = 1.0f / det;
+        return XMMATRIX(inv[0]*s, inv[1]*s, inv[2]*s, inv[3]*s, inv[4]*s, inv[5]*s, inv[6]*s, inv[7]*s,
+                        inv[8]*s, inv[9]*s, inv[10]*s, inv[11]*s, inv[12]*s, inv[13]*s, inv[14]*s, inv[15]*s);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMMatrixDeterminant(FXMMATRIX M)
+    {
+        XMVECTOR det;
+        XMMatrixInverse(&det, M);
+        return det;
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector3Transform(FXMVECTOR v, FXMMATRIX m)
+    {
+        XMVECTOR r = _mm_add_ps(_mm_mul_ps(XMVectorSplatZ(v), m.r[2]), m.r[3]);
+        r = _mm_add_ps(_mm_mul_ps(XMVectorSplatY(v), m.r[1]), r);
+        return _mm_add_ps(_mm_mul_ps(XMVectorSplatX(v), m.r[0]), r);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector3TransformCoord(FXMVECTOR v, FXMMATRIX m)
+    {
+        XMVECTOR r = _mm_add_ps(_mm_mul_ps(XMVectorSplatZ(v), m.r[2]), m.r[3]);
+        r = _mm_add_ps(_mm_mul_ps(XMVectorSplatY(v), m.r[1]), r);
+        r = _mm_add_ps(_mm_mul_ps(XMVectorSplatX(v), m.r[0]), r);
+        return _mm_div_ps(r, XMVectorSplatW(r));
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector3TransformNormal(FXMVECTOR v, FXMMATRIX m)
+    {
+        XMVECTOR r = _mm_mul_ps(XMVectorSplatZ(v), m.r[2]);
+        r = _mm_add_ps(_mm_mul_ps(XMVectorSplatY(v), m.r[1]), r);
+        return _mm_add_ps(_mm_mul_ps(XMVectorSplatX(v), m.r[0]), r);
+    }
+
+    inline XMVECTOR XM_CALLCONV XMVector4Transform(FXMVECTOR v, FXMMATRIX m)
+    {
+        XMVECTOR r = _mm_mul_ps(XMVectorSplatW(v), m.r[3]);
+        r = _mm_add_ps(_mm_mul_ps(XMVectorSplatZ(v), m.r[2]), r);
+        r = _mm_add_ps(_mm_mul_ps(XMVectorSplatY(v), m.r[1]), r);
+        return _mm_add_ps(_mm_mul_ps(XMVectorSplatX(v), m.r[0]), r);
+    }
+
+    inline XMMATRIX XM_CALLCONV XMLoadFloat4x4(const XMFLOAT4X4* p)
+    {
+        return XMMATRIX(_mm_loadu_ps(p->m[0]), _mm_loadu_ps(p->m[1]), _mm_loadu_ps(p->m[2]), _mm_loadu_ps(p->m[3]));
+    }
+
+    inline void XM_CALLCONV XMStoreFloat4x4(XMFLOAT4X4* p, FXMMATRIX m)
+    {
+        for (int i = 0; i < 4; ++i)
+            _mm_storeu_ps(p->m[i], m.r[i]);
+    }
+
+    //-----------------------------------------------------------------------------------
+    // Quaternions
+    //-----------------------------------------------------------------------------------
+
+    inline XMVECTOR XM_CALLCONV XMQuaternionIdentity() { return g_XMIdentityR3; }
+    inline XMVECTOR XM_CALLCONV XMQuaternionDot(FXMVECTOR q1, FXMVECTOR q2) { return XMVector4Dot(q1, q2); }
+    inline XMVECTOR XM_CALLCONV XMQuaternionNormalize(FXMVECTOR q) { return XMVector4Normalize(q); }
+
+    // Same shuffles as DirectXMath, so the results match it exactly.
+    inline XMMATRIX XM_CALLCONV XMMatrixRotationQuaternion(FXMVECTOR q)
+    {
+        const XMVECTORF32 constant1110 = { { { 1.0f, 1.0f, 1.0f, 0.0f } } };
+
+        XMVECTOR q0 = _mm_add_ps(q, q);
+        XMVECTOR q1 = _mm_mul_ps(q, q0);
+
+        XMVECTOR v0 = _mm_and_ps(_mm_shuffle_ps(q1, q1, _MM_SHUFFLE(3, 0, 0, 1)), g_XMMask3);
+        XMVECTOR v1 = _mm_and_ps(_mm_shuffle_ps(q1, q1, _MM_SHUFFLE(3, 1, 2, 2)), g_XMMask3);
+        XMVECTOR r0 = _mm_sub_ps(_mm_sub_ps(constant1110, v0), v1);
+
+        v0 = _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(3, 1, 0, 0)), _mm_shuffle_ps(q0, q0, _MM_SHUFFLE(3, 2, 1, 2)));
+        v1 = _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(3, 3, 3, 3)), _mm_shuffle_ps(q0, q0, _MM_SHUFFLE(3, 0, 2, 1)));
+        XMVECTOR r1 = _mm_add_ps(v0, v1);
+        XMVECTOR r2 = _mm_sub_ps(v0, v1);
+
+        v0 = _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(1, 0, 2, 1));
+        v0 = _mm_shuffle_ps(v0, v0, _MM_SHUFFLE(1, 3, 2, 0));
+        v1 = _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(2, 2, 0, 0));
+        v1 = _mm_shuffle_ps(v1, v1, _MM_SHUFFLE(2, 0, 2, 0));
+
+        XMMATRIX m;
+        q1 = _mm_shuffle_ps(r0, v0, _MM_SHUFFLE(1, 0, 3, 0));
+        m.r[0] = _mm_shuffle_ps(q1, q1, _MM_SHUFFLE(1, 3, 2, 0));
+        q1 = _mm_shuffle_ps(r0, v0, _MM_SHUFFLE(3, 2, 3, 1));
+        m.r[1] = _mm_shuffle_ps(q1, q1, _MM_SHUFFLE(1, 3, 0, 2));
+        m.r[2] = _mm_shuffle_ps(v1, r0, _MM_SHUFFLE(3, 2, 1, 0));
+        m.r[3] = g_XMIdentityR3;
+        return m;
+    }
+
+    // DirectXMath's branch-free selection of the largest of x, y, z and w, done with
+    // branches; only used off the measured paths.
+    inline XMVECTOR XM_CALLCONV XMQuaternionRotationMatrix(FXMMATRIX M)
+    {
+        XMFLOAT4X4 m;
+        XMStoreFloat4x4(&m, M);
+
+        float r00 = m.m[0][0], r11 = m.m[1][1], r22 = m.m[2][2];
+        float q[4];
+        if (r22 <= 0.0f)
+        {
+            if (r11 - r00 <= 0.0f)
+            {
+                q[0] = 1.0f + r00 - r11 - r22;
+                q[1] = m.m[0][1] + m.m[1][0];
+                q[2] = m.m[0][2] + m.m[2][0];
+                q[3] = m.m[1][2] - m.m[2][1];
+            }
+            else
+            {
+                q[0] = m.m[0][1] + m.m[1][0];
+                q[1] = 1.0f - r00 + r11 - r22;
+                q[2] = m.m[1][2] + m.m[2][1];
+                q[3] = m.m[2][0] - m.m[0][2];
+            }
+        }
+        else
+        {
+            if (r11 + r00 <= 0.0f)
+            {
+                q[0] = m.m[0][2] + m.m[2][0];
+                q[1] = m.m[1][2] + m.m[2][1];
+                q[2] = 1.0f - r00 - r11 + r22;
+                q[3] = m.m[0][1] - m.m[1][0];
+            }
+            else
+            {
+                q[0] = m.m[1][2] - m.m[2][1];
+                q[1] = m.m[2][0] - m.m[0][2];
+                q[2] = m.m[0][1] - m.m[1][0];
+                q[3] = 1.0f + r00 + r11 + r22;
+            }
+        }
+
+        XMVECTOR v = XMVectorSet(q[0], q[1], q[2], q[3]);
+        return _mm_div_ps(v, XMVector4Length(v));
+    }
+
+    // The angle comes from the C library rather than DirectXMath's polynomials, so the
+    // weights may differ from a Windows build in the last bit.
+    inline XMVECTOR XM_CALLCONV XMQuaternionSlerp(FXMVECTOR q0, FXMVECTOR q1, float t)
+    {
+        float cosOmega = XMVectorGetX(XMQuaternionDot(q0, q1));
+        float sign = cosOmega < 0.0f ? -1.0f : 1.0f;
+        cosOmega *= sign;
+
+        float s0 = 1.0f - t, s1 = t;
+        if (cosOmega < 1.0f - 0.00001f)
+        {
+            float sinOmega = sqrtf(1.0f - cosOmega * cosOmega);
+            float omega = atan2f(sinOmega, cosOmega);
+            s0 = sinf(s0 * omega) / sinOmega;
+            s1 = sinf(s1 * omega) / sinOmega;
+        }
+
+        return _mm_add_ps(_mm_mul_ps(q0, _mm_set1_ps(s0)), _mm_mul_ps(q1, _mm_set1_ps(s1 * sign)));
+    }
+
+    // Same steps as DirectXMath: the longest basis vector is kept, degenerate ones are
+    // rebuilt from it, and a reflection is moved into the scale of the longest.
+    inline bool XM_CALLCONV XMMatrixDecompose(XMVECTOR* outScale, XMVECTOR* outRotQuat, XMVECTOR* outTrans, FXMMATRIX M)
+    {
+        const float epsilon = 0.0001f;
+        const XMVECTOR canonical[3] = { g_XMIdentityR0, g_XMIdentityR1, g_XMIdentityR2 };
+
+        *outTrans = M.r[3];
+
+        XMMATRIX basis(M.r[0], M.r[1], M.r[2], g_XMIdentityR3);
+        float scales[3];
+        for (int i = 0; i < 3; ++i)
+            scales[i] = XMVectorGetX(XMVector3Length(basis.r[i]));
+
+        // a, b, c: the axes from longest to shortest, ties going as DirectXMath's do.
+        auto rank = [](float x, float y, float z, size_t& a, size_t& b, size_t& c)
+        {
+            if (x < y)
+            {
+                if (y < z)      { a = 2; b = 1; c = 0; }
+                else if (x < z) { a = 1; b = 2; c = 0; }
+                else            { a = 1; b = 0; c = 2; }
+            }
+            else
+            {
+                if (x < z)      { a = 2; b = 0; c = 1; }
+                else if (y < z) { a = 0; b = 2; c = 1; }
+                else            { a = 0; b = 1; c = 2; }
+            }
+        };
+
+        size_t a, b, c;
+        rank(scales[0], scales[1], scales[2], a, b, c);
+
+        if (scales[a] < epsilon)
+            basis.r[a] = canonical[a];
+        basis.r[a] = XMVector3Normalize(basis.r[a]);
+
+        if (scales[b] < epsilon)
+        {
+            size_t aa, bb, cc;
+            rank(fabsf(XMVectorGetX(basis.r[a])), fabsf(XMVectorGetY(basis.r[a])), fabsf(XMVectorGetZ(basis.r[a])), aa, bb, cc);
+            basis.r[b] = XMVector3Cross(basis.r[a], canonical[cc]);
+        }
+        basis.r[b] = XMVector3Normalize(basis.r[b]);
+
+        if (scales[c] < epsilon)
+            basis.r[c] = XMVector3Cross(basis.r[a], basis.r[b]);
+        basis.r[c] = XMVector3Normalize(basis.r[c]);
+
+        float det = XMVectorGetX(XMMatrixDeterminant(basis));
+        if (det < 0.0f)
+        {
+            scales[a] = -scales[a];
+            basis.r[a] = XMVectorNegate(basis.r[a]);
+            det = -det;
+        }
+        *outScale = XMVectorSet(scales[0], scales[1], scales[2], 0.0f);
+
+        det -= 1.0f;
+        det *= det;
+        if (epsilon < det)
+            return false;
+
+        *outRotQuat = XMQuaternionRotationMatrix(basis);
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------------
+    // Scalar
+    //-----------------------------------------------------------------------------------
+
+    inline void XMScalarSinCos(float* pSin, float* pCos, float value)
+    {
+        // Same minimax polynomials as DirectXMath, so the results match it exactly.
+        float quotient = XM_1DIV2PI * value;
+        if (value >= 0.0f)
+            quotient = (float)((int)(quotient + 0.5f));
+        else
+            quotient = (float)((int)(quotient - 0.5f));
+        float y = value - XM_2PI * quotient;
+
+        float sign;
+        if (y > XM_PIDIV2)       { y = XM_PI - y;  sign = -1.0f; }
+        else if (y < -XM_PIDIV2) { y = -XM_PI - y; sign = -1.0f; }
+        else                     { sign = +1.0f; }
+
+        float y2 = y * y;
+        *pSin = (((((-2.3889859e-08f * y2 + 2.7525562e-06f) * y2 - 0.00019840874f) * y2 + 0.0083333310f) * y2 - 0.16666667f) * y2 + 1.0f) * y;
+        float p = ((((-2.6051615e-07f * y2 + 2.4760495e-05f) * y2 - 0.0013888378f) * y2 + 0.041666638f) * y2 - 0.5f) * y2 + 1.0f;
+        *pCos = sign * p;
+    }
+}
+
+#endif // TESTS_COMPAT_DIRECTXMATH_H
@@ -0,0 +1,150 @@
+//***************************************************************************************
+// DirectXPackedVector.h (test compat)
+//
+// The packed vector types used by the model parsers under test, for building the
+// headless tests where the Windows SDK is not available.  Conversions follow the
+// _XM_SSE_INTRINSICS_ implementations.  Never on the include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_DIRECTXPACKEDVECTOR_H
+#define TESTS_COMPAT_DIRECTXPACKEDVECTOR_H
+
+#include "DirectXMath.h"
+#include <string.h>
+
+namespace DirectX
+{
+namespace PackedVector
+{
+    typedef uint16_t HALF;
+
+    // Two half precision values.
+    struct XMHALF2
+    {
+        HALF x;
+        HALF y;
+    };
+
+    // DirectXMath's scalar conversions; the F16C paths round the same way.
+    inline float XMConvertHalfToFloat(HALF value)
+    {
+        uint32_t mantissa = (uint32_t)(value & 0x03FF);
+        uint32_t exponent = (value & 0x7C00);
+
+        if( exponent == 0x7C00 )
+        {
+            // INF/NAN
+            exponent = 0x8f;
+        }
+        else if( exponent != 0 )
+        {
+            // The value is normalized
+            exponent = (uint32_t)((value >> 10) & 0x1F);
+        }
+        else if( mantissa != 0 )
+        {
+            // The value is denormalized; normalize it in the result
+            exponent = 1;
+            do
+            {
+                exponent--;
+                mantissa <<= 1;
+            }
+            while( (mantissa & 0x0400) == 0 );
+
+            mantissa &= 0x03FF;
+        }
+        else
+        {
+            // The value is zero
+            exponent = (uint32_t)-112;
+        }
+
+        uint32_t result = ((value & 0x8000) << 16) | ((exponent + 112) << 23) | (mantissa << 13);
+        float f;
+        memcpy(&f, &result, sizeof(f));
+        return f;
+    }
+
+    inline HALF XMConvertFloatToHalf(float value)
+    {
+        uint32_t iValue;
+        memcpy(&iValue, &value, sizeof(iValue));
+        uint32_t sign = (iValue & 0x80000000U) >> 16U;
+        iValue = iValue & 0x7FFFFFFFU;
+
+        uint32_t result;
+        if( iValue > 0x477FE000U )
+        {
+            // The number is too large to be represented as a half; saturate to infinity.
+            if( ((iValue & 0x7F800000) == 0x7F800000) && ((iValue & 0x7FFFFF) != 0) )
+                result = 0x7FFF;    // NAN
+            else
+                result = 0x7C00U;   // INF
+        }
+        else if( !iValue )
+        {
+            result = 0;
+        }
+        else
+        {
+            if( iValue < 0x38800000U )
+            {
+                // The number is too small to be represented as a normalized half;
+                // convert it to a denormalized value.
+                uint32_t shift = 113U - (iValue >> 23U);
+                iValue = (0x800000U | (iValue & 0x7FFFFFU)) >> shift;
+            }
+            else
+            {
+                // Rebias the exponent to represent the value as a normalized half.
+                iValue += 0xC8000000U;
+            }
+
+            result = ((iValue + 0x0FFFU + ((iValue >> 13U) & 1U)) >> 13U) & 0x7FFFU;
+        }
+        return (HALF)(result | sign);
+    }
+
+    // Four unsigned normalized 8-bit values.
+    struct XMUBYTEN4
+    {
+        union
+        {
+            struct
+            {
+                uint8_t x;
+                uint8_t y;
+                uint8_t z;
+                uint8_t w;
+            };
+            uint32_t v;
+        };
+
+        XMUBYTEN4() = default;
+        XMUBYTEN4(uint8_t _x, uint8_t _y, uint8_t _z, uint8_t _w) : x(_x), y(_y), z(_z), w(_w) {}
+        explicit XMUBYTEN4(uint32_t packed) : v(packed) {}
+    };
+
+    inline XMVECTOR XM_CALLCONV XMLoadUByteN4(const XMUBYTEN4* p)
+    {
+        XMVECTOR v = _mm_setr_ps((float)p->x, (float)p->y, (float)p->z, (float)p->w);
+        return _mm_mul_ps(v, _mm_set1_ps(1.0f / 255.0f));
+    }
+
+    inline void XM_CALLCONV XMStoreUByteN4(XMUBYTEN4* p, FXMVECTOR v)
+    {
+        XMVECTOR n = XMVectorSaturate(v);
+        n = XMVectorRound(XMVectorMultiply(n, _mm_set1_ps(255.0f)));
+
+        alignas(16) float f[4];
+        _mm_store_ps(f, n);
+        p->x = (uint8_t)f[0];
+        p->y = (uint8_t)f[1];
+        p->z = (uint8_t)f[2];
+        p->w = (uint8_t)f[3];
+    }
+}
+}
+
+#endif // TESTS_COMPAT_DIRECTXPACKEDVECTOR_H
@@ -0,0 +1,157 @@
+//***************************************************************************************
+// MsvcCompat.h (test compat)
+//
+// Force-included ahead of the DirectXTK sources that need a device, for the parts of
+// Microsoft's C and C++ libraries they rely on that other libraries lack:
+//
+// - They throw std::exception("message"), and subclass std::exception with a what()
+//   that is not noexcept.  After every standard header they might use has been read,
+//   std::exception is renamed to a class that allows both.  It is not related to the
+//   real std::exception, so callers must catch it with catch (...) or by that name.
+// - sprintf_s into a fixed-size array, and assert() and USHRT_MAX without an include.
+// - _countof, and the wide string functions the effect factories build texture paths
+//   with: wcscpy_s and wcscat_s into a fixed-size array, _wcsicmp and _wsplitpath_s.
+// - _CPPRTTI, MSVC's name for RTTI being on, which Model.cpp checks for.
+// - __declspec(align(n)) after the class key, which becomes alignas(n), and
+//   __declspec(selectany), which becomes a weak definition.
+//
+// Never used on Windows.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_MSVCCOMPAT_H
+#define TESTS_COMPAT_MSVCCOMPAT_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cwchar>
+#include <cwctype>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace std
+{
+    class msvc_exception
+    {
+    public:
+        msvc_exception() : mMessage("Unknown exception") {}
+        explicit msvc_exception(const char* message) : mMessage(message) {}
+        virtual ~msvc_exception() {}
+
+        virtual const char* what() const { return mMessage.c_str(); }
+
+    private:
+        string mMessage;
+    };
+}
+
+#define exception msvc_exception
+
+#define __declspec(x) msvc_declspec_##x
+#define msvc_declspec_align(n) alignas(n)
+#define msvc_declspec_selectany __attribute__((weak))
+
+#ifdef __GXX_RTTI
+#define _CPPRTTI 1
+#endif
+
+template<size_t N>
+inline int sprintf_s(char (&buffer)[N], const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int result = vsnprintf(buffer, N, format, args);
+    va_end(args);
+    return result;
+}
+
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#define _MAX_DRIVE 3
+#define _MAX_DIR   256
+#define _MAX_FNAME 256
+#define _MAX_EXT   256
+
+// Truncate instead of invoking the invalid parameter handler.
+template<size_t N>
+inline int wcscpy_s(wchar_t (&dest)[N], const wchar_t* source)
+{
+    wcsncpy(dest, source, N - 1);
+    dest[N - 1] = 0;
+    return 0;
+}
+
+template<size_t N>
+inline int wcscat_s(wchar_t (&dest)[N], const wchar_t* source)
+{
+    size_t length = wcslen(dest);
+    wcsncpy(dest + length, source, N - 1 - length);
+    dest[N - 1] = 0;
+    return 0;
+}
+
+inline int _wcsicmp(const wchar_t* a, const wchar_t* b)
+{
+    for(;; ++a, ++b)
+    {
+        wint_t ca = towlower(*a), cb = towlower(*b);
+        if( ca != cb || !ca )
+            return (int)ca - (int)cb;
+    }
+}
+
+// Splits at the last separator (either slash) and the last dot after it.
+inline int _wsplitpath_s(const wchar_t* path, wchar_t* drive, size_t driveSize, wchar_t* dir, size_t dirSize,
+    wchar_t* fname, size_t fnameSize, wchar_t* ext, size_t extSize)
+{
+    auto copy = [](wchar_t* dest, size_t destSize, const wchar_t* begin, const wchar_t* end)
+    {
+        if( !dest || !destSize )
+            return;
+        size_t length = std::min<size_t>(end - begin, destSize - 1);
+        wmemcpy(dest, begin, length);
+        dest[length] = 0;
+    };
+
+    const wchar_t* end = path + wcslen(path);
+    const wchar_t* start = path[0] && path[1] == L':' ? path + 2 : path;
+    const wchar_t* name = start;
+    for(const wchar_t* p = start; p < end; ++p)
+    {
+        if( *p == L'\\' || *p == L'/' )
+            name = p + 1;
+    }
+    const wchar_t* dot = end;
+    for(const wchar_t* p = name; p < end; ++p)
+    {
+        if( *p == L'.' )
+            dot = p;
+    }
+
+    copy(drive, driveSize, path, start);
+    copy(dir, dirSize, start, name);
+    copy(fname, fnameSize, name, dot);
+    copy(ext, extSize, dot, end);
+    return 0;
+}
+
+#endif // TESTS_COMPAT_MSVCCOMPAT_H
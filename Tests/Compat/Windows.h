@@ -0,0 +1,185 @@
+//***************************************************************************************
+// Windows.h (test compat)
+//
+// The handful of Windows SDK types the device independent code uses, for building the
+// headless tests on other platforms.  Never on the include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_WINDOWS_H
+#define TESTS_COMPAT_WINDOWS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <sal.h>
+
+typedef unsigned char  BYTE;
+typedef uint8_t        UINT8;
+typedef unsigned short USHORT;
+typedef unsigned short WORD;
+typedef unsigned int   UINT;
+typedef uint32_t       DWORD;
+typedef int32_t        INT;
+typedef int32_t        LONG;
+typedef uint32_t       ULONG;
+typedef int64_t        INT64;
+typedef uint64_t       UINT64;
+typedef int            BOOL;
+typedef float          FLOAT;
+typedef void*          HANDLE;
+typedef LONG           HRESULT;
+typedef BYTE           BOOLEAN;
+typedef const wchar_t* LPCWSTR;
+typedef void*          PVOID;
+
+#define MAX_PATH 260
+
+union LARGE_INTEGER
+{
+    struct
+    {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    int64_t QuadPart;
+};
+
+struct RECT
+{
+    LONG left;
+    LONG top;
+    LONG right;
+    LONG bottom;
+};
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define S_OK          ((HRESULT)0)
+#define E_FAIL        ((HRESULT)0x80004005)
+#define E_INVALIDARG  ((HRESULT)0x80070057)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_POINTER     ((HRESULT)0x80004003)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)    (((HRESULT)(hr)) < 0)
+
+#ifndef __cdecl
+#define __cdecl
+#endif
+
+#define CALLBACK
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+#define ZeroMemory(dest, size) memset((dest), 0, (size))
+#define MemoryBarrier() __sync_synchronize()
+
+// Only referenced by PlatformHelpers.h's deleters, which nothing built here uses.
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define MEM_RELEASE 0x8000
+inline BOOL CloseHandle(HANDLE) { return FALSE; }
+inline BOOL VirtualFree(void*, size_t, DWORD) { return FALSE; }
+
+// Only referenced by LoaderHelpers.h's file reading and deleting and by
+// BinaryReader::ReadEntireFile, which nothing built here uses either; every call fails.
+#define GENERIC_READ          0x80000000
+#define FILE_SHARE_READ       0x1
+#define OPEN_EXISTING         3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0xFFFF) | 0x80070000))
+
+enum FILE_INFO_BY_HANDLE_CLASS
+{
+    FileStandardInfo    = 1,
+    FileDispositionInfo = 4,
+};
+
+struct FILE_STANDARD_INFO
+{
+    LARGE_INTEGER AllocationSize;
+    LARGE_INTEGER EndOfFile;
+    DWORD NumberOfLinks;
+    BOOLEAN DeletePending;
+    BOOLEAN Directory;
+};
+
+struct FILE_DISPOSITION_INFO
+{
+    BOOLEAN DeleteFile;
+};
+
+inline DWORD GetLastError() { return 1; }
+inline HANDLE CreateFile2(LPCWSTR, DWORD, DWORD, DWORD, void*) { return INVALID_HANDLE_VALUE; }
+inline HANDLE CreateFileW(LPCWSTR, DWORD, DWORD, void*, DWORD, DWORD, HANDLE) { return INVALID_HANDLE_VALUE; }
+inline BOOL GetFileInformationByHandleEx(HANDLE, FILE_INFO_BY_HANDLE_CLASS, void*, DWORD) { return FALSE; }
+inline BOOL SetFileInformationByHandle(HANDLE, FILE_INFO_BY_HANDLE_CLASS, void*, DWORD) { return FALSE; }
+inline BOOL ReadFile(HANDLE, void*, DWORD, DWORD*, void*) { return FALSE; }
+inline BOOL DeleteFileW(LPCWSTR) { return FALSE; }
+
+// Only referenced by the effect factories' texture loading, which the tests never reach.
+enum GET_FILEEX_INFO_LEVELS
+{
+    GetFileExInfoStandard = 0,
+};
+
+struct FILETIME
+{
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+};
+
+struct WIN32_FILE_ATTRIBUTE_DATA
+{
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+};
+
+inline BOOL GetFileAttributesExW(LPCWSTR, GET_FILEEX_INFO_LEVELS, void*) { return FALSE; }
+
+// One-time initialization, as the model loaders use it for their shared vertex
+// declarations.
+struct INIT_ONCE
+{
+    std::once_flag Flag;
+    BOOL Result;
+};
+typedef INIT_ONCE* PINIT_ONCE;
+typedef BOOL (CALLBACK* PINIT_ONCE_FN)(PINIT_ONCE, PVOID, PVOID*);
+#define INIT_ONCE_STATIC_INIT {}
+
+inline BOOL InitOnceExecuteOnce(PINIT_ONCE initOnce, PINIT_ONCE_FN fn, PVOID parameter, PVOID* context)
+{
+    std::call_once(initOnce->Flag, [&]{ initOnce->Result = fn(initOnce, parameter, context); });
+    return initOnce->Result;
+}
+
+// The ANSI code page taken as Latin-1, which covers the ASCII names the model
+// loaders convert.  Like Windows, a source longer than the buffer fills it without a
+// terminator and returns 0.
+#define CP_ACP         0
+#define MB_PRECOMPOSED 0x1
+
+inline int MultiByteToWideChar(UINT, DWORD, const char* source, int sourceLength, wchar_t* dest, int destLength)
+{
+    size_t length = sourceLength < 0 ? strlen(source) + 1 : (size_t)sourceLength;
+    if( destLength == 0 )
+        return (int)length;
+
+    for(size_t i = 0; i < length; ++i)
+    {
+        if( i == (size_t)destLength )
+            return 0;
+        dest[i] = (wchar_t)(unsigned char)source[i];
+    }
+    return (int)length;
+}
+
+#endif // TESTS_COMPAT_WINDOWS_H
@@ -0,0 +1,609 @@
+//***************************************************************************************
+// d3d11_1.h (test compat)
+//
+// A stub Direct3D 11 device for the headless tests.  It declares what VertexTypes.h,
+// CommonStates, SpriteBatch and TextureCache use, and implements just enough of it to
+// run them: buffers keep their contents in system memory, Map and UpdateSubresource
+// write to that copy, and the context remembers what is bound and counts what it is
+// asked to draw.  Nothing is rasterized.  Never on the include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_D3D11_1_H
+#define TESTS_COMPAT_D3D11_1_H
+
+#include "Windows.h"
+#include "dxgiformat.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+enum DXGI_MODE_ROTATION
+{
+    DXGI_MODE_ROTATION_UNSPECIFIED = 0,
+    DXGI_MODE_ROTATION_IDENTITY    = 1,
+    DXGI_MODE_ROTATION_ROTATE90    = 2,
+    DXGI_MODE_ROTATION_ROTATE180   = 3,
+    DXGI_MODE_ROTATION_ROTATE270   = 4,
+};
+
+struct DXGI_SAMPLE_DESC
+{
+    UINT Count;
+    UINT Quality;
+};
+
+enum D3D_FEATURE_LEVEL
+{
+    D3D_FEATURE_LEVEL_9_1  = 0x9100,
+    D3D_FEATURE_LEVEL_9_2  = 0x9200,
+    D3D_FEATURE_LEVEL_9_3  = 0x9300,
+    D3D_FEATURE_LEVEL_10_0 = 0xa000,
+    D3D_FEATURE_LEVEL_10_1 = 0xa100,
+    D3D_FEATURE_LEVEL_11_0 = 0xb000,
+    D3D_FEATURE_LEVEL_11_1 = 0xb100,
+};
+
+enum D3D11_USAGE
+{
+    D3D11_USAGE_DEFAULT   = 0,
+    D3D11_USAGE_IMMUTABLE = 1,
+    D3D11_USAGE_DYNAMIC   = 2,
+    D3D11_USAGE_STAGING   = 3,
+};
+
+enum D3D11_BIND_FLAG
+{
+    D3D11_BIND_VERTEX_BUFFER   = 0x1,
+    D3D11_BIND_INDEX_BUFFER    = 0x2,
+    D3D11_BIND_CONSTANT_BUFFER = 0x4,
+    D3D11_BIND_SHADER_RESOURCE = 0x8,
+};
+
+enum D3D11_CPU_ACCESS_FLAG
+{
+    D3D11_CPU_ACCESS_WRITE = 0x10000,
+    D3D11_CPU_ACCESS_READ  = 0x20000,
+};
+
+enum D3D11_MAP
+{
+    D3D11_MAP_READ               = 1,
+    D3D11_MAP_WRITE              = 2,
+    D3D11_MAP_READ_WRITE         = 3,
+    D3D11_MAP_WRITE_DISCARD      = 4,
+    D3D11_MAP_WRITE_NO_OVERWRITE = 5,
+};
+
+enum D3D11_DEVICE_CONTEXT_TYPE
+{
+    D3D11_DEVICE_CONTEXT_IMMEDIATE = 0,
+    D3D11_DEVICE_CONTEXT_DEFERRED  = 1,
+};
+
+enum D3D_PRIMITIVE_TOPOLOGY
+{
+    D3D_PRIMITIVE_TOPOLOGY_UNDEFINED              = 0,
+    D3D_PRIMITIVE_TOPOLOGY_POINTLIST              = 1,
+    D3D_PRIMITIVE_TOPOLOGY_LINELIST               = 2,
+    D3D_PRIMITIVE_TOPOLOGY_LINESTRIP              = 3,
+    D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST           = 4,
+    D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP          = 5,
+    D3D_PRIMITIVE_TOPOLOGY_LINELIST_ADJ           = 10,
+    D3D_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ          = 11,
+    D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ       = 12,
+    D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP_ADJ      = 13,
+    D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED            = 0,
+    D3D11_PRIMITIVE_TOPOLOGY_POINTLIST            = 1,
+    D3D11_PRIMITIVE_TOPOLOGY_LINELIST             = 2,
+    D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP            = 3,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST         = 4,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP        = 5,
+    D3D11_PRIMITIVE_TOPOLOGY_LINELIST_ADJ         = 10,
+    D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ        = 11,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ     = 12,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP_ADJ    = 13,
+};
+typedef D3D_PRIMITIVE_TOPOLOGY D3D11_PRIMITIVE_TOPOLOGY;
+
+enum D3D11_INPUT_CLASSIFICATION
+{
+    D3D11_INPUT_PER_VERTEX_DATA   = 0,
+    D3D11_INPUT_PER_INSTANCE_DATA = 1,
+};
+
+#define D3D11_APPEND_ALIGNED_ELEMENT     0xffffffff
+#define D3D11_DEFAULT_STENCIL_READ_MASK  0xff
+#define D3D11_DEFAULT_STENCIL_WRITE_MASK 0xff
+#define D3D11_MAX_MAXANISOTROPY          16
+
+enum D3D11_RESOURCE_DIMENSION
+{
+    D3D11_RESOURCE_DIMENSION_UNKNOWN   = 0,
+    D3D11_RESOURCE_DIMENSION_BUFFER    = 1,
+    D3D11_RESOURCE_DIMENSION_TEXTURE1D = 2,
+    D3D11_RESOURCE_DIMENSION_TEXTURE2D = 3,
+    D3D11_RESOURCE_DIMENSION_TEXTURE3D = 4,
+};
+
+enum D3D11_SRV_DIMENSION
+{
+    D3D11_SRV_DIMENSION_UNKNOWN   = 0,
+    D3D11_SRV_DIMENSION_BUFFER    = 1,
+    D3D11_SRV_DIMENSION_TEXTURE1D = 2,
+    D3D11_SRV_DIMENSION_TEXTURE2D = 4,
+    D3D11_SRV_DIMENSION_TEXTURE3D = 8,
+};
+
+enum D3D11_BLEND
+{
+    D3D11_BLEND_ZERO          = 1,
+    D3D11_BLEND_ONE           = 2,
+    D3D11_BLEND_SRC_ALPHA     = 5,
+    D3D11_BLEND_INV_SRC_ALPHA = 6,
+};
+
+enum D3D11_BLEND_OP
+{
+    D3D11_BLEND_OP_ADD = 1,
+};
+
+enum D3D11_COLOR_WRITE_ENABLE
+{
+    D3D11_COLOR_WRITE_ENABLE_ALL = 0xf,
+};
+
+enum D3D11_COMPARISON_FUNC
+{
+    D3D11_COMPARISON_NEVER      = 1,
+    D3D11_COMPARISON_LESS_EQUAL = 4,
+    D3D11_COMPARISON_ALWAYS     = 8,
+};
+
+enum D3D11_DEPTH_WRITE_MASK
+{
+    D3D11_DEPTH_WRITE_MASK_ZERO = 0,
+    D3D11_DEPTH_WRITE_MASK_ALL  = 1,
+};
+
+enum D3D11_STENCIL_OP
+{
+    D3D11_STENCIL_OP_KEEP = 1,
+};
+
+enum D3D11_FILL_MODE
+{
+    D3D11_FILL_WIREFRAME = 2,
+    D3D11_FILL_SOLID     = 3,
+};
+
+enum D3D11_CULL_MODE
+{
+    D3D11_CULL_NONE  = 1,
+    D3D11_CULL_FRONT = 2,
+    D3D11_CULL_BACK  = 3,
+};
+
+enum D3D11_FILTER
+{
+    D3D11_FILTER_MIN_MAG_MIP_POINT  = 0,
+    D3D11_FILTER_MIN_MAG_MIP_LINEAR = 0x15,
+    D3D11_FILTER_ANISOTROPIC        = 0x55,
+};
+
+enum D3D11_TEXTURE_ADDRESS_MODE
+{
+    D3D11_TEXTURE_ADDRESS_WRAP  = 1,
+    D3D11_TEXTURE_ADDRESS_CLAMP = 3,
+};
+
+struct D3D11_INPUT_ELEMENT_DESC
+{
+    const char* SemanticName;
+    UINT SemanticIndex;
+    DXGI_FORMAT Format;
+    UINT InputSlot;
+    UINT AlignedByteOffset;
+    D3D11_INPUT_CLASSIFICATION InputSlotClass;
+    UINT InstanceDataStepRate;
+};
+
+struct D3D11_BUFFER_DESC
+{
+    UINT ByteWidth;
+    D3D11_USAGE Usage;
+    UINT BindFlags;
+    UINT CPUAccessFlags;
+    UINT MiscFlags;
+    UINT StructureByteStride;
+};
+
+struct D3D11_TEXTURE1D_DESC
+{
+    UINT Width;
+    UINT MipLevels;
+    UINT ArraySize;
+    DXGI_FORMAT Format;
+    D3D11_USAGE Usage;
+    UINT BindFlags;
+    UINT CPUAccessFlags;
+    UINT MiscFlags;
+};
+
+struct D3D11_TEXTURE2D_DESC
+{
+    UINT Width;
+    UINT Height;
+    UINT MipLevels;
+    UINT ArraySize;
+    DXGI_FORMAT Format;
+    DXGI_SAMPLE_DESC SampleDesc;
+    D3D11_USAGE Usage;
+    UINT BindFlags;
+    UINT CPUAccessFlags;
+    UINT MiscFlags;
+};
+
+struct D3D11_TEXTURE3D_DESC
+{
+    UINT Width;
+    UINT Height;
+    UINT Depth;
+    UINT MipLevels;
+    DXGI_FORMAT Format;
+    D3D11_USAGE Usage;
+    UINT BindFlags;
+    UINT CPUAccessFlags;
+    UINT MiscFlags;
+};
+
+struct D3D11_TEX2D_SRV
+{
+    UINT MostDetailedMip;
+    UINT MipLevels;
+};
+
+// Only the 2D member of the real union.
+struct D3D11_SHADER_RESOURCE_VIEW_DESC
+{
+    DXGI_FORMAT Format;
+    D3D11_SRV_DIMENSION ViewDimension;
+    D3D11_TEX2D_SRV Texture2D;
+};
+
+struct D3D11_SUBRESOURCE_DATA
+{
+    const void* pSysMem;
+    UINT SysMemPitch;
+    UINT SysMemSlicePitch;
+};
+
+struct D3D11_MAPPED_SUBRESOURCE
+{
+    void* pData;
+    UINT RowPitch;
+    UINT DepthPitch;
+};
+
+struct D3D11_BOX
+{
+    UINT left;
+    UINT top;
+    UINT front;
+    UINT right;
+    UINT bottom;
+    UINT back;
+};
+
+struct D3D11_VIEWPORT
+{
+    FLOAT TopLeftX;
+    FLOAT TopLeftY;
+    FLOAT Width;
+    FLOAT Height;
+    FLOAT MinDepth;
+    FLOAT MaxDepth;
+};
+
+struct D3D11_RENDER_TARGET_BLEND_DESC
+{
+    BOOL BlendEnable;
+    D3D11_BLEND SrcBlend;
+    D3D11_BLEND DestBlend;
+    D3D11_BLEND_OP BlendOp;
+    D3D11_BLEND SrcBlendAlpha;
+    D3D11_BLEND DestBlendAlpha;
+    D3D11_BLEND_OP BlendOpAlpha;
+    UINT8 RenderTargetWriteMask;
+};
+
+struct D3D11_BLEND_DESC
+{
+    BOOL AlphaToCoverageEnable;
+    BOOL IndependentBlendEnable;
+    D3D11_RENDER_TARGET_BLEND_DESC RenderTarget[8];
+};
+
+struct D3D11_DEPTH_STENCILOP_DESC
+{
+    D3D11_STENCIL_OP StencilFailOp;
+    D3D11_STENCIL_OP StencilDepthFailOp;
+    D3D11_STENCIL_OP StencilPassOp;
+    D3D11_COMPARISON_FUNC StencilFunc;
+};
+
+struct D3D11_DEPTH_STENCIL_DESC
+{
+    BOOL DepthEnable;
+    D3D11_DEPTH_WRITE_MASK DepthWriteMask;
+    D3D11_COMPARISON_FUNC DepthFunc;
+    BOOL StencilEnable;
+    UINT8 StencilReadMask;
+    UINT8 StencilWriteMask;
+    D3D11_DEPTH_STENCILOP_DESC FrontFace;
+    D3D11_DEPTH_STENCILOP_DESC BackFace;
+};
+
+struct D3D11_RASTERIZER_DESC
+{
+    D3D11_FILL_MODE FillMode;
+    D3D11_CULL_MODE CullMode;
+    BOOL FrontCounterClockwise;
+    INT DepthBias;
+    FLOAT DepthBiasClamp;
+    FLOAT SlopeScaledDepthBias;
+    BOOL DepthClipEnable;
+    BOOL ScissorEnable;
+    BOOL MultisampleEnable;
+    BOOL AntialiasedLineEnable;
+};
+
+struct D3D11_SAMPLER_DESC
+{
+    D3D11_FILTER Filter;
+    D3D11_TEXTURE_ADDRESS_MODE AddressU;
+    D3D11_TEXTURE_ADDRESS_MODE AddressV;
+    D3D11_TEXTURE_ADDRESS_MODE AddressW;
+    FLOAT MipLODBias;
+    UINT MaxAnisotropy;
+    D3D11_COMPARISON_FUNC ComparisonFunc;
+    FLOAT BorderColor[4];
+    FLOAT MinLOD;
+    FLOAT MaxLOD;
+};
+
+// Reference counted base of every interface.  Objects are plain C++ and are deleted by
+// their last Release.
+struct IUnknown
+{
+    IUnknown() : mRefCount(1) {}
+    virtual ~IUnknown() {}
+
+    ULONG AddRef() { return ++mRefCount; }
+    ULONG Release()
+    {
+        ULONG count = --mRefCount;
+        if( count == 0 )
+            delete this;
+        return count;
+    }
+
+private:
+    std::atomic<ULONG> mRefCount;
+
+    IUnknown(const IUnknown&);
+    IUnknown& operator=(const IUnknown&);
+};
+
+struct ID3D11DeviceChild : IUnknown {};
+
+struct ID3D11Resource : ID3D11DeviceChild
+{
+    virtual D3D11_RESOURCE_DIMENSION Dimension()const = 0;
+    void GetType(D3D11_RESOURCE_DIMENSION* dimension) { *dimension = Dimension(); }
+};
+
+struct ID3D11Buffer : ID3D11Resource
+{
+    D3D11_RESOURCE_DIMENSION Dimension()const { return D3D11_RESOURCE_DIMENSION_BUFFER; }
+    void GetDesc(D3D11_BUFFER_DESC* desc) { *desc = Desc; }
+
+    // Stub only: the description and the buffer's contents.
+    D3D11_BUFFER_DESC Desc;
+    std::vector<BYTE> Contents;
+};
+
+struct ID3D11Texture1D : ID3D11Resource
+{
+    D3D11_RESOURCE_DIMENSION Dimension()const { return D3D11_RESOURCE_DIMENSION_TEXTURE1D; }
+    void GetDesc(D3D11_TEXTURE1D_DESC* desc) { *desc = Desc; }
+
+    // Stub only.
+    D3D11_TEXTURE1D_DESC Desc;
+};
+
+struct ID3D11Texture2D : ID3D11Resource
+{
+    D3D11_RESOURCE_DIMENSION Dimension()const { return D3D11_RESOURCE_DIMENSION_TEXTURE2D; }
+    void GetDesc(D3D11_TEXTURE2D_DESC* desc) { *desc = Desc; }
+
+    // Stub only.
+    D3D11_TEXTURE2D_DESC Desc;
+};
+
+struct ID3D11Texture3D : ID3D11Resource
+{
+    D3D11_RESOURCE_DIMENSION Dimension()const { return D3D11_RESOURCE_DIMENSION_TEXTURE3D; }
+    void GetDesc(D3D11_TEXTURE3D_DESC* desc) { *desc = Desc; }
+
+    // Stub only.
+    D3D11_TEXTURE3D_DESC Desc;
+};
+
+struct ID3D11ShaderResourceView : ID3D11DeviceChild
+{
+    explicit ID3D11ShaderResourceView(ID3D11Resource* resource) : Resource(resource) { Resource->AddRef(); }
+    ~ID3D11ShaderResourceView() { Resource->Release(); }
+
+    void GetResource(ID3D11Resource** resource) { Resource->AddRef(); *resource = Resource; }
+
+    // Stub only: the viewed resource, referenced by the view.
+    ID3D11Resource* Resource;
+};
+
+struct ID3D11VertexShader : ID3D11DeviceChild {};
+struct ID3D11PixelShader : ID3D11DeviceChild {};
+struct ID3D11InputLayout : ID3D11DeviceChild {};
+struct ID3D11BlendState : ID3D11DeviceChild {};
+struct ID3D11DepthStencilState : ID3D11DeviceChild {};
+struct ID3D11RasterizerState : ID3D11DeviceChild {};
+struct ID3D11SamplerState : ID3D11DeviceChild {};
+struct ID3D11ClassLinkage;
+struct ID3D11ClassInstance;
+
+struct ID3D11Device : IUnknown
+{
+    ID3D11Device() : FeatureLevel(D3D_FEATURE_LEVEL_11_0) {}
+
+    D3D_FEATURE_LEVEL GetFeatureLevel() { return FeatureLevel; }
+
+    HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer)
+    {
+        ID3D11Buffer* b = new ID3D11Buffer;
+        b->Desc = *desc;
+        b->Contents.resize(desc->ByteWidth);
+        if( initialData )
+            memcpy(b->Contents.data(), initialData->pSysMem, desc->ByteWidth);
+        *buffer = b;
+        return S_OK;
+    }
+
+    // Textures have no contents, only their description.
+    HRESULT CreateTexture1D(const D3D11_TEXTURE1D_DESC* desc, const D3D11_SUBRESOURCE_DATA*, ID3D11Texture1D** texture)
+    {
+        ID3D11Texture1D* t = new ID3D11Texture1D;
+        t->Desc = *desc;
+        *texture = t;
+        return S_OK;
+    }
+
+    HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA*, ID3D11Texture2D** texture)
+    {
+        ID3D11Texture2D* t = new ID3D11Texture2D;
+        t->Desc = *desc;
+        *texture = t;
+        return S_OK;
+    }
+
+    HRESULT CreateTexture3D(const D3D11_TEXTURE3D_DESC* desc, const D3D11_SUBRESOURCE_DATA*, ID3D11Texture3D** texture)
+    {
+        ID3D11Texture3D* t = new ID3D11Texture3D;
+        t->Desc = *desc;
+        *texture = t;
+        return S_OK;
+    }
+
+    HRESULT CreateShaderResourceView(ID3D11Resource* resource, const D3D11_SHADER_RESOURCE_VIEW_DESC*, ID3D11ShaderResourceView** view)
+    {
+        *view = new ID3D11ShaderResourceView(resource);
+        return S_OK;
+    }
+
+    HRESULT CreateVertexShader(const void*, size_t, ID3D11ClassLinkage*, ID3D11VertexShader** shader) { *shader = new ID3D11VertexShader; return S_OK; }
+    HRESULT CreatePixelShader(const void*, size_t, ID3D11ClassLinkage*, ID3D11PixelShader** shader) { *shader = new ID3D11PixelShader; return S_OK; }
+    HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC*, UINT, const void*, size_t, ID3D11InputLayout** layout) { *layout = new ID3D11InputLayout; return S_OK; }
+    HRESULT CreateBlendState(const D3D11_BLEND_DESC*, ID3D11BlendState** state) { *state = new ID3D11BlendState; return S_OK; }
+    HRESULT CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC*, ID3D11DepthStencilState** state) { *state = new ID3D11DepthStencilState; return S_OK; }
+    HRESULT CreateRasterizerState(const D3D11_RASTERIZER_DESC*, ID3D11RasterizerState** state) { *state = new ID3D11RasterizerState; return S_OK; }
+    HRESULT CreateSamplerState(const D3D11_SAMPLER_DESC*, ID3D11SamplerState** state) { *state = new ID3D11SamplerState; return S_OK; }
+
+    // Stub only.
+    D3D_FEATURE_LEVEL FeatureLevel;
+};
+
+// Remembers the buffers, index format and texture bound for drawing, and counts draws
+// and uploads.  Bindings are not reference counted, so they must not outlive the
+// objects bound.
+struct ID3D11DeviceContext : IUnknown
+{
+    typedef std::function<void(ID3D11DeviceContext* context, UINT indexCount, UINT startIndex, INT baseVertex)> DrawFn;
+
+    explicit ID3D11DeviceContext(ID3D11Device* device)
+    : Device(device), Type(D3D11_DEVICE_CONTEXT_IMMEDIATE),
+      VertexBuffer(0), IndexBuffer(0), IndexFormat(DXGI_FORMAT_UNKNOWN), Texture(0),
+      Viewport(), NumDraws(0), NumIndices(0), NumMaps(0), NumUpdates(0), UpdateBytes(0)
+    {
+        Device->AddRef();
+        Viewport.Width = 1920.0f;
+        Viewport.Height = 1080.0f;
+        Viewport.MaxDepth = 1.0f;
+    }
+    ~ID3D11DeviceContext() { Device->Release(); }
+
+    void GetDevice(ID3D11Device** device) { Device->AddRef(); *device = Device; }
+    D3D11_DEVICE_CONTEXT_TYPE GetType() { return Type; }
+
+    HRESULT Map(ID3D11Resource* resource, UINT, D3D11_MAP, UINT, D3D11_MAPPED_SUBRESOURCE* mapped)
+    {
+        ID3D11Buffer* buffer = static_cast<ID3D11Buffer*>(resource);
+        mapped->pData = buffer->Contents.data();
+        mapped->RowPitch = buffer->Desc.ByteWidth;
+        mapped->DepthPitch = buffer->Desc.ByteWidth;
+        ++NumMaps;
+        return S_OK;
+    }
+    void Unmap(ID3D11Resource*, UINT) {}
+
+    void UpdateSubresource(ID3D11Resource* resource, UINT, const D3D11_BOX* box, const void* data, UINT, UINT)
+    {
+        ID3D11Buffer* buffer = static_cast<ID3D11Buffer*>(resource);
+        UINT left = box ? box->left : 0;
+        UINT right = box ? box->right : buffer->Desc.ByteWidth;
+        if( left > right || right > buffer->Desc.ByteWidth )
+            abort();
+        memcpy(buffer->Contents.data() + left, data, right - left);
+        ++NumUpdates;
+        UpdateBytes += right - left;
+    }
+
+    void IASetVertexBuffers(UINT, UINT, ID3D11Buffer* const* buffers, const UINT*, const UINT*) { VertexBuffer = buffers[0]; }
+    void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT) { IndexBuffer = buffer; IndexFormat = format; }
+    void IASetInputLayout(ID3D11InputLayout*) {}
+    void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) {}
+    void VSSetShader(ID3D11VertexShader*, ID3D11ClassInstance* const*, UINT) {}
+    void VSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*) {}
+    void PSSetShader(ID3D11PixelShader*, ID3D11ClassInstance* const*, UINT) {}
+    void PSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*) {}
+    void PSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const* views) { Texture = views[0]; }
+    void PSSetSamplers(UINT, UINT, ID3D11SamplerState* const*) {}
+    void OMSetBlendState(ID3D11BlendState*, const FLOAT*, UINT) {}
+    void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT) {}
+    void RSSetState(ID3D11RasterizerState*) {}
+    void RSGetViewports(UINT* count, D3D11_VIEWPORT* viewports) { *count = 1; viewports[0] = Viewport; }
+
+    void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+    {
+        ++NumDraws;
+        NumIndices += indexCount;
+        if( OnDrawIndexed )
+            OnDrawIndexed(this, indexCount, startIndex, baseVertex);
+    }
+
+    // Stub only.
+    ID3D11Device* Device;
+    D3D11_DEVICE_CONTEXT_TYPE Type;
+    ID3D11Buffer* VertexBuffer;
+    ID3D11Buffer* IndexBuffer;
+    DXGI_FORMAT IndexFormat;
+    ID3D11ShaderResourceView* Texture;
+    D3D11_VIEWPORT Viewport;
+    DrawFn OnDrawIndexed;
+    UINT64 NumDraws;
+    UINT64 NumIndices;
+    UINT64 NumMaps;
+    UINT64 NumUpdates;
+    UINT64 UpdateBytes;
+};
+
+#endif // TESTS_COMPAT_D3D11_1_H
@@ -0,0 +1,39 @@
+//***************************************************************************************
+// intrin.h (test compat)
+//
+// The Microsoft CPUID and XGETBV intrinsics, for the runtime feature checks under test.
+// The vector intrinsics come from the compiler's immintrin.h.  Never on the include path
+// of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_INTRIN_H
+#define TESTS_COMPAT_INTRIN_H
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+// cpuid.h defines a __cpuid macro with a different signature.
+#undef __cpuid
+
+inline void __cpuid(int info[4], int function)
+{
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    __get_cpuid((unsigned int)function, &a, &b, &c, &d);
+    info[0] = (int)a;
+    info[1] = (int)b;
+    info[2] = (int)c;
+    info[3] = (int)d;
+}
+
+// MSVC's _xgetbv can be called from code built without XSAVE enabled, as the AVX check
+// must be; GCC's cannot.
+#define _xgetbv TestsCompatXgetbv
+
+inline unsigned long long TestsCompatXgetbv(unsigned int index)
+{
+    unsigned int eax = 0, edx = 0;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+    return ((unsigned long long)edx << 32) | eax;
+}
+
+#endif // TESTS_COMPAT_INTRIN_H
@@ -0,0 +1,27 @@
+//***************************************************************************************
+// malloc.h (test compat)
+//
+// Adds the Microsoft aligned allocation functions AlignedNew uses to the system
+// header.  Never on the include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_MALLOC_H
+#define TESTS_COMPAT_MALLOC_H
+
+#include_next <malloc.h>
+#include <cstdlib>
+#include <new>
+
+inline void* _aligned_malloc(size_t size, size_t alignment)
+{
+    void* ptr = 0;
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : 0;
+}
+
+// Kept out of line so GCC does not pair AlignedNew's operator new with free().
+__attribute__((noinline)) inline void _aligned_free(void* ptr)
+{
+    free(ptr);
+}
+
+#endif // TESTS_COMPAT_MALLOC_H
@@ -0,0 +1,30 @@
+//***************************************************************************************
+// sal.h (test compat)
+//
+// The source annotations used by the code under test, which only the Microsoft
+// compiler checks.  Never on the include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_SAL_H
+#define TESTS_COMPAT_SAL_H
+
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_opt_z_
+#define _Printf_format_string_
+#define _In_reads_(n)
+#define _In_reads_bytes_(n)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(n)
+#define _Out_writes_all_(n)
+#define _Outptr_
+#define _Outptr_opt_
+#define _Outptr_result_maybenull_
+#define _Inout_
+#define _Inout_updates_(n)
+#define _Use_decl_annotations_
+#define _Analysis_assume_(expr)
+
+#endif // TESTS_COMPAT_SAL_H
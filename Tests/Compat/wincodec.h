@@ -0,0 +1,16 @@
+//***************************************************************************************
+// wincodec.h (test compat)
+//
+// Included by DirectXTK's pch.h; only the WIC loader uses it, and that is not built
+// here.  LoaderHelpers.h names IWICStream in a helper nothing built here calls.
+// Never on the include path of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_WINCODEC_H
+#define TESTS_COMPAT_WINCODEC_H
+
+#include <d3d11_1.h>
+
+struct IWICStream : IUnknown {};
+
+#endif // TESTS_COMPAT_WINCODEC_H
@@ -0,0 +1,107 @@
+//***************************************************************************************
+// wrl.h (test compat)
+//
+// Microsoft::WRL::ComPtr for the stub device in d3d11_1.h.  Never on the include path
+// of a Windows build.
+//***************************************************************************************
+
+#ifndef TESTS_COMPAT_WRL_H
+#define TESTS_COMPAT_WRL_H
+
+#include "Windows.h"
+#include <cstddef>
+
+namespace Microsoft
+{
+namespace WRL
+{
+    template<class T> class ComPtr;
+
+    namespace Details
+    {
+        // What &ptr gives for a ComPtr: an out parameter for a raw pointer, releasing
+        // the old one first, or the ComPtr itself for As().
+        template<class C>
+        class ComPtrRef
+        {
+        public:
+            explicit ComPtrRef(C* ptr) : mPtr(ptr) {}
+
+            operator typename C::InterfaceType**() { return mPtr->ReleaseAndGetAddressOf(); }
+            operator C*() { return mPtr; }
+            C* Get()const { return mPtr; }
+
+        private:
+            C* mPtr;
+        };
+    }
+
+    template<class T>
+    class ComPtr
+    {
+    public:
+        typedef T InterfaceType;
+
+        ComPtr() : mPtr(0) {}
+        ComPtr(std::nullptr_t) : mPtr(0) {}
+        ComPtr(T* ptr) : mPtr(ptr) { if( mPtr ) mPtr->AddRef(); }
+        ComPtr(const ComPtr& rhs) : mPtr(rhs.mPtr) { if( mPtr ) mPtr->AddRef(); }
+        ComPtr(ComPtr&& rhs) : mPtr(rhs.mPtr) { rhs.mPtr = 0; }
+        ~ComPtr() { Reset(); }
+
+        ComPtr& operator=(const ComPtr& rhs) { ComPtr(rhs).Swap(*this); return *this; }
+        ComPtr& operator=(ComPtr&& rhs) { ComPtr(static_cast<ComPtr&&>(rhs)).Swap(*this); return *this; }
+        ComPtr& operator=(T* ptr) { ComPtr(ptr).Swap(*this); return *this; }
+        ComPtr& operator=(std::nullptr_t) { Reset(); return *this; }
+
+        T* Get()const { return mPtr; }
+        T* operator->()const { return mPtr; }
+        explicit operator bool()const { return mPtr != 0; }
+
+        T* const* GetAddressOf()const { return &mPtr; }
+        T** GetAddressOf() { return &mPtr; }
+        T** ReleaseAndGetAddressOf() { Reset(); return &mPtr; }
+        Details::ComPtrRef<ComPtr> operator&() { return Details::ComPtrRef<ComPtr>(this); }
+
+        ULONG Reset()
+        {
+            ULONG count = 0;
+            if( mPtr )
+            {
+                T* ptr = mPtr;
+                mPtr = 0;
+                count = ptr->Release();
+            }
+            return count;
+        }
+
+        T* Detach() { T* ptr = mPtr; mPtr = 0; return ptr; }
+        void Attach(T* ptr) { Reset(); mPtr = ptr; }
+        void Swap(ComPtr& rhs) { T* ptr = mPtr; mPtr = rhs.mPtr; rhs.mPtr = ptr; }
+
+        // QueryInterface is a dynamic_cast here.
+        template<class U>
+        HRESULT As(Details::ComPtrRef<ComPtr<U> > ptr)const
+        {
+            U* other = dynamic_cast<U*>(mPtr);
+            if( !other )
+                return E_NOINTERFACE;
+            *ptr.Get() = other;
+            return S_OK;
+        }
+
+        HRESULT CopyTo(T** ptr)const
+        {
+            if( mPtr )
+                mPtr->AddRef();
+            *ptr = mPtr;
+            return S_OK;
+        }
+
+    private:
+        T* mPtr;
+    };
+}
+}
+
+#endif // TESTS_COMPAT_WRL_H
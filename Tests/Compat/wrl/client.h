@@ -0,0 +1,5 @@
+//***************************************************************************************
+// wrl/client.h (test compat)
+//***************************************************************************************
+
+#include "../wrl.h"
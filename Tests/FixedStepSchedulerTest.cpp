@@ -0,0 +1,177 @@
+//***************************************************************************************
+// FixedStepSchedulerTest.cpp
+//
+// Drives GameTimer from a ManualClock and feeds its frame times to FixedStepScheduler,
+// the way D3DApp::Run does: checks the step count and interpolation factor at several
+// frame rates, the catch-up limit on a long stall, and paused time.
+//***************************************************************************************
+
+#include "Clock.h"
+#include "FixedStepScheduler.h"
+#include "GameTimer.h"
+#include "TestUtil.h"
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+	const float Step = 1.0f/60.0f;
+	const unsigned int MaxSteps = 5;
+
+	// The spin of SnowSceneApp's box: stepped at the fixed rate, blended for drawing.
+	struct Spin
+	{
+		float Angle;
+		float PrevAngle;
+
+		Spin() : Angle(0.0f), PrevAngle(0.0f) {}
+
+		void Step(float dt)
+		{
+			PrevAngle = Angle;
+			Angle += dt;
+		}
+
+		float Blend(float alpha)const
+		{
+			return PrevAngle + alpha*(Angle - PrevAngle);
+		}
+	};
+
+	struct RunResult
+	{
+		unsigned long long Steps;
+		float MaxLagError;
+		bool AlphaInRange;
+		bool StepsInRange;
+	};
+
+	// Runs for the given time at a fixed frame rate.  With no time dropped the blended
+	// angle trails the timer by exactly one step.
+	RunResult Run(double frameRate, double seconds)
+	{
+		ManualClock clock(123456789);
+		GameTimer timer(&clock);
+		FixedStepScheduler simulation;
+		simulation.Init(Step, MaxSteps);
+		Spin spin;
+
+		RunResult result;
+		result.Steps = 0;
+		result.MaxLagError = 0.0f;
+		result.AlphaInRange = true;
+		result.StepsInRange = true;
+
+		timer.Reset();
+		int frames = (int)(seconds*frameRate + 0.5);
+		for(int i = 0; i < frames; ++i)
+		{
+			clock.AdvanceSeconds(1.0/frameRate);
+			timer.Tick();
+
+			unsigned int steps = simulation.Advance(timer.DeltaTime(), [&spin](float dt) { spin.Step(dt); });
+			float alpha = simulation.GetAlpha();
+
+			result.AlphaInRange = result.AlphaInRange && alpha >= 0.0f && alpha < 1.0f;
+			result.StepsInRange = result.StepsInRange && steps <= (unsigned int)ceil((1.0/frameRate)/Step) + 1;
+
+			if( simulation.GetStepCount() > 0 )
+			{
+				float expected = timer.TotalTime() - Step;
+				float error = fabsf(spin.Blend(alpha) - expected);
+				result.MaxLagError = error > result.MaxLagError ? error : result.MaxLagError;
+			}
+		}
+
+		result.Steps = simulation.GetStepCount();
+		return result;
+	}
+}
+
+int main()
+{
+	// GameTimer reads the injected clock.
+	{
+		ManualClock clock(5000000000ll);
+		GameTimer timer(&clock);
+		timer.Reset();
+
+		clock.AdvanceSeconds(0.016);
+		timer.Tick();
+		CHECK(fabsf(timer.DeltaTime() - 0.016f) < 1e-6f);
+		CHECK(fabsf(timer.TotalTime() - 0.016f) < 1e-6f);
+
+		// Paused time is not counted, and the first frame after it is short.
+		timer.Stop();
+		clock.AdvanceSeconds(3.0);
+		timer.Tick();
+		CHECK(timer.DeltaTime() == 0.0f);
+		timer.Start();
+		clock.AdvanceSeconds(0.010);
+		timer.Tick();
+		CHECK(fabsf(timer.DeltaTime() - 0.010f) < 1e-6f);
+		CHECK(fabsf(timer.TotalTime() - 0.026f) < 1e-6f);
+
+		// A clock that steps back gives a zero frame, not a negative one.
+		clock.Advance(-1000000);
+		timer.Tick();
+		CHECK(timer.DeltaTime() == 0.0f);
+	}
+
+	// The same ten seconds at different frame rates run the same steps, and the
+	// blended state is where the timer says it should be.
+	const double rates[] = { 24.0, 30.0, 59.94, 60.0, 75.0, 144.0, 240.0 };
+	unsigned long long expectedSteps = (unsigned long long)(10.0/Step);
+	for(size_t i = 0; i < sizeof(rates)/sizeof(rates[0]); ++i)
+	{
+		RunResult r = Run(rates[i], 10.0);
+		printf("%7.2f Hz: %llu steps, blended spin within %.2e of the timer\n", rates[i], r.Steps, r.MaxLagError);
+
+		CHECK(r.Steps + 1 >= expectedSteps && r.Steps <= expectedSteps + 1);
+		CHECK(r.MaxLagError < 1e-4f);
+		CHECK(r.AlphaInRange);
+		CHECK(r.StepsInRange);
+	}
+
+	// A one second stall runs the catch-up limit and drops the rest, keeping only
+	// the fraction of a step.
+	{
+		FixedStepScheduler simulation;
+		simulation.Init(Step, MaxSteps);
+		Spin spin;
+		unsigned int steps = simulation.Advance(1.0f + 0.25f*Step, [&spin](float dt) { spin.Step(dt); });
+
+		CHECK(steps == MaxSteps);
+		CHECK(simulation.GetStepCount() == MaxSteps);
+		CHECK(fabsf(simulation.GetAlpha() - 0.25f) < 1e-3f);
+		CHECK(fabs(simulation.GetDroppedTime() - (60 - MaxSteps)*(double)Step) < 1e-5);
+		CHECK(fabsf(spin.Angle - MaxSteps*Step) < 1e-6f);
+
+		// Simulated, dropped and leftover time add up to the frame time.
+		double total = simulation.GetSimulationTime() + simulation.GetDroppedTime() + simulation.GetAlpha()*Step;
+		CHECK(fabs(total - (1.0 + 0.25*Step)) < 1e-5);
+
+		// The next normal frame is not behind.
+		steps = simulation.Advance(Step, [&spin](float dt) { spin.Step(dt); });
+		CHECK(steps == 1);
+	}
+
+	// Frames shorter than a step run none until enough time has built up.
+	{
+		FixedStepScheduler simulation;
+		simulation.Init(Step, MaxSteps);
+		unsigned int calls = 0;
+		for(int i = 0; i < 3; ++i)
+			simulation.Advance(0.3f*Step, [&calls](float) { ++calls; });
+		CHECK(calls == 0);
+		CHECK(fabsf(simulation.GetAlpha() - 0.9f) < 1e-4f);
+		CHECK(simulation.Advance(0.3f*Step, [](float) {}) == 1);
+		CHECK(fabsf(simulation.GetAlpha() - 0.2f) < 1e-4f);
+
+		// Negative frame times are ignored.
+		CHECK(simulation.Advance(-1.0f, [](float) {}) == 0);
+		CHECK(fabsf(simulation.GetAlpha() - 0.2f) < 1e-4f);
+	}
+
+	return TestResult("FixedStepSchedulerTest");
+}
@@ -0,0 +1,213 @@
+//***************************************************************************************
+// GeometricPrimitiveTest.cpp
+//
+// Every built-in primitive must come out of GeometricPrimitive's geometry functions in
+// its generation order, and OptimizeMesh on it must keep the same triangles with the
+// same winding, use every vertex in first-use order, never raise the 16-entry FIFO
+// ACMR by more than the overdraw allowance, and lower it by at least 10% on the
+// curved shapes.  ComputeVertexCacheMissRate must agree with a plain FIFO simulation.
+// Also prints vertices, triangles, ACMR and ATVR for 16 and 32-entry FIFOs before and
+// after, and the time OptimizeMesh takes on each primitive.
+//***************************************************************************************
+
+#include <windows.h>
+#include <malloc.h>
+#include "GeometricPrimitive.h"
+#include "MeshOptimizer.h"
+#include "TestUtil.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	typedef GeometricPrimitive::VertexType Vertex;
+
+	struct Primitive
+	{
+		const char* Name;
+		void (*Create)(std::vector<Vertex>& vertices, std::vector<uint16_t>& indices);
+		bool Curved;	// shares vertices between many triangles, so reordering must pay off
+	};
+
+	const Primitive Primitives[] =
+	{
+		{ "cube",          [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateCube(v, i); }, false },
+		{ "box",           [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateBox(v, i, XMFLOAT3(1, 2, 3)); }, false },
+		{ "sphere 16",     [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateSphere(v, i, 1, 16); }, true },
+		{ "sphere 64",     [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateSphere(v, i, 1, 64); }, true },
+		{ "geosphere 3",   [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateGeoSphere(v, i, 1, 3); }, true },
+		{ "geosphere 5",   [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateGeoSphere(v, i, 1, 5); }, true },
+		{ "cylinder 32",   [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateCylinder(v, i, 1, 1, 32); }, false },
+		{ "cone 32",       [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateCone(v, i, 1, 1, 32); }, false },
+		{ "torus 32",      [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateTorus(v, i, 1, 0.333f, 32); }, true },
+		{ "torus 128",     [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateTorus(v, i, 1, 0.333f, 128); }, true },
+		{ "tetrahedron",   [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateTetrahedron(v, i); }, false },
+		{ "octahedron",    [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateOctahedron(v, i); }, false },
+		{ "dodecahedron",  [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateDodecahedron(v, i); }, false },
+		{ "icosahedron",   [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateIcosahedron(v, i); }, false },
+		{ "teapot 8",      [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateTeapot(v, i, 1, 8); }, true },
+		{ "teapot 16",     [](std::vector<Vertex>& v, std::vector<uint16_t>& i) { GeometricPrimitive::CreateTeapot(v, i, 1, 16); }, true },
+	};
+
+	// Misses in a FIFO cache of cacheSize entries, the textbook way.
+	size_t ReferenceMisses(const std::vector<uint16_t>& indices, size_t cacheSize)
+	{
+		std::deque<uint16_t> fifo;
+		size_t misses = 0;
+		for(size_t i = 0; i < indices.size(); ++i)
+		{
+			if( std::find(fifo.begin(), fifo.end(), indices[i]) != fifo.end() )
+				continue;
+			++misses;
+			fifo.push_back(indices[i]);
+			if( fifo.size() > cacheSize )
+				fifo.pop_front();
+		}
+		return misses;
+	}
+
+	size_t UsedVertices(const std::vector<uint16_t>& indices)
+	{
+		std::vector<uint16_t> sorted(indices);
+		std::sort(sorted.begin(), sorted.end());
+		return std::unique(sorted.begin(), sorted.end()) - sorted.begin();
+	}
+
+	struct MissRate
+	{
+		float Acmr;
+		float Atvr;
+	};
+
+	MissRate Measure(const char* name, const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices, size_t cacheSize)
+	{
+		MissRate rate;
+		ComputeVertexCacheMissRate(indices.data(), indices.size() / 3, vertices.size(), cacheSize, rate.Acmr, rate.Atvr);
+
+		size_t misses = ReferenceMisses(indices, cacheSize);
+		float acmr = float(misses) / float(indices.size() / 3);
+		float atvr = float(misses) / float(UsedVertices(indices));
+		if( rate.Acmr != acmr || rate.Atvr != atvr )
+		{
+			printf("  %s, FIFO %zu: ACMR %.4f ATVR %.4f, simulation gives %.4f %.4f\n", name, cacheSize, rate.Acmr,
+				rate.Atvr, acmr, atvr);
+		}
+		CHECK(rate.Acmr == acmr && rate.Atvr == atvr);
+		return rate;
+	}
+
+	// Each triangle as the bytes of its three vertices, rotated to start at the smallest
+	// so the winding is kept; sorted, so the order of the triangles does not matter.
+	std::vector<std::string> TriangleSet(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices)
+	{
+		std::vector<std::string> triangles;
+		for(size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			std::string corner[3];
+			for(int k = 0; k < 3; ++k)
+				corner[k].assign(reinterpret_cast<const char*>(&vertices[indices[t + k]]), sizeof(Vertex));
+			int first = (int)(std::min_element(corner, corner + 3) - corner);
+			triangles.push_back(corner[first] + corner[(first + 1) % 3] + corner[(first + 2) % 3]);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// True if each vertex is first used after every vertex numbered below it.
+	bool FirstUseOrder(const std::vector<uint16_t>& indices, size_t vertexCount)
+	{
+		size_t next = 0;
+		for(size_t i = 0; i < indices.size(); ++i)
+		{
+			if( indices[i] > next )
+				return false;
+			if( indices[i] == next )
+				++next;
+		}
+		return next == vertexCount;
+	}
+
+	// The generation order: rings of the sphere from the south pole up, and the first
+	// index of each quad on its lower ring.
+	void CheckDefaultOrder()
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint16_t> indices;
+		GeometricPrimitive::CreateSphere(vertices, indices, 1, 16);
+		CHECK(vertices.size() == 17*33);
+		bool rising = true;
+		for(size_t v = 1; v < vertices.size(); ++v)
+			rising = rising && vertices[v].position.y >= vertices[v - 1].position.y;
+		CHECK(rising);
+		CHECK(indices[0] == 0 && indices[1] == 33);
+
+		GeometricPrimitive::CreateTorus(vertices, indices, 1, 0.333f, 32);
+		CHECK(vertices.size() == 33*33);
+		CHECK(!FirstUseOrder(indices, vertices.size()));
+	}
+
+	void CheckPrimitive(const Primitive& primitive)
+	{
+		std::vector<Vertex> vertices, optimizedVertices;
+		std::vector<uint16_t> indices, optimizedIndices;
+		primitive.Create(vertices, indices);
+
+		// Best of several runs, each from a fresh copy of the generated geometry.
+		double best = 1e30;
+		for(int run = 0; run < 5; ++run)
+		{
+			optimizedVertices = vertices;
+			optimizedIndices = indices;
+			double t0 = TestSeconds();
+			OptimizeMesh(optimizedVertices, optimizedIndices);
+			best = std::min(best, TestSeconds() - t0);
+		}
+
+		bool inRange = true;
+		for(size_t i = 0; i < optimizedIndices.size(); ++i)
+			inRange = inRange && optimizedIndices[i] < optimizedVertices.size();
+		CHECK(inRange);
+		if( !inRange )
+			return;
+		CHECK(optimizedIndices.size() == indices.size());
+		CHECK(FirstUseOrder(optimizedIndices, optimizedVertices.size()));
+		bool sameTriangles = TriangleSet(vertices, indices) == TriangleSet(optimizedVertices, optimizedIndices);
+		if( !sameTriangles )
+			printf("  %s: OptimizeMesh changed the triangles\n", primitive.Name);
+		CHECK(sameTriangles);
+
+		MissRate before16 = Measure(primitive.Name, vertices, indices, 16);
+		MissRate after16 = Measure(primitive.Name, optimizedVertices, optimizedIndices, 16);
+		MissRate before32 = Measure(primitive.Name, vertices, indices, 32);
+		MissRate after32 = Measure(primitive.Name, optimizedVertices, optimizedIndices, 32);
+		CHECK(after16.Acmr <= before16.Acmr * OPTIMIZE_DEFAULT_OVERDRAW_THRESHOLD);
+		if( primitive.Curved )
+			CHECK(after16.Acmr <= before16.Acmr * 0.9f);
+
+		printf("%-13s %5zu -> %5zu verts %6zu tris  FIFO16 ACMR %.3f -> %.3f ATVR %.3f -> %.3f"
+			"  FIFO32 ACMR %.3f -> %.3f ATVR %.3f -> %.3f  %8.1f us\n", primitive.Name, vertices.size(),
+			optimizedVertices.size(), indices.size() / 3, before16.Acmr, after16.Acmr, before16.Atvr, after16.Atvr,
+			before32.Acmr, after32.Acmr, before32.Atvr, after32.Atvr, best*1e6);
+	}
+}
+
+int main()
+{
+	CheckDefaultOrder();
+
+	// A vertex no triangle uses does not count towards ATVR.
+	std::vector<Vertex> vertices;
+	std::vector<uint16_t> indices;
+	GeometricPrimitive::CreateCube(vertices, indices);
+	vertices.push_back(vertices[0]);
+	Measure("cube with an unused vertex", vertices, indices, 16);
+
+	for(size_t p = 0; p < sizeof(Primitives)/sizeof(Primitives[0]); ++p)
+		CheckPrimitive(Primitives[p]);
+
+	return TestResult("GeometricPrimitiveTest");
+}
@@ -0,0 +1,256 @@
+//***************************************************************************************
+// MeshSimplifierTest.cpp
+//
+// Checks SimplifyMesh on generated meshes (a flat grid must collapse to two triangles,
+// a sphere must keep valid, non-degenerate triangles within the target), builds the
+// level of detail chain of needle01.cmo the way ModelLoader does and reports its
+// triangle counts per level, and reports simplification throughput.
+//***************************************************************************************
+
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "ModelData.h"
+#include "TestUtil.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	struct Mesh
+	{
+		std::vector<XMFLOAT3> Vertices;
+		std::vector<uint32_t> Indices;
+	};
+
+	// n x n quads in the y = 0 plane.
+	Mesh MakeGrid(uint32_t n)
+	{
+		Mesh mesh;
+		for(uint32_t i = 0; i <= n; ++i)
+			for(uint32_t j = 0; j <= n; ++j)
+				mesh.Vertices.push_back(XMFLOAT3((float)j, 0.0f, (float)i));
+
+		for(uint32_t i = 0; i < n; ++i)
+		{
+			for(uint32_t j = 0; j < n; ++j)
+			{
+				uint32_t a = i*(n+1) + j;
+				uint32_t b = a + 1;
+				uint32_t c = a + n + 1;
+				uint32_t d = c + 1;
+				uint32_t quad[6] = { a, c, b, b, c, d };
+				mesh.Indices.insert(mesh.Indices.end(), quad, quad + 6);
+			}
+		}
+		return mesh;
+	}
+
+	// Unit sphere with a seam of duplicated vertices along one meridian, as texture
+	// coordinates would require.
+	Mesh MakeSphere(uint32_t rings, uint32_t segments)
+	{
+		Mesh mesh;
+		for(uint32_t i = 0; i <= rings; ++i)
+		{
+			float phi = XM_PI*i/rings;
+			for(uint32_t j = 0; j <= segments; ++j)
+			{
+				float theta = XM_2PI*(j % segments)/segments;
+				mesh.Vertices.push_back(XMFLOAT3(sinf(phi)*cosf(theta), cosf(phi), sinf(phi)*sinf(theta)));
+			}
+		}
+
+		for(uint32_t i = 0; i < rings; ++i)
+		{
+			for(uint32_t j = 0; j < segments; ++j)
+			{
+				uint32_t a = i*(segments+1) + j;
+				uint32_t b = a + 1;
+				uint32_t c = a + segments + 1;
+				uint32_t d = c + 1;
+				if( i > 0 )
+				{
+					uint32_t top[3] = { a, b, c };
+					mesh.Indices.insert(mesh.Indices.end(), top, top + 3);
+				}
+				if( i + 1 < rings )
+				{
+					uint32_t bottom[3] = { b, d, c };
+					mesh.Indices.insert(mesh.Indices.end(), bottom, bottom + 3);
+				}
+			}
+		}
+		return mesh;
+	}
+
+	size_t Simplify(const Mesh& mesh, size_t targetFaces, float maxError, std::vector<uint32_t>& result, float* error)
+	{
+		result.resize(mesh.Indices.size());
+		size_t kept = SimplifyMesh(&mesh.Indices[0], mesh.Indices.size()/3, &mesh.Vertices[0], sizeof(XMFLOAT3),
+			mesh.Vertices.size(), targetFaces, maxError, &result[0], error);
+		result.resize(kept*3);
+		return kept;
+	}
+
+	// Triangles whose corners are distinct vertices at distinct positions.
+	bool ValidTriangles(const Mesh& mesh, const std::vector<uint32_t>& indices)
+	{
+		for(size_t i = 0; i < indices.size(); i += 3)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				if( indices[i+k] >= mesh.Vertices.size() )
+					return false;
+			}
+
+			const XMFLOAT3& a = mesh.Vertices[indices[i]];
+			const XMFLOAT3& b = mesh.Vertices[indices[i+1]];
+			const XMFLOAT3& c = mesh.Vertices[indices[i+2]];
+			if( memcmp(&a, &b, sizeof(a)) == 0 || memcmp(&b, &c, sizeof(b)) == 0 || memcmp(&a, &c, sizeof(a)) == 0 )
+				return false;
+		}
+		return true;
+	}
+
+	// Triangles drawn by the given submeshes of a mesh, checking their indices.
+	size_t CountFaces(const ModelData& data, const ModelData::Mesh& mesh, const ModelData::SubMesh* subMeshes, bool& indicesValid)
+	{
+		size_t faces = 0;
+		for(uint32_t s = 0; s < mesh.subMeshCount; ++s)
+		{
+			const ModelData::SubMesh& sm = subMeshes[s];
+			const ModelData::IndexBuffer& ib = data.indexBuffers[mesh.firstIndexBuffer + sm.indexBufferIndex];
+			const ModelData::VertexBuffer& vb = data.vertexBuffers[mesh.firstVertexBuffer + sm.vertexBufferIndex];
+			const uint8_t* indices = data.GetData(ib.data);
+
+			indicesValid = indicesValid && sm.startIndex + sm.indexCount <= ib.indexCount;
+			for(uint32_t q = sm.startIndex; q < sm.startIndex + sm.indexCount && indicesValid; ++q)
+			{
+				uint32_t v = ib.indexSize == 2 ? ((const uint16_t*)indices)[q] : ((const uint32_t*)indices)[q];
+				indicesValid = v < vb.vertexCount;
+			}
+
+			faces += sm.indexCount/3;
+		}
+		return faces;
+	}
+}
+
+int main()
+{
+	std::vector<uint32_t> result;
+	float error = -1.0f;
+
+	// A flat grid loses everything but its two corner triangles, at no cost.
+	{
+		Mesh grid = MakeGrid(32);
+		size_t kept = Simplify(grid, 0, 1e-3f, result, &error);
+		printf("32 x 32 grid: %zu -> %zu triangles, error %g\n", grid.Indices.size()/3, kept, error);
+		CHECK(kept == 2);
+		CHECK(error >= 0.0f && error < 1e-5f);
+		CHECK(ValidTriangles(grid, result));
+	}
+
+	// A sphere stops at the target, or earlier at the error bound.
+	Mesh sphere = MakeSphere(100, 200);
+	size_t sphereFaces = sphere.Indices.size()/3;
+	{
+		size_t kept = Simplify(sphere, sphereFaces/4, 1.0f, result, &error);
+		printf("sphere: %zu -> %zu triangles, error %g\n", sphereFaces, kept, error);
+		CHECK(kept <= sphereFaces/4 && kept > sphereFaces/8);
+		CHECK(error > 0.0f && error < 0.05f);
+		CHECK(ValidTriangles(sphere, result));
+
+		std::vector<uint32_t> bounded;
+		float boundedError = -1.0f;
+		size_t boundedKept = Simplify(sphere, 0, 1e-4f, bounded, &boundedError);
+		printf("sphere within 1e-4: %zu triangles, error %g\n", boundedKept, boundedError);
+		CHECK(boundedKept > kept);
+		CHECK(boundedError <= 1e-4f);
+		CHECK(ValidTriangles(sphere, bounded));
+
+		// 16-bit indices and simplifying in place give the same triangles.
+		std::vector<uint16_t> indices16(sphere.Indices.begin(), sphere.Indices.end());
+		size_t kept16 = SimplifyMesh(&indices16[0], sphereFaces, &sphere.Vertices[0], sizeof(XMFLOAT3),
+			sphere.Vertices.size(), sphereFaces/4, 1.0f, &indices16[0]);
+		CHECK(kept16 == kept);
+		CHECK(std::equal(result.begin(), result.end(), indices16.begin()));
+
+		// Out of range indices are rejected.
+		std::vector<uint32_t> bad(sphere.Indices);
+		bad[bad.size()/2] = (uint32_t)sphere.Vertices.size();
+		bool threw = false;
+		try
+		{
+			SimplifyMesh(&bad[0], sphereFaces, &sphere.Vertices[0], sizeof(XMFLOAT3), sphere.Vertices.size(),
+				sphereFaces/2, 1.0f, &bad[0]);
+		}
+		catch( const std::out_of_range& )
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// The tree SnowSceneApp draws, with the chain ModelLoader builds for it.
+	{
+		std::string path = std::string(TEST_MODEL_DIR) + "/needle01.cmo";
+		MappedFile file;
+		file.Open(std::wstring(path.begin(), path.end()).c_str());
+
+		double t0 = TestSeconds();
+		std::unique_ptr<ModelData> data = ModelData::ParseCMO(file.GetData(), file.GetSize(), ModelData::ParseFlags_OptimizeMeshes);
+		double t1 = TestSeconds();
+		data->GenerateLODs();
+		double t2 = TestSeconds();
+
+		CHECK(!data->meshes.empty());
+		for(size_t m = 0; m < data->meshes.size(); ++m)
+		{
+			const ModelData::Mesh& mesh = data->meshes[m];
+			bool indicesValid = true;
+			size_t faces = CountFaces(*data, mesh, &data->subMeshes[mesh.firstSubMesh], indicesValid);
+
+			printf("needle01.cmo mesh %zu (radius %.2f): %zu", m, mesh.radius, faces);
+			CHECK(mesh.lodCount >= 2);
+
+			float previousError = 0.0f;
+			for(uint32_t l = 0; l < mesh.lodCount; ++l)
+			{
+				const ModelData::LevelOfDetail& lod = data->lods[mesh.firstLOD + l];
+				size_t levelFaces = CountFaces(*data, mesh, &data->lodSubMeshes[lod.firstSubMesh], indicesValid);
+				printf(" -> %zu", levelFaces);
+
+				// Each level is meaningfully smaller, and strays further, within the bound.
+				CHECK(levelFaces <= faces*9/10);
+				CHECK(lod.error >= previousError && lod.error <= 0.05f*mesh.radius);
+				faces = levelFaces;
+				previousError = lod.error;
+			}
+			printf(" triangles, error %.4f\n", previousError);
+			CHECK(indicesValid);
+		}
+
+		printf("ParseCMO %.1f ms, GenerateLODs %.1f ms\n", (t1 - t0)*1e3, (t2 - t1)*1e3);
+	}
+
+	// Throughput of SimplifyMesh alone, halving the sphere.
+	{
+		const int runs = 5;
+		double seconds = 0.0;
+		for(int run = 0; run < runs; ++run)
+		{
+			double t0 = TestSeconds();
+			Simplify(sphere, sphereFaces/2, 1.0f, result, 0);
+			seconds += TestSeconds() - t0;
+		}
+		printf("SimplifyMesh: %.2fM triangles/s\n", runs*sphereFaces / seconds * 1e-6);
+	}
+
+	return TestResult("MeshSimplifierTest");
+}
@@ -0,0 +1,526 @@
+//***************************************************************************************
+// ModelAnimationTest.cpp
+//
+// ModelAnimation on generated skeletons whose bones are listed children first as often
+// as not, with keys stored shuffled, some bones left without keys and some keys sharing
+// a time: every palette Evaluate writes must match a double precision reference that
+// scans the unsorted keys, blends the two around the clip time (of tied keys, the last
+// stored), composes the hierarchy recursively and applies the inverse bind pose, with
+// times before, inside, on a key and past the clip, looped and clamped.  Bad parents,
+// cycles and keys for missing bones must be rejected.  Also prints the time to evaluate
+// 1,000 instances of a 64 bone rig with 60 keys per bone.
+//***************************************************************************************
+
+#include "ModelAnimation.h"
+#include "ModelData.h"
+#include "TestUtil.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	// Row vectors, as DirectXMath: v' = v*M.
+	struct Matrix
+	{
+		double m[4][4];
+	};
+
+	Matrix Multiply(const Matrix& a, const Matrix& b)
+	{
+		Matrix r;
+		for(int i = 0; i < 4; ++i)
+			for(int j = 0; j < 4; ++j)
+				r.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j] + a.m[i][3]*b.m[3][j];
+		return r;
+	}
+
+	// Scale * rotation * translation, the scale positive.
+	struct Pose
+	{
+		double Scale[3];
+		double Rotation[4];		// unit quaternion x y z w
+		double Translation[3];
+	};
+
+	Matrix ToMatrix(const Pose& p)
+	{
+		double x = p.Rotation[0], y = p.Rotation[1], z = p.Rotation[2], w = p.Rotation[3];
+		double r[3][3] =
+		{
+			{ 1 - 2*(y*y + z*z), 2*(x*y + z*w),     2*(x*z - y*w) },
+			{ 2*(x*y - z*w),     1 - 2*(x*x + z*z), 2*(y*z + x*w) },
+			{ 2*(x*z + y*w),     2*(y*z - x*w),     1 - 2*(x*x + y*y) },
+		};
+
+		Matrix m;
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int j = 0; j < 3; ++j)
+				m.m[i][j] = r[i][j]*p.Scale[i];
+			m.m[i][3] = 0.0;
+		}
+		for(int j = 0; j < 3; ++j)
+			m.m[3][j] = p.Translation[j];
+		m.m[3][3] = 1.0;
+		return m;
+	}
+
+	// The inverse of ToMatrix(p): T^-1 * R^T * S^-1.
+	Matrix ToInverseMatrix(const Pose& p)
+	{
+		Matrix m = ToMatrix(p);
+		Matrix inv;
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int j = 0; j < 3; ++j)
+				inv.m[i][j] = m.m[j][i] / (p.Scale[j]*p.Scale[j]);
+			inv.m[i][3] = 0.0;
+		}
+		for(int j = 0; j < 3; ++j)
+			inv.m[3][j] = -(p.Translation[0]*inv.m[0][j] + p.Translation[1]*inv.m[1][j] + p.Translation[2]*inv.m[2][j]);
+		inv.m[3][3] = 1.0;
+		return inv;
+	}
+
+	XMFLOAT4X4 ToFloat(const Matrix& m)
+	{
+		XMFLOAT4X4 f;
+		for(int i = 0; i < 4; ++i)
+			for(int j = 0; j < 4; ++j)
+				f.m[i][j] = (float)m.m[i][j];
+		return f;
+	}
+
+	Pose Blend(const Pose& a, const Pose& b, double w)
+	{
+		Pose p;
+		for(int i = 0; i < 3; ++i)
+		{
+			p.Scale[i] = a.Scale[i] + (b.Scale[i] - a.Scale[i])*w;
+			p.Translation[i] = a.Translation[i] + (b.Translation[i] - a.Translation[i])*w;
+		}
+
+		// Slerp along the shorter arc.
+		double cosOmega = 0.0;
+		for(int i = 0; i < 4; ++i)
+			cosOmega += a.Rotation[i]*b.Rotation[i];
+		double sign = cosOmega < 0.0 ? -1.0 : 1.0;
+		cosOmega = std::min(cosOmega*sign, 1.0);
+
+		double omega = std::acos(cosOmega);
+		double s0 = 1.0 - w, s1 = w;
+		if( omega > 1e-9 )
+		{
+			s0 = std::sin((1.0 - w)*omega) / std::sin(omega);
+			s1 = std::sin(w*omega) / std::sin(omega);
+		}
+		double length = 0.0;
+		for(int i = 0; i < 4; ++i)
+		{
+			p.Rotation[i] = a.Rotation[i]*s0 + b.Rotation[i]*s1*sign;
+			length += p.Rotation[i]*p.Rotation[i];
+		}
+		for(int i = 0; i < 4; ++i)
+			p.Rotation[i] /= std::sqrt(length);
+		return p;
+	}
+
+	Pose RandomPose(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<double> unit(-1.0, 1.0);
+		std::uniform_real_distribution<double> scale(0.5, 2.0);
+
+		Pose p;
+		double length = 0.0;
+		for(int i = 0; i < 4; ++i)
+		{
+			p.Rotation[i] = unit(rng);
+			length += p.Rotation[i]*p.Rotation[i];
+		}
+		for(int i = 0; i < 4; ++i)
+			p.Rotation[i] /= std::sqrt(length);
+
+		for(int i = 0; i < 3; ++i)
+		{
+			p.Scale[i] = scale(rng);
+			p.Translation[i] = unit(rng);
+		}
+		return p;
+	}
+
+	struct Key
+	{
+		uint32_t Bone;
+		float Time;
+		Pose Transform;
+	};
+
+	// A skeleton with one clip, kept both as a ModelData and as the reference needs it.
+	struct Rig
+	{
+		std::vector<int32_t> Parents;
+		std::vector<Pose> BindLocal;
+		std::vector<Matrix> InvBindPose;
+		std::vector<Key> Keys;		// in the order stored in the clip
+		float StartTime;
+		float EndTime;
+		ModelData Data;
+	};
+
+	// Bones come in a random order, so parents are as likely to follow their children as
+	// to precede them; every keylessEvery-th bone has no keys.  With a timeStep, key times
+	// are multiples of it, so a bone often has several keys at the same time.
+	void MakeRig(Rig& rig, std::mt19937& rng, uint32_t numBones, uint32_t keysPerBone, uint32_t keylessEvery,
+		float timeStep = 0.0f)
+	{
+		std::vector<uint32_t> slot(numBones);
+		for(uint32_t j = 0; j < numBones; ++j)
+			slot[j] = j;
+		std::shuffle(slot.begin(), slot.end(), rng);
+
+		// Bone slot[k] is the k-th created; its parent is one created before it.
+		rig.Parents.assign(numBones, -1);
+		for(uint32_t k = 1; k < numBones; ++k)
+			rig.Parents[slot[k]] = (int32_t)slot[rng() % k];
+
+		rig.BindLocal.resize(numBones);
+		for(uint32_t j = 0; j < numBones; ++j)
+			rig.BindLocal[j] = RandomPose(rng);
+
+		std::vector<Matrix> bindWorld(numBones);
+		rig.InvBindPose.resize(numBones);
+		for(uint32_t k = 0; k < numBones; ++k)
+		{
+			uint32_t j = slot[k];
+			Matrix local = ToMatrix(rig.BindLocal[j]);
+			bindWorld[j] = rig.Parents[j] < 0 ? local : Multiply(local, bindWorld[rig.Parents[j]]);
+
+			Matrix inv = ToInverseMatrix(rig.BindLocal[j]);
+			rig.InvBindPose[j] = rig.Parents[j] < 0 ? inv : Multiply(rig.InvBindPose[rig.Parents[j]], inv);
+		}
+
+		rig.StartTime = 1.0f;
+		rig.EndTime = 1.0f + keysPerBone*0.1f;
+		std::uniform_real_distribution<float> time(rig.StartTime, rig.EndTime);
+
+		rig.Keys.clear();
+		for(uint32_t j = 0; j < numBones; ++j)
+		{
+			if( keylessEvery && j % keylessEvery == keylessEvery - 1 )
+				continue;
+			for(uint32_t k = 0; k < keysPerBone; ++k)
+			{
+				Key key;
+				key.Bone = j;
+				key.Time = time(rng);
+				if( timeStep > 0.0f )
+					key.Time = rig.StartTime + floorf((key.Time - rig.StartTime) / timeStep)*timeStep;
+				key.Transform = RandomPose(rng);
+				rig.Keys.push_back(key);
+			}
+		}
+		std::shuffle(rig.Keys.begin(), rig.Keys.end(), rng);
+
+		ModelData& data = rig.Data;
+		for(uint32_t j = 0; j < numBones; ++j)
+		{
+			ModelData::Bone bone;
+			bone.name = L"bone" + std::to_wstring(j);
+			bone.parentIndex = rig.Parents[j];
+			bone.invBindPos = ToFloat(rig.InvBindPose[j]);
+			bone.bindPos = ToFloat(bindWorld[j]);
+			bone.localTransform = ToFloat(ToMatrix(rig.BindLocal[j]));
+			data.bones.push_back(bone);
+		}
+
+		std::vector<ModelData::Keyframe> keyframes(rig.Keys.size());
+		for(size_t k = 0; k < rig.Keys.size(); ++k)
+		{
+			keyframes[k].boneIndex = rig.Keys[k].Bone;
+			keyframes[k].time = rig.Keys[k].Time;
+			keyframes[k].transform = ToFloat(ToMatrix(rig.Keys[k].Transform));
+		}
+
+		ModelData::Clip clip;
+		clip.name = L"walk";
+		clip.startTime = rig.StartTime;
+		clip.endTime = rig.EndTime;
+		clip.keys = data.AddOwned(keyframes.data(), keyframes.size()*sizeof(ModelData::Keyframe));
+		clip.keyCount = (uint32_t)keyframes.size();
+		data.clips.push_back(clip);
+
+		ModelData::Mesh mesh = ModelData::Mesh();
+		mesh.name = L"rig";
+		mesh.boneCount = numBones;
+		mesh.clipCount = 1;
+		mesh.skinning = true;
+		data.meshes.push_back(mesh);
+	}
+
+	// Local pose of a bone at clip time t: the last key at or before t blended with the
+	// first one after it, by a scan of the unsorted keys.
+	Matrix ReferenceLocal(const Rig& rig, uint32_t bone, float t)
+	{
+		const Key* before = nullptr;
+		const Key* after = nullptr;
+		const Key* first = nullptr;
+		const Key* last = nullptr;
+		for(size_t k = 0; k < rig.Keys.size(); ++k)
+		{
+			const Key& key = rig.Keys[k];
+			if( key.Bone != bone )
+				continue;
+			if( key.Time <= t && (!before || key.Time >= before->Time) )
+				before = &key;
+			if( key.Time > t && (!after || key.Time < after->Time) )
+				after = &key;
+			if( !first || key.Time < first->Time )
+				first = &key;
+			if( !last || key.Time >= last->Time )
+				last = &key;
+		}
+
+		if( !first )
+			return ToMatrix(rig.BindLocal[bone]);
+		if( !before )
+			return ToMatrix(first->Transform);
+		if( !after )
+			return ToMatrix(last->Transform);
+
+		double w = ((double)t - before->Time) / ((double)after->Time - before->Time);
+		return ToMatrix(Blend(before->Transform, after->Transform, w));
+	}
+
+	Matrix ReferenceWorld(const Rig& rig, uint32_t bone, float t)
+	{
+		Matrix local = ReferenceLocal(rig, bone, t);
+		int32_t parent = rig.Parents[bone];
+		return parent < 0 ? local : Multiply(local, ReferenceWorld(rig, parent, t));
+	}
+
+	// Largest difference relative to the largest element of the reference.
+	double RelativeError(const XMMATRIX& actual, const Matrix& expected)
+	{
+		XMFLOAT4X4 a;
+		XMStoreFloat4x4(&a, actual);
+
+		double scale = 1.0, error = 0.0;
+		for(int i = 0; i < 4; ++i)
+		{
+			for(int j = 0; j < 4; ++j)
+			{
+				scale = std::max(scale, std::fabs(expected.m[i][j]));
+				error = std::max(error, std::fabs(a.m[i][j] - expected.m[i][j]));
+			}
+		}
+		return error / scale;
+	}
+
+	void CheckRig(const char* name, std::mt19937& rng, uint32_t numBones, uint32_t keysPerBone, uint32_t keylessEvery,
+		float timeStep = 0.0f)
+	{
+		Rig rig;
+		MakeRig(rig, rng, numBones, keysPerBone, keylessEvery, timeStep);
+
+		std::unique_ptr<ModelAnimation> anim = ModelAnimation::CreateFromModelData(rig.Data, 0);
+		CHECK(anim);
+		if( !anim )
+			return;
+
+		CHECK(anim->GetBoneCount() == numBones && anim->GetClipCount() == 1);
+		CHECK(anim->FindClip(L"walk") == 0 && anim->FindClip(L"run") == -1);
+		CHECK(anim->FindBone(L"bone0") == 0 && anim->FindBone(L"bone9999") == -1);
+		CHECK(anim->GetClipStartTime(0) == rig.StartTime && anim->GetClipEndTime(0) == rig.EndTime);
+		for(uint32_t j = 0; j < numBones; ++j)
+			CHECK(anim->GetBoneParent(j) == rig.Parents[j]);
+
+		float start = rig.StartTime, duration = rig.EndTime - rig.StartTime;
+		std::uniform_real_distribution<float> inside(0.0f, 1.0f);
+
+		// (time asked for, loop, clip time it must be sampled at)
+		struct Sample { float Time; bool Loop; float ClipTime; };
+		std::vector<Sample> samples;
+		for(int i = 0; i < 40; ++i)
+		{
+			float t = start + inside(rng)*duration;
+			Sample s = { t, i % 2 == 0, t };
+			samples.push_back(s);
+		}
+		Sample edges[] =
+		{
+			{ start - 5.0f, false, start },
+			{ rig.EndTime + 5.0f, false, rig.EndTime },
+			{ start, false, start },
+			{ rig.EndTime, false, rig.EndTime },
+		};
+		samples.insert(samples.end(), edges, edges + sizeof(edges)/sizeof(edges[0]));
+		for(int i = 0; timeStep > 0.0f && i < 20; ++i)
+		{
+			// Exactly on a key time, where tied keys must blend the last with the next.
+			float t = start + (rng() % (uint32_t)(duration / timeStep))*timeStep;
+			Sample s = { t, false, t };
+			samples.push_back(s);
+		}
+		for(int i = 0; i < 10; ++i)
+		{
+			// Whole periods before and after wrap back into the clip.
+			float offset = inside(rng)*duration;
+			float periods = (float)(i - 5);
+			float t = start + offset + periods*duration;
+			float wrapped = start + fmodf(t - start, duration);
+			if( wrapped < start )
+				wrapped += duration;
+			Sample s = { t, true, wrapped };
+			samples.push_back(s);
+		}
+
+		std::vector<XMMATRIX> palette(numBones), world(numBones);
+		double worstPalette = 0.0, worstWorld = 0.0;
+		for(size_t i = 0; i < samples.size(); ++i)
+		{
+			anim->Evaluate(0, samples[i].Time, samples[i].Loop, palette.data());
+			anim->EvaluateWorld(0, samples[i].Time, samples[i].Loop, world.data());
+			for(uint32_t j = 0; j < numBones; ++j)
+			{
+				Matrix expected = ReferenceWorld(rig, j, samples[i].ClipTime);
+				worstWorld = std::max(worstWorld, RelativeError(world[j], expected));
+				worstPalette = std::max(worstPalette, RelativeError(palette[j], Multiply(rig.InvBindPose[j], expected)));
+			}
+		}
+
+		// Keys go through float matrices and a decomposition, and a deep bone's error
+		// grows with each parent.
+		printf("%-22s %4u bones, %5zu keys: worst relative error %.2g world, %.2g palette\n",
+			name, numBones, rig.Keys.size(), worstWorld, worstPalette);
+		CHECK(worstWorld < 2e-5);
+		CHECK(worstPalette < 2e-5);
+
+		bool threw = false;
+		try
+		{
+			anim->Evaluate(1, 0.0f, false, palette.data());
+		}
+		catch( const std::out_of_range& )
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// True if building the animation throws std::runtime_error.
+	bool Rejects(const ModelData& data)
+	{
+		try
+		{
+			ModelAnimation::CreateFromModelData(data, 0);
+		}
+		catch( const std::runtime_error& )
+		{
+			return true;
+		}
+		return false;
+	}
+
+	void CheckMalformed(std::mt19937& rng)
+	{
+		{
+			Rig rig;
+			MakeRig(rig, rng, 8, 4, 0);
+			rig.Data.bones[3].parentIndex = 8;
+			CHECK(Rejects(rig.Data));
+		}
+		{
+			// 2 -> 5 -> 2 never reaches a root.
+			Rig rig;
+			MakeRig(rig, rng, 8, 4, 0);
+			rig.Data.bones[2].parentIndex = 5;
+			rig.Data.bones[5].parentIndex = 2;
+			CHECK(Rejects(rig.Data));
+		}
+		{
+			Rig rig;
+			MakeRig(rig, rng, 8, 4, 0);
+			ModelData::Clip& clip = rig.Data.clips[0];
+			ModelData::Keyframe* keys = reinterpret_cast<ModelData::Keyframe*>(rig.Data.GetOwnedData(clip.keys));
+			keys[clip.keyCount - 1].boneIndex = 8;
+			CHECK(Rejects(rig.Data));
+		}
+		{
+			// A mesh without bones has nothing to animate.
+			Rig rig;
+			MakeRig(rig, rng, 8, 4, 0);
+			rig.Data.meshes[0].boneCount = 0;
+			rig.Data.meshes[0].clipCount = 0;
+			CHECK(!ModelAnimation::CreateFromModelData(rig.Data, 0));
+		}
+	}
+
+	void Benchmark(std::mt19937& rng)
+	{
+		const uint32_t numBones = 64, keysPerBone = 60, numInstances = 1000;
+		const int frames = 20;
+
+		Rig rig;
+		MakeRig(rig, rng, numBones, keysPerBone, 0);
+		std::unique_ptr<ModelAnimation> anim = ModelAnimation::CreateFromModelData(rig.Data, 0);
+
+		// Each instance at its own point in the clip.
+		std::vector<float> phase(numInstances);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for(uint32_t i = 0; i < numInstances; ++i)
+			phase[i] = unit(rng)*(rig.EndTime - rig.StartTime);
+
+		std::vector<XMMATRIX> palettes((size_t)numInstances*numBones);
+		auto evaluate = [&](uint32_t first, uint32_t last, float time)
+		{
+			for(uint32_t i = first; i < last; ++i)
+				anim->Evaluate(0, time + phase[i], true, &palettes[(size_t)i*numBones]);
+		};
+
+		unsigned counts[] = { 1, std::max(1u, std::thread::hardware_concurrency()) };
+		for(size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c)
+		{
+			if( c > 0 && counts[c] == 1 )
+				break;
+
+			double t0 = TestSeconds();
+			for(int f = 0; f < frames; ++f)
+			{
+				float time = rig.StartTime + f/60.0f;
+				std::vector<std::thread> threads;
+				for(unsigned t = 1; t < counts[c]; ++t)
+					threads.emplace_back(evaluate, numInstances*t/counts[c], numInstances*(t+1)/counts[c], time);
+				evaluate(0, numInstances/counts[c], time);
+				for(size_t t = 0; t < threads.size(); ++t)
+					threads[t].join();
+			}
+			double seconds = (TestSeconds() - t0) / frames;
+
+			printf("%u instances x %u bones x %u keys, %2u threads: %6.2f ms/frame, %6.1f M bones/s\n",
+				numInstances, numBones, keysPerBone, counts[c], seconds*1000.0,
+				(double)numInstances*numBones/seconds*1e-6);
+		}
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(12);
+
+	CheckRig("one bone", rng, 1, 5, 0);
+	CheckRig("one key per bone", rng, 16, 1, 0);
+	CheckRig("some bones without keys", rng, 40, 8, 3);
+	CheckRig("64 bones", rng, 64, 60, 0);
+	CheckRig("keys at the same time", rng, 24, 48, 0, 0.2f);
+	CheckMalformed(rng);
+
+	Benchmark(rng);
+
+	return TestResult("ModelAnimationTest");
+}
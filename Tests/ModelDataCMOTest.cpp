@@ -0,0 +1,270 @@
+//***************************************************************************************
+// ModelDataCMOTest.cpp
+//
+// ModelData::ParseCMO on the two models SnowScene ships: every blob must lie inside its
+// storage and agree with its counts, every submesh and index must stay inside its
+// buffers, vertex and index data must be referenced in place unless a flag rewrites
+// it, SetSource must move the blobs with the data, and WriteCMO must give back a file
+// that parses to the same buffers.  Every truncation of snowhouse2.cmo, and a spread
+// of those of needle01.cmo, must be rejected with std::runtime_error.  Also prints
+// the parse time of both models with each parse flag.
+//***************************************************************************************
+
+#include "MappedFile.h"
+#include "ModelData.h"
+#include "TestUtil.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	std::vector<uint8_t> ReadModel(const char* name)
+	{
+		std::string path = std::string(TEST_MODEL_DIR) + "/" + name;
+		MappedFile file;
+		file.Open(std::wstring(path.begin(), path.end()).c_str());
+		return std::vector<uint8_t>(file.GetData(), file.GetData() + file.GetSize());
+	}
+
+	bool BlobInside(const ModelData& data, const ModelData::Blob& blob)
+	{
+		size_t storage = blob.location == ModelData::BlobLocation_Source ? data.GetSourceSize() : data.GetOwnedSize();
+		return blob.offset <= storage && blob.size <= storage - blob.offset;
+	}
+
+	// Index i of an index buffer of either width.
+	uint32_t GetIndex(const ModelData& data, const ModelData::IndexBuffer& ib, uint32_t i)
+	{
+		const uint8_t* p = data.GetData(ib.data) + (size_t)i*ib.indexSize;
+		if( ib.indexSize == 2 )
+		{
+			uint16_t index;
+			memcpy(&index, p, sizeof(index));
+			return index;
+		}
+		uint32_t index;
+		memcpy(&index, p, sizeof(index));
+		return index;
+	}
+
+	void CheckConsistent(const char* name, const ModelData& data)
+	{
+		CHECK(!data.meshes.empty());
+
+		for(size_t i = 0; i < data.vertexBuffers.size(); ++i)
+		{
+			const ModelData::VertexBuffer& vb = data.vertexBuffers[i];
+			CHECK(BlobInside(data, vb.data));
+			CHECK(vb.data.size == (size_t)vb.stride*vb.vertexCount);
+			CHECK(vb.stride == (vb.format == ModelData::VertexFormat_PositionNormalTangentColorTexture ? 52u : 60u));
+		}
+		for(size_t i = 0; i < data.indexBuffers.size(); ++i)
+		{
+			const ModelData::IndexBuffer& ib = data.indexBuffers[i];
+			CHECK(BlobInside(data, ib.data));
+			CHECK((ib.indexSize == 2 || ib.indexSize == 4) && ib.data.size == (size_t)ib.indexSize*ib.indexCount);
+		}
+		for(size_t i = 0; i < data.clips.size(); ++i)
+		{
+			const ModelData::Clip& clip = data.clips[i];
+			CHECK(BlobInside(data, clip.keys));
+			CHECK(clip.keys.size == (size_t)clip.keyCount*sizeof(ModelData::Keyframe));
+		}
+
+		bool indicesValid = true;
+		for(size_t m = 0; m < data.meshes.size(); ++m)
+		{
+			const ModelData::Mesh& mesh = data.meshes[m];
+			CHECK(mesh.firstSubMesh + mesh.subMeshCount <= data.subMeshes.size());
+			CHECK(mesh.firstMaterial + mesh.materialCount <= data.materials.size());
+			CHECK(mesh.firstVertexBuffer + mesh.vertexBufferCount <= data.vertexBuffers.size());
+			CHECK(mesh.firstIndexBuffer + mesh.indexBufferCount <= data.indexBuffers.size());
+			CHECK(mesh.firstBone + mesh.boneCount <= data.bones.size());
+			CHECK(mesh.firstClip + mesh.clipCount <= data.clips.size());
+			CHECK(mesh.radius >= 0.0f);
+
+			for(uint32_t s = 0; s < mesh.subMeshCount; ++s)
+			{
+				const ModelData::SubMesh& sub = data.subMeshes[mesh.firstSubMesh + s];
+				CHECK(sub.materialIndex < mesh.materialCount);
+				CHECK(sub.indexBufferIndex < mesh.indexBufferCount && sub.vertexBufferIndex < mesh.vertexBufferCount);
+				if( sub.indexBufferIndex >= mesh.indexBufferCount || sub.vertexBufferIndex >= mesh.vertexBufferCount )
+					continue;
+
+				const ModelData::IndexBuffer& ib = data.indexBuffers[mesh.firstIndexBuffer + sub.indexBufferIndex];
+				const ModelData::VertexBuffer& vb = data.vertexBuffers[mesh.firstVertexBuffer + sub.vertexBufferIndex];
+				CHECK(sub.startIndex <= ib.indexCount && sub.indexCount <= ib.indexCount - sub.startIndex);
+				if( sub.startIndex > ib.indexCount || sub.indexCount > ib.indexCount - sub.startIndex )
+					continue;
+
+				for(uint32_t k = 0; k < sub.indexCount; ++k)
+				{
+					if( GetIndex(data, ib, sub.startIndex + k) >= vb.vertexCount )
+						indicesValid = false;
+				}
+			}
+		}
+		if( !indicesValid )
+			printf("  %s: an index is past the end of its vertex buffer\n", name);
+		CHECK(indicesValid);
+	}
+
+	bool SameBlobs(const ModelData& a, const ModelData& b)
+	{
+		if( a.vertexBuffers.size() != b.vertexBuffers.size() || a.indexBuffers.size() != b.indexBuffers.size() ||
+			a.subMeshes.size() != b.subMeshes.size() || a.materials.size() != b.materials.size() )
+		{
+			return false;
+		}
+		for(size_t i = 0; i < a.vertexBuffers.size(); ++i)
+		{
+			const ModelData::Blob& x = a.vertexBuffers[i].data;
+			const ModelData::Blob& y = b.vertexBuffers[i].data;
+			if( x.size != y.size || memcmp(a.GetData(x), b.GetData(y), x.size) != 0 )
+				return false;
+		}
+		for(size_t i = 0; i < a.indexBuffers.size(); ++i)
+		{
+			const ModelData::Blob& x = a.indexBuffers[i].data;
+			const ModelData::Blob& y = b.indexBuffers[i].data;
+			if( x.size != y.size || memcmp(a.GetData(x), b.GetData(y), x.size) != 0 )
+				return false;
+		}
+		for(size_t i = 0; i < a.subMeshes.size(); ++i)
+		{
+			if( memcmp(&a.subMeshes[i], &b.subMeshes[i], sizeof(ModelData::SubMesh)) != 0 )
+				return false;
+		}
+		for(size_t i = 0; i < a.materials.size(); ++i)
+		{
+			if( a.materials[i].name != b.materials[i].name || a.materials[i].texture[0] != b.materials[i].texture[0] )
+				return false;
+		}
+		return true;
+	}
+
+	// True if parsing the first size bytes throws std::runtime_error, and nothing else.
+	bool Rejects(const std::vector<uint8_t>& file, size_t size)
+	{
+		// A copy of just the prefix, so reading past it is caught by the sanitizers.  A
+		// null pointer is a different error.
+		std::vector<uint8_t> prefix(file.begin(), file.begin() + size);
+		try
+		{
+			ModelData::ParseCMO(size ? &prefix[0] : &file[0], size);
+		}
+		catch( const std::runtime_error& )
+		{
+			return true;
+		}
+		catch( ... )
+		{
+		}
+		return false;
+	}
+
+	void CheckModel(const char* name, size_t truncationStep)
+	{
+		std::vector<uint8_t> file = ReadModel(name);
+		CHECK(!file.empty());
+		if( file.empty() )
+			return;
+
+		std::unique_ptr<ModelData> data = ModelData::ParseCMO(&file[0], file.size());
+		CheckConsistent(name, *data);
+
+		// Unskinned vertices and all indices are used where they are.
+		bool skinned = false;
+		for(size_t m = 0; m < data->meshes.size(); ++m)
+			skinned = skinned || data->meshes[m].skinning;
+		if( !skinned )
+			CHECK(data->GetOwnedSize() == 0);
+
+		std::unique_ptr<ModelData> baked = ModelData::ParseCMO(&file[0], file.size(), ModelData::ParseFlags_BakeUVTransform);
+		CheckConsistent(name, *baked);
+		std::unique_ptr<ModelData> optimized = ModelData::ParseCMO(&file[0], file.size(), ModelData::ParseFlags_OptimizeMeshes);
+		CheckConsistent(name, *optimized);
+
+		// Moving the source moves every blob that refers to it.
+		std::vector<uint8_t> copy(file);
+		data->SetSource(&copy[0], copy.size());
+		for(size_t i = 0; i < data->vertexBuffers.size(); ++i)
+		{
+			const ModelData::Blob& blob = data->vertexBuffers[i].data;
+			if( blob.location == ModelData::BlobLocation_Source )
+				CHECK(data->GetData(blob) == &copy[0] + blob.offset);
+		}
+		std::unique_ptr<ModelData> original = ModelData::ParseCMO(&file[0], file.size());
+		CHECK(SameBlobs(*data, *original));
+
+		// Written back out, the model parses to the same buffers.
+		std::vector<uint8_t> written;
+		data->WriteCMO(written);
+		std::unique_ptr<ModelData> reparsed = ModelData::ParseCMO(&written[0], written.size());
+		CHECK(SameBlobs(*reparsed, *original));
+
+		// Every prefix up to 4 KB, then one in truncationStep.
+		size_t checked = 0, accepted = 0;
+		for(size_t size = 0; size < file.size(); size += size < 4096 ? 1 : truncationStep)
+		{
+			if( !Rejects(file, size) )
+			{
+				if( accepted++ == 0 )
+					printf("  %s: the first %zu bytes parse\n", name, size);
+			}
+			++checked;
+		}
+		CHECK(accepted == 0);
+
+		printf("%-15s %zu bytes, %zu meshes, %zu vertex buffers, %zu submeshes, %zu bones, %zu clips; "
+			"owned bytes %zu / %zu baked / %zu optimized; %zu truncations rejected\n",
+			name, file.size(), data->meshes.size(), data->vertexBuffers.size(), data->subMeshes.size(),
+			data->bones.size(), data->clips.size(), data->GetOwnedSize(), baked->GetOwnedSize(),
+			optimized->GetOwnedSize(), checked - accepted);
+	}
+
+	void Benchmark(const char* name)
+	{
+		std::vector<uint8_t> file = ReadModel(name);
+		if( file.empty() )
+			return;
+
+		const uint32_t flags[] =
+		{
+			ModelData::ParseFlags_None, ModelData::ParseFlags_BakeUVTransform, ModelData::ParseFlags_OptimizeMeshes
+		};
+		const char* flagNames[] = { "no flags", "BakeUVTransform", "OptimizeMeshes" };
+
+		for(size_t f = 0; f < sizeof(flags)/sizeof(flags[0]); ++f)
+		{
+			// Enough runs for about a tenth of a second.
+			int runs = 0;
+			double t0 = TestSeconds(), seconds = 0.0;
+			do
+			{
+				ModelData::ParseCMO(&file[0], file.size(), flags[f]);
+				++runs;
+				seconds = TestSeconds() - t0;
+			}
+			while( seconds < 0.1 );
+
+			double perParse = seconds / runs;
+			printf("%-15s ParseCMO, %-15s %10.2f us, %8.1f MB/s\n", name, flagNames[f], perParse*1e6,
+				file.size() / perParse * 1e-6);
+		}
+	}
+}
+
+int main()
+{
+	CheckModel("snowhouse2.cmo", 1);
+	CheckModel("needle01.cmo", 997);
+
+	Benchmark("snowhouse2.cmo");
+	Benchmark("needle01.cmo");
+
+	return TestResult("ModelDataCMOTest");
+}
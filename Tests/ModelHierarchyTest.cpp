@@ -0,0 +1,730 @@
+//***************************************************************************************
+// ModelHierarchyTest.cpp
+//
+// ModelHierarchy on generated .SDKMESH and .SDKMESH_ANIM files whose frames are listed
+// children first as often as not, with some frames left without keys, keys for frames
+// that do not exist, and unnormalized, zero and sign flipped quaternions: every world
+// matrix EvaluateWorld writes and every palette matrix GetBonePalette writes must match
+// a double precision reference that normalizes the keys, blends the two ticks around
+// the time, composes the hierarchy recursively and applies the inverse bind pose, with
+// times before, inside and past the animation, looped and clamped.  Every truncation of
+// both files, bad parents, meshes and influences, cycles, big-endian files and
+// absolute transforms must be rejected with std::runtime_error.  Also prints the time
+// to evaluate rigs of 64, 256 and 1024 frames against a DXUT-style recursive walk.
+//***************************************************************************************
+
+#include "ModelHierarchy.h"
+#include "TestUtil.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+#include <dxgiformat.h>
+#include "SDKMesh.h"
+using namespace DirectX;
+
+namespace
+{
+	const float KeysPerSecond = 30.0f;
+
+	// Row vectors, as DirectXMath: v' = v*M.
+	struct Matrix
+	{
+		double m[4][4];
+	};
+
+	Matrix Multiply(const Matrix& a, const Matrix& b)
+	{
+		Matrix r;
+		for(int i = 0; i < 4; ++i)
+			for(int j = 0; j < 4; ++j)
+				r.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j] + a.m[i][3]*b.m[3][j];
+		return r;
+	}
+
+	// Rotation q (x y z w, unit length), then translation t.
+	Matrix ToMatrix(const double q[4], const double t[3])
+	{
+		double x = q[0], y = q[1], z = q[2], w = q[3];
+		Matrix m =
+		{ {
+			{ 1 - 2*(y*y + z*z), 2*(x*y + z*w),     2*(x*z - y*w),     0.0 },
+			{ 2*(x*y - z*w),     1 - 2*(x*x + z*z), 2*(y*z + x*w),     0.0 },
+			{ 2*(x*z + y*w),     2*(y*z - x*w),     1 - 2*(x*x + y*y), 0.0 },
+			{ t[0],              t[1],              t[2],              1.0 },
+		} };
+		return m;
+	}
+
+	// Inverse of a rotation followed by a translation.
+	Matrix InverseRigid(const Matrix& m)
+	{
+		Matrix inv;
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int j = 0; j < 3; ++j)
+				inv.m[i][j] = m.m[j][i];
+			inv.m[i][3] = 0.0;
+		}
+		for(int j = 0; j < 3; ++j)
+			inv.m[3][j] = -(m.m[3][0]*inv.m[0][j] + m.m[3][1]*inv.m[1][j] + m.m[3][2]*inv.m[2][j]);
+		inv.m[3][3] = 1.0;
+		return inv;
+	}
+
+	XMFLOAT4X4 ToFloat(const Matrix& m)
+	{
+		XMFLOAT4X4 f;
+		for(int i = 0; i < 4; ++i)
+			for(int j = 0; j < 4; ++j)
+				f.m[i][j] = (float)m.m[i][j];
+		return f;
+	}
+
+	void RandomRotation(std::mt19937& rng, double q[4])
+	{
+		std::uniform_real_distribution<double> unit(-1.0, 1.0);
+		double length = 0.0;
+		for(int i = 0; i < 4; ++i)
+		{
+			q[i] = unit(rng);
+			length += q[i]*q[i];
+		}
+		for(int i = 0; i < 4; ++i)
+			q[i] /= std::sqrt(length);
+	}
+
+	template<size_t N>
+	void SetName(char (&field)[N], const std::string& name)
+	{
+		memset(field, 0, N);
+		memcpy(field, name.data(), std::min(name.size(), N - 1));
+	}
+
+	// A rig in file form, and what the reference needs of it.
+	struct Rig
+	{
+		std::vector<uint8_t> MeshFile;
+		std::vector<uint8_t> AnimFile;
+
+		std::vector<int32_t> Parents;
+		std::vector<Matrix> BindLocal;
+		std::vector<Matrix> InvBindWorld;
+		std::vector<uint32_t> Influences;		// of mesh 0; mesh 1 has none
+		std::vector<int32_t> KeySource;			// animation frame of each frame, or -1
+		uint32_t NumKeys;
+		std::vector<DXUT::SDKANIMATION_DATA> Keys;	// animation frame major, as in the file
+	};
+
+	// Frames come in a random order, so parents are as likely to follow their children as
+	// to precede them.  About animatedPercent of the frames get keys; the animation also
+	// has keys for a few frames that do not exist.
+	void MakeRig(Rig& rig, std::mt19937& rng, uint32_t numFrames, uint32_t numKeys, uint32_t animatedPercent)
+	{
+		std::vector<uint32_t> slot(numFrames);
+		for(uint32_t j = 0; j < numFrames; ++j)
+			slot[j] = j;
+		std::shuffle(slot.begin(), slot.end(), rng);
+
+		rig.Parents.assign(numFrames, -1);
+		for(uint32_t k = 1; k < numFrames; ++k)
+			rig.Parents[slot[k]] = (int32_t)slot[rng() % k];
+
+		std::uniform_real_distribution<double> unit(-1.0, 1.0);
+		rig.BindLocal.resize(numFrames);
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			double q[4], t[3] = { unit(rng), unit(rng), unit(rng) };
+			RandomRotation(rng, q);
+			rig.BindLocal[j] = ToMatrix(q, t);
+		}
+
+		std::vector<Matrix> bindWorld(numFrames);
+		rig.InvBindWorld.resize(numFrames);
+		for(uint32_t k = 0; k < numFrames; ++k)
+		{
+			uint32_t j = slot[k];
+			bindWorld[j] = rig.Parents[j] < 0 ? rig.BindLocal[j] : Multiply(rig.BindLocal[j], bindWorld[rig.Parents[j]]);
+			rig.InvBindWorld[j] = InverseRigid(bindWorld[j]);
+		}
+
+		rig.Influences.clear();
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			if( rng() % 4 != 0 )
+				rig.Influences.push_back(j);
+		}
+		std::shuffle(rig.Influences.begin(), rig.Influences.end(), rng);
+
+		// .SDKMESH: header, two meshes, frames, then the influences of mesh 0.
+		DXUT::SDKMESH_HEADER header = {};
+		header.Version = DXUT::SDKMESH_FILE_VERSION;
+		header.HeaderSize = sizeof(header);
+		header.NumMeshes = 2;
+		header.NumFrames = numFrames;
+		header.MeshDataOffset = sizeof(header);
+		header.FrameDataOffset = header.MeshDataOffset + 2*sizeof(DXUT::SDKMESH_MESH);
+		uint64_t influenceOffset = header.FrameDataOffset + numFrames*sizeof(DXUT::SDKMESH_FRAME);
+		header.NonBufferDataSize = influenceOffset + rig.Influences.size()*sizeof(uint32_t);
+
+		rig.MeshFile.assign((size_t)header.NonBufferDataSize, 0);
+		memcpy(&rig.MeshFile[0], &header, sizeof(header));
+
+		DXUT::SDKMESH_MESH meshes[2] = {};
+		SetName(meshes[0].Name, "skinned");
+		meshes[0].NumFrameInfluences = (uint32_t)rig.Influences.size();
+		meshes[0].FrameInfluenceOffset = influenceOffset;
+		SetName(meshes[1].Name, "rigid");
+		memcpy(&rig.MeshFile[(size_t)header.MeshDataOffset], meshes, sizeof(meshes));
+		if( !rig.Influences.empty() )
+			memcpy(&rig.MeshFile[(size_t)influenceOffset], rig.Influences.data(), rig.Influences.size()*sizeof(uint32_t));
+
+		// Child and sibling links are only for the DXUT-style walk.
+		std::vector<uint32_t> child(numFrames, DXUT::INVALID_FRAME), sibling(numFrames, DXUT::INVALID_FRAME);
+		for(uint32_t j = numFrames; j-- > 0; )
+		{
+			if( rig.Parents[j] >= 0 )
+			{
+				sibling[j] = child[rig.Parents[j]];
+				child[rig.Parents[j]] = j;
+			}
+		}
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			DXUT::SDKMESH_FRAME frame = {};
+			SetName(frame.Name, "frame" + std::to_string(j));
+			frame.Mesh = j == 0 ? 0 : j == 1 ? 1 : DXUT::INVALID_MESH;
+			frame.ParentFrame = rig.Parents[j] < 0 ? DXUT::INVALID_FRAME : (uint32_t)rig.Parents[j];
+			frame.ChildFrame = child[j];
+			frame.SiblingFrame = sibling[j];
+			frame.Matrix = ToFloat(rig.BindLocal[j]);
+			frame.AnimationDataIndex = UINT32_MAX;
+			memcpy(&rig.MeshFile[(size_t)(header.FrameDataOffset + j*sizeof(frame))], &frame, sizeof(frame));
+		}
+
+		// .SDKMESH_ANIM: header, one record per animated frame, then each one's keys.
+		std::vector<std::string> names;
+		rig.KeySource.assign(numFrames, -1);
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			if( rng() % 100 < animatedPercent )
+			{
+				rig.KeySource[j] = (int32_t)names.size();
+				names.push_back("frame" + std::to_string(j));
+			}
+		}
+		for(int i = 0; i < 3; ++i)
+			names.push_back("missing" + std::to_string(i));
+
+		// Shuffle the records, keeping KeySource pointing at them.
+		std::vector<uint32_t> perm(names.size());
+		for(size_t i = 0; i < perm.size(); ++i)
+			perm[i] = (uint32_t)i;
+		std::shuffle(perm.begin(), perm.end(), rng);
+		std::vector<std::string> shuffled(names.size());
+		for(size_t i = 0; i < perm.size(); ++i)
+			shuffled[perm[i]] = names[i];
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			if( rig.KeySource[j] >= 0 )
+				rig.KeySource[j] = (int32_t)perm[rig.KeySource[j]];
+		}
+
+		// Keys turn a little each tick, as sampled animation does, but are stored with
+		// random lengths and signs; now and then one is zero, meaning no rotation.
+		rig.NumKeys = numKeys;
+		rig.Keys.resize(shuffled.size()*numKeys);
+		for(size_t a = 0; a < shuffled.size(); ++a)
+		{
+			double q[4];
+			RandomRotation(rng, q);
+			double t[3] = { unit(rng), unit(rng), unit(rng) };
+			for(uint32_t k = 0; k < numKeys; ++k)
+			{
+				DXUT::SDKANIMATION_DATA& key = rig.Keys[a*numKeys + k];
+				double length = 0.0;
+				for(int i = 0; i < 4; ++i)
+				{
+					q[i] += unit(rng)*0.1;
+					length += q[i]*q[i];
+				}
+				for(int i = 0; i < 4; ++i)
+					q[i] /= std::sqrt(length);
+				for(int i = 0; i < 3; ++i)
+					t[i] += unit(rng)*0.05;
+
+				double stored = (rng() % 2 ? -1.0 : 1.0) * (0.5 + (rng() % 100) / 50.0);
+				if( rng() % 50 == 0 )
+					stored = 0.0;
+				key.Orientation = XMFLOAT4((float)(q[0]*stored), (float)(q[1]*stored), (float)(q[2]*stored), (float)(q[3]*stored));
+				key.Translation = XMFLOAT3((float)t[0], (float)t[1], (float)t[2]);
+				key.Scaling = XMFLOAT3(2.0f, 2.0f, 2.0f);	// ignored
+			}
+		}
+
+		DXUT::SDKANIMATION_FILE_HEADER animHeader = {};
+		animHeader.FrameTransformType = DXUT::FTT_RELATIVE;
+		animHeader.NumFrames = (uint32_t)shuffled.size();
+		animHeader.NumAnimationKeys = numKeys;
+		animHeader.AnimationFPS = (uint32_t)KeysPerSecond;
+		animHeader.AnimationDataOffset = sizeof(animHeader);
+		size_t keysOffset = sizeof(animHeader) + shuffled.size()*sizeof(DXUT::SDKANIMATION_FRAME_DATA);
+		animHeader.AnimationDataSize = keysOffset - sizeof(animHeader) + rig.Keys.size()*sizeof(DXUT::SDKANIMATION_DATA);
+
+		rig.AnimFile.assign(sizeof(animHeader) + (size_t)animHeader.AnimationDataSize, 0);
+		memcpy(&rig.AnimFile[0], &animHeader, sizeof(animHeader));
+		for(size_t a = 0; a < shuffled.size(); ++a)
+		{
+			DXUT::SDKANIMATION_FRAME_DATA frameData = {};
+			SetName(frameData.FrameName, shuffled[a]);
+			frameData.DataOffset = keysOffset - sizeof(animHeader) + a*numKeys*sizeof(DXUT::SDKANIMATION_DATA);
+			memcpy(&rig.AnimFile[sizeof(animHeader) + a*sizeof(frameData)], &frameData, sizeof(frameData));
+		}
+		if( !rig.Keys.empty() )
+			memcpy(&rig.AnimFile[keysOffset], rig.Keys.data(), rig.Keys.size()*sizeof(DXUT::SDKANIMATION_DATA));
+	}
+
+	// Unit quaternion of a stored key; zero means no rotation.
+	void KeyRotation(const DXUT::SDKANIMATION_DATA& key, double q[4])
+	{
+		q[0] = key.Orientation.x; q[1] = key.Orientation.y; q[2] = key.Orientation.z; q[3] = key.Orientation.w;
+		double length = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+		if( length == 0.0 )
+		{
+			q[0] = q[1] = q[2] = 0.0;
+			q[3] = length = 1.0;
+		}
+		for(int i = 0; i < 4; ++i)
+			q[i] /= length;
+	}
+
+	// Tick 0 is the reference pose; ticks 1 to NumKeys - 1 are played, one per 1/30 s.
+	void TickAt(const Rig& rig, float time, bool loop, uint32_t& k0, uint32_t& k1, double& w)
+	{
+		k0 = std::min(1u, rig.NumKeys - 1);
+		w = 0.0;
+		if( rig.NumKeys > 2 )
+		{
+			float span = (float)(rig.NumKeys - 2);
+			float pos = time*KeysPerSecond;
+			if( loop )
+			{
+				pos = fmodf(pos, span);
+				if( pos < 0.0f )
+					pos += span;
+			}
+			else
+			{
+				pos = std::min(std::max(pos, 0.0f), span);
+			}
+			k0 = 1 + (uint32_t)floorf(pos);
+			w = pos - floorf(pos);
+			if( k0 >= rig.NumKeys - 1 )
+			{
+				k0 = rig.NumKeys - 1;
+				w = 0.0;
+			}
+		}
+		k1 = std::min(k0 + 1, rig.NumKeys - 1);
+	}
+
+	Matrix ReferenceLocal(const Rig& rig, uint32_t frame, float time, bool loop)
+	{
+		if( rig.KeySource[frame] < 0 || rig.NumKeys == 0 )
+			return rig.BindLocal[frame];
+
+		uint32_t k0, k1;
+		double w;
+		TickAt(rig, time, loop, k0, k1, w);
+
+		const DXUT::SDKANIMATION_DATA* keys = &rig.Keys[(size_t)rig.KeySource[frame]*rig.NumKeys];
+		double q0[4], q1[4];
+		KeyRotation(keys[k0], q0);
+		KeyRotation(keys[k1], q1);
+
+		// Normalized lerp along the shorter arc.
+		double dot = q0[0]*q1[0] + q0[1]*q1[1] + q0[2]*q1[2] + q0[3]*q1[3];
+		double sign = dot < 0.0 ? -1.0 : 1.0;
+		double q[4], length = 0.0;
+		for(int i = 0; i < 4; ++i)
+		{
+			q[i] = q0[i] + (q1[i]*sign - q0[i])*w;
+			length += q[i]*q[i];
+		}
+		for(int i = 0; i < 4; ++i)
+			q[i] /= std::sqrt(length);
+
+		const XMFLOAT3& t0 = keys[k0].Translation;
+		const XMFLOAT3& t1 = keys[k1].Translation;
+		double t[3] = { t0.x + (t1.x - t0.x)*w, t0.y + (t1.y - t0.y)*w, t0.z + (t1.z - t0.z)*w };
+		return ToMatrix(q, t);
+	}
+
+	Matrix ReferenceWorld(const Rig& rig, uint32_t frame, float time, bool loop)
+	{
+		Matrix local = ReferenceLocal(rig, frame, time, loop);
+		int32_t parent = rig.Parents[frame];
+		return parent < 0 ? local : Multiply(local, ReferenceWorld(rig, parent, time, loop));
+	}
+
+	// Largest difference relative to the largest element of the reference.
+	double RelativeError(const XMMATRIX& actual, const Matrix& expected)
+	{
+		XMFLOAT4X4 a;
+		XMStoreFloat4x4(&a, actual);
+
+		double scale = 1.0, error = 0.0;
+		for(int i = 0; i < 4; ++i)
+		{
+			for(int j = 0; j < 4; ++j)
+			{
+				scale = std::max(scale, std::fabs(expected.m[i][j]));
+				error = std::max(error, std::fabs(a.m[i][j] - expected.m[i][j]));
+			}
+		}
+		return error / scale;
+	}
+
+	// Worst errors of EvaluateWorld and mesh 0's palette at the given times.
+	void Compare(const Rig& rig, const ModelHierarchy& hierarchy, const std::vector<float>& times, bool loop,
+		double& worstWorld, double& worstPalette)
+	{
+		size_t numFrames = rig.Parents.size();
+		std::vector<XMMATRIX> world(numFrames), palette(rig.Influences.size() + 1);
+		for(size_t i = 0; i < times.size(); ++i)
+		{
+			hierarchy.EvaluateWorld(times[i], loop, world.data());
+			hierarchy.GetBonePalette(0, world.data(), palette.data());
+
+			std::vector<Matrix> expected(numFrames);
+			for(uint32_t j = 0; j < numFrames; ++j)
+			{
+				expected[j] = ReferenceWorld(rig, j, times[i], loop);
+				worstWorld = std::max(worstWorld, RelativeError(world[j], expected[j]));
+			}
+			for(size_t b = 0; b < rig.Influences.size(); ++b)
+			{
+				uint32_t j = rig.Influences[b];
+				worstPalette = std::max(worstPalette, RelativeError(palette[b], Multiply(rig.InvBindWorld[j], expected[j])));
+			}
+		}
+	}
+
+	void CheckRig(const char* name, std::mt19937& rng, uint32_t numFrames, uint32_t numKeys, uint32_t animatedPercent)
+	{
+		Rig rig;
+		MakeRig(rig, rng, numFrames, numKeys, animatedPercent);
+
+		std::unique_ptr<ModelHierarchy> hierarchy = ModelHierarchy::CreateFromSDKMESH(&rig.MeshFile[0], rig.MeshFile.size());
+		CHECK(hierarchy->GetFrameCount() == numFrames && hierarchy->GetMeshCount() == 2);
+		CHECK(hierarchy->FindFrame(L"frame0") == 0 && hierarchy->FindFrame(L"missing0") == -1);
+		CHECK(hierarchy->GetInfluenceCount(0) == rig.Influences.size() && hierarchy->GetInfluenceCount(1) == 0);
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			CHECK(hierarchy->GetFrameParent(j) == rig.Parents[j]);
+			CHECK(hierarchy->GetFrameMesh(j) == (j < 2 ? (int32_t)j : -1));
+		}
+		for(size_t b = 0; b < rig.Influences.size(); ++b)
+			CHECK(hierarchy->GetInfluenceFrame(0, b) == rig.Influences[b]);
+
+		// Without animation: the bind pose, and an identity palette.
+		CHECK(!hierarchy->HasAnimation() && hierarchy->GetAnimationDuration() == 0.0f);
+		std::vector<XMMATRIX> world(numFrames), palette(rig.Influences.size() + 1);
+		hierarchy->EvaluateWorld(0.5f, true, world.data());
+		hierarchy->GetBonePalette(0, world.data(), palette.data());
+		Matrix identity = { { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } } };
+		double worstBind = 0.0;
+		for(size_t b = 0; b < rig.Influences.size(); ++b)
+			worstBind = std::max(worstBind, RelativeError(palette[b], identity));
+		CHECK(worstBind < 1e-5);
+
+		hierarchy->LoadAnimation(&rig.AnimFile[0], rig.AnimFile.size());
+		size_t animated = 0;
+		for(uint32_t j = 0; j < numFrames; ++j)
+			animated += rig.KeySource[j] >= 0;
+		CHECK(hierarchy->HasAnimation() == (animated > 0 && numKeys > 0));
+		CHECK(hierarchy->GetAnimatedFrameCount() == (numKeys > 0 ? animated : 0));
+		float duration = numKeys >= 3 ? (numKeys - 2) / KeysPerSecond : 0.0f;
+		CHECK(hierarchy->GetAnimationDuration() == duration);
+
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<float> inside, outside;
+		for(int i = 0; i < 30; ++i)
+			inside.push_back(unit(rng)*duration);
+		outside.push_back(-1.0f);
+		outside.push_back(duration + 0.01f);
+		outside.push_back(duration*3.5f + 0.02f);
+		outside.push_back(-duration*2.25f);
+		outside.push_back(0.0f);
+		outside.push_back(duration);
+
+		double worstWorld = 0.0, worstPalette = 0.0;
+		Compare(rig, *hierarchy, inside, false, worstWorld, worstPalette);
+		Compare(rig, *hierarchy, inside, true, worstWorld, worstPalette);
+		Compare(rig, *hierarchy, outside, false, worstWorld, worstPalette);
+		Compare(rig, *hierarchy, outside, true, worstWorld, worstPalette);
+
+		// Deep chains gather error from every parent.
+		printf("%-24s %4u frames, %3u keys, %4zu animated: worst relative error %.2g bind, %.2g world, %.2g palette\n",
+			name, numFrames, numKeys, animated, worstBind, worstWorld, worstPalette);
+		CHECK(worstWorld < 1e-4);
+		CHECK(worstPalette < 1e-4);
+
+		bool threw = false;
+		try
+		{
+			hierarchy->GetBonePalette(2, world.data(), palette.data());
+		}
+		catch( const std::out_of_range& )
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// True if loading throws std::runtime_error, and nothing else.  A copy of just the
+	// data given, so reading past it is caught by the sanitizers.
+	bool RejectsMesh(const std::vector<uint8_t>& file, size_t size)
+	{
+		std::vector<uint8_t> prefix(file.begin(), file.begin() + size);
+		try
+		{
+			ModelHierarchy::CreateFromSDKMESH(size ? &prefix[0] : &file[0], size);
+		}
+		catch( const std::runtime_error& )
+		{
+			return true;
+		}
+		catch( ... )
+		{
+		}
+		return false;
+	}
+
+	bool RejectsAnimation(ModelHierarchy& hierarchy, const std::vector<uint8_t>& file, size_t size)
+	{
+		std::vector<uint8_t> prefix(file.begin(), file.begin() + size);
+		try
+		{
+			hierarchy.LoadAnimation(size ? &prefix[0] : &file[0], size);
+		}
+		catch( const std::runtime_error& )
+		{
+			return true;
+		}
+		catch( ... )
+		{
+		}
+		return false;
+	}
+
+	void CheckMalformed(std::mt19937& rng)
+	{
+		Rig rig;
+		MakeRig(rig, rng, 12, 6, 80);
+
+		// Every truncation of either file.  The influences are the last thing in the mesh
+		// file and the keys in the animation file, so every prefix is missing something.
+		size_t accepted = 0;
+		for(size_t size = 0; size < rig.MeshFile.size(); ++size)
+			accepted += !RejectsMesh(rig.MeshFile, size);
+		std::unique_ptr<ModelHierarchy> hierarchy = ModelHierarchy::CreateFromSDKMESH(&rig.MeshFile[0], rig.MeshFile.size());
+		for(size_t size = 0; size < rig.AnimFile.size(); ++size)
+			accepted += !RejectsAnimation(*hierarchy, rig.AnimFile, size);
+		CHECK(accepted == 0);
+
+		auto editFrame = [&](std::vector<uint8_t>& file, uint32_t j, void (*edit)(DXUT::SDKMESH_FRAME&))
+		{
+			DXUT::SDKMESH_HEADER header;
+			memcpy(&header, &file[0], sizeof(header));
+			DXUT::SDKMESH_FRAME frame;
+			size_t offset = (size_t)(header.FrameDataOffset + j*sizeof(frame));
+			memcpy(&frame, &file[offset], sizeof(frame));
+			edit(frame);
+			memcpy(&file[offset], &frame, sizeof(frame));
+		};
+
+		std::vector<uint8_t> bad = rig.MeshFile;
+		editFrame(bad, 3, [](DXUT::SDKMESH_FRAME& f) { f.ParentFrame = 12; });
+		CHECK(RejectsMesh(bad, bad.size()));
+
+		bad = rig.MeshFile;
+		editFrame(bad, 3, [](DXUT::SDKMESH_FRAME& f) { f.Mesh = 2; });
+		CHECK(RejectsMesh(bad, bad.size()));
+
+		// 4 -> 7 -> 4 never reaches a root.
+		bad = rig.MeshFile;
+		editFrame(bad, 4, [](DXUT::SDKMESH_FRAME& f) { f.ParentFrame = 7; });
+		editFrame(bad, 7, [](DXUT::SDKMESH_FRAME& f) { f.ParentFrame = 4; });
+		CHECK(RejectsMesh(bad, bad.size()));
+
+		bad = rig.MeshFile;
+		uint32_t frame = 12;
+		memcpy(&bad[bad.size() - sizeof(frame)], &frame, sizeof(frame));
+		CHECK(RejectsMesh(bad, bad.size()));
+
+		bad = rig.MeshFile;
+		DXUT::SDKMESH_HEADER header;
+		memcpy(&header, &bad[0], sizeof(header));
+		header.IsBigEndian = 1;
+		memcpy(&bad[0], &header, sizeof(header));
+		CHECK(RejectsMesh(bad, bad.size()));
+
+		// Offsets past the end, and far enough past to wrap around.
+		header.IsBigEndian = 0;
+		header.FrameDataOffset = bad.size() + 1;
+		memcpy(&bad[0], &header, sizeof(header));
+		CHECK(RejectsMesh(bad, bad.size()));
+		header.FrameDataOffset = UINT64_MAX - 8;
+		memcpy(&bad[0], &header, sizeof(header));
+		CHECK(RejectsMesh(bad, bad.size()));
+
+		DXUT::SDKANIMATION_FILE_HEADER animHeader;
+		bad = rig.AnimFile;
+		memcpy(&animHeader, &bad[0], sizeof(animHeader));
+		animHeader.FrameTransformType = DXUT::FTT_ABSOLUTE;
+		memcpy(&bad[0], &animHeader, sizeof(animHeader));
+		CHECK(RejectsAnimation(*hierarchy, bad, bad.size()));
+
+		animHeader.FrameTransformType = DXUT::FTT_RELATIVE;
+		animHeader.IsBigEndian = 1;
+		memcpy(&bad[0], &animHeader, sizeof(animHeader));
+		CHECK(RejectsAnimation(*hierarchy, bad, bad.size()));
+
+		// A key offset that wraps around past the end of the file.
+		bad = rig.AnimFile;
+		DXUT::SDKANIMATION_FRAME_DATA frameData;
+		memcpy(&frameData, &bad[sizeof(animHeader)], sizeof(frameData));
+		frameData.DataOffset = UINT64_MAX - 16;
+		memcpy(&bad[sizeof(animHeader)], &frameData, sizeof(frameData));
+		CHECK(RejectsAnimation(*hierarchy, bad, bad.size()));
+	}
+
+	// How DXUT's CDXUTSDKMesh::TransformFrame walks the tree: recursively over child and
+	// sibling links, reading each frame's keys where the file stores them, here with a
+	// slerp between ticks so it does the same work as ModelHierarchy.
+	struct DxutRig
+	{
+		std::vector<DXUT::SDKMESH_FRAME> Frames;
+		std::vector<const DXUT::SDKANIMATION_DATA*> Keys;	// per frame, or null
+		uint32_t NumKeys;
+	};
+
+	void TransformFrame(const DxutRig& rig, uint32_t frame, FXMMATRIX parentWorld, uint32_t k0, uint32_t k1, float w,
+		XMMATRIX* world)
+	{
+		while( frame != DXUT::INVALID_FRAME )
+		{
+			const DXUT::SDKMESH_FRAME& f = rig.Frames[frame];
+			XMMATRIX local;
+			if( rig.Keys[frame] )
+			{
+				const DXUT::SDKANIMATION_DATA& a = rig.Keys[frame][k0];
+				const DXUT::SDKANIMATION_DATA& b = rig.Keys[frame][k1];
+				XMVECTOR qa = XMLoadFloat4(&a.Orientation), qb = XMLoadFloat4(&b.Orientation);
+				if( XMVector4Equal(qa, XMVectorZero()) )
+					qa = XMQuaternionIdentity();
+				if( XMVector4Equal(qb, XMVectorZero()) )
+					qb = XMQuaternionIdentity();
+				XMVECTOR q = XMQuaternionSlerp(XMQuaternionNormalize(qa), XMQuaternionNormalize(qb), w);
+				XMVECTOR t = XMVectorLerp(XMLoadFloat3(&a.Translation), XMLoadFloat3(&b.Translation), w);
+				local = XMMatrixMultiply(XMMatrixRotationQuaternion(q),
+					XMMatrixTranslation(XMVectorGetX(t), XMVectorGetY(t), XMVectorGetZ(t)));
+			}
+			else
+			{
+				local = XMLoadFloat4x4(&f.Matrix);
+			}
+
+			world[frame] = XMMatrixMultiply(local, parentWorld);
+			if( f.ChildFrame != DXUT::INVALID_FRAME )
+				TransformFrame(rig, f.ChildFrame, world[frame], k0, k1, w, world);
+			frame = f.SiblingFrame;
+		}
+	}
+
+	void Benchmark(std::mt19937& rng, uint32_t numFrames)
+	{
+		const uint32_t numKeys = 120;
+		Rig rig;
+		MakeRig(rig, rng, numFrames, numKeys, 80);
+
+		std::unique_ptr<ModelHierarchy> hierarchy = ModelHierarchy::CreateFromSDKMESH(&rig.MeshFile[0], rig.MeshFile.size());
+		hierarchy->LoadAnimation(&rig.AnimFile[0], rig.AnimFile.size());
+
+		// Every frame a bone, so both sides build a full palette.
+		std::vector<XMMATRIX> world(numFrames), palette(numFrames);
+		std::vector<XMFLOAT4X4> invBind(numFrames);
+		for(uint32_t j = 0; j < numFrames; ++j)
+			invBind[j] = ToFloat(rig.InvBindWorld[j]);
+
+		DxutRig dxut;
+		dxut.NumKeys = numKeys;
+		dxut.Frames.resize(numFrames);
+		dxut.Keys.assign(numFrames, nullptr);
+		DXUT::SDKMESH_HEADER header;
+		memcpy(&header, &rig.MeshFile[0], sizeof(header));
+		memcpy(dxut.Frames.data(), &rig.MeshFile[(size_t)header.FrameDataOffset], numFrames*sizeof(DXUT::SDKMESH_FRAME));
+		for(uint32_t j = 0; j < numFrames; ++j)
+		{
+			if( rig.KeySource[j] >= 0 )
+				dxut.Keys[j] = &rig.Keys[(size_t)rig.KeySource[j]*numKeys];
+		}
+
+		const int runs = 2000 * 64 / numFrames;
+		float duration = hierarchy->GetAnimationDuration();
+
+		double t0 = TestSeconds();
+		for(int r = 0; r < runs; ++r)
+		{
+			hierarchy->EvaluateWorld(duration*r/runs, true, world.data());
+			for(uint32_t j = 0; j < numFrames; ++j)
+				palette[j] = XMMatrixMultiply(XMLoadFloat4x4(&invBind[j]), world[j]);
+		}
+		double seconds = (TestSeconds() - t0) / runs;
+
+		double t1 = TestSeconds();
+		for(int r = 0; r < runs; ++r)
+		{
+			uint32_t k0, k1;
+			double w;
+			TickAt(rig, duration*r/runs, true, k0, k1, w);
+			for(uint32_t j = 0; j < numFrames; ++j)
+			{
+				if( rig.Parents[j] < 0 )
+					TransformFrame(dxut, j, XMMatrixIdentity(), k0, k1, (float)w, world.data());
+			}
+			for(uint32_t j = 0; j < numFrames; ++j)
+				palette[j] = XMMatrixMultiply(XMLoadFloat4x4(&invBind[j]), world[j]);
+		}
+		double dxutSeconds = (TestSeconds() - t1) / runs;
+
+		printf("%4u frames, %u keys at %.0f/s, 80%% animated: %7.2f us per pose and palette, DXUT-style walk %7.2f us (%.1fx)\n",
+			numFrames, numKeys, KeysPerSecond, seconds*1e6, dxutSeconds*1e6, dxutSeconds / seconds);
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(5);
+
+	CheckRig("one frame", rng, 1, 10, 100);
+	CheckRig("no keys", rng, 16, 0, 80);
+	CheckRig("one key", rng, 16, 1, 80);
+	CheckRig("two keys", rng, 16, 2, 80);
+	CheckRig("64 frames", rng, 64, 120, 80);
+	CheckRig("odd lanes", rng, 67, 9, 50);
+	CheckRig("256 frames", rng, 256, 40, 80);
+	CheckMalformed(rng);
+
+	Benchmark(rng, 64);
+	Benchmark(rng, 256);
+	Benchmark(rng, 1024);
+
+	return TestResult("ModelHierarchyTest");
+}
@@ -0,0 +1,368 @@
+//***************************************************************************************
+// ModelLoaderTest.cpp
+//
+// ModelLoader on the stub device.  A model it loads must have the same meshes, parts
+// and buffer contents as the same file parsed and created on the calling thread, with
+// and without levels of detail, and its effect factory must only be used on the
+// owning thread.  A second request for a file still loading must share the pending
+// load and one with other options must not; a missing or empty file and a future from
+// elsewhere must report their errors; Shutdown with loads queued must break their
+// promises; and Load from four threads while the owner flushes must complete every
+// request.  Also prints the time to load 48 copies of needle01.cmo on the calling
+// thread and through the loader with 1, 2, 4 and 8 workers.
+//***************************************************************************************
+
+#include "ModelLoader.h"
+#include "Effects.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	class TestEffect : public IEffect
+	{
+	public:
+		void __cdecl Apply(ID3D11DeviceContext*) override {}
+
+		void __cdecl GetVertexShaderBytecode(void const** pShaderByteCode, size_t* pByteCodeLength) override
+		{
+			static const BYTE bytecode[4] = {};
+			*pShaderByteCode = bytecode;
+			*pByteCodeLength = sizeof(bytecode);
+		}
+	};
+
+	// Hands out plain effects and counts calls made from any thread but the owner's.
+	class TestEffectFactory : public IEffectFactory
+	{
+	public:
+		TestEffectFactory() : Owner(std::this_thread::get_id()), Effects(0), WrongThread(0) {}
+
+		std::shared_ptr<IEffect> __cdecl CreateEffect(const EffectInfo&, ID3D11DeviceContext*) override
+		{
+			if( std::this_thread::get_id() != Owner )
+				++WrongThread;
+			++Effects;
+			return std::make_shared<TestEffect>();
+		}
+
+		void __cdecl CreateTexture(const wchar_t*, ID3D11DeviceContext*, ID3D11ShaderResourceView** textureView) override
+		{
+			if( std::this_thread::get_id() != Owner )
+				++WrongThread;
+			*textureView = nullptr;
+		}
+
+		std::thread::id Owner;
+		std::atomic<int> Effects;
+		std::atomic<int> WrongThread;
+	};
+
+	std::wstring ModelPath(const char* name)
+	{
+		std::string path = std::string(TEST_MODEL_DIR) + "/" + name;
+		return std::wstring(path.begin(), path.end());
+	}
+
+	// Copies of a model under new names, so each is a separate load.
+	std::vector<std::wstring> CopyModel(const char* name, const char* prefix, int copies)
+	{
+		MappedFile source;
+		source.Open(ModelPath(name).c_str());
+
+		std::vector<std::wstring> names;
+		for(int i = 0; i < copies; ++i)
+		{
+			char copyName[64];
+			snprintf(copyName, sizeof(copyName), "%s%02d.cmo", prefix, i);
+			FILE* file = fopen(copyName, "wb");
+			if( file )
+			{
+				fwrite(source.GetData(), 1, source.GetSize(), file);
+				fclose(file);
+			}
+			names.push_back(std::wstring(copyName, copyName + strlen(copyName)));
+		}
+		return names;
+	}
+
+	void RemoveFiles(const std::vector<std::wstring>& names)
+	{
+		for(size_t i = 0; i < names.size(); ++i)
+			remove(std::string(names[i].begin(), names[i].end()).c_str());
+	}
+
+	// What the loader does for a .cmo, done on the calling thread.
+	std::unique_ptr<Model> CreateSerial(ID3D11Device* device, IEffectFactory& factory, const std::wstring& path, bool generateLODs)
+	{
+		MappedFile file;
+		file.Open(path.c_str());
+
+		uint32_t flags = ModelData::ParseFlags_BakeUVTransform | ModelData::ParseFlags_OptimizeMeshes;
+		if( generateLODs )
+			flags |= ModelData::ParseFlags_GenerateLODs;
+		std::unique_ptr<ModelData> data = ModelData::ParseCMO(file.GetData(), file.GetSize(), flags);
+		return Model::CreateFromModelData(device, *data, factory, true, false);
+	}
+
+	bool SameBuffer(ID3D11Buffer* a, ID3D11Buffer* b)
+	{
+		return a && b && a->Contents == b->Contents && a->Desc.ByteWidth == b->Desc.ByteWidth &&
+			a->Desc.BindFlags == b->Desc.BindFlags;
+	}
+
+	bool SamePart(const ModelMeshPart& a, const ModelMeshPart& b)
+	{
+		return a.indexCount == b.indexCount && a.startIndex == b.startIndex && a.vertexOffset == b.vertexOffset &&
+			a.vertexStride == b.vertexStride && a.primitiveType == b.primitiveType && a.indexFormat == b.indexFormat &&
+			a.isAlpha == b.isAlpha && a.inputLayout && a.effect && SameBuffer(a.indexBuffer.Get(), b.indexBuffer.Get()) &&
+			SameBuffer(a.vertexBuffer.Get(), b.vertexBuffer.Get());
+	}
+
+	bool SameParts(const ModelMeshPart::Collection& a, const ModelMeshPart::Collection& b)
+	{
+		if( a.size() != b.size() )
+			return false;
+		for(size_t i = 0; i < a.size(); ++i)
+		{
+			if( !SamePart(*a[i], *b[i]) )
+				return false;
+		}
+		return true;
+	}
+
+	bool SameModel(const Model& a, const Model& b)
+	{
+		if( a.meshes.size() != b.meshes.size() )
+			return false;
+		for(size_t m = 0; m < a.meshes.size(); ++m)
+		{
+			const ModelMesh& x = *a.meshes[m];
+			const ModelMesh& y = *b.meshes[m];
+			if( x.name != y.name || x.ccw != y.ccw || x.pmalpha != y.pmalpha || x.lodErrors != y.lodErrors ||
+				memcmp(&x.boundingSphere, &y.boundingSphere, sizeof(BoundingSphere)) != 0 ||
+				!SameParts(x.meshParts, y.meshParts) || x.lodParts.size() != y.lodParts.size() )
+			{
+				return false;
+			}
+			for(size_t l = 0; l < x.lodParts.size(); ++l)
+			{
+				if( !SameParts(x.lodParts[l], y.lodParts[l]) )
+					return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename Fn>
+	bool Throws(Fn fn)
+	{
+		try
+		{
+			fn();
+		}
+		catch( ... )
+		{
+			return true;
+		}
+		return false;
+	}
+
+	void CheckModels(ID3D11Device* device)
+	{
+		TestEffectFactory factory;
+		ModelLoader loader;
+		loader.Init(device, &factory, 2);
+
+		const char* names[] = { "snowhouse2.cmo", "needle01.cmo" };
+		for(int lods = 0; lods < 2; ++lods)
+		{
+			for(size_t n = 0; n < 2; ++n)
+			{
+				std::shared_ptr<Model> loaded = loader.Wait(loader.Load(ModelPath(names[n]), lods != 0));
+				std::unique_ptr<Model> serial = CreateSerial(device, factory, ModelPath(names[n]), lods != 0);
+				CHECK(loaded && loaded->name == ModelPath(names[n]));
+				CHECK(!loaded->meshes.empty());
+				CHECK(SameModel(*loaded, *serial));
+				if( lods )
+					CHECK(!loaded->meshes[0]->lodParts.empty());
+			}
+		}
+
+		// Requests made while a load is pending share it, unless the options differ.
+		ModelLoader::ModelFuture first = loader.Load(ModelPath("needle01.cmo"));
+		ModelLoader::ModelFuture second = loader.Load(ModelPath("NEEDLE01.CMO"));
+		ModelLoader::ModelFuture other = loader.Load(ModelPath("needle01.cmo"), true);
+		ModelLoader::ModelFuture cw = loader.Load(ModelPath("needle01.cmo"), ModelLoader::Format_CMO, false);
+		CHECK(loader.GetStats().RequestsShared == 1);
+		loader.Flush();
+		CHECK(first.get() == second.get());
+		CHECK(first.get() != other.get() && first.get() != cw.get() && other.get() != cw.get());
+		CHECK(!cw.get()->meshes[0]->ccw);
+
+		// Errors reach the future; a future the loader did not make is refused.
+		ModelLoader::ModelFuture missing = loader.Load(L"ModelLoaderTest.missing.cmo");
+		CHECK(Throws([&]{ loader.Wait(missing); }));
+		FILE* file = fopen("ModelLoaderTest.empty.cmo", "wb");
+		if( file )
+			fclose(file);
+		ModelLoader::ModelFuture empty = loader.Load(L"ModelLoaderTest.empty.cmo");
+		CHECK(Throws([&]{ loader.Wait(empty); }));
+		remove("ModelLoaderTest.empty.cmo");
+
+		std::promise<std::shared_ptr<Model>> foreign;
+		ModelLoader::ModelFuture foreignFuture = foreign.get_future().share();
+		bool refused = false;
+		try
+		{
+			loader.Wait(foreignFuture);
+		}
+		catch( const std::logic_error& )
+		{
+			refused = true;
+		}
+		CHECK(refused);
+
+		ModelLoader::Stats stats = loader.GetStats();
+		CHECK(stats.Queued == 0 && stats.Parsing == 0 && stats.Parsed == 0);
+		CHECK(factory.WrongThread == 0);
+	}
+
+	// Loads dropped by Shutdown report std::future_error.
+	void CheckShutdown(ID3D11Device* device, const std::vector<std::wstring>& names)
+	{
+		TestEffectFactory factory;
+		ModelLoader loader;
+		loader.Init(device, &factory, 1);
+
+		std::vector<ModelLoader::ModelFuture> futures;
+		for(size_t i = 0; i < names.size(); ++i)
+			futures.push_back(loader.Load(names[i]));
+		loader.Shutdown();
+
+		size_t broken = 0;
+		for(size_t i = 0; i < futures.size(); ++i)
+		{
+			try
+			{
+				futures[i].get();
+			}
+			catch( const std::future_error& )
+			{
+				++broken;
+			}
+		}
+		CHECK(broken == futures.size());
+		CHECK(factory.Effects == 0);
+	}
+
+	// Four threads request the same files while the owner creates what they load.
+	void CheckThreads(ID3D11Device* device, const std::vector<std::wstring>& names)
+	{
+		TestEffectFactory factory;
+		ModelLoader loader;
+		loader.Init(device, &factory, 4);
+
+		const int numThreads = 4;
+		std::vector<std::vector<ModelLoader::ModelFuture>> futures(numThreads);
+		std::atomic<int> running(numThreads);
+		std::vector<std::thread> threads;
+		for(int t = 0; t < numThreads; ++t)
+		{
+			threads.push_back(std::thread([&, t]
+			{
+				for(size_t i = 0; i < names.size(); ++i)
+					futures[t].push_back(loader.Load(names[(i + t*5) % names.size()]));
+				--running;
+			}));
+		}
+		while( running > 0 )
+			loader.Update();
+		for(int t = 0; t < numThreads; ++t)
+			threads[t].join();
+		loader.Flush();
+
+		std::set<Model*> models;
+		size_t ready = 0;
+		for(int t = 0; t < numThreads; ++t)
+		{
+			for(size_t i = 0; i < futures[t].size(); ++i)
+			{
+				if( futures[t][i].wait_for(std::chrono::seconds(0)) == std::future_status::ready && futures[t][i].get() )
+				{
+					++ready;
+					models.insert(futures[t][i].get().get());
+				}
+			}
+		}
+		ModelLoader::Stats stats = loader.GetStats();
+		CHECK(ready == numThreads*names.size());
+		CHECK(stats.LoadsCompleted == models.size());
+		CHECK(stats.LoadsCompleted + stats.RequestsShared == numThreads*names.size());
+		CHECK(factory.WrongThread == 0);
+	}
+
+	void Benchmark(ID3D11Device* device, const std::vector<std::wstring>& names, bool generateLODs)
+	{
+		TestEffectFactory factory;
+
+		// The file cache is warm from the checks; one more pass makes sure of it.
+		double serial = 1e30;
+		for(int run = 0; run < 2; ++run)
+		{
+			double t0 = TestSeconds();
+			for(size_t i = 0; i < names.size(); ++i)
+				CreateSerial(device, factory, names[i], generateLODs);
+			serial = std::min(serial, TestSeconds() - t0);
+		}
+		printf("%zu x needle01.cmo%s: calling thread %8.1f ms\n", names.size(), generateLODs ? " with LODs" : "",
+			serial*1000.0);
+
+		const UINT workers[] = { 1, 2, 4, 8 };
+		for(size_t w = 0; w < sizeof(workers)/sizeof(workers[0]); ++w)
+		{
+			ModelLoader loader;
+			loader.Init(device, &factory, workers[w]);
+
+			double t0 = TestSeconds();
+			std::vector<ModelLoader::ModelFuture> futures;
+			for(size_t i = 0; i < names.size(); ++i)
+				futures.push_back(loader.Load(names[i], generateLODs));
+			loader.Flush();
+			double seconds = TestSeconds() - t0;
+
+			CHECK(loader.GetStats().LoadsCompleted == names.size());
+			printf("%zu x needle01.cmo%s: %u worker%s %11.1f ms, %5.2fx (%u hardware threads)\n", names.size(),
+				generateLODs ? " with LODs" : "", workers[w], workers[w] == 1 ? " " : "s", seconds*1000.0,
+				serial / seconds, std::thread::hardware_concurrency());
+		}
+	}
+}
+
+int main()
+{
+	ComPtr<ID3D11Device> device;
+	device.Attach(new ID3D11Device);
+
+	CheckModels(device.Get());
+
+	std::vector<std::wstring> few = CopyModel("snowhouse2.cmo", "ModelLoaderTest.house", 24);
+	CheckShutdown(device.Get(), few);
+	CheckThreads(device.Get(), few);
+	RemoveFiles(few);
+
+	std::vector<std::wstring> copies = CopyModel("needle01.cmo", "ModelLoaderTest.needle", 48);
+	Benchmark(device.Get(), copies, false);
+	Benchmark(device.Get(), std::vector<std::wstring>(copies.begin(), copies.begin() + 8), true);
+	RemoveFiles(copies);
+
+	return TestResult("ModelLoaderTest");
+}
@@ -0,0 +1,362 @@
+//***************************************************************************************
+// ParticleSimulatorTest.cpp
+//
+// ParticleSimulator must stream out exactly what StreamOutGS in Snow.fx does, written
+// here one particle at a time: emitters fire five flares ahead of themselves once
+// their age passes 2ms, flares die after three seconds and whatever does not fit in
+// the buffer is dropped from the end.  Also measures the peak particle count for a
+// range of frame rates, which is what SnowSceneApp sizes its buffers from, and the
+// update rate at 5k, 100k and 1M particles.
+//***************************************************************************************
+
+#include "ParticleSimulator.h"
+#include "ThreadPool.h"
+#include "TestUtil.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	typedef ParticleSimulator::Particle Particle;
+
+	const float EmitInterval  = 0.002f;
+	const float FlareLifetime = 3.0f;
+	const UINT  FlaresPerEmit = 5;
+
+	// StreamOutGS and the stream-out target, one particle at a time.
+	class ReferenceSnow
+	{
+	public:
+		ReferenceSnow(UINT maxParticles, const std::vector<XMFLOAT4>& randomValues)
+		: mMaxParticles(maxParticles), mOverflow(0), mFirstRun(true), mRandomValues(randomValues)
+		{
+			mEmitPos = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		}
+
+		void SetEmitPos(const XMFLOAT3& emitPos) { mEmitPos = emitPos; }
+
+		void SetParticles(const std::vector<Particle>& particles)
+		{
+			mParticles.assign(particles.begin(), particles.begin() + (particles.size() < mMaxParticles ? particles.size() : mMaxParticles));
+			mFirstRun = false;
+		}
+
+		void Update(float dt, float gameTime)
+		{
+			if( mFirstRun )
+			{
+				Particle emitter;
+				memset(&emitter, 0, sizeof(emitter));
+				mParticles.assign(1, emitter);
+				mFirstRun = false;
+			}
+
+			std::vector<Particle> out;
+			mOverflow = 0;
+			for(size_t i = 0; i < mParticles.size(); ++i)
+			{
+				Particle p = mParticles[i];
+				p.Age += dt;
+
+				if( p.Type == ParticleSimulator::PT_Emitter )
+				{
+					if( p.Age > EmitInterval )
+					{
+						for(UINT k = 0; k < FlaresPerEmit; ++k)
+						{
+							XMFLOAT3 r = RandVec3(gameTime, (float)k/5.0f);
+
+							Particle f;
+							f.InitialPos = XMFLOAT3(mEmitPos.x + 35.0f*r.x, mEmitPos.y + 20.0f, mEmitPos.z + 35.0f*r.z);
+							f.InitialVel = XMFLOAT3(0.0f, 0.0f, 0.0f);
+							f.Size = XMFLOAT2(1.0f, 1.0f);
+							f.Age  = 0.0f;
+							f.Type = ParticleSimulator::PT_Flare;
+							Append(out, f);
+						}
+						p.Age = 0.0f;
+					}
+					Append(out, p);
+				}
+				else if( p.Age <= FlareLifetime )
+				{
+					Append(out, p);
+				}
+			}
+			mParticles.swap(out);
+		}
+
+		const std::vector<Particle>& Particles()const { return mParticles; }
+		UINT Overflow()const { return mOverflow; }
+
+	private:
+		void Append(std::vector<Particle>& out, const Particle& p)
+		{
+			if( out.size() < mMaxParticles )
+				out.push_back(p);
+			else
+				++mOverflow;
+		}
+
+		// gRandomTex.SampleLevel with linear filtering and wrap addressing.
+		XMFLOAT3 RandVec3(float gameTime, float offset)const
+		{
+			int n = (int)mRandomValues.size();
+			float x = (gameTime + offset)*n - 0.5f;
+			float fx = floorf(x);
+			float s = x - fx;
+
+			int i0 = ((int)fx % n + n) % n;
+			int i1 = (i0 + 1) % n;
+			const XMFLOAT4& a = mRandomValues[i0];
+			const XMFLOAT4& b = mRandomValues[i1];
+			return XMFLOAT3(a.x + (b.x - a.x)*s, a.y + (b.y - a.y)*s, a.z + (b.z - a.z)*s);
+		}
+
+		UINT mMaxParticles;
+		UINT mOverflow;
+		bool mFirstRun;
+		XMFLOAT3 mEmitPos;
+		std::vector<XMFLOAT4> mRandomValues;
+		std::vector<Particle> mParticles;
+	};
+
+	std::vector<XMFLOAT4> MakeRandomValues(unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+		std::vector<XMFLOAT4> values(ParticleSimulator::RandomTexSize);
+		for(size_t i = 0; i < values.size(); ++i)
+			values[i] = XMFLOAT4(dist(rng), dist(rng), dist(rng), dist(rng));
+		return values;
+	}
+
+	// count particles, one emitter in emitterEvery, ages spread over a flare's life
+	// (and past it, when maxAge > FlareLifetime).
+	std::vector<Particle> MakeParticles(UINT count, UINT emitterEvery, float maxAge, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		std::vector<Particle> particles(count);
+		for(UINT i = 0; i < count; ++i)
+		{
+			Particle& p = particles[i];
+			bool emitter = (rng() % emitterEvery) == 0;
+			p.InitialPos = XMFLOAT3(unit(rng)*100.0f - 50.0f, 20.0f + unit(rng), unit(rng)*100.0f - 50.0f);
+			p.InitialVel = XMFLOAT3(unit(rng) - 0.5f, -unit(rng), unit(rng) - 0.5f);
+			p.Size = XMFLOAT2(1.0f, 1.0f);
+			p.Age  = emitter ? unit(rng)*1.5f*EmitInterval : unit(rng)*maxAge;
+			p.Type = emitter ? ParticleSimulator::PT_Emitter : ParticleSimulator::PT_Flare;
+		}
+		return particles;
+	}
+
+	bool SameParticles(const ParticleSimulator& sim, const ReferenceSnow& ref)
+	{
+		std::vector<Particle> actual;
+		sim.GetParticles(actual);
+
+		const std::vector<Particle>& expected = ref.Particles();
+		if( actual.size() != expected.size() )
+		{
+			printf("  %zu particles, StreamOutGS gives %zu\n", actual.size(), expected.size());
+			return false;
+		}
+
+		for(size_t i = 0; i < actual.size(); ++i)
+		{
+			if( memcmp(&actual[i], &expected[i], sizeof(Particle)) != 0 )
+			{
+				printf("  particle %zu: type %u age %.9g pos (%.9g %.9g %.9g), StreamOutGS gives type %u age %.9g pos (%.9g %.9g %.9g)\n",
+					i, actual[i].Type, actual[i].Age, actual[i].InitialPos.x, actual[i].InitialPos.y, actual[i].InitialPos.z,
+					expected[i].Type, expected[i].Age, expected[i].InitialPos.x, expected[i].InitialPos.y, expected[i].InitialPos.z);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Runs both for a number of passes with random steps, comparing after each one.
+	void CheckAgainstReference(ParticleSimulator& sim, ReferenceSnow& ref, UINT passes, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> step(0.0005f, 0.05f);
+
+		float gameTime = 10.0f;
+		for(UINT pass = 0; pass < passes; ++pass)
+		{
+			float dt = step(rng);
+			gameTime += dt;
+
+			XMFLOAT3 emitPos((float)pass, 2.0f, -(float)pass);
+			sim.SetEmitPos(emitPos);
+			ref.SetEmitPos(emitPos);
+
+			sim.Update(dt, gameTime);
+			ref.Update(dt, gameTime);
+
+			bool same = SameParticles(sim, ref);
+			CHECK(same);
+			CHECK(sim.GetOverflowCount() == ref.Overflow());
+			if( !same )
+				break;
+		}
+	}
+
+	double Best(double a, double b)
+	{
+		return a < b ? a : b;
+	}
+}
+
+int main()
+{
+	ThreadPool pool;
+	pool.Init(4);
+
+	std::vector<XMFLOAT4> randomValues = MakeRandomValues(7);
+
+	// Emit, age, kill and clip on a single emitter.
+	{
+		ParticleSimulator sim;
+		sim.Init(8, &pool);
+		sim.SetRandomValues(&randomValues[0], (UINT)randomValues.size());
+
+		// The first pass starts from the initialization emitter, which is too young to fire.
+		sim.Update(0.001f, 1.0f);
+		CHECK(sim.GetParticleCount() == 1);
+		CHECK(sim.GetType()[0] == ParticleSimulator::PT_Emitter);
+		CHECK(sim.GetAge()[0] == 0.001f);
+
+		// Past 2ms it fires five flares ahead of itself and starts again.
+		sim.Update(0.0015f, 1.0015f);
+		CHECK(sim.GetParticleCount() == 6);
+		for(UINT i = 0; i < 5; ++i)
+			CHECK(sim.GetType()[i] == ParticleSimulator::PT_Flare && sim.GetAge()[i] == 0.0f);
+		CHECK(sim.GetType()[5] == ParticleSimulator::PT_Emitter && sim.GetAge()[5] == 0.0f);
+
+		// Firing again needs more room than there is; the emitter itself is dropped.
+		sim.Update(0.0025f, 1.004f);
+		CHECK(sim.GetParticleCount() == 8);
+		CHECK(sim.GetOverflowCount() == 3);
+		for(UINT i = 0; i < 8; ++i)
+			CHECK(sim.GetType()[i] == ParticleSimulator::PT_Flare);
+
+		// Flares live for three seconds exactly.
+		Particle flares[2];
+		memset(flares, 0, sizeof(flares));
+		flares[0].Type = flares[1].Type = ParticleSimulator::PT_Flare;
+		flares[0].Age = 2.75f;
+		flares[1].Age = 2.875f;
+		sim.SetParticles(flares, 2);
+		sim.Update(0.25f, 2.0f);
+		CHECK(sim.GetParticleCount() == 1);
+		CHECK(sim.GetAge()[0] == 3.0f);
+	}
+
+	// Bit for bit against StreamOutGS, from the initialization emitter and from a
+	// store spanning many chunks that overflows.
+	{
+		ParticleSimulator sim;
+		sim.Init(4096, &pool);
+		sim.SetRandomValues(&randomValues[0], (UINT)randomValues.size());
+		ReferenceSnow ref(4096, randomValues);
+		CheckAgainstReference(sim, ref, 400, 3);
+	}
+	{
+		const UINT capacity = 30000;
+		std::vector<Particle> particles = MakeParticles(capacity - 200, 50, 3.05f, 5);
+
+		ParticleSimulator sim;
+		sim.Init(capacity, &pool);
+		sim.SetRandomValues(&randomValues[0], (UINT)randomValues.size());
+		sim.SetParticles(&particles[0], (UINT)particles.size());
+		ReferenceSnow ref(capacity, randomValues);
+		ref.SetParticles(particles);
+		CheckAgainstReference(sim, ref, 60, 11);
+	}
+
+	// Positions follow the constant acceleration equation in DrawVS.
+	{
+		std::vector<Particle> particles = MakeParticles(10001, 20, 3.0f, 13);
+
+		ParticleSimulator sim;
+		sim.Init((UINT)particles.size(), &pool);
+		sim.SetAcceleration(XMFLOAT3(-1.0f, -9.8f, 0.5f));
+		sim.SetParticles(&particles[0], (UINT)particles.size());
+		sim.ComputePositions();
+
+		int mismatches = 0;
+		for(size_t i = 0; i < particles.size(); ++i)
+		{
+			const Particle& p = particles[i];
+			float t = p.Age;
+			float x = 0.5f*t*t*-1.0f + t*p.InitialVel.x + p.InitialPos.x;
+			float y = 0.5f*t*t*-9.8f + t*p.InitialVel.y + p.InitialPos.y;
+			float z = 0.5f*t*t*0.5f  + t*p.InitialVel.z + p.InitialPos.z;
+			if( fabsf(sim.GetPosX()[i] - x) > 1e-4f || fabsf(sim.GetPosY()[i] - y) > 1e-4f || fabsf(sim.GetPosZ()[i] - z) > 1e-4f )
+				++mismatches;
+		}
+		CHECK(mismatches == 0);
+	}
+
+	// Peak snow for a range of frame times.  The emitter fires at most once per 2ms,
+	// so the count can never pass FlaresPerEmit flares per 2ms of flare life.
+	{
+		const UINT bound = (UINT)(FlareLifetime / EmitInterval)*FlaresPerEmit + FlaresPerEmit + 1;
+
+		ParticleSimulator sim;
+		sim.Init(2*bound, &pool);
+
+		const float frameTimes[] = { 1.0f/30.0f, 1.0f/60.0f, 1.0f/144.0f, 1.0f/240.0f, 0.0025f, 0.00201f, 0.002f, 0.001f, 0.0005f };
+		UINT worst = 0;
+		for(size_t i = 0; i < sizeof(frameTimes)/sizeof(frameTimes[0]); ++i)
+		{
+			UINT peak = sim.MeasurePeakCount(frameTimes[i], 4.0f);
+			printf("%7.2f ms frames: peak %u particles\n", frameTimes[i]*1000.0f, peak);
+			CHECK(peak <= bound);
+			CHECK(sim.GetOverflowCount() == 0);
+			worst = peak > worst ? peak : worst;
+		}
+		printf("worst case %u particles, bound %u\n", worst, bound);
+	}
+
+	// Update and position throughput at steady state sizes: flares young enough to
+	// survive the pass, one emitter per thousand particles.
+	const UINT sizes[] = { 5000, 100000, 1000000 };
+	for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+	{
+		UINT count = sizes[s];
+		std::vector<Particle> particles = MakeParticles(count, 1000, 2.9f, 17);
+
+		ParticleSimulator sim;
+		sim.Init(count + count/100, &pool);
+
+		int runs = count >= 1000000 ? 10 : 50;
+		double update = 1e30, positions = 1e30;
+		for(int run = 0; run < runs; ++run)
+		{
+			sim.SetParticles(&particles[0], count);
+
+			double t0 = TestSeconds();
+			sim.Update(1.0f/60.0f, 5.0f);
+			double t1 = TestSeconds();
+			sim.ComputePositions();
+			double t2 = TestSeconds();
+
+			update = Best(update, t1 - t0);
+			positions = Best(positions, t2 - t1);
+		}
+
+		printf("%8u particles: update %7.1f M particles/s, positions %7.1f M particles/s (%u threads)\n",
+			count, count/update*1e-6, sim.GetParticleCount()/positions*1e-6, pool.ThreadCount());
+	}
+
+	pool.Shutdown();
+	return TestResult("ParticleSimulatorTest");
+}
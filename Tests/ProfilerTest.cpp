@@ -0,0 +1,226 @@
+//***************************************************************************************
+// ProfilerTest.cpp
+//
+// Checks that scopes are keyed by parent and name, that calls and times are counted,
+// that EndFrame() and WriteChromeTrace() can run while other threads record (build with
+// -DTESTS_SANITIZE=thread to check the latter), that threads which exit hand their
+// buffers on, and reports the cost of a scope.
+//***************************************************************************************
+
+#include "Profiler.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const Profiler::ScopeStats* FindStats(const std::vector<Profiler::ScopeStats>& stats, size_t first, const char* name)
+	{
+		for(size_t i = first; i < stats.size(); ++i)
+		{
+			if( strcmp(stats[i].Name, name) == 0 )
+				return &stats[i];
+		}
+		return 0;
+	}
+
+	void Leaf()
+	{
+		PROFILE_SCOPE("Leaf");
+	}
+
+	void BusyWait(double seconds)
+	{
+		double start = TestSeconds();
+		while( TestSeconds() - start < seconds )
+		{
+		}
+	}
+}
+
+int main()
+{
+	Profiler& profiler = Profiler::Default();
+	std::vector<Profiler::ScopeStats> stats;
+
+	// The same name under two parents is two scopes, listed under each parent.
+	profiler.Reset();
+	{
+		PROFILE_SCOPE("Update");
+		Leaf();
+		Leaf();
+	}
+	{
+		PROFILE_SCOPE("Draw");
+		Leaf();
+		{
+			PROFILE_SCOPE("Draw");
+			Leaf();
+		}
+	}
+	profiler.EndFrame();
+	profiler.GetStats(stats);
+
+	const char* expectedNames[] = { "Frame", "Update", "Leaf", "Draw", "Leaf", "Draw", "Leaf" };
+	const UINT expectedDepths[] = { 0, 1, 2, 1, 2, 2, 3 };
+	const UINT expectedCalls[]  = { 1, 1, 2, 1, 1, 1, 1 };
+	const size_t numExpected = sizeof(expectedNames)/sizeof(expectedNames[0]);
+	CHECK(stats.size() == numExpected);
+	for(size_t i = 0; i < numExpected && i < stats.size(); ++i)
+	{
+		CHECK(strcmp(stats[i].Name, expectedNames[i]) == 0);
+		CHECK(stats[i].Depth == expectedDepths[i]);
+		CHECK(stats[i].Calls == expectedCalls[i]);
+	}
+
+	// Times are in milliseconds of the calibrated clock.
+	profiler.Reset();
+	{
+		PROFILE_SCOPE("Wait");
+		BusyWait(0.005);
+	}
+	profiler.EndFrame();
+	profiler.GetStats(stats);
+	const Profiler::ScopeStats* wait = FindStats(stats, 0, "Wait");
+	CHECK(wait != 0);
+	if( wait )
+	{
+		printf("5 ms busy wait measured %.3f ms\n", wait->LastMs);
+		CHECK(wait->LastMs > 4.5f && wait->LastMs < 50.0f);
+	}
+
+	// Disabled scopes record nothing.
+	profiler.Reset();
+	profiler.SetEnabled(false);
+	Leaf();
+	profiler.SetEnabled(true);
+	profiler.EndFrame();
+	profiler.GetStats(stats);
+	CHECK(FindStats(stats, 0, "Leaf") == 0);
+
+	// Workers record as fast as they can, wrapping their rings many times, while
+	// this thread closes frames and writes traces.
+	profiler.Reset();
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> workers;
+	for(int w = 0; w < 3; ++w)
+	{
+		workers.push_back(std::thread([&stop]()
+		{
+			while( !stop.load() )
+			{
+				PROFILE_SCOPE("Worker");
+				for(int i = 0; i < 64; ++i)
+					Leaf();
+			}
+		}));
+	}
+
+	int badStats = 0;
+	for(int frame = 0; frame < 50; ++frame)
+	{
+		BusyWait(0.002);
+		profiler.EndFrame();
+		profiler.GetStats(stats);
+		for(size_t i = 0; i < stats.size(); ++i)
+		{
+			bool known = strcmp(stats[i].Name, "Frame") == 0 || strcmp(stats[i].Name, "Worker") == 0 ||
+				strcmp(stats[i].Name, "Leaf") == 0;
+			if( !known || stats[i].Depth > 2 )
+				++badStats;
+		}
+
+		if( frame % 10 == 0 )
+			CHECK(profiler.WriteChromeTrace(L"ProfilerTest.json"));
+	}
+
+	stop.store(true);
+	for(size_t w = 0; w < workers.size(); ++w)
+		workers[w].join();
+
+	CHECK(badStats == 0);
+	CHECK(FindStats(stats, 0, "Worker") != 0);
+
+	// Slots being overwritten during a concurrent dump are left out, so only check
+	// the contents once the workers are done.
+	CHECK(profiler.WriteChromeTrace(L"ProfilerTest.json"));
+	{
+		std::ifstream in("ProfilerTest.json");
+		std::stringstream text;
+		text << in.rdbuf();
+		std::string json = text.str();
+		CHECK(json.compare(0, 15, "{\"traceEvents\":") == 0);
+		CHECK(json.find("\"name\":\"Leaf\"") != std::string::npos);
+		CHECK(json.find("\"tid\":3") != std::string::npos);
+	}
+	remove("ProfilerTest.json");
+
+	// Short-lived threads take over the buffers of the workers that have exited
+	// instead of allocating their own, and what they record is still reported.
+	{
+		UINT buffers = profiler.GetThreadBufferCount();
+		profiler.EndFrame();
+		for(int t = 0; t < 50; ++t)
+		{
+			std::thread([]()
+			{
+				PROFILE_SCOPE("ShortLived");
+				Leaf();
+			}).join();
+		}
+		profiler.EndFrame();
+		profiler.GetStats(stats);
+
+		const Profiler::ScopeStats* shortLived = FindStats(stats, 0, "ShortLived");
+		CHECK(profiler.GetThreadBufferCount() == buffers);
+		CHECK(shortLived != 0 && shortLived->Calls == 50);
+	}
+
+	// Cost of a scope nested in another, the common case: recording it, its share of
+	// EndFrame(), and how much of that is the two clock reads.
+	profiler.Reset();
+	const int frames = 100;
+	const int scopesPerFrame = 10000;
+	double recordSeconds = 0.0;
+	double endFrameSeconds = 0.0;
+	for(int frame = 0; frame < frames; ++frame)
+	{
+		double t0 = TestSeconds();
+		{
+			PROFILE_SCOPE("Frame loop");
+			for(int i = 0; i < scopesPerFrame; ++i)
+				Leaf();
+		}
+		double t1 = TestSeconds();
+		profiler.EndFrame();
+		double t2 = TestSeconds();
+
+		recordSeconds   += t1 - t0;
+		endFrameSeconds += t2 - t1;
+	}
+
+	// Summed unsigned so the wraparound is defined; the sum only keeps the reads alive.
+	UINT64 sum = 0;
+	double t0 = TestSeconds();
+	for(int i = 0; i < frames*scopesPerFrame; ++i)
+	{
+		sum += (UINT64)Profiler::Now();
+		sum += (UINT64)Profiler::Now();
+	}
+	double t1 = TestSeconds();
+
+	double scopes = (double)frames*scopesPerFrame;
+	printf("%.1f ns per scope to record, of which %.1f ns is two clock reads, plus %.1f ns in EndFrame (%llu)\n",
+		recordSeconds / scopes * 1e9, (t1 - t0) / scopes * 1e9, endFrameSeconds / scopes * 1e9, (unsigned long long)(sum & 1));
+
+	profiler.GetStats(stats);
+	const Profiler::ScopeStats* leaf = FindStats(stats, 0, "Leaf");
+	CHECK(leaf != 0 && leaf->Calls == scopesPerFrame);
+
+	return TestResult("ProfilerTest");
+}
@@ -0,0 +1,269 @@
+//***************************************************************************************
+// SpriteBatchSortTest.cpp
+//
+// SpriteBatch's sorted modes must draw exactly what a stable sort of the queued sprites
+// gives: in Texture mode one run per texture, the runs in order of first use, and in
+// BackToFront and FrontToBack mode descending or ascending layer depth, with sprites
+// of equal key in the order they were drawn.  Checked with tied depths, more than 256
+// textures, negative depths and -0 beside +0, on batches from one sprite to well past
+// MaxBatchSize, so vertex generation is split into chunks wherever worker threads run.
+// Each sprite's vertices are compared with the same sprite drawn in Immediate mode,
+// which never sorts or splits a batch.  Also prints sprites/s for 100k sprites in
+// every sort mode with 32 and 1024 textures.
+//***************************************************************************************
+
+#include "SpriteTestUtil.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const XMFLOAT2 Origin(1.0f, 2.0f);
+
+	struct SpriteDesc
+	{
+		UINT Texture;
+		XMFLOAT2 Position;
+		RECT Source;
+		float Rotation;
+		XMFLOAT4 Color;
+		float Depth;
+		SpriteEffects Effects;
+	};
+
+	// Draws the sprites in order.  The position makes every sprite's vertices unique.
+	void DrawSprites(SpriteBatch& batch, const std::vector<ComPtr<ID3D11ShaderResourceView> >& textures,
+		const std::vector<SpriteDesc>& sprites)
+	{
+		for(size_t i = 0; i < sprites.size(); ++i)
+		{
+			const SpriteDesc& s = sprites[i];
+			batch.Draw(textures[s.Texture].Get(), s.Position, &s.Source, XMLoadFloat4(&s.Color),
+				s.Rotation, Origin, 1.0f, s.Effects, s.Depth);
+		}
+	}
+
+	// Sprites using textures picked by nextTexture and depths from the given list.
+	template<typename TexturePicker>
+	std::vector<SpriteDesc> MakeSprites(std::mt19937& rng, size_t count, TexturePicker nextTexture,
+		const std::vector<float>& depths)
+	{
+		std::vector<SpriteDesc> sprites(count);
+		for(size_t i = 0; i < count; ++i)
+		{
+			SpriteDesc& s = sprites[i];
+			s.Texture  = nextTexture(i);
+			s.Position = XMFLOAT2((float)(i % 1920), (float)(i / 1920));
+
+			LONG u = rng() % 200, v = rng() % 200;
+			s.Source.left   = u;
+			s.Source.top    = v;
+			s.Source.right  = u + 8 + rng() % 40;
+			s.Source.bottom = v + 8 + rng() % 40;
+
+			s.Rotation = rng() % 4 == 0 ? (rng() % 628) / 100.0f : 0.0f;
+			s.Color    = XMFLOAT4((rng() % 256) / 255.0f, 1.0f, 0.5f, 1.0f);
+			s.Depth    = depths[rng() % depths.size()];
+			s.Effects  = (SpriteEffects)(rng() % 4);
+		}
+		return sprites;
+	}
+
+	// The order the sprites must come out in: a stable sort, so -0 and +0 tie.
+	std::vector<size_t> ExpectedOrder(const std::vector<SpriteDesc>& sprites, SpriteSortMode mode)
+	{
+		std::vector<size_t> order(sprites.size());
+		for(size_t i = 0; i < order.size(); ++i)
+			order[i] = i;
+
+		if( mode == SpriteSortMode_Texture )
+		{
+			std::vector<size_t> firstUse;
+			for(size_t i = 0; i < sprites.size(); ++i)
+			{
+				UINT t = sprites[i].Texture;
+				if( t >= firstUse.size() )
+					firstUse.resize(t + 1, SIZE_MAX);
+				if( firstUse[t] == SIZE_MAX )
+					firstUse[t] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+				{ return firstUse[sprites[a].Texture] < firstUse[sprites[b].Texture]; });
+		}
+		else if( mode == SpriteSortMode_BackToFront )
+		{
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+				{ return sprites[a].Depth > sprites[b].Depth; });
+		}
+		else if( mode == SpriteSortMode_FrontToBack )
+		{
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+				{ return sprites[a].Depth < sprites[b].Depth; });
+		}
+		return order;
+	}
+
+	const char* ModeName(SpriteSortMode mode)
+	{
+		switch( mode )
+		{
+		case SpriteSortMode_Deferred:    return "Deferred";
+		case SpriteSortMode_Texture:     return "Texture";
+		case SpriteSortMode_BackToFront: return "BackToFront";
+		case SpriteSortMode_FrontToBack: return "FrontToBack";
+		default:                         return "Immediate";
+		}
+	}
+
+	void CheckCase(const char* name, StubDevice& stub, SpriteBatch& batch,
+		const std::vector<ComPtr<ID3D11ShaderResourceView> >& textures, const std::vector<SpriteDesc>& sprites)
+	{
+		// Immediate mode draws every sprite on its own as it is queued.
+		std::vector<DrawnSprite> single;
+		RecordSprites(stub.Context.Get(), &single);
+		batch.Begin(SpriteSortMode_Immediate);
+		DrawSprites(batch, textures, sprites);
+		batch.End();
+		StopRecording(stub.Context.Get());
+		CHECK(single.size() == sprites.size());
+		if( single.size() != sprites.size() )
+			return;
+
+		const SpriteSortMode modes[] =
+		{
+			SpriteSortMode_Deferred, SpriteSortMode_Texture, SpriteSortMode_BackToFront, SpriteSortMode_FrontToBack
+		};
+		for(size_t m = 0; m < sizeof(modes)/sizeof(modes[0]); ++m)
+		{
+			std::vector<DrawnSprite> drawn;
+			RecordSprites(stub.Context.Get(), &drawn);
+			batch.Begin(modes[m]);
+			DrawSprites(batch, textures, sprites);
+			batch.End();
+			StopRecording(stub.Context.Get());
+
+			std::vector<size_t> order = ExpectedOrder(sprites, modes[m]);
+			size_t i = 0;
+			while( i < drawn.size() && i < order.size() && drawn[i] == single[order[i]] )
+				++i;
+			if( i != order.size() || drawn.size() != order.size() )
+			{
+				if( i < drawn.size() && i < order.size() )
+				{
+					printf("  %s, %s, %zu sprites: position %zu should be sprite %zu (texture %u, depth %g)\n",
+						name, ModeName(modes[m]), sprites.size(), i, order[i],
+						sprites[order[i]].Texture, sprites[order[i]].Depth);
+				}
+				else
+				{
+					printf("  %s, %s: drew %zu sprites of %zu\n", name, ModeName(modes[m]), drawn.size(), sprites.size());
+				}
+				CHECK(i == order.size() && drawn.size() == order.size());
+			}
+		}
+	}
+
+	void Benchmark(StubDevice& stub, SpriteBatch& batch, const std::vector<ComPtr<ID3D11ShaderResourceView> >& textures,
+		UINT numTextures)
+	{
+		const size_t numSprites = 100000;
+		const int frames = 10;
+		std::mt19937 rng(3);
+
+		std::vector<float> depths(4096);
+		for(size_t i = 0; i < depths.size(); ++i)
+			depths[i] = (float)i / depths.size();
+
+		// Runs of a few sprites per texture, the way a scene's sprites usually come in.
+		UINT texture = 0;
+		std::vector<SpriteDesc> sprites = MakeSprites(rng, numSprites,
+			[&](size_t) { if( rng() % 8 == 0 ) texture = rng() % numTextures; return texture; }, depths);
+
+		const SpriteSortMode modes[] =
+		{
+			SpriteSortMode_Deferred, SpriteSortMode_Texture, SpriteSortMode_BackToFront, SpriteSortMode_FrontToBack
+		};
+		for(size_t m = 0; m < sizeof(modes)/sizeof(modes[0]); ++m)
+		{
+			stub.Context->NumDraws = 0;
+
+			double t0 = TestSeconds();
+			for(int f = 0; f < frames; ++f)
+			{
+				batch.Begin(modes[m]);
+				DrawSprites(batch, textures, sprites);
+				batch.End();
+			}
+			double seconds = (TestSeconds() - t0) / frames;
+
+			printf("%-11s %zu sprites, %4u textures: %7.2f ms/frame, %6.1f M sprites/s, %6.0f draws/frame (%u hardware threads)\n",
+				ModeName(modes[m]), numSprites, numTextures, seconds*1000.0, numSprites/seconds*1e-6,
+				(double)stub.Context->NumDraws / frames, std::thread::hardware_concurrency());
+		}
+	}
+}
+
+int main()
+{
+	StubDevice stub;
+	std::vector<ComPtr<ID3D11ShaderResourceView> > textures;
+	for(UINT i = 0; i < 1024; ++i)
+		textures.push_back(stub.CreateTexture(64 << (i % 3), 64 << (i % 2)));
+
+	SpriteBatch batch(stub.Context.Get());
+	std::mt19937 rng(17);
+
+	// Batch sizes around one chunk, two chunks and MaxBatchSize, and several batches.
+	const size_t counts[] = { 1, 2, 255, 256, 511, 512, 513, 2047, 2048, 2049, 6000, 20000 };
+
+	// Four depths and eight textures: nearly every key is tied.
+	std::vector<float> fewDepths;
+	fewDepths.push_back(0.0f);
+	fewDepths.push_back(0.25f);
+	fewDepths.push_back(0.5f);
+	fewDepths.push_back(1.0f);
+	for(size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c)
+	{
+		std::vector<SpriteDesc> sprites = MakeSprites(rng, counts[c], [&](size_t) { return (UINT)(rng() % 8); }, fewDepths);
+		CheckCase("tied depths", stub, batch, textures, sprites);
+	}
+
+	// Depths either side of zero and at the extremes, so every byte of the key differs
+	// somewhere; -0 and +0 must tie and keep their draw order.
+	std::vector<float> signedDepths;
+	const float signedValues[] =
+	{
+		-FLT_MAX, -1e30f, -3.0f, -1.0f, -0.5f, -FLT_MIN, -FLT_MIN/4, -0.0f, 0.0f,
+		FLT_MIN/4, FLT_MIN, 0.5f, 1.0f, 3.0f, 1e30f, FLT_MAX,
+	};
+	signedDepths.assign(signedValues, signedValues + sizeof(signedValues)/sizeof(signedValues[0]));
+	for(size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c)
+	{
+		std::vector<SpriteDesc> sprites = MakeSprites(rng, counts[c], [&](size_t) { return (UINT)(rng() % 8); }, signedDepths);
+		CheckCase("signed depths", stub, batch, textures, sprites);
+	}
+
+	std::vector<SpriteDesc> zeros = MakeSprites(rng, 3000, [&](size_t) { return (UINT)(rng() % 4); },
+		std::vector<float>(signedValues + 7, signedValues + 9));
+	CheckCase("-0 and +0 only", stub, batch, textures, zeros);
+
+	// 1024 textures, each coming back after others: texture numbers past 255 take a
+	// second radix pass, and runs must gather in order of first use.
+	for(size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c)
+	{
+		std::vector<SpriteDesc> sprites = MakeSprites(rng, counts[c],
+			[&](size_t i) { return (UINT)(i % 3 == 0 ? rng() % 1024 : (i * 7) % 300); }, fewDepths);
+		CheckCase("1024 textures", stub, batch, textures, sprites);
+	}
+
+	Benchmark(stub, batch, textures, 32);
+	Benchmark(stub, batch, textures, 1024);
+
+	return TestResult("SpriteBatchSortTest");
+}
@@ -0,0 +1,224 @@
+//***************************************************************************************
+// SpriteBatchVerticesTest.cpp
+//
+// The four-wide, AVX and dispatching sprite kernels must write exactly the vertices
+// RenderSprite writes, for every combination of flags, zero source sizes, large
+// angles and exact multiples of pi/4.  Also reports vertex generation throughput for
+// each kernel on a full SpriteBatch batch.
+//***************************************************************************************
+
+#include "SpriteBatchVertices.h"
+#include "VertexTypes.h"
+#include "TestUtil.h"
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+using namespace DirectX;
+using namespace DirectX::Internal;
+
+namespace
+{
+	const size_t BatchSize = 2048;   // SpriteBatch's MaxBatchSize
+
+	typedef void (XM_CALLCONV *GroupKernel)(SpriteInfo const* const*, VertexPositionColorTexture*, FXMVECTOR, FXMVECTOR);
+
+	enum Rotation
+	{
+		Rotation_All,
+		Rotation_Half,
+		Rotation_None,
+	};
+
+	// Random sprites as SpriteBatch::Draw queues them.  Every fourth one covers the
+	// awkward cases: zero source sizes and rotations that are exact multiples of pi/4.
+	void MakeSprites(SpriteInfo* sprites, size_t count, Rotation rotation, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_real_distribution<float> angle(-1000.0f, 1000.0f);
+
+		for(size_t i = 0; i < count; ++i)
+		{
+			SpriteInfo& s = sprites[i];
+			s.flags = (int)(rng() & 15);
+			bool texels = (s.flags & SpriteInfo::SourceInTexels) != 0;
+
+			float sourceScale = texels ? 256.0f : 1.0f;
+			s.source = XMFLOAT4A(unit(rng)*sourceScale, unit(rng)*sourceScale, unit(rng)*sourceScale, unit(rng)*sourceScale);
+			s.destination = XMFLOAT4A(unit(rng)*1920.0f - 200.0f, unit(rng)*1080.0f - 200.0f, unit(rng)*300.0f, unit(rng)*300.0f);
+			s.color = XMFLOAT4A(unit(rng), unit(rng), unit(rng), unit(rng));
+
+			float r = 0.0f;
+			if( rotation == Rotation_All || (rotation == Rotation_Half && (rng() & 1)) )
+				r = angle(rng);
+
+			if( i % 4 == 3 )
+			{
+				if( rng() & 1 )
+					s.source.z = 0.0f;
+				if( rng() & 1 )
+					s.source.w = 0.0f;
+				if( r != 0.0f )
+					r = (float)((int)(rng() % 33) - 16) * XM_PIDIV4;
+			}
+
+			s.originRotationDepth = XMFLOAT4A(unit(rng)*64.0f, unit(rng)*64.0f, r, unit(rng));
+			s.texture = 0;
+		}
+	}
+
+	void RenderScalar(SpriteInfo const* const* sprites, size_t count, VertexPositionColorTexture* vertices,
+		FXMVECTOR textureSize, FXMVECTOR inverseTextureSize)
+	{
+		for(size_t i = 0; i < count; ++i)
+			RenderSprite(sprites[i], vertices + i*VerticesPerSprite, textureSize, inverseTextureSize);
+	}
+
+	void RenderGroups(GroupKernel kernel, size_t width, SpriteInfo const* const* sprites, size_t count,
+		VertexPositionColorTexture* vertices, FXMVECTOR textureSize, FXMVECTOR inverseTextureSize)
+	{
+		for(size_t i = 0; i + width <= count; i += width)
+			kernel(sprites + i, vertices + i*VerticesPerSprite, textureSize, inverseTextureSize);
+	}
+
+	// Index of the first differing vertex, or count*VerticesPerSprite if none.
+	size_t FirstMismatch(const std::vector<VertexPositionColorTexture>& a, const std::vector<VertexPositionColorTexture>& b)
+	{
+		for(size_t i = 0; i < a.size(); ++i)
+		{
+			if( memcmp(&a[i], &b[i], sizeof(a[i])) != 0 )
+				return i;
+		}
+		return a.size();
+	}
+
+	void Report(const char* kernel, const std::vector<VertexPositionColorTexture>& expected,
+		const std::vector<VertexPositionColorTexture>& actual)
+	{
+		size_t i = FirstMismatch(expected, actual);
+		if( i == expected.size() )
+			return;
+
+		const VertexPositionColorTexture& e = expected[i];
+		const VertexPositionColorTexture& a = actual[i];
+		printf("  %s: vertex %zu is (%.9g %.9g %.9g) uv (%.9g %.9g), RenderSprite gives (%.9g %.9g %.9g) uv (%.9g %.9g)\n",
+			kernel, i, a.position.x, a.position.y, a.position.z, a.textureCoordinate.x, a.textureCoordinate.y,
+			e.position.x, e.position.y, e.position.z, e.textureCoordinate.x, e.textureCoordinate.y);
+		CHECK(i == expected.size());
+	}
+
+	template<typename Render>
+	double SpritesPerSecond(Render render, size_t count)
+	{
+		const int runs = 40;
+		double best = 1e30;
+		for(int run = 0; run < runs; ++run)
+		{
+			double t0 = TestSeconds();
+			render();
+			double t = TestSeconds() - t0;
+			best = t < best ? t : best;
+		}
+		return count / best;
+	}
+}
+
+int main()
+{
+	const XMVECTORF32 textureSize = { { { 256.0f, 128.0f, 256.0f, 128.0f } } };
+	XMVECTOR inverseTextureSize = XMVectorReciprocal(textureSize);
+
+#ifdef SPRITEBATCH_AVX
+	bool hasAVX = IsAVXSupported();
+#else
+	bool hasAVX = false;
+#endif
+	printf("AVX kernel %s\n", hasAVX ? "used" : "not available");
+
+	// An unrotated, unmirrored sprite sized in pixels lands exactly on its rectangle.
+	{
+		std::unique_ptr<SpriteInfo[]> sprite(new SpriteInfo[1]);
+		sprite[0].source = XMFLOAT4A(0.0f, 0.0f, 1.0f, 1.0f);
+		sprite[0].destination = XMFLOAT4A(10.0f, 20.0f, 30.0f, 40.0f);
+		sprite[0].color = XMFLOAT4A(1.0f, 0.5f, 0.25f, 1.0f);
+		sprite[0].originRotationDepth = XMFLOAT4A(0.0f, 0.0f, 0.0f, 0.5f);
+		sprite[0].texture = 0;
+		sprite[0].flags = SpriteInfo::DestSizeInPixels;
+
+		VertexPositionColorTexture v[VerticesPerSprite];
+		RenderSprite(&sprite[0], v, textureSize, inverseTextureSize);
+		CHECK(v[0].position.x == 10.0f && v[0].position.y == 20.0f && v[0].position.z == 0.5f);
+		CHECK(v[3].position.x == 40.0f && v[3].position.y == 60.0f);
+		CHECK(v[1].textureCoordinate.x == 1.0f && v[1].textureCoordinate.y == 0.0f);
+		CHECK(v[2].color.y == 0.5f);
+	}
+
+	// Every kernel against RenderSprite, bit for bit.
+	const size_t count = 8192;
+	std::unique_ptr<SpriteInfo[]> sprites(new SpriteInfo[count]);
+	std::vector<SpriteInfo const*> pointers(count);
+	for(size_t i = 0; i < count; ++i)
+		pointers[i] = &sprites[i];
+
+	std::vector<VertexPositionColorTexture> expected(count*VerticesPerSprite);
+	std::vector<VertexPositionColorTexture> actual(count*VerticesPerSprite);
+
+	const Rotation rotations[] = { Rotation_All, Rotation_Half, Rotation_None };
+	for(size_t r = 0; r < sizeof(rotations)/sizeof(rotations[0]); ++r)
+	{
+		MakeSprites(&sprites[0], count, rotations[r], (unsigned)(17 + r));
+		RenderScalar(&pointers[0], count, &expected[0], textureSize, inverseTextureSize);
+
+		memset(&actual[0], 0xCD, actual.size()*sizeof(actual[0]));
+		RenderGroups(RenderFourSprites, 4, &pointers[0], count, &actual[0], textureSize, inverseTextureSize);
+		Report("RenderFourSprites", expected, actual);
+
+#ifdef SPRITEBATCH_AVX
+		if( hasAVX )
+		{
+			memset(&actual[0], 0xCD, actual.size()*sizeof(actual[0]));
+			RenderGroups(RenderEightSpritesAVX, 8, &pointers[0], count, &actual[0], textureSize, inverseTextureSize);
+			Report("RenderEightSpritesAVX", expected, actual);
+		}
+#endif
+
+		// Runs that do not fill the wider kernels leave a tail for the narrower ones.
+		const size_t runs[] = { 1, 3, 4, 7, 12, 13, 31 };
+		size_t first = 0;
+		memset(&actual[0], 0xCD, actual.size()*sizeof(actual[0]));
+		for(size_t k = 0; first < count; k = (k + 1) % (sizeof(runs)/sizeof(runs[0])))
+		{
+			size_t run = runs[k] < count - first ? runs[k] : count - first;
+			RenderSprites(&pointers[first], run, &actual[first*VerticesPerSprite], textureSize, inverseTextureSize);
+			first += run;
+		}
+		Report("RenderSprites", expected, actual);
+	}
+
+	// Throughput on one full batch, best of 40 runs.
+	const char* rotationNames[] = { "every sprite rotated", "half rotated", "none rotated" };
+	for(size_t r = 0; r < sizeof(rotations)/sizeof(rotations[0]); ++r)
+	{
+		MakeSprites(&sprites[0], BatchSize, rotations[r], (unsigned)(41 + r));
+		SpriteInfo const* const* batch = &pointers[0];
+		VertexPositionColorTexture* vertices = &actual[0];
+
+		double scalar = SpritesPerSecond([&]() { RenderScalar(batch, BatchSize, vertices, textureSize, inverseTextureSize); }, BatchSize);
+		double four = SpritesPerSecond([&]() { RenderGroups(RenderFourSprites, 4, batch, BatchSize, vertices, textureSize, inverseTextureSize); }, BatchSize);
+		double dispatch = SpritesPerSecond([&]() { RenderSprites(batch, BatchSize, vertices, textureSize, inverseTextureSize); }, BatchSize);
+
+		printf("%-21s scalar %5.1f M/s, 4-wide %5.1f M/s, RenderSprites %5.1f M/s",
+			rotationNames[r], scalar*1e-6, four*1e-6, dispatch*1e-6);
+#ifdef SPRITEBATCH_AVX
+		if( hasAVX )
+		{
+			double eight = SpritesPerSecond([&]() { RenderGroups(RenderEightSpritesAVX, 8, batch, BatchSize, vertices, textureSize, inverseTextureSize); }, BatchSize);
+			printf(", 8-wide AVX %5.1f M/s", eight*1e-6);
+		}
+#endif
+		printf("\n");
+	}
+
+	return TestResult("SpriteBatchVerticesTest");
+}
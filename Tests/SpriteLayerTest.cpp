@@ -0,0 +1,369 @@
+//***************************************************************************************
+// SpriteLayerTest.cpp
+//
+// A SpriteLayer must draw exactly what SpriteBatch draws for the same sprites queued in
+// the order they were added, in every sort mode, after any sequence of adds, removes,
+// updates, moves, recolors, re-depths and clears.  Texture mode is the exception in
+// one respect: the layer orders textures by first use over its lifetime rather than in
+// the frame, so only the grouping and the order within each texture are compared.
+// Also prints the cost of a frame with 0%, 1% and 100% of 100k sprites changed,
+// against re-submitting them all to SpriteBatch.
+//***************************************************************************************
+
+#include "SpriteTestUtil.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const UINT NumTextures = 32;
+	const XMFLOAT2 Origin(2.0f, 3.0f);
+
+	// Everything needed to queue a sprite again, in one of the two Draw forms.
+	struct SpriteDesc
+	{
+		UINT64 AddOrder;
+		UINT Texture;
+		bool RectDest;
+		XMFLOAT2 Position;
+		RECT Dest;
+		RECT Source;
+		float Rotation;
+		XMFLOAT4 Color;
+		float Depth;
+		SpriteEffects Effects;
+	};
+
+	void RandomSprite(std::mt19937& rng, SpriteDesc& s)
+	{
+		s.Texture  = rng() % NumTextures;
+		s.RectDest = rng() % 5 == 0;
+		s.Position = XMFLOAT2((float)(rng() % 1920), (float)(rng() % 1080));
+
+		LONG x = rng() % 1000, y = rng() % 800;
+		s.Dest.left   = x;
+		s.Dest.top    = y;
+		s.Dest.right  = x + 10 + rng() % 90;
+		s.Dest.bottom = y + 10 + rng() % 90;
+
+		LONG u = rng() % 200, v = rng() % 200;
+		s.Source.left   = u;
+		s.Source.top    = v;
+		s.Source.right  = u + 8 + rng() % 40;
+		s.Source.bottom = v + 8 + rng() % 40;
+
+		s.Rotation = rng() % 3 == 0 ? (rng() % 628) / 100.0f : 0.0f;
+		s.Color    = XMFLOAT4((rng() % 256) / 255.0f, 1.0f, (float)(rng() % 7), 1.0f);
+
+		// Few distinct depths, so sorted modes have plenty of ties.
+		s.Depth   = (rng() % 64) / 64.0f;
+		s.Effects = (SpriteEffects)(rng() % 4);
+	}
+
+	class LayerModel
+	{
+	public:
+		LayerModel(SpriteSortMode sortMode, const std::vector<ComPtr<ID3D11ShaderResourceView> >& textures)
+		: mLayer(sortMode), mTextures(textures), mNextAddOrder(0)
+		{
+		}
+
+		SpriteLayer& Layer() { return mLayer; }
+		size_t Count()const { return mSprites.size(); }
+
+		void Add(std::mt19937& rng)
+		{
+			SpriteDesc s;
+			RandomSprite(rng, s);
+			s.AddOrder = mNextAddOrder++;
+
+			XMVECTOR color = XMLoadFloat4(&s.Color);
+			SpriteLayer::Handle h = s.RectDest ?
+				mLayer.Add(mTextures[s.Texture].Get(), s.Dest, &s.Source, color, s.Rotation, Origin, s.Effects, s.Depth) :
+				mLayer.Add(mTextures[s.Texture].Get(), s.Position, &s.Source, color, s.Rotation, Origin, 1.5f, s.Effects, s.Depth);
+
+			CHECK(h != 0 && mSprites.count(h) == 0);
+			mSprites[h] = s;
+		}
+
+		// Applies one random edit to a random sprite.
+		void Edit(std::mt19937& rng)
+		{
+			std::map<SpriteLayer::Handle, SpriteDesc>::iterator it = mSprites.begin();
+			std::advance(it, rng() % mSprites.size());
+			SpriteLayer::Handle h = it->first;
+			SpriteDesc& s = it->second;
+
+			switch( rng() % 5 )
+			{
+			case 0:
+				mLayer.Remove(h);
+				CHECK(!mLayer.IsValid(h));
+				mSprites.erase(it);
+				break;
+
+			case 1:
+			{
+				UINT64 addOrder = s.AddOrder;
+				RandomSprite(rng, s);
+				s.AddOrder = addOrder;
+
+				XMVECTOR color = XMLoadFloat4(&s.Color);
+				if( s.RectDest )
+					mLayer.Update(h, mTextures[s.Texture].Get(), s.Dest, &s.Source, color, s.Rotation, Origin, s.Effects, s.Depth);
+				else
+					mLayer.Update(h, mTextures[s.Texture].Get(), s.Position, &s.Source, color, s.Rotation, Origin, 1.5f, s.Effects, s.Depth);
+				break;
+			}
+
+			case 2:
+			{
+				// A rectangle keeps its size and moves its top left corner.
+				XMFLOAT2 p((float)(rng() % 1920), (float)(rng() % 1080));
+				s.Position = p;
+				s.Dest.right  += (LONG)p.x - s.Dest.left;
+				s.Dest.bottom += (LONG)p.y - s.Dest.top;
+				s.Dest.left    = (LONG)p.x;
+				s.Dest.top     = (LONG)p.y;
+				mLayer.SetPosition(h, p);
+				break;
+			}
+
+			case 3:
+				s.Color = XMFLOAT4(0.5f, (float)(rng() % 9), 0.25f, 1.0f);
+				mLayer.SetColor(h, XMLoadFloat4(&s.Color));
+				break;
+
+			case 4:
+				s.Depth = (rng() % 64) / 64.0f;
+				mLayer.SetLayerDepth(h, s.Depth);
+				break;
+			}
+		}
+
+		void Clear()
+		{
+			mLayer.Clear();
+			mSprites.clear();
+		}
+
+		// Queues the live sprites on batch in the order they were added.
+		void Resubmit(SpriteBatch& batch)const
+		{
+			std::vector<const SpriteDesc*> sprites;
+			for(std::map<SpriteLayer::Handle, SpriteDesc>::const_iterator it = mSprites.begin(); it != mSprites.end(); ++it)
+				sprites.push_back(&it->second);
+			std::sort(sprites.begin(), sprites.end(),
+				[](const SpriteDesc* a, const SpriteDesc* b) { return a->AddOrder < b->AddOrder; });
+
+			for(size_t i = 0; i < sprites.size(); ++i)
+			{
+				const SpriteDesc& s = *sprites[i];
+				XMVECTOR color = XMLoadFloat4(&s.Color);
+				if( s.RectDest )
+					batch.Draw(mTextures[s.Texture].Get(), s.Dest, &s.Source, color, s.Rotation, Origin, s.Effects, s.Depth);
+				else
+					batch.Draw(mTextures[s.Texture].Get(), s.Position, &s.Source, color, s.Rotation, Origin, 1.5f, s.Effects, s.Depth);
+			}
+		}
+
+	private:
+		SpriteLayer mLayer;
+		const std::vector<ComPtr<ID3D11ShaderResourceView> >& mTextures;
+		std::map<SpriteLayer::Handle, SpriteDesc> mSprites;
+		UINT64 mNextAddOrder;
+	};
+
+	// Every texture's sprites form one run in layer, and the runs hold the same sprites
+	// in the same order as the sprites of that texture in batch.
+	bool SameGrouping(const std::vector<DrawnSprite>& layer, const std::vector<DrawnSprite>& batch)
+	{
+		std::map<ID3D11ShaderResourceView*, std::vector<size_t> > layerRuns, batchRuns;
+		for(size_t i = 0; i < layer.size(); ++i)
+			layerRuns[layer[i].Texture].push_back(i);
+		for(size_t i = 0; i < batch.size(); ++i)
+			batchRuns[batch[i].Texture].push_back(i);
+		if( layerRuns.size() != batchRuns.size() )
+			return false;
+
+		for(std::map<ID3D11ShaderResourceView*, std::vector<size_t> >::const_iterator it = layerRuns.begin(); it != layerRuns.end(); ++it)
+		{
+			const std::vector<size_t>& a = it->second;
+			const std::vector<size_t>& b = batchRuns[it->first];
+			if( a.size() != b.size() || a.back() - a.front() + 1 != a.size() )
+				return false;
+			for(size_t k = 0; k < a.size(); ++k)
+			{
+				if( !(layer[a[k]] == batch[b[k]]) )
+					return false;
+			}
+		}
+		return true;
+	}
+
+	const char* ModeName(SpriteSortMode mode)
+	{
+		switch( mode )
+		{
+		case SpriteSortMode_Deferred:    return "Deferred";
+		case SpriteSortMode_Texture:     return "Texture";
+		case SpriteSortMode_BackToFront: return "BackToFront";
+		case SpriteSortMode_FrontToBack: return "FrontToBack";
+		default:                         return "Immediate";
+		}
+	}
+
+	void CheckEdits(StubDevice& stub, SpriteBatch& batch, const std::vector<ComPtr<ID3D11ShaderResourceView> >& textures,
+		SpriteSortMode mode)
+	{
+		std::mt19937 rng(11 + mode);
+		LayerModel model(mode, textures);
+
+		for(int frame = 0; frame < 60; ++frame)
+		{
+			// A big first frame, then a few hundred edits, now and then a clear.
+			if( frame == 0 )
+			{
+				for(int i = 0; i < 3000; ++i)
+					model.Add(rng);
+			}
+			else if( rng() % 40 == 0 )
+			{
+				model.Clear();
+			}
+			else
+			{
+				int ops = rng() % 400;
+				for(int i = 0; i < ops; ++i)
+				{
+					if( model.Count() == 0 || rng() % 5 == 0 )
+						model.Add(rng);
+					else
+						model.Edit(rng);
+				}
+			}
+			CHECK(model.Layer().GetCount() == model.Count());
+
+			std::vector<DrawnSprite> fromLayer, fromBatch;
+			RecordSprites(stub.Context.Get(), &fromLayer);
+			batch.Begin(SpriteSortMode_Deferred);
+			batch.Draw(model.Layer());
+			batch.End();
+
+			RecordSprites(stub.Context.Get(), &fromBatch);
+			batch.Begin(mode);
+			model.Resubmit(batch);
+			batch.End();
+			StopRecording(stub.Context.Get());
+
+			bool same = fromLayer == fromBatch;
+			if( !same && mode == SpriteSortMode_Texture )
+				same = SameGrouping(fromLayer, fromBatch);
+			if( !same )
+			{
+				printf("  %s, frame %d: layer drew %zu sprites, SpriteBatch %zu, and they differ\n",
+					ModeName(mode), frame, fromLayer.size(), fromBatch.size());
+				CHECK(same);
+				return;
+			}
+		}
+	}
+
+	void Benchmark(StubDevice& stub, SpriteBatch& batch, const std::vector<ComPtr<ID3D11ShaderResourceView> >& textures,
+		SpriteSortMode mode)
+	{
+		const size_t numSprites = 100000;
+		const int frames = 10;
+		std::mt19937 rng(5);
+
+		std::vector<SpriteDesc> sprites(numSprites);
+		SpriteLayer layer(mode);
+		std::vector<SpriteLayer::Handle> handles(numSprites);
+		for(size_t i = 0; i < numSprites; ++i)
+		{
+			SpriteDesc& s = sprites[i];
+			RandomSprite(rng, s);
+			handles[i] = layer.Add(textures[s.Texture].Get(), s.Position, &s.Source, XMLoadFloat4(&s.Color),
+				s.Rotation, Origin, 1.0f, s.Effects, s.Depth);
+		}
+
+		double t0 = TestSeconds();
+		for(int f = 0; f < frames; ++f)
+		{
+			batch.Begin(mode);
+			for(size_t i = 0; i < numSprites; ++i)
+			{
+				const SpriteDesc& s = sprites[i];
+				batch.Draw(textures[s.Texture].Get(), s.Position, &s.Source, XMLoadFloat4(&s.Color),
+					s.Rotation, Origin, 1.0f, s.Effects, s.Depth);
+			}
+			batch.End();
+		}
+		double resubmit = (TestSeconds() - t0) / frames;
+		printf("%-11s %zu sprites: SpriteBatch re-submit %7.2f ms/frame\n", ModeName(mode), numSprites, resubmit*1000.0);
+
+		// The first draw builds everything.
+		batch.Begin(mode);
+		batch.Draw(layer);
+		batch.End();
+
+		const double percents[] = { 0.0, 1.0, 100.0 };
+		for(int depth = 0; depth < (mode == SpriteSortMode_Deferred ? 1 : 2); ++depth)
+		{
+			for(size_t p = 0; p < sizeof(percents)/sizeof(percents[0]); ++p)
+			{
+				size_t changed = (size_t)(numSprites*percents[p] / 100.0);
+				stub.Context->NumUpdates = 0;
+				stub.Context->UpdateBytes = 0;
+
+				double t1 = TestSeconds();
+				for(int f = 0; f < frames; ++f)
+				{
+					for(size_t i = 0; i < changed; ++i)
+					{
+						size_t j = changed == numSprites ? i : rng() % numSprites;
+						if( depth )
+							layer.SetLayerDepth(handles[j], (rng() % 4096) / 4096.0f);
+						else
+							layer.SetPosition(handles[j], XMFLOAT2((float)f, (float)(i % 1000)));
+					}
+					batch.Begin(mode);
+					batch.Draw(layer);
+					batch.End();
+				}
+				double seconds = (TestSeconds() - t1) / frames;
+
+				printf("  layer, %5.1f%% %s %7.2f ms/frame (%5.1fx), %.2f MB uploaded/frame in %.0f copies\n",
+					percents[p], depth ? "re-depthed:" : "moved:     ", seconds*1000.0, resubmit/seconds,
+					stub.Context->UpdateBytes / 1e6 / frames, (double)stub.Context->NumUpdates / frames);
+			}
+		}
+	}
+}
+
+int main()
+{
+	StubDevice stub;
+	std::vector<ComPtr<ID3D11ShaderResourceView> > textures;
+	for(UINT i = 0; i < NumTextures; ++i)
+		textures.push_back(stub.CreateTexture(256 << (i % 3), 128 << (i % 2)));
+
+	SpriteBatch batch(stub.Context.Get());
+
+	const SpriteSortMode modes[] =
+	{
+		SpriteSortMode_Deferred, SpriteSortMode_Texture, SpriteSortMode_BackToFront, SpriteSortMode_FrontToBack
+	};
+	for(size_t m = 0; m < sizeof(modes)/sizeof(modes[0]); ++m)
+		CheckEdits(stub, batch, textures, modes[m]);
+
+	Benchmark(stub, batch, textures, SpriteSortMode_Deferred);
+	Benchmark(stub, batch, textures, SpriteSortMode_BackToFront);
+
+	return TestResult("SpriteLayerTest");
+}
@@ -0,0 +1,102 @@
+//***************************************************************************************
+// SpriteTestUtil.h
+//
+// Helpers for the tests that run SpriteBatch, SpriteLayer and SpriteFont on the stub
+// device in Compat/d3d11_1.h: creating the device and textures, and reading back the
+// sprites each DrawIndexed call would have drawn.
+//***************************************************************************************
+
+#ifndef SPRITETESTUTIL_H
+#define SPRITETESTUTIL_H
+
+#include "SpriteBatch.h"
+#include "VertexTypes.h"
+#include "TestUtil.h"
+#include <wrl.h>
+#include <vector>
+
+struct StubDevice
+{
+	Microsoft::WRL::ComPtr<ID3D11Device> Device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> Context;
+
+	StubDevice()
+	{
+		Device.Attach(new ID3D11Device);
+		Context.Attach(new ID3D11DeviceContext(Device.Get()));
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTexture(UINT width, UINT height)
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = width;
+		desc.Height = height;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view;
+		Device->CreateTexture2D(&desc, 0, texture.GetAddressOf());
+		Device->CreateShaderResourceView(texture.Get(), 0, view.GetAddressOf());
+		return view;
+	}
+};
+
+// One sprite as the GPU would see it: the bound texture and its four vertices.
+struct DrawnSprite
+{
+	ID3D11ShaderResourceView* Texture;
+	DirectX::VertexPositionColorTexture Vertices[4];
+};
+
+inline bool operator==(const DrawnSprite& a, const DrawnSprite& b)
+{
+	return a.Texture == b.Texture && memcmp(a.Vertices, b.Vertices, sizeof(a.Vertices)) == 0;
+}
+
+// Until StopRecording, appends every sprite drawn on context to sprites.  Both SpriteBatch
+// and SpriteLayer draw quads as (0 1 2) (1 3 2) with 16 or 32-bit indices; anything else
+// fails a check.
+inline void RecordSprites(ID3D11DeviceContext* context, std::vector<DrawnSprite>* sprites)
+{
+	context->OnDrawIndexed = [sprites](ID3D11DeviceContext* ctx, UINT indexCount, UINT startIndex, INT baseVertex)
+	{
+		const BYTE* indexData = ctx->IndexBuffer->Contents.data();
+		const DirectX::VertexPositionColorTexture* vertices =
+			reinterpret_cast<const DirectX::VertexPositionColorTexture*>(ctx->VertexBuffer->Contents.data());
+
+		CHECK(indexCount % 6 == 0);
+		for(UINT s = 0; s < indexCount / 6; ++s)
+		{
+			UINT index[6];
+			for(UINT k = 0; k < 6; ++k)
+			{
+				UINT i = startIndex + s*6 + k;
+				if( ctx->IndexFormat == DXGI_FORMAT_R32_UINT )
+					index[k] = reinterpret_cast<const UINT*>(indexData)[i];
+				else
+					index[k] = reinterpret_cast<const USHORT*>(indexData)[i];
+				index[k] += baseVertex;
+			}
+
+			UINT b = index[0];
+			CHECK(b % 4 == 0 && index[1] == b+1 && index[2] == b+2 &&
+				index[3] == b+1 && index[4] == b+3 && index[5] == b+2);
+
+			DrawnSprite sprite;
+			sprite.Texture = ctx->Texture;
+			memcpy(sprite.Vertices, vertices + b, sizeof(sprite.Vertices));
+			sprites->push_back(sprite);
+		}
+	};
+}
+
+inline void StopRecording(ID3D11DeviceContext* context)
+{
+	context->OnDrawIndexed = nullptr;
+}
+
+#endif // SPRITETESTUTIL_H
@@ -0,0 +1,219 @@
+//***************************************************************************************
+// TerrainHeightfieldTest.cpp
+//
+// GetHeights must return exactly what GetHeight returns for the same point, for small
+// batches (resolved in order) and large ones (bucketed by patch), including points on
+// the last row and column of texels and points off the map.  Also checks how
+// HeightmapSource treats missing, empty and truncated files.
+//***************************************************************************************
+
+#include "TerrainHeightfield.h"
+#include "ThreadPool.h"
+#include "TestUtil.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	// Writes a width x height R32F heightmap of random heights and returns its name.
+	std::wstring WriteHeightmap(const char* name, UINT width, UINT height, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> dist(1.0f, 100.0f);
+
+		std::vector<float> texels((size_t)width*height);
+		for(size_t i = 0; i < texels.size(); ++i)
+			texels[i] = dist(rng);
+
+		FILE* file = fopen(name, "wb");
+		CHECK(file != 0);
+		if( file )
+		{
+			fwrite(&texels[0], sizeof(float), texels.size(), file);
+			fclose(file);
+		}
+
+		return std::wstring(name, name + strlen(name));
+	}
+
+	void CheckBatch(const TerrainHeightfield& field, const std::vector<XMFLOAT2>& points, ThreadPool* pool)
+	{
+		std::vector<float> heights(points.size(), -1.0f);
+		field.GetHeights(&points[0], &heights[0], (UINT)points.size(), pool);
+
+		int mismatches = 0;
+		for(size_t i = 0; i < points.size(); ++i)
+		{
+			float expected = field.GetHeight(points[i].x, points[i].y);
+			if( memcmp(&expected, &heights[i], sizeof(float)) != 0 && ++mismatches <= 10 )
+			{
+				printf("  (%.9g, %.9g): GetHeights %.9g, GetHeight %.9g\n",
+					points[i].x, points[i].y, heights[i], expected);
+			}
+		}
+
+		CHECK(mismatches == 0);
+	}
+
+	void TestMap(UINT width, UINT height, float cellSpacing, ThreadPool& pool)
+	{
+		printf("%u x %u heightmap, cell spacing %g\n", width, height, cellSpacing);
+
+		TerrainHeightfield::InitInfo info;
+		info.HeightMapFilename = WriteHeightmap("TerrainHeightfieldTest.raw", width, height, width*31 + height);
+		info.HeightmapFormat   = HeightmapSource::Format_R32F;
+		info.HeightScale       = 1.0f;
+		info.HeightmapWidth    = width;
+		info.HeightmapHeight   = height;
+		info.CellSpacing       = cellSpacing;
+
+		TerrainHeightfield field;
+		field.Init(info);
+		remove("TerrainHeightfieldTest.raw");
+
+		const std::vector<float>& texels = field.GetHeightmap();
+		CHECK(texels.size() == (size_t)width*height);
+
+		float halfWidth = 0.5f*field.GetWidth();
+		float halfDepth = 0.5f*field.GetDepth();
+
+		std::vector<XMFLOAT2> points;
+
+		// Every texel of the first and last rows and columns, so the cells that own
+		// them and the ones past them are both exercised.
+		for(UINT j = 0; j < width; ++j)
+		{
+			float x = -halfWidth + j*cellSpacing;
+			points.push_back(XMFLOAT2(x, +halfDepth));
+			points.push_back(XMFLOAT2(x, -halfDepth));
+		}
+		for(UINT i = 0; i < height; ++i)
+		{
+			float z = halfDepth - i*cellSpacing;
+			points.push_back(XMFLOAT2(-halfWidth, z));
+			points.push_back(XMFLOAT2(+halfWidth, z));
+		}
+
+		// On the last row and column a query must land on the texel, not on the one
+		// before it.
+		for(UINT i = 0; i < height; ++i)
+		{
+			float z = halfDepth - i*cellSpacing;
+			float expected = texels[i*width + width-1];
+			CHECK(fabsf(field.GetHeight(+halfWidth, z) - expected) <= 1e-4f*expected);
+		}
+		for(UINT j = 0; j < width; ++j)
+		{
+			float x = -halfWidth + j*cellSpacing;
+			float expected = texels[(height-1)*width + j];
+			CHECK(fabsf(field.GetHeight(x, -halfDepth) - expected) <= 1e-4f*expected);
+		}
+
+		// Off the map: the height of the nearest border point, never an extrapolation.
+		std::mt19937 rng(width + height);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for(int k = 0; k < 2000; ++k)
+		{
+			float x = (2.0f*unit(rng) - 1.0f)*halfWidth;
+			float z = (2.0f*unit(rng) - 1.0f)*halfDepth;
+			float far = 1.0f + 10.0f*unit(rng);
+
+			points.push_back(XMFLOAT2(x, +halfDepth*far));
+			points.push_back(XMFLOAT2(x, -halfDepth*far));
+			points.push_back(XMFLOAT2(+halfWidth*far, z));
+			points.push_back(XMFLOAT2(-halfWidth*far, z));
+			points.push_back(XMFLOAT2(+halfWidth*far, -halfDepth*far));
+
+			CHECK(field.GetHeight(x, -halfDepth*far) == field.GetHeight(x, -halfDepth));
+			CHECK(field.GetHeight(+halfWidth*far, z) == field.GetHeight(+halfWidth, z));
+			CHECK(field.GetHeight(-halfWidth*far, z) == field.GetHeight(-halfWidth, z));
+		}
+
+		// Interior points, some on cell edges and diagonals.
+		for(int k = 0; k < 20000; ++k)
+		{
+			float x = (2.0f*unit(rng) - 1.0f)*halfWidth;
+			float z = (2.0f*unit(rng) - 1.0f)*halfDepth;
+			if( k % 4 == 1 )
+				x = -halfWidth + floorf(unit(rng)*(width-1))*cellSpacing;
+			if( k % 4 == 2 )
+				z = halfDepth - floorf(unit(rng)*(height-1))*cellSpacing;
+			points.push_back(XMFLOAT2(x, z));
+		}
+
+		// Large batch: bucketed by patch.
+		CheckBatch(field, points, &pool);
+		CheckBatch(field, points, 0);
+
+		// Small batches of every length up to a few steps of four, and one just
+		// under the bucketing threshold.
+		for(UINT n = 1; n <= 13; ++n)
+			CheckBatch(field, std::vector<XMFLOAT2>(points.end() - n, points.end()), &pool);
+		CheckBatch(field, std::vector<XMFLOAT2>(points.begin(), points.begin() + 4095), &pool);
+
+		// Throughput of the batched path against per point calls.
+		std::vector<float> heights(points.size());
+		double t0 = TestSeconds();
+		for(int rep = 0; rep < 10; ++rep)
+			field.GetHeights(&points[0], &heights[0], (UINT)points.size(), &pool);
+		double t1 = TestSeconds();
+		float sum = 0.0f;
+		for(int rep = 0; rep < 10; ++rep)
+			for(size_t i = 0; i < points.size(); ++i)
+				sum += field.GetHeight(points[i].x, points[i].y);
+		double t2 = TestSeconds();
+
+		double n = 10.0*points.size();
+		printf("  GetHeights %.1f Mqueries/s, GetHeight %.1f Mqueries/s (%g)\n",
+			n / (t1 - t0) * 1e-6, n / (t2 - t1) * 1e-6, sum > 0.0f ? 1.0 : 0.0);
+	}
+}
+
+int main()
+{
+	ThreadPool pool;
+	pool.Init(3);
+
+	TestMap(257, 193, 1.0f, pool);
+	TestMap(129, 321, 0.5f, pool);
+	TestMap(65, 65, 3.0f, pool);
+
+	// Missing and empty files are not opened; a truncated one reads zero past its end.
+	{
+		HeightmapSource source;
+		CHECK(!source.Open(L"TerrainHeightfieldTest.missing", HeightmapSource::Format_R8, 4, 4));
+		CHECK(!source.IsOpen());
+
+		FILE* file = fopen("TerrainHeightfieldTest.raw", "wb");
+		CHECK(file != 0);
+		if( file )
+			fclose(file);
+		CHECK(!source.Open(L"TerrainHeightfieldTest.raw", HeightmapSource::Format_R8, 4, 4));
+		CHECK(!source.IsOpen());
+
+		const BYTE texels[] = { 0, 51, 102, 153, 204, 255 };
+		file = fopen("TerrainHeightfieldTest.raw", "wb");
+		if( file )
+		{
+			fwrite(texels, 1, sizeof(texels), file);
+			fclose(file);
+		}
+		CHECK(source.Open(L"TerrainHeightfieldTest.raw", HeightmapSource::Format_R8, 4, 4));
+		CHECK(source.IsOpen());
+		CHECK(source.GetTexelCount() == sizeof(texels));
+
+		float heights[16];
+		source.ReadTile(0, 0, 4, 4, 10.0f, heights, 4);
+		CHECK(fabsf(heights[1] - 2.0f) < 1e-5f && heights[5] == 10.0f);
+		CHECK(heights[6] == 0.0f && heights[15] == 0.0f);
+
+		source.Close();
+		CHECK(!source.IsOpen());
+		remove("TerrainHeightfieldTest.raw");
+	}
+
+	return TestResult("TerrainHeightfieldTest");
+}
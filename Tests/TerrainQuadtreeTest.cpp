@@ -0,0 +1,233 @@
+//***************************************************************************************
+// TerrainQuadtreeTest.cpp
+//
+// TerrainQuadtree::Cull must keep exactly the patches whose boxes pass the per-patch
+// plane test the hull shader makes, for grids of every shape and cameras inside, above
+// and outside the map, and must report them as sorted, merged leaf ranges.  Also
+// prints the visible count and cull time against testing every patch on a large map.
+//***************************************************************************************
+
+#include "TerrainQuadtree.h"
+#include "TestUtil.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	const float PatchSize = 32.0f;   // CellsPerPatch cells of 0.5 units
+
+	struct Grid
+	{
+		UINT Rows;
+		UINT Cols;
+		std::vector<XMFLOAT2> BoundsY;
+
+		float Width()const { return Cols*PatchSize; }
+		float Depth()const { return Rows*PatchSize; }
+	};
+
+	Grid MakeGrid(UINT rows, UINT cols, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> base(0.0f, 50.0f);
+		std::uniform_real_distribution<float> range(0.0f, 20.0f);
+
+		Grid grid;
+		grid.Rows = rows;
+		grid.Cols = cols;
+		grid.BoundsY.resize(rows*cols);
+		for(size_t i = 0; i < grid.BoundsY.size(); ++i)
+		{
+			float minY = base(rng);
+			grid.BoundsY[i] = XMFLOAT2(minY, minY + range(rng));
+		}
+		return grid;
+	}
+
+	// Inward facing planes of a perspective camera, in the order of ExtractFrustumPlanes.
+	void MakeFrustum(XMFLOAT4 planes[6], const XMFLOAT3& eye, float yaw, float pitch,
+		float fovY, float aspect, float nearZ, float farZ)
+	{
+		XMVECTOR f = XMVectorSet(sinf(yaw)*cosf(pitch), sinf(pitch), cosf(yaw)*cosf(pitch), 0.0f);
+		XMVECTOR r = XMVector3Normalize(XMVector3Cross(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), f));
+		XMVECTOR u = XMVector3Cross(f, r);
+		XMVECTOR p = XMLoadFloat3(&eye);
+
+		float tanV = tanf(0.5f*fovY);
+		float tanH = tanV*aspect;
+
+		XMVECTOR normals[6] =
+		{
+			XMVector3Cross(u, f - r*tanH),   // left
+			XMVector3Cross(f + r*tanH, u),   // right
+			XMVector3Cross(f - u*tanV, r),   // bottom
+			XMVector3Cross(r, f + u*tanV),   // top
+			f,                               // near
+			XMVectorNegate(f)                // far
+		};
+		XMVECTOR points[6] = { p, p, p, p, p + f*nearZ, p + f*farZ };
+
+		for(int i = 0; i < 6; ++i)
+		{
+			XMVECTOR n = XMVector3Normalize(normals[i]);
+			float d = -XMVectorGetX(XMVector3Dot(n, points[i]));
+			XMStoreFloat4(&planes[i], XMVectorSetW(n, d));
+		}
+	}
+
+	// Every patch on its own, with the box and test the hull shader uses.
+	void BruteForceCull(const Grid& grid, const XMFLOAT4 planes[6], std::vector<char>& visible)
+	{
+		float patchWidth = grid.Width() / grid.Cols;
+		float patchDepth = grid.Depth() / grid.Rows;
+		float halfWidth  = 0.5f*grid.Width();
+		float halfDepth  = 0.5f*grid.Depth();
+
+		visible.assign(grid.Rows*grid.Cols, 0);
+		for(UINT i = 0; i < grid.Rows; ++i)
+		{
+			for(UINT j = 0; j < grid.Cols; ++j)
+			{
+				UINT patchID = i*grid.Cols + j;
+				XMVECTOR vMin = XMVectorSet(-halfWidth + j*patchWidth, grid.BoundsY[patchID].x, halfDepth - (i+1)*patchDepth, 0.0f);
+				XMVECTOR vMax = XMVectorSet(-halfWidth + (j+1)*patchWidth, grid.BoundsY[patchID].y, halfDepth - i*patchDepth, 0.0f);
+				XMVECTOR center  = 0.5f*(vMin + vMax);
+				XMVECTOR extents = 0.5f*(vMax - vMin);
+
+				bool inside = true;
+				for(int k = 0; k < 6 && inside; ++k)
+				{
+					XMVECTOR plane = XMLoadFloat4(&planes[k]);
+					float r = XMVectorGetX(XMVector3Dot(extents, XMVectorAbs(plane)));
+					float s = XMVectorGetX(XMPlaneDotCoord(plane, center));
+					inside = s + r >= 0.0f;
+				}
+				visible[patchID] = inside ? 1 : 0;
+			}
+		}
+	}
+
+	// Culls with the quadtree and checks the result against the brute force test.
+	void CheckCull(const TerrainQuadtree& tree, const Grid& grid, const XMFLOAT4 planes[6])
+	{
+		std::vector<TerrainQuadtree::LeafRange> ranges;
+		TerrainQuadtree::CullStats stats;
+		tree.Cull(planes, ranges, &stats);
+
+		std::vector<char> expected;
+		BruteForceCull(grid, planes, expected);
+
+		// Ranges are sorted, do not overlap and are merged whenever they touch.
+		std::vector<char> actual(expected.size(), 0);
+		UINT count = 0;
+		bool ordered = true;
+		for(size_t r = 0; r < ranges.size(); ++r)
+		{
+			if( r > 0 && ranges[r].FirstLeaf <= ranges[r-1].FirstLeaf + ranges[r-1].NumLeaves )
+				ordered = false;
+			for(UINT leaf = ranges[r].FirstLeaf; leaf < ranges[r].FirstLeaf + ranges[r].NumLeaves; ++leaf)
+				actual[tree.GetLeafPatch(leaf)] = 1;
+			count += ranges[r].NumLeaves;
+		}
+		CHECK(ordered);
+		CHECK(stats.NumVisible == count);
+		CHECK(stats.NumRanges == (UINT)ranges.size());
+		CHECK(stats.NumPatches == grid.Rows*grid.Cols);
+
+		int mismatches = 0;
+		for(size_t i = 0; i < expected.size(); ++i)
+		{
+			if( expected[i] != actual[i] && ++mismatches <= 5 )
+				printf("  %ux%u grid, patch %zu: quadtree %d, brute force %d\n", grid.Rows, grid.Cols, i, actual[i], expected[i]);
+		}
+		CHECK(mismatches == 0);
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(23);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// Every leaf appears once, whatever the grid shape.
+	const UINT shapes[][2] = { { 1, 1 }, { 1, 7 }, { 7, 1 }, { 2, 2 }, { 5, 3 }, { 31, 17 }, { 32, 32 }, { 33, 64 } };
+	for(size_t g = 0; g < sizeof(shapes)/sizeof(shapes[0]); ++g)
+	{
+		Grid grid = MakeGrid(shapes[g][0], shapes[g][1], (unsigned)g);
+
+		TerrainQuadtree tree;
+		tree.Build(&grid.BoundsY[0], grid.Rows, grid.Cols, grid.Width(), grid.Depth());
+		CHECK(tree.GetNumPatches() == grid.Rows*grid.Cols);
+
+		std::vector<int> seen(grid.Rows*grid.Cols, 0);
+		for(UINT leaf = 0; leaf < tree.GetNumPatches(); ++leaf)
+			++seen[tree.GetLeafPatch(leaf)];
+		bool once = true;
+		for(size_t i = 0; i < seen.size(); ++i)
+			once = once && seen[i] == 1;
+		CHECK(once);
+
+		// Cameras inside, above and outside the map, looking every way, with near and
+		// far planes that cut through it.
+		for(int c = 0; c < 200; ++c)
+		{
+			float span = 1.5f*(grid.Width() > grid.Depth() ? grid.Width() : grid.Depth());
+			XMFLOAT3 eye((unit(rng) - 0.5f)*span, unit(rng)*120.0f - 10.0f, (unit(rng) - 0.5f)*span);
+			float yaw   = unit(rng)*XM_2PI;
+			float pitch = (unit(rng) - 0.5f)*XM_PI*0.95f;
+			float farZ  = c % 2 ? 3000.0f : 20.0f + unit(rng)*200.0f;
+
+			XMFLOAT4 planes[6];
+			MakeFrustum(planes, eye, yaw, pitch, 0.25f*XM_PI, 16.0f/9.0f, 1.0f + unit(rng)*10.0f, farZ);
+			CheckCull(tree, grid, planes);
+		}
+	}
+
+	// A 16385x16385 heightmap, as the demo would see it from the ground.
+	{
+		Grid grid = MakeGrid(256, 256, 99);
+
+		TerrainQuadtree tree;
+		tree.Build(&grid.BoundsY[0], grid.Rows, grid.Cols, grid.Width(), grid.Depth());
+
+		const float views[][4] =
+		{
+			// eye y, pitch, far, yaw
+			{  60.0f,  0.0f,  500.0f, 0.3f },
+			{  60.0f, -0.2f, 3000.0f, 0.3f },
+			{ 400.0f, -1.2f, 3000.0f, 2.0f },
+		};
+		for(size_t v = 0; v < sizeof(views)/sizeof(views[0]); ++v)
+		{
+			XMFLOAT4 planes[6];
+			MakeFrustum(planes, XMFLOAT3(0.0f, views[v][0], 0.0f), views[v][3], views[v][1],
+				0.25f*XM_PI, 16.0f/9.0f, 1.0f, views[v][2]);
+			CheckCull(tree, grid, planes);
+
+			std::vector<TerrainQuadtree::LeafRange> ranges;
+			std::vector<char> visible;
+			TerrainQuadtree::CullStats stats;
+			double quadtree = 1e30, bruteForce = 1e30;
+			for(int run = 0; run < 20; ++run)
+			{
+				double t0 = TestSeconds();
+				tree.Cull(planes, ranges, &stats);
+				double t1 = TestSeconds();
+				BruteForceCull(grid, planes, visible);
+				double t2 = TestSeconds();
+
+				quadtree   = t1 - t0 < quadtree ? t1 - t0 : quadtree;
+				bruteForce = t2 - t1 < bruteForce ? t2 - t1 : bruteForce;
+			}
+
+			printf("view %zu: %u of %u patches visible in %u ranges, %u nodes tested, cull %.3f ms, every patch %.3f ms\n",
+				v, stats.NumVisible, stats.NumPatches, stats.NumRanges, stats.NumNodesTested,
+				quadtree*1000.0, bruteForce*1000.0);
+		}
+	}
+
+	return TestResult("TerrainQuadtreeTest");
+}
@@ -0,0 +1,155 @@
+//***************************************************************************************
+// TerrainRayTest.cpp
+//
+// Checks TerrainHeightfield::CastRay against marching the ray in small steps over
+// GetHeight, checks CastRays against CastRay, and reports rays per second.
+//***************************************************************************************
+
+#include "TerrainHeightfield.h"
+#include "ThreadPool.h"
+#include "TestUtil.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	const UINT MapSize = 513;
+	const float CellSpacing = 0.5f;
+
+	// Height of the ray above the surface at distance t.
+	float Clearance(const TerrainHeightfield& field, const XMFLOAT3& o, const XMFLOAT3& d, float t)
+	{
+		float x = o.x + d.x*t;
+		float y = o.y + d.y*t;
+		float z = o.z + d.z*t;
+		return y - field.GetHeight(x, z);
+	}
+
+	bool InsideMap(const TerrainHeightfield& field, const XMFLOAT3& o, const XMFLOAT3& d, float t)
+	{
+		return fabsf(o.x + d.x*t) <= 0.5f*field.GetWidth() && fabsf(o.z + d.z*t) <= 0.5f*field.GetDepth();
+	}
+}
+
+int main()
+{
+	// A rough random map; smoothing turns it into hills a few cells across.
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	{
+		std::vector<unsigned char> texels(MapSize*MapSize);
+		for(size_t i = 0; i < texels.size(); ++i)
+			texels[i] = (unsigned char)(unit(rng)*255.0f);
+
+		FILE* file = fopen("TerrainRayTest.raw", "wb");
+		CHECK(file != 0);
+		if( file )
+		{
+			fwrite(&texels[0], 1, texels.size(), file);
+			fclose(file);
+		}
+	}
+
+	TerrainHeightfield::InitInfo info;
+	info.HeightMapFilename = L"TerrainRayTest.raw";
+	info.HeightmapFormat   = HeightmapSource::Format_R8;
+	info.HeightScale       = 40.0f;
+	info.HeightmapWidth    = MapSize;
+	info.HeightmapHeight   = MapSize;
+	info.CellSpacing       = CellSpacing;
+
+	TerrainHeightfield field;
+	field.Init(info);
+	remove("TerrainRayTest.raw");
+
+	// Rays starting above the terrain in every direction, most of them heading down.
+	const UINT numRays = 2000;
+	std::vector<TerrainHeightfield::RayQuery> rays(numRays);
+	for(UINT i = 0; i < numRays; ++i)
+	{
+		TerrainHeightfield::RayQuery& ray = rays[i];
+		ray.Origin.x = (unit(rng) - 0.5f)*field.GetWidth();
+		ray.Origin.z = (unit(rng) - 0.5f)*field.GetDepth();
+		ray.Origin.y = field.GetHeight(ray.Origin.x, ray.Origin.z) + 0.5f + 20.0f*unit(rng);
+
+		XMVECTOR dir = XMVectorSet(unit(rng) - 0.5f, -unit(rng)*0.6f + 0.1f, unit(rng) - 0.5f, 0.0f);
+		XMStoreFloat3(&ray.Dir, XMVector3Normalize(dir));
+		ray.MaxDist = 400.0f*unit(rng);
+	}
+
+	// Compare each ray with a march in steps of a small fraction of a cell.  A hit
+	// must be on the surface with no crossing before it; a miss must stay above.
+	const float step = 0.02f*CellSpacing;
+	const float tolerance = 1e-3f;
+	int hits = 0;
+	int bad = 0;
+	for(UINT i = 0; i < numRays; ++i)
+	{
+		const TerrainHeightfield::RayQuery& ray = rays[i];
+		float hitDist = -1.0f;
+		bool hit = field.CastRay(ray.Origin, ray.Dir, ray.MaxDist, hitDist);
+
+		float end = hit ? hitDist - 2.0f*step : ray.MaxDist;
+		bool crossed = false;
+		for(float t = 0.0f; t < end && !crossed; t += step)
+			crossed = InsideMap(field, ray.Origin, ray.Dir, t) && Clearance(field, ray.Origin, ray.Dir, t) < -tolerance;
+
+		bool ok = !crossed;
+		if( hit )
+		{
+			++hits;
+			ok = ok && hitDist >= 0.0f && hitDist <= ray.MaxDist &&
+				fabsf(Clearance(field, ray.Origin, ray.Dir, hitDist)) <= tolerance;
+		}
+
+		if( !ok && ++bad <= 10 )
+			printf("  ray %u: hit %d at %g\n", i, hit ? 1 : 0, hitDist);
+	}
+
+	CHECK(bad == 0);
+	CHECK(hits > (int)numRays/4 && hits < (int)numRays);
+
+	// The batched version gives the same answers.
+	ThreadPool pool;
+	pool.Init(3);
+
+	std::vector<TerrainHeightfield::RayHit> results(numRays);
+	field.CastRays(&rays[0], &results[0], numRays, &pool);
+	int batchMismatches = 0;
+	for(UINT i = 0; i < numRays; ++i)
+	{
+		float hitDist = 0.0f;
+		bool hit = field.CastRay(rays[i].Origin, rays[i].Dir, rays[i].MaxDist, hitDist);
+		if( hit != results[i].Hit || (hit && hitDist != results[i].Dist) )
+			++batchMismatches;
+	}
+	CHECK(batchMismatches == 0);
+
+	// Segments: one straight down through the surface, one well above it.
+	CHECK(field.IntersectSegment(XMFLOAT3(1.0f, 100.0f, 2.0f), XMFLOAT3(1.0f, -100.0f, 2.0f)));
+	CHECK(!field.IntersectSegment(XMFLOAT3(-50.0f, 200.0f, 0.0f), XMFLOAT3(50.0f, 200.0f, 0.0f)));
+
+	// Throughput.
+	const int reps = 20;
+	double t0 = TestSeconds();
+	for(int rep = 0; rep < reps; ++rep)
+	{
+		for(UINT i = 0; i < numRays; ++i)
+		{
+			float hitDist;
+			field.CastRay(rays[i].Origin, rays[i].Dir, rays[i].MaxDist, hitDist);
+		}
+	}
+	double t1 = TestSeconds();
+	for(int rep = 0; rep < reps; ++rep)
+		field.CastRays(&rays[0], &results[0], numRays, &pool);
+	double t2 = TestSeconds();
+
+	printf("%d of %u rays hit; CastRay %.2f Mrays/s, CastRays %.2f Mrays/s (%u threads)\n",
+		hits, numRays, reps*numRays / (t1 - t0) * 1e-6, reps*numRays / (t2 - t1) * 1e-6, pool.ThreadCount());
+
+	return TestResult("TerrainRayTest");
+}
@@ -0,0 +1,254 @@
+//***************************************************************************************
+// TerrainSmoothTest.cpp
+//
+// TerrainHeightfield::Init must produce exactly what Terrain::Init produced before the
+// heightmap preprocessing was rewritten: 8-bit texels divided by 255 and scaled, the
+// 3x3 Average()/InBounds() box filter, and the per-patch min/max heights.  Checked bit
+// for bit on odd and even sizes, including maps too narrow for the vector path, and
+// timed against that baseline on 2049^2, 4097^2 and 8193^2 maps.
+//***************************************************************************************
+
+#include "TerrainHeightfield.h"
+#include "ThreadPool.h"
+#include "TestUtil.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	const float HeightScale = 50.0f;
+
+	// Terrain::LoadHeightmap, Smooth, Average, InBounds and CalcAllPatchBoundsY as
+	// they were, reading the file with std::ifstream and filtering one texel at a time.
+	class BaselineHeightmap
+	{
+	public:
+		BaselineHeightmap(const char* filename, UINT width, UINT height)
+		: mWidth(width), mHeight(height)
+		{
+			double t0 = TestSeconds();
+			Load(filename);
+			double t1 = TestSeconds();
+			Smooth();
+			double t2 = TestSeconds();
+			CalcAllPatchBoundsY();
+			double t3 = TestSeconds();
+
+			LoadSeconds   = t1 - t0;
+			SmoothSeconds = t2 - t1;
+			BoundsSeconds = t3 - t2;
+		}
+
+		std::vector<float> Heightmap;
+		std::vector<XMFLOAT2> PatchBoundsY;
+		double LoadSeconds;
+		double SmoothSeconds;
+		double BoundsSeconds;
+
+	private:
+		void Load(const char* filename)
+		{
+			std::vector<unsigned char> in(mWidth*mHeight);
+
+			std::ifstream inFile;
+			inFile.open(filename, std::ios_base::binary);
+			if( inFile )
+			{
+				inFile.read((char*)&in[0], (std::streamsize)in.size());
+				inFile.close();
+			}
+
+			Heightmap.resize(mHeight*mWidth, 0);
+			for(UINT i = 0; i < mHeight*mWidth; ++i)
+				Heightmap[i] = (in[i] / 255.0f)*HeightScale;
+		}
+
+		void Smooth()
+		{
+			std::vector<float> dest(Heightmap.size());
+
+			for(UINT i = 0; i < mHeight; ++i)
+			{
+				for(UINT j = 0; j < mWidth; ++j)
+					dest[i*mWidth+j] = Average(i,j);
+			}
+
+			Heightmap = dest;
+		}
+
+		bool InBounds(int i, int j)const
+		{
+			return
+				i >= 0 && i < (int)mHeight &&
+				j >= 0 && j < (int)mWidth;
+		}
+
+		float Average(int i, int j)const
+		{
+			float avg = 0.0f;
+			float num = 0.0f;
+
+			for(int m = i-1; m <= i+1; ++m)
+			{
+				for(int n = j-1; n <= j+1; ++n)
+				{
+					if( InBounds(m,n) )
+					{
+						avg += Heightmap[m*mWidth + n];
+						num += 1.0f;
+					}
+				}
+			}
+
+			return avg / num;
+		}
+
+		void CalcAllPatchBoundsY()
+		{
+			const UINT cells = TerrainHeightfield::CellsPerPatch;
+			UINT rows = (mHeight-1) / cells;
+			UINT cols = (mWidth-1) / cells;
+
+			PatchBoundsY.resize(rows*cols);
+			for(UINT i = 0; i < rows; ++i)
+			{
+				for(UINT j = 0; j < cols; ++j)
+				{
+					float minY = +INFINITY;
+					float maxY = -INFINITY;
+					for(UINT y = i*cells; y <= (i+1)*cells; ++y)
+					{
+						for(UINT x = j*cells; x <= (j+1)*cells; ++x)
+						{
+							float h = Heightmap[y*mWidth + x];
+							minY = h < minY ? h : minY;
+							maxY = h > maxY ? h : maxY;
+						}
+					}
+					PatchBoundsY[i*cols+j] = XMFLOAT2(minY, maxY);
+				}
+			}
+		}
+
+		UINT mWidth;
+		UINT mHeight;
+	};
+
+	void WriteHeightmap(const char* name, UINT width, UINT height, unsigned seed)
+	{
+		// Mostly random bytes, with runs of 0 and 255 so the extremes are filtered too.
+		std::mt19937 rng(seed);
+		std::vector<BYTE> texels((size_t)width*height);
+		for(size_t i = 0; i < texels.size(); ++i)
+		{
+			unsigned r = rng();
+			texels[i] = (r & 0x700) == 0 ? 0 : ((r & 0x700) == 0x700 ? 255 : (BYTE)r);
+		}
+
+		FILE* file = fopen(name, "wb");
+		CHECK(file != 0);
+		if( file )
+		{
+			fwrite(&texels[0], 1, texels.size(), file);
+			fclose(file);
+		}
+	}
+
+	// Index of the first differing float, or count if none.
+	size_t FirstMismatch(const float* a, const float* b, size_t count)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			if( memcmp(&a[i], &b[i], sizeof(float)) != 0 )
+				return i;
+		}
+		return count;
+	}
+
+	void CheckMap(UINT width, UINT height, bool benchmark)
+	{
+		const char* name = "TerrainSmoothTest.raw";
+		WriteHeightmap(name, width, height, width*7 + height);
+
+		TerrainHeightfield::InitInfo info;
+		info.HeightMapFilename = L"TerrainSmoothTest.raw";
+		info.HeightmapFormat   = HeightmapSource::Format_R8;
+		info.HeightScale       = HeightScale;
+		info.HeightmapWidth    = width;
+		info.HeightmapHeight   = height;
+		info.CellSpacing       = 0.5f;
+
+		double baselineSeconds = 0.0;
+		std::vector<float> expected;
+		std::vector<XMFLOAT2> expectedBounds;
+		{
+			BaselineHeightmap baseline(name, width, height);
+			baselineSeconds = baseline.LoadSeconds + baseline.SmoothSeconds + baseline.BoundsSeconds;
+			if( benchmark )
+			{
+				printf("%5u x %-5u baseline: load %7.1f ms, smooth %7.1f ms, bounds %6.1f ms\n", width, height,
+					baseline.LoadSeconds*1000.0, baseline.SmoothSeconds*1000.0, baseline.BoundsSeconds*1000.0);
+			}
+			expected.swap(baseline.Heightmap);
+			expectedBounds.swap(baseline.PatchBoundsY);
+		}
+
+		TerrainHeightfield field;
+		double t0 = TestSeconds();
+		field.Init(info);
+		double seconds = TestSeconds() - t0;
+		remove(name);
+
+		const std::vector<float>& heights = field.GetHeightmap();
+		CHECK(heights.size() == expected.size());
+		if( heights.size() == expected.size() )
+		{
+			size_t i = FirstMismatch(&heights[0], &expected[0], expected.size());
+			if( i != expected.size() )
+			{
+				printf("  %u x %u: texel (%zu, %zu) is %.9g, baseline gives %.9g\n",
+					width, height, i % width, i / width, heights[i], expected[i]);
+			}
+			CHECK(i == expected.size());
+		}
+
+		const std::vector<XMFLOAT2>& bounds = field.GetPatchBoundsY();
+		CHECK(bounds.size() == expectedBounds.size());
+		if( bounds.size() == expectedBounds.size() && !bounds.empty() )
+			CHECK(memcmp(&bounds[0], &expectedBounds[0], bounds.size()*sizeof(XMFLOAT2)) == 0);
+
+		if( benchmark )
+		{
+			double texels = (double)width*height;
+			printf("%5u x %-5u TerrainHeightfield::Init %7.1f ms against %7.1f ms, %.1f Mtexels/s against %.1f Mtexels/s (%u threads)\n",
+				width, height, seconds*1000.0, baselineSeconds*1000.0,
+				texels/seconds*1e-6, texels/baselineSeconds*1e-6, ThreadPool::Default().ThreadCount());
+		}
+	}
+}
+
+int main()
+{
+	// Small maps of odd and even sizes: every texel is next to a border or the end of
+	// the four-wide interior loop.  Maps under three texels wide or high have no
+	// interior at all.
+	const UINT sizes[][2] =
+	{
+		{ 1, 1 }, { 2, 2 }, { 1, 5 }, { 5, 1 }, { 2, 9 }, { 3, 3 }, { 4, 4 }, { 5, 6 },
+		{ 6, 5 }, { 7, 8 }, { 8, 7 }, { 9, 9 }, { 10, 13 }, { 64, 64 }, { 65, 65 },
+		{ 66, 67 }, { 130, 129 }, { 257, 193 }, { 200, 300 },
+	};
+	for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+		CheckMap(sizes[s][0], sizes[s][1], false);
+
+	// The demo's map and the two sizes above it.
+	CheckMap(2049, 2049, true);
+	CheckMap(4097, 4097, true);
+	CheckMap(8193, 8193, true);
+
+	return TestResult("TerrainSmoothTest");
+}
@@ -0,0 +1,193 @@
+//***************************************************************************************
+// TerrainTileStoreTest.cpp
+//
+// Walks a camera across a synthetic 32k x 32k heightmap (4 GB of float heights) with
+// the tile store capped at 48 MB, checking every height and patch bounds query
+// against the analytic map and the resident size against the budget on every frame.
+//***************************************************************************************
+
+#include "TerrainTileStore.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <random>
+using namespace DirectX;
+
+namespace
+{
+	const UINT MapCells = 32768;
+	const UINT MapTexels = MapCells + 1;
+	const UINT64 MemoryBudget = 48ull << 20;
+
+	// Height of texel (x, y); cheap to evaluate and different for every texel.
+	float TexelHeight(UINT x, UINT y)
+	{
+		UINT h = x*73856093u ^ y*19349663u;
+		h ^= h >> 13;
+		return (float)(h & 0xFFFF) / 256.0f;
+	}
+
+	// GetHeight of a map of TexelHeight values, written out the way
+	// TerrainHeightfield::GetHeight computes it.
+	float ReferenceHeight(float x, float z, float cellSpacing)
+	{
+		float halfSize = 0.5f*(MapTexels-1)*cellSpacing;
+		float c = (x + halfSize) /  cellSpacing;
+		float d = (z - halfSize) / -cellSpacing;
+		c = c < 0.0f ? 0.0f : (c > (float)(MapTexels-1) ? (float)(MapTexels-1) : c);
+		d = d < 0.0f ? 0.0f : (d > (float)(MapTexels-1) ? (float)(MapTexels-1) : d);
+
+		int row = (int)floorf(d) < (int)MapTexels-2 ? (int)floorf(d) : (int)MapTexels-2;
+		int col = (int)floorf(c) < (int)MapTexels-2 ? (int)floorf(c) : (int)MapTexels-2;
+
+		float A = TexelHeight(col,   row);
+		float B = TexelHeight(col+1, row);
+		float C = TexelHeight(col,   row+1);
+		float D = TexelHeight(col+1, row+1);
+
+		float s = c - (float)col;
+		float t = d - (float)row;
+		if( s + t <= 1.0f )
+			return A + s*(B - A) + t*(C - A);
+		else
+			return D + (1.0f-s)*(C - D) + (1.0f-t)*(B - D);
+	}
+
+	XMFLOAT2 ReferencePatchBoundsY(UINT row, UINT col, UINT patchCells)
+	{
+		XMFLOAT2 bounds(+FLT_MAX, -FLT_MAX);
+		for(UINT y = row*patchCells; y <= (row+1)*patchCells; ++y)
+		{
+			for(UINT x = col*patchCells; x <= (col+1)*patchCells; ++x)
+			{
+				float h = TexelHeight(x, y);
+				bounds.x = h < bounds.x ? h : bounds.x;
+				bounds.y = h > bounds.y ? h : bounds.y;
+			}
+		}
+		return bounds;
+	}
+}
+
+int main()
+{
+	TerrainTileStore::InitInfo info;
+	info.HeightmapWidth  = MapTexels;
+	info.HeightmapHeight = MapTexels;
+	info.CellSpacing     = 1.0f;
+	info.TileCells       = 512;
+	info.PatchCells      = 64;
+	info.MemoryBudget    = MemoryBudget;
+	info.PrefetchRadius  = 2;
+	info.PrefetchAhead   = 2;
+
+	std::atomic<UINT> badRequests(0);
+	std::atomic<UINT64> texelsLoaded(0);
+	TerrainTileStore::TileLoader loader = [&](UINT x0, UINT y0, UINT w, UINT h, float* dest, UINT destPitch)
+	{
+		if( x0 + w > MapTexels || y0 + h > MapTexels || destPitch < w )
+		{
+			++badRequests;
+			return false;
+		}
+
+		for(UINT y = 0; y < h; ++y)
+			for(UINT x = 0; x < w; ++x)
+				dest[(size_t)y*destPitch + x] = TexelHeight(x0 + x, y0 + y);
+
+		texelsLoaded += (UINT64)w*h;
+		return true;
+	};
+
+	TerrainTileStore store;
+	CHECK(store.Init(info, loader));
+	CHECK(store.GetNumPatchRows() == MapCells / info.PatchCells);
+
+	float halfSize = 0.5f*store.GetWidth();
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> around(-150.0f, 150.0f);
+
+	// Corner to corner, then back along the other diagonal, 24 units per frame.
+	const XMFLOAT2 path[] =
+	{
+		XMFLOAT2(-halfSize + 100.0f, -halfSize + 100.0f),
+		XMFLOAT2(+halfSize - 100.0f, +halfSize - 100.0f),
+		XMFLOAT2(-halfSize + 100.0f, +halfSize - 100.0f),
+	};
+	const float speed = 24.0f;
+
+	UINT frames = 0;
+	UINT64 peakBytes = 0;
+	int heightMismatches = 0;
+	int boundsMismatches = 0;
+	double t0 = TestSeconds();
+
+	for(int leg = 0; leg + 1 < (int)(sizeof(path)/sizeof(path[0])); ++leg)
+	{
+		XMVECTOR a = XMLoadFloat2(&path[leg]);
+		XMVECTOR b = XMLoadFloat2(&path[leg+1]);
+		float length = XMVectorGetX(XMVector2Length(XMVectorSubtract(b, a)));
+		UINT steps = (UINT)(length / speed);
+
+		for(UINT step = 0; step <= steps; ++step, ++frames)
+		{
+			XMFLOAT2 eye;
+			XMStoreFloat2(&eye, XMVectorLerp(a, b, (float)step / steps));
+			store.Update(XMFLOAT3(eye.x, 100.0f, eye.y));
+
+			// The camera height, then scattered queries around it as gameplay
+			// code would make.
+			for(int k = 0; k < 17; ++k)
+			{
+				float x = eye.x + (k ? around(rng) : 0.0f);
+				float z = eye.y + (k ? around(rng) : 0.0f);
+
+				float expected = ReferenceHeight(x, z, info.CellSpacing);
+				float h = store.GetHeight(x, z);
+				if( h != expected && ++heightMismatches <= 10 )
+					printf("  height (%g, %g): %.9g, expected %.9g\n", x, z, h, expected);
+
+				float tryHeight;
+				if( store.TryGetHeight(x, z, tryHeight) && tryHeight != expected )
+					++heightMismatches;
+			}
+
+			if( frames % 64 == 0 )
+			{
+				UINT row = (UINT)((halfSize - eye.y) / info.CellSpacing) / info.PatchCells;
+				UINT col = (UINT)((eye.x + halfSize) / info.CellSpacing) / info.PatchCells;
+				XMFLOAT2 expected = ReferencePatchBoundsY(row, col, info.PatchCells);
+				XMFLOAT2 bounds = store.GetPatchBoundsY(row, col);
+				if( bounds.x != expected.x || bounds.y != expected.y )
+					++boundsMismatches;
+			}
+
+			TerrainTileStore::Stats stats = store.GetStats();
+			peakBytes = stats.ResidentBytes > peakBytes ? stats.ResidentBytes : peakBytes;
+		}
+	}
+
+	double t1 = TestSeconds();
+
+	// Off the map: the height of the nearest border point.
+	CHECK(store.GetHeight(halfSize + 5000.0f, 12.25f) == store.GetHeight(halfSize, 12.25f));
+	CHECK(store.GetHeight(-3.5f, -halfSize - 1e6f) == store.GetHeight(-3.5f, -halfSize));
+	CHECK(store.GetHeight(halfSize, 12.25f) == ReferenceHeight(halfSize, 12.25f, info.CellSpacing));
+
+	TerrainTileStore::Stats stats = store.GetStats();
+	printf("%u frames in %.2f s; peak resident %.1f MB of %.1f MB budget\n",
+		frames, t1 - t0, peakBytes / 1048576.0, MemoryBudget / 1048576.0);
+	printf("tiles: %llu prefetched, %llu loaded on demand, %llu evicted; %.2f GB of heights read\n",
+		(unsigned long long)stats.TilesPrefetched, (unsigned long long)stats.TilesLoadedOnDemand,
+		(unsigned long long)stats.TilesEvicted, texelsLoaded.load()*sizeof(float) / 1073741824.0);
+
+	CHECK(heightMismatches == 0);
+	CHECK(boundsMismatches == 0);
+	CHECK(badRequests.load() == 0);
+	CHECK(peakBytes <= MemoryBudget);
+	CHECK(stats.TilesEvicted > 0);
+
+	store.Shutdown();
+	return TestResult("TerrainTileStoreTest");
+}
@@ -0,0 +1,47 @@
+//***************************************************************************************
+// TestUtil.h
+//
+// Minimal check macros and timing for the headless tests.  A failed CHECK prints its
+// location and is counted; main() returns TestResult() so ctest sees the failure.
+//***************************************************************************************
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+inline int& TestFailureCount()
+{
+	static int count = 0;
+	return count;
+}
+
+inline void TestFail(const char* file, int line, const char* expr)
+{
+	fprintf(stderr, "%s(%d): CHECK(%s) failed\n", file, line, expr);
+	++TestFailureCount();
+}
+
+#define CHECK(expr) \
+	do { if( !(expr) ) TestFail(__FILE__, __LINE__, #expr); } while(0)
+
+// Compares the bit patterns, so -0 and +0 or two NaNs with different payloads differ.
+#define CHECK_BITWISE_EQUAL(a, b) \
+	do { if( memcmp(&(a), &(b), sizeof(a)) != 0 ) TestFail(__FILE__, __LINE__, #a " == " #b); } while(0)
+
+inline int TestResult(const char* name)
+{
+	int failures = TestFailureCount();
+	printf("%s: %s (%d failed checks)\n", name, failures ? "FAILED" : "passed", failures);
+	return failures ? 1 : 0;
+}
+
+// Seconds since an arbitrary fixed point, for throughput figures.
+inline double TestSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // TESTUTIL_H
@@ -0,0 +1,486 @@
+//***************************************************************************************
+// TextureCacheTest.cpp
+//
+// TextureCache must load each texture once however many threads ask for it at the
+// same time, hand every waiting thread the loader's error, and cache nothing for a
+// failed load.  Over the budget it may only evict textures nothing else references,
+// least recently requested first, and Clear and Trim racing loads must leave the byte
+// count right and never release a view twice.  The loader makes views of stub
+// textures that count how many are alive.  Also prints requests per second on 1 to 32
+// threads, warm and with slow loads, against one map under one mutex.
+//***************************************************************************************
+
+#include "TextureCache.h"
+#include "TestUtil.h"
+#include <wrl.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	std::atomic<long> LiveTextures(0);
+	std::atomic<long> Loads(0);
+
+	// A 16x16 RGBA texture that counts itself.
+	struct CountedTexture : ID3D11Texture2D
+	{
+		CountedTexture()
+		{
+			D3D11_TEXTURE2D_DESC desc = {};
+			desc.Width = 16;
+			desc.Height = 16;
+			desc.MipLevels = 1;
+			desc.ArraySize = 1;
+			desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			desc.SampleDesc.Count = 1;
+			Desc = desc;
+			++LiveTextures;
+		}
+		~CountedTexture() { --LiveTextures; }
+	};
+
+	const size_t TextureBytes = 16*16*4;
+
+	void Spin(int microseconds)
+	{
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+		while( std::chrono::steady_clock::now() < end )
+		{
+		}
+	}
+
+	// Loads a counted texture after spinning for the given time.
+	TextureCache::Loader SlowLoader(int microseconds)
+	{
+		return [microseconds](const wchar_t*, ID3D11ShaderResourceView** view)
+		{
+			++Loads;
+			if( microseconds )
+				Spin(microseconds);
+			ID3D11Texture2D* texture = new CountedTexture;
+			*view = new ID3D11ShaderResourceView(texture);
+			texture->Release();
+		};
+	}
+
+	// Blocks until the cache has counted waits requests waiting on another thread's load,
+	// or a few seconds have gone by.
+	void WaitForWaiters(TextureCache& cache, uint64_t waits)
+	{
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while( cache.GetStats().waits < waits && std::chrono::steady_clock::now() < end )
+			std::this_thread::yield();
+	}
+
+	bool IsCached(TextureCache& cache, const wchar_t* name)
+	{
+		ID3D11ShaderResourceView* view = 0;
+		bool found = cache.Find(name, &view);
+		if( view )
+			view->Release();
+		return found;
+	}
+
+	void CheckTextureBytes()
+	{
+		ID3D11Device device;
+
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.ByteWidth = 1000;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		device.CreateBuffer(&bufferDesc, 0, buffer.GetAddressOf());
+
+		// 100, 50 and 25 texels in two slices.
+		D3D11_TEXTURE1D_DESC desc1D = {};
+		desc1D.Width = 100;
+		desc1D.MipLevels = 3;
+		desc1D.ArraySize = 2;
+		desc1D.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		Microsoft::WRL::ComPtr<ID3D11Texture1D> texture1D;
+		device.CreateTexture1D(&desc1D, 0, texture1D.GetAddressOf());
+
+		// Block compressed: 8 bytes per 4x4 block, and a whole block for the 2x2 and 1x1
+		// mips.  Three slices.
+		D3D11_TEXTURE2D_DESC desc2D = {};
+		desc2D.Width = 16;
+		desc2D.Height = 8;
+		desc2D.MipLevels = 5;
+		desc2D.ArraySize = 3;
+		desc2D.Format = DXGI_FORMAT_BC1_UNORM;
+		desc2D.SampleDesc.Count = 1;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture2D;
+		device.CreateTexture2D(&desc2D, 0, texture2D.GetAddressOf());
+
+		// Depth halves with the mips too: 8x4x4, 4x2x2, 2x1x1.
+		D3D11_TEXTURE3D_DESC desc3D = {};
+		desc3D.Width = 8;
+		desc3D.Height = 4;
+		desc3D.Depth = 4;
+		desc3D.MipLevels = 3;
+		desc3D.Format = DXGI_FORMAT_R32_FLOAT;
+		Microsoft::WRL::ComPtr<ID3D11Texture3D> texture3D;
+		device.CreateTexture3D(&desc3D, 0, texture3D.GetAddressOf());
+
+		ID3D11Resource* resources[] = { buffer.Get(), texture1D.Get(), texture2D.Get(), texture3D.Get() };
+		const size_t expected[] =
+		{
+			1000,
+			(100 + 50 + 25)*4*2,
+			(4*2 + 2*1 + 1 + 1 + 1)*8*3,
+			(8*4*4 + 4*2*2 + 2*1*1)*4,
+		};
+		for(size_t i = 0; i < 4; ++i)
+		{
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view;
+			device.CreateShaderResourceView(resources[i], 0, view.GetAddressOf());
+			CHECK(TextureCache::GetTextureBytes(view.Get()) == expected[i]);
+		}
+	}
+
+	void CheckSingleThread()
+	{
+		TextureCache cache;
+		TextureCache::Loader loader = SlowLoader(0);
+		Loads = 0;
+
+		// Case and slash direction do not matter.
+		ID3D11ShaderResourceView* a = 0;
+		ID3D11ShaderResourceView* b = 0;
+		cache.GetOrLoad(L"Textures/Snow.DDS", loader, &a);
+		cache.GetOrLoad(L"textures\\snow.dds", loader, &b);
+		CHECK(a != 0 && a == b && Loads == 1);
+		CHECK(!IsCached(cache, L"textures\\snow.dd"));
+		CHECK(!IsCached(cache, L"textures\\snow.ddss"));
+
+		TextureCache::Stats stats = cache.GetStats();
+		CHECK(stats.textures == 1 && stats.bytes == TextureBytes && stats.hits == 1 && stats.misses == 1);
+
+		// A loader that makes no view fails the request and caches nothing.
+		bool threw = false;
+		try
+		{
+			ID3D11ShaderResourceView* none = 0;
+			cache.GetOrLoad(L"empty", [](const wchar_t*, ID3D11ShaderResourceView**) {}, &none);
+		}
+		catch(...)
+		{
+			threw = true;
+		}
+		CHECK(threw && !IsCached(cache, L"empty"));
+
+		// Textures still referenced outside the cache stay, over the budget if need be.
+		cache.SetBudget(0);
+		CHECK(cache.GetStats().textures == 1 && IsCached(cache, L"TEXTURES/SNOW.DDS"));
+		a->Release();
+		b->Release();
+		CHECK(cache.Trim(0) == 0 && cache.GetStats().textures == 0 && cache.GetStats().evictions == 1);
+
+		// Least recently requested first.  A hit makes a texture as new as the last load.
+		cache.SetBudget(SIZE_MAX);
+		const wchar_t* names[] = { L"1", L"2", L"3", L"4" };
+		ID3D11ShaderResourceView* view = 0;
+		for(size_t i = 0; i < 4; ++i)
+		{
+			cache.GetOrLoad(names[i], loader, &view);
+			view->Release();
+		}
+		cache.GetOrLoad(L"1", loader, &view);
+		view->Release();
+
+		// Without the hit 1 would go first.
+		cache.SetBudget(3*TextureBytes);
+		CHECK(cache.GetStats().textures == 3 && !IsCached(cache, L"2"));
+
+		// Loading a fifth evicts 3, then the new one, which the caller holds, outlives
+		// a budget of nothing.
+		cache.GetOrLoad(L"5", loader, &view);
+		CHECK(cache.GetStats().textures == 3 && !IsCached(cache, L"3"));
+		CHECK(IsCached(cache, L"1") && IsCached(cache, L"4"));
+		cache.SetBudget(0);
+		CHECK(cache.GetStats().textures == 1 && IsCached(cache, L"5"));
+		view->Release();
+
+		cache.Clear();
+		stats = cache.GetStats();
+		CHECK(stats.textures == 0 && stats.bytes == 0);
+		CHECK(LiveTextures == 0);
+	}
+
+	void CheckConcurrentLoads()
+	{
+		TextureCache cache;
+		const int numThreads = 8;
+
+		// Every thread asks for one texture while the first is still loading it.
+		Loads = 0;
+		std::vector<ID3D11ShaderResourceView*> views(numThreads, 0);
+		std::vector<std::thread> threads;
+		for(int t = 0; t < numThreads; ++t)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				cache.GetOrLoad(L"shared", [&](const wchar_t* name, ID3D11ShaderResourceView** view)
+				{
+					WaitForWaiters(cache, numThreads - 1);
+					SlowLoader(0)(name, view);
+				}, &views[t]);
+			}));
+		}
+		for(size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+
+		CHECK(Loads == 1 && cache.GetStats().waits == numThreads - 1);
+		for(int t = 0; t < numThreads; ++t)
+		{
+			CHECK(views[t] == views[0]);
+			views[t]->Release();
+		}
+
+		// The loader's error reaches every waiting thread without any of them loading
+		// again, and nothing is cached.
+		std::atomic<int> errors(0), calls(0);
+		uint64_t waits = cache.GetStats().waits;
+		threads.clear();
+		for(int t = 0; t < numThreads; ++t)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				try
+				{
+					ID3D11ShaderResourceView* view = 0;
+					cache.GetOrLoad(L"bad", [&](const wchar_t*, ID3D11ShaderResourceView**)
+					{
+						if( calls++ == 0 )
+							WaitForWaiters(cache, waits + numThreads - 1);
+						throw std::runtime_error("bad texture");
+					}, &view);
+				}
+				catch(const std::runtime_error&)
+				{
+					++errors;
+				}
+			}));
+		}
+		for(size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+
+		CHECK(errors == numThreads && calls == 1 && !IsCached(cache, L"bad"));
+
+		// A later request tries again.
+		ID3D11ShaderResourceView* view = 0;
+		cache.GetOrLoad(L"bad", SlowLoader(0), &view);
+		CHECK(view != 0 && IsCached(cache, L"bad"));
+		view->Release();
+
+		cache.Clear();
+		CHECK(LiveTextures == 0);
+	}
+
+	// Threads requesting, holding and releasing textures under a small budget while one
+	// of them clears the cache and another trims it, and a few loads fail.
+	void CheckClearRacingLoads()
+	{
+		const int numThreads = 8;
+		const size_t budget = 64*TextureBytes;
+		std::atomic<int> thrown(0), caught(0), badViews(0);
+		{
+			TextureCache cache(budget);
+			std::vector<std::thread> threads;
+			for(int t = 0; t < numThreads; ++t)
+			{
+				threads.push_back(std::thread([&, t]()
+				{
+					uint32_t x = 7919*t + 1;
+					std::vector<ID3D11ShaderResourceView*> held;
+					for(int i = 0; i < 4000; ++i)
+					{
+						x = x*1664525 + 1013904223;
+						std::wstring name = L"Textures\\t" + std::to_wstring((x >> 8) % 300) + L".dds";
+						bool fail = (x >> 20) % 64 == 0;
+
+						try
+						{
+							ID3D11ShaderResourceView* view = 0;
+							cache.GetOrLoad(name.c_str(), [&](const wchar_t* n, ID3D11ShaderResourceView** v)
+							{
+								if( fail )
+								{
+									++thrown;
+									throw std::runtime_error("bad texture");
+								}
+								SlowLoader(i % 16 == 0 ? 50 : 0)(n, v);
+							}, &view);
+
+							// The view and its texture are still alive.
+							if( !view || TextureCache::GetTextureBytes(view) != TextureBytes )
+								++badViews;
+							held.push_back(view);
+						}
+						catch(const std::runtime_error&)
+						{
+							++caught;
+						}
+
+						if( held.size() > 8 )
+						{
+							held.front()->Release();
+							held.erase(held.begin());
+						}
+						if( t == 0 && i % 500 == 0 )
+							cache.Clear();
+						if( t == 1 && i % 300 == 0 )
+							cache.Trim(budget / 2);
+					}
+					for(size_t k = 0; k < held.size(); ++k)
+						held[k]->Release();
+				}));
+			}
+			for(size_t t = 0; t < threads.size(); ++t)
+				threads[t].join();
+
+			TextureCache::Stats stats = cache.GetStats();
+			CHECK(stats.bytes == stats.textures*TextureBytes);
+
+			// A load that went over the budget skips eviction if another thread is
+			// already evicting, so only a trim brings it back under.
+			CHECK(cache.Trim(budget) <= budget);
+			CHECK(cache.GetStats().textures == (size_t)LiveTextures);
+
+			cache.Clear();
+			CHECK(cache.GetStats().bytes == 0);
+		}
+
+		// Waiters rethrow too, so there are at least as many errors as failed loads.
+		CHECK(thrown > 0 && caught >= thrown && badViews == 0);
+		CHECK(LiveTextures == 0);
+	}
+
+	// The factories' scheme before TextureCache, with its lookup locked: one map under one
+	// mutex, loading with the lock released, so threads missing together all load.
+	class MapCache
+	{
+	public:
+		~MapCache()
+		{
+			for(std::map<std::wstring, ID3D11ShaderResourceView*>::iterator it = mMap.begin(); it != mMap.end(); ++it)
+				it->second->Release();
+		}
+
+		void GetOrLoad(const wchar_t* name, const TextureCache::Loader& loader, ID3D11ShaderResourceView** view)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				std::map<std::wstring, ID3D11ShaderResourceView*>::iterator it = mMap.find(name);
+				if( it != mMap.end() )
+				{
+					*view = it->second;
+					(*view)->AddRef();
+					return;
+				}
+			}
+
+			loader(name, view);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			if( mMap.insert(std::make_pair(std::wstring(name), *view)).second )
+				(*view)->AddRef();
+		}
+
+	private:
+		std::mutex mMutex;
+		std::map<std::wstring, ID3D11ShaderResourceView*> mMap;
+	};
+
+	// Each thread requests from a window of 256 of 1024 names, shifted by 32 per thread,
+	// so neighbouring threads share 7/8 of their textures.  Warm, every request hits;
+	// cold, each thread asks for its window once and every load takes 200 us.  Only
+	// TextureCache promises a single load per texture.
+	template<typename Cache>
+	void Benchmark(const char* name, const std::vector<std::wstring>& names, int numThreads, bool cold, bool loadsOnce)
+	{
+		const int window = 256;
+		const int requests = cold ? window : 20000;
+		TextureCache::Loader loader = SlowLoader(cold ? 200 : 0);
+
+		Cache cache;
+		if( !cold )
+		{
+			for(size_t i = 0; i < names.size(); ++i)
+			{
+				ID3D11ShaderResourceView* view = 0;
+				cache.GetOrLoad(names[i].c_str(), loader, &view);
+				view->Release();
+			}
+		}
+		Loads = 0;
+
+		double t0 = TestSeconds();
+		std::vector<std::thread> threads;
+		for(int t = 0; t < numThreads; ++t)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				uint32_t x = 12345 + t;
+				for(int i = 0; i < requests; ++i)
+				{
+					x = x*1664525 + 1013904223;
+					size_t k = (t*32 + (cold ? i : (int)((x >> 8) % window))) % names.size();
+					ID3D11ShaderResourceView* view = 0;
+					cache.GetOrLoad(names[k].c_str(), loader, &view);
+					view->Release();
+				}
+			}));
+		}
+		for(size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+		double seconds = TestSeconds() - t0;
+
+		if( cold )
+		{
+			size_t distinct = std::min(names.size(), (size_t)(window + 32*(numThreads - 1)));
+			printf("%-12s %2d threads, cold: %5ld loads for %4zu textures, %7.1f ms\n",
+				name, numThreads, (long)Loads, distinct, seconds*1000.0);
+			if( loadsOnce )
+				CHECK(Loads == (long)distinct);
+		}
+		else
+		{
+			printf("%-12s %2d threads, warm: %6.2f M requests/s\n",
+				name, numThreads, numThreads*(double)requests/seconds*1e-6);
+		}
+	}
+}
+
+int main()
+{
+	CheckTextureBytes();
+	CheckSingleThread();
+	CheckConcurrentLoads();
+	CheckClearRacingLoads();
+
+	std::vector<std::wstring> names;
+	for(int i = 0; i < 1024; ++i)
+		names.push_back(L"Textures\\Level" + std::to_wstring(i % 7) + L"\\texture_" + std::to_wstring(i) + L".dds");
+
+	const int threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+	for(int cold = 0; cold < 2; ++cold)
+	{
+		for(size_t t = 0; t < sizeof(threadCounts)/sizeof(threadCounts[0]); ++t)
+		{
+			Benchmark<TextureCache>("TextureCache", names, threadCounts[t], cold != 0, true);
+			Benchmark<MapCache>("map + mutex", names, threadCounts[t], cold != 0, false);
+		}
+	}
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	CHECK(LiveTextures == 0);
+
+	return TestResult("TextureCacheTest");
+}
@@ -0,0 +1,148 @@
+//***************************************************************************************
+// ThreadPoolTest.cpp
+//
+// Checks that ParallelFor covers every index once, runs nested loops inline, and
+// recovers from a loop body that throws on the calling thread or on a worker: the
+// exception reaches the caller only after every running chunk has finished, and later
+// loops are still shared out among the workers.
+//***************************************************************************************
+
+#include "ThreadPool.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const UINT Count = 4096;
+	const UINT Grain = 16;
+
+	// Runs one loop over Count items and returns how many distinct threads took part.
+	size_t ThreadsUsed(ThreadPool& pool, std::vector<int>& visits)
+	{
+		std::mutex mutex;
+		std::set<std::thread::id> threads;
+
+		visits.assign(Count, 0);
+		pool.ParallelFor(Count, Grain, [&](UINT begin, UINT end)
+		{
+			for(UINT i = begin; i < end; ++i)
+				++visits[i];
+
+			// Long enough that every worker wakes up for a share.
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+			std::lock_guard<std::mutex> lock(mutex);
+			threads.insert(std::this_thread::get_id());
+		});
+		return threads.size();
+	}
+
+	bool EachVisitedOnce(const std::vector<int>& visits)
+	{
+		for(size_t i = 0; i < visits.size(); ++i)
+		{
+			if( visits[i] != 1 )
+				return false;
+		}
+		return true;
+	}
+
+	// Throws from the chunk starting at throwAt, on whichever thread runs it, and
+	// checks the loop waited for every other chunk that was started.
+	void CheckThrow(ThreadPool& pool, UINT throwAt, bool onCaller)
+	{
+		std::thread::id caller = std::this_thread::get_id();
+		std::atomic<int> running(0);
+		std::atomic<int> finished(0);
+		std::atomic<bool> thrown(false);
+
+		bool caught = false;
+		try
+		{
+			pool.ParallelFor(Count, Grain, [&](UINT begin, UINT)
+			{
+				++running;
+				bool here = (std::this_thread::get_id() == caller) == onCaller;
+				if( begin >= throwAt && here && !thrown.exchange(true) )
+				{
+					--running;
+					throw std::runtime_error("chunk failed");
+				}
+
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				++finished;
+				--running;
+			});
+		}
+		catch( const std::runtime_error& )
+		{
+			caught = true;
+		}
+
+		CHECK(caught == thrown.load());
+		CHECK(running == 0);
+		CHECK(finished < (int)(Count/Grain));
+	}
+}
+
+int main()
+{
+	ThreadPool pool;
+	pool.Init(4);
+	CHECK(pool.ThreadCount() == 5);
+
+	std::vector<int> visits;
+	size_t threads = ThreadsUsed(pool, visits);
+	printf("%zu threads took part in the loop\n", threads);
+	CHECK(EachVisitedOnce(visits));
+	CHECK(threads > 1);
+
+	// Nested loops run inline on the thread that makes them.
+	{
+		std::atomic<int> mismatches(0);
+		pool.ParallelFor(64, 1, [&](UINT, UINT)
+		{
+			std::thread::id outer = std::this_thread::get_id();
+			pool.ParallelFor(64, 1, [&](UINT, UINT)
+			{
+				if( std::this_thread::get_id() != outer )
+					++mismatches;
+			});
+		});
+		CHECK(mismatches == 0);
+	}
+
+	// A throw on the calling thread, then on a worker.  Both times the next loop still
+	// runs on more than one thread and covers everything.
+	CheckThrow(pool, 0, true);
+	threads = ThreadsUsed(pool, visits);
+	CHECK(EachVisitedOnce(visits));
+	CHECK(threads > 1);
+
+	CheckThrow(pool, Count/2, false);
+	threads = ThreadsUsed(pool, visits);
+	CHECK(EachVisitedOnce(visits));
+	CHECK(threads > 1);
+
+	// A loop too small to share out throws straight through.
+	bool caught = false;
+	try
+	{
+		pool.ParallelFor(1, 1, [](UINT, UINT) { throw std::runtime_error("inline"); });
+	}
+	catch( const std::runtime_error& )
+	{
+		caught = true;
+	}
+	CHECK(caught);
+
+	pool.Shutdown();
+	return TestResult("ThreadPoolTest");
+}
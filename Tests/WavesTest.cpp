@@ -0,0 +1,265 @@
+//***************************************************************************************
+// WavesTest.cpp
+//
+// Waves must give the same heights, normals and tangents as the original scalar
+// solver, which kept every grid point as an XMFLOAT3 and stepped the rows one by one,
+// bit for bit.  Grids are sized so the row bands the solver hands out end at every
+// position, including a last band of one and two rows, and are stepped on pools of
+// several sizes.  Also prints cell updates per second at 256^2, 1024^2 and 4096^2.
+//***************************************************************************************
+
+#include "Waves.h"
+#include "ThreadPool.h"
+#include "TestUtil.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+using namespace DirectX;
+
+namespace
+{
+	const float SpatialStep = 0.8f;
+	const float TimeStep    = 0.03f;
+	const float Speed       = 3.25f;
+	const float Damping     = 0.4f;
+
+	// Waves::Init and Waves::Update before the rewrite, with the static timer made a
+	// member so several instances can run side by side.
+	class ReferenceWaves
+	{
+	public:
+		void Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
+		{
+			mNumRows = m;
+			mNumCols = n;
+			mTimeStep    = dt;
+			mSpatialStep = dx;
+			mTime = 0.0f;
+
+			float d = damping*dt+2.0f;
+			float e = (speed*speed)*(dt*dt)/(dx*dx);
+			mK1     = (damping*dt-2.0f)/ d;
+			mK2     = (4.0f-8.0f*e) / d;
+			mK3     = (2.0f*e) / d;
+
+			mPrevSolution.resize(m*n);
+			mCurrSolution.resize(m*n);
+			mNormals.resize(m*n);
+			mTangentX.resize(m*n);
+
+			float halfWidth = (n-1)*dx*0.5f;
+			float halfDepth = (m-1)*dx*0.5f;
+			for(UINT i = 0; i < m; ++i)
+			{
+				float z = halfDepth - i*dx;
+				for(UINT j = 0; j < n; ++j)
+				{
+					float x = -halfWidth + j*dx;
+
+					mPrevSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
+					mCurrSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
+					mNormals[i*n+j]      = XMFLOAT3(0.0f, 1.0f, 0.0f);
+					mTangentX[i*n+j]     = XMFLOAT3(1.0f, 0.0f, 0.0f);
+				}
+			}
+		}
+
+		void Update(float dt)
+		{
+			mTime += dt;
+
+			if( mTime >= mTimeStep )
+			{
+				for(UINT i = 1; i < mNumRows-1; ++i)
+				{
+					for(UINT j = 1; j < mNumCols-1; ++j)
+					{
+						mPrevSolution[i*mNumCols+j].y =
+							mK1*mPrevSolution[i*mNumCols+j].y +
+							mK2*mCurrSolution[i*mNumCols+j].y +
+							mK3*(mCurrSolution[(i+1)*mNumCols+j].y +
+							     mCurrSolution[(i-1)*mNumCols+j].y +
+							     mCurrSolution[i*mNumCols+j+1].y +
+							     mCurrSolution[i*mNumCols+j-1].y);
+					}
+				}
+
+				mPrevSolution.swap(mCurrSolution);
+				mTime = 0.0f;
+
+				for(UINT i = 1; i < mNumRows-1; ++i)
+				{
+					for(UINT j = 1; j < mNumCols-1; ++j)
+					{
+						float l = mCurrSolution[i*mNumCols+j-1].y;
+						float r = mCurrSolution[i*mNumCols+j+1].y;
+						float t = mCurrSolution[(i-1)*mNumCols+j].y;
+						float b = mCurrSolution[(i+1)*mNumCols+j].y;
+						mNormals[i*mNumCols+j].x = -r+l;
+						mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
+						mNormals[i*mNumCols+j].z = b-t;
+
+						XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
+						XMStoreFloat3(&mNormals[i*mNumCols+j], n);
+
+						mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
+						XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
+						XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+					}
+				}
+			}
+		}
+
+		void Disturb(UINT i, UINT j, float magnitude)
+		{
+			float halfMag = 0.5f*magnitude;
+
+			mCurrSolution[i*mNumCols+j].y     += magnitude;
+			mCurrSolution[i*mNumCols+j+1].y   += halfMag;
+			mCurrSolution[i*mNumCols+j-1].y   += halfMag;
+			mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
+			mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+		}
+
+		const XMFLOAT3& operator[](int i)const { return mCurrSolution[i]; }
+		const XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+		const XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+
+	private:
+		UINT mNumRows;
+		UINT mNumCols;
+		float mK1;
+		float mK2;
+		float mK3;
+		float mTimeStep;
+		float mSpatialStep;
+		float mTime;
+		std::vector<XMFLOAT3> mPrevSolution;
+		std::vector<XMFLOAT3> mCurrSolution;
+		std::vector<XMFLOAT3> mNormals;
+		std::vector<XMFLOAT3> mTangentX;
+	};
+
+	// First grid point whose position, normal or tangent differs, or -1.
+	int FirstMismatch(const Waves& waves, const ReferenceWaves& ref)
+	{
+		for(UINT i = 0; i < waves.VertexCount(); ++i)
+		{
+			XMFLOAT3 p = waves[i];
+			if( memcmp(&p, &ref[i], sizeof(p)) != 0 ||
+				memcmp(&waves.Normal(i), &ref.Normal(i), sizeof(XMFLOAT3)) != 0 ||
+				memcmp(&waves.TangentX(i), &ref.TangentX(i), sizeof(XMFLOAT3)) != 0 )
+			{
+				return (int)i;
+			}
+		}
+		return -1;
+	}
+
+	void CheckGrid(UINT rows, UINT cols, ThreadPool& pool, unsigned seed)
+	{
+		Waves waves;
+		waves.Init(rows, cols, SpatialStep, TimeStep, Speed, Damping, &pool);
+		ReferenceWaves ref;
+		ref.Init(rows, cols, SpatialStep, TimeStep, Speed, Damping);
+
+		std::mt19937 rng(seed);
+		for(int step = 0; step < 60; ++step)
+		{
+			// A few drops now and then, anywhere Disturb allows; a grid with fewer than
+			// five rows or columns has nowhere.
+			if( step % 7 == 0 && rows > 4 && cols > 4 )
+			{
+				for(int k = 0; k < 3; ++k)
+				{
+					UINT i = 2 + rng() % (rows - 4);
+					UINT j = 2 + rng() % (cols - 4);
+					float magnitude = 0.1f + (rng() % 1000)*0.001f;
+					waves.Disturb(i, j, magnitude);
+					ref.Disturb(i, j, magnitude);
+				}
+			}
+
+			// Half steps accumulate to one, as with a frame rate above the time step.
+			float dt = step % 3 == 0 ? 0.5f*TimeStep : TimeStep;
+			waves.Update(dt);
+			ref.Update(dt);
+
+			int i = FirstMismatch(waves, ref);
+			if( i >= 0 )
+			{
+				printf("  %u x %u grid on %u threads, step %d: point (%u, %u) height %.9g normal (%.9g %.9g %.9g), original gives %.9g (%.9g %.9g %.9g)\n",
+					rows, cols, pool.ThreadCount(), step, i / cols, i % cols,
+					waves.Height(i), waves.Normal(i).x, waves.Normal(i).y, waves.Normal(i).z,
+					ref[i].y, ref.Normal(i).x, ref.Normal(i).y, ref.Normal(i).z);
+				CHECK(i < 0);
+				return;
+			}
+		}
+	}
+}
+
+int main()
+{
+	// Interior rows of 2, 3, 31 to 34, 64, 65 and 97: one band, a full band, a
+	// last band of one and two rows, and several bands.  Column counts leave every
+	// remainder after the four-wide loop.
+	const UINT grids[][2] =
+	{
+		{ 4, 4 }, { 5, 9 }, { 33, 6 }, { 34, 7 }, { 35, 8 }, { 36, 13 },
+		{ 66, 37 }, { 67, 40 }, { 99, 101 },
+	};
+	const UINT workers[] = { 0, 1, 3, 6 };
+
+	for(size_t w = 0; w < sizeof(workers)/sizeof(workers[0]); ++w)
+	{
+		// A pool with no workers runs every band on the calling thread.
+		ThreadPool pool;
+		if( workers[w] > 0 )
+			pool.Init(workers[w]);
+
+		for(size_t g = 0; g < sizeof(grids)/sizeof(grids[0]); ++g)
+			CheckGrid(grids[g][0], grids[g][1], pool, (unsigned)(g*13 + w));
+
+		pool.Shutdown();
+	}
+
+	// Throughput: steps of the whole grid after a disturbance, against the original.
+	const UINT sizes[] = { 256, 1024, 4096 };
+	for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+	{
+		UINT n = sizes[s];
+		int steps = n >= 4096 ? 3 : (n >= 1024 ? 20 : 200);
+		double cells = (double)(n-2)*(n-2)*steps;
+
+		double solver = 0.0;
+		{
+			Waves waves;
+			waves.Init(n, n, SpatialStep, TimeStep, Speed, Damping);
+			waves.Disturb(n/2, n/2, 1.0f);
+
+			double t0 = TestSeconds();
+			for(int step = 0; step < steps; ++step)
+				waves.Update(TimeStep);
+			solver = TestSeconds() - t0;
+		}
+
+		double original = 0.0;
+		{
+			ReferenceWaves ref;
+			ref.Init(n, n, SpatialStep, TimeStep, Speed, Damping);
+			ref.Disturb(n/2, n/2, 1.0f);
+
+			double t0 = TestSeconds();
+			for(int step = 0; step < steps; ++step)
+				ref.Update(TimeStep);
+			original = TestSeconds() - t0;
+		}
+
+		printf("%4u x %-4u Waves %7.1f M cell updates/s, original %7.1f M cell updates/s (%u threads)\n",
+			n, n, cells/solver*1e-6, cells/original*1e-6, ThreadPool::Default().ThreadCount());
+	}
+
+	return TestResult("WavesTest");
+}